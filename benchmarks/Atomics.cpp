@@ -0,0 +1,170 @@
+/*
+ * Copyright (c) 2020 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "remill/Arch/Runtime/Intrinsics.h"
+#include "remill/Memory/PagedMemory.h"
+
+DEFINE_uint64(max_threads, 0,
+              "Maximum number of threads to run. By default, one thread per "
+              "hardware thread is used.");
+
+DEFINE_uint64(atomic_iterations, 1000000,
+              "Number of atomic operations performed by each thread.");
+
+namespace {
+
+static constexpr addr_t kDataAddress = 0x10000;
+
+// Each thread's private counter is on its own cache line.
+static constexpr addr_t kPrivateStride = 64;
+
+using AtomicOp = void (*)(Memory *memory, addr_t addr, uint64_t iterations);
+
+static void FetchAndAdd64(Memory *memory, addr_t addr, uint64_t iterations) {
+  for (uint64_t i = 0; i < iterations; ++i) {
+    uint64_t val = 1;
+    memory = __remill_fetch_and_add_64(memory, addr, val);
+  }
+}
+
+// Increment using a compare and exchange loop, like a lifted `LOCK CMPXCHG`
+// retry loop would.
+static void CompareExchange64(Memory *memory, addr_t addr,
+                              uint64_t iterations) {
+  for (uint64_t i = 0; i < iterations; ++i) {
+    uint64_t expected = 0;
+    for (;;) {
+      const auto old = expected;
+      memory = __remill_compare_exchange_memory_64(memory, addr, expected,
+                                                   old + 1);
+      if (expected == old) {
+        break;
+      }
+    }
+  }
+}
+
+static void CompareExchange128(Memory *memory, addr_t addr,
+                               uint64_t iterations) {
+  for (uint64_t i = 0; i < iterations; ++i) {
+    uint128_t expected = 0;
+    for (;;) {
+      const auto old = expected;
+      uint128_t desired = old + 1;
+      memory = __remill_compare_exchange_memory_128(memory, addr, expected,
+                                                    desired);
+      if (expected == old) {
+        break;
+      }
+    }
+  }
+}
+
+// Misaligned accesses fall back to the striped locks.
+static void MisalignedFetchAndAdd32(Memory *memory, addr_t addr,
+                                    uint64_t iterations) {
+  for (uint64_t i = 0; i < iterations; ++i) {
+    uint32_t val = 1;
+    memory = __remill_fetch_and_add_32(memory, addr + 1, val);
+  }
+}
+
+struct Benchmark {
+  const char *name;
+  AtomicOp op;
+};
+
+static const Benchmark kBenchmarks[] = {
+    {"fetch_and_add_64", FetchAndAdd64},
+    {"compare_exchange_64", CompareExchange64},
+    {"compare_exchange_128", CompareExchange128},
+    {"misaligned_fetch_and_add_32", MisalignedFetchAndAdd32},
+};
+
+// Run `op` on `num_threads` threads, each with its own view of `memory`, and
+// return the total number of operations per second. If `shared` is true, then
+// every thread operates on the same address.
+static double Run(remill::PagedMemory &memory, AtomicOp op,
+                  uint64_t num_threads, bool shared) {
+  std::vector<std::unique_ptr<remill::PagedMemory>> views;
+  for (uint64_t i = 0; i < num_threads; ++i) {
+    views.emplace_back(new remill::PagedMemory(memory));
+  }
+
+  std::atomic<uint64_t> num_ready(0);
+  std::vector<std::thread> threads;
+  const auto start = std::chrono::steady_clock::now();
+  for (uint64_t i = 0; i < num_threads; ++i) {
+    threads.emplace_back([&, i](void) {
+      const auto addr =
+          kDataAddress + (shared ? 0 : static_cast<addr_t>(i * kPrivateStride));
+      num_ready.fetch_add(1);
+      while (num_ready.load() < num_threads) {
+      }
+      op(views[i]->AsMemory(), addr, FLAGS_atomic_iterations);
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  const std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+
+  return static_cast<double>(num_threads * FLAGS_atomic_iterations) /
+         std::max(elapsed.count(), 1e-9);
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  google::InitGoogleLogging(argv[0]);
+
+  auto max_threads = FLAGS_max_threads;
+  if (!max_threads) {
+    max_threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+
+  remill::PagedMemory memory;
+  memory.Map(kDataAddress, max_threads * kPrivateStride + 16,
+             remill::PagedMemory::kReadWrite);
+
+  std::cout << "operation,threads,sharing,ops_per_second" << std::endl;
+  for (const auto &bench : kBenchmarks) {
+    for (uint64_t num_threads = 1; num_threads <= max_threads;
+         num_threads *= 2) {
+      for (auto shared : {true, false}) {
+        const auto ops = Run(memory, bench.op, num_threads, shared);
+        std::cout << bench.name << ',' << num_threads << ','
+                  << (shared ? "shared" : "private") << ','
+                  << static_cast<uint64_t>(ops) << std::endl;
+      }
+    }
+  }
+
+  return EXIT_SUCCESS;
+}
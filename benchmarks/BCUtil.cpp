@@ -0,0 +1,355 @@
+/*
+ * Copyright (c) 2020 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <llvm/IR/BasicBlock.h>
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/DataLayout.h>
+#include <llvm/IR/DerivedTypes.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "remill/Arch/Arch.h"
+#include "remill/Arch/Name.h"
+#include "remill/BC/ABI.h"
+#include "remill/BC/Compat/VectorType.h"
+#include "remill/BC/DeadStoreEliminator.h"
+#include "remill/BC/IntrinsicTable.h"
+#include "remill/BC/Util.h"
+#include "remill/OS/OS.h"
+
+DECLARE_string(arch);
+DECLARE_string(os);
+
+DEFINE_string(sizes, "16,64,256,1024",
+              "Comma-separated list of the sizes of the synthetic inputs of "
+              "each benchmark, e.g. the number of functions to move, or the "
+              "number of stores in each function.");
+
+DEFINE_string(benchmarks, "",
+              "Comma-separated list of benchmarks to run, e.g. "
+              "`clone_function,remove_dead_stores`. By default, all of them "
+              "are run.");
+
+DEFINE_uint64(iterations, 3, "Number of times to run each benchmark.");
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// Number of distinct `State` offsets that the synthetic lifted functions
+// store into, so that most of their stores are overwritten, and dead.
+static constexpr uint64_t kNumStoreOffsets = 32;
+
+// Number of lifted functions in the modules of `remove_dead_stores`.
+static constexpr uint64_t kNumDeadStoreFuncs = 16;
+
+// Number of stores in each of the functions moved by `move_function`.
+static constexpr uint64_t kMovedFuncSize = 16;
+
+// Returns the time taken to run `func`.
+template <typename F>
+static double Time(F func) {
+  const auto start = Clock::now();
+  func();
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+static std::unique_ptr<const remill::Arch>
+BuildArch(llvm::LLVMContext &context) {
+  auto arch = remill::Arch::Build(&context, remill::GetOSName(FLAGS_os),
+                                  remill::GetArchName(FLAGS_arch));
+  CHECK(arch != nullptr) << "Unsupported architecture " << FLAGS_arch;
+  return arch;
+}
+
+// Define the lifted function `name` in `module`, which stores a value derived
+// from the program counter into the `State` structure `size` times, cycling
+// through `kNumStoreOffsets` offsets.
+static llvm::Function *DefineLiftedFunction(const remill::Arch *arch,
+                                            llvm::Module *module,
+                                            const std::string &name,
+                                            uint64_t size) {
+  auto &context = module->getContext();
+  const llvm::DataLayout dl(module);
+  const auto state_size = dl.getTypeAllocSize(arch->StateStructType());
+  const auto num_offsets = std::max<uint64_t>(
+      1u, std::min<uint64_t>(kNumStoreOffsets, state_size / 8u));
+
+  auto func = remill::DeclareLiftedFunction(module, name);
+  remill::CloneBlockFunctionInto(func);
+  auto block = &(func->front());
+  llvm::IRBuilder<> ir(block);
+
+  const auto word_type = llvm::Type::getInt64Ty(context);
+  const auto word_ptr_type = llvm::PointerType::get(word_type, 0);
+  const auto state_ptr = remill::NthArgument(func, remill::kStatePointerArgNum);
+  const auto pc = ir.CreateZExtOrTrunc(
+      remill::NthArgument(func, remill::kPCArgNum), word_type);
+
+  for (uint64_t i = 0; i < size; ++i) {
+    const auto ptr = remill::BuildPointerToOffset(
+        ir, state_ptr, (i % num_offsets) * 8u, word_ptr_type);
+    ir.CreateStore(ir.CreateAdd(pc, llvm::ConstantInt::get(word_type, i)),
+                   ptr);
+  }
+  ir.CreateRet(remill::LoadMemoryPointer(block));
+  return func;
+}
+
+// Returns a structure type with `size` fields, cycling through the kinds of
+// fields found in `State` and in the types of lifted memory accesses.
+static llvm::StructType *SyntheticStructType(llvm::LLVMContext &context,
+                                             uint64_t size) {
+  const auto i8_type = llvm::Type::getInt8Ty(context);
+  const auto i32_type = llvm::Type::getInt32Ty(context);
+  const auto i64_type = llvm::Type::getInt64Ty(context);
+  const auto float_type = llvm::Type::getFloatTy(context);
+  const auto double_type = llvm::Type::getDoubleTy(context);
+  const auto inner_type = llvm::StructType::create(
+      context, {i8_type, llvm::ArrayType::get(i32_type, 4), double_type},
+      "struct.SyntheticInner");
+
+  llvm::Type *const kinds[] = {
+      i8_type,
+      llvm::Type::getInt16Ty(context),
+      i32_type,
+      i64_type,
+      float_type,
+      double_type,
+      llvm::ArrayType::get(i8_type, 16),
+      llvm::FixedVectorType::get(i32_type, 4),
+      inner_type,
+  };
+
+  std::vector<llvm::Type *> fields;
+  for (uint64_t i = 0; i < size; ++i) {
+    fields.push_back(kinds[i % std::size(kinds)]);
+  }
+  return llvm::StructType::create(context, fields, "struct.Synthetic");
+}
+
+// Clone a lifted function with `size` stores, `FLAGS_iterations` times.
+static double BenchCloneFunction(uint64_t size) {
+  llvm::LLVMContext context;
+  const auto arch = BuildArch(context);
+  auto module = remill::LoadArchSemantics(arch.get());
+  const auto source = DefineLiftedFunction(arch.get(), module.get(),
+                                           "sub_source", size);
+
+  double seconds = 0;
+  for (uint64_t i = 0; i < FLAGS_iterations; ++i) {
+    auto dest = remill::DeclareLiftedFunction(module.get(), "sub_dest");
+    seconds += Time([=](void) { remill::CloneFunctionInto(source, dest); });
+    dest->eraseFromParent();
+  }
+  return seconds;
+}
+
+// Move `size` lifted functions, one at a time, from the semantics module into
+// another module, like when the trace lifter moves each trace into its own
+// module.
+static double BenchMoveFunction(uint64_t size) {
+  double seconds = 0;
+  for (uint64_t i = 0; i < FLAGS_iterations; ++i) {
+    llvm::LLVMContext context;
+    const auto arch = BuildArch(context);
+    auto source_module = remill::LoadArchSemantics(arch.get());
+    std::vector<llvm::Function *> funcs;
+    for (uint64_t j = 0; j < size; ++j) {
+      funcs.push_back(DefineLiftedFunction(arch.get(), source_module.get(),
+                                           "sub_" + std::to_string(j),
+                                           kMovedFuncSize));
+    }
+
+    llvm::Module dest_module("moved", context);
+    dest_module.setDataLayout(source_module->getDataLayout());
+    dest_module.setTargetTriple(source_module->getTargetTriple());
+
+    seconds += Time([&](void) {
+      for (auto func : funcs) {
+        remill::MoveFunctionIntoModule(func, &dest_module);
+      }
+    });
+  }
+  return seconds;
+}
+
+// Recontextualize a structure with `size` fields into a fresh context.
+static double BenchRecontextualizeType(uint64_t size) {
+  llvm::LLVMContext source_context;
+  const auto type = SyntheticStructType(source_context, size);
+
+  double seconds = 0;
+  for (uint64_t i = 0; i < FLAGS_iterations; ++i) {
+    llvm::LLVMContext dest_context;
+    seconds += Time([&](void) {
+      (void) remill::RecontextualizeType(type, dest_context);
+    });
+  }
+  return seconds;
+}
+
+// Load or store a synthetic structure `size` times in one block.
+static double BenchMemoryAccess(uint64_t size, bool is_store) {
+  llvm::LLVMContext context;
+  const auto arch = BuildArch(context);
+  auto module = remill::LoadArchSemantics(arch.get());
+  const remill::IntrinsicTable intrinsics(module.get());
+  const auto type = SyntheticStructType(context, 16);
+  const auto val = llvm::Constant::getNullValue(type);
+
+  double seconds = 0;
+  for (uint64_t i = 0; i < FLAGS_iterations; ++i) {
+    auto func = remill::DeclareLiftedFunction(module.get(), "sub_access");
+    remill::CloneBlockFunctionInto(func);
+    auto block = &(func->front());
+    llvm::Value *mem_ptr = remill::LoadMemoryPointer(block);
+    const auto addr = remill::NthArgument(func, remill::kPCArgNum);
+
+    seconds += Time([&](void) {
+      for (uint64_t j = 0; j < size; ++j) {
+        if (is_store) {
+          mem_ptr =
+              remill::StoreToMemory(intrinsics, block, val, mem_ptr, addr);
+        } else {
+          (void) remill::LoadFromMemory(intrinsics, block, type, mem_ptr,
+                                        addr);
+        }
+      }
+    });
+    func->eraseFromParent();
+  }
+  return seconds;
+}
+
+static double BenchLoadFromMemory(uint64_t size) {
+  return BenchMemoryAccess(size, false);
+}
+
+static double BenchStoreToMemory(uint64_t size) {
+  return BenchMemoryAccess(size, true);
+}
+
+// Compute the `State` slots of the semantics `size` times. The cost of this
+// only depends on the `State` structure of the architecture.
+static double BenchStateSlots(uint64_t size) {
+  llvm::LLVMContext context;
+  const auto arch = BuildArch(context);
+  auto module = remill::LoadArchSemantics(arch.get());
+
+  double seconds = 0;
+  for (uint64_t i = 0; i < FLAGS_iterations; ++i) {
+    seconds += Time([&](void) {
+      for (uint64_t j = 0; j < size; ++j) {
+        (void) remill::StateSlots(arch.get(), module.get());
+      }
+    });
+  }
+  return seconds;
+}
+
+// Remove the dead stores of `kNumDeadStoreFuncs` lifted functions, each with
+// `size` stores, all but `kNumStoreOffsets` of which are dead.
+static double BenchRemoveDeadStores(uint64_t size) {
+  double seconds = 0;
+  for (uint64_t i = 0; i < FLAGS_iterations; ++i) {
+    llvm::LLVMContext context;
+    const auto arch = BuildArch(context);
+    auto module = remill::LoadArchSemantics(arch.get());
+    for (uint64_t j = 0; j < kNumDeadStoreFuncs; ++j) {
+      (void) DefineLiftedFunction(arch.get(), module.get(),
+                                  "sub_" + std::to_string(j), size);
+    }
+    const auto bb_func = remill::BasicBlockFunction(module.get());
+    const auto slots = remill::StateSlots(arch.get(), module.get());
+    seconds += Time([&](void) {
+      remill::RemoveDeadStores(arch.get(), module.get(), bb_func, slots);
+    });
+  }
+  return seconds;
+}
+
+struct Benchmark {
+  const char *name;
+  double (*run)(uint64_t size);
+};
+
+static const Benchmark kBenchmarks[] = {
+    {"clone_function", BenchCloneFunction},
+    {"move_function", BenchMoveFunction},
+    {"recontextualize_type", BenchRecontextualizeType},
+    {"load_from_memory", BenchLoadFromMemory},
+    {"store_to_memory", BenchStoreToMemory},
+    {"state_slots", BenchStateSlots},
+    {"remove_dead_stores", BenchRemoveDeadStores},
+};
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  google::InitGoogleLogging(argv[0]);
+
+  std::vector<uint64_t> sizes;
+  std::stringstream sizes_ss(FLAGS_sizes);
+  for (std::string size; std::getline(sizes_ss, size, ',');) {
+    sizes.push_back(std::stoull(size));
+  }
+  CHECK(!sizes.empty()) << "--sizes must not be empty";
+  CHECK(FLAGS_iterations) << "--iterations must be positive";
+
+  const auto selected = ',' + FLAGS_benchmarks + ',';
+
+  // The time per element of each size shows how each entry point scales: it
+  // stays flat for linear entry points, and grows with quadratic ones.
+  std::cout << "benchmark,arch,size,iterations,seconds,ns_per_element"
+            << std::endl;
+  for (const auto &bench : kBenchmarks) {
+    if (!FLAGS_benchmarks.empty() &&
+        selected.find(',' + std::string(bench.name) + ',') ==
+            std::string::npos) {
+      continue;
+    }
+    for (auto size : sizes) {
+      const auto seconds = bench.run(size);
+      const auto num_elems = std::max<uint64_t>(1u, size * FLAGS_iterations);
+      std::cout << bench.name << ',' << FLAGS_arch << ',' << size << ','
+                << FLAGS_iterations << ',' << std::fixed
+                << std::setprecision(6) << seconds << ','
+                << std::setprecision(1)
+                << (seconds * 1e9 / static_cast<double>(num_elems))
+                << std::endl;
+    }
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,741 @@
+/*
+ * Copyright (c) 2020 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/Analysis/CFG.h>
+#include <llvm/IR/BasicBlock.h>
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/InstIterator.h>
+#include <llvm/IR/InstrTypes.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Support/DynamicLibrary.h>
+#include <llvm/Support/Error.h>
+#include <llvm/Support/TargetSelect.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "remill/Arch/Arch.h"
+#include "remill/Arch/Instruction.h"
+#include "remill/Arch/Name.h"
+#include "remill/BC/DeadStoreEliminator.h"
+#include "remill/BC/IntrinsicTable.h"
+#include "remill/BC/Lifter.h"
+#include "remill/BC/Optimizer.h"
+#include "remill/BC/Util.h"
+#include "remill/BC/Version.h"
+#include "remill/Memory/PagedMemory.h"
+#include "remill/OS/OS.h"
+
+#if LLVM_VERSION_NUMBER >= LLVM_VERSION(11, 0)
+#  include <llvm/ExecutionEngine/Orc/ExecutionUtils.h>
+#  include <llvm/ExecutionEngine/Orc/LLJIT.h>
+#  include <llvm/ExecutionEngine/Orc/ThreadSafeModule.h>
+#endif
+
+#if defined(REMILL_BENCH_X86_TESTS)
+#  include "tests/X86/Test.h"
+#elif defined(REMILL_BENCH_AARCH64_TESTS)
+#  include "tests/AArch64/Test.h"
+#endif
+
+DEFINE_string(corpora, "",
+              "Comma-separated list of corpora to benchmark. By default, "
+              "all corpora are benchmarked.");
+
+DEFINE_uint64(repeat, 1000,
+              "Number of times to repeat the body of each built-in corpus.");
+
+DEFINE_uint64(decode_iterations, 100,
+              "Number of times to decode each corpus.");
+
+DEFINE_uint64(lift_iterations, 20, "Number of times to lift each corpus.");
+
+DEFINE_uint64(optimize_iterations, 2,
+              "Number of times to optimize and remove dead stores from the "
+              "lifted traces of each corpus.");
+
+DEFINE_bool(compare_guides, false,
+            "Instead of benchmarking each phase, optimize the lifted traces "
+            "of each corpus with every combination of --guide_presets and "
+            "the slp_vectorize, loop_vectorize, and eliminate_dead_stores "
+            "options, and report the time taken to optimize them, their "
+            "size, and the time taken to run them.");
+
+DEFINE_string(guide_presets, "legacy,fast,balanced,max",
+              "Comma-separated list of the optimization presets compared by "
+              "--compare_guides.");
+
+DEFINE_uint64(execute_iterations, 100,
+              "Number of times that --compare_guides runs each optimized "
+              "trace of the corpora of 64-bit architectures.");
+
+DECLARE_string(os);
+
+namespace {
+
+// A contiguous range of executable bytes.
+struct Segment {
+  uint64_t address;
+  std::string bytes;
+};
+
+// A named set of instructions to lift for a specific architecture.
+struct Corpus {
+  std::string name;
+  std::string arch_name;
+  std::vector<Segment> segments;
+  std::vector<uint64_t> entries;
+};
+
+// The body of a built-in corpus is a straight-line sequence of common data
+// movement, arithmetic, and memory instructions, which is repeated
+// `--repeat` times and followed by `tail` (a return).
+struct BuiltinCorpus {
+  const char *name;
+  const char *arch_name;
+  std::string_view body;
+  std::string_view tail;
+};
+
+static const BuiltinCorpus kBuiltinCorpora[] = {
+
+    // mov eax, 1; add eax, ecx; sub edx, 4; mov ebx, [ecx];
+    // mov [ecx+4], ebx; cmp eax, ecx; lea esi, [eax+ecx*2+8]; ret
+    {"x86", "x86",
+     {"\xb8\x01\x00\x00\x00\x01\xc8\x83\xea\x04\x8b\x19\x89\x59\x04\x39\xc8"
+      "\x8d\x74\x48\x08",
+      21},
+     {"\xc3", 1}},
+
+    // Same as above, but with 64-bit memory addressing.
+    {"amd64", "amd64",
+     {"\xb8\x01\x00\x00\x00\x01\xc8\x83\xea\x04\x8b\x19\x89\x59\x04\x39\xc8"
+      "\x8d\x74\x48\x08",
+      21},
+     {"\xc3", 1}},
+
+    // mov x0, #1; add x1, x0, x2; sub x3, x1, #4; ldr x4, [x1];
+    // str x4, [x1, #8]; cmp x0, x1; ret
+    {"aarch64", "aarch64",
+     {"\x20\x00\x80\xd2\x01\x00\x02\x8b\x23\x10\x00\xd1\x24\x00\x40\xf9"
+      "\x24\x04\x00\xf9\x1f\x00\x01\xeb",
+      24},
+     {"\xc0\x03\x5f\xd6", 4}},
+
+    // mov r0, #1; add r1, r0, r2; sub r3, r1, #4; ldr r4, [r1];
+    // str r4, [r1, #4]; cmp r0, r1; bx lr
+    {"aarch32", "aarch32",
+     {"\x01\x00\xa0\xe3\x02\x10\x80\xe0\x04\x30\x41\xe2\x00\x40\x91\xe5"
+      "\x04\x40\x81\xe5\x01\x00\x50\xe1",
+      24},
+     {"\x1e\xff\x2f\xe1", 4}},
+
+    // add %o0, %o1, %o2; sub %o0, 1, %o0; ld [%o0], %o1; st %o1, [%o0+4];
+    // mov 5, %o3; cmp %o0, %o1; retl; nop
+    {"sparc32", "sparc32",
+     {"\x94\x02\x00\x09\x90\x22\x20\x01\xd2\x02\x00\x00\xd2\x22\x20\x04"
+      "\x96\x10\x20\x05\x80\xa2\x00\x09",
+      24},
+     {"\x81\xc3\xe0\x08\x01\x00\x00\x00", 8}},
+
+    // Same as above.
+    {"sparc64", "sparc64",
+     {"\x94\x02\x00\x09\x90\x22\x20\x01\xd2\x02\x00\x00\xd2\x22\x20\x04"
+      "\x96\x10\x20\x05\x80\xa2\x00\x09",
+      24},
+     {"\x81\xc3\xe0\x08\x01\x00\x00\x00", 8}},
+};
+
+static constexpr uint64_t kBuiltinCorpusAddress = 0x10000;
+
+static Corpus MakeBuiltinCorpus(const BuiltinCorpus &builtin) {
+  Corpus corpus;
+  corpus.name = builtin.name;
+  corpus.arch_name = builtin.arch_name;
+
+  std::string bytes;
+  bytes.reserve(builtin.body.size() * FLAGS_repeat + builtin.tail.size());
+  for (uint64_t i = 0; i < FLAGS_repeat; ++i) {
+    bytes.append(builtin.body.data(), builtin.body.size());
+  }
+  bytes.append(builtin.tail.data(), builtin.tail.size());
+
+  corpus.segments.push_back({kBuiltinCorpusAddress, std::move(bytes)});
+  corpus.entries.push_back(kBuiltinCorpusAddress);
+  return corpus;
+}
+
+#if defined(REMILL_BENCH_X86_TESTS) || defined(REMILL_BENCH_AARCH64_TESTS)
+
+// Make a corpus out of every test case in the arch's semantics tests, which
+// are linked into this binary.
+static Corpus MakeTestCorpus(void) {
+  Corpus corpus;
+#  if defined(REMILL_BENCH_X86_TESTS)
+  corpus.name = "amd64-tests";
+  corpus.arch_name = "amd64";
+  const auto tests_begin = &(test::__x86_test_table_begin[0]);
+  const auto tests_end = &(test::__x86_test_table_end[0]);
+#  else
+  corpus.name = "aarch64-tests";
+  corpus.arch_name = "aarch64";
+  const auto tests_begin = &(test::__aarch64_test_table_begin[0]);
+  const auto tests_end = &(test::__aarch64_test_table_end[0]);
+#  endif
+
+  for (auto test = tests_begin; test < tests_end; ++test) {
+    corpus.segments.push_back(
+        {test->test_begin,
+         std::string(reinterpret_cast<const char *>(test->test_begin),
+                     test->test_end - test->test_begin)});
+    corpus.entries.push_back(test->test_begin);
+  }
+  return corpus;
+}
+
+#endif
+
+// Keeps the memory intrinsics of `remill_paged_memory_64` in this binary, so
+// that the JIT of `--compare_guides` finds them in the process.
+extern "C" uint8_t __remill_read_memory_8(Memory *, uint64_t);
+__attribute__((used)) static void *const gKeepPagedMemoryIntrinsics =
+    reinterpret_cast<void *>(__remill_read_memory_8);
+
+// Trace manager whose memory is the segments of a corpus.
+class BenchTraceManager : public remill::TraceManager {
+ public:
+  virtual ~BenchTraceManager(void) = default;
+
+  explicit BenchTraceManager(const Corpus &corpus_) : corpus(corpus_) {}
+
+  void SetLiftedTraceDefinition(uint64_t addr,
+                                llvm::Function *lifted_func) override {
+    traces[addr] = lifted_func;
+  }
+
+  llvm::Function *GetLiftedTraceDeclaration(uint64_t addr) override {
+    auto trace_it = traces.find(addr);
+    if (trace_it != traces.end()) {
+      return trace_it->second;
+    } else {
+      return nullptr;
+    }
+  }
+
+  llvm::Function *GetLiftedTraceDefinition(uint64_t addr) override {
+    return GetLiftedTraceDeclaration(addr);
+  }
+
+  bool TryReadExecutableByte(uint64_t addr, uint8_t *byte) override {
+    std::string buffer;
+    const auto bytes = TryReadExecutableBytes(addr, 1, buffer);
+    if (bytes.empty()) {
+      return false;
+    }
+    *byte = static_cast<uint8_t>(bytes[0]);
+    return true;
+  }
+
+  std::string_view TryReadExecutableBytes(uint64_t addr, size_t size,
+                                          std::string &) override {
+    for (const auto &segment : corpus.segments) {
+      if (segment.address <= addr &&
+          addr < (segment.address + segment.bytes.size())) {
+        std::string_view bytes(segment.bytes);
+        return bytes.substr(addr - segment.address, size);
+      }
+    }
+    return {};
+  }
+
+  // Erase all lifted traces from their module. Traces can call each other,
+  // so drop all of their bodies before erasing any of them.
+  void Clear(void) {
+    for (auto [addr, func] : traces) {
+      (void) addr;
+      func->dropAllReferences();
+    }
+    for (auto [addr, func] : traces) {
+      (void) addr;
+      func->eraseFromParent();
+    }
+    traces.clear();
+  }
+
+  const Corpus &corpus;
+  std::unordered_map<uint64_t, llvm::Function *> traces;
+};
+
+using Clock = std::chrono::steady_clock;
+
+// Measurements of one phase of one corpus.
+struct PhaseResult {
+  uint64_t iterations{0};
+  uint64_t instructions{0};
+  uint64_t bytes{0};
+  double seconds{0};
+};
+
+static void Report(const Corpus &corpus, const char *phase,
+                   const PhaseResult &result) {
+  const auto seconds = std::max(result.seconds, 1e-9);
+  std::cout << corpus.name << ',' << corpus.arch_name << ',' << phase << ','
+            << result.iterations << ',' << result.instructions << ','
+            << result.bytes << ',' << std::fixed << std::setprecision(6)
+            << result.seconds << ',' << std::setprecision(0)
+            << (static_cast<double>(result.instructions) / seconds) << ','
+            << (static_cast<double>(result.bytes) / seconds) << std::endl;
+}
+
+// Linear sweep decode of each segment of `corpus`. Returns every decoded
+// instruction of the last iteration in `insts`.
+static PhaseResult BenchDecode(const remill::Arch *arch, const Corpus &corpus,
+                               std::vector<remill::Instruction> &insts) {
+  PhaseResult result;
+  const auto max_size = arch->MaxInstructionSize();
+  remill::Instruction inst;
+
+  for (uint64_t i = 0; i < FLAGS_decode_iterations; ++i) {
+    insts.clear();
+    const auto start = Clock::now();
+    for (const auto &segment : corpus.segments) {
+      std::string_view bytes(segment.bytes);
+      for (uint64_t offset = 0; offset < bytes.size();) {
+        inst.Reset();
+        const auto addr = segment.address + offset;
+        if (arch->DecodeInstruction(addr, bytes.substr(offset, max_size),
+                                    inst) &&
+            !inst.bytes.empty()) {
+          offset += inst.bytes.size();
+          result.bytes += inst.bytes.size();
+          result.instructions += 1;
+          insts.push_back(inst);
+        } else {
+          offset += 1;  // Skip over undecodable bytes.
+        }
+      }
+    }
+    result.seconds +=
+        std::chrono::duration<double>(Clock::now() - start).count();
+    result.iterations += 1;
+  }
+  return result;
+}
+
+// Lift `insts` one at a time into a single block.
+static PhaseResult BenchLift(const remill::Arch *arch, llvm::Module *module,
+                             const remill::IntrinsicTable &intrinsics,
+                             std::vector<remill::Instruction> &insts) {
+  PhaseResult result;
+  remill::InstructionLifter inst_lifter(arch, intrinsics);
+
+  for (uint64_t i = 0; i < FLAGS_lift_iterations; ++i) {
+    const auto func = remill::DeclareLiftedFunction(module, "bench_lift");
+    remill::CloneBlockFunctionInto(func);
+    const auto block = &(func->back());
+
+    const auto start = Clock::now();
+    for (auto &inst : insts) {
+      const auto status = inst_lifter.LiftIntoBlock(inst, block);
+      if (remill::kLiftedInstruction == status) {
+        result.instructions += 1;
+        result.bytes += inst.bytes.size();
+      }
+    }
+    result.seconds +=
+        std::chrono::duration<double>(Clock::now() - start).count();
+    result.iterations += 1;
+
+    func->eraseFromParent();
+  }
+  return result;
+}
+
+// Lift the traces of `corpus` into `module`, without erasing them. Returns
+// the time taken.
+static double LiftTraces(const remill::Arch *arch, llvm::Module *module,
+                         const Corpus &corpus, BenchTraceManager &manager) {
+  remill::IntrinsicTable intrinsics(module);
+  remill::InstructionLifter inst_lifter(arch, intrinsics);
+  remill::TraceLifter trace_lifter(inst_lifter, manager);
+
+  const auto start = Clock::now();
+  for (auto entry : corpus.entries) {
+    trace_lifter.Lift(entry);
+  }
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+static PhaseResult BenchTrace(const remill::Arch *arch, llvm::Module *module,
+                              const Corpus &corpus, uint64_t num_insts,
+                              uint64_t num_bytes) {
+  PhaseResult result;
+  BenchTraceManager manager(corpus);
+  for (uint64_t i = 0; i < FLAGS_lift_iterations; ++i) {
+    result.seconds += LiftTraces(arch, module, corpus, manager);
+    result.iterations += 1;
+    result.instructions += num_insts;
+    result.bytes += num_bytes;
+    manager.Clear();
+  }
+  return result;
+}
+
+// Optimize, then remove dead stores, from freshly lifted traces. Each
+// iteration uses a new semantics module, as optimization changes it.
+static void BenchOptimize(const remill::Arch *arch, const Corpus &corpus,
+                          uint64_t num_insts, uint64_t num_bytes,
+                          PhaseResult &opt_result, PhaseResult &dse_result) {
+  for (uint64_t i = 0; i < FLAGS_optimize_iterations; ++i) {
+    auto module = remill::LoadArchSemantics(arch);
+    BenchTraceManager manager(corpus);
+    (void) LiftTraces(arch, module.get(), corpus, manager);
+
+    const auto bb_func = remill::BasicBlockFunction(module.get());
+    const auto slots = remill::StateSlots(arch, module.get());
+
+    remill::OptimizationGuide guide = {};
+    auto start = Clock::now();
+    remill::OptimizeModule(arch, module.get(), manager.traces, guide);
+    opt_result.seconds +=
+        std::chrono::duration<double>(Clock::now() - start).count();
+
+    start = Clock::now();
+    remill::RemoveDeadStores(arch, module.get(), bb_func, slots);
+    dse_result.seconds +=
+        std::chrono::duration<double>(Clock::now() - start).count();
+
+    for (auto result : {&opt_result, &dse_result}) {
+      result->iterations += 1;
+      result->instructions += num_insts;
+      result->bytes += num_bytes;
+    }
+  }
+}
+
+// What came of optimizing the traces of a corpus with one guide.
+struct GuideResult {
+  double optimize_seconds{0};
+  uint64_t ir_instructions{0};
+  uint64_t executed_traces{0};
+  double execute_seconds{0};
+};
+
+// Returns `true` if `func` can be run on its own without risk of looping
+// forever, i.e. it has no loops, and doesn't call any other lifted code.
+static bool IsSelfContained(llvm::Function *func) {
+  llvm::SmallVector<
+      std::pair<const llvm::BasicBlock *, const llvm::BasicBlock *>, 4>
+      back_edges;
+  llvm::FindFunctionBackedges(*func, back_edges);
+  if (!back_edges.empty()) {
+    return false;
+  }
+  for (auto &inst : llvm::instructions(func)) {
+    if (auto call = llvm::dyn_cast<llvm::CallBase>(&inst)) {
+      const auto callee = call->getCalledFunction();
+      if (!callee || !callee->isDeclaration()) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+// Give a body to every intrinsic declared by `module` that this process
+// doesn't define, so that the lifted code can be run. Each one returns its
+// last argument of its return type, e.g. the `Memory *` of the control flow
+// and hyper call intrinsics, or the result of the flag computation
+// intrinsics, and otherwise zero.
+static void StubMissingIntrinsics(llvm::Module *module) {
+  for (auto &func : *module) {
+    if (!func.isDeclaration() || !func.getName().startswith("__remill_") ||
+        llvm::sys::DynamicLibrary::SearchForAddressOfSymbol(
+            func.getName().str())) {
+      continue;
+    }
+
+    llvm::IRBuilder<> ir(
+        llvm::BasicBlock::Create(module->getContext(), "", &func));
+    const auto ret_type = func.getReturnType();
+    if (ret_type->isVoidTy()) {
+      ir.CreateRetVoid();
+      continue;
+    }
+    llvm::Value *ret = llvm::Constant::getNullValue(ret_type);
+    for (auto &arg : func.args()) {
+      if (arg.getType() == ret_type) {
+        ret = &arg;
+      }
+    }
+    ir.CreateRet(ret);
+  }
+}
+
+#if LLVM_VERSION_NUMBER >= LLVM_VERSION(11, 0)
+
+// The guest memory of the lifted code is mapped on demand.
+static bool MapOnFault(remill::PagedMemory &memory, uint64_t addr, uint64_t,
+                       remill::PagedMemory::Permission, void *) {
+  memory.Map(addr & ~static_cast<uint64_t>(remill::PagedMemory::kPageMask),
+             remill::PagedMemory::kPageSize,
+             remill::PagedMemory::kReadWrite);
+  return true;
+}
+
+// JIT-compile `module`, whose context is owned by `tsc`, and run each of its
+// self-contained `traces` `--execute_iterations` times, from a zeroed state.
+static void ExecuteTraces(const remill::Arch *arch,
+                          std::unique_ptr<llvm::Module> module,
+                          llvm::orc::ThreadSafeContext tsc,
+                          const std::unordered_map<uint64_t, llvm::Function *>
+                              &traces,
+                          GuideResult &result) {
+  std::vector<std::pair<uint64_t, std::string>> entries;
+  for (auto [addr, func] : traces) {
+    if (IsSelfContained(func)) {
+      entries.emplace_back(addr, func->getName().str());
+    }
+  }
+  std::sort(entries.begin(), entries.end());
+  const auto state_size =
+      module->getDataLayout().getTypeAllocSize(arch->StateStructType());
+  StubMissingIntrinsics(module.get());
+
+  auto jit = llvm::orc::LLJITBuilder().create();
+  if (!jit) {
+    LOG(ERROR) << "Could not create the JIT: "
+               << llvm::toString(jit.takeError());
+    return;
+  }
+  auto gen = llvm::orc::DynamicLibrarySearchGenerator::GetForCurrentProcess(
+      (*jit)->getDataLayout().getGlobalPrefix());
+  CHECK(gen) << "Could not search this process for the intrinsics: "
+             << llvm::toString(gen.takeError());
+  (*jit)->getMainJITDylib().addGenerator(std::move(*gen));
+
+  module->setDataLayout((*jit)->getDataLayout());
+  module->setTargetTriple((*jit)->getTargetTriple().str());
+  if (auto err = (*jit)->addIRModule(
+          llvm::orc::ThreadSafeModule(std::move(module), tsc))) {
+    LOG(ERROR) << "Could not add the lifted code to the JIT: "
+               << llvm::toString(std::move(err));
+    return;
+  }
+
+  using LiftedFunc = Memory *(void *, uint64_t, Memory *);
+  std::vector<std::pair<uint64_t, LiftedFunc *>> funcs;
+  for (const auto &[addr, name] : entries) {
+    auto sym = (*jit)->lookup(name);
+    if (!sym) {
+      LOG(WARNING) << "Could not compile trace " << name << ": "
+                   << llvm::toString(sym.takeError());
+      continue;
+    }
+#  if LLVM_VERSION_NUMBER >= LLVM_VERSION(15, 0)
+    funcs.emplace_back(addr, sym->toPtr<LiftedFunc *>());
+#  else
+    funcs.emplace_back(addr, reinterpret_cast<LiftedFunc *>(sym->getAddress()));
+#  endif
+  }
+
+  remill::PagedMemory memory;
+  memory.SetFaultHandler(MapOnFault);
+  std::vector<uint8_t> state_buff(state_size + 64);
+  const auto state = reinterpret_cast<uint8_t *>(
+      (reinterpret_cast<uintptr_t>(state_buff.data()) + 63) &
+      ~static_cast<uintptr_t>(63));
+
+  const auto start = Clock::now();
+  for (uint64_t i = 0; i < FLAGS_execute_iterations; ++i) {
+    for (auto [addr, func] : funcs) {
+      memset(state, 0, state_size);
+      (void) func(state, addr, memory.AsMemory());
+    }
+  }
+  result.execute_seconds =
+      std::chrono::duration<double>(Clock::now() - start).count();
+  result.executed_traces = funcs.size();
+}
+
+#endif
+
+// Lift the traces of `corpus` into a fresh copy of the semantics, optimize
+// them with `guide`, and then run them.
+static GuideResult BenchGuide(const Corpus &corpus,
+                              const remill::OptimizationGuide &guide) {
+  GuideResult result;
+#if LLVM_VERSION_NUMBER >= LLVM_VERSION(11, 0)
+  llvm::orc::ThreadSafeContext tsc(std::make_unique<llvm::LLVMContext>());
+  auto &context = *tsc.getContext();
+#else
+  llvm::LLVMContext context;
+#endif
+  const auto arch = remill::Arch::Build(&context, remill::GetOSName(FLAGS_os),
+                                        remill::GetArchName(corpus.arch_name));
+  CHECK(arch != nullptr) << "Unsupported architecture " << corpus.arch_name;
+
+  auto module = remill::LoadArchSemantics(arch.get());
+  BenchTraceManager manager(corpus);
+  (void) LiftTraces(arch.get(), module.get(), corpus, manager);
+
+  const auto start = Clock::now();
+  remill::OptimizeModule(arch.get(), module.get(), manager.traces, guide);
+  result.optimize_seconds =
+      std::chrono::duration<double>(Clock::now() - start).count();
+
+  for (auto [addr, func] : manager.traces) {
+    (void) addr;
+    result.ir_instructions += func->getInstructionCount();
+  }
+
+  // The memory intrinsics of this process are for 64-bit guests.
+#if LLVM_VERSION_NUMBER >= LLVM_VERSION(11, 0)
+  if (arch->address_size == 64 && FLAGS_execute_iterations) {
+    ExecuteTraces(arch.get(), std::move(module), tsc, manager.traces, result);
+  }
+#endif
+  return result;
+}
+
+// Benchmark `corpus` with every combination of the `presets` and the boolean
+// options of `OptimizationGuide`.
+static void CompareGuides(const Corpus &corpus,
+                          const std::vector<std::string> &presets) {
+  for (const auto &preset_name : presets) {
+    const auto preset = remill::OptimizationPresetFromName(preset_name);
+    CHECK(preset) << "Invalid --guide_presets value: " << preset_name;
+
+    for (unsigned options = 0; options < 8u; ++options) {
+      remill::OptimizationGuide guide = {};
+      guide.preset = *preset;
+      guide.slp_vectorize = options & 1u;
+      guide.loop_vectorize = options & 2u;
+      guide.eliminate_dead_stores = options & 4u;
+
+      const auto result = BenchGuide(corpus, guide);
+      std::cout << corpus.name << ',' << corpus.arch_name << ','
+                << preset_name << ',' << guide.slp_vectorize << ','
+                << guide.loop_vectorize << ',' << guide.eliminate_dead_stores
+                << ',' << std::fixed << std::setprecision(6)
+                << result.optimize_seconds << ',' << result.ir_instructions
+                << ',' << result.executed_traces << ','
+                << FLAGS_execute_iterations << ',' << result.execute_seconds
+                << std::endl;
+    }
+  }
+}
+
+static void BenchCorpus(const Corpus &corpus) {
+  llvm::LLVMContext context;
+  const auto arch = remill::Arch::Build(&context, remill::GetOSName(FLAGS_os),
+                                        remill::GetArchName(corpus.arch_name));
+  CHECK(arch != nullptr) << "Unsupported architecture " << corpus.arch_name;
+
+  std::vector<remill::Instruction> insts;
+  const auto decode_result = BenchDecode(arch.get(), corpus, insts);
+  Report(corpus, "decode", decode_result);
+
+  uint64_t num_insts = insts.size();
+  uint64_t num_bytes = 0;
+  for (const auto &inst : insts) {
+    num_bytes += inst.bytes.size();
+  }
+
+  auto module = remill::LoadArchSemantics(arch.get());
+  remill::IntrinsicTable intrinsics(module.get());
+  Report(corpus, "lift",
+         BenchLift(arch.get(), module.get(), intrinsics, insts));
+  Report(corpus, "trace",
+         BenchTrace(arch.get(), module.get(), corpus, num_insts, num_bytes));
+  module.reset();
+
+  PhaseResult opt_result;
+  PhaseResult dse_result;
+  BenchOptimize(arch.get(), corpus, num_insts, num_bytes, opt_result,
+                dse_result);
+  Report(corpus, "optimize", opt_result);
+  Report(corpus, "dse", dse_result);
+}
+
+}  // namespace
+
+extern "C" int main(int argc, char *argv[]) {
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  google::InitGoogleLogging(argv[0]);
+
+  std::vector<Corpus> corpora;
+  for (const auto &builtin : kBuiltinCorpora) {
+    corpora.push_back(MakeBuiltinCorpus(builtin));
+  }
+#if defined(REMILL_BENCH_X86_TESTS) || defined(REMILL_BENCH_AARCH64_TESTS)
+  corpora.push_back(MakeTestCorpus());
+#endif
+
+  std::stringstream ss;
+  ss << ',' << FLAGS_corpora << ',';
+  const auto selected = ss.str();
+
+  std::vector<std::string> presets;
+  if (FLAGS_compare_guides) {
+    llvm::InitializeNativeTarget();
+    llvm::InitializeNativeTargetAsmPrinter();
+    llvm::sys::DynamicLibrary::LoadLibraryPermanently(nullptr);
+
+    std::stringstream preset_ss(FLAGS_guide_presets);
+    for (std::string preset; std::getline(preset_ss, preset, ',');) {
+      presets.push_back(preset);
+    }
+
+    std::cout << "corpus,arch,preset,slp_vectorize,loop_vectorize,"
+              << "eliminate_dead_stores,optimize_seconds,ir_instructions,"
+              << "executed_traces,execute_iterations,execute_seconds"
+              << std::endl;
+  } else {
+    std::cout << "corpus,arch,phase,iterations,instructions,bytes,seconds,"
+              << "instructions_per_second,bytes_per_second" << std::endl;
+  }
+
+  for (const auto &corpus : corpora) {
+    if (!FLAGS_corpora.empty() &&
+        selected.find(',' + corpus.name + ',') == std::string::npos) {
+      continue;
+    } else if (FLAGS_compare_guides) {
+      CompareGuides(corpus, presets);
+    } else {
+      BenchCorpus(corpus);
+    }
+  }
+
+  return EXIT_SUCCESS;
+}
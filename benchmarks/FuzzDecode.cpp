@@ -0,0 +1,221 @@
+/*
+ * Copyright (c) 2020 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/MemoryBuffer.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+#include "remill/Arch/Arch.h"
+#include "remill/Arch/Instruction.h"
+#include "remill/Arch/Name.h"
+#include "remill/OS/OS.h"
+
+#ifndef REMILL_FUZZ_ARCH
+#  error "REMILL_FUZZ_ARCH must name the architecture whose decoder is fuzzed."
+#endif
+
+DECLARE_string(os);
+
+#ifndef REMILL_FUZZ_LIBFUZZER
+DEFINE_uint64(replay_iterations, 1,
+              "Number of times to decode every input of the corpus.");
+#endif
+
+namespace {
+
+// Address of the first byte of every input.
+static constexpr uint64_t kFuzzAddress = 0x10000;
+
+// The decode throughput is reported after every this many instructions.
+static constexpr uint64_t kReportInterval = 1u << 20;
+
+using Clock = std::chrono::steady_clock;
+
+static const remill::Arch *FuzzArch(void) {
+  static llvm::LLVMContext context;
+  static const auto arch =
+      remill::Arch::Build(&context, remill::GetOSName(FLAGS_os),
+                          remill::GetArchName(REMILL_FUZZ_ARCH));
+  CHECK(arch != nullptr) << "Unsupported architecture " << REMILL_FUZZ_ARCH;
+  return arch.get();
+}
+
+// Linear sweep decode of `bytes`, checking that every decoded instruction
+// is made of a prefix of the bytes it was decoded from. Returns the number
+// of decoded instructions, and adds their bytes to `num_bytes`.
+static uint64_t DecodeAll(const remill::Arch *arch, std::string_view bytes,
+                          uint64_t &num_bytes) {
+  const auto max_size = arch->MaxInstructionSize();
+  const auto align = std::max<uint64_t>(1u, arch->MinInstructionAlign());
+  remill::Instruction inst;
+  uint64_t num_insts = 0;
+
+  for (uint64_t offset = 0; offset < bytes.size();) {
+    inst.Reset();
+    const auto inst_bytes = bytes.substr(offset, max_size);
+    if (arch->DecodeInstruction(kFuzzAddress + offset, inst_bytes, inst) &&
+        !inst.bytes.empty()) {
+      CHECK(inst.bytes.size() <= inst_bytes.size() &&
+            inst_bytes.substr(0, inst.bytes.size()) == inst.bytes)
+          << "Decoded instruction at offset " << offset
+          << " doesn't match its input bytes: " << inst.Serialize();
+      offset += inst.bytes.size();
+      num_bytes += inst.bytes.size();
+      num_insts += 1;
+    } else {
+      offset += align;  // Skip over undecodable bytes.
+    }
+  }
+  return num_insts;
+}
+
+// Prints the decode throughput of one pass over the corpus, or of the
+// instructions decoded since the last report while fuzzing.
+static void Report(const char *mode, uint64_t num_inputs,
+                   uint64_t num_insts, uint64_t num_bytes, double seconds) {
+  const auto secs = std::max(seconds, 1e-9);
+  std::cout << REMILL_FUZZ_ARCH << ',' << mode << ',' << num_inputs << ','
+            << num_insts << ',' << num_bytes << ',' << std::fixed
+            << std::setprecision(6) << seconds << ',' << std::setprecision(0)
+            << (static_cast<double>(num_insts) / secs) << ','
+            << (static_cast<double>(num_bytes) / secs) << std::endl;
+}
+
+static void PrintHeader(void) {
+  std::cout << "arch,mode,inputs,instructions,bytes,seconds,"
+            << "decodes_per_second,bytes_per_second" << std::endl;
+}
+
+}  // namespace
+
+// The libFuzzer entry point, which AFL++ can also drive.
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+  static uint64_t num_inputs = 0;
+  static uint64_t num_insts = 0;
+  static uint64_t num_bytes = 0;
+  static auto start = Clock::now();
+
+  const auto arch = FuzzArch();
+  const std::string_view bytes(reinterpret_cast<const char *>(data), size);
+  num_insts += DecodeAll(arch, bytes, num_bytes);
+  num_inputs += 1;
+
+  if (kReportInterval <= num_insts) {
+    const auto now = Clock::now();
+    Report("fuzz", num_inputs, num_insts, num_bytes,
+           std::chrono::duration<double>(now - start).count());
+    num_inputs = 0;
+    num_insts = 0;
+    num_bytes = 0;
+    start = now;
+  }
+  return 0;
+}
+
+#ifdef REMILL_FUZZ_LIBFUZZER
+
+extern "C" int LLVMFuzzerInitialize(int *, char ***argv) {
+  google::InitGoogleLogging((*argv)[0]);
+  (void) FuzzArch();
+  PrintHeader();
+  return 0;
+}
+
+#else
+
+namespace {
+
+using Inputs = std::vector<std::unique_ptr<llvm::MemoryBuffer>>;
+
+// Add the contents of `path`, or of every file under it if it's a directory,
+// to `inputs`.
+static void ReadCorpus(const std::string &path, Inputs &inputs) {
+  auto add_file = [&](const std::string &file_path) {
+    auto buff = llvm::MemoryBuffer::getFile(file_path);
+    CHECK(buff) << "Could not read corpus file " << file_path;
+    inputs.push_back(std::move(buff.get()));
+  };
+
+  if (!llvm::sys::fs::is_directory(path)) {
+    add_file(path);
+    return;
+  }
+
+  std::error_code ec;
+  for (llvm::sys::fs::recursive_directory_iterator it(path, ec), end;
+       !ec && it != end; it.increment(ec)) {
+    if (!llvm::sys::fs::is_directory(it->path())) {
+      add_file(it->path());
+    }
+  }
+  CHECK(!ec) << "Could not read corpus directory " << path << ": "
+             << ec.message();
+}
+
+}  // namespace
+
+// Replays a corpus of files and directories, or, without any, decodes the
+// input on stdin once, e.g. when run by AFL.
+extern "C" int main(int argc, char *argv[]) {
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  google::InitGoogleLogging(argv[0]);
+
+  Inputs inputs;
+  for (auto i = 1; i < argc; ++i) {
+    ReadCorpus(argv[i], inputs);
+  }
+
+  if (inputs.empty()) {
+    auto buff = llvm::MemoryBuffer::getSTDIN();
+    CHECK(buff) << "Could not read the input from stdin";
+    const auto bytes = buff.get()->getBuffer();
+    (void) LLVMFuzzerTestOneInput(
+        reinterpret_cast<const uint8_t *>(bytes.data()), bytes.size());
+    return EXIT_SUCCESS;
+  }
+
+  const auto arch = FuzzArch();
+  PrintHeader();
+  for (uint64_t i = 0; i < FLAGS_replay_iterations; ++i) {
+    uint64_t num_insts = 0;
+    uint64_t num_bytes = 0;
+    const auto start = Clock::now();
+    for (const auto &input : inputs) {
+      const auto bytes = input->getBuffer();
+      num_insts += DecodeAll(
+          arch, std::string_view(bytes.data(), bytes.size()), num_bytes);
+    }
+    Report("replay", inputs.size(), num_insts, num_bytes,
+           std::chrono::duration<double>(Clock::now() - start).count());
+  }
+  return EXIT_SUCCESS;
+}
+
+#endif  // REMILL_FUZZ_LIBFUZZER
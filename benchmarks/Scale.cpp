@@ -0,0 +1,385 @@
+/*
+ * Copyright (c) 2020 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
+
+#ifndef _WIN32
+#  include <sys/resource.h>
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "remill/Arch/Arch.h"
+#include "remill/Arch/Instruction.h"
+#include "remill/Arch/Name.h"
+#include "remill/BC/DeadStoreEliminator.h"
+#include "remill/BC/IntrinsicTable.h"
+#include "remill/BC/Lifter.h"
+#include "remill/BC/Optimizer.h"
+#include "remill/BC/Util.h"
+#include "remill/OS/OS.h"
+
+DECLARE_string(arch);
+DECLARE_string(os);
+
+DEFINE_string(scenarios, "giant_trace,jump_table,call_graph",
+              "Comma-separated list of the synthetic inputs to lift. For an "
+              "accurate peak memory usage, run one scenario per process.");
+
+DEFINE_uint64(giant_trace_instructions, 500000,
+              "Number of instructions in the single trace of `giant_trace`.");
+
+DEFINE_uint64(jump_table_entries, 10000,
+              "Number of targets of the indirect jump of `jump_table`.");
+
+DEFINE_uint64(call_graph_functions, 100000,
+              "Number of functions in the call graph of `call_graph`.");
+
+DEFINE_double(max_us_per_instruction, 0,
+              "Fail if lifting, optimizing, and removing the dead stores of "
+              "a scenario takes longer than this many microseconds per "
+              "instruction. Zero means unlimited.");
+
+DEFINE_double(max_kb_per_instruction, 0,
+              "Fail if a scenario grows the peak memory usage of this "
+              "process by more than this many KiB per instruction. Zero "
+              "means unlimited.");
+
+namespace {
+
+// Address of the first byte of every synthetic input.
+static constexpr uint64_t kScaleAddress = 0x100000;
+
+using Clock = std::chrono::steady_clock;
+
+// Synthetic machine code, with its entry point at `kScaleAddress`.
+struct Scenario {
+  std::string name;
+  std::string bytes;
+  uint64_t num_insts{0};
+
+  // Targets of the indirect jumps of the code.
+  std::unordered_map<uint64_t, remill::DevirtualizedTargetList> jump_tables;
+};
+
+static void Emit32(std::string &bytes, uint32_t val) {
+  for (auto i = 0u; i < 4u; ++i) {
+    bytes.push_back(static_cast<char>((val >> (i * 8u)) & 0xFFu));
+  }
+}
+
+// One trace of `num_insts` straight-line instructions, with a conditional
+// branch to the next instruction after every four instructions, so that the
+// trace is also made of many blocks.
+static Scenario MakeGiantTrace(const remill::Arch *arch, uint64_t num_insts) {
+  Scenario scenario;
+  scenario.name = "giant_trace";
+  for (uint64_t i = 0; i < num_insts; i += 5) {
+    if (arch->IsAArch64()) {
+
+      // add x0, x1, x2; ldr x3, [x0, #8]; eor w4, w4, w4; cmp x0, #0;
+      // b.eq .+4
+      Emit32(scenario.bytes, 0x8b020020u);
+      Emit32(scenario.bytes, 0xf9400403u);
+      Emit32(scenario.bytes, 0x4a040084u);
+      Emit32(scenario.bytes, 0xf100001fu);
+      Emit32(scenario.bytes, 0x54000020u);
+    } else {
+
+      // add eax, ebx; mov ecx, [eax + 8]; xor edx, edx;
+      // lea esi, [edi + ecx * 4]; jz .+2
+      scenario.bytes.append("\x01\xd8\x8b\x48\x08\x31\xd2\x8d\x34\x8f\x74\x00",
+                            12);
+    }
+    scenario.num_insts += 5;
+  }
+
+  // ret
+  if (arch->IsAArch64()) {
+    Emit32(scenario.bytes, 0xd65f03c0u);
+  } else {
+    scenario.bytes.push_back('\xc3');
+  }
+  scenario.num_insts += 1;
+  return scenario;
+}
+
+// One indirect jump with `num_entries` targets, each of which returns its
+// index, like a large `switch` lowered to a jump table.
+static Scenario MakeJumpTable(const remill::Arch *arch, uint64_t num_entries) {
+  Scenario scenario;
+  scenario.name = "jump_table";
+
+  auto &targets = scenario.jump_tables[kScaleAddress];
+  const uint64_t jump_size = arch->IsAArch64() ? 4u : 2u;
+  const uint64_t target_size = arch->IsAArch64() ? 8u : 6u;
+
+  // br x0, or jmp rax
+  if (arch->IsAArch64()) {
+    Emit32(scenario.bytes, 0xd61f0000u);
+  } else {
+    scenario.bytes.append("\xff\xe0", 2);
+  }
+  scenario.num_insts += 1;
+
+  for (uint64_t i = 0; i < num_entries; ++i) {
+    targets.emplace_back(kScaleAddress + jump_size + i * target_size,
+                         remill::DevirtualizedTargetKind::kTraceLocal);
+
+    // movz w0, #i; ret, or mov eax, i; ret
+    if (arch->IsAArch64()) {
+      Emit32(scenario.bytes, 0x52800000u | ((i & 0xFFFFu) << 5u));
+      Emit32(scenario.bytes, 0xd65f03c0u);
+    } else {
+      scenario.bytes.push_back('\xb8');
+      Emit32(scenario.bytes, static_cast<uint32_t>(i));
+      scenario.bytes.push_back('\xc3');
+    }
+    scenario.num_insts += 2;
+  }
+  return scenario;
+}
+
+// A binary tree of `num_funcs` functions, where function `i` calls functions
+// `2i + 1` and `2i + 2`, and every function is a trace of its own.
+static Scenario MakeCallGraph(const remill::Arch *arch, uint64_t num_funcs) {
+  Scenario scenario;
+  scenario.name = "call_graph";
+  const uint64_t func_size = arch->IsAArch64() ? 12u : 11u;
+
+  for (uint64_t i = 0; i < num_funcs; ++i) {
+    const auto func_addr = kScaleAddress + i * func_size;
+    for (uint64_t j = 1; j <= 2; ++j) {
+      const auto callee = 2 * i + j;
+      const auto call_addr =
+          func_addr + (j - 1) * (arch->IsAArch64() ? 4u : 5u);
+      const auto target_addr = kScaleAddress + callee * func_size;
+
+      // bl callee, or call callee, or a nop the size of either.
+      if (arch->IsAArch64()) {
+        const auto disp = static_cast<int64_t>(target_addr - call_addr) / 4;
+        Emit32(scenario.bytes,
+               callee < num_funcs
+                   ? 0x94000000u | (static_cast<uint32_t>(disp) & 0x3ffffffu)
+                   : 0xd503201fu);
+      } else if (callee < num_funcs) {
+        scenario.bytes.push_back('\xe8');
+        Emit32(scenario.bytes,
+               static_cast<uint32_t>(target_addr - (call_addr + 5u)));
+      } else {
+        scenario.bytes.append("\x0f\x1f\x44\x00\x00", 5);
+      }
+    }
+
+    // ret
+    if (arch->IsAArch64()) {
+      Emit32(scenario.bytes, 0xd65f03c0u);
+    } else {
+      scenario.bytes.push_back('\xc3');
+    }
+    scenario.num_insts += 3;
+  }
+  return scenario;
+}
+
+// Trace manager whose memory is the code of a scenario.
+class ScaleTraceManager : public remill::TraceManager {
+ public:
+  virtual ~ScaleTraceManager(void) = default;
+
+  explicit ScaleTraceManager(const Scenario &scenario_)
+      : scenario(scenario_) {}
+
+  void SetLiftedTraceDefinition(uint64_t addr,
+                                llvm::Function *lifted_func) override {
+    traces[addr] = lifted_func;
+  }
+
+  llvm::Function *GetLiftedTraceDeclaration(uint64_t addr) override {
+    auto trace_it = traces.find(addr);
+    if (trace_it != traces.end()) {
+      return trace_it->second;
+    } else {
+      return nullptr;
+    }
+  }
+
+  llvm::Function *GetLiftedTraceDefinition(uint64_t addr) override {
+    return GetLiftedTraceDeclaration(addr);
+  }
+
+  void GetDevirtualizedTargets(
+      const remill::Instruction &inst,
+      remill::DevirtualizedTargetList &targets) override {
+    auto table_it = scenario.jump_tables.find(inst.pc);
+    if (table_it != scenario.jump_tables.end()) {
+      targets = table_it->second;
+    }
+  }
+
+  bool TryReadExecutableByte(uint64_t addr, uint8_t *byte) override {
+    std::string buffer;
+    const auto bytes = TryReadExecutableBytes(addr, 1, buffer);
+    if (bytes.empty()) {
+      return false;
+    }
+    *byte = static_cast<uint8_t>(bytes[0]);
+    return true;
+  }
+
+  std::string_view TryReadExecutableBytes(uint64_t addr, size_t size,
+                                          std::string &) override {
+    if (kScaleAddress <= addr &&
+        addr < (kScaleAddress + scenario.bytes.size())) {
+      std::string_view bytes(scenario.bytes);
+      return bytes.substr(addr - kScaleAddress, size);
+    }
+    return {};
+  }
+
+  const Scenario &scenario;
+  std::unordered_map<uint64_t, llvm::Function *> traces;
+};
+
+// Returns the peak memory usage of this process, in KiB.
+static uint64_t PeakMemoryKiB(void) {
+#ifdef _WIN32
+  return 0;
+#else
+  struct rusage usage = {};
+  CHECK(!getrusage(RUSAGE_SELF, &usage));
+#  ifdef __APPLE__
+  return static_cast<uint64_t>(usage.ru_maxrss) / 1024u;
+#  else
+  return static_cast<uint64_t>(usage.ru_maxrss);
+#  endif
+#endif
+}
+
+static double SecondsSince(Clock::time_point start) {
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// Lift, optimize, and remove the dead stores of `scenario`, and report the
+// time taken by each phase, and the growth of the peak memory usage. Returns
+// `false` if the scenario went over a budget.
+static bool RunScenario(const remill::Arch *arch, const Scenario &scenario) {
+  auto module = remill::LoadArchSemantics(arch);
+  const auto bb_func = remill::BasicBlockFunction(module.get());
+  const auto slots = remill::StateSlots(arch, module.get());
+  const auto base_kib = PeakMemoryKiB();
+
+  ScaleTraceManager manager(scenario);
+  remill::IntrinsicTable intrinsics(module.get());
+  remill::InstructionLifter inst_lifter(arch, intrinsics);
+  remill::TraceLifter trace_lifter(inst_lifter, manager);
+
+  auto start = Clock::now();
+  trace_lifter.Lift(kScaleAddress);
+  const auto lift_seconds = SecondsSince(start);
+
+  remill::OptimizationGuide guide = {};
+  start = Clock::now();
+  remill::OptimizeModule(arch, module.get(), manager.traces, guide);
+  const auto optimize_seconds = SecondsSince(start);
+
+  start = Clock::now();
+  remill::RemoveDeadStores(arch, module.get(), bb_func, slots);
+  const auto dse_seconds = SecondsSince(start);
+
+  const auto peak_kib = PeakMemoryKiB();
+  const auto grown_kib = peak_kib > base_kib ? peak_kib - base_kib : 0u;
+  const auto num_insts = static_cast<double>(scenario.num_insts);
+  const auto us_per_inst =
+      (lift_seconds + optimize_seconds + dse_seconds) * 1e6 / num_insts;
+  const auto kib_per_inst = static_cast<double>(grown_kib) / num_insts;
+
+  auto ok = true;
+  if (FLAGS_max_us_per_instruction &&
+      us_per_inst > FLAGS_max_us_per_instruction) {
+    LOG(ERROR) << "Scenario " << scenario.name << " took " << us_per_inst
+               << "us per instruction, over the budget of "
+               << FLAGS_max_us_per_instruction << "us";
+    ok = false;
+  }
+  if (FLAGS_max_kb_per_instruction &&
+      kib_per_inst > FLAGS_max_kb_per_instruction) {
+    LOG(ERROR) << "Scenario " << scenario.name << " used " << kib_per_inst
+               << "KiB per instruction, over the budget of "
+               << FLAGS_max_kb_per_instruction << "KiB";
+    ok = false;
+  }
+
+  std::cout << scenario.name << ',' << FLAGS_arch << ','
+            << scenario.num_insts << ',' << manager.traces.size() << ','
+            << std::fixed << std::setprecision(6) << lift_seconds << ','
+            << optimize_seconds << ',' << dse_seconds << ',' << grown_kib
+            << ',' << std::setprecision(3) << us_per_inst << ','
+            << kib_per_inst << ',' << (ok ? "ok" : "over_budget")
+            << std::endl;
+  return ok;
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  google::InitGoogleLogging(argv[0]);
+
+  llvm::LLVMContext context;
+  const auto arch = remill::Arch::Build(&context, remill::GetOSName(FLAGS_os),
+                                        remill::GetArchName(FLAGS_arch));
+  CHECK(arch != nullptr) << "Unsupported architecture " << FLAGS_arch;
+  CHECK(arch->IsX86() || arch->IsAMD64() || arch->IsAArch64())
+      << "Synthetic inputs are only generated for x86, amd64, and aarch64";
+
+  std::cout << "scenario,arch,instructions,traces,lift_seconds,"
+            << "optimize_seconds,dse_seconds,peak_memory_growth_kib,"
+            << "us_per_instruction,kib_per_instruction,status" << std::endl;
+
+  auto ok = true;
+  std::stringstream scenarios_ss(FLAGS_scenarios);
+  for (std::string name; std::getline(scenarios_ss, name, ',');) {
+    Scenario scenario;
+    if (name == "giant_trace") {
+      scenario = MakeGiantTrace(arch.get(), FLAGS_giant_trace_instructions);
+    } else if (name == "jump_table") {
+      scenario = MakeJumpTable(arch.get(), FLAGS_jump_table_entries);
+    } else if (name == "call_graph") {
+      scenario = MakeCallGraph(arch.get(), FLAGS_call_graph_functions);
+    } else {
+      LOG(FATAL) << "Invalid --scenarios value: " << name;
+    }
+    ok = RunScenario(arch.get(), scenario) && ok;
+  }
+
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
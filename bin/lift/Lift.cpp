@@ -16,36 +16,84 @@
 
 #include <gflags/gflags.h>
 #include <glog/logging.h>
+#include <llvm/ADT/ArrayRef.h>
+#include <llvm/ADT/StringExtras.h>
+#include <llvm/Bitcode/BitcodeReader.h>
 #include <llvm/IR/Function.h>
 #include <llvm/IR/GlobalValue.h>
+#include <llvm/IR/InstIterator.h>
 #include <llvm/IR/IRBuilder.h>
 #include <llvm/IR/Instructions.h>
 #include <llvm/IR/LLVMContext.h>
 #include <llvm/IR/Module.h>
 #include <llvm/IR/Type.h>
+#include <llvm/Linker/Linker.h>
+#include <llvm/Object/Binary.h>
+#include <llvm/Object/ObjectFile.h>
+#include <llvm/Pass.h>
+#include <llvm/Support/Error.h>
 #include <llvm/Support/FileSystem.h>
+#include <llvm/Support/MemoryBuffer.h>
 #include <llvm/Support/raw_ostream.h>
+#include <llvm/Support/xxhash.h>
+#include <llvm/Transforms/Utils/Cloning.h>
 #include <remill/Arch/Arch.h>
 #include <remill/Arch/Instruction.h>
 #include <remill/Arch/Name.h>
 #include <remill/BC/ABI.h>
+#include <remill/BC/BackgroundOptimizer.h>
+#include <remill/BC/CodeGen.h>
+#include <remill/BC/Compat/Cloning.h>
+#include <remill/BC/DispatchTable.h>
 #include <remill/BC/IntrinsicTable.h>
 #include <remill/BC/Lifter.h>
 #include <remill/BC/Optimizer.h>
+#include <remill/BC/ReducedState.h>
+#include <remill/BC/StateEscape.h>
+#include <remill/BC/Statistics.h>
+#include <remill/BC/TraceMerging.h>
 #include <remill/BC/Util.h>
+#include <remill/BC/Version.h>
+#include <remill/OS/FileSystem.h>
 #include <remill/OS/OS.h>
 #include <remill/Version/Version.h>
 
 #include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
 #include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
 #include <fstream>
 #include <functional>
 #include <iostream>
-#include <map>
 #include <memory>
+#include <mutex>
+#include <new>
 #include <sstream>
 #include <string>
+#include <string_view>
 #include <system_error>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#if LLVM_VERSION_NUMBER >= LLVM_VERSION(8, 0)
+#  include <llvm/IR/PassTimingInfo.h>
+#endif
+
+#ifndef _WIN32
+#  include <sys/resource.h>
+#  include <sys/socket.h>
+#  include <sys/un.h>
+#  include <unistd.h>
+#endif
 
 DECLARE_string(arch);
 DECLARE_string(os);
@@ -57,66 +105,711 @@ DEFINE_uint64(address, 0,
 DEFINE_uint64(entry_address, 0,
               "Address of instruction that should be "
               "considered the entrypoint of this code. "
-              "Defaults to the value of --address.");
+              "Defaults to the entry point of an --input object file, "
+              "or to the value of --address.");
 
 DEFINE_string(bytes, "", "Hex-encoded byte string to lift.");
 
+DEFINE_string(input, "",
+              "Path to a file holding the code to lift, instead of --bytes. "
+              "The file is memory-mapped rather than read.");
+
+DEFINE_string(entry_addresses, "",
+              "Path to a file listing more addresses, one per line, from "
+              "which to lift into the same module as --entry_address.");
+
+DEFINE_string(jobs, "",
+              "Path to a CSV manifest of lifting jobs, instead of --bytes or "
+              "--input. Each line is 'address,entry_address,bytes', where "
+              "the bytes are hex-encoded, and an empty entry address "
+              "defaults to the address. The code of the Nth job is saved in "
+              "place of --ir_out and --bc_out, e.g. to 'out.N.bc'.");
+
+DEFINE_string(regions, "",
+              "Path to a CSV manifest of code regions of several "
+              "architectures, to lift into one module, instead of --bytes "
+              "or --input. Each line is 'arch,address,entry_addresses,bytes', "
+              "where an empty arch defaults to --arch, the entry addresses "
+              "are space-separated and default to the address, and the "
+              "bytes are hex-encoded. Each architecture is lifted on its own "
+              "thread, and transfers into the regions of other "
+              "architectures call the traces lifted from them.");
+
+DEFINE_uint32(job_threads, 1,
+              "Number of threads on which to lift the --jobs. Each thread "
+              "loads the semantics once.");
+
+DEFINE_bool(serve, false,
+            "Keep the semantics loaded, and lift the requests read from "
+            "stdin, or from the clients of --serve_socket, instead of "
+            "--bytes, --input, or --jobs. Each request is a line "
+            "'id,arch,address,entry_address,format,bytes', where an empty "
+            "arch defaults to --arch, and the format is 'ir' or 'bc'. Each "
+            "response is a line 'id,ok,size' or 'id,error,size', followed "
+            "by that many bytes of lifted code or of an error message.");
+
+DEFINE_string(serve_socket, "",
+              "Path of a Unix socket on which --serve accepts clients, "
+              "instead of reading stdin.");
+
+DEFINE_uint32(serve_threads, 0,
+              "Number of threads on which --serve lifts requests. By "
+              "default, one thread per hardware thread is used.");
+
+DEFINE_string(serve_archs, "",
+              "Comma-separated list of architectures whose semantics each "
+              "--serve thread loads up front. Defaults to --arch. The "
+              "semantics of other architectures are loaded on their first "
+              "request.");
+
+DEFINE_string(input_format, "auto",
+              "Format of the --input file. One of 'raw', for bytes located "
+              "at --address, 'object', for the executable sections of an "
+              "ELF, Mach-O, or PE/COFF file, or 'auto', to use 'object' "
+              "for files that are recognized as such, and 'raw' otherwise.");
+
 DEFINE_string(ir_out, "", "Path to file where the LLVM IR should be saved.");
 DEFINE_string(bc_out, "",
               "Path to file where the LLVM bitcode should be "
               "saved.");
 
+DEFINE_uint32(bc_out_parts, 1,
+              "Number of bitcode files into which the lifted code is split "
+              "when saved to --bc_out. Each file holds the traces of one "
+              "range of addresses, and the files are written in parallel.");
+
+DEFINE_string(obj_out, "",
+              "Path to file where the native object code of the lifted code "
+              "should be saved. With --bc_out_parts, the code is split into "
+              "that many object files, e.g. 'out.N.o', the same way as the "
+              "bitcode, and they are compiled in parallel.");
+
+DEFINE_bool(stream_traces, false,
+            "Optimize and save each lifted trace to its own files as soon "
+            "as it is lifted, e.g. to 'out.N.bc' for the Nth trace, in "
+            "place of --ir_out and --bc_out, and then free it, instead of "
+            "saving all of the lifted code at the end. This can't be used "
+            "to make slices.");
+
+DEFINE_uint32(background_optimize_threads, 0,
+              "If positive, optimize each trace on this many background "
+              "threads, each with its own LLVM context, as soon as it is "
+              "lifted, so that optimizing overlaps with lifting the next "
+              "traces. As with --stream_traces, the traces are optimized on "
+              "their own, without dead store elimination. This isn't used "
+              "to make slices.");
+
 DEFINE_string(slice_inputs, "",
               "Comma-separated list of registers to treat as inputs.");
 DEFINE_string(slice_outputs, "",
               "Comma-separated list of registers to treat as outputs.");
 
-using Memory = std::map<uint64_t, uint8_t>;
+DEFINE_string(slices, "",
+              "Path to a CSV manifest of more slices to make of the lifted "
+              "code, in the same module. Each line is "
+              "'name,entry_address,inputs,outputs', where the input and "
+              "output registers are space-separated.");
+
+DEFINE_bool(fuse_instructions, false,
+            "Fuse idioms of consecutive instructions, e.g. AArch64 ADRP+ADD, "
+            "into single instructions when lifting.");
+
+DEFINE_bool(native_atomics, false,
+            "Lift atomic instructions, e.g. AArch64 LDXR/STXR pairs, to the "
+            "atomic memory intrinsics, so that the lifted code stays atomic "
+            "when run on many threads at once.");
+
+DEFINE_bool(guest_pc_debug_locations, false,
+            "Give the lifted code of each instruction a debug location whose "
+            "line and column encode the address of the instruction, so that "
+            "profilers can attribute the compiled code to the instructions.");
+
+DEFINE_bool(split_cold_exits, false,
+            "Move the blocks of each trace that exit to __remill_error or "
+            "__remill_missing_block to the end of the trace, and mark them "
+            "as cold.");
+
+DEFINE_string(opt_preset, "legacy",
+              "Optimization pipeline to use on the lifted code. One of "
+              "'legacy', 'fast', 'balanced', or 'max'.");
+
+DEFINE_string(barriers, "keep",
+              "What to do with the memory barrier and atomic region "
+              "intrinsics. One of 'keep', 'fences', or 'remove'.");
+
+DEFINE_bool(prune_semantics, true,
+            "Remove the semantics functions that the lifted code doesn't "
+            "use before running the module passes of the optimizer.");
+
+DEFINE_bool(promote_state_in_loops, false,
+            "Keep the registers that loops in the lifted code load and store "
+            "in SSA values, rather than in the State structure, within "
+            "the loops.");
+
+DEFINE_bool(relax_memory_chains, false,
+            "Let memory reads skip over the memory writes that can't overlap "
+            "them, so that repeated reads of the same address can be "
+            "merged.");
+
+DEFINE_bool(coalesce_memory_accesses, false,
+            "After optimizing, merge the narrow memory accesses that access "
+            "adjacent bytes, e.g. byte-by-byte copies, into wider ones.");
+
+DEFINE_bool(dispatch_table, false,
+            "Add a table of the lifted traces, sorted by address, to the "
+            "lifted code, along with a function, __remill_dispatch_lookup, "
+            "that returns the lifted function of an address. It isn't added "
+            "with --stream_traces.");
+
+DEFINE_bool(merge_identical_traces, false,
+            "Before optimizing, share one body between the lifted traces "
+            "that are identical apart from the addresses that they use, "
+            "e.g. the copies of a helper function in a statically linked "
+            "binary, and make the others into thunks that call it.");
+
+DEFINE_bool(outline_repeated_code, false,
+            "After optimizing, move the sequences of instructions that "
+            "repeat across the lifted code into shared functions. This "
+            "needs LLVM 14 or newer.");
+
+DEFINE_bool(inline_rdtsc, false,
+            "Lower the RDTSC and RDTSCP hyper calls of x86 code to reads of "
+            "the host's cycle counter, rather than calls to "
+            "__remill_sync_hyper_call.");
+
+DEFINE_bool(track_dirty_state, false,
+            "Make the lifted code set a dirty bit for each 64-byte line of "
+            "the State structure that it writes. The bitmap immediately "
+            "follows the State structure, which the runtime must allocate "
+            "with room for it.");
+
+DEFINE_string(stats, "",
+              "Report the size of the input, the numbers of traces and "
+              "instructions lifted, the time spent in each phase, the peak "
+              "memory use, and the bytes allocated by each part of the "
+              "lifting pipeline, once everything has been lifted. One of "
+              "'text' or 'json'. The time spent in each LLVM pass is also "
+              "printed to stderr.");
+
+DEFINE_string(stats_out, "",
+              "Path to the file where the --stats report is saved. Defaults "
+              "to stderr.");
+
+DEFINE_string(trace_events, "",
+              "Path to the file where a timeline of the lifting pipeline is "
+              "saved, in the Chrome trace event format. It has one span for "
+              "each lifted trace, burst of lookahead decoding, run of the "
+              "optimization passes and of dead store elimination, and "
+              "bitcode write, on each thread.");
+
+DEFINE_string(undefined_values, "keep",
+              "What to replace the undefined value intrinsics with. One of "
+              "'keep', 'freeze', or 'zero'.");
+
+DEFINE_string(fp_exceptions, "keep",
+              "How to track the floating point exceptions that set the "
+              "sticky flags of the status register. One of 'keep', 'defer', "
+              "or 'ignore'.");
+
+DEFINE_string(cache_dir, "",
+              "Directory of previously lifted code, keyed by the "
+              "architecture, OS, input bytes, entry addresses, slices, "
+              "semantics, and optimization options. If the same code was "
+              "already lifted, then the cached bitcode is saved without "
+              "lifting anything. The directory can be shared by concurrent "
+              "runs. It isn't used with --stream_traces, --bc_out_parts, "
+              "or --regions.");
+
+DEFINE_string(shard, "",
+              "Lift only this node's share of the --jobs, as 'I/N' for the "
+              "Ith of N nodes, counting from zero, and publish the lifted "
+              "code of each job to the --cache_dir, which all of the nodes "
+              "share, instead of saving it. Jobs that another node already "
+              "published are skipped. Once every node is done, run with "
+              "--assemble_jobs to save the outputs of the jobs.");
+
+DEFINE_bool(assemble_jobs, false,
+            "Save the outputs of the --jobs from the lifted code that the "
+            "--shard nodes published to the --cache_dir, without lifting "
+            "anything. Fails if the code of any job is missing.");
+
+// The bytes that can be lifted, as a list of non-overlapping contiguous
+// segments sorted by their base addresses. The bytes of an `--input` file
+// aren't copied out of the mapped file.
+class Memory {
+ public:
+  struct Segment {
+    uint64_t base;
+    llvm::ArrayRef<uint8_t> bytes;
+  };
 
-// Unhexlify the data passed to `--bytes`, and fill in `memory` with each
-// such byte.
-static Memory UnhexlifyInputBytes(uint64_t addr_mask) {
-  Memory memory;
+  void AddSegment(uint64_t base, llvm::ArrayRef<uint8_t> bytes) {
+    segments.insert(FindSegmentAfter(base), Segment{base, bytes});
+  }
 
-  for (size_t i = 0; i < FLAGS_bytes.size(); i += 2) {
-    char nibbles[] = {FLAGS_bytes[i], FLAGS_bytes[i + 1], '\0'};
-    char *parsed_to = nullptr;
-    auto byte_val = strtol(nibbles, &parsed_to, 16);
+  bool empty(void) const {
+    return segments.empty();
+  }
 
-    if (parsed_to != &(nibbles[2])) {
-      std::cerr << "Invalid hex byte value '" << nibbles
-                << "' specified in --bytes." << std::endl;
-      exit(EXIT_FAILURE);
+  llvm::ArrayRef<Segment> Segments(void) const {
+    return segments;
+  }
+
+  // Returns the total number of bytes in all segments.
+  uint64_t size(void) const {
+    uint64_t num_bytes = 0;
+    for (const auto &seg : segments) {
+      num_bytes += seg.bytes.size();
     }
+    return num_bytes;
+  }
 
-    auto byte_addr = FLAGS_address + (i / 2);
-    auto masked_addr = byte_addr & addr_mask;
+  // Returns the bytes from `addr` to the end of the segment containing
+  // `addr`, or an empty list if `addr` isn't in any segment.
+  llvm::ArrayRef<uint8_t> BytesAt(uint64_t addr) const {
+    auto seg_it = FindSegmentAfter(addr);
+    if (seg_it == segments.begin()) {
+      return {};
+    }
+    --seg_it;
+    const auto offset = addr - seg_it->base;
+    if (offset < seg_it->bytes.size()) {
+      return seg_it->bytes.drop_front(offset);
+    } else {
+      return {};
+    }
+  }
 
-    // Make sure that if a really big number is specified for `--address`,
-    // that we don't accidentally wrap around and start filling out low
-    // byte addresses.
-    if (masked_addr < byte_addr) {
-      std::cerr << "Too many bytes specified to --bytes, would result "
-                << "in a 32-bit overflow.";
-      exit(EXIT_FAILURE);
+ private:
+  // Returns the first segment whose base address is greater than `addr`.
+  std::vector<Segment>::const_iterator FindSegmentAfter(uint64_t addr) const {
+    return std::upper_bound(
+        segments.begin(), segments.end(), addr,
+        [](uint64_t lhs, const Segment &rhs) { return lhs < rhs.base; });
+  }
+
+  std::vector<Segment> segments;
+};
+
+// What `--stats` reports about a run. The phases are timed by `remill-lift`,
+// and the lifting pipeline adds its own counters and timers to `pipeline`.
+struct RunStatistics {
+  remill::LiftStatistics pipeline;
+  uint64_t input_bytes{0};
+  double load_semantics_seconds{0};
+  double lift_seconds{0};
+  double optimize_seconds{0};
+  double move_seconds{0};
+  double slice_seconds{0};
+  double store_seconds{0};
+
+  // The number of jobs whose lifted code was found in the `--cache_dir`.
+  uint64_t cached_jobs{0};
+
+  void Add(const RunStatistics &other) {
+    pipeline.Add(other.pipeline);
+    input_bytes += other.input_bytes;
+    cached_jobs += other.cached_jobs;
+    load_semantics_seconds += other.load_semantics_seconds;
+    lift_seconds += other.lift_seconds;
+    optimize_seconds += other.optimize_seconds;
+    move_seconds += other.move_seconds;
+    slice_seconds += other.slice_seconds;
+    store_seconds += other.store_seconds;
+  }
+};
+
+// Returns the peak resident set size of this process, in bytes, or zero if
+// it isn't known.
+static uint64_t PeakResidentSetSize(void) {
+#ifndef _WIN32
+  rusage usage = {};
+  if (getrusage(RUSAGE_SELF, &usage)) {
+    return 0;
+  }
+#  ifdef __APPLE__
+  return static_cast<uint64_t>(usage.ru_maxrss);
+#  else
+  return static_cast<uint64_t>(usage.ru_maxrss) * 1024u;
+#  endif
+#else
+  return 0;
+#endif
+}
+
+// Count the heap allocations of the lifting pipeline into the `--stats`. This
+// only costs a thread-local load outside of a `StatisticsAllocationScope`,
+// i.e. when `--stats` isn't used.
+void *operator new(size_t size) {
+  remill::CountStatisticsAllocation(size);
+  if (auto ptr = std::malloc(size ? size : 1)) {
+    return ptr;
+  }
+  throw std::bad_alloc();
+}
+
+void *operator new[](size_t size) {
+  return ::operator new(size);
+}
+
+void operator delete(void *ptr) noexcept {
+  std::free(ptr);
+}
+
+void operator delete[](void *ptr) noexcept {
+  std::free(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept {
+  std::free(ptr);
+}
+
+void operator delete[](void *ptr, size_t) noexcept {
+  std::free(ptr);
+}
+
+// Save the `--stats` report of `stats`, for a run that took `total_seconds`.
+static void ReportStatistics(const RunStatistics &stats,
+                             double total_seconds) {
+  std::ofstream file;
+  if (!FLAGS_stats_out.empty()) {
+    file.open(FLAGS_stats_out);
+    if (!file) {
+      LOG(ERROR) << "Could not open --stats_out " << FLAGS_stats_out;
+      return;
+    }
+  }
+  std::ostream &os = FLAGS_stats_out.empty() ? std::cerr : file;
+
+  const std::pair<const char *, double> phases[] = {
+      {"load_semantics_seconds", stats.load_semantics_seconds},
+      {"lift_seconds", stats.lift_seconds},
+      {"optimize_seconds", stats.optimize_seconds},
+      {"move_seconds", stats.move_seconds},
+      {"slice_seconds", stats.slice_seconds},
+      {"store_seconds", stats.store_seconds},
+      {"total_seconds", total_seconds}};
+
+  if (FLAGS_stats == "json") {
+    os << "{\"input_bytes\": " << stats.input_bytes
+       << ", \"cached_jobs\": " << stats.cached_jobs
+       << ", \"peak_rss_bytes\": " << PeakResidentSetSize()
+       << ", \"phases\": {";
+    const char *sep = "";
+    for (const auto &[name, seconds] : phases) {
+      os << sep << '"' << name << "\": " << seconds;
+      sep = ", ";
+    }
+    os << "}, \"pipeline\": ";
+    stats.pipeline.PrintJSON(os);
+    os << "}" << std::endl;
+
+  } else {
+    os << "input_bytes: " << stats.input_bytes << '\n'
+       << "cached_jobs: " << stats.cached_jobs << '\n'
+       << "peak_rss_bytes: " << PeakResidentSetSize() << '\n';
+    for (const auto &[name, seconds] : phases) {
+      os << name << ": " << seconds << '\n';
+    }
+    stats.pipeline.Print(os);
+    os.flush();
+  }
+}
+
+// Returns the name of the `num`th of several files that are saved in place
+// of `path`, e.g. `out.2.bc` for `out.bc`.
+static std::string NumberedFileName(const std::string &path,
+                                    const std::string &extension,
+                                    unsigned num) {
+  auto base = path;
+  auto ext = std::string();
+  if (base.size() > extension.size() &&
+      !base.compare(base.size() - extension.size(), extension.size(),
+                    extension)) {
+    base.resize(base.size() - extension.size());
+    ext = extension;
+  }
+  return base + "." + std::to_string(num) + ext;
+}
+
+// Add a dispatch table of the traces in `trace_names` that `module` still
+// defines, for `--dispatch_table`.
+static void AddDispatchTable(
+    llvm::Module *module,
+    const std::vector<std::pair<uint64_t, std::string>> &trace_names) {
+
+  // Traces may have been inlined and deleted when making a slice.
+  std::vector<std::pair<uint64_t, llvm::Function *>> traces;
+  for (const auto &[addr, name] : trace_names) {
+    if (auto func = module->getFunction(name); func && !func->isDeclaration()) {
+      traces.emplace_back(addr, func);
+    }
+  }
+  remill::AddDispatchTable(module, traces);
+}
+
+// Split the traces in `trace_names`, which is sorted by trace address, into
+// up to `--bc_out_parts` ranges of the traces that `module` defines.
+static std::vector<std::vector<llvm::Function *>> PartitionTraces(
+    llvm::Module *module,
+    const std::vector<std::pair<uint64_t, std::string>> &trace_names) {
+
+  // Traces may have been inlined and deleted when making a slice.
+  std::vector<llvm::Function *> funcs;
+  for (const auto &[addr, name] : trace_names) {
+    if (auto func = module->getFunction(name); func && !func->isDeclaration()) {
+      funcs.push_back(func);
+    }
+  }
+
+  const auto num_parts = std::max<size_t>(
+      1u, std::min<size_t>(FLAGS_bc_out_parts, funcs.size()));
+  std::vector<std::vector<llvm::Function *>> parts(num_parts);
+  for (size_t i = 0; i < funcs.size(); ++i) {
+    parts[(i * num_parts) / funcs.size()].push_back(funcs[i]);
+  }
+  return parts;
+}
+
+// Split the lifted code in `module` into `--bc_out_parts` modules, each with
+// a range of the traces in `trace_names`, which is sorted by trace address,
+// and save them in parallel in place of `bc_out`.
+static bool StoreBitcodeParts(
+    llvm::Module *module, const std::string &bc_out,
+    const std::vector<std::pair<uint64_t, std::string>> &trace_names) {
+  auto split_modules =
+      remill::SplitModule(module, PartitionTraces(module, trace_names));
+  std::vector<llvm::Module *> modules;
+  std::vector<std::string> file_names;
+  for (auto &split_module : split_modules) {
+    file_names.push_back(NumberedFileName(bc_out, ".bc", modules.size()));
+    modules.push_back(split_module.get());
+  }
+  return remill::StoreModulesToFiles(modules, file_names, 0, true);
+}
+
+// Compile the lifted code in `module` into `--bc_out_parts` native object
+// files, split like `StoreBitcodeParts` does, in place of `obj_out`.
+static bool EmitObjectParts(
+    llvm::Module *module, const std::string &obj_out,
+    const std::vector<std::pair<uint64_t, std::string>> &trace_names) {
+  const auto parts = PartitionTraces(module, trace_names);
+  std::vector<std::string> file_names;
+  for (size_t i = 0; i < parts.size(); ++i) {
+    file_names.push_back(NumberedFileName(obj_out, ".o", i));
+  }
+  return remill::EmitObjectFiles(module, parts, file_names, {}, true);
+}
+
+// Maps each character to the value of the hex digit that it represents, or
+// to `kNotHex`. The invalid value has its high bits set, so that one test of
+// both digits of a byte finds either of them being invalid.
+static constexpr uint8_t kNotHex = 0xFF;
+
+struct HexDigitTable {
+  constexpr HexDigitTable(void) : values() {
+    for (auto &val : values) {
+      val = kNotHex;
+    }
+    for (uint8_t i = 0; i < 10; ++i) {
+      values['0' + i] = i;
+    }
+    for (uint8_t i = 0; i < 6; ++i) {
+      values['a' + i] = static_cast<uint8_t>(10 + i);
+      values['A' + i] = static_cast<uint8_t>(10 + i);
+    }
+  }
+
+  uint8_t values[256];
+};
+
+static constexpr HexDigitTable kHexDigits;
+
+// Unhexlify the `hex` bytes located at `address`, which come from `source`,
+// e.g. `--bytes`, into `bytes`. Returns an error message, or an empty string
+// if the bytes are valid.
+static std::string TryUnhexlifyInputBytes(const std::string &hex,
+                                          uint64_t address, uint64_t addr_mask,
+                                          const std::string &source,
+                                          std::vector<uint8_t> &bytes) {
+  std::stringstream err;
+  if (hex.size() % 2) {
+    err << "Please specify an even number of nibbles to " << source << ".";
+    return err.str();
+  }
+
+  // Make sure that if a really big number is specified for `--address`,
+  // that we don't accidentally wrap around and start filling out low
+  // byte addresses.
+  const auto num_bytes = hex.size() / 2;
+  if (num_bytes) {
+    const auto last_addr = address + (num_bytes - 1);
+    if (last_addr < address) {
+      err << "Too many bytes specified to " << source
+          << ", would result in a 64-bit overflow.";
+      return err.str();
+
+    } else if ((last_addr & addr_mask) != last_addr) {
+      err << "Too many bytes specified to " << source
+          << ", would result in a 32-bit overflow.";
+      return err.str();
+    }
+  }
+
+  // Decode straight into `bytes`, which is what the memory segment of the
+  // bytes will refer to.
+  bytes.resize(num_bytes);
+  const auto digits = reinterpret_cast<const uint8_t *>(hex.data());
+  auto invalid = uint8_t(0);
+  for (size_t i = 0; i < num_bytes; ++i) {
+    const auto high = kHexDigits.values[digits[i * 2]];
+    const auto low = kHexDigits.values[digits[i * 2 + 1]];
+    invalid |= high | low;
+    bytes[i] = static_cast<uint8_t>((high << 4) | low);
+  }
 
-    } else if (masked_addr < FLAGS_address) {
-      std::cerr << "Too many bytes specified to --bytes, would result "
-                << "in a 64-bit overflow.";
+  // Only look for the first invalid digit if there is one, so that the loop
+  // above doesn't need to branch on each byte.
+  if (invalid & 0xF0) {
+    bytes.clear();
+    for (size_t i = 0; i < hex.size(); ++i) {
+      if (kHexDigits.values[digits[i]] == kNotHex) {
+        err << "Invalid hex digit '" << hex[i] << "' at offset " << i
+            << " of the hex byte value '" << hex.substr(i & ~size_t(1), 2)
+            << "' specified in " << source << ".";
+        return err.str();
+      }
+    }
+  }
+
+  return {};
+}
+
+// Unhexlify the `hex` bytes located at `address`, which come from `source`,
+// exiting if they are invalid.
+static std::vector<uint8_t> UnhexlifyInputBytes(const std::string &hex,
+                                                uint64_t address,
+                                                uint64_t addr_mask,
+                                                const std::string &source) {
+  std::vector<uint8_t> bytes;
+  const auto err =
+      TryUnhexlifyInputBytes(hex, address, addr_mask, source, bytes);
+  if (!err.empty()) {
+    std::cerr << err << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  return bytes;
+}
+
+// Add the `bytes` located at `addr` to `memory`, making sure that they don't
+// wrap around the end of the address space.
+static void AddInputBytes(Memory &memory, uint64_t addr,
+                          llvm::ArrayRef<uint8_t> bytes, uint64_t addr_mask) {
+  if (bytes.empty()) {
+    return;
+  }
+  const auto last_addr = addr + (bytes.size() - 1);
+  if (last_addr < addr || last_addr != (last_addr & addr_mask)) {
+    std::cerr << "The " << bytes.size() << " bytes at address " << std::hex
+              << addr << std::dec << " in --input overflow the "
+              << (addr_mask >> 32 ? 64 : 32) << "-bit address space."
+              << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  memory.AddSegment(addr, bytes);
+}
+
+// Add the executable sections of `obj` to `memory`, and return the entry
+// point of `obj`, or `--address` if it has none.
+static uint64_t LoadObjectFile(Memory &memory,
+                               const llvm::object::ObjectFile &obj,
+                               uint64_t addr_mask) {
+  for (const auto &section : obj.sections()) {
+    if (!section.isText() || section.isVirtual()) {
+      continue;
+    }
+    auto contents = section.getContents();
+    if (!contents) {
+      std::cerr << "Could not get the contents of a section in --input "
+                << FLAGS_input << ": "
+                << llvm::toString(contents.takeError()) << std::endl;
       exit(EXIT_FAILURE);
     }
+    AddInputBytes(memory, section.getAddress(),
+                  llvm::arrayRefFromStringRef(*contents), addr_mask);
+  }
+
+  if (memory.empty()) {
+    std::cerr << "No executable sections found in --input " << FLAGS_input
+              << std::endl;
+    exit(EXIT_FAILURE);
+  }
+
+  if (auto start = obj.getStartAddress()) {
+    return *start;
+  } else {
+    llvm::consumeError(start.takeError());
+    return FLAGS_address;
+  }
+}
 
-    memory[byte_addr] = static_cast<uint8_t>(byte_val);
+// Memory-map the file passed to `--input`, and add the bytes to lift from it
+// to `memory`. Returns the mapped file, which must outlive `memory`, and
+// updates `entry_address` with the default entry point of the file.
+static std::unique_ptr<llvm::MemoryBuffer>
+LoadInputFile(Memory &memory, uint64_t addr_mask, uint64_t *entry_address) {
+  if (FLAGS_input_format != "auto" && FLAGS_input_format != "raw" &&
+      FLAGS_input_format != "object") {
+    std::cerr << "Invalid --input_format value: " << FLAGS_input_format
+              << std::endl;
+    exit(EXIT_FAILURE);
+  }
+
+#if LLVM_VERSION_NUMBER >= LLVM_VERSION(13, 0)
+  auto maybe_buffer = llvm::MemoryBuffer::getFile(
+      FLAGS_input, false /* IsText */, false /* RequiresNullTerminator */);
+#else
+  auto maybe_buffer = llvm::MemoryBuffer::getFile(
+      FLAGS_input, -1 /* FileSize */, false /* RequiresNullTerminator */);
+#endif
+  if (!maybe_buffer) {
+    std::cerr << "Could not open --input " << FLAGS_input << ": "
+              << maybe_buffer.getError().message() << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  auto buffer = std::move(maybe_buffer.get());
+
+  *entry_address = FLAGS_address;
+  if (FLAGS_input_format != "raw") {
+    auto binary = llvm::object::createBinary(buffer->getMemBufferRef());
+    if (binary) {
+      auto obj = llvm::dyn_cast<llvm::object::ObjectFile>(binary->get());
+      if (!obj) {
+        std::cerr << "The --input " << FLAGS_input << " is not an ELF, "
+                  << "Mach-O, or PE/COFF object file." << std::endl;
+        exit(EXIT_FAILURE);
+      }
+      *entry_address = LoadObjectFile(memory, *obj, addr_mask);
+      return buffer;
+
+    } else if (FLAGS_input_format == "object") {
+      std::cerr << "Could not parse --input " << FLAGS_input << ": "
+                << llvm::toString(binary.takeError()) << std::endl;
+      exit(EXIT_FAILURE);
+    }
+    llvm::consumeError(binary.takeError());
   }
 
-  return memory;
+  AddInputBytes(memory, FLAGS_address,
+                llvm::arrayRefFromStringRef(buffer->getBuffer()), addr_mask);
+  return buffer;
 }
 
 class SimpleTraceManager : public remill::TraceManager {
  public:
   virtual ~SimpleTraceManager(void) = default;
 
-  explicit SimpleTraceManager(Memory &memory_) : memory(memory_) {}
+  explicit SimpleTraceManager(const Memory &memory_) : memory(memory_) {}
 
  protected:
   // Called when we have lifted, i.e. defined the contents, of a new trace.
@@ -137,9 +830,20 @@ class SimpleTraceManager : public remill::TraceManager {
     auto trace_it = traces.find(addr);
     if (trace_it != traces.end()) {
       return trace_it->second;
-    } else {
-      return nullptr;
     }
+
+    // Transfers into the code of other architectures are left as calls to
+    // the declarations of their traces, which are lifted by another lifter.
+    // Returning a declaration tells the lifter not to lift it.
+    if (other_arch_memory && memory.BytesAt(addr).empty() &&
+        !other_arch_memory->BytesAt(addr).empty()) {
+      const auto name = TraceName(addr);
+      if (auto func = module->getFunction(name)) {
+        return func;
+      }
+      return remill::DeclareLiftedFunction(module, name);
+    }
+    return nullptr;
   }
 
   // Get a definition for a lifted trace.
@@ -153,34 +857,271 @@ class SimpleTraceManager : public remill::TraceManager {
   // at address `addr` is executable and readable, and updates the byte
   // pointed to by `byte` with the read value.
   bool TryReadExecutableByte(uint64_t addr, uint8_t *byte) override {
-    auto byte_it = memory.find(addr);
-    if (byte_it != memory.end()) {
-      *byte = byte_it->second;
+    const auto bytes = memory.BytesAt(addr);
+    if (!bytes.empty()) {
+      *byte = bytes.front();
       return true;
     } else {
       return false;
     }
   }
 
+  // Try to read up to `size` contiguous executable bytes starting at address
+  // `addr`. This returns a view into the segment containing `addr`, so that
+  // decoding doesn't copy the bytes.
+  std::string_view TryReadExecutableBytes(uint64_t addr, size_t size,
+                                          std::string &buffer) override {
+    const auto bytes = memory.BytesAt(addr);
+    if (bytes.empty() || bytes.size() >= size) {
+      return std::string_view(reinterpret_cast<const char *>(bytes.data()),
+                              std::min(bytes.size(), size));
+    }
+
+    // The bytes may continue into the next segment.
+    return TraceManager::TryReadExecutableBytes(addr, size, buffer);
+  }
+
  public:
-  Memory &memory;
+  const Memory &memory;
   std::unordered_map<uint64_t, llvm::Function *> traces;
+
+  // The code of other architectures, and the module into which traces are
+  // lifted, where the traces of that code are declared.
+  const Memory *other_arch_memory{nullptr};
+  llvm::Module *module{nullptr};
+};
+
+// A function to make from the lifted code, which calls the trace at
+// `entry_address` with the `inputs` registers as arguments, and returns the
+// `outputs` registers through pointer arguments.
+struct SliceSpec {
+  std::string name;
+  uint64_t entry_address;
+  std::vector<std::string> inputs;
+  std::vector<std::string> outputs;
 };
 
-// Looks for calls to a function like `__remill_function_return`, and
-// replace its state pointer with a null pointer so that the state
-// pointer never escapes.
-static void MuteStateEscape(llvm::Module *module, const char *func_name) {
-  auto func = module->getFunction(func_name);
-  if (!func) {
+// The code to lift in one job, and where to save the lifted code.
+struct LiftJob {
+  Memory memory;
+
+  // The unhexlified bytes that `memory` refers to, if any.
+  std::vector<uint8_t> bytes;
+
+  // Where to start lifting. The first address is the entry point of the
+  // slice, if one is made.
+  std::vector<uint64_t> entry_addresses;
+
+  std::string ir_out;
+  std::string bc_out;
+  std::string obj_out;
+
+  // The code of other architectures, to which this code may transfer
+  // control, for `--regions`.
+  const Memory *other_arch_memory{nullptr};
+
+  // The slices to make of the lifted code, if any.
+  std::vector<SliceSpec> slices;
+
+  // Where to accumulate the `--stats` of lifting this job, if anywhere.
+  RunStatistics *stats{nullptr};
+};
+
+// The node of a distributed run that this is, and the number of nodes, from
+// the `--shard`. Each node lifts every `gNumShards`th job of the `--jobs`.
+static unsigned gShardIndex = 0;
+static unsigned gNumShards = 1;
+
+// Returns `true` if the `num`th job of the `--jobs` is lifted by this node.
+static bool IsInShard(size_t num) {
+  return num % gNumShards == gShardIndex;
+}
+
+// Parse the `--shard`, i.e. 'I/N'. Returns `false` if it is invalid.
+static bool ParseShard(void) {
+  const auto [index_str, count_str] = llvm::StringRef(FLAGS_shard).split('/');
+  unsigned index = 0;
+  unsigned count = 0;
+  if (index_str.trim().getAsInteger(10, index) ||
+      count_str.trim().getAsInteger(10, count) || index >= count) {
+    return false;
+  }
+  gShardIndex = index;
+  gNumShards = count;
+  return true;
+}
+
+// Parse an address, where hex addresses have a `0x` prefix. Returns `false`
+// if `str` isn't an address that fits into `addr_mask`.
+static bool TryParseAddress(llvm::StringRef str, uint64_t addr_mask,
+                            uint64_t &addr) {
+  return !str.trim().getAsInteger(0, addr) && addr == (addr & addr_mask);
+}
+
+// Parse an address from `source`, exiting if it is invalid.
+static uint64_t ParseAddress(llvm::StringRef str, uint64_t addr_mask,
+                             const std::string &source) {
+  uint64_t addr = 0;
+  if (!TryParseAddress(str, addr_mask, addr)) {
+    std::cerr << "Invalid address '" << str.trim().str() << "' in " << source
+              << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  return addr;
+}
+
+// Call `cb` with each line of the file `path`, and its line number, skipping
+// blank lines and `#` comments.
+template <typename CB>
+static void ForEachLine(const std::string &path, CB cb) {
+  std::ifstream file(path);
+  if (!file) {
+    std::cerr << "Could not open " << path << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  std::string line;
+  for (unsigned line_num = 1; std::getline(file, line); ++line_num) {
+    const auto trimmed = llvm::StringRef(line).trim();
+    if (!trimmed.empty() && !trimmed.startswith("#")) {
+      cb(trimmed, line_num);
+    }
+  }
+}
+
+// Append the addresses listed in `--entry_addresses` to `entry_addresses`.
+static void ReadEntryAddresses(std::vector<uint64_t> &entry_addresses,
+                               uint64_t addr_mask) {
+  ForEachLine(FLAGS_entry_addresses, [&](llvm::StringRef line,
+                                         unsigned line_num) {
+    const auto source =
+        FLAGS_entry_addresses + ":" + std::to_string(line_num);
+    entry_addresses.push_back(ParseAddress(line, addr_mask, source));
+  });
+}
+
+// Returns the register names in the `sep`-separated list `names`.
+static std::vector<std::string> SplitRegisterNames(llvm::StringRef names,
+                                                   char sep) {
+  llvm::SmallVector<llvm::StringRef, 4> parts;
+  names.split(parts, sep, -1, false /* KeepEmpty */);
+  std::vector<std::string> reg_names;
+  for (auto part : parts) {
+    if (!part.trim().empty()) {
+      reg_names.push_back(part.trim().str());
+    }
+  }
+  return reg_names;
+}
+
+// Add the slice described by `--slice_inputs` and `--slice_outputs`, if
+// any, to `job`. The slice starts at the first entry address of `job`.
+static void AddFlagSlice(LiftJob &job) {
+  if (FLAGS_slice_inputs.empty() && FLAGS_slice_outputs.empty()) {
     return;
   }
+  SliceSpec slice = {"slice", job.entry_addresses.front(),
+                     SplitRegisterNames(FLAGS_slice_inputs, ','),
+                     SplitRegisterNames(FLAGS_slice_outputs, ',')};
+  CHECK(!(slice.inputs.empty() && slice.outputs.empty()))
+      << "Empty lists passed to both --slice_inputs and --slice_outputs";
+  job.slices.push_back(std::move(slice));
+}
+
+// Add the slices of the `--slices` manifest to `job`, along with their entry
+// addresses, so that their traces are lifted.
+static void ReadSlices(LiftJob &job, uint64_t addr_mask) {
+  ForEachLine(FLAGS_slices, [&](llvm::StringRef line, unsigned line_num) {
+    const auto source = FLAGS_slices + ":" + std::to_string(line_num);
+    llvm::SmallVector<llvm::StringRef, 4> fields;
+    line.split(fields, ',');
+    if (fields.size() != 4 || fields[0].trim().empty()) {
+      std::cerr << "Expected 'name,entry_address,inputs,outputs' in "
+                << source << std::endl;
+      exit(EXIT_FAILURE);
+    }
 
-  for (auto user : func->users()) {
-    if (auto call_inst = llvm::dyn_cast<llvm::CallInst>(user)) {
-      auto arg_op = call_inst->getArgOperand(remill::kStatePointerArgNum);
-      call_inst->setArgOperand(remill::kStatePointerArgNum,
-                               llvm::UndefValue::get(arg_op->getType()));
+    SliceSpec slice = {fields[0].trim().str(),
+                       ParseAddress(fields[1], addr_mask, source),
+                       SplitRegisterNames(fields[2], ' '),
+                       SplitRegisterNames(fields[3], ' ')};
+    if (slice.inputs.empty() && slice.outputs.empty()) {
+      std::cerr << "Empty lists of input and output registers in " << source
+                << std::endl;
+      exit(EXIT_FAILURE);
+    }
+
+    auto &addrs = job.entry_addresses;
+    if (std::find(addrs.begin(), addrs.end(), slice.entry_address) ==
+        addrs.end()) {
+      addrs.push_back(slice.entry_address);
+    }
+    job.slices.push_back(std::move(slice));
+  });
+}
+
+// Read the jobs of the `--jobs` manifest into `jobs`.
+static void ReadJobs(std::deque<LiftJob> &jobs, uint64_t addr_mask) {
+  ForEachLine(FLAGS_jobs, [&](llvm::StringRef line, unsigned line_num) {
+
+    // The jobs of the other nodes of a `--shard` are left empty, but keep
+    // their numbers.
+    if (!IsInShard(jobs.size())) {
+      jobs.emplace_back();
+      return;
+    }
+
+    const auto source = FLAGS_jobs + ":" + std::to_string(line_num);
+    llvm::SmallVector<llvm::StringRef, 3> fields;
+    line.split(fields, ',');
+    if (fields.size() != 3) {
+      std::cerr << "Expected 'address,entry_address,bytes' in " << source
+                << std::endl;
+      exit(EXIT_FAILURE);
+    }
+
+    const auto num = static_cast<unsigned>(jobs.size());
+    auto &job = jobs.emplace_back();
+    const auto addr = ParseAddress(fields[0], addr_mask, source);
+    job.entry_addresses.push_back(
+        fields[1].trim().empty() ? addr
+                                 : ParseAddress(fields[1], addr_mask, source));
+    job.bytes =
+        UnhexlifyInputBytes(fields[2].trim().str(), addr, addr_mask, source);
+    job.memory.AddSegment(addr, job.bytes);
+    if (!FLAGS_ir_out.empty()) {
+      job.ir_out = NumberedFileName(FLAGS_ir_out, ".ll", num);
+    }
+    if (!FLAGS_bc_out.empty()) {
+      job.bc_out = NumberedFileName(FLAGS_bc_out, ".bc", num);
+    }
+    if (!FLAGS_obj_out.empty()) {
+      job.obj_out = NumberedFileName(FLAGS_obj_out, ".o", num);
+    }
+    AddFlagSlice(job);
+  });
+}
+
+// Inline each of the lifted `traces` that `func` calls into it once. The
+// other calls to a trace, e.g. the back edges of loops that span several
+// traces, remain calls.
+static void
+InlineTracesOnce(llvm::Function *func,
+                 const std::unordered_set<llvm::Function *> &traces) {
+  std::unordered_set<llvm::Function *> inlined;
+  for (auto changed = true; changed;) {
+    changed = false;
+    for (auto &inst : llvm::instructions(*func)) {
+      auto call = llvm::dyn_cast<llvm::CallInst>(&inst);
+      if (!call) {
+        continue;
+      }
+      auto callee = call->getCalledFunction();
+      if (callee && traces.count(callee) && inlined.insert(callee).second) {
+        llvm::InlineFunctionInfo info;
+        (void) llvm::InlineFunction(call, info);
+        changed = true;
+        break;
+      }
     }
   }
 }
@@ -210,236 +1151,1371 @@ static void SetVersion(void) {
   google::SetVersionString(ss.str());
 }
 
-int main(int argc, char *argv[]) {
-  SetVersion();
-  google::ParseCommandLineFlags(&argc, &argv, true);
-  google::InitGoogleLogging(argv[0]);
-
+// Create the function `slice.name` in `dest_module`, which calls
+// `entry_trace` with a `State` structure on the stack, passes the input
+// registers of `slice` as arguments, and returns its output registers
+// through pointer arguments. If the lifted code has been rewritten to use
+// the `reduced` structure, then only that structure is allocated, and the
+// registers that aren't in it are neither stored nor loaded.
+static void MakeSlice(const remill::Arch *arch, llvm::Module *dest_module,
+                      llvm::Function *entry_trace, const SliceSpec &slice,
+                      const remill::ReducedState *reduced,
+                      const std::unordered_set<llvm::Function *> &traces) {
+  auto &context = dest_module->getContext();
+  const auto state_ptr_type = arch->StatePointerType();
+  const auto mem_ptr_type = arch->MemoryPointerType();
 
-  if (FLAGS_bytes.empty()) {
-    std::cerr << "Please specify a sequence of hex bytes to --bytes."
-              << std::endl;
-    return EXIT_FAILURE;
+  std::vector<const remill::Register *> input_regs;
+  std::vector<const remill::Register *> output_regs;
+  for (const auto &reg_name : slice.inputs) {
+    const auto reg = arch->RegisterByName(reg_name);
+    CHECK(reg != nullptr) << "Invalid register name '" << reg_name
+                          << "' used in input slice list of " << slice.name;
+    input_regs.push_back(reg);
+  }
+  for (const auto &reg_name : slice.outputs) {
+    const auto reg = arch->RegisterByName(reg_name);
+    CHECK(reg != nullptr) << "Invalid register name '" << reg_name
+                          << "' used in output slice list of " << slice.name;
+    output_regs.push_back(reg);
   }
 
-  if (FLAGS_bytes.size() % 2) {
-    std::cerr << "Please specify an even number of nibbles to --bytes."
-              << std::endl;
-    return EXIT_FAILURE;
+  // Use the registers to build a function prototype. Outputs are "returned"
+  // by pointer through arguments.
+  llvm::SmallVector<llvm::Type *, 8> arg_types;
+  arg_types.push_back(mem_ptr_type);
+  for (auto reg : input_regs) {
+    arg_types.push_back(reg->type);
+  }
+  for (auto reg : output_regs) {
+    arg_types.push_back(llvm::PointerType::get(reg->type, 0));
   }
 
-  if (!FLAGS_entry_address) {
-    FLAGS_entry_address = FLAGS_address;
+  const auto func_type =
+      llvm::FunctionType::get(mem_ptr_type, arg_types, false);
+  const auto func =
+      llvm::Function::Create(func_type, llvm::GlobalValue::ExternalLinkage,
+                             slice.name, dest_module);
+
+  auto entry = llvm::BasicBlock::Create(context, "", func);
+  llvm::IRBuilder<> ir(entry);
+
+  // Allocate the part of the `State` structure that the lifted code uses.
+  llvm::AllocaInst *state_alloca = nullptr;
+  llvm::Value *state_ptr = nullptr;
+  if (reduced) {
+    state_alloca = ir.CreateAlloca(reduced->type);
+    state_ptr = ir.CreateBitCast(state_alloca, state_ptr_type);
+  } else {
+    state_alloca = ir.CreateAlloca(state_ptr_type->getPointerElementType());
+    state_ptr = state_alloca;
   }
 
-  // Make sure `--address` and `--entry_address` are in-bounds for the target
-  // architecture's address size.
-  llvm::LLVMContext context;
-  auto arch = remill::Arch::Get(context, FLAGS_os, FLAGS_arch);
-  const uint64_t addr_mask = ~0ULL >> (64UL - arch->address_size);
-  if (FLAGS_address != (FLAGS_address & addr_mask)) {
-    std::cerr << "Value " << std::hex << FLAGS_address
-              << " passed to --address does not fit into 32-bits. Did mean"
-              << " to specify a 64-bit architecture to --arch?" << std::endl;
-    return EXIT_FAILURE;
+  // Returns a pointer to `reg` in the stack-allocated `State`, or `nullptr`
+  // if the lifted code never accesses `reg`.
+  const auto byte_ptr_type = llvm::Type::getInt8PtrTy(context);
+  auto reg_address = [&](const remill::Register *reg) -> llvm::Value * {
+    if (!reduced) {
+      auto reg_ptr = reg->AddressOf(state_ptr, entry);
+      ir.SetInsertPoint(entry);
+      return reg_ptr;
+    }
+    const auto offset = reduced->ReducedOffset(reg->offset);
+    if (offset == remill::ReducedState::kNotKept) {
+      return nullptr;
+    }
+    auto reg_ptr = ir.CreateConstInBoundsGEP1_64(
+        ir.getInt8Ty(), ir.CreateBitCast(state_ptr, byte_ptr_type), offset);
+    return ir.CreateBitCast(reg_ptr, llvm::PointerType::get(reg->type, 0));
+  };
+
+  const remill::Register *pc_reg =
+      arch->RegisterByName(arch->ProgramCounterRegisterName());
+
+  CHECK(pc_reg != nullptr)
+      << "Could not find the register in the state structure "
+      << "associated with the program counter.";
+
+  // Store the program counter into the state.
+  const auto trace_pc =
+      llvm::ConstantInt::get(pc_reg->type, slice.entry_address, false);
+  if (auto pc_reg_ptr = reg_address(pc_reg)) {
+    ir.CreateStore(trace_pc, pc_reg_ptr);
   }
 
-  if (FLAGS_entry_address != (FLAGS_entry_address & addr_mask)) {
-    std::cerr
-        << "Value " << std::hex << FLAGS_entry_address
-        << " passed to --entry_address does not fit into 32-bits. Did mean"
-        << " to specify a 64-bit architecture to --arch?" << std::endl;
-    return EXIT_FAILURE;
+  // Store the input arguments into the state.
+  auto args_it = func->arg_begin();
+  std::unordered_map<const remill::Register *, llvm::Value *> input_args;
+  for (auto reg : input_regs) {
+    auto &arg = *++args_it;  // Pre-increment, as first arg is memory pointer.
+    arg.setName(reg->name);
+    CHECK_EQ(arg.getType(), reg->type);
+    input_args[reg] = &arg;
+    if (auto reg_ptr = reg_address(reg)) {
+      ir.CreateStore(&arg, reg_ptr);
+    }
   }
 
-  std::unique_ptr<llvm::Module> module(remill::LoadArchSemantics(arch));
+  llvm::Value *mem_ptr = &*func->arg_begin();
+
+  llvm::Value *trace_args[remill::kNumBlockArgs] = {};
+  trace_args[remill::kStatePointerArgNum] = state_ptr;
+  trace_args[remill::kMemoryPointerArgNum] = mem_ptr;
+  trace_args[remill::kPCArgNum] = trace_pc;
+
+  mem_ptr = ir.CreateCall(entry_trace, trace_args);
+
+  // Go read all output registers out of the state and store them into the
+  // output parameters. The registers that the lifted code never accesses
+  // keep their input values.
+  for (auto reg : output_regs) {
+    auto &arg = *++args_it;
+    arg.setName(reg->name + "_output");
+    llvm::Value *val = nullptr;
+    if (auto reg_ptr = reg_address(reg)) {
+      val = ir.CreateLoad(reg_ptr);
+    } else if (input_args.count(reg)) {
+      val = input_args[reg];
+    } else {
+      val = llvm::UndefValue::get(reg->type);
+    }
+    ir.CreateStore(val, &arg);
+  }
 
-  const auto state_ptr_type = arch->StatePointerType();
-  const auto mem_ptr_type = arch->MemoryPointerType();
+  // Return the memory pointer, so that all memory accesses are
+  // preserved.
+  ir.CreateRet(mem_ptr);
+
+  // We want the stack-allocated `State` to be subject to scalarization and
+  // mem2reg, but to "encourage" that, we need to prevent it from escaping.
+  // Once the traces are inlined, it only escapes through the calls that
+  // leave the lifted code, after which its registers are read out above, and
+  // through the calls that remain, around which it is spilled.
+  InlineTracesOnce(func, traces);
+  remill::PrivatizeState(state_alloca, remill::ExitIntrinsicStateSlots);
+}
 
-  Memory memory = UnhexlifyInputBytes(addr_mask);
-  SimpleTraceManager manager(memory);
+// Lift `job` into `module`, which holds the semantics of `arch`, then move
+// the lifted code into a new module, and return it. The names of the lifted
+// traces, sorted by address, are saved into `trace_names`.
+static std::unique_ptr<llvm::Module>
+LiftToModule(const remill::Arch *arch, llvm::Module *module,
+             const LiftJob &job, remill::OptimizationGuide guide,
+             std::vector<std::pair<uint64_t, std::string>> &trace_names) {
+  auto &context = module->getContext();
+
+  SimpleTraceManager manager(job.memory);
+  manager.other_arch_memory = job.other_arch_memory;
+  manager.module = module;
   remill::IntrinsicTable intrinsics(module);
   remill::InstructionLifter inst_lifter(arch, intrinsics);
+  inst_lifter.SetNativeAtomics(FLAGS_native_atomics);
+  inst_lifter.SetGuestPCDebugLocations(FLAGS_guest_pc_debug_locations);
   remill::TraceLifter trace_lifter(inst_lifter, manager);
+  trace_lifter.SetFuseInstructions(FLAGS_fuse_instructions);
+  trace_lifter.SetSplitColdExits(FLAGS_split_cold_exits);
+
+  const auto stats = job.stats;
+  if (stats) {
+    stats->input_bytes += job.memory.size();
+    trace_lifter.SetStatistics(&(stats->pipeline));
+    guide.stats = &(stats->pipeline);
+  }
 
-  // Lift all discoverable traces starting from `--entry_address` into
-  // `module`.
-  trace_lifter.Lift(FLAGS_entry_address);
+  // Optimize each trace in the background as soon as it is lifted, rather
+  // than optimizing the whole module once lifting is done.
+  std::unique_ptr<remill::BackgroundTraceOptimizer> background;
+  if (FLAGS_background_optimize_threads && job.slices.empty()) {
+    background = std::make_unique<remill::BackgroundTraceOptimizer>(
+        guide, FLAGS_background_optimize_threads);
+  }
 
-  // Optimize the module, but with a particular focus on only the functions
-  // that we actually lifted.
-  remill::OptimizationGuide guide = {};
-  guide.eliminate_dead_stores = true;
-  remill::OptimizeModule(arch, module, manager.traces, guide);
+  auto optimize_in_background = [&background](uint64_t addr,
+                                              llvm::Function *func) {
+    remill::InlineSemanticsIntoTrace(func);
+    background->Submit(addr, func);
+  };
+
+  // Lift all discoverable traces starting from each entry address into
+  // `module`. Traces that are reachable from several entries are lifted once.
+  {
+    remill::StatisticsTimer timer(stats ? &(stats->lift_seconds) : nullptr);
+    for (auto addr : job.entry_addresses) {
+      if (background) {
+        trace_lifter.Lift(addr, optimize_in_background);
+      } else {
+        trace_lifter.Lift(addr);
+      }
+    }
+  }
 
   // Create a new module in which we will move all the lifted functions. Prepare
   // the module for code of this architecture, i.e. set the data layout, triple,
   // etc.
-  llvm::Module dest_module("lifted_code", context);
-  arch->PrepareModuleDataLayout(&dest_module);
+  std::unique_ptr<llvm::Module> dest_module(
+      new llvm::Module("lifted_code", context));
+  arch->PrepareModuleDataLayout(dest_module.get());
+
+  // The traces were optimized while they were being lifted; wait for the
+  // last of them, and then copy them into the new module.
+  if (background) {
+    remill::StatisticsTimer timer(stats ? &(stats->optimize_seconds)
+                                        : nullptr);
+    background->MergeInto(dest_module.get());
+    background.reset();
+
+    trace_names.clear();
+    trace_names.reserve(manager.traces.size());
+    for (auto &lifted_entry : manager.traces) {
+      trace_names.emplace_back(lifted_entry.first,
+                               lifted_entry.second->getName().str());
+    }
+    std::sort(trace_names.begin(), trace_names.end());
+    return dest_module;
+  }
 
-  llvm::Function *entry_trace = nullptr;
-  const auto make_slice =
-      !FLAGS_slice_inputs.empty() || !FLAGS_slice_outputs.empty();
+  // Optimize the module, but with a particular focus on only the functions
+  // that we actually lifted.
+  {
+    remill::StatisticsTimer timer(stats ? &(stats->optimize_seconds)
+                                        : nullptr);
+    if (FLAGS_merge_identical_traces) {
+      remill::MergeIdenticalTraces(manager.traces);
+    }
+    remill::OptimizeModule(arch, module, manager.traces, guide);
+  }
 
   // Move the lifted code into a new module. This module will be much smaller
   // because it won't be bogged down with all of the semantics definitions.
   // This is a good JITing strategy: optimize the lifted code in the semantics
   // module, move it to a new module, instrument it there, then JIT compile it.
+  std::vector<llvm::Function *> lifted_funcs;
+  lifted_funcs.reserve(manager.traces.size());
   for (auto &lifted_entry : manager.traces) {
-    if (lifted_entry.first == FLAGS_entry_address) {
-      entry_trace = lifted_entry.second;
-    }
-    remill::MoveFunctionIntoModule(lifted_entry.second, &dest_module);
+    lifted_funcs.push_back(lifted_entry.second);
+  }
+  {
+    remill::StatisticsTimer timer(stats ? &(stats->move_seconds) : nullptr);
+    remill::StatisticsAllocationScope allocs(
+        stats ? &(stats->pipeline.util_alloc_bytes) : nullptr,
+        stats ? &(stats->pipeline.util_allocs) : nullptr);
+    remill::MoveFunctionsIntoModule(lifted_funcs, dest_module.get());
+  }
 
-    // If we are providing a prototype, then we'll be re-optimizing the new
-    // module, and we want everything to get inlined.
-    if (make_slice) {
-      lifted_entry.second->setLinkage(llvm::GlobalValue::InternalLinkage);
-      lifted_entry.second->removeFnAttr(llvm::Attribute::NoInline);
-      lifted_entry.second->addFnAttr(llvm::Attribute::InlineHint);
-      lifted_entry.second->addFnAttr(llvm::Attribute::AlwaysInline);
-    }
+  trace_names.clear();
+  trace_names.reserve(manager.traces.size());
+  for (auto &lifted_entry : manager.traces) {
+    trace_names.emplace_back(lifted_entry.first,
+                             lifted_entry.second->getName().str());
+  }
+  std::sort(trace_names.begin(), trace_names.end());
+
+  if (job.slices.empty()) {
+    return dest_module;
   }
 
-  // We have a prototype, so go create a function that will call our entrypoint.
-  if (make_slice) {
-    CHECK_NOTNULL(entry_trace);
+  remill::StatisticsTimer slice_timer(stats ? &(stats->slice_seconds)
+                                            : nullptr);
+  remill::StatisticsAllocationScope slice_allocs(
+      stats ? &(stats->pipeline.util_alloc_bytes) : nullptr,
+      stats ? &(stats->pipeline.util_allocs) : nullptr);
+
+  // We'll be re-optimizing the new module to make the slices, and we want
+  // everything to get inlined into them.
+  for (auto func : lifted_funcs) {
+    func->setLinkage(llvm::GlobalValue::InternalLinkage);
+    func->removeFnAttr(llvm::Attribute::NoInline);
+    func->addFnAttr(llvm::Attribute::InlineHint);
+    func->addFnAttr(llvm::Attribute::AlwaysInline);
+  }
 
-    llvm::SmallVector<llvm::StringRef, 4> input_reg_names;
-    llvm::SmallVector<llvm::StringRef, 4> output_reg_names;
-    llvm::StringRef(FLAGS_slice_inputs)
-        .split(input_reg_names, ',', -1, false /* KeepEmpty */);
-    llvm::StringRef(FLAGS_slice_outputs)
-        .split(output_reg_names, ',', -1, false /* KeepEmpty */);
+  // Shrink the `State` structure down to the registers that the lifted code
+  // accesses, so that the slices only allocate those. This needs every
+  // access to be at a constant offset, which is usually the case once dead
+  // stores have been eliminated; otherwise, the slices allocate the whole
+  // `State` structure.
+  const auto reduced = remill::ReduceStateStructure(arch, lifted_funcs);
+
+  const std::unordered_set<llvm::Function *> trace_set(lifted_funcs.begin(),
+                                                       lifted_funcs.end());
+
+  for (const auto &slice : job.slices) {
+    auto trace_it = manager.traces.find(slice.entry_address);
+    CHECK(trace_it != manager.traces.end())
+        << "No trace was lifted at the entry address " << std::hex
+        << slice.entry_address << std::dec << " of the slice " << slice.name;
+    MakeSlice(arch, dest_module.get(), trace_it->second, slice,
+              reduced ? &*reduced : nullptr, trace_set);
+  }
+
+  guide.slp_vectorize = true;
+  guide.loop_vectorize = true;
+  guide.eliminate_dead_stores = false;
+  remill::OptimizeBareModule(dest_module.get(), guide);
+
+  return dest_module;
+}
+
+// Lift `job` into `module`, which holds the semantics of `arch`, saving each
+// trace as soon as it is lifted, for `--stream_traces`. The semantics are
+// inlined into each trace while it is still in `module`, and the trace is
+// then optimized and saved on its own, so that only one lifted trace is ever
+// held in memory. Returns `false` if saving failed.
+static bool LiftStreaming(const remill::Arch *arch, llvm::Module *module,
+                          const LiftJob &job,
+                          remill::OptimizationGuide guide) {
+  SimpleTraceManager manager(job.memory);
+  manager.other_arch_memory = job.other_arch_memory;
+  manager.module = module;
+  remill::IntrinsicTable intrinsics(module);
+  remill::InstructionLifter inst_lifter(arch, intrinsics);
+  inst_lifter.SetNativeAtomics(FLAGS_native_atomics);
+  inst_lifter.SetGuestPCDebugLocations(FLAGS_guest_pc_debug_locations);
+  remill::TraceLifter trace_lifter(inst_lifter, manager);
+  trace_lifter.SetFuseInstructions(FLAGS_fuse_instructions);
+  trace_lifter.SetSplitColdExits(FLAGS_split_cold_exits);
+
+  // Dead store elimination needs the `State` structure of the semantics
+  // module, so it isn't done on the released traces.
+  guide.eliminate_dead_stores = false;
+
+  // The time spent optimizing and saving the released traces is taken out
+  // of the time spent lifting them.
+  const auto stats = job.stats;
+  double release_seconds = 0;
+  double total_seconds = 0;
+  if (stats) {
+    stats->input_bytes += job.memory.size();
+    trace_lifter.SetStatistics(&(stats->pipeline));
+    guide.stats = &(stats->pipeline);
+  }
 
-    CHECK(!(input_reg_names.empty() && output_reg_names.empty()))
-        << "Empty lists passed to both --slice_inputs and --slice_outputs";
+  auto ret = true;
+  unsigned num_traces = 0;
+  auto release = [&](uint64_t addr, llvm::Function *,
+                     std::unique_ptr<llvm::Module> trace_module) {
+    remill::StatisticsTimer release_timer(stats ? &release_seconds : nullptr);
+    const auto num = num_traces++;
+    {
+      remill::StatisticsTimer timer(stats ? &(stats->optimize_seconds)
+                                          : nullptr);
+      remill::OptimizeBareModule(trace_module.get(), guide);
+    }
 
-    // Use the registers to build a function prototype.
-    llvm::SmallVector<llvm::Type *, 8> arg_types;
-    arg_types.push_back(mem_ptr_type);
+    remill::StatisticsTimer timer(stats ? &(stats->store_seconds) : nullptr);
+    remill::TraceEventSpan span(stats ? stats->pipeline.events : nullptr,
+                                "write_bitcode", addr);
+    if (!job.ir_out.empty()) {
+      const auto path = NumberedFileName(job.ir_out, ".ll", num);
+      if (!remill::StoreModuleIRToFile(trace_module.get(), path, true)) {
+        LOG(ERROR) << "Could not save LLVM IR of trace " << std::hex << addr
+                   << std::dec << " to " << path;
+        ret = false;
+      }
+    }
+    if (!job.bc_out.empty()) {
+      const auto path = NumberedFileName(job.bc_out, ".bc", num);
+      if (!remill::StoreModuleToFile(trace_module.get(), path, true)) {
+        LOG(ERROR) << "Could not save LLVM bitcode of trace " << std::hex
+                   << addr << std::dec << " to " << path;
+        ret = false;
+      }
+    }
+  };
 
-    for (auto &reg_name : input_reg_names) {
-      const auto reg = arch->RegisterByName(reg_name.str());
-      CHECK(reg != nullptr)
-          << "Invalid register name '" << reg_name.str()
-          << "' used in input slice list '" << FLAGS_slice_inputs << "'";
+  auto inline_semantics = [](uint64_t, llvm::Function *func) {
+    remill::InlineSemanticsIntoTrace(func);
+  };
 
-      arg_types.push_back(reg->type);
+  {
+    remill::StatisticsTimer timer(stats ? &total_seconds : nullptr);
+    for (auto addr : job.entry_addresses) {
+      trace_lifter.LiftStreaming(addr, release, inline_semantics);
     }
+  }
 
-    const auto first_output_reg_index = arg_types.size();
+  if (stats) {
+    stats->lift_seconds += total_seconds - release_seconds;
+  }
+  return ret;
+}
 
-    // Outputs are "returned" by pointer through arguments.
-    for (auto &reg_name : output_reg_names) {
-      const auto reg = arch->RegisterByName(reg_name.str());
-      CHECK(reg != nullptr)
-          << "Invalid register name '" << reg_name.str()
-          << "' used in output slice list '" << FLAGS_slice_outputs << "'";
+// Save `dest_module`, the lifted code of `job`, to the outputs of `job`.
+// Returns `false` if saving failed.
+static bool SaveLiftedModule(
+    llvm::Module *dest_module, const LiftJob &job,
+    const std::vector<std::pair<uint64_t, std::string>> &trace_names) {
+  auto ret = true;
+  if (!job.ir_out.empty()) {
+    if (!remill::StoreModuleIRToFile(dest_module, job.ir_out, true)) {
+      LOG(ERROR) << "Could not save LLVM IR to " << job.ir_out;
+      ret = false;
+    }
+  }
+  if (!job.bc_out.empty() && 1 < FLAGS_bc_out_parts) {
+    if (!StoreBitcodeParts(dest_module, job.bc_out, trace_names)) {
+      LOG(ERROR) << "Could not save LLVM bitcode parts of " << job.bc_out;
+      ret = false;
+    }
+  } else if (!job.bc_out.empty()) {
+    if (!remill::StoreModuleToFile(dest_module, job.bc_out, true)) {
+      LOG(ERROR) << "Could not save LLVM bitcode to " << job.bc_out;
+      ret = false;
+    }
+  }
 
-      arg_types.push_back(llvm::PointerType::get(reg->type, 0));
+  // Splitting the module for the object files changes the linkage of its
+  // local definitions, and so this comes after saving the bitcode.
+  if (!job.obj_out.empty() && 1 < FLAGS_bc_out_parts) {
+    if (!EmitObjectParts(dest_module, job.obj_out, trace_names)) {
+      LOG(ERROR) << "Could not save object code parts of " << job.obj_out;
+      ret = false;
     }
+  } else if (!job.obj_out.empty()) {
+    if (!remill::EmitObjectFile(dest_module, job.obj_out, {}, true)) {
+      LOG(ERROR) << "Could not save object code to " << job.obj_out;
+      ret = false;
+    }
+  }
+  return ret;
+}
 
-    const auto state_type = state_ptr_type->getPointerElementType();
-    const auto func_type =
-        llvm::FunctionType::get(mem_ptr_type, arg_types, false);
-    const auto func = llvm::Function::Create(
-        func_type, llvm::GlobalValue::ExternalLinkage, "slice", &dest_module);
+// Mix `val` into `hash`.
+static uint64_t HashCombine(uint64_t hash, uint64_t val) {
+  return hash ^ (val + 0x9E3779B97F4A7C15ull + (hash << 6) + (hash >> 2));
+}
+
+static uint64_t HashString(std::string_view str) {
+  return llvm::xxHash64(llvm::StringRef(str.data(), str.size()));
+}
 
-    // Store all of the function arguments (corresponding with specific registers)
-    // into the stack-allocated `State` structure.
-    auto entry = llvm::BasicBlock::Create(context, "", func);
-    llvm::IRBuilder<> ir(entry);
+// Returns the hash of the semantics of `arch`, against which all of its
+// cached code was lifted. The semantics file is only hashed once per
+// architecture and OS.
+static uint64_t SemanticsHash(const remill::Arch *arch) {
+  static std::mutex lock;
+  static std::unordered_map<std::string, uint64_t> hashes;
+
+  const auto arch_name = remill::GetArchName(arch->arch_name);
+  const auto os_name = remill::GetOSName(arch->os_name);
+  std::string key(arch_name);
+  key.append(1, ',').append(os_name.data(), os_name.size());
+
+  std::lock_guard<std::mutex> locker(lock);
+  if (auto it = hashes.find(key); it != hashes.end()) {
+    return it->second;
+  }
 
-    const auto state_ptr = ir.CreateAlloca(state_type);
+  const auto sem_path = remill::FindSemanticsBitcodeFile(arch_name);
+  auto sem_buff = llvm::MemoryBuffer::getFile(sem_path);
+  CHECK(sem_buff) << "Could not read semantics bitcode file " << sem_path;
 
-    const remill::Register *pc_reg =
-        arch->RegisterByName(arch->ProgramCounterRegisterName());
+  auto hash = llvm::xxHash64(sem_buff.get()->getBuffer());
+  hash = HashCombine(hash, HashString(key));
+  hash = HashCombine(hash, HashString(remill::version::GetCommitHash()));
+  hashes.emplace(key, hash);
+  return hash;
+}
 
-    CHECK(pc_reg != nullptr)
-        << "Could not find the register in the state structure "
-        << "associated with the program counter.";
+// Returns the path of the file in the `--cache_dir` that holds the lifted
+// code of `job`, or an empty string if `job` isn't cached. The file name
+// hashes everything that the lifted code depends on.
+static std::string CacheFileName(const remill::Arch *arch, const LiftJob &job,
+                                 const remill::OptimizationGuide &guide) {
+  if (FLAGS_cache_dir.empty() || FLAGS_stream_traces ||
+      1 < FLAGS_bc_out_parts || job.other_arch_memory) {
+    return {};
+  }
 
-    // Store the program counter into the state.
-    const auto pc_reg_ptr = pc_reg->AddressOf(state_ptr, entry);
-    const auto trace_pc =
-        llvm::ConstantInt::get(pc_reg->type, FLAGS_entry_address, false);
-    ir.SetInsertPoint(entry);
-    ir.CreateStore(trace_pc, pc_reg_ptr);
+  auto hash = SemanticsHash(arch);
+  hash = HashCombine(hash, static_cast<uint64_t>(guide.preset));
+  hash = HashCombine(hash, static_cast<uint64_t>(guide.barriers));
+  hash = HashCombine(hash, static_cast<uint64_t>(guide.undefined));
+  hash = HashCombine(hash, static_cast<uint64_t>(guide.fp_exceptions));
+  hash = HashCombine(hash, guide.eliminate_dead_stores);
+  hash = HashCombine(hash, FLAGS_fuse_instructions);
+  hash = HashCombine(hash, FLAGS_native_atomics);
+  hash = HashCombine(hash, FLAGS_guest_pc_debug_locations);
+  hash = HashCombine(hash, FLAGS_split_cold_exits);
+  hash = HashCombine(hash, guide.sync_hyper_calls != nullptr);
+  hash = HashCombine(hash, guide.track_dirty_state_lines);
+  hash = HashCombine(hash, guide.outline_repeated_code);
+  hash = HashCombine(hash, guide.coalesce_memory_accesses);
+  hash = HashCombine(hash, FLAGS_merge_identical_traces);
+  hash = HashCombine(hash, FLAGS_dispatch_table);
+  hash = HashCombine(hash, FLAGS_background_optimize_threads != 0);
+
+  const auto segments = job.memory.Segments();
+  hash = HashCombine(hash, segments.size());
+  for (const auto &seg : segments) {
+    hash = HashCombine(hash, seg.base);
+    hash = HashCombine(hash, seg.bytes.size());
+    hash = HashCombine(
+        hash, HashString(std::string_view(
+                  reinterpret_cast<const char *>(seg.bytes.data()),
+                  seg.bytes.size())));
+  }
 
-    auto args_it = func->arg_begin();
-    for (auto &reg_name : input_reg_names) {
-      const auto reg = arch->RegisterByName(reg_name.str());
-      auto &arg = *++args_it;  // Pre-increment, as first arg is memory pointer.
-      arg.setName(reg_name);
-      CHECK_EQ(arg.getType(), reg->type);
-      auto reg_ptr = reg->AddressOf(state_ptr, entry);
-      ir.SetInsertPoint(entry);
-      ir.CreateStore(&arg, reg_ptr);
+  hash = HashCombine(hash, job.entry_addresses.size());
+  for (auto entry_address : job.entry_addresses) {
+    hash = HashCombine(hash, entry_address);
+  }
+
+  hash = HashCombine(hash, job.slices.size());
+  for (const auto &slice : job.slices) {
+    hash = HashCombine(hash, HashString(slice.name));
+    hash = HashCombine(hash, slice.entry_address);
+    for (const auto *regs : {&slice.inputs, &slice.outputs}) {
+      hash = HashCombine(hash, regs->size());
+      for (const auto &reg : *regs) {
+        hash = HashCombine(hash, HashString(reg));
+      }
     }
+  }
+
+  std::stringstream ss;
+  ss << FLAGS_cache_dir << remill::PathSeparator()
+     << remill::GetArchName(arch->arch_name) << '_'
+     << remill::GetOSName(arch->os_name) << '_' << llvm::utohexstr(hash)
+     << ".bc";
+  return ss.str();
+}
+
+// Save the lifted code of `job` from the `cache_file`, if it is there.
+// Returns `false` if it isn't, and otherwise sets `ok` to whether saving
+// succeeded.
+static bool SaveCachedJob(llvm::LLVMContext &context, const LiftJob &job,
+                          const std::string &cache_file, bool &ok) {
+  if (cache_file.empty() || !remill::FileExists(cache_file)) {
+    return false;
+  }
+
+  remill::StatisticsTimer timer(job.stats ? &(job.stats->store_seconds)
+                                          : nullptr);
+  remill::TraceEventSpan span(job.stats ? job.stats->pipeline.events : nullptr,
+                              "write_bitcode");
+  auto module = remill::LoadModuleFromFile(&context, cache_file, true);
+  if (!module) {
+    LOG(WARNING) << "Ignoring unreadable cache file " << cache_file;
+    return false;
+  }
+  if (job.stats) {
+    job.stats->cached_jobs += 1;
+  }
+  ok = SaveLiftedModule(module.get(), job, {});
+  return true;
+}
+
+// Lift `job` into `module`, which holds the semantics of `arch`, and save the
+// lifted code, and also to `cache_file`, if there is one. Returns `false` if
+// saving failed.
+static bool Lift(const remill::Arch *arch, llvm::Module *module,
+                 const LiftJob &job, const remill::OptimizationGuide &guide,
+                 const std::string &cache_file = {}) {
+  if (FLAGS_stream_traces) {
+    return LiftStreaming(arch, module, job, guide);
+  }
+
+  std::vector<std::pair<uint64_t, std::string>> trace_names;
+  auto dest_module = LiftToModule(arch, module, job, guide, trace_names);
+  if (FLAGS_dispatch_table) {
+    AddDispatchTable(dest_module.get(), trace_names);
+  }
 
-    llvm::Value *mem_ptr = &*func->arg_begin();
+  remill::StatisticsTimer timer(job.stats ? &(job.stats->store_seconds)
+                                          : nullptr);
+  remill::TraceEventSpan span(job.stats ? job.stats->pipeline.events : nullptr,
+                              "write_bitcode");
 
-    llvm::Value *trace_args[remill::kNumBlockArgs] = {};
-    trace_args[remill::kStatePointerArgNum] = state_ptr;
-    trace_args[remill::kMemoryPointerArgNum] = mem_ptr;
-    trace_args[remill::kPCArgNum] = trace_pc;
+  // The file is saved to a temporary and then renamed, so other runs that
+  // share the cache either see all of it or nothing.
+  if (!cache_file.empty() &&
+      !remill::StoreModuleToFile(dest_module.get(), cache_file, true)) {
+    LOG(WARNING) << "Could not save lifted code to cache file " << cache_file;
+  }
+
+  return SaveLiftedModule(dest_module.get(), job, trace_names);
+}
 
-    mem_ptr = ir.CreateCall(entry_trace, trace_args);
+// Lift the `jobs` of a `--jobs` manifest on `--job_threads` threads. Each
+// thread loads the semantics once, the first time that one of its jobs isn't
+// in the `--cache_dir`, and lifts each of its jobs into a copy of them.
+static bool LiftJobs(std::deque<LiftJob> &jobs,
+                     const remill::OptimizationGuide &guide,
+                     RunStatistics *stats) {
+  std::atomic<size_t> next_job(0);
+  std::atomic<bool> ok(true);
+  std::mutex stats_lock;
+  auto lift_jobs = [&](void) {
+    RunStatistics thread_stats;
+    const auto job_stats = stats ? &thread_stats : nullptr;
+    if (stats) {
+      thread_stats.pipeline.events = stats->pipeline.events;
+    }
+    llvm::LLVMContext context;
+    auto arch = remill::Arch::Get(context, FLAGS_os, FLAGS_arch);
+    std::unique_ptr<llvm::Module> semantics;
 
-    // Go read all output registers out of the state and store them
-    // into the output parameters.
-    args_it = func->arg_begin();
-    for (size_t i = 0, j = 0; i < func->arg_size(); ++i, ++args_it) {
-      if (i < first_output_reg_index) {
+    for (size_t i; (i = next_job.fetch_add(1)) < jobs.size();) {
+      if (!IsInShard(i)) {
         continue;
       }
 
-      const auto &reg_name = output_reg_names[j++];
-      const auto reg = arch->RegisterByName(reg_name.str());
-      auto &arg = *args_it;
-      arg.setName(reg_name + "_output");
+      auto &job = jobs[i];
+      job.stats = job_stats;
+      const auto cache_file = CacheFileName(arch.get(), job, guide);
+
+      // A node of a `--shard` only publishes the lifted code to the
+      // `--cache_dir`, from which `--assemble_jobs` later saves it.
+      if (!FLAGS_shard.empty()) {
+        if (remill::FileExists(cache_file)) {
+          if (job_stats) {
+            job_stats->cached_jobs += 1;
+          }
+          continue;
+        }
+        job.ir_out.clear();
+        job.bc_out.clear();
+        job.obj_out.clear();
+
+      } else if (bool saved = false;
+                 SaveCachedJob(context, job, cache_file, saved)) {
+        if (!saved) {
+          ok = false;
+        }
+        continue;
 
-      auto reg_ptr = reg->AddressOf(state_ptr, entry);
-      ir.SetInsertPoint(entry);
-      ir.CreateStore(ir.CreateLoad(reg_ptr), &arg);
+      } else if (FLAGS_assemble_jobs) {
+        LOG(ERROR) << "The lifted code of job " << i << " of " << FLAGS_jobs
+                   << " isn't in the --cache_dir " << FLAGS_cache_dir;
+        ok = false;
+        continue;
+      }
+
+      if (!semantics) {
+        remill::StatisticsTimer timer(
+            job_stats ? &(job_stats->load_semantics_seconds) : nullptr);
+        semantics = remill::LoadArchSemantics(arch);
+      }
+      auto module = llvm::CloneModule(*semantics);
+      if (!Lift(arch.get(), module.get(), job, guide, cache_file)) {
+        ok = false;
+      }
+    }
+
+    if (stats) {
+      std::lock_guard<std::mutex> locker(stats_lock);
+      stats->Add(thread_stats);
+    }
+  };
+
+  const auto num_threads = std::max<size_t>(
+      1u, std::min<size_t>(FLAGS_job_threads, jobs.size()));
+  std::vector<std::thread> threads;
+  for (size_t i = 1; i < num_threads; ++i) {
+    threads.emplace_back(lift_jobs);
+  }
+  lift_jobs();
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  return ok;
+}
+
+// The regions of one architecture in a `--regions` manifest, all lifted by
+// one job.
+struct ArchRegions {
+  std::string arch_name;
+  uint64_t addr_mask;
+  LiftJob job;
+
+  // The unhexlified bytes of each region, which `job.memory` refers to.
+  std::deque<std::vector<uint8_t>> bytes;
+};
+
+// Read the regions of the `--regions` manifest into `arch_regions`, grouped
+// by architecture, and add every region to `all_memory`.
+static void ReadRegions(std::deque<ArchRegions> &arch_regions,
+                        Memory &all_memory) {
+  llvm::LLVMContext context;
+  ForEachLine(FLAGS_regions, [&](llvm::StringRef line, unsigned line_num) {
+    const auto source = FLAGS_regions + ":" + std::to_string(line_num);
+    llvm::SmallVector<llvm::StringRef, 4> fields;
+    line.split(fields, ',');
+    if (fields.size() != 4) {
+      std::cerr << "Expected 'arch,address,entry_addresses,bytes' in "
+                << source << std::endl;
+      exit(EXIT_FAILURE);
+    }
+
+    const auto arch_name =
+        fields[0].trim().empty() ? FLAGS_arch : fields[0].trim().str();
+    auto regions_it = std::find_if(
+        arch_regions.begin(), arch_regions.end(),
+        [&](const ArchRegions &regions) {
+          return regions.arch_name == arch_name;
+        });
+    if (regions_it == arch_regions.end()) {
+      auto arch = remill::GetArchName(arch_name) != remill::kArchInvalid
+                      ? remill::Arch::Get(context, FLAGS_os, arch_name)
+                      : nullptr;
+      if (!arch) {
+        std::cerr << "Invalid architecture '" << arch_name << "' in "
+                  << source << std::endl;
+        exit(EXIT_FAILURE);
+      }
+      auto &regions = arch_regions.emplace_back();
+      regions.arch_name = arch_name;
+      regions.addr_mask = ~0ULL >> (64UL - arch->address_size);
+      regions.job.other_arch_memory = &all_memory;
+      regions_it = std::prev(arch_regions.end());
     }
 
-    // Return the memory pointer, so that all memory accesses are
-    // preserved.
-    ir.CreateRet(mem_ptr);
+    auto &regions = *regions_it;
+    const auto addr = ParseAddress(fields[1], regions.addr_mask, source);
+    llvm::SmallVector<llvm::StringRef, 4> entry_addresses;
+    fields[2].split(entry_addresses, ' ', -1, false /* KeepEmpty */);
+    if (entry_addresses.empty()) {
+      regions.job.entry_addresses.push_back(addr);
+    }
+    for (auto entry_address : entry_addresses) {
+      regions.job.entry_addresses.push_back(
+          ParseAddress(entry_address, regions.addr_mask, source));
+    }
 
-    // We want the stack-allocated `State` to be subject to scalarization
-    // and mem2reg, but to "encourage" that, we need to prevent the
-    // `alloca`d `State` from escaping.
-    MuteStateEscape(&dest_module, "__remill_error");
-    MuteStateEscape(&dest_module, "__remill_function_call");
-    MuteStateEscape(&dest_module, "__remill_function_return");
-    MuteStateEscape(&dest_module, "__remill_jump");
-    MuteStateEscape(&dest_module, "__remill_missing_block");
+    auto &bytes = regions.bytes.emplace_back(UnhexlifyInputBytes(
+        fields[3].trim().str(), addr, regions.addr_mask, source));
+    regions.job.memory.AddSegment(addr, bytes);
+    all_memory.AddSegment(addr, bytes);
+  });
 
-    guide.slp_vectorize = true;
-    guide.loop_vectorize = true;
-    guide.eliminate_dead_stores = false;
-    remill::OptimizeBareModule(&dest_module, guide);
+  if (arch_regions.empty()) {
+    std::cerr << "No regions found in --regions " << FLAGS_regions
+              << std::endl;
+    exit(EXIT_FAILURE);
   }
+}
 
-  int ret = EXIT_SUCCESS;
+// Lift the `arch_regions` of a `--regions` manifest, each architecture on
+// its own thread, with its own context and semantics. The lifted code of
+// every architecture is then linked into one module, where the calls to the
+// declared traces of other architectures resolve to their definitions, and
+// saved.
+static bool LiftRegions(std::deque<ArchRegions> &arch_regions,
+                        const remill::OptimizationGuide &guide,
+                        RunStatistics *stats) {
+  std::vector<llvm::SmallVector<char, 0>> buffers(arch_regions.size());
+  std::vector<RunStatistics> arch_stats(arch_regions.size());
+  std::atomic<bool> ok(true);
+  auto lift_regions = [&](size_t i) {
+    auto &regions = arch_regions[i];
+    if (stats) {
+      regions.job.stats = &(arch_stats[i]);
+      arch_stats[i].pipeline.events = stats->pipeline.events;
+    }
+    llvm::LLVMContext context;
+    auto arch = remill::Arch::Get(context, FLAGS_os, regions.arch_name);
+    std::unique_ptr<llvm::Module> module;
+    {
+      remill::StatisticsTimer timer(
+          stats ? &(arch_stats[i].load_semantics_seconds) : nullptr);
+      module = remill::LoadArchSemantics(arch);
+    }
+    std::vector<std::pair<uint64_t, std::string>> trace_names;
+    auto dest_module =
+        LiftToModule(arch.get(), module.get(), regions.job, guide, trace_names);
+    if (!remill::StoreModuleToBuffer(dest_module.get(), buffers[i], {},
+                                     true)) {
+      LOG(ERROR) << "Could not serialize the lifted " << regions.arch_name
+                 << " code";
+      ok = false;
+    }
+  };
 
-  if (!FLAGS_ir_out.empty()) {
-    if (!remill::StoreModuleIRToFile(&dest_module, FLAGS_ir_out, true)) {
-      LOG(ERROR) << "Could not save LLVM IR to " << FLAGS_ir_out;
-      ret = EXIT_FAILURE;
+  std::vector<std::thread> threads;
+  for (size_t i = 1; i < arch_regions.size(); ++i) {
+    threads.emplace_back(lift_regions, i);
+  }
+  lift_regions(0);
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  if (stats) {
+    for (const auto &regions_stats : arch_stats) {
+      stats->Add(regions_stats);
     }
   }
-  if (!FLAGS_bc_out.empty()) {
-    if (!remill::StoreModuleToFile(&dest_module, FLAGS_bc_out, true)) {
-      LOG(ERROR) << "Could not save LLVM bitcode to " << FLAGS_bc_out;
-      ret = EXIT_FAILURE;
+  if (!ok) {
+    return false;
+  }
+
+  remill::StatisticsTimer timer(stats ? &(stats->store_seconds) : nullptr);
+  remill::TraceEventSpan span(stats ? stats->pipeline.events : nullptr,
+                              "write_bitcode");
+
+  // The combined module takes the data layout and triple of the first
+  // architecture.
+  llvm::LLVMContext context;
+  std::unique_ptr<llvm::Module> combined;
+  for (size_t i = 0; i < arch_regions.size(); ++i) {
+    const auto &arch_name = arch_regions[i].arch_name;
+    llvm::MemoryBufferRef buffer(
+        llvm::StringRef(buffers[i].data(), buffers[i].size()), arch_name);
+    auto module = llvm::parseBitcodeFile(buffer, context);
+    if (!module) {
+      LOG(ERROR) << "Could not load the lifted " << arch_name << " code: "
+                 << llvm::toString(module.takeError());
+      return false;
+    }
+    if (!combined) {
+      combined = std::move(*module);
+    } else if (llvm::Linker::linkModules(*combined, std::move(*module))) {
+      LOG(ERROR) << "Could not link the lifted " << arch_name << " code";
+      return false;
     }
   }
 
+  auto ret = true;
+  if (!FLAGS_ir_out.empty() &&
+      !remill::StoreModuleIRToFile(combined.get(), FLAGS_ir_out, true)) {
+    LOG(ERROR) << "Could not save LLVM IR to " << FLAGS_ir_out;
+    ret = false;
+  }
+  if (!FLAGS_bc_out.empty() &&
+      !remill::StoreModuleToFile(combined.get(), FLAGS_bc_out, true)) {
+    LOG(ERROR) << "Could not save LLVM bitcode to " << FLAGS_bc_out;
+    ret = false;
+  }
   return ret;
 }
+
+// A client of `--serve`. Each response starts with the id of its request,
+// because the responses are written in the order in which the lifts finish.
+// The files are closed once the client disconnects and every one of its
+// requests has been answered.
+class ServeConnection {
+ public:
+  ServeConnection(FILE *in_, FILE *out_, bool owned_)
+      : in(in_),
+        out(out_),
+        owned(owned_) {}
+
+  ~ServeConnection(void) {
+    if (owned) {
+      fclose(in);
+      fclose(out);
+    }
+  }
+
+  ServeConnection(const ServeConnection &) = delete;
+  ServeConnection &operator=(const ServeConnection &) = delete;
+
+  // Write the response `id,ok,<size>` or `id,error,<size>`, followed by the
+  // `size` bytes of `payload`.
+  void Respond(llvm::StringRef id, bool ok, llvm::StringRef payload) {
+    const auto header = id.str() + (ok ? ",ok," : ",error,") +
+                        std::to_string(payload.size()) + "\n";
+    std::lock_guard<std::mutex> locker(lock);
+    fwrite(header.data(), 1, header.size(), out);
+    fwrite(payload.data(), 1, payload.size(), out);
+    fflush(out);
+  }
+
+  FILE *const in;
+
+ private:
+  FILE *const out;
+  const bool owned;
+  std::mutex lock;
+};
+
+// A request line read from a client of `--serve`.
+struct ServeRequest {
+  std::shared_ptr<ServeConnection> conn;
+  std::string line;
+};
+
+// The requests of every client, waiting for a worker thread.
+class ServeQueue {
+ public:
+  void Push(ServeRequest request) {
+    std::lock_guard<std::mutex> locker(lock);
+    requests.push_back(std::move(request));
+    cond.notify_one();
+  }
+
+  // Wait for the next request. Returns `false` once the queue is closed and
+  // empty.
+  bool Pop(ServeRequest &request) {
+    std::unique_lock<std::mutex> locker(lock);
+    cond.wait(locker, [this](void) { return closed || !requests.empty(); });
+    if (requests.empty()) {
+      return false;
+    }
+    request = std::move(requests.front());
+    requests.pop_front();
+    return true;
+  }
+
+  void Close(void) {
+    std::lock_guard<std::mutex> locker(lock);
+    closed = true;
+    cond.notify_all();
+  }
+
+ private:
+  std::mutex lock;
+  std::condition_variable cond;
+  std::deque<ServeRequest> requests;
+  bool closed{false};
+};
+
+// The semantics of one architecture, loaded once by a `--serve` worker, and
+// copied for each request. Each architecture has its own context, so that
+// the contexts of idle architectures don't grow.
+struct WarmArch {
+  std::unique_ptr<llvm::LLVMContext> context;
+  remill::Arch::ArchPtr arch;
+  std::unique_ptr<llvm::Module> semantics;
+};
+
+using WarmArchMap = std::unordered_map<std::string, WarmArch>;
+
+// Returns the semantics of the architecture `name`, loading them into
+// `warm_archs` if this is the first request for it, or `nullptr` if `name`
+// isn't an architecture.
+static WarmArch *GetWarmArch(WarmArchMap &warm_archs, const std::string &name) {
+  auto warm_it = warm_archs.find(name);
+  if (warm_it != warm_archs.end()) {
+    return &(warm_it->second);
+  }
+  if (remill::GetArchName(name) == remill::kArchInvalid) {
+    return nullptr;
+  }
+
+  WarmArch warm;
+  warm.context.reset(new llvm::LLVMContext);
+  warm.arch = remill::Arch::Get(*warm.context, FLAGS_os, name);
+  if (!warm.arch) {
+    return nullptr;
+  }
+  warm.semantics = remill::LoadArchSemantics(warm.arch);
+  return &(warm_archs.emplace(name, std::move(warm)).first->second);
+}
+
+// Lift the request `fields`, i.e. `id,arch,address,entry_address,format,bytes`,
+// into a copy of the warm semantics. Returns `true` and the lifted code in
+// `out`, or `false` and an error message in `out`.
+static bool LiftRequest(WarmArchMap &warm_archs,
+                        llvm::ArrayRef<llvm::StringRef> fields,
+                        const remill::OptimizationGuide &guide,
+                        std::string &out) {
+  if (fields.size() != 6) {
+    out = "Expected 'id,arch,address,entry_address,format,bytes'";
+    return false;
+  }
+
+  const auto arch_name =
+      fields[1].trim().empty() ? FLAGS_arch : fields[1].trim().str();
+  const auto warm = GetWarmArch(warm_archs, arch_name);
+  if (!warm) {
+    out = "Invalid architecture '" + arch_name + "'";
+    return false;
+  }
+
+  const auto format = fields[4].trim();
+  if (format != "ir" && format != "bc") {
+    out = "Invalid format '" + format.str() + "', expected 'ir' or 'bc'";
+    return false;
+  }
+
+  const uint64_t addr_mask = ~0ULL >> (64UL - warm->arch->address_size);
+  LiftJob job;
+  uint64_t addr = 0;
+  uint64_t entry_address = 0;
+  if (!TryParseAddress(fields[2], addr_mask, addr)) {
+    out = "Invalid address '" + fields[2].trim().str() + "'";
+    return false;
+  } else if (fields[3].trim().empty()) {
+    entry_address = addr;
+  } else if (!TryParseAddress(fields[3], addr_mask, entry_address)) {
+    out = "Invalid entry address '" + fields[3].trim().str() + "'";
+    return false;
+  }
+
+  out = TryUnhexlifyInputBytes(fields[5].trim().str(), addr, addr_mask,
+                               "the request", job.bytes);
+  if (!out.empty()) {
+    return false;
+  }
+  job.memory.AddSegment(addr, job.bytes);
+  job.entry_addresses.push_back(entry_address);
+
+  // Lift into a copy of the semantics, which are left untouched for the next
+  // request. The copy is deleted along with the lifted code.
+  auto module = llvm::CloneModule(*warm->semantics);
+  std::vector<std::pair<uint64_t, std::string>> trace_names;
+  auto dest_module =
+      LiftToModule(warm->arch.get(), module.get(), job, guide, trace_names);
+
+  if (format == "ir") {
+    llvm::raw_string_ostream os(out);
+    dest_module->print(os, nullptr);
+    os.flush();
+    return true;
+  }
+
+  llvm::SmallVector<char, 0> buffer;
+  if (!remill::StoreModuleToBuffer(dest_module.get(), buffer, {}, true)) {
+    out = "Could not serialize the lifted code to bitcode";
+    return false;
+  }
+  out.assign(buffer.begin(), buffer.end());
+  return true;
+}
+
+// Lift the requests in `queue` until it is closed. The semantics of
+// `--serve_archs` are loaded up front, and those of any other architecture
+// on its first request.
+static void ServeRequests(ServeQueue &queue,
+                          const remill::OptimizationGuide &guide) {
+  WarmArchMap warm_archs;
+  llvm::SmallVector<llvm::StringRef, 4> arch_names;
+  llvm::StringRef(FLAGS_serve_archs.empty() ? FLAGS_arch : FLAGS_serve_archs)
+      .split(arch_names, ',', -1, false /* KeepEmpty */);
+  for (auto arch_name : arch_names) {
+    if (!GetWarmArch(warm_archs, arch_name.trim().str())) {
+      LOG(ERROR) << "Invalid architecture '" << arch_name.trim().str()
+                 << "' in --serve_archs";
+    }
+  }
+
+  ServeRequest request;
+  std::string out;
+  while (queue.Pop(request)) {
+    llvm::SmallVector<llvm::StringRef, 6> fields;
+    llvm::StringRef(request.line).split(fields, ',');
+    const auto id = fields.front().trim();
+    const auto ok = LiftRequest(warm_archs, fields, guide, out);
+    request.conn->Respond(id, ok, out);
+    request.conn.reset();
+  }
+}
+
+// Read a line from `file` into `line`, without its newline. Returns `false`
+// at the end of the file.
+static bool ReadLine(FILE *file, std::string &line) {
+  char buf[4096];
+  line.clear();
+  while (fgets(buf, sizeof(buf), file)) {
+    line += buf;
+    if (line.back() == '\n') {
+      line.pop_back();
+      return true;
+    }
+  }
+  return !line.empty();
+}
+
+// Queue up the requests of `conn` until it disconnects, skipping blank lines
+// and `#` comments.
+static void ReadRequests(std::shared_ptr<ServeConnection> conn,
+                         ServeQueue &queue) {
+  std::string line;
+  while (ReadLine(conn->in, line)) {
+    const auto trimmed = llvm::StringRef(line).trim();
+    if (!trimmed.empty() && !trimmed.startswith("#")) {
+      queue.Push({conn, trimmed.str()});
+    }
+  }
+}
+
+#ifndef _WIN32
+
+// Accept clients on the Unix socket `--serve_socket`, and read the requests
+// of each one on its own thread. This only returns if the socket fails.
+static void AcceptClients(ServeQueue &queue) {
+  sockaddr_un addr = {};
+  if (FLAGS_serve_socket.size() >= sizeof(addr.sun_path)) {
+    std::cerr << "The path passed to --serve_socket is too long." << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  addr.sun_family = AF_UNIX;
+  memcpy(addr.sun_path, FLAGS_serve_socket.data(), FLAGS_serve_socket.size());
+
+  const auto fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  unlink(FLAGS_serve_socket.c_str());
+  if (fd < 0 ||
+      bind(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) ||
+      listen(fd, SOMAXCONN)) {
+    std::cerr << "Could not listen on --serve_socket " << FLAGS_serve_socket
+              << ": " << strerror(errno) << std::endl;
+    exit(EXIT_FAILURE);
+  }
+
+  // Clients that disconnect before reading their responses shouldn't kill
+  // the server.
+  signal(SIGPIPE, SIG_IGN);
+
+  for (;;) {
+    const auto client = accept(fd, nullptr, nullptr);
+    if (client < 0) {
+      if (errno == EINTR || errno == ECONNABORTED) {
+        continue;
+      }
+      LOG(ERROR) << "Could not accept a client on --serve_socket "
+                 << FLAGS_serve_socket << ": " << strerror(errno);
+      break;
+    }
+    auto conn = std::make_shared<ServeConnection>(
+        fdopen(client, "r"), fdopen(dup(client), "w"), true);
+    std::thread(ReadRequests, std::move(conn), std::ref(queue)).detach();
+  }
+  close(fd);
+}
+
+#endif  // _WIN32
+
+// Serve lifting requests from stdin, or from the clients of `--serve_socket`,
+// on `--serve_threads` worker threads.
+static bool Serve(const remill::OptimizationGuide &guide) {
+  ServeQueue queue;
+  auto num_threads = FLAGS_serve_threads;
+  if (!num_threads) {
+    num_threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  std::vector<std::thread> threads;
+  for (uint32_t i = 0; i < num_threads; ++i) {
+    threads.emplace_back(ServeRequests, std::ref(queue), std::cref(guide));
+  }
+
+  if (FLAGS_serve_socket.empty()) {
+    ReadRequests(std::make_shared<ServeConnection>(stdin, stdout, false),
+                 queue);
+  } else {
+#ifndef _WIN32
+    AcceptClients(queue);
+#else
+    std::cerr << "--serve_socket is not supported on Windows." << std::endl;
+#endif
+  }
+
+  queue.Close();
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  return FLAGS_serve_socket.empty();
+}
+
+int main(int argc, char *argv[]) {
+  SetVersion();
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  google::InitGoogleLogging(argv[0]);
+
+  const auto num_inputs = !FLAGS_bytes.empty() + !FLAGS_input.empty() +
+                          !FLAGS_jobs.empty() + !FLAGS_regions.empty() +
+                          FLAGS_serve;
+  if (num_inputs != 1) {
+    std::cerr << "Please specify one of a sequence of hex bytes to --bytes, "
+              << "a file to --input, a manifest to --jobs or --regions, or "
+              << "--serve." << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  const auto make_slice = !FLAGS_slice_inputs.empty() ||
+                          !FLAGS_slice_outputs.empty() ||
+                          !FLAGS_slices.empty();
+  if (FLAGS_stream_traces && make_slice) {
+    std::cerr << "Slices can't be made of the lifted code with "
+              << "--stream_traces." << std::endl;
+    return EXIT_FAILURE;
+  } else if (!FLAGS_regions.empty() && (FLAGS_stream_traces || make_slice)) {
+    std::cerr << "The lifted code of --regions can't be streamed or sliced."
+              << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Make sure `--address` and `--entry_address` are in-bounds for the target
+  // architecture's address size.
+  llvm::LLVMContext context;
+  auto arch = remill::Arch::Get(context, FLAGS_os, FLAGS_arch);
+  const uint64_t addr_mask = ~0ULL >> (64UL - arch->address_size);
+  if (FLAGS_address != (FLAGS_address & addr_mask)) {
+    std::cerr << "Value " << std::hex << FLAGS_address
+              << " passed to --address does not fit into 32-bits. Did mean"
+              << " to specify a 64-bit architecture to --arch?" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  remill::OptimizationGuide guide = {};
+  guide.eliminate_dead_stores = true;
+  guide.prune_semantics = FLAGS_prune_semantics;
+  guide.promote_state_in_loops = FLAGS_promote_state_in_loops;
+  guide.relax_memory_chains = FLAGS_relax_memory_chains;
+  guide.coalesce_memory_accesses = FLAGS_coalesce_memory_accesses;
+  guide.track_dirty_state_lines = FLAGS_track_dirty_state;
+  guide.outline_repeated_code = FLAGS_outline_repeated_code;
+  static remill::SyncHyperCallLowering sync_hyper_calls;
+  if (FLAGS_inline_rdtsc) {
+    sync_hyper_calls.read_tsc = true;
+    guide.sync_hyper_calls = &sync_hyper_calls;
+  }
+  if (auto preset = remill::OptimizationPresetFromName(FLAGS_opt_preset)) {
+    guide.preset = *preset;
+  } else {
+    LOG(FATAL) << "Invalid --opt_preset value: " << FLAGS_opt_preset;
+  }
+  if (auto barriers = remill::BarrierLoweringFromName(FLAGS_barriers)) {
+    guide.barriers = *barriers;
+  } else {
+    LOG(FATAL) << "Invalid --barriers value: " << FLAGS_barriers;
+  }
+  if (auto undef = remill::UndefinedLoweringFromName(FLAGS_undefined_values)) {
+    guide.undefined = *undef;
+  } else {
+    LOG(FATAL) << "Invalid --undefined_values value: "
+               << FLAGS_undefined_values;
+  }
+  if (auto fp = remill::FPExceptionLoweringFromName(FLAGS_fp_exceptions)) {
+    guide.fp_exceptions = *fp;
+  } else {
+    LOG(FATAL) << "Invalid --fp_exceptions value: " << FLAGS_fp_exceptions;
+  }
+
+  if (FLAGS_serve) {
+    return Serve(guide) ? EXIT_SUCCESS : EXIT_FAILURE;
+  }
+
+  if (!FLAGS_shard.empty() || FLAGS_assemble_jobs) {
+    if (FLAGS_jobs.empty() || FLAGS_cache_dir.empty() ||
+        FLAGS_stream_traces || 1 < FLAGS_bc_out_parts) {
+      std::cerr << "--shard and --assemble_jobs need a --jobs manifest and "
+                << "a shared --cache_dir, and can't be used with "
+                << "--stream_traces or --bc_out_parts." << std::endl;
+      return EXIT_FAILURE;
+    } else if (!FLAGS_shard.empty() && FLAGS_assemble_jobs) {
+      std::cerr << "--assemble_jobs saves the jobs of every --shard."
+                << std::endl;
+      return EXIT_FAILURE;
+    } else if (!FLAGS_shard.empty() && !ParseShard()) {
+      std::cerr << "Invalid --shard value: " << FLAGS_shard
+                << "; expected 'I/N' with I < N." << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+
+  if (!FLAGS_cache_dir.empty() &&
+      !remill::TryCreateDirectory(FLAGS_cache_dir)) {
+    std::cerr << "Could not create --cache_dir " << FLAGS_cache_dir
+              << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Collect the `--stats` of the whole run, including the time spent in each
+  // LLVM pass.
+  std::unique_ptr<RunStatistics> stats;
+  if (FLAGS_stats == "text" || FLAGS_stats == "json") {
+    stats.reset(new RunStatistics);
+    llvm::TimePassesIsEnabled = true;
+  } else if (!FLAGS_stats.empty()) {
+    std::cerr << "Invalid --stats value: " << FLAGS_stats << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // The `--trace_events` are recorded through the statistics of each thread,
+  // which are then only reported if `--stats` is also used.
+  std::unique_ptr<remill::TraceEventLog> events;
+  if (!FLAGS_trace_events.empty()) {
+    events.reset(new remill::TraceEventLog);
+    if (!stats) {
+      stats.reset(new RunStatistics);
+    }
+    stats->pipeline.events = events.get();
+  }
+  const auto start = std::chrono::steady_clock::now();
+  auto finish = [&](bool ok) {
+    if (events) {
+      std::ofstream file(FLAGS_trace_events);
+      if (file) {
+        events->PrintJSON(file);
+      } else {
+        LOG(ERROR) << "Could not open --trace_events " << FLAGS_trace_events;
+      }
+    }
+    if (stats && !FLAGS_stats.empty()) {
+      const std::chrono::duration<double> elapsed =
+          std::chrono::steady_clock::now() - start;
+#if LLVM_VERSION_NUMBER >= LLVM_VERSION(8, 0)
+      llvm::reportAndResetTimings();
+#endif
+      ReportStatistics(*stats, elapsed.count());
+    }
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+  };
+
+  if (!FLAGS_regions.empty()) {
+    Memory all_memory;
+    std::deque<ArchRegions> arch_regions;
+    ReadRegions(arch_regions, all_memory);
+    return finish(LiftRegions(arch_regions, guide, stats.get()));
+  }
+
+  // The jobs are in a deque so that their `memory` can refer to their own
+  // `bytes`.
+  std::deque<LiftJob> jobs;
+  if (!FLAGS_jobs.empty()) {
+    ReadJobs(jobs, addr_mask);
+    return finish(LiftJobs(jobs, guide, stats.get()));
+  }
+
+  auto &job = jobs.emplace_back();
+  job.ir_out = FLAGS_ir_out;
+  job.bc_out = FLAGS_bc_out;
+  job.obj_out = FLAGS_obj_out;
+  job.stats = stats.get();
+
+  // The file that `job.memory` refers to.
+  std::unique_ptr<llvm::MemoryBuffer> input_file;
+  uint64_t default_entry_address = FLAGS_address;
+  if (!FLAGS_input.empty()) {
+    input_file = LoadInputFile(job.memory, addr_mask, &default_entry_address);
+  } else {
+    job.bytes =
+        UnhexlifyInputBytes(FLAGS_bytes, FLAGS_address, addr_mask, "--bytes");
+    job.memory.AddSegment(FLAGS_address, job.bytes);
+  }
+
+  if (!FLAGS_entry_address) {
+    FLAGS_entry_address = default_entry_address;
+  }
+
+  if (FLAGS_entry_address != (FLAGS_entry_address & addr_mask)) {
+    std::cerr
+        << "Value " << std::hex << FLAGS_entry_address
+        << " passed to --entry_address does not fit into 32-bits. Did mean"
+        << " to specify a 64-bit architecture to --arch?" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  job.entry_addresses.push_back(FLAGS_entry_address);
+  if (!FLAGS_entry_addresses.empty()) {
+    ReadEntryAddresses(job.entry_addresses, addr_mask);
+  }
+  AddFlagSlice(job);
+  if (!FLAGS_slices.empty()) {
+    ReadSlices(job, addr_mask);
+  }
+
+  const auto cache_file = CacheFileName(arch.get(), job, guide);
+  if (bool saved = false; SaveCachedJob(context, job, cache_file, saved)) {
+    return finish(saved);
+  }
+
+  std::unique_ptr<llvm::Module> module;
+  {
+    remill::StatisticsTimer timer(stats ? &(stats->load_semantics_seconds)
+                                        : nullptr);
+    module = remill::LoadArchSemantics(arch);
+  }
+  return finish(Lift(arch.get(), module.get(), job, guide, cache_file));
+}
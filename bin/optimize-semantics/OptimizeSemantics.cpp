@@ -0,0 +1,52 @@
+/*
+ * Copyright (c) 2020 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
+#include <remill/BC/Optimizer.h>
+#include <remill/BC/Util.h>
+
+#include <cstdlib>
+#include <iostream>
+
+DEFINE_string(semantics_bitcode, "",
+              "Path to the semantics bitcode file to optimize.");
+
+DEFINE_string(bc_out, "",
+              "Path to file where the optimized semantics bitcode should be "
+              "saved.");
+
+int main(int argc, char *argv[]) {
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  google::InitGoogleLogging(argv[0]);
+
+  if (FLAGS_semantics_bitcode.empty() || FLAGS_bc_out.empty()) {
+    std::cerr << "Please specify a semantics file to --semantics_bitcode, and "
+              << "an output file to --bc_out." << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  llvm::LLVMContext context;
+  auto module = remill::LoadModuleFromFile(&context, FLAGS_semantics_bitcode);
+  remill::OptimizeSemantics(module.get());
+  if (!remill::StoreModuleToFile(module.get(), FLAGS_bc_out, true)) {
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,60 @@
+/*
+ * Copyright (c) 2020 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
+#include <remill/BC/SemanticsChunks.h>
+#include <remill/BC/Util.h>
+
+#include <cstdlib>
+#include <iostream>
+
+DEFINE_string(semantics_bitcode, "",
+              "Path to the semantics bitcode file to split.");
+
+DEFINE_string(output_prefix, "",
+              "Path prefix of the output files. The chunks are saved to "
+              "`<prefix>.chunks`, and the index to `<prefix>.index`.");
+
+DEFINE_uint32(isels_per_chunk, 64, "Number of ISELs to put in each chunk.");
+
+int main(int argc, char *argv[]) {
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  google::InitGoogleLogging(argv[0]);
+
+  if (FLAGS_semantics_bitcode.empty() || FLAGS_output_prefix.empty()) {
+    std::cerr << "Please specify a semantics file to --semantics_bitcode, and "
+              << "an output path prefix to --output_prefix." << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  if (!FLAGS_isels_per_chunk) {
+    std::cerr << "Please specify a non-zero --isels_per_chunk." << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  llvm::LLVMContext context;
+  auto module = remill::LoadModuleFromFile(&context, FLAGS_semantics_bitcode);
+  if (!remill::SplitSemanticsModule(
+          module.get(), FLAGS_output_prefix + ".chunks",
+          FLAGS_output_prefix + ".index", FLAGS_isels_per_chunk)) {
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -48,7 +48,7 @@ endif()
 #
 
 # this is the runtime target generator, used in a similar way to add_executable
-set(add_runtime_usage "add_runtime(target_name SOURCES <src1 src2> ADDRESS_SIZE <size> DEFINITIONS <def1 def2> BCFLAGS <bcflag1 bcflag2> LINKERFLAGS <lnkflag1 lnkflag2> INCLUDEDIRECTORIES <path1 path2> INSTALLDESTINATION <path> DEPENDENCIES <dependency1 dependency2>")
+set(add_runtime_usage "add_runtime(target_name SOURCES <src1 src2> SHARDED_SOURCES <src1 src2> SHARDS <category1 category2+category3> ADDRESS_SIZE <size> DEFINITIONS <def1 def2> BCFLAGS <bcflag1 bcflag2> LINKERFLAGS <lnkflag1 lnkflag2> INCLUDEDIRECTORIES <path1 path2> INSTALLDESTINATION <path> DEPENDENCIES <dependency1 dependency2>")
 
 function(add_runtime target_name)
   if(NOT DEFINED CMAKE_BC_COMPILER)
@@ -64,6 +64,14 @@ function(add_runtime target_name)
       set(state "${macro_parameter}")
       continue()
 
+    elseif("${macro_parameter}" STREQUAL "SHARDED_SOURCES")
+      set(state "${macro_parameter}")
+      continue()
+
+    elseif("${macro_parameter}" STREQUAL "SHARDS")
+      set(state "${macro_parameter}")
+      continue()
+
     elseif("${macro_parameter}" STREQUAL "ADDRESS_SIZE")
       set(state "${macro_parameter}")
       continue()
@@ -96,6 +104,12 @@ function(add_runtime target_name)
     if("${state}" STREQUAL "SOURCES")
       list(APPEND source_file_list "${macro_parameter}")
 
+    elseif("${state}" STREQUAL "SHARDED_SOURCES")
+      list(APPEND sharded_source_file_list "${macro_parameter}")
+
+    elseif("${state}" STREQUAL "SHARDS")
+      list(APPEND shard_list "${macro_parameter}")
+
     elseif("${state}" STREQUAL "ADDRESS_SIZE")
       if(DEFINED address_size_bits_found)
         message(SEND_ERROR "The ADDRESS_SIZE parameter has been specified twice!")
@@ -139,30 +153,75 @@ function(add_runtime target_name)
     message(SEND_ERROR "Missing address size.")
   endif()
 
+  if(REMILL_HOT_STATE_LAYOUT)
+    list(APPEND definition_list "-DREMILL_HOT_STATE_LAYOUT=1")
+  endif()
+
+  if(REMILL_PACKED_ARITH_FLAGS)
+    list(APPEND definition_list "-DREMILL_PACKED_ARITH_FLAGS=1")
+  endif()
+
+  # Without sharding, the sharded sources are compiled whole, like the others.
+  if(NOT REMILL_SHARD_SEMANTICS OR "${shard_list}" STREQUAL "")
+    set(source_file_list ${sharded_source_file_list} ${source_file_list})
+    set(sharded_source_file_list)
+  endif()
+
   if("${source_file_list}" STREQUAL "")
     message(SEND_ERROR "No source files specified.")
   endif()
 
-  foreach(source_file ${source_file_list})
+  if(NOT "${dependency_list}" STREQUAL "")
+    set(dependency_list_directive DEPENDS ${dependency_list})
+  endif()
+
+  if(WIN32)
+    # We are actually using two different compilers; the LLVM platform toolset downloaded
+    # from the official LLVM download page and our own version from the cxx-common tarball.
+    #
+    # When the versions do not match, the compilation will fail; we don't really care about
+    # this, as the second compiler is only really used to output BC files.
+    set(additional_windows_settings "-D_ALLOW_COMPILER_AND_STL_VERSION_MISMATCH")
+  endif()
+
+  # Each shard of a sharded source is compiled on its own, with only the
+  # semantics of its categories, and so the shards are compiled in parallel.
+  # A shard is a category, or categories joined with `+`, e.g. `SSE+AVX`.
+  foreach(source_file ${sharded_source_file_list})
     get_filename_component(source_file_name "${source_file}" NAME)
     get_filename_component(absolute_source_file_path "${source_file}" ABSOLUTE)
-    set(absolute_output_file_path "${CMAKE_CURRENT_BINARY_DIR}/${target_name}_${source_file_name}.bc")
 
     get_property(source_file_properties SOURCE "${absolute_source_file_path}" PROPERTY COMPILE_FLAGS)
     string(REPLACE " " ";" source_file_option_list "${source_file_properties}")
 
-    if(NOT "${dependency_list}" STREQUAL "")
-      set(dependency_list_directive DEPENDS ${dependency_list})
-    endif()
+    foreach(shard ${shard_list})
+      string(REPLACE "+" "_" shard_name "${shard}")
+      string(REPLACE "+" ";" shard_category_list "${shard}")
+      set(absolute_output_file_path "${CMAKE_CURRENT_BINARY_DIR}/${target_name}_${source_file_name}.${shard_name}.bc")
+
+      set(shard_definition_list "-DREMILL_SEMANTICS_SHARD=1")
+      foreach(shard_category ${shard_category_list})
+        list(APPEND shard_definition_list "-DREMILL_SEMANTICS_SHARD_${shard_category}=1")
+      endforeach()
+
+      add_custom_command(OUTPUT "${absolute_output_file_path}"
+        COMMAND "${CMAKE_BC_COMPILER}" ${include_directory_list} ${additional_windows_settings} "-DADDRESS_SIZE_BITS=${address_size}" ${definition_list} ${shard_definition_list} ${DEFAULT_BC_COMPILER_FLAGS} ${bc_flag_list} ${source_file_option_list} -c "${absolute_source_file_path}" -o "${absolute_output_file_path}"
+        DEPENDS "${absolute_source_file_path}" ${dependency_list}
+        COMMENT "Building BC object ${absolute_output_file_path}"
+      )
+
+      set_property(DIRECTORY APPEND PROPERTY ADDITIONAL_MAKE_CLEAN_FILES "${absolute_output_file_path}")
+      list(APPEND bitcode_file_list "${absolute_output_file_path}")
+    endforeach()
+  endforeach()
 
-    if(WIN32)
-      # We are actually using two different compilers; the LLVM platform toolset downloaded
-      # from the official LLVM download page and our own version from the cxx-common tarball.
-      #
-      # When the versions do not match, the compilation will fail; we don't really care about
-      # this, as the second compiler is only really used to output BC files.
-      set(additional_windows_settings "-D_ALLOW_COMPILER_AND_STL_VERSION_MISMATCH")
-    endif()
+  foreach(source_file ${source_file_list})
+    get_filename_component(source_file_name "${source_file}" NAME)
+    get_filename_component(absolute_source_file_path "${source_file}" ABSOLUTE)
+    set(absolute_output_file_path "${CMAKE_CURRENT_BINARY_DIR}/${target_name}_${source_file_name}.bc")
+
+    get_property(source_file_properties SOURCE "${absolute_source_file_path}" PROPERTY COMPILE_FLAGS)
+    string(REPLACE " " ";" source_file_option_list "${source_file_properties}")
 
     add_custom_command(OUTPUT "${absolute_output_file_path}"
       COMMAND "${CMAKE_BC_COMPILER}" ${include_directory_list} ${additional_windows_settings} "-DADDRESS_SIZE_BITS=${address_size}" ${definition_list} ${DEFAULT_BC_COMPILER_FLAGS} ${bc_flag_list} ${source_file_option_list} -c "${absolute_source_file_path}" -o "${absolute_output_file_path}"
@@ -177,18 +236,74 @@ function(add_runtime target_name)
 
   set(absolute_target_path "${CMAKE_CURRENT_BINARY_DIR}/${target_name}.bc")
 
-  add_custom_command(OUTPUT "${absolute_target_path}"
-    COMMAND "${CMAKE_BC_LINKER}" ${linker_flag_list} ${bitcode_file_list} -o "${absolute_target_path}"
+  # With `REMILL_SUMMARIZE_SEMANTICS`, the linked runtime is summarized into
+  # the runtime, so that the optimized and split copies below have the
+  # summaries too.
+  if(REMILL_SUMMARIZE_SEMANTICS)
+    set(absolute_linked_path "${CMAKE_CURRENT_BINARY_DIR}/${target_name}.linked.bc")
+  else()
+    set(absolute_linked_path "${absolute_target_path}")
+  endif()
+
+  add_custom_command(OUTPUT "${absolute_linked_path}"
+    COMMAND "${CMAKE_BC_LINKER}" ${linker_flag_list} ${bitcode_file_list} -o "${absolute_linked_path}"
     DEPENDS ${bitcode_file_list}
-    COMMENT "Linking BC runtime ${absolute_target_path}"
+    COMMENT "Linking BC runtime ${absolute_linked_path}"
   )
 
+  if(REMILL_SUMMARIZE_SEMANTICS)
+    add_custom_command(OUTPUT "${absolute_target_path}"
+      COMMAND ${REMILL_SUMMARIZE_SEMANTICS_TOOL} --semantics_bitcode "${absolute_linked_path}" --bc_out "${absolute_target_path}"
+      DEPENDS "${absolute_linked_path}" ${REMILL_SUMMARIZE_SEMANTICS_TOOL}
+      COMMENT "Summarizing BC runtime ${absolute_target_path}"
+    )
+
+    set_property(DIRECTORY APPEND PROPERTY ADDITIONAL_MAKE_CLEAN_FILES "${absolute_linked_path}")
+  endif()
+
   set(DIRECTORY APPEND PROPERTY ADDITIONAL_MAKE_CLEAN_FILES "${absolute_target_path}")
+  set(runtime_file_list "${absolute_target_path}")
+
+  # Remember the runtime, so that `remill_bc` can embed it with
+  # `REMILL_EMBED_SEMANTICS`.
+  set_property(GLOBAL APPEND PROPERTY REMILL_RUNTIME_NAMES "${target_name}")
+  set_property(GLOBAL APPEND PROPERTY REMILL_RUNTIME_FILES "${absolute_target_path}")
+
+  # Save a copy of the runtime with canonicalized semantics functions, which
+  # is loaded instead when `--prefer_optimized_semantics` is used.
+  if(REMILL_OPTIMIZE_SEMANTICS)
+    set(absolute_optimized_path "${CMAKE_CURRENT_BINARY_DIR}/${target_name}.opt.bc")
+
+    add_custom_command(OUTPUT "${absolute_optimized_path}"
+      COMMAND ${REMILL_OPTIMIZE_SEMANTICS_TOOL} --semantics_bitcode "${absolute_target_path}" --bc_out "${absolute_optimized_path}"
+      DEPENDS "${absolute_target_path}" ${REMILL_OPTIMIZE_SEMANTICS_TOOL}
+      COMMENT "Optimizing BC runtime ${absolute_target_path}"
+    )
+
+    set_property(DIRECTORY APPEND PROPERTY ADDITIONAL_MAKE_CLEAN_FILES "${absolute_optimized_path}")
+    list(APPEND runtime_file_list "${absolute_optimized_path}")
+  endif()
+
+  # Split the runtime into chunks of ISELs, so that only the needed ones are
+  # loaded by `LoadArchSemanticsChunks`.
+  if(REMILL_SPLIT_SEMANTICS)
+    set(absolute_chunks_path "${CMAKE_CURRENT_BINARY_DIR}/${target_name}.chunks")
+    set(absolute_index_path "${CMAKE_CURRENT_BINARY_DIR}/${target_name}.index")
+
+    add_custom_command(OUTPUT "${absolute_chunks_path}" "${absolute_index_path}"
+      COMMAND ${REMILL_SPLIT_SEMANTICS_TOOL} --semantics_bitcode "${absolute_target_path}" --output_prefix "${CMAKE_CURRENT_BINARY_DIR}/${target_name}"
+      DEPENDS "${absolute_target_path}" ${REMILL_SPLIT_SEMANTICS_TOOL}
+      COMMENT "Splitting BC runtime ${absolute_target_path}"
+    )
+
+    set_property(DIRECTORY APPEND PROPERTY ADDITIONAL_MAKE_CLEAN_FILES "${absolute_chunks_path}" "${absolute_index_path}")
+    list(APPEND runtime_file_list "${absolute_chunks_path}" "${absolute_index_path}")
+  endif()
 
-  add_custom_target("${target_name}" ALL DEPENDS "${absolute_target_path}")
+  add_custom_target("${target_name}" ALL DEPENDS ${runtime_file_list})
   set_property(TARGET "${target_name}" PROPERTY LOCATION "${absolute_target_path}")
 
   if(DEFINED install_destination)
-    install(FILES "${absolute_target_path}" DESTINATION "${install_destination}")
+    install(FILES ${runtime_file_list} DESTINATION "${install_destination}")
   endif()
 endfunction()
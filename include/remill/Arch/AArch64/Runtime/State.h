@@ -280,9 +280,11 @@ struct alignas(16) SIMD {
 static_assert(512 == sizeof(SIMD), "Invalid packing of `struct SIMD`.");
 
 struct alignas(16) State final : public ArchState {
+#if !REMILL_HOT_STATE_LAYOUT
   SIMD simd;  // 512 bytes.
 
   uint64_t _0;
+#endif
 
   GPR gpr;  // 528 bytes.
 
@@ -298,6 +300,14 @@ struct alignas(16) State final : public ArchState {
 
   uint64_t _3;
 
+#if REMILL_HOT_STATE_LAYOUT
+
+  // The general purpose registers (including `pc`) and flags come first, so
+  // that they occupy the first 648 bytes. `_0` keeps `simd` 16-byte aligned.
+  uint64_t _0;
+
+  SIMD simd;  // 512 bytes.
+#endif
 } __attribute__((packed));
 
 static_assert((1152 + 16) == sizeof(State),
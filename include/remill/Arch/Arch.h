@@ -26,6 +26,7 @@
 #include <remill/BC/Compat/CTypes.h>
 #include <remill/BC/Compat/CallingConvention.h>
 
+#include <llvm/ADT/STLExtras.h>
 #include <llvm/ADT/SmallVector.h>
 #include <llvm/ADT/Triple.h>
 #include <llvm/IR/DataLayout.h>
@@ -34,8 +35,10 @@
 
 // clang-format on
 
+#include <cstdint>
 #include <functional>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <string_view>
 #include <vector>
@@ -74,29 +77,17 @@ struct Register {
   uint64_t offset;  // Byte offset in `State`.
   uint64_t size;  // Size of this register (in bytes).
 
+  // Dense index of this register among all registers of its `Arch`, i.e. in
+  // the range `[0, Arch::NumRegisters())`. This is suitable as an index into a
+  // flat array of per-register information.
+  unsigned index{0};
+
   // LLVM type associated with the field in `State`.
   llvm::Type *type;
 
-  // An LLVM constant that represents this register's name.
-  llvm::Constant *constant_name;
-
-  // A pre-computed index list and type for creating pointers to this register
-  // given a `State` structure pointer.
-  llvm::SmallVector<llvm::Value *, 8> gep_index_list;
-
-  // The offset in `State` nearest to `offset`. You can say that
-  // the `sizeof(gep_type_at_offset)` starting at `gep_offset` in the `State`
-  // structure fully enclose this register. The following invariant holds:
-  //
-  //    gep_offset
-  //        <= offset
-  //            <= offset + sizeof(type)
-  //                <= gep_offset + sizeof(gep_type_at_offset)
-  size_t gep_offset{0};
-
-  // This may be different than `type`. If so, then a bitcast on a
-  // `getelementptr` produced using `gep_index_list` to a `type*` is needed.
-  llvm::Type *gep_type_at_offset{nullptr};
+  // Returns an LLVM constant that represents this register's name. This is
+  // created on first use.
+  llvm::Constant *ConstantName(void) const;
 
   // Returns the enclosing register of size AT LEAST `size`, or `nullptr`.
   const Register *EnclosingRegisterOfSize(uint64_t size) const;
@@ -124,11 +115,38 @@ struct Register {
 
   // The directly enclosed registers.
   std::vector<const Register *> children;
+
+  // Fill in the values below on first use, as most registers of a context
+  // are never lifted.
+  void InitLazyValues(void) const;
+
+  mutable std::once_flag lazy_init;
+
+  mutable llvm::Constant *constant_name{nullptr};
+
+  // A pre-computed index list and type for creating pointers to this register
+  // given a `State` structure pointer.
+  mutable llvm::SmallVector<llvm::Value *, 8> gep_index_list;
+
+  // The offset in `State` nearest to `offset`. You can say that
+  // the `sizeof(gep_type_at_offset)` starting at `gep_offset` in the `State`
+  // structure fully enclose this register. The following invariant holds:
+  //
+  //    gep_offset
+  //        <= offset
+  //            <= offset + sizeof(type)
+  //                <= gep_offset + sizeof(gep_type_at_offset)
+  mutable size_t gep_offset{0};
+
+  // This may be different than `type`. If so, then a bitcast on a
+  // `getelementptr` produced using `gep_index_list` to a `type*` is needed.
+  mutable llvm::Type *gep_type_at_offset{nullptr};
 };
 
 class Arch {
  public:
   using ArchPtr = std::unique_ptr<const Arch>;
+  using SharedArchPtr = std::shared_ptr<const Arch>;
 
   virtual ~Arch(void);
 
@@ -160,10 +178,17 @@ class Arch {
   // Apply `cb` to every register.
   void ForEachRegister(std::function<void(const Register *)> cb) const;
 
+  // Number of registers, i.e. one more than the largest `Register::index`.
+  unsigned NumRegisters(void) const;
+
   // Return information about the register at offset `offset` in the `State`
   // structure.
   const Register *RegisterAtStateOffset(uint64_t offset) const;
 
+  // Return information about a register, given its `Register::index`, or
+  // `nullptr` if `index` isn't less than `NumRegisters()`.
+  const Register *RegisterById(unsigned index) const;
+
   // Return information about a register, given its name.
   const Register *RegisterByName(std::string_view name) const;
 
@@ -184,6 +209,14 @@ class Arch {
   // NOTE(pag): This is an internal API.
   void InitFromSemanticsModule(llvm::Module *module) const;
 
+  // Build the register table without a semantics module, e.g. for code that
+  // only decodes instructions. The registers have their usual names, offsets,
+  // sizes, and types, but the `State` structure is modelled as an array of
+  // bytes of the right size, so this architecture must not be used for
+  // lifting. Semantics must not later be loaded for this architecture; use
+  // another `Arch` for that.
+  void InitWithoutSemanticsModule(void) const;
+
   inline void PrepareModule(const std::unique_ptr<llvm::Module> &mod) const {
     PrepareModule(mod.get());
   }
@@ -201,6 +234,43 @@ class Arch {
   virtual bool DecodeInstruction(uint64_t address, std::string_view instr_bytes,
                                  Instruction &inst) const = 0;
 
+  // Decode an instruction, and report why it couldn't be decoded if decoding
+  // fails. Failures aren't logged unless `--log_decode_failures` is given, so
+  // this is cheap enough to use on bytes that are mostly not code.
+  DecodeResult TryDecodeInstruction(uint64_t address,
+                                    std::string_view instr_bytes,
+                                    Instruction &inst) const;
+
+  // Decode up to `max_insts` consecutive instructions from `insts_bytes`, the
+  // first of which is located at `address`, into `insts`. Decoding stops at
+  // the end of `insts_bytes`, or at the first instruction that fails to
+  // decode. Returns the number of decoded instructions, and resizes `insts`
+  // to that. The existing elements of `insts` are reused, so that repeatedly
+  // decoding into the same vector doesn't need to reallocate them.
+  //
+  // On architectures with delay slots, the instruction in the delay slot of
+  // a decoded instruction is decoded as a delayed instruction, i.e. with
+  // `in_delay_slot` set, so that the two are returned together.
+  virtual size_t DecodeInstructions(uint64_t address,
+                                    std::string_view insts_bytes,
+                                    std::vector<Instruction> &insts,
+                                    size_t max_insts = SIZE_MAX) const;
+
+  // Decode only the length, category, and direct control-flow targets of the
+  // instruction at `address`, without its operands, registers, or ISEL name.
+  // This is much cheaper than `DecodeInstruction`, and is meant for sweeping
+  // over code and for recovering control-flow graphs; instructions are fully
+  // decoded later, when they are lifted. By default, this decodes the whole
+  // instruction.
+  //
+  // NOTE(pag): On some architectures, this classifies instructions by their
+  //            top-level encoding group, and so it may accept encodings that
+  //            `DecodeInstruction` rejects. It never rejects encodings that
+  //            `DecodeInstruction` accepts.
+  virtual bool DecodeLengthAndCategory(uint64_t address,
+                                       std::string_view instr_bytes,
+                                       InstructionSummary &summary) const;
+
   // Decode an instruction that is within a delay slot.
   bool DecodeDelayedInstruction(uint64_t address, std::string_view instr_bytes,
                                 Instruction &inst) const {
@@ -211,6 +281,10 @@ class Arch {
   // Maximum number of bytes in an instruction for this particular architecture.
   virtual uint64_t MaxInstructionSize(void) const = 0;
 
+  // Minimum alignment, in bytes, of instruction addresses. Undecodable bytes
+  // are skipped in steps of this size.
+  uint64_t MinInstructionAlign(void) const;
+
   // Default calling convention for this architecture.
   virtual llvm::CallingConv::ID DefaultCallingConv(void) const = 0;
 
@@ -233,6 +307,24 @@ class Arch {
                                         const Instruction &next_inst,
                                         bool branch_taken_path) const;
 
+  // Returns `true` if `inst` might begin an idiom that can be fused with the
+  // instruction that follows it, i.e. the one at `inst.next_pc`.
+  virtual bool MayFuseWithNextInstruction(const Instruction &inst) const;
+
+  // Tries to fuse `inst` with `next_inst`, the instruction that follows it.
+  // On success, `inst` is updated in place into a single instruction, with a
+  // dedicated fused ISEL, that has the effects of both, and that spans the
+  // bytes of both. On failure, `false` is returned and `inst` is unchanged.
+  virtual bool FuseWithNextInstruction(Instruction &inst,
+                                       const Instruction &next_inst) const;
+
+  // Returns `true` if `inst` is a predicated instruction, i.e. one that only
+  // executes if its first operand, an expression operand, is non-zero, and
+  // that writes whether or not it executed to its second operand, which is
+  // `BRANCH_TAKEN`. Runs of predicated instructions with the same predicate
+  // are lifted under one branch on the predicate by the `TraceLifter`.
+  virtual bool IsPredicated(const Instruction &inst) const;
+
   // Get the architecture related to a module.
   static remill::Arch::ArchPtr GetModuleArch(const llvm::Module &module);
 
@@ -261,6 +353,15 @@ class Arch {
   static ArchPtr Build(llvm::LLVMContext *context, OSName os,
                        ArchName arch_name);
 
+  // Returns the architecture for `os` and `arch_name` within `context`,
+  // sharing it with any other callers that currently hold one. The cache
+  // only holds weak references, so an architecture is destroyed when its last
+  // holder releases it, which must happen before `context` is destroyed. The
+  // cache is safe to use from many threads, but the returned architecture is
+  // no more thread-safe than `context` itself.
+  static SharedArchPtr GetCached(llvm::LLVMContext *context, OSName os,
+                                 ArchName arch_name);
+
   // Get the architecture of the modelled code. This is based on command-line
   // flags. Rather use directly Build.
   static ArchPtr GetTargetArch(llvm::LLVMContext &context)
@@ -277,13 +378,42 @@ class Arch {
   virtual void PopulateBasicBlockFunction(llvm::Module *module,
                                           llvm::Function *bb_func) const = 0;
 
+  // Size of this architecture's `State` structure, in bytes.
+  virtual uint64_t StateStructSize(void) const = 0;
+
   llvm::Triple BasicTriple(void) const;
 
+  // Implements `DecodeInstructions` in terms of `decode`, which decodes one
+  // instruction given at most `max_inst_size` bytes. This lets architectures
+  // avoid a virtual call to `DecodeInstruction` per instruction. If
+  // `has_delay_slots` is `true`, then `MayHaveDelaySlot` is used to find
+  // the instructions that must be decoded as delay slots.
+  size_t DecodeEachInstruction(
+      uint64_t address, std::string_view insts_bytes,
+      std::vector<Instruction> &insts, size_t max_insts,
+      size_t max_inst_size,
+      llvm::function_ref<bool(uint64_t, std::string_view, Instruction &)>
+          decode,
+      bool has_delay_slots = false) const;
+
+  // Fill in `inst.regs_read` and `inst.regs_written` with the registers named
+  // by the operands of `inst`. Decoders add the registers that `inst` uses
+  // implicitly on top of these.
+  void AddOperandRegisters(Instruction &inst) const;
+
+  // Add the registers named `names` to `regs`. Names that aren't registers of
+  // this architecture are ignored.
+  void AddRegistersByName(RegisterSet &regs,
+                          std::initializer_list<std::string_view> names) const;
+
   // Add a register into this
   const Register *AddRegister(const char *reg_name, llvm::Type *val_type,
                               size_t offset, const char *parent_reg_name) const;
 
  private:
+  // Implements `InitFromSemanticsModule` and `InitWithoutSemanticsModule`.
+  void InitRegisters(llvm::Module *module, bool without_semantics) const;
+
   // Defined in `lib/Arch/X86/Arch.cpp`.
   static ArchPtr GetX86(llvm::LLVMContext *context, OSName os,
                         ArchName arch_name);
@@ -0,0 +1,164 @@
+/*
+ * Copyright (c) 2020 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+#include <type_traits>
+
+#include "Instruction.h"
+
+namespace llvm {
+class Constant;
+class Type;
+}  // namespace llvm
+
+namespace remill {
+
+class Arch;
+struct Register;
+
+// Returns a small integer that uniquely identifies `str`. The empty string is
+// always interned as `0`. Interned strings live until the program exits, and
+// interning is thread-safe.
+uint32_t InternString(std::string_view str);
+
+// Returns the string that was interned as `id`.
+std::string_view InternedString(uint32_t id);
+
+// A register operand, with its name interned.
+struct CompactRegister {
+  uint32_t name_id;
+  uint16_t size;  // In bits.
+};
+
+// A node in the flattened expression tree of a `CompactInstruction`. Operands
+// of an `LLVMOpExpr` are always stored before the node that uses them.
+struct CompactExpression {
+  enum Kind : uint8_t {
+    kInvalid,
+    kLLVMOp,
+    kRegister,
+    kConstant,
+    kVariable,
+  } kind;
+
+  uint8_t llvm_opcode;
+  uint8_t op1;  // Index of the first operand, or `kNoExpression`.
+  uint8_t op2;  // Index of the second operand, or `kNoExpression`.
+  uint32_t name_id;  // Interned variable name, for `kVariable`.
+  union {
+    const Register *reg;
+    llvm::Constant *constant;
+  };
+  llvm::Type *type;
+};
+
+// A decoded instruction operand, with the same meaning as an `Operand`. Only
+// the fields used by `type` are meaningful.
+struct CompactOperand {
+  Operand::Type type : 8;
+  Operand::Action action : 8;
+  Operand::ShiftRegister::Shift shift_op : 8;
+  Operand::ShiftRegister::Extend extend_op : 8;
+  Operand::Address::Kind addr_kind : 8;
+  bool shift_first : 1;
+  bool is_signed : 1;
+  uint8_t expr;  // Index of the root expression, or `kNoExpression`.
+  uint16_t shift_size;
+  uint16_t extract_size;
+  uint16_t address_size;
+  uint32_t size;  // In bits.
+
+  // Used as the register of both register and shift register operands.
+  CompactRegister reg;
+  CompactRegister segment_base_reg;
+  CompactRegister base_reg;
+  CompactRegister index_reg;
+
+  // The immediate value, or the address displacement.
+  uint64_t val;
+  int32_t scale;
+};
+
+// A compact, trivially copyable form of a decoded `Instruction`. Strings are
+// interned, and operands, expressions, and bytes are stored inline, so that a
+// `CompactInstruction` can be stored, copied, and hashed without any heap
+// allocations. Instructions that don't fit into the inline storage can't be
+// compacted, and must be kept as an `Instruction`.
+struct CompactInstruction {
+ public:
+  static constexpr unsigned kMaxNumBytes = 15;
+  static constexpr unsigned kMaxNumOperands = 10;
+  static constexpr unsigned kMaxNumExpr = 24;
+  static constexpr unsigned kMaxNumRegs = 24;
+  static constexpr uint8_t kNoExpression = 0xFF;
+
+  // Try to compact `inst` into this instruction. Returns `false`, and leaves
+  // this instruction in an unspecified state, if `inst` does not fit.
+  bool Compact(const Instruction &inst);
+
+  // Expand this instruction into `inst`.
+  void Expand(Instruction &inst) const;
+
+  inline std::string_view Bytes(void) const {
+    return std::string_view(reinterpret_cast<const char *>(bytes), num_bytes);
+  }
+
+  inline std::string_view Function(void) const {
+    return InternedString(function_id);
+  }
+
+  uint64_t pc;
+  uint64_t next_pc;
+  uint64_t delayed_pc;
+  uint64_t branch_taken_pc;
+  uint64_t branch_not_taken_pc;
+
+  const Arch *arch;
+  const Register *segment_override;
+
+  // Interned name of the semantics function that implements this instruction.
+  uint32_t function_id;
+
+  ArchName arch_name;
+  Instruction::Category category : 8;
+  bool is_atomic_read_modify_write : 1;
+  bool has_branch_taken_delay_slot : 1;
+  bool has_branch_not_taken_delay_slot : 1;
+  bool in_delay_slot : 1;
+
+  uint8_t num_bytes;
+  uint8_t num_operands;
+  uint8_t num_exprs;
+  uint8_t num_regs_read;
+  uint8_t num_regs_written;
+
+  uint8_t bytes[kMaxNumBytes];
+  CompactOperand operands[kMaxNumOperands];
+  CompactExpression exprs[kMaxNumExpr];
+
+  // The `Register::index` of each register in `Instruction::regs_read` and
+  // `Instruction::regs_written`.
+  uint16_t regs_read[kMaxNumRegs];
+  uint16_t regs_written[kMaxNumRegs];
+};
+
+static_assert(std::is_trivially_copyable_v<CompactInstruction>,
+              "A `CompactInstruction` must be trivially copyable.");
+
+}  // namespace remill
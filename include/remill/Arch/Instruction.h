@@ -16,6 +16,7 @@
 
 #pragma once
 
+#include <cstdint>
 #include <string>
 #include <variant>
 #include <vector>
@@ -78,6 +79,11 @@ class Operand {
 
     std::string name;
     uint64_t size;  // In bits.
+
+    // Optional; the architectural register named by `name`. Decoders may fill
+    // this in, and the `InstructionLifter` fills it in when it is missing, so
+    // that the register can be found without a lookup by name.
+    const remill::Register *arch_reg{nullptr};
   } reg;
 
   class ShiftRegister {
@@ -171,12 +177,90 @@ class Condition {
   std::string Serialize(void) const;
 };
 
+// Why some bytes could not be decoded into an instruction.
+enum class DecodeError : uint8_t {
+  kNone,
+
+  // Too few bytes were given to decode a whole instruction.
+  kTruncated,
+
+  // The instruction address isn't aligned as the architecture requires.
+  kMisaligned,
+
+  // The bytes don't encode a valid instruction.
+  kInvalidEncoding,
+
+  // The bytes encode an instruction that remill doesn't support, e.g. one
+  // from an ISA extension that isn't enabled for the architecture.
+  kUnsupported,
+};
+
+// Returns the name of `error`, e.g. for reporting decoding statistics.
+const char *GetDecodeErrorName(DecodeError error);
+
+// The result of trying to decode one instruction. On success, `size` is the
+// length of the decoded instruction. On failure, `size` is the number of
+// bytes to skip to reach the next possible instruction.
+struct DecodeResult {
+  DecodeError error;
+  uint32_t size;  // In bytes.
+
+  inline explicit operator bool(void) const {
+    return DecodeError::kNone == error;
+  }
+};
+
+// A set of the registers of one `Arch`, stored as a bitset indexed by
+// `Register::index`. Registers and their sub-registers (e.g. `RAX` and `EAX`)
+// are distinct members of a set.
+class RegisterSet {
+ public:
+  void Insert(const Register *reg);
+  bool Contains(const Register *reg) const;
+
+  // Returns `true` if some register is in both this set and `that`.
+  bool Intersects(const RegisterSet &that) const;
+
+  bool Empty(void) const;
+
+  // Remove all registers. The storage of the set is retained.
+  void Clear(void);
+
+  RegisterSet &operator|=(const RegisterSet &that);
+
+  bool operator==(const RegisterSet &that) const;
+
+  // Call `cb` with the `Register::index` of each register in the set, in
+  // increasing order.
+  template <typename CB>
+  void ForEachIndex(CB cb) const {
+    for (unsigned i = 0; i < words.size(); ++i) {
+      for (auto word = words[i]; word; word &= word - 1) {
+        cb(i * 64u + static_cast<unsigned>(__builtin_ctzll(word)));
+      }
+    }
+  }
+
+ private:
+  std::vector<uint64_t> words;
+};
+
 // Generic instruction type.
 class Instruction {
  public:
   ~Instruction(void) = default;
   Instruction(void);
 
+  // Copying an instruction re-targets the copied operand expressions so
+  // that they point into the copy's own expression storage.
+  Instruction(const Instruction &that);
+  Instruction &operator=(const Instruction &that);
+
+  // Reset this instruction so that it can be reused to decode another
+  // instruction. The capacity of `function`, `bytes`, and `operands` is
+  // retained, and operand expressions live in storage inline in the
+  // instruction, so decoding into a reused instruction generally doesn't
+  // allocate.
   void Reset(void);
 
   // Name of semantics function that implements this instruction.
@@ -215,12 +299,23 @@ class Instruction {
   // Is this instruction decoded within the context of a delay slot?
   bool in_delay_slot;
 
+  // Why decoding this instruction failed, if the decoder could tell.
+  DecodeError decode_error;
+
   // For x86 it is possible to specify a prefix that overrides the default
   // segment register. This attribute by itself is currently not used directly
   // by the lifter - it is expeted `Operand`s will include segment reg where appropriate
   // but it can be used in different applications.
   const Register *segment_override = nullptr;
 
+  // Registers read and written by this instruction, including those that it
+  // uses implicitly, e.g. the arithmetic flags, or the stack pointer of a
+  // `PUSH`, as far as the decoder can tell. Operands that don't name
+  // registers, e.g. `NEXT_PC` or `BRANCH_TAKEN`, aren't included. These are
+  // empty if the registers of `arch` haven't been initialized.
+  RegisterSet regs_read;
+  RegisterSet regs_written;
+
   enum Category {
     kCategoryInvalid,
     kCategoryNormal,
@@ -343,4 +438,31 @@ class Instruction {
   unsigned next_expr_index{0};
 };
 
+// The length, category, and direct control-flow targets of an instruction,
+// as decoded by `Arch::DecodeLengthAndCategory`. This is all that recovering
+// a control-flow graph, or sweeping over code, needs to know.
+struct InstructionSummary {
+  uint64_t pc{0};
+  uint64_t next_pc{0};
+
+  // Like in `Instruction`, these are only meaningful for direct control flow,
+  // and, for `branch_not_taken_pc`, for function calls and conditional
+  // control flow.
+  uint64_t branch_taken_pc{0};
+  uint64_t branch_not_taken_pc{0};
+
+  Instruction::Category category{Instruction::kCategoryInvalid};
+
+  bool has_branch_taken_delay_slot{false};
+  bool has_branch_not_taken_delay_slot{false};
+
+  // Why decoding failed, if the decoder could tell.
+  DecodeError decode_error{DecodeError::kNone};
+
+  // Length, in bytes, of the instruction.
+  inline uint64_t NumBytes(void) const {
+    return next_pc - pc;
+  }
+};
+
 }  // namespace remill
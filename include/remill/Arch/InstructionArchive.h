@@ -0,0 +1,157 @@
+/*
+ * Copyright (c) 2020 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "InstructionCache.h"
+
+namespace llvm {
+class MemoryBuffer;
+}  // namespace llvm
+namespace remill {
+
+class Arch;
+class Instruction;
+
+// Writes decoded instructions into an archive file, read by
+// `InstructionArchive`, so that the decoding done by one process can be
+// shared with others, e.g. with distributed lifting workers. Unlike
+// `Instruction::Serialize`, the encoding is binary and position-independent:
+// registers, semantics functions, and variables are referred to by name
+// through a string table, constants by value, and types by bit width.
+//
+//      remill::InstructionArchiveWriter writer("insts.ria");
+//      for (const auto &inst : decoded_insts) {
+//        writer.AddInstruction(inst);
+//      }
+//      CHECK(writer.Finish());
+//
+// The archive is written to a temporary file, and only replaces `path` once
+// `Finish` succeeds.
+class InstructionArchiveWriter {
+ public:
+  explicit InstructionArchiveWriter(std::string_view path_);
+
+  // Removes the temporary file if `Finish` wasn't called, or failed.
+  ~InstructionArchiveWriter(void);
+
+  // Add `inst` to the archive. Returns `false` if an instruction at the same
+  // PC was already added, if `inst` isn't valid, or if it can't be encoded,
+  // e.g. because it doesn't fit into a `CompactInstruction`, or because an
+  // operand expression uses a constant that isn't an integer.
+  bool AddInstruction(const Instruction &inst);
+
+  // Write the index and the string table, and move the archive into place.
+  // Nothing can be added afterwards.
+  bool Finish(void);
+
+ private:
+  InstructionArchiveWriter(void) = delete;
+
+  // Returns the ID of `str` in the string table.
+  uint32_t StringId(std::string_view str);
+
+  const std::string path;
+  const std::string tmp_path;
+
+  std::ofstream out;
+  bool ok{true};
+  bool finished{false};
+
+  // The architecture of the instructions, taken from the first one.
+  uint32_t arch_name{0};
+
+  // The PC and the file offset of each instruction.
+  std::vector<std::pair<uint64_t, uint64_t>> index;
+  std::unordered_set<uint64_t> pcs;
+
+  std::vector<std::string> strings;
+  std::unordered_map<std::string, uint32_t> string_ids;
+};
+
+// Random access to the instructions of an archive written by
+// `InstructionArchiveWriter`. The archive is mapped into memory, and looking
+// up an instruction is a binary search of the index followed by reading its
+// fixed-layout record in place; nothing is parsed when the archive is
+// opened. Instructions are expanded for `arch`, which must be the
+// architecture that they were decoded with.
+//
+// An archive is also a read-only `InstructionCache`, so that a `TraceLifter`
+// can be given one to skip decoding the instructions that another process
+// already decoded. Expanding an instruction creates constants in the context
+// of `arch`, so an archive must only be used by one thread at a time.
+class InstructionArchive : public InstructionCache {
+ public:
+  virtual ~InstructionArchive(void);
+
+  // Map the archive at `path`. Returns `nullptr` if the file can't be read,
+  // isn't a well-formed archive, or was written for another architecture
+  // than `arch`.
+  static std::unique_ptr<InstructionArchive> Open(const Arch *arch,
+                                                  std::string_view path);
+
+  // Number of instructions in the archive.
+  size_t NumInstructions(void) const;
+
+  // Returns `true` if the archive contains an instruction at `pc`.
+  bool HasInstruction(uint64_t pc) const;
+
+  // Expand the instruction at `pc` into `inst`. Returns `false` if there is
+  // no instruction at `pc`, or if its record is malformed, e.g. because it
+  // names a register that `arch` doesn't have.
+  bool LoadInstruction(uint64_t pc, Instruction &inst) const;
+
+  bool TryGetInstruction(const Arch *arch_, uint64_t addr,
+                         std::string_view bytes, Instruction &inst) override;
+
+  // Does nothing; archives are read-only.
+  void AddInstruction(const Arch *arch_, uint64_t addr,
+                      const Instruction &inst) override;
+
+ private:
+  InstructionArchive(const Arch *arch_,
+                     std::unique_ptr<llvm::MemoryBuffer> buffer_);
+
+  // Returns the record of the instruction at `pc`, or `nullptr`.
+  const char *FindRecord(uint64_t pc) const;
+
+  // Sets `str` to the string with the ID `id`. Returns `false` if `id` is out
+  // of bounds.
+  bool GetString(uint32_t id, std::string_view &str) const;
+
+  const Arch *const arch;
+  const std::unique_ptr<llvm::MemoryBuffer> buffer;
+
+  size_t num_insts{0};
+  size_t num_strings{0};
+  const char *index{nullptr};
+  const char *string_table{nullptr};
+  const char *strings{nullptr};
+  size_t strings_size{0};
+};
+
+}  // namespace remill
@@ -0,0 +1,162 @@
+/*
+ * Copyright (c) 2020 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+
+#include "CompactInstruction.h"
+#include "Instruction.h"
+
+namespace remill {
+
+class Arch;
+
+// A cache of decoded instructions. A `TraceLifter` given a cache consults it
+// before calling `Arch::DecodeInstruction`, so that instructions shared by
+// overlapping traces are only decoded once.
+class InstructionCache {
+ public:
+  virtual ~InstructionCache(void);
+
+  // Try to find an instruction at `addr` that was decoded by `arch`, and whose
+  // bytes are a prefix of `bytes`. Returns `true` and fills `inst` if one
+  // is found.
+  virtual bool TryGetInstruction(const Arch *arch, uint64_t addr,
+                                 std::string_view bytes, Instruction &inst) = 0;
+
+  // Record that decoding the bytes at `addr` with `arch` produced `inst`.
+  virtual void AddInstruction(const Arch *arch, uint64_t addr,
+                              const Instruction &inst) = 0;
+};
+
+// An unbounded, in-memory instruction cache.
+class SimpleInstructionCache : public InstructionCache {
+ public:
+  virtual ~SimpleInstructionCache(void);
+
+  bool TryGetInstruction(const Arch *arch, uint64_t addr,
+                         std::string_view bytes, Instruction &inst) override;
+
+  void AddInstruction(const Arch *arch, uint64_t addr,
+                      const Instruction &inst) override;
+
+  // Forget all cached instructions.
+  void Clear(void);
+
+ private:
+  using Key = std::pair<const Arch *, uint64_t>;
+
+  struct KeyHash {
+    inline size_t operator()(const Key &key) const noexcept {
+      return std::hash<const Arch *>()(key.first) ^
+             std::hash<uint64_t>()(key.second);
+    }
+  };
+
+  std::unordered_map<Key, Instruction, KeyHash> instructions;
+};
+
+// An unbounded, in-memory instruction cache that stores instructions in their
+// `CompactInstruction` form. This uses much less memory than a
+// `SimpleInstructionCache`, at the cost of expanding instructions on lookup.
+// Instructions that can't be compacted are stored as-is.
+class CompactInstructionCache : public InstructionCache {
+ public:
+  virtual ~CompactInstructionCache(void);
+
+  bool TryGetInstruction(const Arch *arch, uint64_t addr,
+                         std::string_view bytes, Instruction &inst) override;
+
+  void AddInstruction(const Arch *arch, uint64_t addr,
+                      const Instruction &inst) override;
+
+  // Forget all cached instructions.
+  void Clear(void);
+
+ private:
+  using Key = std::pair<const Arch *, uint64_t>;
+
+  struct KeyHash {
+    inline size_t operator()(const Key &key) const noexcept {
+      return std::hash<const Arch *>()(key.first) ^
+             std::hash<uint64_t>()(key.second);
+    }
+  };
+
+  std::unordered_map<Key, CompactInstruction, KeyHash> compact_instructions;
+  std::unordered_map<Key, Instruction, KeyHash> instructions;
+};
+
+// An unbounded, in-memory instruction cache keyed by instruction bytes rather
+// than by address. Real programs repeat the same byte sequences (e.g. function
+// prologues, returns, and common moves) many times over, and apart from their
+// PC-relative fields, the instructions decoded from them are identical. A hit
+// copies the cached instruction and relocates its `pc`, `next_pc`,
+// `delayed_pc`, `branch_taken_pc`, and `branch_not_taken_pc` to `addr`;
+// PC-relative operands are already expressed relative to `PC` or `NEXT_PC`.
+//
+// The low two bits of the address are part of the key, so that encodings
+// whose decoding depends on the alignment of the PC (e.g. AArch32's
+// `Align(PC, 4)`) are not shared across alignments. SPARC instructions are
+// never cached, because the SPARC decoders fuse `SETHI` with the instruction
+// that follows it, and so the decoding of the first four bytes depends on the
+// next four.
+class BytePatternInstructionCache : public InstructionCache {
+ public:
+  virtual ~BytePatternInstructionCache(void);
+
+  bool TryGetInstruction(const Arch *arch, uint64_t addr,
+                         std::string_view bytes, Instruction &inst) override;
+
+  void AddInstruction(const Arch *arch, uint64_t addr,
+                      const Instruction &inst) override;
+
+  // Forget all cached instructions.
+  void Clear(void);
+
+ private:
+  // The arch, the alignment of the address, and a hash of the bytes.
+  struct Key {
+    const Arch *arch;
+    uint64_t align;
+    uint64_t hash;
+
+    inline bool operator==(const Key &that) const noexcept {
+      return arch == that.arch && align == that.align && hash == that.hash;
+    }
+  };
+
+  struct KeyHash {
+    inline size_t operator()(const Key &key) const noexcept {
+      return std::hash<const Arch *>()(key.arch) ^
+             std::hash<uint64_t>()(key.hash ^ key.align);
+    }
+  };
+
+  static Key MakeKey(const Arch *arch, uint64_t addr, std::string_view bytes);
+
+  // Bit `n` is set if an `n`-byte instruction has been cached. Lookups try
+  // each cached length, shortest first.
+  uint64_t cached_lengths{0};
+
+  std::unordered_map<Key, Instruction, KeyHash> instructions;
+};
+
+}  // namespace remill
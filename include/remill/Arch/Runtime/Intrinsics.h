@@ -73,6 +73,55 @@ __remill_write_memory_f64(Memory *, addr_t, float64_t);
 [[gnu::used]] extern Memory *__remill_write_memory_f128(Memory *, addr_t,
                                                         float64_t);
 
+// Vector memory access intrinsics. These read or write a whole vector in one
+// access, rather than one element at a time. They aren't `const` as, on some
+// ABIs, the vector is passed or returned through memory.
+[[gnu::used]] extern vec128_t __remill_read_memory_v128(Memory *, addr_t);
+
+[[gnu::used]] extern vec256_t __remill_read_memory_v256(Memory *, addr_t);
+
+[[gnu::used]] extern vec512_t __remill_read_memory_v512(Memory *, addr_t);
+
+[[gnu::used]] extern Memory *__remill_write_memory_v128(Memory *, addr_t,
+                                                        vec128_t);
+
+[[gnu::used]] extern Memory *__remill_write_memory_v256(Memory *, addr_t,
+                                                        vec256_t);
+
+[[gnu::used]] extern Memory *__remill_write_memory_v512(Memory *, addr_t,
+                                                        vec512_t);
+
+// Bulk memory intrinsics. `__remill_copy_memory_N(memory, dst, src, count)`
+// behaves like `count` reads of `N`-bit elements from `src`, each followed by
+// a write to `dst`, with both addresses ascending; thus, overlapping copies
+// behave like `REP MOVS`. `__remill_fill_memory_N(memory, dst, val, count)`
+// writes `val` to `count` ascending `N`-bit elements starting at `dst`. The
+// x86 semantics only use these on ranges that neither overlap each other nor
+// wrap around, and so they can be implemented with `memcpy` and `memset`.
+[[gnu::used]] extern Memory *__remill_copy_memory_8(Memory *, addr_t, addr_t,
+                                                    addr_t);
+
+[[gnu::used]] extern Memory *__remill_copy_memory_16(Memory *, addr_t, addr_t,
+                                                     addr_t);
+
+[[gnu::used]] extern Memory *__remill_copy_memory_32(Memory *, addr_t, addr_t,
+                                                     addr_t);
+
+[[gnu::used]] extern Memory *__remill_copy_memory_64(Memory *, addr_t, addr_t,
+                                                     addr_t);
+
+[[gnu::used]] extern Memory *__remill_fill_memory_8(Memory *, addr_t, uint8_t,
+                                                    addr_t);
+
+[[gnu::used]] extern Memory *__remill_fill_memory_16(Memory *, addr_t,
+                                                     uint16_t, addr_t);
+
+[[gnu::used]] extern Memory *__remill_fill_memory_32(Memory *, addr_t,
+                                                     uint32_t, addr_t);
+
+[[gnu::used]] extern Memory *__remill_fill_memory_64(Memory *, addr_t,
+                                                     uint64_t, addr_t);
+
 [[gnu::used, gnu::const]] extern uint8_t __remill_undefined_8(void);
 
 [[gnu::used, gnu::const]] extern uint16_t __remill_undefined_16(void);
@@ -246,7 +295,10 @@ __remill_compare_exchange_memory_128(Memory *, addr_t addr, uint128_t &expected,
 //      auto res = x op y;
 //      auto flags = __remill_fpu_exception_test_and_clear(FE_ALL_EXCEPT, 0);
 //
-// These flags are also subject to optimizations
+// These flags are also subject to optimizations. Before the status register
+// is read or written, the semantics call it with `(0, 0)`, which does nothing
+// unless the optimizer defers the exceptions of the operations, and then
+// reads and clears all of them.
 [[gnu::used, gnu::const]] extern int
 __remill_fpu_exception_test_and_clear(int read_mask, int clear_mask);
 
@@ -255,10 +255,47 @@ MAKE_READV(F, 64, doubles)
 
 #undef MAKE_READV
 
+// Whole vector memory accesses. If a vector in memory is the same size as a
+// `vec128_t`, `vec256_t`, or `vec512_t`, then it is read or written with one
+// vector intrinsic, and these return `true`. Otherwise, they return `false`,
+// and the vector must be accessed one element at a time.
+#define MAKE_VEC_MEMORY_ACCESS(size) \
+  ALWAYS_INLINE static bool _ReadVecMemory(Memory *memory, addr_t addr, \
+                                           vec##size##_t &vec) { \
+    vec = __remill_read_memory_v##size(memory, addr); \
+    return true; \
+  } \
+\
+  ALWAYS_INLINE static bool _WriteVecMemory( \
+      Memory *&memory, addr_t addr, const vec##size##_t &vec) { \
+    memory = __remill_write_memory_v##size(memory, addr, vec); \
+    return true; \
+  }
+
+MAKE_VEC_MEMORY_ACCESS(128)
+MAKE_VEC_MEMORY_ACCESS(256)
+MAKE_VEC_MEMORY_ACCESS(512)
+
+#undef MAKE_VEC_MEMORY_ACCESS
+
+template <typename T>
+ALWAYS_INLINE static bool _ReadVecMemory(Memory *, addr_t, T &) {
+  return false;
+}
+
+template <typename T>
+ALWAYS_INLINE static bool _WriteVecMemory(Memory *&, addr_t, const T &) {
+  return false;
+}
+
 #define MAKE_MREADV(prefix, size, vec_accessor, mem_accessor) \
   template <typename T> \
   ALWAYS_INLINE static auto _##prefix##ReadV##size(Memory *memory, MVn<T> mem) \
       ->decltype(T().vec_accessor) { \
+    T whole_vec; \
+    if (_ReadVecMemory(memory, mem.addr, whole_vec)) { \
+      return whole_vec.vec_accessor; \
+    } \
     decltype(T().vec_accessor) vec = {}; \
     const addr_t el_size = sizeof(vec.elems[0]); \
     _Pragma("unroll") for (addr_t i = 0; i < NumVectorElems(vec); ++i) { \
@@ -272,6 +309,10 @@ MAKE_READV(F, 64, doubles)
   ALWAYS_INLINE static auto _##prefix##ReadV##size(Memory *memory, \
                                                    MVnW<T> mem) \
       ->decltype(T().vec_accessor) { \
+    T whole_vec; \
+    if (_ReadVecMemory(memory, mem.addr, whole_vec)) { \
+      return whole_vec.vec_accessor; \
+    } \
     decltype(T().vec_accessor) vec = {}; \
     const addr_t el_size = sizeof(vec.elems[0]); \
     _Pragma("unroll") for (addr_t i = 0; i < NumVectorElems(vec); ++i) { \
@@ -366,6 +407,9 @@ MAKE_WRITEV(F, 64, doubles, RVnW, float64_t)
     T vec{}; \
     const addr_t el_size = sizeof(base_type); \
     vec.vec_accessor.elems[0] = val; \
+    if (_WriteVecMemory(memory, mem.addr, vec)) { \
+      return memory; \
+    } \
     _Pragma("unroll") for (addr_t i = 0; i < NumVectorElems(vec.vec_accessor); \
                            ++i) { \
       memory = __remill_write_memory_##mem_accessor( \
@@ -382,6 +426,11 @@ MAKE_WRITEV(F, 64, doubles, RVnW, float64_t)
     typedef decltype(V()) VT; \
     static_assert(std::is_same<BT, VT>::value, \
                   "Incompatible types to a write to a vector register"); \
+    T whole_vec; \
+    whole_vec.vec_accessor = val; \
+    if (_WriteVecMemory(memory, mem.addr, whole_vec)) { \
+      return memory; \
+    } \
     const addr_t el_size = sizeof(base_type); \
     _Pragma("unroll") for (addr_t i = 0; i < NumVectorElems(val); ++i) { \
       memory = __remill_write_memory_##mem_accessor( \
@@ -985,6 +1034,68 @@ ALWAYS_INLINE static bool BNot(bool a) {
   return !a;
 }
 
+// Lanes of native vectors. Signed integer elements are operated on as
+// unsigned lanes, so that lane arithmetic wraps like the scalar operators.
+template <typename BT>
+struct NativeLaneType {
+  static constexpr bool kIsNative = false;
+};
+
+#define MAKE_NATIVE_LANE_TYPE(base_type, lane_type) \
+  template <> \
+  struct NativeLaneType<base_type> { \
+    static constexpr bool kIsNative = true; \
+    typedef lane_type Type; \
+  };
+
+MAKE_NATIVE_LANE_TYPE(uint8_t, uint8_t)
+MAKE_NATIVE_LANE_TYPE(uint16_t, uint16_t)
+MAKE_NATIVE_LANE_TYPE(uint32_t, uint32_t)
+MAKE_NATIVE_LANE_TYPE(uint64_t, uint64_t)
+MAKE_NATIVE_LANE_TYPE(int8_t, uint8_t)
+MAKE_NATIVE_LANE_TYPE(int16_t, uint16_t)
+MAKE_NATIVE_LANE_TYPE(int32_t, uint32_t)
+MAKE_NATIVE_LANE_TYPE(int64_t, uint64_t)
+MAKE_NATIVE_LANE_TYPE(float32_t, float32_t)
+MAKE_NATIVE_LANE_TYPE(float64_t, float64_t)
+
+#undef MAKE_NATIVE_LANE_TYPE
+
+// A Clang vector of `N` lanes of type `LT`. Operations on these become whole
+// vector LLVM instructions, instead of one instruction per element.
+template <typename LT, std::size_t N>
+struct NativeVectorType {
+  typedef LT Type __attribute__((ext_vector_type(N)));
+};
+
+template <typename T>
+using IsNativeVector = std::integral_constant<
+    bool, NativeLaneType<typename VectorType<T>::BT>::kIsNative>;
+
+template <typename T>
+using NativeLaneTypeOf =
+    typename NativeLaneType<typename VectorType<T>::BT>::Type;
+
+template <typename T, typename LT = NativeLaneTypeOf<T>>
+ALWAYS_INLINE static
+    typename NativeVectorType<LT, VectorType<T>::kNumElems>::Type
+    ToNativeVector(const T &vec) {
+  typename NativeVectorType<LT, VectorType<T>::kNumElems>::Type native;
+  static_assert(sizeof(native) == sizeof(vec),
+                "Native vector size must match the vector size.");
+  __builtin_memcpy(&native, &vec, sizeof(vec));
+  return native;
+}
+
+template <typename T, typename NT>
+ALWAYS_INLINE static T FromNativeVector(const NT &native) {
+  T vec;
+  static_assert(sizeof(native) == sizeof(vec),
+                "Native vector size must match the vector size.");
+  __builtin_memcpy(&vec, &native, sizeof(vec));
+  return vec;
+}
+
 // Binary broadcast operator.
 #define MAKE_BIN_BROADCAST(op, size, accessor) \
   template <typename T> \
@@ -1007,6 +1118,61 @@ ALWAYS_INLINE static bool BNot(bool a) {
     return ret; \
   }
 
+// Binary broadcast operator that applies `native_op` to whole native vectors
+// when the elements of `T` can be native lanes, and that falls back to
+// applying `op` to each element otherwise (e.g. for 128-bit elements).
+#define MAKE_NATIVE_BIN_BROADCAST(op, size, native_op) \
+  template <typename T> \
+  ALWAYS_INLINE static T op##V##size(const T &L, const T &R, \
+                                     std::false_type) { \
+    T ret{}; \
+    _Pragma("unroll") for (auto i = 0UL; i < NumVectorElems(L); ++i) { \
+      ret.elems[i] = op(L.elems[i], R.elems[i]); \
+    } \
+    return ret; \
+  } \
+  template <typename T> \
+  ALWAYS_INLINE static T op##V##size(const T &L, const T &R, \
+                                     std::true_type) { \
+    return FromNativeVector<T>(ToNativeVector(L) native_op ToNativeVector(R)); \
+  } \
+  template <typename T> \
+  ALWAYS_INLINE static T op##V##size(const T &L, const T &R) { \
+    return op##V##size(L, R, IsNativeVector<T>()); \
+  }
+
+// Unary broadcast operator that applies `native_op` to whole native vectors.
+#define MAKE_NATIVE_UN_BROADCAST(op, size, native_op) \
+  template <typename T> \
+  ALWAYS_INLINE static T op##V##size(const T &R, std::false_type) { \
+    T ret{}; \
+    _Pragma("unroll") for (auto i = 0UL; i < NumVectorElems(R); ++i) { \
+      ret.elems[i] = op(R.elems[i]); \
+    } \
+    return ret; \
+  } \
+  template <typename T> \
+  ALWAYS_INLINE static T op##V##size(const T &R, std::true_type) { \
+    return FromNativeVector<T>(native_op ToNativeVector(R)); \
+  } \
+  template <typename T> \
+  ALWAYS_INLINE static T op##V##size(const T &R) { \
+    return op##V##size(R, IsNativeVector<T>()); \
+  }
+
+// Comparison broadcast operator. Each element of the result has all of its
+// bits set if `native_op` holds for the corresponding elements of `L` and
+// `R`, and is zero otherwise.
+#define MAKE_CMP_BROADCAST(op, size, native_op) \
+  template <typename T> \
+  ALWAYS_INLINE static T op##V##size(const T &L, const T &R) { \
+    static_assert(IsNativeVector<T>::value, \
+                  "Comparison broadcasts need native vector elements."); \
+    using BT = typename VectorType<T>::BT; \
+    return FromNativeVector<T>(ToNativeVector<T, BT>(L) \
+                                   native_op ToNativeVector<T, BT>(R)); \
+  }
+
 #define MAKE_BROADCASTS(op, make_int_broadcast, make_float_broadcast) \
   make_int_broadcast(U##op, 8, bytes) make_int_broadcast(U##op, 16, words) \
       make_int_broadcast(U##op, 32, dwords) \
@@ -1018,23 +1184,91 @@ ALWAYS_INLINE static bool BNot(bool a) {
                               make_float_broadcast(F##op, 32, floats) \
                                   make_float_broadcast(F##op, 64, doubles)
 
-MAKE_BROADCASTS(Add, MAKE_BIN_BROADCAST, MAKE_BIN_BROADCAST)
-MAKE_BROADCASTS(Sub, MAKE_BIN_BROADCAST, MAKE_BIN_BROADCAST)
-MAKE_BROADCASTS(Mul, MAKE_BIN_BROADCAST, MAKE_BIN_BROADCAST)
-MAKE_BROADCASTS(Div, MAKE_BIN_BROADCAST, MAKE_BIN_BROADCAST)
+#define MAKE_NATIVE_BROADCASTS(op, native_op, make_int_broadcast, \
+                               make_float_broadcast) \
+  make_int_broadcast(U##op, 8, native_op) \
+      make_int_broadcast(U##op, 16, native_op) \
+          make_int_broadcast(U##op, 32, native_op) \
+              make_int_broadcast(U##op, 64, native_op) \
+                  make_int_broadcast(S##op, 8, native_op) \
+                      make_int_broadcast(S##op, 16, native_op) \
+                          make_int_broadcast(S##op, 32, native_op) \
+                              make_int_broadcast(S##op, 64, native_op) \
+                                  make_float_broadcast(F##op, 32, native_op) \
+                                      make_float_broadcast(F##op, 64, native_op)
+
+// Shifts and integer division keep operating on each element, as the native
+// forms are undefined for over-wide shift amounts and zero divisors, and so
+// would let the optimizer discard lanes.
+MAKE_NATIVE_BROADCASTS(Add, +, MAKE_NATIVE_BIN_BROADCAST,
+                       MAKE_NATIVE_BIN_BROADCAST)
+MAKE_NATIVE_BROADCASTS(Sub, -, MAKE_NATIVE_BIN_BROADCAST,
+                       MAKE_NATIVE_BIN_BROADCAST)
+MAKE_NATIVE_BROADCASTS(Mul, *, MAKE_NATIVE_BIN_BROADCAST,
+                       MAKE_NATIVE_BIN_BROADCAST)
+MAKE_NATIVE_BROADCASTS(Div, /, MAKE_BIN_BROADCAST, MAKE_NATIVE_BIN_BROADCAST)
 MAKE_BROADCASTS(Rem, MAKE_BIN_BROADCAST, MAKE_NOP)
-MAKE_BROADCASTS(And, MAKE_BIN_BROADCAST, MAKE_NOP)
-MAKE_BROADCASTS(AndN, MAKE_BIN_BROADCAST, MAKE_NOP)
-MAKE_BROADCASTS(Or, MAKE_BIN_BROADCAST, MAKE_NOP)
-MAKE_BROADCASTS(Xor, MAKE_BIN_BROADCAST, MAKE_NOP)
+MAKE_NATIVE_BROADCASTS(And, &, MAKE_NATIVE_BIN_BROADCAST, MAKE_NOP)
+MAKE_NATIVE_BROADCASTS(AndN, &~, MAKE_NATIVE_BIN_BROADCAST, MAKE_NOP)
+MAKE_NATIVE_BROADCASTS(Or, |, MAKE_NATIVE_BIN_BROADCAST, MAKE_NOP)
+MAKE_NATIVE_BROADCASTS(Xor, ^, MAKE_NATIVE_BIN_BROADCAST, MAKE_NOP)
 MAKE_BROADCASTS(Shl, MAKE_BIN_BROADCAST, MAKE_NOP)
 MAKE_BROADCASTS(Shr, MAKE_BIN_BROADCAST, MAKE_NOP)
-MAKE_BROADCASTS(Neg, MAKE_UN_BROADCAST, MAKE_NOP)
-MAKE_BROADCASTS(Not, MAKE_UN_BROADCAST, MAKE_NOP)
-
+MAKE_NATIVE_BROADCASTS(Neg, -, MAKE_NATIVE_UN_BROADCAST,
+                       MAKE_NATIVE_UN_BROADCAST)
+MAKE_NATIVE_BROADCASTS(Not, ~, MAKE_NATIVE_UN_BROADCAST, MAKE_NOP)
+MAKE_NATIVE_BROADCASTS(CmpEq, ==, MAKE_CMP_BROADCAST, MAKE_NOP)
+MAKE_NATIVE_BROADCASTS(CmpGt, >, MAKE_CMP_BROADCAST, MAKE_NOP)
+
+#undef MAKE_NATIVE_BROADCASTS
+#undef MAKE_NATIVE_BIN_BROADCAST
+#undef MAKE_NATIVE_UN_BROADCAST
+#undef MAKE_CMP_BROADCAST
 #undef MAKE_BIN_BROADCAST
 #undef MAKE_UN_BROADCAST
 
+// Unsigned native lanes that are `kSize` bytes wide.
+template <std::size_t kSize>
+struct NativeMaskLaneType;
+
+#define MAKE_NATIVE_MASK_LANE_TYPE(lane_type) \
+  template <> \
+  struct NativeMaskLaneType<sizeof(lane_type)> { \
+    typedef lane_type Type; \
+  };
+
+MAKE_NATIVE_MASK_LANE_TYPE(uint8_t)
+MAKE_NATIVE_MASK_LANE_TYPE(uint16_t)
+MAKE_NATIVE_MASK_LANE_TYPE(uint32_t)
+MAKE_NATIVE_MASK_LANE_TYPE(uint64_t)
+
+#undef MAKE_NATIVE_MASK_LANE_TYPE
+
+// Selects the elements of `if_true` whose bits are set in `mask`, and the
+// elements of `if_false` otherwise, e.g. for AVX-512 write masks. The bits of
+// `mask` are spread across whole lanes with vector operations, and so this is
+// one vector select rather than a test of each bit.
+template <typename T>
+ALWAYS_INLINE static T SelectV(uint64_t mask, const T &if_true,
+                               const T &if_false) {
+  enum : std::size_t { kNumElems = VectorType<T>::kNumElems };
+  using MT = typename NativeMaskLaneType<sizeof(
+      typename VectorType<T>::BT)>::Type;
+  using BitsType = typename NativeVectorType<uint64_t, kNumElems>::Type;
+  using MaskType = typename NativeVectorType<MT, kNumElems>::Type;
+
+  BitsType lane_nums;
+  _Pragma("unroll") for (auto i = 0UL; i < kNumElems; ++i) {
+    lane_nums[i] = i;
+  }
+  BitsType lane_bits = mask;  // Splat.
+  lane_bits = (lane_bits >> lane_nums) & static_cast<uint64_t>(1);
+  const MaskType lane_mask = -__builtin_convertvector(lane_bits, MaskType);
+  const auto t = ToNativeVector<T, MT>(if_true);
+  const auto f = ToNativeVector<T, MT>(if_false);
+  return FromNativeVector<T>((t & lane_mask) | (f & ~lane_mask));
+}
+
 // Binary broadcast operator.
 #define MAKE_ACCUMULATE(op, size, accessor) \
   template <typename T> \
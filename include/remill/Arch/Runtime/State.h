@@ -18,6 +18,25 @@
 
 #include "remill/Arch/Runtime/HyperCall.h"
 
+// If non-zero, then the architecture-specific `State` structures place the
+// registers that nearly every lifted function accesses, i.e. the general
+// purpose registers, arithmetic flags, and program counter, right after
+// `ArchState`, so that they share as few cache lines as possible. This must
+// be the same when compiling the semantics and the code using them; the
+// register table built by `Arch` follows whichever layout it was built with.
+#ifndef REMILL_HOT_STATE_LAYOUT
+#  define REMILL_HOT_STATE_LAYOUT 0
+#endif
+
+// If non-zero, then the x86 arithmetic flags are packed next to each other,
+// without the `volatile` padding bytes that otherwise stop LLVM from
+// coalescing accesses to neighbouring flags. Like `REMILL_HOT_STATE_LAYOUT`,
+// this must be the same when compiling the semantics and the code using
+// them.
+#ifndef REMILL_PACKED_ARITH_FLAGS
+#  define REMILL_PACKED_ARITH_FLAGS 0
+#endif
+
 struct ArchState {
  public:
   AsyncHyperCall::Name hyper_call;
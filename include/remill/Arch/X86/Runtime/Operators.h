@@ -78,4 +78,64 @@ ALWAYS_INLINE static Memory *_WriteBCD80Indefinite(Memory *memory,
 
 #define WriteBCD80Indefinite(op) _WriteBCD80Indefinite(memory, op)
 
+#if HAS_FEATURE_AVX512
+
+// Combine the result `val` of a write-masked AVX-512 instruction with the old
+// value `dst_val` of its destination. The elements whose bits in `mask` are
+// clear keep their old values, or are zeroed if `zeroing` is set.
+template <typename T>
+ALWAYS_INLINE static T MaskV(uint64_t mask, const T &val, const T &dst_val,
+                             uint8_t zeroing) {
+  return SelectV(mask, val, zeroing ? T{} : dst_val);
+}
+
+// Read the source of a write-masked AVX-512 instruction. Faults on the
+// elements of a memory source whose bits in `mask` are clear are suppressed,
+// and so unless all of the elements are enabled, only the enabled ones are
+// read, and the others are zero. A register source is read whole.
+#  define MAKE_MASKED_READV(prefix, size, accessor, mem_accessor) \
+    template <typename T> \
+    ALWAYS_INLINE static auto _##prefix##MaskedReadV##size( \
+        Memory *memory, uint64_t, Vn<T> vec)->decltype(T().accessor) { \
+      return _##prefix##ReadV##size(memory, vec); \
+    } \
+\
+    template <typename T> \
+    ALWAYS_INLINE static auto _##prefix##MaskedReadV##size( \
+        Memory *memory, uint64_t mask, MVn<T> mem)->decltype(T().accessor) { \
+      decltype(T().accessor) vec = {}; \
+      const addr_t num_elems = NumVectorElems(vec); \
+      const uint64_t all_elems = \
+          64 <= num_elems ? ~0ull : (1ull << num_elems) - 1ull; \
+      if ((mask & all_elems) == all_elems) { \
+        return _##prefix##ReadV##size(memory, mem); \
+      } \
+      const addr_t el_size = sizeof(vec.elems[0]); \
+      _Pragma("unroll") for (addr_t i = 0; i < num_elems; ++i) { \
+        if ((mask >> i) & 1ull) { \
+          vec.elems[i] = __remill_read_memory_##mem_accessor( \
+              memory, mem.addr + (i * el_size)); \
+        } \
+      } \
+      return vec; \
+    }
+
+MAKE_MASKED_READV(U, 8, bytes, 8)
+MAKE_MASKED_READV(U, 16, words, 16)
+MAKE_MASKED_READV(U, 32, dwords, 32)
+MAKE_MASKED_READV(U, 64, qwords, 64)
+MAKE_MASKED_READV(F, 32, floats, f32)
+MAKE_MASKED_READV(F, 64, doubles, f64)
+
+#  undef MAKE_MASKED_READV
+
+#  define UMaskedReadV8(mask, op) _UMaskedReadV8(memory, mask, op)
+#  define UMaskedReadV16(mask, op) _UMaskedReadV16(memory, mask, op)
+#  define UMaskedReadV32(mask, op) _UMaskedReadV32(memory, mask, op)
+#  define UMaskedReadV64(mask, op) _UMaskedReadV64(memory, mask, op)
+#  define FMaskedReadV32(mask, op) _FMaskedReadV32(memory, mask, op)
+#  define FMaskedReadV64(mask, op) _FMaskedReadV64(memory, mask, op)
+
+#endif  // HAS_FEATURE_AVX512
+
 }  // namespace
@@ -45,6 +45,12 @@
 #  define HAS_FEATURE_AVX512 1
 #endif
 
+// The fast x87 semantics don't track the FPU exception flags, the last
+// instruction and data pointers, or the top of stack in the status word.
+#ifndef HAS_FEATURE_FAST_X87
+#  define HAS_FEATURE_FAST_X87 0
+#endif
+
 #if HAS_FEATURE_AVX
 #  define IF_AVX(...) __VA_ARGS__
 #  define IF_AVX_ELSE(a, b) a
@@ -409,6 +415,25 @@ union alignas(8) Flags final {
 
 static_assert(8 == sizeof(Flags), "Invalid structure packing of `Flags`.");
 
+#if REMILL_PACKED_ARITH_FLAGS
+
+// The flags are packed together, so that LLVM may coalesce neighbouring flag
+// accesses, e.g. the stores of an instruction that writes all of the flags,
+// into wider ones. The flags keep their order, and the structure its size.
+struct alignas(8) ArithFlags final {
+  uint8_t cf;
+  uint8_t pf;
+  uint8_t af;
+  uint8_t zf;
+  uint8_t sf;
+  uint8_t df;
+  uint8_t of;
+  uint8_t _0;
+  uint64_t _1;
+} __attribute__((packed));
+
+#else
+
 struct alignas(8) ArithFlags final {
 
   // Prevents LLVM from casting and `ArithFlags` into an `i8` to access `cf`.
@@ -430,6 +455,8 @@ struct alignas(8) ArithFlags final {
   volatile uint8_t _8;
 } __attribute__((packed));
 
+#endif  // REMILL_PACKED_ARITH_FLAGS
+
 static_assert(16 == sizeof(ArithFlags), "Invalid packing of `ArithFlags`.");
 
 union XCR0 {
@@ -754,12 +781,36 @@ struct alignas(8) MMX final {
 
 static_assert(128 == sizeof(MMX), "Invalid structure packing of `MMX`.");
 
+// The AVX-512 opmask registers `k0` through `k7`.
+struct alignas(8) OpmaskRegs final {
+  struct alignas(8) {
+    uint64_t _0;
+    uint64_t val;
+  } __attribute__((packed)) elems[8];
+};
+
+static_assert(128 == sizeof(OpmaskRegs),
+              "Invalid structure packing of `OpmaskRegs`.");
+
 enum : size_t { kNumVecRegisters = 32 };
 
 struct alignas(16) State final : public ArchState {
 
   // ArchState occupies 16 bytes.
 
+#if REMILL_HOT_STATE_LAYOUT
+
+  // The general purpose registers (including `rip`) and flags come first, so
+  // that they occupy the first five cache lines. `seg` keeps `vec` 16-byte
+  // aligned.
+  GPR gpr;  // 272 bytes.
+  ArithFlags aflag;  // 16 bytes.
+  Flags rflag;  // 8 bytes.
+  Segments seg;  // 24 bytes.
+  VectorReg vec[kNumVecRegisters];  // 2048 bytes.
+  AddressSpace addr;  // 96 bytes.
+#else
+
   // AVX512 has 32 vector registers, so we always include them all here for
   // consistency across the various state structures.
   VectorReg vec[kNumVecRegisters];  // 2048 bytes.
@@ -771,15 +822,17 @@ struct alignas(16) State final : public ArchState {
   Segments seg;  // 24 bytes.
   AddressSpace addr;  // 96 bytes.
   GPR gpr;  // 272 bytes.
+#endif
   X87Stack st;  // 128 bytes.
   MMX mmx;  // 128 bytes.
   FPUStatusFlags sw;  // 24 bytes
   XCR0 xcr0;  // 8 bytes.
   FPU x87;  // 512 bytes
   SegmentCaches seg_caches;  // 96 bytes
+  OpmaskRegs k;  // 128 bytes.
 } __attribute__((packed));
 
-static_assert((96 + 3264 + 16) == sizeof(State),
+static_assert((96 + 3392 + 16) == sizeof(State),
               "Invalid packing of `struct State`");
 
 using X86State = State;
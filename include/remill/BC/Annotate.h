@@ -27,6 +27,8 @@
 #include <llvm/IR/Module.h>
 #pragma clang diagnostic pop
 
+#include <cstddef>
+#include <memory>
 #include <string>
 #include <unordered_map>
 #include <utility>
@@ -79,6 +81,49 @@ const std::string TieKind = "remill.function.tie";
 
 #if LLVM_VERSION_NUMBER >= LLVM_VERSION(4, 0)
 
+// Index of the functions of a module by origin type, so that
+// `GetFunctionsByOrigin` doesn't have to look at the metadata of every function
+// in the module. Each distinct origin value is given an integer ID, and a
+// query only compares the origin values, not the functions. The index is
+// built from the metadata of every function when it is created, and is kept
+// up to date by `Annotate`, `ChangeOriginType`, and `Remove` while it is alive.
+// Functions that get their metadata any other way, e.g. by being cloned or
+// linked in, need to be passed to `Update`. Deleted functions are dropped
+// automatically.
+//
+// NOTE(pag): Indexed queries return the functions grouped by origin value,
+//            rather than in the order of the module.
+class OriginIndex {
+ public:
+  explicit OriginIndex(llvm::Module &module);
+  ~OriginIndex(void);
+
+  // Returns the index of `module`, or `nullptr` if it doesn't have one.
+  static OriginIndex *Get(const llvm::Module *module);
+
+  // Re-read the origin type of `func`.
+  void Update(llvm::Function *func);
+
+  // Re-read the origin types of every function in the module.
+  void Rebuild(void);
+
+  // Add the functions whose origin value contains any of the `num_values`
+  // strings of `values` to `result`.
+  void GetFunctions(const std::string *const *values, size_t num_values,
+                    std::vector<llvm::Function *> &result) const;
+
+  struct Impl;
+
+ private:
+  OriginIndex(const OriginIndex &) = delete;
+  OriginIndex &operator=(const OriginIndex &) = delete;
+
+  std::unique_ptr<Impl> impl;
+};
+
+// Update the `OriginIndex` of the module of `func`, if there is one.
+void UpdateOriginIndex(llvm::Function *func);
+
 template <typename OriginType>
 static bool Contains(llvm::MDString *node) {
   return node && node->getString().contains(OriginType::metadata_value);
@@ -106,7 +151,8 @@ static bool Remove(llvm::Function *func) {
     return false;
   }
 
-  func->eraseMetadata(node->getMetadataID());
+  func->setMetadata(OriginType::metadata_kind, nullptr);
+  UpdateOriginIndex(func);
   return true;
 }
 
@@ -120,6 +166,28 @@ static void Annotate(llvm::Function *func) {
   auto node =
       llvm::MDNode::get(C, llvm::MDString::get(C, OriginType::metadata_value));
   func->setMetadata(OriginType::metadata_kind, node);
+  UpdateOriginIndex(func);
+}
+
+// Give every function of `module` OriginType. Unlike calling `Annotate` on
+// each function, the metadata node and kind are only looked up once, and
+// functions that already have OriginType, e.g. because it was added when
+// the bitcode was built, are skipped.
+template <typename OriginType>
+static void AnnotateFunctions(llvm::Module &module) {
+  auto &C = module.getContext();
+  DLOG(INFO) << "Annotating the functions of " << module.getName().str()
+             << ": " << OriginType::metadata_kind << " -> "
+             << OriginType::metadata_value;
+  const auto kind = C.getMDKindID(OriginType::metadata_kind);
+  auto node =
+      llvm::MDNode::get(C, llvm::MDString::get(C, OriginType::metadata_value));
+  for (auto &func : module) {
+    if (func.getMetadata(kind) != node) {
+      func.setMetadata(kind, node);
+      UpdateOriginIndex(&func);
+    }
+  }
 }
 
 template <typename OriginType>
@@ -133,9 +201,20 @@ static bool HasOriginType(llvm::Function *func) {
          HasOriginType<Second, OriginTypes...>(func);
 }
 
-// Return list of functions that are one of chosen OriginType
+// Return list of functions that are one of chosen OriginType. This uses the
+// `OriginIndex` of `module` if it has one.
 template <typename Container, typename... OriginTypes>
 static void GetFunctionsByOrigin(llvm::Module &module, Container &result) {
+  if (auto index = OriginIndex::Get(&module)) {
+    const std::string *const values[] = {&(OriginTypes::metadata_value)...};
+    std::vector<llvm::Function *> funcs;
+    index->GetFunctions(values, sizeof...(OriginTypes), funcs);
+    for (auto func : funcs) {
+      result.insert(result.end(), func);
+    }
+    return;
+  }
+
   for (auto &func : module) {
     if (HasOriginType<OriginTypes...>(&func)) {
 
@@ -193,6 +272,53 @@ TieFunctions(llvm::Function *first, llvm::Function *second,
 llvm::Function *GetTied(llvm::Function *func,
                         const std::string &kind = TieKind);
 
+// Index of the ties of one kind between the functions of a module, with
+// constant time lookups in both directions. The index is built from the tie
+// metadata of every function when it is created, and is kept up to date by
+// `TieFunction` and `TieFunctions` while it is alive. Functions whose ties
+// change any other way need to be passed to `Update`. Deleted functions are
+// dropped automatically. The ties themselves are metadata of the module, so
+// they are saved along with it, and an index of a loaded module is rebuilt
+// from them.
+class TieIndex {
+ public:
+  explicit TieIndex(llvm::Module &module, const std::string &kind = TieKind);
+  ~TieIndex(void);
+
+  // Returns the index of the ties of `kind` in `module`, or `nullptr` if
+  // there is none.
+  static TieIndex *Get(const llvm::Module *module,
+                       const std::string &kind = TieKind);
+
+  // Returns the function that `func` is tied to, or `nullptr`.
+  llvm::Function *GetTied(llvm::Function *func) const;
+
+  // Returns the functions that are tied to `func`.
+  const std::vector<llvm::Function *> &GetTiedFrom(llvm::Function *func) const;
+
+  // Every tie, from a function to the function it is tied to.
+  const std::unordered_map<llvm::Function *, llvm::Function *> &
+  Ties(void) const;
+
+  // Re-read the tie of `func`.
+  void Update(llvm::Function *func);
+
+  // Re-read the ties of every function in the module.
+  void Rebuild(void);
+
+  struct Impl;
+
+ private:
+  TieIndex(const TieIndex &) = delete;
+  TieIndex &operator=(const TieIndex &) = delete;
+
+  std::unique_ptr<Impl> impl;
+};
+
+// Update the `TieIndex` of ties of `kind` in the module of `func`, if there
+// is one.
+void UpdateTieIndex(llvm::Function *func, const std::string &kind = TieKind);
+
 
 /* Filter Tied functions in meaningful way. Several overloads are prepared depending on customization
  * required.
@@ -203,6 +329,15 @@ GetTieMapping(llvm::Module &module, BinaryPredicate pred,
               std::unordered_map<llvm::Function *, llvm::Function *> &result,
               const std::string &kind = TieKind) {
 
+  if (auto index = TieIndex::Get(&module, kind)) {
+    for (const auto &[func, tied_to] : index->Ties()) {
+      if (func->getParent() == &module && pred(func, tied_to)) {
+        result.insert({func, tied_to});
+      }
+    }
+    return;
+  }
+
   for (auto &func : module) {
     auto tied_to = GetTied(&func, kind);
     if (tied_to && pred(&func, tied_to)) {
@@ -286,6 +421,11 @@ static void Annotate(llvm::Function *func) {
   NOT_AVAILABLE(ERROR);
 }
 
+template <typename OriginType>
+static void AnnotateFunctions(llvm::Module &module) {
+  NOT_AVAILABLE(ERROR);
+}
+
 template <typename OriginType>
 static bool HasOriginType(llvm::Function *func) {
   NOT_AVAILABLE(ERROR);
@@ -0,0 +1,127 @@
+/*
+ * Copyright (c) 2020 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <llvm/ADT/SmallVector.h>
+#include <remill/BC/Optimizer.h>
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace llvm {
+class Function;
+class LLVMContext;
+class Module;
+}  // namespace llvm
+namespace remill {
+
+// Optimizes lifted traces on background threads while the lifter goes on to
+// lift the next ones, rather than optimizing them all once lifting is done.
+// Each worker thread has its own `llvm::LLVMContext`. A trace is written to
+// bitcode on the lifting thread, and is then read into a worker's context and
+// optimized there with `OptimizeBareModule`, each trace in a module of its
+// own.
+//
+//      remill::BackgroundTraceOptimizer optimizer(guide);
+//      trace_lifter.Lift(addr, [&](uint64_t addr, llvm::Function *func) {
+//        remill::InlineSemanticsIntoTrace(func);
+//        optimizer.Submit(addr, func);
+//      });
+//      optimizer.MergeInto(dest_module);
+//
+// Traces are optimized on their own, and so dead store elimination, which
+// needs the `State` structure of the semantics module, isn't done, and
+// `guide.eliminate_dead_stores` is ignored. `guide.stats` is also ignored, as
+// the statistics are still being used by the lifting thread.
+//
+// The methods are only to be called from one thread, e.g. the lifting thread.
+class BackgroundTraceOptimizer {
+ public:
+  // Invoked on a worker's thread with each optimized trace, e.g. to save it.
+  // `module` is in the worker's context, and only defines the trace.
+  using OptimizedTraceCallback =
+      std::function<void(uint64_t addr, llvm::Module *module)>;
+
+  // If `num_threads` is zero, then the number of hardware threads is used.
+  explicit BackgroundTraceOptimizer(const OptimizationGuide &guide_,
+                                    unsigned num_threads = 1,
+                                    OptimizedTraceCallback on_optimized_ = {});
+
+  // Waits for the queued traces to be optimized.
+  ~BackgroundTraceOptimizer(void);
+
+  // Queue a copy of the trace `func` at `addr`, e.g. from the callback of
+  // `TraceLifter::Lift`, which leaves `func` where it is. The semantics
+  // functions must already be inlined into `func`, e.g. with
+  // `InlineSemanticsIntoTrace`, as the copy only declares what it calls.
+  void Submit(uint64_t addr, llvm::Function *func);
+
+  // Queue `trace_module`, the module of the trace at `addr`, e.g. as released
+  // by `TraceLifter::LiftStreaming`.
+  void Submit(uint64_t addr, std::unique_ptr<llvm::Module> trace_module);
+
+  // Wait for every queued trace to be optimized.
+  void Wait(void);
+
+  // Wait for every queued trace to be optimized, and then move the optimized
+  // traces into `dest_module` with `MergeModulesInto`. The optimized modules
+  // are dropped afterwards.
+  void MergeInto(llvm::Module *dest_module);
+
+ private:
+  BackgroundTraceOptimizer(void) = delete;
+  BackgroundTraceOptimizer(const BackgroundTraceOptimizer &) = delete;
+  BackgroundTraceOptimizer &
+  operator=(const BackgroundTraceOptimizer &) = delete;
+
+  // The bitcode of a trace that is waiting to be optimized.
+  struct Job {
+    uint64_t addr;
+    std::string name;
+    llvm::SmallVector<char, 0> bitcode;
+  };
+
+  struct Worker {
+    std::unique_ptr<llvm::LLVMContext> context;
+    std::vector<std::pair<uint64_t, std::unique_ptr<llvm::Module>>> traces;
+    std::thread thread;
+  };
+
+  void Run(Worker &worker);
+
+  OptimizationGuide guide;
+  const OptimizedTraceCallback on_optimized;
+
+  std::mutex lock;
+  std::condition_variable jobs_cv;
+  std::condition_variable idle_cv;
+  std::deque<Job> jobs;
+  size_t num_busy{0};
+  bool stop{false};
+
+  std::vector<std::unique_ptr<Worker>> workers;
+};
+
+}  // namespace remill
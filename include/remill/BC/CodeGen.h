@@ -0,0 +1,74 @@
+/*
+ * Copyright (c) 2020 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace llvm {
+class Function;
+class Module;
+}  // namespace llvm
+namespace remill {
+
+// How `EmitObjectFile` and `EmitObjectFiles` generate native code.
+struct CodeGenOptions {
+  // The CPU and the target features to generate code for, e.g. `skylake` and
+  // `+avx2`. By default, the generic CPU of the module's target triple.
+  std::string cpu;
+  std::string features;
+
+  // The code generator's optimization level, from `0` to `3`.
+  unsigned opt_level{2};
+
+  // Generate position-independent code, e.g. for shared libraries and
+  // position-independent executables.
+  bool position_independent{true};
+
+  // The number of parts that are compiled at once by `EmitObjectFiles`, or
+  // all cores if `0`.
+  unsigned num_threads{0};
+};
+
+// Compile `module` into a native object file at `file_name`, for the target
+// triple of `module`. Calls to the intrinsics that are still undefined, e.g.
+// `__remill_read_memory_8`, remain undefined symbols of the object file, to
+// be defined by a runtime. `module` isn't changed. Returns `false` if `module`
+// doesn't verify, its target isn't supported, or the file can't be written.
+bool EmitObjectFile(llvm::Module *module, std::string_view file_name,
+                    const CodeGenOptions &options = {},
+                    bool allow_failure = false);
+
+// Compile `module` into one native object file per element of `parts`, e.g.
+// one per range of trace addresses, at the same index of `file_names`. The
+// module is split as by `SplitModule`, so that the first object file also
+// holds every global value outside of `parts`, and each part is then copied
+// into its own `llvm::LLVMContext`, and compiled on its own thread, on up to
+// `options.num_threads` threads at once. Linking the object files together
+// is equivalent to linking the object file of `EmitObjectFile`.
+//
+// Definitions with local linkage in `module` are given external, hidden
+// linkage, as by `SplitModule`; `module` isn't otherwise changed. Returns
+// `false` if any object file couldn't be generated.
+bool EmitObjectFiles(llvm::Module *module,
+                     const std::vector<std::vector<llvm::Function *>> &parts,
+                     const std::vector<std::string> &file_names,
+                     const CodeGenOptions &options = {},
+                     bool allow_failure = false);
+
+}  // namespace remill
@@ -0,0 +1,151 @@
+/*
+ * Copyright (c) 2020 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <remill/BC/TraceLifter.h>
+
+#include <array>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace llvm {
+class Function;
+class Module;
+}  // namespace llvm
+namespace remill {
+
+// The executable memory of a program, and the owner of each of its traces,
+// shared by the `ConcurrentTraceManager`s of many lifting threads. Each trace
+// is claimed by exactly one owner, e.g. one worker of a `ParallelTraceLifter`,
+// and only that owner lifts it.
+//
+// The executable segments must all be added before lifting starts. After
+// that, every method is thread-safe.
+class ConcurrentTraceTable {
+ public:
+  // Add the executable bytes `bytes` of the segment starting at `base`.
+  // Segments must not overlap.
+  void AddExecutableSegment(uint64_t base, std::string bytes);
+
+  // Declare that a trace starts at `addr`, e.g. because `addr` is the entry
+  // point of a function. Lifted code tail-calls declared traces rather than
+  // continuing into them.
+  void DeclareTrace(uint64_t addr);
+
+  // Returns `true` if `DeclareTrace` was called with `addr`.
+  bool IsTraceDeclared(uint64_t addr) const;
+
+  // Claim the trace at `addr` for `owner`. Returns `true` if `owner` now owns
+  // the trace, either because of this call or an earlier one, and `false` if
+  // another owner claimed it first.
+  bool TryClaimTrace(uint64_t addr, unsigned owner);
+
+  // Returns the owner of the trace at `addr`, if it has been claimed.
+  std::optional<unsigned> TraceOwner(uint64_t addr) const;
+
+  // Returns a view of up to `size` executable bytes starting at `addr`, which
+  // is empty if `addr` isn't in an executable segment. The view never spans
+  // two segments.
+  std::string_view ExecutableBytes(uint64_t addr, size_t size) const;
+
+ private:
+  struct Segment {
+    uint64_t base;
+    std::string bytes;
+  };
+
+  struct Shard {
+    mutable std::mutex lock;
+    std::unordered_map<uint64_t, unsigned> owners;
+    std::unordered_set<uint64_t> declared;
+  };
+
+  enum : size_t { kNumShards = 64 };
+
+  Shard &ShardFor(uint64_t addr);
+  const Shard &ShardFor(uint64_t addr) const;
+
+  // Sorted by `Segment::base`.
+  std::vector<Segment> segments;
+
+  std::array<Shard, kNumShards> shards;
+};
+
+// A `TraceManager` for one of many threads that lift the same program at the
+// same time, e.g. one worker of a `ParallelTraceLifter`. Memory is read from,
+// and traces are claimed in, a `ConcurrentTraceTable` shared by all threads,
+// so that no two threads lift the same trace. Traces owned by other threads
+// are declared in `module`, and linked with their definitions by name.
+//
+//      remill::ConcurrentTraceTable table;
+//      table.AddExecutableSegment(text_base, std::move(text_bytes));
+//      remill::ParallelTraceLifter lifter(
+//          os_name, arch_name,
+//          [&table](unsigned shard, llvm::Module *module) {
+//            return std::make_unique<remill::ConcurrentTraceManager>(
+//                table, shard, module);
+//          });
+//      auto shards = lifter.Lift(entry_points);
+//
+// A manager is only ever used by one thread.
+class ConcurrentTraceManager : public TraceManager {
+ public:
+  // Lift the traces claimed by `owner` into `module`.
+  ConcurrentTraceManager(ConcurrentTraceTable &table_, unsigned owner_,
+                         llvm::Module *module_);
+
+  virtual ~ConcurrentTraceManager(void);
+
+  void SetLiftedTraceDefinition(uint64_t addr,
+                                llvm::Function *lifted_func) override;
+
+  llvm::Function *GetLiftedTraceDeclaration(uint64_t addr) override;
+
+  // Returns `nullptr` if the trace at `addr` has now been claimed by this
+  // manager's owner, and so is to be lifted, and a declaration if it is
+  // lifted by another owner.
+  llvm::Function *GetLiftedTraceDefinition(uint64_t addr) override;
+
+  bool TryReadExecutableByte(uint64_t addr, uint8_t *byte) override;
+
+  std::string_view TryReadExecutableBytes(uint64_t addr, size_t size,
+                                          std::string &buffer) override;
+
+  // Traces lifted by this manager's owner, indexed by their entry address.
+  const std::unordered_map<uint64_t, llvm::Function *> &Traces(void) const {
+    return traces;
+  }
+
+ private:
+  ConcurrentTraceManager(void) = delete;
+
+  // Declare the trace at `addr` in `module`.
+  llvm::Function *DeclareExternalTrace(uint64_t addr);
+
+  ConcurrentTraceTable &table;
+  const unsigned owner;
+  llvm::Module *const module;
+  std::unordered_map<uint64_t, llvm::Function *> traces;
+};
+
+}  // namespace remill
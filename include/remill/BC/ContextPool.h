@@ -0,0 +1,143 @@
+/*
+ * Copyright (c) 2020 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <remill/Arch/Name.h>
+#include <remill/OS/OS.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace llvm {
+class LLVMContext;
+class Module;
+}  // namespace llvm
+namespace remill {
+
+class Arch;
+
+// When a `ContextPool` drops a context instead of recycling it. A limit of
+// zero means "unlimited".
+struct ContextPoolLimits {
+  // Maximum number of times that one context is leased out.
+  size_t max_leases{0};
+
+  // Maximum resident set size of the process, in bytes. A context that is
+  // returned while the process is bigger than this is dropped, along with
+  // every idle context. This is only measured on Linux.
+  uint64_t max_resident_bytes{0};
+
+  // Maximum number of idle contexts that are kept.
+  size_t max_idle{0};
+};
+
+// A pool of `llvm::LLVMContext`s, each with its own `Arch` and semantics
+// module, for long-running lifters. The types, constants, and metadata that
+// are interned in a context are only released along with the context, even
+// once the modules that used them are gone, so a process that lifts forever
+// into the same contexts keeps growing. The pool bounds this by dropping
+// contexts once they have been used too often, or once the process has grown
+// too big, and making new ones in their place.
+//
+// The semantics module of a context is loaded once, and is reused by every
+// lease of the context. Lift into a thin module (see `CreateThinModule`)
+// that refers to it, rather than into the semantics module itself, and drop
+// the thin module before the lease ends, so that each lease starts afresh.
+//
+//      remill::ContextPoolLimits limits;
+//      limits.max_leases = 64;
+//      remill::ContextPool pool(os_name, arch_name, limits);
+//      auto lease = pool.Acquire();
+//      auto module = remill::CreateThinModule(lease.Semantics(),
+//                                             lease.Context(), "lifted");
+//      ...
+//
+// The pool is safe to use from many threads. A lease, and its context, is
+// only to be used by one thread at a time.
+class ContextPool {
+ private:
+  struct Entry;
+
+ public:
+  class Lease {
+   public:
+    Lease(Lease &&that) noexcept;
+    Lease &operator=(Lease &&that) noexcept;
+
+    // Returns the context to its pool.
+    ~Lease(void);
+
+    llvm::LLVMContext *Context(void) const;
+    const Arch *GetArch(void) const;
+    llvm::Module *Semantics(void) const;
+
+    // Drop the context rather than recycle it once it is returned, e.g.
+    // because lifting into it failed part of the way through.
+    void Retire(void);
+
+   private:
+    friend class ContextPool;
+
+    Lease(void) = delete;
+    Lease(const Lease &) = delete;
+    Lease &operator=(const Lease &) = delete;
+
+    Lease(ContextPool *pool_, std::unique_ptr<Entry> entry_);
+
+    ContextPool *pool;
+    std::unique_ptr<Entry> entry;
+  };
+
+  ContextPool(OSName os_name_, ArchName arch_name_,
+              const ContextPoolLimits &limits_ = {});
+
+  // Every lease must have ended.
+  ~ContextPool(void);
+
+  // Lease an idle context, or a new one if there are none.
+  Lease Acquire(void);
+
+  // Drop every idle context.
+  void Clear(void);
+
+  // Number of contexts that have been created, and that have been dropped.
+  size_t NumCreated(void) const;
+  size_t NumDropped(void) const;
+
+ private:
+  ContextPool(void) = delete;
+  ContextPool(const ContextPool &) = delete;
+  ContextPool &operator=(const ContextPool &) = delete;
+
+  // Return `entry` to the pool, or drop it.
+  void Release(std::unique_ptr<Entry> entry);
+
+  const OSName os_name;
+  const ArchName arch_name;
+  const ContextPoolLimits limits;
+
+  mutable std::mutex lock;
+  std::vector<std::unique_ptr<Entry>> idle;
+  size_t num_leased{0};
+  size_t num_created{0};
+  size_t num_dropped{0};
+};
+
+}  // namespace remill
@@ -17,8 +17,13 @@
 #pragma once
 
 #include <cstdint>
+#include <memory>
+#include <optional>
+#include <utility>
 #include <vector>
 
+#include "remill/BC/LiftOptions.h"
+
 namespace llvm {
 class Function;
 class Module;
@@ -26,6 +31,7 @@ class Module;
 namespace remill {
 
 class Arch;
+struct LiftStatistics;
 
 // A field or region of the state structure at a particular offset from
 // the top of the state structure (offset 0) with a given size. You can think
@@ -55,10 +61,111 @@ std::vector<StateSlot> StateSlots(const remill::Arch *arch,
                                   llvm::Module *module);
 
 // Analyze a module, discover aliasing loads and stores, and remove dead
-// stores into the `State` structure.
-void RemoveDeadStores(const remill::Arch *arch, llvm::Module *module,
-                      llvm::Function *bb_func,
-                      const std::vector<StateSlot> &slots,
-                      llvm::Function *ds_func = nullptr);
+// stores into the `State` structure. If `stats` is non-null, then the
+// time taken and the number of stores killed are added to it.
+//
+// If `interrupt` is non-null, then it is checked before analyzing each
+// function. Once it fires, no stores are removed, though loads may already
+// have been forwarded, and the reason is returned. Otherwise, this returns
+// `LiftOutcome::kComplete`.
+LiftOutcome RemoveDeadStores(const remill::Arch *arch, llvm::Module *module,
+                            llvm::Function *bb_func,
+                            const std::vector<StateSlot> &slots,
+                            llvm::Function *ds_func = nullptr,
+                            LiftStatistics *stats = nullptr,
+                            const LiftInterrupt *interrupt = nullptr);
+
+// Caches the `State` slots of a module, and the per-function analyses of
+// `RemoveDeadStores`, so that repeatedly optimizing and eliminating dead
+// stores doesn't recompute them. The analyses of a function are reused only
+// if its instructions and their operands are the same as when they were
+// computed, and are otherwise recomputed when `RemoveDeadStores` next visits
+// it. Functions that dead store elimination itself changes are recomputed
+// too.
+class DeadStoreAnalysisCache {
+ public:
+  DeadStoreAnalysisCache(const remill::Arch *arch, llvm::Module *module);
+  ~DeadStoreAnalysisCache(void);
+
+  // Returns the `State` slots of the module, like `StateSlots`.
+  const std::vector<StateSlot> &Slots(void) const;
+
+  // Forget the analyses of `func`, e.g. before deleting it.
+  void Invalidate(llvm::Function *func);
+
+  // Forget the analyses of all functions.
+  void InvalidateAll(void);
+
+ private:
+  friend LiftOutcome RemoveDeadStores(const remill::Arch *, llvm::Module *,
+                                     llvm::Function *,
+                                     DeadStoreAnalysisCache &,
+                                     llvm::Function *, LiftStatistics *,
+                                     const LiftInterrupt *);
+  friend LiftOutcome RemoveDeadStores(const remill::Arch *, llvm::Module *,
+                                     llvm::Function *,
+                                     DeadStoreAnalysisCache &,
+                                     const std::vector<llvm::Function *> &,
+                                     LiftStatistics *, const LiftInterrupt *);
+
+  DeadStoreAnalysisCache(const DeadStoreAnalysisCache &) = delete;
+  DeadStoreAnalysisCache(void) = delete;
+
+  class Impl;
+
+  const std::unique_ptr<Impl> impl;
+};
+
+// Like above, but reuses and updates the analyses in `cache`, which must
+// have been created for `arch` and `module`.
+LiftOutcome RemoveDeadStores(const remill::Arch *arch, llvm::Module *module,
+                            llvm::Function *bb_func,
+                            DeadStoreAnalysisCache &cache,
+                            llvm::Function *ds_func = nullptr,
+                            LiftStatistics *stats = nullptr,
+                            const LiftInterrupt *interrupt = nullptr);
+
+// Incrementally remove dead stores from only the lifted functions `funcs`,
+// e.g. newly lifted traces, and not from the rest of `module`. This is
+// meant for streaming lifters that eliminate dead stores after lifting each
+// trace: the cost depends on `funcs`, and not on the size of `module`. The
+// other functions don't need to be revisited, as the live sets of calls are
+// derived from their arguments, and not from the bodies of their callees.
+//
+// NOTE(pag): Call `cache.Invalidate` on any function before deleting it, as
+//            this doesn't look for functions that have left the module.
+LiftOutcome RemoveDeadStores(const remill::Arch *arch, llvm::Module *module,
+                            llvm::Function *bb_func,
+                            DeadStoreAnalysisCache &cache,
+                            const std::vector<llvm::Function *> &funcs,
+                            LiftStatistics *stats = nullptr,
+                            const LiftInterrupt *interrupt = nullptr);
+
+// The parts of the `State` structure that a lifted function may read or
+// write, including through the functions that it calls, as sorted, disjoint
+// `[begin, end)` byte ranges. Byte ranges, rather than slot indices, keep
+// summaries meaningful across modules with the same `State` structure.
+//
+// With `--export_state_summaries`, dead store elimination attaches a summary
+// to each lifted function that it fully analyzes, as `remill.state.reads`
+// and `remill.state.writes` metadata. With `--use_state_summaries`, it
+// uses the summaries of callees as the live sets of calls to them, instead
+// of treating all slots as live. A summary only stays valid for as long as
+// the function doesn't gain any `State` accesses, and so it should be
+// cleared if the function's body is replaced, e.g. by lifting it again.
+struct StateSlotSummary {
+  std::vector<std::pair<uint64_t, uint64_t>> reads;
+  std::vector<std::pair<uint64_t, uint64_t>> writes;
+};
+
+// Returns the `State` slot summary attached to `func`, if any.
+std::optional<StateSlotSummary> GetStateSlotSummary(llvm::Function *func);
+
+// Attach `summary` to `func`, replacing any existing summary.
+void SetStateSlotSummary(llvm::Function *func,
+                         const StateSlotSummary &summary);
+
+// Remove the `State` slot summary from `func`.
+void ClearStateSlotSummary(llvm::Function *func);
 
 }  // namespace remill
@@ -0,0 +1,88 @@
+/*
+ * Copyright (c) 2020 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <remill/Arch/Instruction.h>
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+namespace remill {
+
+class Arch;
+class InstructionCache;
+
+// A contiguous range of executable bytes, the first of which is located at
+// `address`.
+struct ExecutableRange {
+  uint64_t address;
+  std::string_view bytes;
+};
+
+// Summary of one instruction found by a `Disassembler`.
+struct DisassembledInstruction {
+  uint64_t pc;
+  uint64_t branch_taken_pc;
+  uint64_t branch_not_taken_pc;
+  uint32_t size;  // In bytes.
+  Instruction::Category category;
+};
+
+// The instructions found by a `Disassembler`, sorted by address.
+struct DisassemblyIndex {
+ public:
+  // Returns the instruction starting at `pc`, or `nullptr` if there is none.
+  const DisassembledInstruction *Find(uint64_t pc) const;
+
+  std::vector<DisassembledInstruction> instructions;
+};
+
+// Decodes whole ranges of executable code ahead of lifting, e.g. for control-
+// flow recovery. Every decoded instruction is summarized in the returned
+// `DisassemblyIndex`, and, if a cache is given, added to the cache. Passing
+// that cache to a `TraceLifter` using the same `Arch` lets the trace lifter
+// lift those instructions without decoding them again.
+class Disassembler {
+ public:
+  // Linear sweeps are split across `num_workers` threads. If `num_workers` is
+  // zero, then the number of hardware threads is used. Each worker decodes
+  // with its own copy of `arch`, in its own `llvm::LLVMContext`, and the
+  // decoded instructions are re-targeted to `arch` before they're cached.
+  Disassembler(const Arch *arch_, InstructionCache *cache_ = nullptr,
+               unsigned num_workers_ = 1);
+
+  // Decode every instruction in `ranges`, one after the other. Undecodable
+  // bytes are skipped up to the next possible instruction boundary.
+  DisassemblyIndex LinearSweep(const std::vector<ExecutableRange> &ranges);
+
+  // Decode the instructions in `ranges` that are reachable from `roots` by
+  // following fall-throughs and direct control-flow targets. This always
+  // runs on the calling thread.
+  DisassemblyIndex
+  RecursiveDescent(const std::vector<ExecutableRange> &ranges,
+                   const std::vector<uint64_t> &roots);
+
+ private:
+  Disassembler(void) = delete;
+
+  const Arch *const arch;
+  InstructionCache *const cache;
+  const unsigned num_workers;
+};
+
+}  // namespace remill
@@ -0,0 +1,70 @@
+/*
+ * Copyright (c) 2020 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#pragma once
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace llvm {
+class Function;
+class Module;
+}  // namespace llvm
+namespace remill {
+
+// Names of the globals of the dispatch table made by `AddDispatchTable`.
+static constexpr const char *kDispatchTablePCsName =
+    "__remill_dispatch_table_pcs";
+static constexpr const char *kDispatchTableTracesName =
+    "__remill_dispatch_table_traces";
+static constexpr const char *kDispatchTableSizeName =
+    "__remill_dispatch_table_size";
+static constexpr const char *kDispatchLookupName = "__remill_dispatch_lookup";
+
+// Add a constant table that maps the entry addresses of `traces` to their
+// lifted functions to `module`, along with a function that looks up the
+// lifted function of an address, so that a runtime can find the target of
+// `__remill_jump`, `__remill_function_call`, or `__remill_function_return`
+// without building a map of its own:
+//
+//      LiftedFunc *__remill_dispatch_lookup(addr_t pc);
+//
+// returns the lifted function of the trace at `pc`, or `nullptr`.
+//
+// The table is `kDispatchTableSizeName` entries long, and is stored as two
+// arrays of one more entry each, `kDispatchTablePCsName` and
+// `kDispatchTableTracesName`, indexed from one, in the order of an implicit
+// binary search tree (Eytzinger order): the children of entry `k` are at
+// `2k` and `2k + 1`. The search is then branch-free, and the first levels of
+// the tree, which every search visits, share a few cache lines. Entry zero
+// has no trace:
+//
+//      size_t k = 1;
+//      while (k <= size) {
+//        k = 2 * k + (pcs[k] < pc);
+//      }
+//      k >>= __builtin_ffsll(~k);
+//      return pcs[k] == pc ? traces[k] : nullptr;
+//
+// The lifted functions of `traces` must be in `module`, and must all have the
+// same type. Returns the lookup function, or `nullptr` if `traces` is empty.
+llvm::Function *AddDispatchTable(
+    llvm::Module *module,
+    const std::vector<std::pair<uint64_t, llvm::Function *>> &traces);
+
+}  // namespace remill
@@ -0,0 +1,65 @@
+/*
+ * Copyright (c) 2020 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace llvm {
+class Function;
+}  // namespace llvm
+namespace remill {
+
+class Arch;
+
+// The calling convention of a lifted function, i.e. of a set of traces that
+// is only entered at its entry and left by returning to its caller.
+struct FunctionABI {
+  // Names of the registers whose values are observed by the caller once the
+  // function returns, e.g. the return value registers and the callee-saved
+  // registers. The program counter and the stack pointer are always
+  // written back.
+  std::vector<std::string> live_out_registers;
+};
+
+// Create a function named `name` that runs the lifted function whose entry
+// trace is `traces[0]`, and whose other traces are `traces[1:]`. The new
+// function has the same type as a trace, and is defined in the module of
+// `traces[0]`.
+//
+// The traces are inlined into the new function, which runs them on a private
+// copy of the `State` structure, so that once the function is optimized
+// (e.g. by SROA), registers live in SSA values rather than in `State`. The
+// private copy is only spilled to the real `State` structure around the
+// calls that remain and may access it (see `PrivatizeState`), e.g. to
+// intrinsics such as `__remill_function_call` or `__remill_async_hyper_call`,
+// and to traces outside of the function. On return, only the registers of
+// `abi` are written back.
+//
+// Each trace is inlined once; the other calls to it (e.g. the back edges of
+// loops that span several traces) remain calls, and so spill `State`. Form
+// larger traces (see `FormTraceRegions`) to keep loops within one trace.
+//
+// The semantics functions must already be inlined into the traces. Returns
+// `nullptr` if any register of `abi` is unknown to `arch`.
+llvm::Function *
+CreateFunctionWrapper(const Arch *arch,
+                      const std::vector<llvm::Function *> &traces,
+                      const FunctionABI &abi, std::string_view name);
+
+}  // namespace remill
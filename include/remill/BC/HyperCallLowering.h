@@ -0,0 +1,70 @@
+/*
+ * Copyright (c) 2020 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <utility>
+
+namespace llvm {
+class Module;
+}  // namespace llvm
+namespace remill {
+
+class Arch;
+
+// The values of `EAX`, `EBX`, `ECX`, and `EDX` after `CPUID`.
+struct CPUIDLeaf {
+  uint32_t eax{0};
+  uint32_t ebx{0};
+  uint32_t ecx{0};
+  uint32_t edx{0};
+};
+
+// The synchronous hyper calls that `LowerSyncHyperCalls` replaces with inline
+// code.
+struct SyncHyperCallLowering {
+
+  // Sub-leaf of the `cpuid` entries that apply to every sub-leaf of their
+  // leaf.
+  static constexpr uint32_t kAnySubLeaf = ~0u;
+
+  // If `true`, then `kX86ReadTSC` and `kX86ReadTSCP` read the host's cycle
+  // counter, with `llvm.readcyclecounter` (i.e. `rdtsc` on x86 hosts), and
+  // `kX86ReadTSCP` sets `ECX` to `tsc_aux`.
+  bool read_tsc{false};
+  uint32_t tsc_aux{0};
+
+  // If non-empty, then `kX86CPUID` looks up the leaf in `EAX` and the
+  // sub-leaf in `ECX` in this table. An entry whose sub-leaf is `kAnySubLeaf`
+  // applies to the sub-leaves of its leaf that have no entry of their own.
+  // Leaves with no entry return zeros.
+  std::map<std::pair<uint32_t, uint32_t>, CPUIDLeaf> cpuid;
+};
+
+// Replace the calls in `module` to `__remill_sync_hyper_call` with the hyper
+// calls selected by `lowering` with inline code, which reads and writes the
+// registers of `arch` in the `State` structure directly, so that they don't
+// need to be implemented by the runtime, and don't cost a call. As with the
+// instructions, the 32-bit register writes of AMD64 zero the upper halves
+// of the registers. Only x86 and AMD64 hyper calls are lowered.
+//
+// Returns the number of calls that were lowered.
+uint64_t LowerSyncHyperCalls(const Arch *arch, llvm::Module *module,
+                             const SyncHyperCallLowering &lowering);
+
+}  // namespace remill
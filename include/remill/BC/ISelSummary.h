@@ -0,0 +1,78 @@
+/*
+ * Copyright (c) 2020 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <utility>
+#include <vector>
+
+namespace llvm {
+class Function;
+class GlobalVariable;
+class Module;
+}  // namespace llvm
+
+namespace remill {
+
+// What the semantics function of one ISEL may do, so that the lifter and the
+// optimizer can reason about calls to it without analyzing its body. The
+// semantics function takes the memory pointer as argument 0, the `State`
+// structure as argument 1, and the operands after that.
+//
+// Summaries are computed when the semantics are built (see
+// `REMILL_SUMMARIZE_SEMANTICS`), and attached to the `ISEL_` variables as
+// metadata.
+struct ISelSummary {
+  // Whether the semantics function calls the memory read or write
+  // intrinsics, has more than one basic block, or calls a hyper call
+  // intrinsic. These are always conservatively correct.
+  bool reads_memory{true};
+  bool writes_memory{true};
+  bool has_control_flow{true};
+  bool has_hyper_calls{true};
+
+  // If `false`, then some access to `State` or through an operand couldn't be
+  // accounted for, e.g. because it has a variable offset, or because the
+  // semantics function passes `State` to a hyper call, and so the function
+  // must be assumed to read and write all of `State` and of its operands.
+  bool precise{false};
+
+  // Sorted, disjoint `[begin, end)` byte ranges of `State` that the semantics
+  // function may read and write through argument 1.
+  std::vector<std::pair<uint64_t, uint64_t>> state_reads;
+  std::vector<std::pair<uint64_t, uint64_t>> state_writes;
+
+  // Pairs of a pointer argument number and the number of bytes from where
+  // that argument points that the semantics function may read or write
+  // through it. Pointer arguments that aren't listed aren't accessed.
+  std::vector<std::pair<unsigned, uint64_t>> arg_reads;
+  std::vector<std::pair<unsigned, uint64_t>> arg_writes;
+};
+
+// Summarize what the semantics function `sem` may do.
+ISelSummary SummarizeSemantics(llvm::Function *sem);
+
+// Attach the summary of each `ISEL_` variable's semantics function in `module`
+// to the variable. Returns the number of variables that were annotated.
+unsigned AnnotateISelSummaries(llvm::Module *module);
+
+// Returns the summary attached to `isel` by `AnnotateISelSummaries`, if any.
+std::optional<ISelSummary> GetISelSummary(const llvm::GlobalVariable *isel);
+
+}  // namespace remill
@@ -16,7 +16,12 @@
 
 #pragma once
 
+#include <llvm/ADT/ArrayRef.h>
+
+#include <cstddef>
 #include <cstdint>
+#include <functional>
+#include <iosfwd>
 #include <memory>
 #include <string_view>
 
@@ -36,8 +41,11 @@ namespace remill {
 
 class Arch;
 class Instruction;
+class InstructionLifterSharedState;
 class IntrinsicTable;
 class Operand;
+struct LiftStatistics;
+struct Register;
 class OperandExpression;
 class TraceLifter;
 
@@ -66,6 +74,55 @@ class InstructionLifter {
 
   InstructionLifter(const Arch *arch_, const IntrinsicTable *intrinsics_);
 
+  // Create a lifter that lifts into the thin module of `intrinsics_` (see
+  // `CreateThinModule`), rather than into the semantics module. The semantics
+  // functions are looked up in `semantics_module_`, and declared in the thin
+  // module as they are used; their bodies are only linked in later, by
+  // `LinkSemanticsInto`. Until then, the options that need the bodies, i.e.
+  // `SetInlineSemantics`, `SetSpecializeSemantics`, and the analysis of the
+  // `State` accesses of semantics functions, treat them as opaque calls.
+  InstructionLifter(const Arch *arch_, const IntrinsicTable *intrinsics_,
+                    llvm::Module *semantics_module_);
+
+  // Create a lifter that shares the immutable parts of another lifter, i.e.
+  // its architecture, intrinsics, and table of instruction semantics
+  // functions. This is cheap, as nothing needs to be looked up in the module.
+  // The shared state is never modified, so it can safely be used by lifters
+  // on different threads. Each lifter has its own caches, and so a lifter
+  // itself must only be used by one thread at a time.
+  //
+  // NOTE(pag): LLVM doesn't allow concurrent modification of IR within the
+  //            same `llvm::LLVMContext`; creating instructions, e.g. calls to
+  //            the same semantics functions, updates shared use lists. Lifters
+  //            on different threads lifting into the same module must
+  //            serialize their calls to `LiftIntoBlock` with a lock.
+  explicit InstructionLifter(
+      std::shared_ptr<const InstructionLifterSharedState> shared_);
+
+  // Create a lifter that lifts into the module of `intrinsics_`, reusing the
+  // index of semantics functions of `tmpl`, the shared state of a lifter of
+  // another module. Indexing the semantics functions is the slow part of
+  // creating a lifter, and so a session that lifts into a new module made
+  // from the same semantics can instead rebind a template, in microseconds:
+  //
+  //      remill::IntrinsicTable intrinsics(tmpl_intrinsics, module);
+  //      remill::InstructionLifter lifter(tmpl_lifter.SharedState(),
+  //                                       &intrinsics, semantics);
+  //
+  // `semantics_module_` is as for the thin module constructor. If it is null,
+  // then the module of `intrinsics_` is its own semantics module, e.g. a clone
+  // of the semantics module of `tmpl`, and the semantics functions are found
+  // in it by the names of their counterparts in `tmpl`. `tmpl` itself doesn't
+  // need to outlive the new lifter.
+  InstructionLifter(
+      const std::shared_ptr<const InstructionLifterSharedState> &tmpl,
+      const IntrinsicTable *intrinsics_,
+      llvm::Module *semantics_module_ = nullptr);
+
+  // Returns the immutable state of this lifter, which can be used to create
+  // other lifters for the same architecture and module.
+  std::shared_ptr<const InstructionLifterSharedState> SharedState(void) const;
+
   // Lift a single instruction into a basic block. `is_delayed` signifies that
   // this instruction will execute within the delay slot of another instruction.
   virtual LiftStatus LiftIntoBlock(Instruction &inst, llvm::BasicBlock *block,
@@ -77,6 +134,32 @@ class InstructionLifter {
   LiftStatus LiftIntoBlock(Instruction &inst, llvm::BasicBlock *block,
                            bool is_delayed = false);
 
+  // Lift a straight-line sequence of decoded instructions into `block`, in
+  // order. This is like calling `LiftIntoBlock` on each instruction, except
+  // that `MEMORY`, `PC`, and `NEXT_PC` are kept as SSA values across the
+  // instructions, and are only stored back to the `State` structure at the end
+  // of the block, or before an instruction that observes them, i.e. a
+  // control-flow instruction, an invalid or unsupported instruction, or one
+  // with an operand naming the program counter.
+  //
+  // NOTE(pag): Semantics functions that read the program counter directly
+  //            out of the `State` structure (instead of through an operand)
+  //            will observe a stale value. Delay slots are not handled; lift
+  //            those with `LiftIntoBlock`.
+  //
+  // Lifting stops at the first instruction that doesn't lift successfully,
+  // and its status is returned. If `num_lifted` is non-null, then it is set to
+  // the number of instructions passed to `LiftIntoBlock`, including that
+  // failing instruction.
+  LiftStatus LiftBlock(llvm::MutableArrayRef<Instruction> insts,
+                       llvm::BasicBlock *block, llvm::Value *state_ptr,
+                       size_t *num_lifted = nullptr);
+
+  // Lift a straight-line sequence of decoded instructions into `block`, using
+  // the `State` pointer argument of `block`'s function.
+  LiftStatus LiftBlock(llvm::MutableArrayRef<Instruction> insts,
+                       llvm::BasicBlock *block, size_t *num_lifted = nullptr);
+
   // Load the address of a register.
   llvm::Value *LoadRegAddress(llvm::BasicBlock *block, llvm::Value *state_ptr,
                               std::string_view reg_name) const;
@@ -85,9 +168,189 @@ class InstructionLifter {
   llvm::Value *LoadRegValue(llvm::BasicBlock *block, llvm::Value *state_ptr,
                             std::string_view reg_name) const;
 
+  // Load the address of a register. This is like looking up the register by
+  // its name, except that the per-function cache is indexed by
+  // `Register::index` instead.
+  llvm::Value *LoadRegAddress(llvm::BasicBlock *block, llvm::Value *state_ptr,
+                              const Register *reg) const;
+
+  // Load the value of a register.
+  llvm::Value *LoadRegValue(llvm::BasicBlock *block, llvm::Value *state_ptr,
+                            const Register *reg) const;
+
   // Clear out the cache of the current register values/addresses loaded.
   void ClearCache(void) const;
 
+  // Count ISEL lookups into `stats`, or stop counting if `stats` is null.
+  // While counting, the outcome of lifting each instruction is also counted
+  // per semantics function; see `ForEachLiftStatus`.
+  void SetStatistics(LiftStatistics *stats);
+
+  // Invoke `cb` on the number of times that each semantics function has been
+  // lifted with each status. Missing semantics functions are reported under
+  // the name of the instruction function that was looked up.
+  void ForEachLiftStatus(
+      std::function<void(std::string_view, LiftStatus, uint64_t)> cb) const;
+
+  // Print out `ForEachLiftStatus` as CSV, with the most frequent first.
+  void PrintLiftStatuses(std::ostream &os) const;
+
+  // Forget the counts of `ForEachLiftStatus`.
+  void ClearLiftStatuses(void);
+
+  // Enable or disable removing stores to the `State` structure that are
+  // overwritten later in the same block before being read, at the end of
+  // `LiftBlock`. This matters most for the arithmetic flags, which most
+  // instructions compute but few instructions read: only the flags that are
+  // observed within the block, or that are live on exit from the block, are
+  // kept. Stores inside of semantics functions are only visible when
+  // `SetInlineSemantics` is also enabled. Calls to semantics functions are
+  // assumed to read all of `State`, unless the semantics were built with
+  // `REMILL_SUMMARIZE_SEMANTICS` (see `ISelSummary`).
+  void SetEliminateDeadStateStores(bool enabled);
+
+  // Enable or disable tracking the stack pointer symbolically within a block
+  // lifted by `LiftBlock`. Each stack pointer value computed in the block
+  // (e.g. by the `PUSH` and `POP` instructions of a prologue or epilogue) is
+  // rewritten as a constant offset from the stack pointer on entry to the
+  // block, or from the last value stored to it by something other than an
+  // addition or subtraction (e.g. `mov rsp, rbp`), and loads of the stack
+  // pointer reuse the value last stored to it. Memory accesses are then made
+  // at `SP_entry + constant` rather than through a serial chain of updates.
+  // Along with `SetEliminateDeadStateStores`, only the last store to the stack
+  // pointer in the block remains. Stack pointer updates inside of semantics
+  // functions are only visible when `SetInlineSemantics` is also enabled.
+  void SetFoldStackPointerDeltas(bool enabled);
+
+  // Enable or disable merging writes to sub-registers (e.g. `AL`, `AH`, and
+  // `AX` on x86) within a block lifted by `LiftBlock`. The value of each
+  // integer register written in the block is kept as one SSA value of the
+  // width of its enclosing register (e.g. `RAX`): a write to a sub-register
+  // is merged into that value with a mask and an or, and a read of a
+  // sub-register after that is extracted from it. The register is stored
+  // back once, at the end of the block, or before anything else that might
+  // access it, e.g. a call that isn't a memory intrinsic. Writes that zero
+  // the upper half of a register (32-bit writes on AMD64, `W` register writes
+  // on AArch64) are already full-width stores, and so they replace the value
+  // outright, and the partial updates before them become trivially dead.
+  // Writes inside of semantics functions are only visible when
+  // `SetInlineSemantics` is also enabled.
+  void SetMergeSubRegisterWrites(bool enabled);
+
+  // Enable or disable specializing semantics functions to their constant
+  // operands, e.g. immediate shift amounts. When a semantics function is
+  // repeatedly called with the same constant operands, a copy of it with those
+  // operands folded in is created once per module, and called instead. This
+  // composes with `SetInlineSemantics`.
+  void SetSpecializeSemantics(bool enabled);
+
+  // Enable or disable splicing the bodies of semantics functions directly into
+  // lifted blocks instead of calling them. Each semantics function is copied
+  // and cleaned up once, and the copy is then inlined at every use, so that
+  // the lifted code doesn't depend on the optimizer's inliner. Semantics
+  // functions whose cleaned-up bodies have more than one basic block are
+  // still called.
+  void SetInlineSemantics(bool enabled);
+
+  // Enable or disable computing the addresses of all registers at once, at the
+  // start of the entry block, the first time that any register of a function
+  // is needed. This emits them in one pass over a per-architecture list of
+  // registers, instead of inserting each register's `getelementptr` when it's
+  // first used. Addresses that go unused are trivially dead, and are removed
+  // by any later cleanup.
+  void SetHoistRegisterAddresses(bool enabled);
+
+  // Enable or disable forwarding of register values within a block. When
+  // enabled, a register read more than once within a block is only loaded once
+  // from the `State` structure, and the loaded SSA value is reused until an
+  // instruction might write to (part of) that register, either through a
+  // write operand, or through a store in its semantics function. Semantics
+  // functions that pass the `State` pointer elsewhere conservatively clobber
+  // all registers. Along with this, identical address and expression operand
+  // computations within a block are memoized. This reduces the number of
+  // loads and redundant arithmetic that later optimizations need to clean up.
+  //
+  // NOTE(pag): Code that stores to registers in a block between calls to
+  //            `LiftIntoBlock` must call `ClearCache` when this is enabled.
+  void SetRegisterValueForwarding(bool enabled);
+
+  // Enable or disable treating segment base registers (e.g. `FSBASE` and
+  // `GSBASE` on x86) as invariant within a lifted function. When enabled, each
+  // segment base used by a memory operand is loaded once, in the entry block,
+  // and that value is used by every address computation in the function.
+  // This is only correct if nothing in the function writes to the segment
+  // bases.
+  void SetInvariantSegmentBases(bool enabled);
+
+  // Enable or disable skipping register writes that are dead within a block
+  // lifted by `LiftBlock`. Before lifting, a backward pass over the decoded
+  // instructions finds the register write operands whose registers are fully
+  // overwritten by a later instruction of the block before being read. It
+  // uses the read and write actions of the operands, and a summary of the
+  // loads and stores that each semantics function makes directly to the
+  // `State` structure (e.g. to the arithmetic flags). Dead write operands are
+  // passed a pointer to scratch space instead of to the register, so that no
+  // store to `State` is emitted for them once the semantics are inlined.
+  // Everything is assumed to be live at the end of the block.
+  void SetSkipDeadRegisterWrites(bool enabled);
+
+  // Enable or disable adding the variables of `__remill_basic_block` (e.g.
+  // the segment bases on x86, or `WZR` on AArch64) to a lifted function when
+  // they're first used, rather than expecting them to already be defined.
+  // Enable this when lifting into functions made with
+  // `CloneBlockFunctionPrologueInto`.
+  void SetLazyBlockVariables(bool enabled);
+
+  // Enable or disable stamping out copies of the IR lifted for identical
+  // instructions. The first time that `LiftIntoBlock` lifts an instruction
+  // with a given semantics function, size, and operands, the IR that it emits
+  // is recorded as a template (in a private function of the module, named
+  // `__remill_instruction_templates`); later occurrences of the same
+  // instruction are lifted by cloning the template into the block, and by
+  // remapping the `State` pointer and the register addresses that it uses.
+  // This skips operand lifting, ISEL argument checks, and the inlining of
+  // semantics, and so lifting repeated instructions costs little more than
+  // copying their IR.
+  //
+  // Templates are only used by `LiftIntoBlock` outside of `LiftBlock`, and
+  // not for delayed instructions, nor when `SetRegisterValueForwarding` or
+  // `SetSpecializeSemantics` are enabled, as those make the lifted IR depend
+  // on what was lifted before it. Debug locations aren't copied.
+  void SetInstructionTemplates(bool enabled);
+
+  // Forget all recorded instruction templates, and remove their function from
+  // the module. This is also done when the lifter is destroyed.
+  void ClearInstructionTemplates(void);
+
+  // Enable or disable lifting atomic read-modify-write instructions with the
+  // native variants of their semantics, named `<ISEL>_NATIVE`, where the
+  // architecture has them. Those use the atomic memory intrinsics (e.g.
+  // `__remill_compare_exchange_memory_64`) rather than modelling atomicity in
+  // the `State` structure, and so they stay atomic when the lifted code runs
+  // on many threads at once.
+  //
+  // On AArch64, a store-exclusive (`STXR`, `STLXR`) becomes a compare-exchange
+  // of the value that the load-exclusive before it loaded, and so a
+  // `LDXR`...`STXR` retry loop becomes a compare-exchange loop. Like other
+  // emulators, this can't tell apart a location that was changed and then
+  // changed back (ABA) from an untouched one.
+  void SetNativeAtomics(bool enabled);
+
+  // Enable or disable giving the IR lifted for each instruction a debug
+  // location that encodes the address of the instruction, in a subprogram of
+  // the lifted function. The line is the low 32 bits of the address, and the
+  // column is the next 16 bits. The locations survive optimization and code
+  // generation, and so profilers can attribute the native code of lifted
+  // functions to the instructions that it came from (see
+  // `TraceJITOptions::write_perf_map`). The IR added around the lifted
+  // instructions, e.g. by the `TraceLifter`, is at line 0.
+  void SetGuestPCDebugLocations(bool enabled);
+
+  // Returns a hash of the settings of this lifter that change the lifted IR,
+  // e.g. so that a `TraceCache` doesn't return traces lifted with different
+  // settings.
+  uint64_t OptionsHash(void) const;
+
  protected:
   friend class TraceLifter;
 
@@ -135,6 +398,14 @@ class InstructionLifter {
   LoadWordRegValOrZero(llvm::BasicBlock *block, llvm::Value *state_ptr,
                        std::string_view reg_name, llvm::ConstantInt *zero);
 
+  // Return the value of a register that doesn't change within the function
+  // of `block`, or zero. The register is loaded once, in the entry block.
+  llvm::Value *
+  LoadInvariantWordRegValOrZero(llvm::BasicBlock *block,
+                                llvm::Value *state_ptr,
+                                std::string_view reg_name,
+                                llvm::ConstantInt *zero);
+
  private:
   InstructionLifter(const InstructionLifter &) = delete;
   InstructionLifter(InstructionLifter &&) noexcept = delete;
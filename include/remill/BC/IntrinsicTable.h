@@ -33,6 +33,13 @@ class IntrinsicTable {
 
   explicit IntrinsicTable(llvm::Module *module);
 
+  // Bind the intrinsics of `module`, e.g. a clone of the module of `tmpl`, or
+  // another thin module of the same semantics (see `CreateThinModule`). Each
+  // intrinsic is found by the name of its counterpart in `tmpl`, and shares
+  // its attributes if both are in the same context, which is much cheaper
+  // than building them again.
+  IntrinsicTable(const IntrinsicTable &tmpl, llvm::Module *module);
+
   llvm::Function *const error;
 
   // Control-flow.
@@ -66,6 +73,26 @@ class IntrinsicTable {
   llvm::Function *const write_memory_f80;
   llvm::Function *const write_memory_f128;
 
+  // Vector memory access intrinsics.
+  llvm::Function *const read_memory_v128;
+  llvm::Function *const read_memory_v256;
+  llvm::Function *const read_memory_v512;
+
+  llvm::Function *const write_memory_v128;
+  llvm::Function *const write_memory_v256;
+  llvm::Function *const write_memory_v512;
+
+  // Bulk memory intrinsics.
+  llvm::Function *const copy_memory_8;
+  llvm::Function *const copy_memory_16;
+  llvm::Function *const copy_memory_32;
+  llvm::Function *const copy_memory_64;
+
+  llvm::Function *const fill_memory_8;
+  llvm::Function *const fill_memory_16;
+  llvm::Function *const fill_memory_32;
+  llvm::Function *const fill_memory_64;
+
   // Memory barriers.
   llvm::Function *const barrier_load_load;
   llvm::Function *const barrier_load_store;
@@ -0,0 +1,103 @@
+/*
+ * Copyright (c) 2020 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+namespace remill {
+
+// Cancels lifting and optimization from another thread, e.g. when the
+// request that they serve has been abandoned. Cancellation is sticky.
+class CancellationToken {
+ public:
+  void Cancel(void) {
+    cancelled.store(true, std::memory_order_relaxed);
+  }
+
+  bool IsCancelled(void) const {
+    return cancelled.load(std::memory_order_relaxed);
+  }
+
+ private:
+  std::atomic<bool> cancelled{false};
+};
+
+// Why lifting or optimization stopped.
+enum class LiftOutcome : uint8_t {
+
+  // Everything was done.
+  kComplete,
+
+  // The `CancellationToken` was cancelled.
+  kCancelled,
+
+  // The deadline passed.
+  kDeadlineExceeded,
+
+  // The instruction or trace budget of `LiftOptions` was used up.
+  kBudgetExhausted
+};
+
+// Returns the name of `status`, e.g. `deadline_exceeded`.
+const char *LiftOutcomeName(LiftOutcome status);
+
+// Tells long-running work when to stop early. This is checked between units
+// of work, e.g. between instructions or functions, and so work may continue
+// for a short while past the deadline. By default, work is never interrupted.
+struct LiftInterrupt {
+  using Clock = std::chrono::steady_clock;
+
+  Clock::time_point deadline{Clock::time_point::max()};
+
+  // Optional; not owned.
+  const CancellationToken *cancel{nullptr};
+
+  // Returns `true` if this can ever interrupt anything.
+  bool IsSet(void) const {
+    return cancel || deadline != Clock::time_point::max();
+  }
+
+  // Returns `kCancelled` or `kDeadlineExceeded` if work should stop now, and
+  // `kComplete` otherwise.
+  LiftOutcome Check(void) const {
+    if (cancel && cancel->IsCancelled()) {
+      return LiftOutcome::kCancelled;
+    } else if (deadline != Clock::time_point::max() &&
+               Clock::now() >= deadline) {
+      return LiftOutcome::kDeadlineExceeded;
+    } else {
+      return LiftOutcome::kComplete;
+    }
+  }
+};
+
+// Bounds on the work done by one call to `TraceLifter::Lift`. A limit of zero
+// means "unlimited".
+struct LiftOptions {
+  LiftInterrupt interrupt;
+
+  // Maximum number of instructions decoded across all traces.
+  size_t max_instructions{0};
+
+  // Maximum number of traces lifted.
+  size_t max_traces{0};
+};
+
+}  // namespace remill
@@ -0,0 +1,126 @@
+/*
+ * Copyright (c) 2020 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+
+namespace llvm {
+class Constant;
+class Module;
+class Value;
+}  // namespace llvm
+namespace remill {
+
+class Arch;
+
+// Replace the calls in `module` to the memory access intrinsics with plain
+// loads and stores into a flat guest address space, so that alias analysis,
+// LICM, vectorization, etc. can reason about the lifted memory accesses. The
+// guest address `addr` is located at the host address `base + addr`, where
+// `base` is a constant pointer, e.g. a global variable, or `nullptr` to use
+// guest addresses as host addresses.
+//
+// This lowers:
+//
+//    * The scalar, floating point, and vector memory reads and writes. The
+//      accesses may be unaligned. `f80` and `f128` memory is converted to and
+//      from `double`, just like the intrinsics do.
+//    * The bulk copy intrinsics, into `memcpy`, and the byte fill intrinsic,
+//      into `memset`. The wider fill intrinsics are left alone.
+//    * The memory barrier intrinsics into fences, and the atomic region
+//      intrinsics into sequentially consistent fences.
+//
+// The lowered writes and barriers return the `Memory *` that they are given.
+// The other intrinsics that take a `Memory *`, e.g. the atomic compare and
+// exchange intrinsics, are left alone, but are no longer marked as not
+// accessing memory, so that the lowered accesses aren't reordered across
+// them. The runtime implementing those must use the same flat address space.
+//
+// NOTE(pag): Accesses between the atomic region intrinsics, e.g. of x86
+//            `LOCK`-prefixed instructions, become individual, non-atomic
+//            loads and stores.
+//
+// Returns the number of calls that were lowered.
+uint64_t LowerMemoryIntrinsics(llvm::Module *module,
+                               llvm::Constant *base = nullptr);
+
+// Replace the calls in `module` to the memory barrier and atomic region
+// intrinsics with fences, as `LowerMemoryIntrinsics` does, and the calls to
+// the delay slot intrinsics with the `Memory *` that they are given. If
+// `single_threaded` is `true`, then no fences are added, because nothing else
+// can observe the order of the guest's memory accesses.
+//
+// NOTE(pag): Fences only order the memory accesses that LLVM can see, and so
+//            they don't order calls to the memory access intrinsics, which
+//            are marked as not accessing memory. Only use fences if those
+//            have been lowered too, or are implemented by a runtime that
+//            orders them some other way.
+//
+// Returns the number of calls that were lowered.
+uint64_t LowerBarrierIntrinsics(llvm::Module *module, bool single_threaded);
+
+// Returns `true` if the `size_a` bytes of guest memory at the address `addr_a`
+// are known not to overlap the `size_b` bytes at the address `addr_b`, e.g.
+// because the `TraceManager` that lifted the code knows that one is a stack
+// slot and the other is a global variable. The addresses are the `addr_t`
+// operands of two memory access intrinsic calls in the same function.
+using DisjointMemoryFunc = std::function<bool(
+    llvm::Value *addr_a, uint64_t size_a, llvm::Value *addr_b,
+    uint64_t size_b)>;
+
+// Relax the chain of `Memory *` values threaded through the calls in
+// `module` to the memory access intrinsics. Every write produces a new
+// `Memory *`, and every read takes the latest one, so the reads of a trace
+// form a single serial chain with its writes, and two reads of the same
+// address can't be merged if any write comes between them. This makes each
+// read take the `Memory *` from before the writes that it follows but that
+// can't overlap it, i.e. that write to a constant offset from the same
+// address (e.g. `RSP + 8` and `RSP + 16`), or that `disjoint` says are
+// disjoint from it. The read intrinsics don't access memory, and so the
+// optimizer can then merge and reorder them.
+//
+// The writes remain a single chain, because the one `Memory *` returned by
+// a trace must reflect all of them. Reads are never moved above a call to
+// anything other than a write intrinsic, e.g. a barrier, an atomic region
+// intrinsic, or an atomic read-modify-write intrinsic, and never through a
+// `phi` of `Memory *` values.
+//
+// Returns the number of reads whose `Memory *` changed.
+uint64_t RelaxMemoryChains(llvm::Module *module,
+                           const DisjointMemoryFunc &disjoint = nullptr);
+
+// Merge the calls in `module` to the 8-, 16-, and 32-bit integer memory
+// access intrinsics that access adjacent guest memory into calls to wider
+// ones, of 16, 32, or 64 bits, e.g. the byte reads and writes of an unrolled
+// `memcpy` or of a structure copy. The bytes of the wide values are ordered
+// as `arch` orders the bytes in memory (see
+// `Arch::MemoryAccessIsLittleEndian`).
+//
+// Only the calls of one basic block are merged. The reads that are merged
+// must take the same `Memory *`, and address constant offsets from the same
+// base address (see `RelaxMemoryChains`, which makes more reads take the
+// same `Memory *`); the wide read goes where the first of them was. The
+// writes that are merged must be a run of the chain of `Memory *` values
+// whose intermediate values aren't used by anything else, and must write
+// to constant offsets from the same base address without overlapping; the
+// wide write goes where the last of them was.
+//
+// Returns the number of calls that were removed.
+uint64_t CoalesceMemoryAccesses(const Arch *arch, llvm::Module *module);
+
+}  // namespace remill
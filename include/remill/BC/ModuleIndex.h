@@ -0,0 +1,71 @@
+/*
+ * Copyright (c) 2020 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "remill/BC/Util.h"
+
+namespace llvm {
+class CallInst;
+class Function;
+class GlobalVariable;
+class Module;
+}  // namespace llvm
+namespace remill {
+
+// An index of the ISEL variables of a module, and of the calls made by its
+// functions, so that `ForEachISel` and `CallersOf` queries take time that is
+// proportional to their results, rather than to the size of the module.
+//
+// The index is built once from the module, and must then be told about new
+// or changed functions with `AddFunction`, e.g. by a `TraceLifter` (see
+// `TraceLifter::SetModuleIndex`). Deleted calls and ISEL variables are
+// skipped, but calls added behind the index's back (e.g. by inlining) aren't
+// seen until the function making them is added again.
+class ModuleIndex {
+ public:
+  explicit ModuleIndex(llvm::Module *module);
+  ~ModuleIndex(void);
+
+  // Apply `callback` to every ISEL variable, like `ForEachISel`.
+  void ForEachISel(ISelCallback callback) const;
+
+  // Returns the indexed calls to `func`, like `CallersOf`.
+  std::vector<llvm::CallInst *> CallersOf(llvm::Function *func) const;
+
+  // Returns the functions directly called by `func`, e.g. the traces called
+  // by a lifted trace, in the order that they are first called.
+  std::vector<llvm::Function *> CalleesOf(llvm::Function *func) const;
+
+  // Index the calls made by `func`, replacing any calls indexed for it
+  // before. If `func` is a declaration, e.g. because it was moved into
+  // another module, then it's no longer indexed.
+  void AddFunction(llvm::Function *func);
+
+  // Index a new ISEL variable, e.g. of an instruction added to the module.
+  void AddISel(llvm::GlobalVariable *isel);
+
+ private:
+  ModuleIndex(void) = delete;
+
+  class Impl;
+  const std::unique_ptr<Impl> impl;
+};
+
+}  // namespace remill
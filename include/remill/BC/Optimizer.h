@@ -25,21 +25,129 @@
 #include <llvm/IR/Module.h>
 #pragma clang diagnostic pop
 
+#include <cstdint>
 #include <functional>
 #include <initializer_list>
 #include <map>
 #include <memory>
+#include <optional>
 #include <set>
+#include <string_view>
 #include <unordered_map>
 #include <unordered_set>
 #include <vector>
 
+#include "remill/BC/HyperCallLowering.h"
+#include "remill/BC/LiftOptions.h"
+#include "remill/BC/MemoryLowering.h"
+
 namespace llvm {
 class Function;
 }  // namespace llvm
 namespace remill {
 
 class Arch;
+class DeadStoreAnalysisCache;
+struct LiftStatistics;
+
+// The pass pipelines used by `OptimizeModule` and `OptimizeBareModule`.
+enum class OptimizationPreset : uint8_t {
+
+  // The legacy pass manager's `-O3` pipeline, with a 250-threshold inliner.
+  kLegacyO3,
+
+  // Inline the always-inline semantics functions into the lifted code, then
+  // clean it up with SROA, early CSE, instruction combining, and CFG
+  // simplification.
+  kFast,
+
+  // Like `kFast`, but also inlines other functions, and interleaves GVN and
+  // dead store elimination with further combining and dead code removal.
+  kBalanced,
+
+  // The new pass manager's `-O3` pipeline, followed by the clean-up of
+  // `kBalanced`.
+  kMax
+};
+
+// Returns the preset named `name`, i.e. one of `legacy`, `fast`, `balanced`,
+// or `max`, or `std::nullopt`.
+std::optional<OptimizationPreset>
+OptimizationPresetFromName(std::string_view name);
+
+// How `OptimizeModule` and `OptimizeBareModule` treat the calls to the memory
+// barrier and atomic region intrinsics, e.g. around x86 `LOCK`-prefixed
+// instructions and AArch64 exclusive accesses.
+enum class BarrierLowering : uint8_t {
+
+  // Leave the calls alone.
+  kKeep,
+
+  // Replace the calls with LLVM fences, with the orderings of the barriers.
+  // See `LowerBarrierIntrinsics`.
+  kFences,
+
+  // Remove the calls, because the lifted code runs on a single thread.
+  kRemove
+};
+
+// Returns the barrier lowering named `name`, i.e. one of `keep`, `fences`, or
+// `remove`, or `std::nullopt`.
+std::optional<BarrierLowering> BarrierLoweringFromName(std::string_view name);
+
+// How `OptimizeModule` and `OptimizeBareModule` treat the calls to the
+// `__remill_undefined_*` intrinsics, e.g. for the flags that x86 `MUL` and
+// `SHL` leave undefined.
+enum class UndefinedLowering : uint8_t {
+
+  // Leave the calls alone.
+  kKeep,
+
+  // Replace the calls with `freeze poison`, i.e. some arbitrary but fixed
+  // value, so that the optimizer can fold the computations that use them.
+  kFreeze,
+
+  // Replace the calls with `OptimizationGuide::undefined_constant`, truncated
+  // to the size of the value, or reinterpreted as a float.
+  kConstant
+};
+
+// Returns the undefined value lowering named `name`, i.e. one of `keep`,
+// `freeze`, or `zero`, which is `kConstant` with a zero constant, or
+// `std::nullopt`.
+std::optional<UndefinedLowering>
+UndefinedLoweringFromName(std::string_view name);
+
+// How `OptimizeModule` and `OptimizeBareModule` treat the calls to
+// `__remill_fpu_exception_test_and_clear` that the semantics make around each
+// floating point operation, to track the sticky exception flags of the
+// status register (e.g. the x87 status word, or the AArch64 `FPSR`) exactly.
+// The calls are opaque, and so keep floating point code from being
+// optimized, e.g. vectorized.
+enum class FPExceptionLowering : uint8_t {
+
+  // Leave the calls alone.
+  kKeep,
+
+  // Let the exceptions accumulate in the host's floating point environment,
+  // and only fold them into the status register when the lifted code reads
+  // or writes it, e.g. with x86 `FNSTSW` or AArch64 `MRS`/`MSR FPSR`. The
+  // operations themselves no longer call the intrinsic. The host's sticky
+  // flags then stand for those of the status register, and so a runtime
+  // that inspects the status register in `State` must first fold them in
+  // itself, and the flags of operations that the semantics don't track,
+  // e.g. x86 SSE, are folded in too.
+  kDefer,
+
+  // Remove the calls, so that the status register never reflects the
+  // exceptions, for when nothing reads it.
+  kIgnore
+};
+
+// Returns the floating point exception lowering named `name`, i.e. one of
+// `keep`, `defer`, or `ignore`, or `std::nullopt`.
+std::optional<FPExceptionLowering>
+FPExceptionLoweringFromName(std::string_view name);
 
 struct OptimizationGuide {
   bool slp_vectorize;
@@ -47,21 +155,145 @@ struct OptimizationGuide {
   bool verify_input;
   bool verify_output;
   bool eliminate_dead_stores;
+
+  // Optional; accumulates the time spent in LLVM passes and in dead store
+  // elimination.
+  LiftStatistics *stats{nullptr};
+
+  // If greater than one, then `OptimizeModule` runs the per-function passes
+  // on this many threads. The traces are split into contiguous groups in the
+  // order produced by the generator, and each group is copied into a module
+  // in its own `llvm::LLVMContext`, optimized, and copied back in place. Each
+  // function is optimized on its own, so the result doesn't depend on the
+  // number of threads. The module passes still run on the calling thread.
+  unsigned num_threads{1};
+
+  // What to do with the calls to the memory barrier and atomic region
+  // intrinsics before optimizing. Lowering them applies to the whole module.
+  BarrierLowering barriers{BarrierLowering::kKeep};
+
+  // What to replace the calls to the undefined value intrinsics with before
+  // optimizing. Lowering them applies to the whole module.
+  UndefinedLowering undefined{UndefinedLowering::kKeep};
+  uint64_t undefined_constant{0};
+
+  // How to track the floating point exceptions raised by the lifted code.
+  // Lowering them applies to the whole module.
+  FPExceptionLowering fp_exceptions{FPExceptionLowering::kKeep};
+
+  // Optional; if non-null, then `OptimizeModule` replaces the synchronous
+  // hyper calls that this selects, e.g. `CPUID` and `RDTSC`, with inline code
+  // before optimizing (see `LowerSyncHyperCalls`). This applies to the whole
+  // module.
+  const SyncHyperCallLowering *sync_hyper_calls{nullptr};
+
+  // The pass pipeline to use. The presets other than `kLegacyO3` use the new
+  // pass manager, and need LLVM 14 or newer; with older versions of LLVM,
+  // they fall back on `kLegacyO3`.
+  OptimizationPreset preset{OptimizationPreset::kLegacyO3};
+
+  // If `true`, then `OptimizeModule` optimizes the traces in two tiers. Every
+  // trace gets the cheap tier: the calls to always-inline functions, e.g.
+  // the semantics functions, are inlined into it, and then mem2reg and
+  // instruction combining clean it up. Only the hot traces then get the full
+  // pipeline. A trace is hot if `is_hot` returns `true` for it, or if it has
+  // at most `hot_max_instructions` instructions after the cheap tier. The
+  // cold traces are marked `optnone` while the module passes run, so that
+  // they are neither optimized further nor inlined into hot traces.
+  bool tiered{false};
+
+  // If `true`, then the traces passed to `OptimizeModule` are new traces that
+  // were added to an already optimized module, e.g. by incremental or
+  // streaming lifting. The function passes already only run on those
+  // traces; the module passes, such as inlining and interprocedural
+  // optimization, are then also limited to them, their direct callers, and
+  // the functions that they call, directly or through always-inline
+  // functions. The other functions of the module are marked `optnone` while
+  // the module passes run, as are the cold traces of `tiered`. Pass a
+  // `dse_cache` so that dead store elimination also skips the functions that
+  // haven't changed.
+  bool incremental{false};
+  std::function<bool(llvm::Function *)> is_hot;
+  size_t hot_max_instructions{0};
+
+  // If positive, then the optional passes of the full pipeline stop running
+  // on a function once they have spent this many seconds on it, in each of
+  // the function and module pass phases. This needs LLVM 14 or newer.
+  double function_time_budget_seconds{0};
+
+  // Optional; if non-null and `eliminate_dead_stores` is `true`, then dead
+  // store elimination reuses the `State` slots and the analyses of unchanged
+  // functions from this cache, which must be for the optimized module.
+  DeadStoreAnalysisCache *dse_cache{nullptr};
+
+  // If `true`, then before the module passes run, `OptimizeModule` removes
+  // the ISEL variables, and every semantics function (and the functions that
+  // only it uses) that no trace calls anymore, so that the module passes
+  // take time proportional to the lifted code rather than to the size of
+  // the instruction set. Nothing can be lifted into the module afterwards.
+  bool prune_semantics{false};
+
+  // If `true`, then after the per-function passes, `OptimizeModule` promotes
+  // the `State` slots that are loaded and stored within the loops of the hot
+  // traces to SSA values, loading them before each loop and storing them
+  // after it (see `PromoteStateInLoops`), so that the module passes can
+  // optimize the loops as they would register-allocated code.
+  bool promote_state_in_loops{false};
+
+  // If `true`, then after the module passes, `OptimizeModule` makes the
+  // memory reads skip the `Memory *` of the writes that can't overlap them
+  // (see `RelaxMemoryChains`), and then merges the repeated reads of the hot
+  // traces. `disjoint_memory` optionally says which other accesses can't
+  // overlap, e.g. using what the `TraceManager` knows about the program.
+  bool relax_memory_chains{false};
+  DisjointMemoryFunc disjoint_memory;
+
+  // If `true`, then after the module passes, `OptimizeModule` merges the
+  // narrow memory accesses of the traces that access adjacent bytes, e.g. the
+  // byte-by-byte loads of an unaligned word, into wider accesses (see
+  // `CoalesceMemoryAccesses`).
+  bool coalesce_memory_accesses{false};
+
+  // If `true`, then once it is done optimizing, `OptimizeModule` makes every
+  // trace set the dirty bit of each line of `State` that it writes (see
+  // `InstrumentStateDirtyLines`), so that an emulator can restore a snapshot
+  // by copying only those lines. The traces must then be run on a
+  // `TrackedState`. This is done even if the optimizations are interrupted.
+  bool track_dirty_state_lines{false};
+
+  // If `true`, and with LLVM 14 or newer, then once it is done optimizing,
+  // `OptimizeModule` moves the sequences of instructions that repeat across
+  // the functions of the module into shared functions with LLVM's IR
+  // outliner, trading some speed for smaller code. This is best combined
+  // with `prune_semantics`, so that only the lifted code is searched.
+  bool outline_repeated_code{false};
+
+  // Optional; if non-null, then the optimized module is a thin module (see
+  // `CreateThinModule`), and `OptimizeModule` first links in the bodies of
+  // the semantics functions that it uses from this module, with
+  // `LinkSemanticsInto`.
+  llvm::Module *semantics{nullptr};
+
+  // Checked between functions, between the phases of `OptimizeModule`, and,
+  // with the new pass manager, before each optional pass. Once it fires, the
+  // remaining optimizations are skipped, leaving the module valid but less
+  // optimized, and `OptimizeModule` returns why it stopped.
+  LiftInterrupt interrupt;
 };
 
 template <typename T>
-inline static void
+inline static LiftOutcome
 OptimizeModule(const std::unique_ptr<const remill::Arch> &arch,
                const std::unique_ptr<llvm::Module> &module, T &&generator,
                OptimizationGuide guide = {}) {
   return OptimizeModule(arch.get(), module.get(), generator, guide);
 }
 
-void OptimizeModule(const remill::Arch *arch, llvm::Module *module,
-                    std::function<llvm::Function *(void)> generator,
-                    OptimizationGuide guide = {});
+LiftOutcome OptimizeModule(const remill::Arch *arch, llvm::Module *module,
+                          std::function<llvm::Function *(void)> generator,
+                          OptimizationGuide guide = {});
 
-inline static void
+inline static LiftOutcome
 OptimizeModule(const remill::Arch *arch, llvm::Module *module,
                std::initializer_list<llvm::Function *> traces,
                OptimizationGuide guide = {}) {
@@ -79,7 +311,7 @@ OptimizeModule(const remill::Arch *arch, llvm::Module *module,
 }
 
 template <typename K>
-inline static void
+inline static LiftOutcome
 OptimizeModule(const remill::Arch *arch, llvm::Module *module,
                const std::unordered_map<K, llvm::Function *> &traces,
                OptimizationGuide guide = {}) {
@@ -97,7 +329,7 @@ OptimizeModule(const remill::Arch *arch, llvm::Module *module,
 }
 
 template <typename K>
-inline static void OptimizeModule(const remill::Arch *arch,
+inline static LiftOutcome OptimizeModule(const remill::Arch *arch,
                                   llvm::Module *module,
                                   const std::map<K, llvm::Function *> &traces,
                                   OptimizationGuide guide = {}) {
@@ -114,7 +346,7 @@ inline static void OptimizeModule(const remill::Arch *arch,
   return OptimizeModule(arch, module, trace_func_gen, guide);
 }
 
-inline static void OptimizeModule(const remill::Arch *arch,
+inline static LiftOutcome OptimizeModule(const remill::Arch *arch,
                                   llvm::Module *module,
                                   const std::set<llvm::Function *> &traces,
                                   OptimizationGuide guide = {}) {
@@ -131,7 +363,7 @@ inline static void OptimizeModule(const remill::Arch *arch,
   return OptimizeModule(arch, module, trace_func_gen, guide);
 }
 
-inline static void
+inline static LiftOutcome
 OptimizeModule(const remill::Arch *arch, llvm::Module *module,
                const std::unordered_set<llvm::Function *> &traces,
                OptimizationGuide guide = {}) {
@@ -148,7 +380,7 @@ OptimizeModule(const remill::Arch *arch, llvm::Module *module,
   return OptimizeModule(arch, module, trace_func_gen, guide);
 }
 
-inline static void OptimizeModule(const remill::Arch *arch,
+inline static LiftOutcome OptimizeModule(const remill::Arch *arch,
                                   llvm::Module *module,
                                   const std::vector<llvm::Function *> &traces,
                                   OptimizationGuide guide = {}) {
@@ -182,4 +414,19 @@ OptimizeBareModule(const std::unique_ptr<llvm::Module> &module,
   return OptimizeBareModule(module.get(), guide);
 }
 
+// Inline the calls to always-inline functions, e.g. the semantics functions,
+// into the trace `func`, along with any such calls that they expose. The
+// trace then no longer needs the bodies of the semantics, so it can be moved
+// into its own module, e.g. by `TraceLifter::LiftStreaming`, and optimized
+// there with `OptimizeBareModule`.
+void InlineSemanticsIntoTrace(llvm::Function *func);
+
+// Canonicalize the bodies of the semantics functions in the semantics module
+// `module` with SROA, early CSE, instruction combining, and CFG
+// simplification. No functions are inlined, internalized, or removed, and
+// remill's own functions are left untouched, so the result can be used just
+// like the unoptimized semantics. Lifted code that inlines these functions
+// then starts `OptimizeModule` from smaller IR.
+void OptimizeSemantics(llvm::Module *module);
+
 }  // namespace remill
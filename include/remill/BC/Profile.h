@@ -0,0 +1,106 @@
+/*
+ * Copyright (c) 2020 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace remill {
+
+// What a counter of an instrumented trace counts.
+enum ProfileCounterKind : uint8_t {
+
+  // Number of times that the block of instructions at `pc` was executed.
+  kProfileBlockCounter,
+
+  // Number of times that the conditional control-flow instruction at `pc`
+  // was taken, or not taken.
+  kProfileBranchTakenCounter,
+  kProfileBranchNotTakenCounter
+};
+
+// The counters of a trace lifted with `TraceProfiling` enabled. Each
+// instrumented trace defines one of these as an external global variable,
+// named by `ProfileCountersName`. The structure is followed by the array of
+// `num_counters` counts, which the trace increments, then by the address of
+// each counter, and then by the kind of each counter.
+//
+// NOTE(pag): This layout is mirrored by the trace lifter.
+struct ProfileCounters {
+  uint64_t trace_pc;
+  uint64_t num_counters;
+
+  inline uint64_t *Counts(void) const {
+    return const_cast<uint64_t *>(
+        reinterpret_cast<const uint64_t *>(&this[1]));
+  }
+
+  inline const uint64_t *PCs(void) const {
+    return &(Counts()[num_counters]);
+  }
+
+  inline const ProfileCounterKind *Kinds(void) const {
+    return reinterpret_cast<const ProfileCounterKind *>(
+        &(PCs()[num_counters]));
+  }
+};
+
+// Returns the name of the `ProfileCounters` of the trace named `trace_name`.
+std::string ProfileCountersName(const std::string &trace_name);
+
+// Name of the byte that is added to each counter each time that it is
+// reached, when the counters are sampled. See `SetProfileSampling`.
+static constexpr const char *kProfileSamplingName =
+    "__remill_profile_sampling";
+
+// Turn the sampled counters on or off. Turning them on for short bursts, e.g.
+// from a timer, bounds the overhead of profiling long runs.
+void SetProfileSampling(bool enable);
+
+// Add the address of the sampling byte to `runtime`, by name, e.g. for
+// `TraceJITOptions::runtime`.
+void AddProfileRuntime(std::unordered_map<std::string, void *> &runtime);
+
+// Write the counts of `counters` to `os`, as read by `ExecutionProfile::Read`.
+// The counts of instructions that are in more than one trace are summed.
+void WriteProfile(const std::vector<const ProfileCounters *> &counters,
+                  std::ostream &os);
+
+// Block and branch counts read from a profile written by `WriteProfile`. A
+// `TraceManager` can forward its `TryGetBlockCount` and `TryGetBranchCounts`
+// to an `ExecutionProfile` to lift code with profile-guided layout.
+class ExecutionProfile {
+ public:
+  // Merge the counts in `is` into this profile. Returns `false` if `is` isn't
+  // a valid profile.
+  bool Read(std::istream &is);
+
+  bool TryGetBlockCount(uint64_t addr, uint64_t *count) const;
+
+  bool TryGetBranchCounts(uint64_t inst_addr, uint64_t *taken,
+                          uint64_t *not_taken) const;
+
+ private:
+  std::unordered_map<uint64_t, uint64_t> block_counts;
+  std::unordered_map<uint64_t, std::pair<uint64_t, uint64_t>> branch_counts;
+};
+
+}  // namespace remill
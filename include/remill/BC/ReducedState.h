@@ -0,0 +1,83 @@
+/*
+ * Copyright (c) 2020 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+namespace llvm {
+class Function;
+class StructType;
+}  // namespace llvm
+namespace remill {
+
+class Arch;
+
+// A compact layout of the `State` structure that keeps only the registers
+// that some set of lifted functions actually access.
+class ReducedState {
+ public:
+  // The bytes `[begin, end)` of the `State` structure are located at
+  // `reduced_offset` in the reduced structure.
+  struct Range {
+    uint64_t begin;
+    uint64_t end;
+    uint64_t reduced_offset;
+  };
+
+  // Returns the offset in the reduced structure of the byte at `offset` in
+  // the `State` structure, or `kNotKept` if that byte isn't kept.
+  uint64_t ReducedOffset(uint64_t offset) const;
+
+  static constexpr uint64_t kNotKept = ~0ull;
+
+  // The kept ranges of the `State` structure, sorted by `begin`.
+  std::vector<Range> ranges;
+
+  // Size of the reduced structure, in bytes.
+  uint64_t size{0};
+
+  // The reduced structure, as a packed structure of byte arrays that
+  // alternate between padding and the kept ranges.
+  llvm::StructType *type{nullptr};
+};
+
+// Rewrite the lifted functions `funcs` so that their `State` pointer
+// arguments point to a reduced `State` structure, which only holds the
+// registers that `funcs` access, and return the layout of that structure.
+// Each accessed byte is widened to its largest enclosing register, and kept
+// ranges are placed at the same offset modulo 16 as in `State`, so that
+// accesses keep their alignment.
+//
+// The function types aren't changed. Calls between functions in `funcs`, and
+// calls to declared functions (e.g. intrinsics) are passed the reduced
+// structure, and so the runtime must be built against that same layout.
+//
+// This is meant to be run on optimized lifted code, in which every access to
+// `State` is at a constant offset from the `State` pointer argument. If any
+// function uses its `State` pointer in any other way, e.g. with a variable
+// index, by storing it to memory, or by passing it to a defined function not
+// in `funcs`, then nothing is changed and `std::nullopt` is returned.
+//
+// NOTE(pag): Run dead store elimination before reducing the `State`
+//            structure, as `StateSlots` describes the full structure.
+std::optional<ReducedState>
+ReduceStateStructure(const Arch *arch,
+                     const std::vector<llvm::Function *> &funcs);
+
+}  // namespace remill
@@ -0,0 +1,64 @@
+/*
+ * Copyright (c) 2020 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace llvm {
+class Module;
+}  // namespace llvm
+
+namespace remill {
+
+class Arch;
+
+// Split semantics are stored next to the semantics bitcode file, e.g.
+// `amd64.bc` is split into `amd64.chunks` and `amd64.index`.
+//
+// The chunks file is a sequence of bitcode modules. The first chunk holds
+// `__remill_basic_block`, the intrinsics, and everything else that isn't only
+// used by instruction semantics. Each other chunk holds a group of ISEL
+// variables, in the order they appear in the semantics module (and so roughly
+// by instruction category), along with the semantics functions that they
+// use that aren't in an earlier chunk.
+//
+// The index file is text. Each `C <offset> <size>` line gives the location of
+// the next chunk within the chunks file, and each `D <name> <chunk>` line
+// gives the chunk that defines the global named `<name>`.
+
+// Split the semantics module `module` into chunks of `isels_per_chunk` ISEL
+// variables, and write them to `chunks_path` and `index_path`. Internal
+// globals are given external, hidden linkage so that they can be shared
+// between chunks. Returns `false` if the files couldn't be written.
+bool SplitSemanticsModule(llvm::Module *module, std::string_view chunks_path,
+                          std::string_view index_path,
+                          unsigned isels_per_chunk = 64);
+
+// Loads the semantics for `arch`, like `LoadArchSemantics`, but only reads
+// the first chunk, and the chunks that are needed for the instruction
+// functions `inst_functions`, e.g. the `function` of decoded instructions.
+// Instruction functions that aren't in the index are left out, and so are
+// lifted as unsupported instructions. If the semantics of `arch` weren't
+// split, then this loads all of them with `LoadArchSemantics`.
+std::unique_ptr<llvm::Module>
+LoadArchSemanticsChunks(const Arch *arch,
+                        const std::vector<std::string> &inst_functions);
+
+}  // namespace remill
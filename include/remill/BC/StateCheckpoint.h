@@ -0,0 +1,89 @@
+/*
+ * Copyright (c) 2020 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace llvm {
+class Function;
+}  // namespace llvm
+namespace remill {
+
+class Arch;
+
+// Dirty tracking of the `State` structure, for executors that snapshot and
+// restore it often, e.g. fuzzers. The `State` structure is split into lines
+// of `kStateLineSize` bytes, and a bitmap of one bit per line immediately
+// follows the `State` structure, at `StateDirtyBitmapOffset(sizeof(State))`:
+//
+//      struct TrackedState {
+//        State state;
+//        uint64_t dirty[NumStateDirtyWords(sizeof(State))];
+//      };
+//
+// Lifted code instrumented with `InstrumentStateDirtyLines` sets the bit of
+// each line of `State` that it writes to. The executor must allocate the
+// bitmap, and must mark the lines that it writes itself, e.g. in a hyper
+// call, with `MarkStateDirty`. Snapshotting then goes like this:
+//
+//      memcpy(&snapshot, &tracked.state, sizeof(State));
+//      ClearStateDirtyLines(tracked.dirty, sizeof(State));
+//      ... run lifted code on `tracked.state` ...
+//      RestoreDirtyStateLines(&tracked.state, &snapshot, tracked.dirty,
+//                             sizeof(State));
+//
+// and costs time proportional to the lines that were written.
+enum : uint64_t { kStateLineSize = 64 };
+
+// Returns the number of 64-bit words in the dirty bitmap of a `State`
+// structure of `state_size` bytes.
+inline static uint64_t NumStateDirtyWords(uint64_t state_size) {
+  const auto num_lines = (state_size + kStateLineSize - 1) / kStateLineSize;
+  return (num_lines + 63) / 64;
+}
+
+// Returns the offset of the dirty bitmap from the start of a `State`
+// structure of `state_size` bytes.
+inline static uint64_t StateDirtyBitmapOffset(uint64_t state_size) {
+  return (state_size + 7u) & ~7ull;
+}
+
+// Instrument the lifted function `func` so that it sets the dirty bit of each
+// line of `State` that it writes to, through its `State` argument. Bits are
+// set once per line per run of straight-line code, before each call and at
+// the end of each block. Writes at unknown offsets, and calls that are passed a pointer into
+// `State` (other than lifted functions and remill's intrinsics), mark every
+// line. This should be applied after optimization and dead store
+// elimination, so that only the remaining stores are tracked. Returns the
+// number of writes that were instrumented.
+unsigned InstrumentStateDirtyLines(const Arch *arch, llvm::Function *func);
+
+// Set the dirty bits of the `size` bytes at `offset` in `State`.
+void MarkStateDirty(uint64_t *dirty, uint64_t offset, uint64_t size);
+
+// Clear all of the dirty bits of a `State` structure of `state_size` bytes.
+void ClearStateDirtyLines(uint64_t *dirty, size_t state_size);
+
+// Copy the dirty lines of `snapshot` to `state`, both `State` structures of
+// `state_size` bytes, and then clear the dirty bits. Returns the number of
+// lines that were copied.
+size_t RestoreDirtyStateLines(void *state, const void *snapshot,
+                              uint64_t *dirty, size_t state_size);
+
+}  // namespace remill
@@ -0,0 +1,76 @@
+/*
+ * Copyright (c) 2020 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <utility>
+#include <vector>
+
+namespace llvm {
+class AllocaInst;
+class CallBase;
+class Value;
+}  // namespace llvm
+namespace remill {
+
+// Byte ranges, as `(offset, size)` pairs, of the `State` structure.
+using StateSlotList = std::vector<std::pair<uint64_t, uint64_t>>;
+
+// Returns the slots of the `State` structure that `call` may access through
+// the `State` pointer that it is passed, an empty list if it doesn't access
+// `State`, or `std::nullopt` if it may access any slot.
+using StateSlotsFunc =
+    std::function<std::optional<StateSlotList>(llvm::CallBase *call)>;
+
+// A `StateSlotsFunc` for code that runs until it leaves the lifted code, and
+// whose caller then reads the registers out of `State`, e.g. a slice made by
+// `remill-lift`. The intrinsics through which the lifted code leaves, i.e.
+// `__remill_error`, `__remill_function_call`, `__remill_function_return`,
+// `__remill_jump`, and `__remill_missing_block`, are taken not to access
+// `State`. Any other call may access all of it.
+std::optional<StateSlotList> ExitIntrinsicStateSlots(llvm::CallBase *call);
+
+// Returns the calls that are passed `state`, a local `State` structure, or a
+// cast of it, other than to LLVM intrinsics such as `llvm.memcpy`. Sets
+// `*escapes_otherwise`, if given, if the address of `state` escapes in any
+// other way, e.g. by being stored to memory, or passed to a call at an
+// offset, such that the structure can't be scalarized even once those calls
+// are dealt with.
+std::vector<llvm::CallBase *>
+FindStateEscapes(llvm::AllocaInst *state, bool *escapes_otherwise = nullptr);
+
+// Keep `state`, a local `State` structure, from escaping through the calls
+// found by `FindStateEscapes`, so that SROA and mem2reg can scalarize it,
+// e.g. after the lifted code is inlined into a slice or a function wrapper.
+//
+// A call that can't access `State`, because the parameter that it is passed
+// `state` through is never used or is `readnone` and `nocapture`, or because
+// `slots_of` says so, is passed `undef` instead. Any other call is passed
+// `shared_state` instead, or a new local `State` structure if that is
+// `nullptr`, with the slots that `slots_of` says the call accesses (all of
+// them if `slots_of` is empty or returns `std::nullopt`) copied into it
+// before the call and back out of it after the call.
+//
+// Returns the number of calls that were changed.
+unsigned PrivatizeState(llvm::AllocaInst *state,
+                        const StateSlotsFunc &slots_of = {},
+                        llvm::Value *shared_state = nullptr);
+
+}  // namespace remill
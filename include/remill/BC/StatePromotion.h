@@ -0,0 +1,48 @@
+/*
+ * Copyright (c) 2020 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+namespace llvm {
+class Function;
+}  // namespace llvm
+namespace remill {
+
+// Promote the slots of the `State` structure (e.g. the registers `RCX`, `RSI`,
+// and `RDI` of an x86 `REP MOVSB` loop) that are loaded and stored within the
+// loops of the lifted function `func` to SSA values. The initial value of
+// each slot is loaded in the loop preheader, and the final value is stored in
+// each loop exit, so that the loop body itself no longer touches `State`.
+//
+// This understands that the memory access intrinsics, e.g.
+// `__remill_read_memory_32`, and the other remill intrinsics that aren't
+// passed the `State` pointer, don't access `State`, which LLVM's own loop
+// invariant code motion can't assume of opaque calls. A loop is left alone
+// if it calls anything else, passes the `State` pointer to anything, returns
+// from within the loop, or accesses `State` through a pointer with an unknown
+// offset. A slot is only promoted if every access to it within the loop has
+// the same offset and type, and no other access in the loop overlaps it.
+// Plain memory accesses, e.g. made by `LowerMemoryIntrinsics`, are only
+// assumed not to alias `State` if the `State` argument is `noalias`.
+//
+// The loops must be in loop-simplified form, i.e. have a preheader and
+// dedicated exits, as the loop passes of the optimizer leave them; other
+// loops are left alone.
+//
+// Returns the number of (loop, slot) pairs that were promoted.
+unsigned PromoteStateInLoops(llvm::Function *func);
+
+}  // namespace remill
@@ -0,0 +1,273 @@
+/*
+ * Copyright (c) 2020 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace remill {
+
+// A timeline of the spans of time that the threads of the lifting pipeline
+// spend on each piece of work, e.g. lifting one trace, or running the function
+// passes on one shard of traces. It is printed in the Chrome trace event
+// format, and so can be opened in `chrome://tracing` or in Perfetto, to find
+// load imbalance and serialization points between threads.
+//
+// Unlike `LiftStatistics`, one log is shared by all threads, and every method
+// is thread-safe. Point `LiftStatistics::events` of each thread at it.
+class TraceEventLog {
+ public:
+  TraceEventLog(void);
+
+  // Record a span named `name` on this thread from `begin` to `end`, about the
+  // code at `addr`, if any. `name` must outlive this log, e.g. be a string
+  // literal.
+  void AddSpan(const char *name, std::chrono::steady_clock::time_point begin,
+               std::chrono::steady_clock::time_point end,
+               std::optional<uint64_t> addr = std::nullopt);
+
+  // Print out all spans as one JSON object in the Chrome trace event format.
+  void PrintJSON(std::ostream &os) const;
+
+ private:
+  TraceEventLog(const TraceEventLog &) = delete;
+  TraceEventLog &operator=(const TraceEventLog &) = delete;
+
+  struct Span {
+    const char *name;
+    unsigned thread;
+    double begin_us;
+    double duration_us;
+    std::optional<uint64_t> addr;
+  };
+
+  // Timestamps are relative to the creation of the log.
+  const std::chrono::steady_clock::time_point origin;
+
+  mutable std::mutex lock;
+  std::vector<Span> spans;
+};
+
+// Statistics of one run of dead store elimination on one lifted function.
+struct DeadStoreFunctionStatistics {
+  std::string name;
+
+  // Whether the alias analysis succeeded, and whether its result was reused
+  // from a `DeadStoreAnalysisCache`.
+  bool analyzed{false};
+  bool cached{false};
+
+  uint64_t num_stores{0};
+  uint64_t dead_stores{0};
+  uint64_t removed_insts{0};
+  uint64_t forwarded_loads{0};
+  uint64_t forwarded_stores{0};
+  uint64_t forwarded_perfect{0};
+  uint64_t forwarded_truncated{0};
+  uint64_t forwarded_casted{0};
+  uint64_t forwarded_reordered{0};
+  uint64_t failed_forwards{0};
+
+  // Time spent in the alias analysis and forwarding of this function. The
+  // live set analysis is shared by all functions, and isn't included.
+  double analysis_seconds{0};
+};
+
+// Opt-in counters and timers for the lifting pipeline. Pass a pointer to one
+// of these to `TraceLifter::SetStatistics`, `InstructionLifter::SetStatistics`,
+// `OptimizationGuide::stats`, or `RemoveDeadStores`. Statistics accumulate
+// across calls until `Reset` is called.
+//
+// NOTE(pag): This is not thread-safe; use one object per thread.
+struct LiftStatistics {
+  void Reset(void);
+
+  // Print out all statistics, one per line.
+  void Print(std::ostream &os) const;
+
+  // Print out the counters and timers as one JSON object, without the
+  // statistics of each function.
+  void PrintJSON(std::ostream &os) const;
+
+  // Add the statistics of `other` to these, e.g. to sum up the statistics of
+  // several threads.
+  void Add(const LiftStatistics &other);
+
+  // `TraceLifter::Lift`. `num_lifted_insts` counts every instruction given to
+  // the `InstructionLifter`, of which `num_failed_lifts` didn't lift cleanly.
+  // `num_fused_insts` counts instructions fused with the instruction after
+  // them. `num_lookahead_insts` counts instructions decoded ahead of the
+  // lifter (see `TraceLifter::SetLookaheadDecoding`), which are not counted in
+  // `num_decoded_insts`.
+  // `trace_seconds` includes the time spent in the `Lift` callback.
+  uint64_t num_traces{0};
+  uint64_t num_bytes_read{0};
+  uint64_t num_decoded_insts{0};
+  uint64_t num_cached_insts{0};
+  uint64_t num_lookahead_insts{0};
+  uint64_t num_invalid_insts{0};
+  uint64_t num_lifted_insts{0};
+  uint64_t num_failed_lifts{0};
+  uint64_t num_fused_insts{0};
+  uint64_t num_blocks{0};
+  double trace_seconds{0};
+  double read_seconds{0};
+  double decode_seconds{0};
+  double lift_seconds{0};
+
+  // `InstructionLifter::LiftIntoBlock`. `num_dead_reg_writes` counts the
+  // register write operands lifted to scratch space by `LiftBlock` (see
+  // `InstructionLifter::SetSkipDeadRegisterWrites`). `num_template_insts`
+  // counts instructions lifted by copying a template (see
+  // `InstructionLifter::SetInstructionTemplates`).
+  uint64_t num_isel_lookups{0};
+  uint64_t num_missing_isels{0};
+  uint64_t num_dead_reg_writes{0};
+  uint64_t num_template_insts{0};
+
+  // `OptimizeModule`.
+  double function_pass_seconds{0};
+  double module_pass_seconds{0};
+
+  // `RemoveDeadStores`.
+  uint64_t dse_num_stores{0};
+  uint64_t dse_dead_stores{0};
+  uint64_t dse_removed_insts{0};
+  uint64_t dse_forwarded_loads{0};
+  uint64_t dse_forwarded_stores{0};
+  uint64_t dse_failed_funcs{0};
+  double dse_seconds{0};
+
+  // Bytes and number of heap allocations made by each subsystem, counted by
+  // `StatisticsAllocationScope`s. These stay zero unless the program installs
+  // an allocation hook that calls `CountStatisticsAllocation`. Allocations
+  // made on other threads, e.g. by `OptimizationGuide::num_threads`, aren't
+  // counted. The `util_` counters are for callers to wrap around functions
+  // from `remill/BC/Util.h`.
+  uint64_t decode_alloc_bytes{0};
+  uint64_t decode_allocs{0};
+  uint64_t trace_alloc_bytes{0};
+  uint64_t trace_allocs{0};
+  uint64_t lift_alloc_bytes{0};
+  uint64_t lift_allocs{0};
+  uint64_t optimize_alloc_bytes{0};
+  uint64_t optimize_allocs{0};
+  uint64_t dse_alloc_bytes{0};
+  uint64_t dse_allocs{0};
+  uint64_t util_alloc_bytes{0};
+  uint64_t util_allocs{0};
+
+  // If `true`, then `RemoveDeadStores` appends the statistics of each
+  // function that it processes to `dse_function_stats`. This is kept by
+  // `Reset`.
+  bool collect_dse_function_stats{false};
+  std::vector<DeadStoreFunctionStatistics> dse_function_stats;
+
+  // If non-null, then the lifting pipeline records the spans of lifting each
+  // trace, of each burst of lookahead decoding, of the function and module
+  // passes of `OptimizeModule` (and of each shard of the function passes, when
+  // `OptimizationGuide::num_threads` is greater than one), and of each run of
+  // `RemoveDeadStores` into this log. This is kept by `Reset`, and isn't
+  // changed by `Add`.
+  TraceEventLog *events{nullptr};
+};
+
+// Adds the time between its construction and destruction to `*seconds`, if
+// `seconds` is non-null.
+class StatisticsTimer {
+ public:
+  inline explicit StatisticsTimer(double *seconds_) : seconds(seconds_) {
+    if (seconds) {
+      start = std::chrono::steady_clock::now();
+    }
+  }
+
+  inline ~StatisticsTimer(void) {
+    if (seconds) {
+      *seconds += std::chrono::duration<double>(
+                      std::chrono::steady_clock::now() - start)
+                      .count();
+    }
+  }
+
+ private:
+  StatisticsTimer(const StatisticsTimer &) = delete;
+  StatisticsTimer &operator=(const StatisticsTimer &) = delete;
+
+  double *const seconds;
+  std::chrono::steady_clock::time_point start;
+};
+
+// Records the time between its construction and destruction as a span named
+// `name` in `*log`, if `log` is non-null.
+class TraceEventSpan {
+ public:
+  inline TraceEventSpan(TraceEventLog *log_, const char *name_,
+                        std::optional<uint64_t> addr_ = std::nullopt)
+      : log(log_),
+        name(name_),
+        addr(addr_) {
+    if (log) {
+      start = std::chrono::steady_clock::now();
+    }
+  }
+
+  inline ~TraceEventSpan(void) {
+    if (log) {
+      log->AddSpan(name, start, std::chrono::steady_clock::now(), addr);
+    }
+  }
+
+ private:
+  TraceEventSpan(const TraceEventSpan &) = delete;
+  TraceEventSpan &operator=(const TraceEventSpan &) = delete;
+
+  TraceEventLog *const log;
+  const char *const name;
+  const std::optional<uint64_t> addr;
+  std::chrono::steady_clock::time_point start;
+};
+
+// Counts the heap allocations that this thread makes between its construction
+// and destruction into `*bytes` and `*count`, if `bytes` is non-null. Scopes
+// nest, and an allocation is only counted by the innermost scope.
+class StatisticsAllocationScope {
+ public:
+  StatisticsAllocationScope(uint64_t *bytes, uint64_t *count);
+  ~StatisticsAllocationScope(void);
+
+ private:
+  StatisticsAllocationScope(const StatisticsAllocationScope &) = delete;
+  StatisticsAllocationScope &
+  operator=(const StatisticsAllocationScope &) = delete;
+
+  uint64_t *const prev_bytes;
+  uint64_t *const prev_count;
+};
+
+// Counts an allocation of `size` bytes into the innermost
+// `StatisticsAllocationScope` of this thread, if any. This is meant to be
+// called from a replacement `operator new`, and doesn't allocate.
+void CountStatisticsAllocation(size_t size) noexcept;
+
+}  // namespace remill
@@ -0,0 +1,162 @@
+/*
+ * Copyright (c) 2020 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace llvm {
+class Function;
+class MemoryBuffer;
+class Module;
+}  // namespace llvm
+namespace remill {
+
+class Arch;
+
+// Writes many lifted traces into one archive file, read by `TraceArchive`.
+// Storing each trace in its own module with `StoreModuleToFile` repeats the
+// types (e.g. `State`), the intrinsic declarations, and the global variables
+// that every trace uses. Instead, the traces are grouped into shards of
+// `traces_per_shard` traces, each of which is a single bitcode module that
+// holds what its traces share once, and the archive ends with an index from
+// the entry address of each trace to its shard and function.
+//
+//      remill::TraceArchiveWriter writer(arch, "traces.rta");
+//      for (auto [addr, func] : traces) {
+//        writer.AddTrace(addr, func);
+//      }
+//      CHECK(writer.Finish());
+//
+// The traces should be optimized first, so that they no longer call the
+// semantics functions; calls to functions outside of a trace, including to
+// other traces, are stored as declarations. The archive is written to a
+// temporary file, and only replaces `path` once `Finish` succeeds.
+class TraceArchiveWriter {
+ public:
+  TraceArchiveWriter(const Arch *arch_, std::string_view path_,
+                     size_t traces_per_shard_ = 1024);
+
+  // Removes the temporary file if `Finish` wasn't called, or failed.
+  ~TraceArchiveWriter(void);
+
+  // Add `func`, the lifted trace starting at `addr`, to the archive. Returns
+  // `false` if a trace at `addr` or with the same name was already added, or
+  // if the shard of the trace couldn't be written.
+  bool AddTrace(uint64_t addr, llvm::Function *func);
+
+  // Write the last shard and the index, and move the archive into place.
+  // Nothing can be added afterwards.
+  bool Finish(void);
+
+ private:
+  TraceArchiveWriter(void) = delete;
+
+  struct Entry {
+    uint64_t addr;
+    uint32_t shard;
+    std::string name;
+  };
+
+  struct Shard {
+    uint64_t offset;
+    uint64_t size;
+  };
+
+  // Serialize the shard being filled, and append it to the archive.
+  bool FlushShard(void);
+
+  const Arch *const arch;
+  const std::string path;
+  const std::string tmp_path;
+  const size_t traces_per_shard;
+
+  std::ofstream out;
+  bool ok{true};
+  bool finished{false};
+
+  // The module of the shard being filled, and the number of traces in it.
+  std::unique_ptr<llvm::Module> shard_module;
+  size_t shard_size{0};
+
+  std::vector<Shard> shards;
+  std::vector<Entry> entries;
+  std::unordered_map<uint64_t, size_t> entry_index;
+};
+
+// Random access to the traces of an archive written by `TraceArchiveWriter`.
+// The archive is mapped into memory, and loading a trace only reads the
+// module-level parts of its shard, i.e. the types, declarations, and global
+// variables, and then the body of the trace itself. The other traces of the
+// shard are read if and when they are loaded.
+//
+// Traces are loaded into modules owned by the archive, within the context of
+// `arch`, and so an archive must only be used by one thread at a time. Those
+// modules still contain the traces that haven't been loaded, unread, and so
+// copy the loaded traces out (e.g. with `CloneFunctionInto`) rather than
+// verifying, optimizing, or storing the modules themselves.
+class TraceArchive {
+ public:
+  ~TraceArchive(void);
+
+  // Map the archive at `path`. Returns `nullptr` if the file can't be read,
+  // or isn't a well-formed archive.
+  static std::unique_ptr<TraceArchive> Open(const Arch *arch,
+                                            std::string_view path);
+
+  // Number of traces in the archive.
+  size_t NumTraces(void) const;
+
+  // Returns `true` if the archive contains a trace starting at `addr`.
+  bool HasTrace(uint64_t addr) const;
+
+  // The entry addresses of the traces in the archive, in increasing order.
+  std::vector<uint64_t> TraceAddresses(void) const;
+
+  // Load the trace starting at `addr`, along with the declarations of what it
+  // uses. Loading the same trace twice returns the same function. Returns
+  // `nullptr` if there is no trace at `addr`, or if its shard is malformed.
+  llvm::Function *LoadTrace(uint64_t addr);
+
+ private:
+  TraceArchive(const Arch *arch_, std::unique_ptr<llvm::MemoryBuffer> buffer_);
+
+  // Returns the index of the entry for the trace at `addr`, or the number of
+  // traces if there is none.
+  size_t FindEntry(uint64_t addr) const;
+
+  const Arch *const arch;
+  const std::unique_ptr<llvm::MemoryBuffer> buffer;
+
+  size_t num_shards{0};
+  size_t num_traces{0};
+  const char *shard_table{nullptr};
+  const char *entries{nullptr};
+  const char *strings{nullptr};
+  size_t strings_size{0};
+
+  // Lazily loaded shard modules, by shard number. These refer to `buffer`.
+  std::unordered_map<uint32_t, std::unique_ptr<llvm::Module>> modules;
+};
+
+}  // namespace remill
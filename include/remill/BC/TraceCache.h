@@ -0,0 +1,103 @@
+/*
+ * Copyright (c) 2020 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <remill/BC/TraceLifter.h>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace llvm {
+class Function;
+class Module;
+}  // namespace llvm
+namespace remill {
+
+class Arch;
+
+// An on-disk cache of lifted traces, used to avoid re-lifting traces whose
+// bytes have not changed across runs. A trace is identified by its entry
+// address, and is valid only if the bytes of all of its instructions, the
+// architecture, the OS, the semantics bitcode, and the settings of the lifter
+// are the same as when it was stored.
+//
+// A `TraceManager` can use this as follows:
+//
+//    * Once the `TraceLifter` is set up, pass its `OptionsHash` to
+//      `SetLiftOptionsHash`.
+//    * In `SetLiftedTraceInstructions`, pass the instructions to
+//      `SetTraceInstructions`.
+//    * After lifting (and possibly optimizing), call `StoreTrace` with each
+//      lifted trace.
+//    * In `GetLiftedTraceDefinition`, return the result of `LoadTrace` if no
+//      other definition is available.
+class TraceCache {
+ public:
+  ~TraceCache(void);
+
+  // Traces are stored within `dir`, which is created if it doesn't exist.
+  TraceCache(const Arch *arch_, std::string_view dir_);
+
+  // Only use the traces lifted with the settings hashed into `hash` (see
+  // `TraceLifter::OptionsHash`), and store traces as lifted with them.
+  void SetLiftOptionsHash(uint64_t hash);
+
+  // Remember the instructions lifted into the trace at `addr`.
+  void SetTraceInstructions(uint64_t addr, const TraceInstructionList &insts);
+
+  // Store `func`, the lifted trace starting at `addr`, into the cache. The
+  // bytes of the trace are read from `manager`. Returns `false` if the
+  // instructions of the trace are unknown or if the trace can't be stored.
+  bool StoreTrace(uint64_t addr, llvm::Function *func, TraceManager &manager);
+
+  // Load a previously stored trace starting at `addr`. The trace is
+  // loaded into a module owned by this cache, within the context of `arch`.
+  // Returns `nullptr` if there is no cached trace at `addr`, or if any of the
+  // bytes of the trace have changed.
+  llvm::Function *LoadTrace(uint64_t addr, TraceManager &manager);
+
+ private:
+  TraceCache(void) = delete;
+
+  // Hashes the arch, OS, semantics, lifter settings, and bytes of the
+  // instructions `insts`. Returns `false` if any of the bytes can't be read.
+  bool HashTrace(uint64_t addr, const TraceInstructionList &insts,
+                 TraceManager &manager, uint64_t *hash) const;
+
+  // Path to the file in which the trace at `addr` is stored.
+  std::string TracePath(uint64_t addr, const char *ext) const;
+
+  const Arch *const arch;
+  const std::string dir;
+
+  // Hash of the semantics bitcode and remill version.
+  uint64_t semantics_hash{0};
+
+  // Hash of the settings of the lifter.
+  uint64_t lift_options_hash{0};
+
+  std::unordered_map<uint64_t, TraceInstructionList> trace_insts;
+
+  // Modules containing the traces that were loaded from the cache.
+  std::vector<std::unique_ptr<llvm::Module>> modules;
+};
+
+}  // namespace remill
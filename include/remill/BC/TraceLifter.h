@@ -16,17 +16,99 @@
 
 #pragma once
 
+#include <remill/BC/LiftOptions.h>
 #include <remill/BC/Lifter.h>
 
 #include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
 #include <unordered_map>
+#include <utility>
+#include <vector>
 
+namespace llvm {
+class LLVMContext;
+class Module;
+}  // namespace llvm
 namespace remill {
 
+class Arch;
+class InstructionCache;
+class ModuleIndex;
+struct LiftStatistics;
+
+enum OSName : uint32_t;
+enum ArchName : uint32_t;
+
 using TraceMap = std::unordered_map<uint64_t, llvm::Function *>;
 
+// List of `(address, size)` pairs of the instructions lifted into a trace.
+using TraceInstructionList = std::vector<std::pair<uint64_t, uint64_t>>;
+
 enum class DevirtualizedTargetKind { kTraceLocal, kTraceHead };
 
+// List of `(target address, kind)` pairs, e.g. of the entries of a jump table.
+using DevirtualizedTargetList =
+    std::vector<std::pair<uint64_t, DevirtualizedTargetKind>>;
+
+// Limits on the size of a single lifted trace. Very large traces (e.g. in
+// obfuscated code) make the optimizer super-linear in time and memory. Once
+// a trace reaches a limit, every block of the trace that hasn't yet been
+// lifted is instead made into a trace head of its own, and the trace
+// tail-calls into it. A limit of zero means "unlimited".
+struct TraceLimits {
+  // Maximum number of instructions decoded into a trace.
+  size_t max_instructions{0};
+
+  // Maximum number of instruction blocks in a trace.
+  size_t max_blocks{0};
+};
+
+// An entry of the trace table probed by the indirect jumps of the traces
+// lifted with `TraceLifter::SetChainIndirectJumps`. The table is an array of
+// `kNumTraceTableEntries` entries named `kTraceTableName`, and the entry of
+// the trace at `pc` is at `TraceTableIndex(pc)`. An entry whose `pc` is
+// `kEmptyTraceTableEntry` is unused. An executor, e.g. `TraceJIT`, defines the
+// table, and fills in `trace` before atomically publishing `pc` with release
+// semantics. Entries are never replaced, so that a trace can be found by
+// another thread without any locking.
+struct TraceTableEntry {
+  uint64_t pc;
+  void *trace;
+};
+
+enum : uint64_t {
+  kNumTraceTableEntries = 1u << 12,
+  kEmptyTraceTableEntry = ~0ull
+};
+
+static constexpr const char *kTraceTableName = "__remill_trace_table";
+
+inline static uint64_t TraceTableIndex(uint64_t pc) {
+  return (pc ^ (pc >> 2)) & (kNumTraceTableEntries - 1);
+}
+
+// Instrumentation of lifted traces, so that they count their own execution.
+// Each instrumented trace has its own array of counters, described by its
+// `ProfileCounters` (see `remill/BC/Profile.h`). The counts are written with
+// `WriteProfile`, and read back with `ExecutionProfile` to drive the
+// profile-guided layout of the trace lifter. The counters are not atomic, and
+// so the counts of code run by many threads at once are approximate.
+struct TraceProfiling {
+  // Count the executions of each block of instructions, at its first
+  // instruction.
+  bool count_blocks{false};
+
+  // Count the taken and not-taken edges of each conditional control-flow
+  // instruction.
+  bool count_branches{false};
+
+  // Add the runtime's sampling byte to each counter instead of one, so that
+  // the counters can be turned on for bursts with `SetProfileSampling`.
+  bool sampled{false};
+};
+
 // Manages information about traces. Permits a user of the trace lifter to
 // provide more global information to the decoder as it goes, e.g. by pre-
 // declaring the existence of many traces, and by supporting devirtualization.
@@ -45,6 +127,15 @@ class TraceManager {
   virtual void SetLiftedTraceDefinition(uint64_t addr,
                                         llvm::Function *lifted_func) = 0;
 
+  // Called just before `SetLiftedTraceDefinition`, with the address and size
+  // of every instruction that was decoded while lifting the trace starting at
+  // `addr`. This lets a derived class, e.g. one using a `TraceCache`, know
+  // which bytes the lifted trace was derived from.
+  //
+  // By default, this does nothing.
+  virtual void SetLiftedTraceInstructions(uint64_t addr,
+                                          const TraceInstructionList &insts);
+
   // Get a declaration for a lifted trace. The idea here is that a derived
   // class might have additional global info available to them that lets
   // them declare traces ahead of time. In order to distinguish between
@@ -75,10 +166,75 @@ class TraceManager {
       const Instruction &inst,
       std::function<void(uint64_t, DevirtualizedTargetKind)> func);
 
+  // Fill `targets` with all known targets of the indirect jump `inst`, e.g.
+  // every entry of a jump table. The trace lifter turns a non-empty list into
+  // a single `switch` on the next program counter, falling back on the
+  // `__remill_jump` intrinsic for unlisted targets. `targets` is empty on
+  // entry, and may contain duplicates on return.
+  //
+  // The default implementation collects the targets passed to the callback
+  // of `ForEachDevirtualizedTarget`. Managers that know about large jump
+  // tables should override this to fill in `targets` directly.
+  virtual void GetDevirtualizedTargets(const Instruction &inst,
+                                       DevirtualizedTargetList &targets);
+
+  // Try to get the number of times that the block of instructions starting at
+  // `addr` was executed, e.g. from an execution profile. Returns `false` if
+  // there is no profile data for the block. The trace lifter lays out the
+  // blocks of each trace hot-first, and moves the blocks that were never
+  // executed to the end of the trace, marking their calls as cold.
+  //
+  // By default, there is no profile data.
+  virtual bool TryGetBlockCount(uint64_t addr, uint64_t *count);
+
+  // Try to get the counts of the two edges out of the conditional control-flow
+  // instruction at `inst_addr`, i.e. the number of times that it was taken and
+  // not taken. Returns `false` if there is no profile data for the
+  // instruction. The trace lifter attaches these as the branch weights of the
+  // conditional branch that it emits for the instruction.
+  //
+  // By default, there is no profile data.
+  virtual bool TryGetBranchCounts(uint64_t inst_addr, uint64_t *taken,
+                                  uint64_t *not_taken);
+
+  // Returns `true` if the segment base registers (e.g. `FSBASE` and `GSBASE`
+  // on x86) are never written by the lifted code, e.g. because the program
+  // doesn't change its thread-local storage pointer. The trace lifter then
+  // loads each segment base once per trace, rather than once per memory
+  // access. See `InstructionLifter::SetInvariantSegmentBases`.
+  //
+  // By default, segment bases may change.
+  virtual bool HasInvariantSegmentBases(void);
+
+  // Returns `true` if the code at `addr` belongs to a function that follows
+  // the standard calling convention of the architecture, i.e. that is only
+  // entered by calls, and that only returns to the return address of its
+  // caller. With `TraceLifter::SetNativeCallReturns`, the direct calls to,
+  // and the returns of, such functions are lifted as native calls and
+  // returns. This is asked both of the targets of direct calls, and of the
+  // address of each lifted trace.
+  //
+  // By default, no function is known to be standard.
+  virtual bool IsStandardFunction(uint64_t addr);
+
   // Try to read an executable byte of memory. Returns `true` of the byte
   // at address `addr` is executable and readable, and updates the byte
   // pointed to by `byte` with the read value.
   virtual bool TryReadExecutableByte(uint64_t addr, uint8_t *byte) = 0;
+
+  // Try to read up to `size` contiguous executable bytes starting at address
+  // `addr`. Returns a view of the bytes that could be read, which is empty if
+  // the byte at `addr` isn't executable and readable, and may be shorter than
+  // `size`. The returned view need only remain valid until the next call.
+  //
+  // The default implementation reads one byte at a time using
+  // `TryReadExecutableByte`, and stores the bytes into `buffer`. Managers whose
+  // memory is backed by contiguous (e.g. memory-mapped) segments should
+  // override this to return views directly into those segments.
+  //
+  // NOTE: The caller guarantees that `addr + size` does not overflow.
+  virtual std::string_view TryReadExecutableBytes(uint64_t addr, size_t size,
+                                                  std::string &buffer);
 };
 
 // Implements a recursive decoder that lifts a trace of instructions to bitcode.
@@ -89,16 +245,170 @@ class TraceLifter {
   inline TraceLifter(InstructionLifter &inst_lifter_, TraceManager &manager_)
       : TraceLifter(&inst_lifter_, &manager_) {}
 
-  TraceLifter(InstructionLifter *inst_lifter_, TraceManager *manager_);
+  // Decoded instructions are looked up in, and added to, `cache_`. The same
+  // cache can be shared by many trace lifters, so long as they are not used
+  // concurrently.
+  inline TraceLifter(InstructionLifter &inst_lifter_, TraceManager &manager_,
+                     InstructionCache &cache_)
+      : TraceLifter(&inst_lifter_, &manager_, &cache_) {}
+
+  TraceLifter(InstructionLifter *inst_lifter_, TraceManager *manager_,
+              InstructionCache *cache_ = nullptr);
 
   static void NullCallback(uint64_t, llvm::Function *);
 
+  // Limit the size of each trace lifted after this call. By default, traces
+  // are unlimited.
+  void SetTraceLimits(const TraceLimits &limits);
+
+  // Fuse idioms of consecutive instructions into single instructions, as
+  // done by `Arch::FuseWithNextInstruction`, in each trace lifted after this
+  // call. This emits fewer semantics calls, and fewer stores of intermediate
+  // values that are immediately overwritten. By default, idioms aren't fused.
+  void SetFuseInstructions(bool enable);
+
+  // Fold address operands relative to the program counter (e.g. RIP-relative
+  // operands on x86, or `ADR` and literal loads on AArch64) into absolute
+  // addresses in each trace lifted after this call, so that they are lifted
+  // as constants rather than as arithmetic on `PC` or `NEXT_PC`. This also
+  // lets more instructions skip storing the program counter before their
+  // semantics are called. Disable this if the lifted code must run at a
+  // different address than it was lifted at, i.e. if the program counter
+  // passed to a trace can differ from the trace's address. By default,
+  // PC-relative operands are folded.
+  void SetFoldPCRelativeOperands(bool enable);
+
+  // Decode instructions ahead of the lifter on a thread of its own, following
+  // the fall-through and direct branch edges of each trace lifted after this
+  // call, so that decoding overlaps with building IR. At most
+  // `max_queued_insts` decoded instructions wait to be lifted at once; zero
+  // disables lookahead decoding, which is the default. Instructions decoded
+  // ahead are only used if their bytes still match the bytes read by the
+  // lifter. The `TraceManager`'s `TryReadExecutableBytes` must be safe to call
+  // from another thread (e.g. that of `ConcurrentTraceManager` is). The
+  // `InstructionCache`, if any, is only used by the lifting thread.
+  void SetLookaheadDecoding(size_t max_queued_insts);
+
+  // Start each trace lifted after this call with a minimal prologue (see
+  // `CloneBlockFunctionPrologueInto`) that only defines the control variables,
+  // rather than with a clone of all of `__remill_basic_block`. The other
+  // variables are added when first used, as enabled on the `InstructionLifter`
+  // used by this trace lifter by `SetLazyBlockVariables`. By default, traces
+  // start with a full clone.
+  void SetLazyPrologue(bool enable);
+
+  // Chain the indirect jumps of each trace lifted after this call to their
+  // target traces without leaving lifted code. Targets that aren't known
+  // to the `TraceManager` are looked up in the trace table (see
+  // `TraceTableEntry`) and tail-called when found, falling back on the
+  // `__remill_jump` intrinsic otherwise. Direct jumps to other traces are
+  // always tail calls. By default, indirect jumps aren't chained.
+  void SetChainIndirectJumps(bool enable);
+
+  // Emit an inline target cache at each indirect jump and call site of each
+  // trace lifted after this call, so that monomorphic sites go straight to
+  // their target trace. Each cache remembers the two traces most recently
+  // found in the trace table by its site, and is checked before the table.
+  // Function returns also return directly to the calling trace, instead of
+  // via `__remill_function_return`, and each call of a trace checks that it
+  // returned to the return address, i.e. the native stack acts as a shadow
+  // stack. The executor must define the trace table. By default, there are
+  // no inline target caches.
+  void SetInlineTargetCaches(bool enable);
+
+  // Lift the direct calls to the functions for which
+  // `TraceManager::IsStandardFunction` returns `true` as native calls that
+  // continue in the calling trace once the callee returns, in each trace
+  // lifted after this call. The returns of the traces of those functions go
+  // straight back to their caller, rather than through
+  // `__remill_function_return`, and each such call checks that its callee
+  // returned to the return address, tail-calling `__remill_jump` if it
+  // didn't. By default, only the traces lifted with `SetInlineTargetCaches`
+  // return directly to their caller.
+  void SetNativeCallReturns(bool enable);
+
+  // Move the blocks of each trace lifted after this call that exit to
+  // `__remill_error` (e.g. after invalid or unsupported instructions) or to
+  // `__remill_missing_block` to the end of the trace, mark their calls as
+  // cold, and weight the branches into them as unlikely, so that the
+  // optimizer and code generator favor the hot paths. By default, these exits
+  // are left where they were lifted.
+  void SetSplitColdExits(bool enable);
+
+  // Instrument each trace lifted after this call so that it counts its own
+  // execution. By default, traces aren't instrumented.
+  void SetProfiling(const TraceProfiling &profiling);
+
+  // Accumulate statistics about each trace lifted after this call into
+  // `stats`, or stop if `stats` is null. This also applies to the ISEL
+  // lookups of the `InstructionLifter` used by this trace lifter.
+  void SetStatistics(LiftStatistics *stats);
+
+  // Add each trace lifted after this call to `index`, or stop if `index` is
+  // null, so that `index` knows about the calls made by each trace. `index`
+  // must be of the module into which traces are lifted. Traces released by
+  // `LiftStreaming` aren't added, as they leave the module.
+  void SetModuleIndex(ModuleIndex *index);
+
+  // Invoked with each trace head discovered by `Lift`, other than the one it
+  // was passed, e.g. the targets of direct function calls. Returns `true` if
+  // the trace will be lifted elsewhere, in which case it is left as an
+  // external declaration and linked with its definition by name.
+  using TraceHeadCallback = std::function<bool(uint64_t addr)>;
+
+  // Hand off each trace head discovered after this call to `on_trace_head`
+  // rather than lifting it, e.g. so that it can be scheduled on another
+  // thread. By default, or if `on_trace_head` is empty, every trace head
+  // reachable from the address passed to `Lift` is lifted by `Lift`.
+  void SetTraceHeadCallback(TraceHeadCallback on_trace_head);
+
+  // Bound the work done by each call to `Lift` or `LiftStreaming` after this
+  // call. Once a bound is reached, the trace being lifted is ended early by
+  // tail-calling its unlifted blocks as traces, and the trace heads that
+  // haven't been lifted are left as external declarations. The traces that
+  // were lifted, and passed to the callback, are complete and valid. By
+  // default, lifting is unbounded.
+  void SetLiftOptions(const LiftOptions &options);
+
+  // Returns why the most recent call to `Lift` or `LiftStreaming` stopped.
+  // This is `LiftOutcome::kComplete` unless that call returned `false`
+  // because of the bounds set by `SetLiftOptions`.
+  LiftOutcome Outcome(void) const;
+
+  // Returns a hash of the settings of this trace lifter, and of its
+  // `InstructionLifter`, that change the lifted IR, e.g. to pass to
+  // `TraceCache::SetLiftOptionsHash`.
+  uint64_t OptionsHash(void) const;
+
   // Lift one or more traces starting from `addr`. Calls `callback` with each
   // lifted trace.
   bool
   Lift(uint64_t addr,
        std::function<void(uint64_t, llvm::Function *)> callback = NullCallback);
 
+  // Invoked with each trace lifted by `LiftStreaming`, after it has been
+  // moved into its own module, `trace_module`. The callee owns the module,
+  // and can optimize, serialize, and then drop it.
+  using TraceModuleCallback =
+      std::function<void(uint64_t addr, llvm::Function *func,
+                         std::unique_ptr<llvm::Module> trace_module)>;
+
+  // Lift one or more traces starting from `addr`, handing off each trace to
+  // `release` once it has been lifted, so that the memory used by lifting
+  // is bounded by the largest trace rather than by the whole program.
+  //
+  // `callback` is invoked first, while the trace is still in the semantics
+  // module. This is where semantics functions can be inlined into the trace,
+  // as only their declarations are moved along with the trace.
+  //
+  // Each released trace is given external linkage, and is replaced by an
+  // external declaration in the semantics module. That declaration is what
+  // is passed to `TraceManager::SetLiftedTraceDefinition`; returning it from
+  // `GetLiftedTraceDefinition` tells the lifter not to lift the trace again.
+  bool LiftStreaming(
+      uint64_t addr, TraceModuleCallback release,
+      std::function<void(uint64_t, llvm::Function *)> callback = NullCallback);
+
  private:
   TraceLifter(void) = delete;
 
@@ -107,4 +417,102 @@ class TraceLifter {
   std::unique_ptr<Impl> impl;
 };
 
+// Limits on the merging of traces into regions by `FormTraceRegions`. Sizes
+// are in LLVM instructions.
+struct RegionLimits {
+  // Maximum size of a trace that is merged into its only caller.
+  size_t max_merged_size{256};
+
+  // Maximum size of a region, i.e. of a trace after others are merged into it.
+  size_t max_region_size{4096};
+};
+
+// Merge each small trace of `traces` whose only use is a single call or tail
+// call from another trace of `traces` into that trace, by inlining it there.
+// This gives LLVM single-entry regions that are larger than traces, so that it
+// can keep `State` in registers across what were trace boundaries. Traces are
+// merged bottom-up, so that a chain of traces that each have only one caller
+// becomes a single region.
+//
+// Merged traces are kept as functions of their own, because they may still be
+// entered directly at run time, e.g. by an indirect jump. Call this on the
+// traces lifted into one module, e.g. by `TraceLifter::Lift`, before inlining
+// the semantics and optimizing. Returns the number of merged traces.
+size_t FormTraceRegions(const TraceMap &traces,
+                        const RegionLimits &limits = {});
+
+// The lifted traces produced by one worker of a `ParallelTraceLifter`. Each
+// shard owns its own `llvm::LLVMContext`, so the modules of two different
+// shards must be serialized (e.g. to bitcode) before they can be combined.
+struct LiftedTraceShard {
+  std::unique_ptr<llvm::LLVMContext> context;
+  std::unique_ptr<const Arch> arch;
+
+  // The semantics module into which the traces were lifted. This still
+  // contains the declarations of the traces found in `module`, and is kept
+  // alive so that the traces can be re-optimized against the semantics.
+  std::unique_ptr<llvm::Module> semantics_module;
+
+  // Module containing only the lifted traces of this shard, moved out of
+  // `semantics_module` using `MoveFunctionIntoModule`.
+  std::unique_ptr<llvm::Module> module;
+
+  // Lifted traces, indexed by their entry address. The functions are in
+  // `module`.
+  TraceMap traces;
+};
+
+// Lifts many trace roots in parallel. Each worker thread owns its own
+// `llvm::LLVMContext`, semantics module, `IntrinsicTable`,
+// `InstructionLifter`, `TraceLifter`, and `TraceManager`.
+//
+// Traces are scheduled by work stealing. Each worker has a deque of trace
+// heads, which is seeded with a contiguous address range of the roots. The
+// trace heads discovered while lifting a trace (e.g. the targets of direct
+// calls, devirtualized targets, and the heads of split traces) are pushed
+// onto the discovering worker's deque instead of being lifted on the spot,
+// and a worker whose deque is empty steals from the others. A trace head is
+// only ever pushed once, so no two workers lift the same trace, and calls
+// to the traces of other workers are external declarations that are linked
+// by name.
+class ParallelTraceLifter {
+ public:
+  // Creates the trace manager used by worker number `shard`, which lifts
+  // into `module`. This is invoked on the worker's thread, and the returned
+  // manager is only ever used on that thread.
+  using ManagerFactory = std::function<std::unique_ptr<TraceManager>(
+      unsigned shard, llvm::Module *module)>;
+
+  // Invoked on a worker's thread once all of the traces of that worker have
+  // been lifted into its semantics module, and before they are moved into
+  // the shard's module. This is a good place to call `OptimizeModule`.
+  using ShardCallback = std::function<void(
+      unsigned shard, const Arch *arch, llvm::Module *semantics_module,
+      const TraceMap &traces)>;
+
+  ~ParallelTraceLifter(void);
+
+  // If `num_workers` is zero, then the number of hardware threads is used.
+  ParallelTraceLifter(OSName os_name_, ArchName arch_name_,
+                      ManagerFactory manager_factory_,
+                      unsigned num_workers_ = 0);
+
+  static void NullCallback(unsigned, const Arch *, llvm::Module *,
+                           const TraceMap &);
+
+  // Lift all traces reachable from `trace_addrs`. Returns one shard per
+  // worker, with at most one worker per root.
+  std::vector<LiftedTraceShard>
+  Lift(const std::vector<uint64_t> &trace_addrs,
+       ShardCallback callback = NullCallback);
+
+ private:
+  ParallelTraceLifter(void) = delete;
+
+  const OSName os_name;
+  const ArchName arch_name;
+  const ManagerFactory manager_factory;
+  const unsigned num_workers;
+};
+
 }  // namespace remill
@@ -0,0 +1,49 @@
+/*
+ * Copyright (c) 2020 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#pragma once
+
+#include <cstdint>
+#include <unordered_map>
+
+namespace llvm {
+class Function;
+}  // namespace llvm
+namespace remill {
+
+// Share one body between the traces of `traces`, indexed by their entry
+// addresses, that are identical apart from the program counter values that
+// they use, e.g. the copies of a runtime helper or of a template instance at
+// different addresses of a statically linked binary.
+//
+// The integer constants of a trace that are within 64 KiB of its address,
+// other than those below 64 KiB, are taken to be program counter values, and
+// are rewritten to be relative to the program counter argument. The traces that are then identical, as
+// told by `llvm::FunctionComparator`, form a class. The trace of the class
+// with the lowest address keeps its body, made relative, and is marked
+// `noinline`; the other traces become thunks that tail-call it, passing
+// their own address as the program counter. This relies on the program
+// counter argument of a trace being the address of the trace, as it is for
+// the calls made by lifted code. Traces that differ in anything else, e.g.
+// in which traces they call, are not merged.
+//
+// This is best done before optimizing, so that each body is only optimized
+// once. Returns the number of traces that were made into thunks.
+unsigned MergeIdenticalTraces(
+    const std::unordered_map<uint64_t, llvm::Function *> &traces);
+
+}  // namespace remill
@@ -56,6 +56,8 @@ class PointerType;
 class Type;
 class Value;
 class LLVMContext;
+class MemoryBuffer;
+class raw_ostream;
 }  // namespace llvm
 
 namespace remill {
@@ -142,13 +144,24 @@ llvm::GlobalVariable *FindGlobaVariable(llvm::Module *M, std::string_view name);
 // Try to verify a module.
 bool VerifyModule(llvm::Module *module);
 
-// Parses and loads a bitcode file into memory.
+// Memory-maps the file `file_name`, or reads it into memory if it's small.
+// Unlike the buffers that `llvm::parseIRFile` reads, the returned buffer
+// isn't null-terminated, which bitcode doesn't need, and so large files are
+// always mapped, even if their size is a multiple of the page size. Thus,
+// processes that read the same file share its pages in the page cache.
+std::unique_ptr<llvm::MemoryBuffer>
+MapBitcodeFile(std::string_view file_name, bool allow_failure = false);
+
+// Parses and loads a bitcode file into memory. Bitcode files are read with
+// `MapBitcodeFile`.
 std::unique_ptr<llvm::Module> LoadModuleFromFile(llvm::LLVMContext *context,
                                                  std::string_view file_name,
                                                  bool allow_failure = false);
 
 // Loads the semantics for the `arch`-specific machine, i.e. the machine of the
-// code that we want to lift.
+// code that we want to lift. The semantics file is only found and read once,
+// and then kept in memory, so loading the same semantics into one context per
+// thread only parses the bitcode again.
 std::unique_ptr<llvm::Module> LoadArchSemantics(const Arch *arch);
 
 inline std::unique_ptr<llvm::Module>
@@ -156,10 +169,61 @@ LoadArchSemantics(const std::unique_ptr<const Arch> &arch) {
   return LoadArchSemantics(arch.get());
 }
 
+// Parses a bitcode file into memory without reading any function bodies.
+// Bodies are read by `MaterializeFunction`. The module isn't verified. The
+// module owns the mapping of the file made by `MapBitcodeFile`, and so
+// unread bodies only take up space in the page cache.
+std::unique_ptr<llvm::Module>
+LoadLazyModuleFromFile(llvm::LLVMContext *context, std::string_view file_name,
+                       bool allow_failure = false);
+
+// Loads the semantics for the `arch`-specific machine, like
+// `LoadArchSemantics`, but only reads the bodies of `__remill_basic_block`
+// and the functions it uses. The bodies of the semantics functions are read
+// when an `InstructionLifter` first looks them up. This is much faster than
+// `LoadArchSemantics` when only a few instructions will be lifted. Functions
+// that are still unread must be read (`llvm::Module::materializeAll`) or
+// deleted before the module is verified, optimized, or stored.
+std::unique_ptr<llvm::Module> LoadLazyArchSemantics(const Arch *arch);
+
+inline std::unique_ptr<llvm::Module>
+LoadLazyArchSemantics(const std::unique_ptr<const Arch> &arch) {
+  return LoadLazyArchSemantics(arch.get());
+}
+
+// Read the body of `func`, and of every function that it transitively uses,
+// from the bitcode file of a lazily loaded module. If `verify` is `true`,
+// then each newly read function is verified. Returns `false` if reading or
+// verifying a function failed.
+bool MaterializeFunction(llvm::Function *func, bool verify = false);
+
 // Store an LLVM module into a file.
 bool StoreModuleToFile(llvm::Module *module, std::string_view file_name,
                        bool allow_failure = false);
 
+// Options for serializing a module to bitcode in memory.
+struct BitcodeStoreOptions {
+  // Verify the module before serializing it. If verification fails, then
+  // nothing is written.
+  bool verify{true};
+
+  // Write a symbol table after the module. Readers don't need the symbol
+  // table; it only speeds up linking, e.g. with LTO, and it is slow to build.
+  bool symbol_table{false};
+};
+
+// Serialize an LLVM module to bitcode in `buffer`, replacing what was there.
+// Unlike `StoreModuleToFile`, this doesn't go through a temporary file.
+bool StoreModuleToBuffer(llvm::Module *module,
+                         llvm::SmallVectorImpl<char> &buffer,
+                         const BitcodeStoreOptions &options = {},
+                         bool allow_failure = false);
+
+// Serialize an LLVM module to bitcode, and write it to `os`.
+bool StoreModuleToStream(llvm::Module *module, llvm::raw_ostream &os,
+                         const BitcodeStoreOptions &options = {},
+                         bool allow_failure = false);
+
 // Store a module, serialized to LLVM IR, into a file.
 bool StoreModuleIRToFile(llvm::Module *module, std::string_view file_name,
                          bool allow_failure = false);
@@ -171,7 +235,8 @@ std::string FindTargetSemanticsBitcodeFile(void) __attribute__((deprecated));
 // the architecture on which remill is compiled.
 std::string FindHostSemanticsBitcodeFile(void) __attribute__((deprecated));
 
-// Find a semantics bitcode file for the architecture `arch`.
+// Find a semantics bitcode file for the architecture `arch`. This prefers the
+// fast x87 variant of x86 and amd64 semantics with `--fast_x87_semantics`.
 std::string FindSemanticsBitcodeFile(std::string_view arch);
 
 // Return a pointer to the Nth argument (N=0 is the first argument).
@@ -195,7 +260,9 @@ LiftedFunctionArgs(llvm::BasicBlock *block);
 std::string LLVMThingToString(llvm::Value *thing);
 std::string LLVMThingToString(llvm::Type *thing);
 
-// Apply a callback function to every semantics bitcode function.
+// Apply a callback function to every semantics bitcode function. This scans
+// every global variable of `module`; `ModuleIndex` answers repeated queries
+// without doing so.
 using ISelCallback =
     std::function<void(llvm::GlobalVariable *, llvm::Function *)>;
 void ForEachISel(llvm::Module *module, ISelCallback callback);
@@ -244,7 +311,22 @@ void CloneFunctionInto(llvm::Function *source_func, llvm::Function *dest_func);
 // Make `func` a clone of the `__remill_basic_block` function.
 void CloneBlockFunctionInto(llvm::Function *func);
 
-// Returns a list of callers of a specific function.
+// Make `func` a minimal clone of the `__remill_basic_block` function, whose
+// entry block only defines the control variables, i.e. `STATE`, `MEMORY`,
+// `PC`, `NEXT_PC`, `RETURN_PC`, and `BRANCH_TAKEN`. The other variables of
+// `__remill_basic_block` are added on demand with `CloneBlockVariableInto`.
+// As with `CloneBlockFunctionInto`, the entry block has no terminator.
+void CloneBlockFunctionPrologueInto(llvm::Function *func);
+
+// Clone the variable `name` of the `__remill_basic_block` function, along
+// with the stores that initialize it, into the start of the entry block of
+// `func`. Returns the new variable, or `nullptr` if `__remill_basic_block`
+// has no such variable.
+llvm::Value *CloneBlockVariableInto(llvm::Function *func,
+                                    std::string_view name);
+
+// Returns a list of callers of a specific function. See also
+// `ModuleIndex::CallersOf`.
 std::vector<llvm::CallInst *> CallersOf(llvm::Function *func);
 
 // Returns the name of a module.
@@ -260,9 +342,122 @@ unsigned ReplaceAllUsesOfConstant(llvm::Constant *old_c, llvm::Constant *new_c,
 // Move a function from one module into another module.
 void MoveFunctionIntoModule(llvm::Function *func, llvm::Module *dest_module);
 
+// Move the functions `funcs` into `dest_module`. This is like calling
+// `MoveFunctionIntoModule` on each of them, but the globals and declarations
+// that they share are only moved or declared in `dest_module` once.
+void MoveFunctionsIntoModule(const std::vector<llvm::Function *> &funcs,
+                             llvm::Module *dest_module);
+
+// Copy `module` into `context`, which may be a different `llvm::LLVMContext`,
+// by serializing it to bitcode in memory and parsing it back.
+std::unique_ptr<llvm::Module> CopyModuleToContext(llvm::Module *module,
+                                                  llvm::LLVMContext *context);
+
+// Move the function definitions of `modules` into `dest_module`, like
+// `MoveFunctionsIntoModule`. The modules may be in different contexts, e.g.
+// the modules of `LiftedTraceShard`s. Those that aren't in the context of
+// `dest_module` are serialized to bitcode in memory on up to `num_threads`
+// threads (all cores if `0`), one context per thread, and then lazily read
+// into the context of `dest_module`. Only the first definition of each
+// function name is kept, and the bodies of the other definitions aren't read.
+// Modules in the context of `dest_module` are left with declarations of their
+// functions, and the other modules aren't changed.
+void MergeModulesInto(const std::vector<llvm::Module *> &modules,
+                      llvm::Module *dest_module, unsigned num_threads = 0);
+
+// Split the definitions of `module` into one module per element of `parts`,
+// e.g. one per range of trace addresses. The `i`th module defines the
+// functions in `parts[i]`, and the first module also defines every other
+// global value. Each module declares the global values that it uses but
+// doesn't define. Definitions with local linkage in `module` are given
+// external, hidden linkage, so that they can be used from the other modules.
+// The split modules are in the same context as `module`, and `module` isn't
+// otherwise changed.
+std::vector<std::unique_ptr<llvm::Module>>
+SplitModule(llvm::Module *module,
+            const std::vector<std::vector<llvm::Function *>> &parts);
+
+// Create an empty module named `name` in `context` to lift into, instead of
+// lifting into the semantics module `semantics` itself. The new module has
+// the data layout and target triple of `semantics`, a copy of
+// `__remill_basic_block`, and declarations of the other `__remill_*`
+// functions, and so an `IntrinsicTable` can be made from it. Pass `semantics`
+// to the `InstructionLifter`, which then declares the semantics functions of
+// the lifted instructions in the new module, and link in their bodies with
+// `LinkSemanticsInto` (or `OptimizationGuide::semantics`) before optimizing.
+//
+// Many thin modules, e.g. one per lifting thread and context, can share one
+// semantics module, which they only read. A lazily loaded semantics module
+// must be fully read (`llvm::Module::materializeAll`) before it is shared.
+std::unique_ptr<llvm::Module> CreateThinModule(llvm::Module *semantics,
+                                               llvm::LLVMContext *context,
+                                               std::string_view name);
+
+// Declare the semantics function `sem` of the instruction function named
+// `function` (e.g. `ADD_GPRv_GPRv_32`) in `dest_module`, along with its
+// `ISEL_` variable. Semantics functions with local linkage are declared as
+// external, and get their linkage back once `LinkSemanticsInto` links in
+// their bodies.
+llvm::Function *DeclareISelInModule(std::string_view function,
+                                    llvm::Function *sem,
+                                    llvm::Module *dest_module);
+
+// Define the functions and variables that `module` declares and `semantics`
+// defines by copying them from `semantics`, along with everything that they
+// use, transitively. `semantics` isn't changed, except that the bodies of
+// lazily loaded functions are read.
+void LinkSemanticsInto(llvm::Module *module, llvm::Module *semantics);
+
+// Store each of `modules` into the file at the same index of `file_names`,
+// like `StoreModuleToFile`, writing up to `num_threads` files at once (all
+// cores if `0`). Verifying and writing bitcode only read the IR, and so
+// modules that share a context can be stored at the same time; however, the
+// context must not be used by anything else until this returns. Lazily loaded
+// modules are fully read on this thread first. Returns `false` if any module
+// couldn't be stored.
+bool StoreModulesToFiles(const std::vector<llvm::Module *> &modules,
+                         const std::vector<std::string> &file_names,
+                         unsigned num_threads = 0, bool allow_failure = false);
+
 // Get an instance of `type` that belongs to `context`.
 llvm::Type *RecontextualizeType(llvm::Type *type, llvm::LLVMContext &context);
 
+// Caches the types and metadata that are moved or cloned into `dest_context`
+// from other contexts, e.g. by `CloneFunctionInto`, `MoveFunctionIntoModule`,
+// and `RecontextualizeType`. Without a session, every call rebuilds the types
+// and metadata that it needs, and so structures like `State` are created
+// again each time. A session applies to the transfers made on the thread that
+// created it, for as long as it is alive, and the innermost live session is
+// only used for transfers into its `dest_context`.
+//
+// NOTE(pag): The cached entries are keyed by the types and metadata of the
+//            source contexts, and so those contexts must outlive the session.
+class ContextTransferSession {
+ public:
+  explicit ContextTransferSession(llvm::LLVMContext &dest_context_);
+  ~ContextTransferSession(void);
+
+  // Returns the innermost live session on this thread if it transfers into
+  // `context`, or `nullptr`.
+  static ContextTransferSession *Get(llvm::LLVMContext &context);
+
+  llvm::LLVMContext &dest_context;
+
+  // Types of other contexts, mapped to their instances in `dest_context`.
+  std::unordered_map<llvm::Type *, llvm::Type *> types;
+
+  // Metadata of other contexts that doesn't refer to any values, mapped to
+  // its clones in `dest_context`.
+  MDMap metadata;
+
+ private:
+  ContextTransferSession(void) = delete;
+  ContextTransferSession(const ContextTransferSession &) = delete;
+  ContextTransferSession &operator=(const ContextTransferSession &) = delete;
+
+  ContextTransferSession *const outer;
+};
+
 // Produce a sequence of instructions that will load values from
 // memory, building up the correct type. This will invoke the various
 // memory read intrinsics in order to match the right type, or
@@ -283,6 +478,38 @@ llvm::Value *StoreToMemory(const IntrinsicTable &intrinsics,
                            llvm::BasicBlock *block, llvm::Value *val_to_store,
                            llvm::Value *mem_ptr, llvm::Value *addr);
 
+// Emits the loads and stores of `LoadFromMemory` and `StoreToMemory`, but
+// keeps the data layout and the intrinsics that it needs between calls, and
+// so is cheaper when there are many memory accesses to emit for one module.
+//
+// Vectors and arrays of whole-byte integers and of `float`s and `double`s,
+// as well as integers that have no matching intrinsic, are accessed in bulk,
+// using one 64-bit memory intrinsic per eight bytes, instead of one intrinsic
+// per element.
+class MemoryAccessEmitter {
+ public:
+  explicit MemoryAccessEmitter(const IntrinsicTable &intrinsics);
+  ~MemoryAccessEmitter(void);
+
+  // Produce a sequence of instructions at the end of `block` that will load
+  // a value of type `type` from memory at `addr`. Returns the loaded value.
+  llvm::Value *Load(llvm::BasicBlock *block, llvm::Type *type,
+                    llvm::Value *mem_ptr, llvm::Value *addr);
+
+  // Produce a sequence of instructions at the end of `block` that will store
+  // `val_to_store` to memory at `addr`. Returns the new value of the memory
+  // pointer.
+  llvm::Value *Store(llvm::BasicBlock *block, llvm::Value *val_to_store,
+                     llvm::Value *mem_ptr, llvm::Value *addr);
+
+ private:
+  MemoryAccessEmitter(void) = delete;
+
+  class Impl;
+
+  const std::unique_ptr<Impl> impl;
+};
+
 // Create an array of index values to pass to a GetElementPtr instruction
 // that will let us locate a particular register. Returns the final offset
 // into `type` which was reached as the first value in the pair, and the type
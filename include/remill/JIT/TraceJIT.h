@@ -0,0 +1,187 @@
+/*
+ * Copyright (c) 2020 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <remill/BC/TraceLifter.h>
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace llvm {
+class Function;
+class Module;
+}  // namespace llvm
+namespace remill {
+
+struct ProfileCounters;
+
+// Configuration of a `TraceJIT`.
+struct TraceJITOptions {
+  // Number of threads on which traces are compiled. If zero, then the number
+  // of hardware threads is used.
+  unsigned num_compile_threads{0};
+
+  // Addresses of the runtime functions and variables used by the lifted code,
+  // by name, e.g. the memory intrinsics (see `AddPagedMemoryIntrinsics`), and
+  // the control flow and hyper call intrinsics, such as `__remill_jump` and
+  // `__remill_sync_hyper_call`. These take precedence over the symbols of
+  // this process.
+  std::unordered_map<std::string, void *> runtime;
+
+  // Resolve the symbols that aren't in `runtime` against this process, which
+  // then needs to export them, e.g. by linking with `-rdynamic`.
+  bool search_process_symbols{true};
+
+  // Returns the address of the trace named `name`, or `std::nullopt` if `name`
+  // isn't the name of a trace. The default matches the default
+  // `TraceManager::TraceName`, i.e. `sub_` followed by the hex address.
+  std::function<std::optional<uint64_t>(std::string_view name)> trace_address;
+
+  // Called with the address of a trace that is needed, i.e. called by another
+  // trace or passed to `TraceJIT::GetTrace`, but hasn't been added. It should
+  // lift the trace, e.g. with `TraceLifter::LiftStreaming`, and pass it (and
+  // any other traces that it lifts) to `TraceJIT::AddTrace`. Returns `false`
+  // if the trace can't be lifted.
+  //
+  // NOTE(pag): This is called on whichever thread needs the trace, including
+  //            the compile threads, but never on two threads at once. It must
+  //            still synchronize with any other use of the same lifter.
+  std::function<bool(uint64_t addr)> lift_trace;
+
+  // Directory in which the compiled traces are cached, which is created if it
+  // doesn't exist, or empty for no cache. Later runs load the cached traces
+  // instead of lifting, optimizing, and compiling them again. Only the traces
+  // whose instructions are passed to `TraceJIT::SetTraceInstructions` are
+  // cached.
+  std::string object_cache_dir;
+
+  // Identifies everything other than the bytes of a trace and the host that
+  // the cached traces depend on, e.g. a hash of the semantics bitcode, the
+  // remill version, and the `OptimizationGuide`. Cached traces are only
+  // loaded by runs with the same key.
+  uint64_t object_cache_key{0};
+
+  // Reads the executable bytes in `[addr, addr + size)`, as does
+  // `TraceManager::TryReadExecutableBytes`, so that a cached trace is only
+  // loaded if its bytes haven't changed. This is required by the cache, and
+  // is only called when `lift_trace` or `TraceJIT::AddTrace` may be.
+  std::function<std::string_view(uint64_t addr, size_t size,
+                                 std::string &buffer)>
+      read_executable_bytes;
+
+  // Write `/tmp/perf-<pid>.map`, from which `perf report` names the compiled
+  // traces. If the traces were lifted with
+  // `InstructionLifter::SetGuestPCDebugLocations`, then the code of each
+  // guest instruction is named after the trace and the instruction's address,
+  // so that the host cycles spent in a trace are attributed to its guest
+  // instructions.
+  bool write_perf_map{false};
+
+  // Write jitdump records (`jit-<pid>.dump`), which `perf inject --jit` merges
+  // into a profile, along with the line tables of the traces, i.e. their guest
+  // PC debug locations. This needs LLVM to be built with `LLVM_USE_PERF`, and
+  // otherwise only logs a warning.
+  bool write_jitdump{false};
+};
+
+// Compiles lifted traces on demand with LLVM's ORC JIT, so that lifted code can
+// start running while the rest of the program is still being lifted. Each
+// trace is a compile unit of its own, and is only compiled once it is first
+// called, on a pool of compile threads. Calls between traces are linked by
+// name, and lifted via `TraceJITOptions::lift_trace` if they are missing.
+// Once a trace is compiled, the stubs through which the other traces call or
+// jump to it are patched to go straight to the compiled code.
+//
+// The JIT defines the trace table (see `TraceTableEntry`), and adds to it each
+// trace returned by `GetTrace`. The indirect jumps of traces lifted with
+// `TraceLifter::SetChainIndirectJumps` or `TraceLifter::SetInlineTargetCaches`
+// go straight to the traces found in the table, so that only the first jump to
+// a trace goes through the dispatcher.
+//
+// If `TraceJITOptions::object_cache_dir` is set, then the native code of each
+// trace is stored there once it is compiled, keyed by the bytes of the trace,
+// `TraceJITOptions::object_cache_key`, and the CPU and features of the host.
+// The traces found in the cache are mapped from there instead of being
+// lifted, optimized, and compiled. A cached trace is linked when it is first
+// needed, along with the cached traces that it calls.
+//
+//      auto jit = remill::TraceJIT::Create(std::move(options));
+//      trace_lifter.LiftStreaming(
+//          entry,
+//          [&](uint64_t addr, llvm::Function *func,
+//              std::unique_ptr<llvm::Module> trace_module) {
+//            jit->AddTrace(addr, func, std::move(trace_module));
+//          },
+//          [](uint64_t, llvm::Function *func) {
+//            remill::InlineSemanticsIntoTrace(func);
+//          });
+//      auto trace = reinterpret_cast<LiftedFunc *>(jit->GetTrace(entry));
+//      memory = trace(state, entry, memory);
+//
+// The methods of a `TraceJIT` are thread-safe.
+class TraceJIT {
+ public:
+  // Returns `nullptr` if the JIT can't be created for this host.
+  static std::unique_ptr<TraceJIT> Create(TraceJITOptions options);
+
+  ~TraceJIT(void);
+
+  // Add the lifted trace `func` at `addr`, the only definition in
+  // `trace_module`, as released by `TraceLifter::LiftStreaming`. The
+  // semantics functions must already be inlined into the trace. The trace is
+  // copied into a context of its own, so that the caller can keep lifting
+  // into the context of `trace_module` while the trace is compiled. Returns
+  // `false` if the trace couldn't be added, e.g. because it was already
+  // added.
+  bool AddTrace(uint64_t addr, llvm::Function *func,
+                std::unique_ptr<llvm::Module> trace_module);
+
+  // Remember `insts`, the instructions of the trace at `addr`, e.g. in
+  // `TraceManager::SetLiftedTraceInstructions`, so that the trace is stored
+  // in the object cache once it is compiled. This must be called before the
+  // trace is added.
+  void SetTraceInstructions(uint64_t addr, const TraceInstructionList &insts);
+
+  // Returns the lifted function of the trace at `addr`, lifting it first if
+  // needed, or `nullptr` if it isn't available. The trace itself is compiled
+  // when it is first called. This is what a dispatcher should call when the
+  // lifted code returns to it through `__remill_jump`.
+  void *GetTrace(uint64_t addr);
+
+  // Add the `ProfileCounters` of each added trace that was lifted with
+  // `TraceProfiling` enabled to `counters`, e.g. for `WriteProfile`. This
+  // compiles the traces that haven't yet been compiled.
+  void GetProfileCounters(std::vector<const ProfileCounters *> &counters);
+
+  class Impl;
+
+ private:
+  TraceJIT(void);
+
+  TraceJIT(const TraceJIT &) = delete;
+  TraceJIT &operator=(const TraceJIT &) = delete;
+
+  std::unique_ptr<Impl> impl;
+};
+
+}  // namespace remill
@@ -0,0 +1,192 @@
+/*
+ * Copyright (c) 2020 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+struct Memory;
+
+namespace remill {
+
+// A paged guest address space, for running lifted code. This is the
+// `Memory *` that is passed to lifted code linked against one of the
+// `remill_paged_memory_32` or `remill_paged_memory_64` libraries, which
+// implement the memory intrinsics in terms of this class.
+//
+// Translations of guest pages into host pages are cached in a direct-mapped
+// software TLB, so that accesses which don't cross a page boundary take a
+// handful of instructions. Accesses that miss the TLB, cross a page boundary,
+// or fault take the slow path. The naturally aligned atomic accesses use host
+// atomics on the translated pages.
+//
+//      remill::PagedMemory memory;
+//      memory.Map(0x400000, code_size, remill::PagedMemory::kReadExecute);
+//      memory.CopyIn(0x400000, code, code_size);
+//      ...
+//      lifted_func(state, pc, memory.AsMemory());
+class PagedMemory {
+ public:
+  enum : uint64_t {
+    kPageShift = 12,
+    kPageSize = 1ull << kPageShift,
+    kPageMask = kPageSize - 1,
+    kNumTLBEntries = 256
+  };
+
+  enum Permission : uint8_t {
+    kNone = 0,
+    kRead = 1,
+    kWrite = 2,
+    kExecute = 4,
+    kReadWrite = kRead | kWrite,
+    kReadExecute = kRead | kExecute,
+    kReadWriteExecute = kRead | kWrite | kExecute
+  };
+
+  // Called when the guest accesses `size` bytes at `addr` that aren't mapped
+  // with the permissions `perms`. The handler may map or re-protect the range,
+  // and return `true` to retry the access, or return `false` to fail it.
+  using FaultHandler = bool (*)(PagedMemory &memory, uint64_t addr,
+                                uint64_t size, Permission perms, void *data);
+
+  PagedMemory(void);
+
+  // Create a view of the same address space as `shared`, with its own TLBs.
+  // The TLBs aren't thread-safe, and so each guest thread should run on its
+  // own view. Changing the mappings flushes the TLBs of every view, and so
+  // must not race with accesses made through the other views.
+  explicit PagedMemory(PagedMemory &shared);
+
+  ~PagedMemory(void);
+
+  PagedMemory(const PagedMemory &) = delete;
+  PagedMemory &operator=(const PagedMemory &) = delete;
+
+  // The unmapped guest memory reads as zeroes, and the failed writes are
+  // dropped, after the fault handler fails an access. The default handler
+  // logs a fatal error.
+  void SetFaultHandler(FaultHandler handler, void *data = nullptr);
+
+  // Map the pages spanning `[addr, addr + size)` with the permissions
+  // `perms`. Newly mapped pages are zeroed; already mapped pages keep their
+  // contents and are re-protected.
+  void Map(uint64_t addr, uint64_t size, uint8_t perms);
+
+  // Unmap the pages spanning `[addr, addr + size)`.
+  void Unmap(uint64_t addr, uint64_t size);
+
+  // Change the permissions of the mapped pages spanning `[addr, addr + size)`.
+  void Protect(uint64_t addr, uint64_t size, uint8_t perms);
+
+  // Returns the permissions of the page containing `addr`, or `kNone` if it
+  // isn't mapped.
+  uint8_t Permissions(uint64_t addr) const;
+
+  // Copy bytes into or out of mapped guest memory, ignoring page permissions,
+  // e.g. to load a program. Returns `false` if any page isn't mapped.
+  bool CopyIn(uint64_t addr, const void *data, uint64_t size);
+  bool CopyOut(uint64_t addr, void *data, uint64_t size) const;
+
+  // Read or write guest memory, checking page permissions and calling the
+  // fault handler on faults. Returns `false` if the access failed.
+  bool Read(uint64_t addr, void *data, uint64_t size);
+  bool Write(uint64_t addr, const void *data, uint64_t size);
+
+  // Returns the host address of `size` bytes at the guest address `addr` if
+  // they are within one page that permits the access, or `nullptr` otherwise.
+  inline uint8_t *TranslateForRead(uint64_t addr, uint64_t size) {
+    return Translate(read_tlb, addr, size, kRead);
+  }
+
+  // The write TLB only caches pages that are both readable and writable, so
+  // that atomic read-modify-write accesses can use it.
+  inline uint8_t *TranslateForWrite(uint64_t addr, uint64_t size) {
+    return Translate(write_tlb, addr, size, kReadWrite);
+  }
+
+  template <typename T>
+  inline T Load(uint64_t addr) {
+    T val;
+    if (auto host = TranslateForRead(addr, sizeof(T))) {
+      memcpy(&val, host, sizeof(T));
+    } else {
+      Read(addr, &val, sizeof(T));
+    }
+    return val;
+  }
+
+  template <typename T>
+  inline void Store(uint64_t addr, T val) {
+    if (auto host = TranslateForWrite(addr, sizeof(T))) {
+      memcpy(host, &val, sizeof(T));
+    } else {
+      Write(addr, &val, sizeof(T));
+    }
+  }
+
+  // Drop all cached translations.
+  void FlushTLB(void);
+
+  inline Memory *AsMemory(void) {
+    return reinterpret_cast<Memory *>(this);
+  }
+
+  static inline PagedMemory *FromMemory(Memory *memory) {
+    return reinterpret_cast<PagedMemory *>(memory);
+  }
+
+ private:
+  struct TLBEntry {
+    uint64_t page;
+    uint8_t *host_page;
+  };
+
+  inline uint8_t *Translate(TLBEntry (&tlb)[kNumTLBEntries], uint64_t addr,
+                            uint64_t size, uint8_t perms) {
+    const auto page = addr >> kPageShift;
+    const auto offset = addr & kPageMask;
+    auto &entry = tlb[page % kNumTLBEntries];
+    if ((offset + size) > kPageSize) {
+      return nullptr;
+    } else if (entry.page == page) {
+      return &(entry.host_page[offset]);
+    } else {
+      return Refill(entry, addr, perms);
+    }
+  }
+
+  // Fill `entry` with the translation of `addr` if its page permits `perms`.
+  uint8_t *Refill(TLBEntry &entry, uint64_t addr, uint8_t perms);
+
+  TLBEntry read_tlb[kNumTLBEntries];
+  TLBEntry write_tlb[kNumTLBEntries];
+
+  class Impl;
+  std::shared_ptr<Impl> impl;
+};
+
+// Add the address of each memory intrinsic implemented by the linked
+// `remill_paged_memory_32` or `remill_paged_memory_64` library to `runtime`,
+// by name, e.g. for `TraceJITOptions::runtime`.
+void AddPagedMemoryIntrinsics(
+    std::unordered_map<std::string, void *> &runtime);
+
+}  // namespace remill
@@ -103,6 +103,11 @@ std::string_view AArch32Arch::ProgramCounterRegisterName(void) const {
   return "PC";
 }
 
+// Size of the `State` structure, in bytes.
+uint64_t AArch32Arch::StateStructSize(void) const {
+  return sizeof(State);
+}
+
 // Populate the `__remill_basic_block` function with variables.
 void AArch32Arch::PopulateBasicBlockFunction(llvm::Module *module,
                                              llvm::Function *bb_func) const {
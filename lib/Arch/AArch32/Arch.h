@@ -36,9 +36,17 @@ class AArch32Arch final : public Arch {
   bool DecodeInstruction(uint64_t address, std::string_view inst_bytes,
                          Instruction &inst) const override;
 
+  // Decode several consecutive instructions.
+  size_t DecodeInstructions(uint64_t address, std::string_view insts_bytes,
+                            std::vector<Instruction> &insts,
+                            size_t max_insts) const override;
+
   // Maximum number of bytes in an instruction.
   uint64_t MaxInstructionSize(void) const override;
 
+  // Returns `true` if `inst` is conditionally executed.
+  bool IsPredicated(const Instruction &inst) const override;
+
   llvm::Triple Triple(void) const override;
   llvm::DataLayout DataLayout(void) const override;
 
@@ -49,6 +57,9 @@ class AArch32Arch final : public Arch {
   void PopulateBasicBlockFunction(llvm::Module *module,
                                   llvm::Function *bb_func) const override;
 
+  // Size of the `State` structure, in bytes.
+  uint64_t StateStructSize(void) const override;
+
  private:
   AArch32Arch(void) = delete;
 };
@@ -14,13 +14,17 @@
  * limitations under the License.
  */
 
+#include <gflags/gflags.h>
 #include <glog/logging.h>
 
+#include <array>
 #include <optional>
 
 #include "Arch.h"
 #include "remill/BC/ABI.h"
 
+DECLARE_bool(log_decode_failures);
+
 namespace remill {
 
 namespace {
@@ -3444,6 +3448,35 @@ static TryDecode *TryDecodeTopLevelEncodings(uint32_t bits) {
   }
 }
 
+// The structured decoder above only ever looks at whether `cond` is `1111`,
+// and at bits 27:20 and 7:4 of an instruction. Indexing a flat table with
+// those bits selects the same `TryDecode` function in a single load.
+static constexpr uint32_t kNumDispatchEntries = 2u << 12u;
+
+static uint32_t DispatchIndex(uint32_t bits) {
+  const auto unconditional = (bits >> 28u) == 0b1111u;
+  const auto bits_27_to_20 = (bits >> 20u) & 0xFFu;
+  const auto bits_7_to_4 = (bits >> 4u) & 0xFu;
+  return (unconditional ? 1u << 12u : 0u) | (bits_27_to_20 << 4u) | bits_7_to_4;
+}
+
+// Builds the flat dispatch table by running the structured decoder on one
+// representative instruction for each index.
+static const std::array<TryDecode *, kNumDispatchEntries> &DispatchTable(void) {
+  static const auto table = [] {
+    std::array<TryDecode *, kNumDispatchEntries> entries = {};
+    for (uint32_t index = 0; index < kNumDispatchEntries; ++index) {
+      const uint32_t cond = (index >> 12u) ? 0b1111u : 0b1110u;
+      const uint32_t bits = (cond << 28u) | (((index >> 4u) & 0xFFu) << 20u) |
+                            ((index & 0xFu) << 4u);
+      CHECK_EQ(DispatchIndex(bits), index);
+      entries[index] = TryDecodeTopLevelEncodings(bits);
+    }
+    return entries;
+  }();
+  return table;
+}
+
 static uint32_t BytesToBits(const uint8_t *bytes) {
   uint32_t bits = 0;
   bits = (bits << 8) | static_cast<uint32_t>(bytes[3]);
@@ -3454,6 +3487,61 @@ static uint32_t BytesToBits(const uint8_t *bytes) {
 }
 }  // namespace
 
+// Decode several consecutive instructions, without making a virtual call to
+// `DecodeInstruction` for each one.
+size_t AArch32Arch::DecodeInstructions(uint64_t address,
+                                       std::string_view insts_bytes,
+                                       std::vector<Instruction> &insts,
+                                       size_t max_insts) const {
+  return DecodeEachInstruction(
+      address, insts_bytes, insts, max_insts, MaxInstructionSize(),
+      [this](uint64_t inst_addr, std::string_view inst_bytes,
+             Instruction &inst) {
+        return AArch32Arch::DecodeInstruction(inst_addr, inst_bytes, inst);
+      });
+}
+
+// Returns `true` if `inst` is conditionally executed. The first two operands
+// of a conditionally executed instruction are added by `DecodeCondition`.
+bool AArch32Arch::IsPredicated(const Instruction &inst) const {
+  if (!inst.IsValid() || inst.operands.size() < 2) {
+    return false;
+  }
+
+  const auto &cond_op = inst.operands[0];
+  const auto &branch_taken_op = inst.operands[1];
+  if (Operand::kTypeExpression != cond_op.type ||
+      Operand::kActionRead != cond_op.action || !cond_op.expr ||
+      std::holds_alternative<llvm::Constant *>(*cond_op.expr) ||
+      Operand::kTypeExpression != branch_taken_op.type ||
+      Operand::kActionWrite != branch_taken_op.action ||
+      !branch_taken_op.expr) {
+    return false;
+  }
+
+  auto var = std::get_if<std::string>(branch_taken_op.expr);
+  return var && *var == kBranchTakenVariableName;
+}
+
+// Returns `true` if the semantics function `func` updates the condition
+// flags. Reads of the flags are always explicit operands, but the writes are
+// implicit in the semantics of the flag-setting variants.
+static bool WritesFlags(std::string_view func) {
+  static const std::string_view kFlagSettingFuncs[] = {
+      "MULS",   "MLAS",   "UMULLS", "UMLALS", "SMULLS",
+      "SMLALS", "TSTr",   "TEQr",   "CMPr",   "CMNr"};
+
+  if (func.size() > 3 && func.substr(func.size() - 3) == "Srr") {
+    return true;
+  }
+  for (auto flag_setting_func : kFlagSettingFuncs) {
+    if (func == flag_setting_func) {
+      return true;
+    }
+  }
+  return false;
+}
+
 // Decode an instruction
 bool AArch32Arch::DecodeInstruction(uint64_t address,
                                     std::string_view inst_bytes,
@@ -3471,6 +3559,7 @@ bool AArch32Arch::DecodeInstruction(uint64_t address,
   inst.operands.clear();
 
   if (4ull > inst_bytes.size()) {
+    inst.decode_error = DecodeError::kTruncated;
     return false;
   }
 
@@ -3480,22 +3569,37 @@ bool AArch32Arch::DecodeInstruction(uint64_t address,
     inst.bytes = inst_bytes;
   }
 
+  // The low bit of an interworking branch target is the T bit, which selects
+  // the Thumb instruction set. Only A32 is supported, so reject Thumb code
+  // instead of decoding its halfwords as A32 instructions.
   if (address & 0b1u) {
+    inst.decode_error = DecodeError::kUnsupported;
+    LOG_IF(ERROR, FLAGS_log_decode_failures)
+        << "Thumb instructions at " << std::hex << (address & ~0b1ull)
+        << std::dec << " are unsupported";
     return false;
   }
 
   const auto bytes = reinterpret_cast<const uint8_t *>(inst.bytes.data());
   const auto bits = BytesToBits(bytes);
 
-  auto decoder = TryDecodeTopLevelEncodings(bits);
+  auto decoder = DispatchTable()[DispatchIndex(bits)];
   if (!decoder) {
-    LOG(ERROR) << "unhandled bits " << std::hex << bits << std::dec;
+    inst.decode_error = DecodeError::kInvalidEncoding;
+    LOG_IF(ERROR, FLAGS_log_decode_failures)
+        << "unhandled bits " << std::hex << bits << std::dec;
     return false;
   }
 
-  auto ret = decoder(inst, bits);
-  LOG(ERROR) << inst.Serialize();
-  return ret;
+  if (!decoder(inst, bits)) {
+    return false;
+  }
+
+  AddOperandRegisters(inst);
+  if (WritesFlags(inst.function)) {
+    AddRegistersByName(inst.regs_written, {"N", "Z", "C", "V"});
+  }
+  return true;
 }
 
 }  // namespace remill
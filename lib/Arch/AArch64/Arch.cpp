@@ -28,7 +28,6 @@
 #include <iomanip>
 #include <map>
 #include <memory>
-#include <sstream>
 #include <string>
 
 #define REMILL_AARCH_STRICT_REGNUM
@@ -122,9 +121,25 @@ class AArch64Arch final : public Arch {
   bool DecodeInstruction(uint64_t address, std::string_view instr_bytes,
                          Instruction &inst) const override;
 
+  // Decode several consecutive instructions.
+  size_t DecodeInstructions(uint64_t address, std::string_view insts_bytes,
+                            std::vector<Instruction> &insts,
+                            size_t max_insts) const override;
+
+  // Decode only the length, category, and direct control-flow targets of an
+  // instruction.
+  bool DecodeLengthAndCategory(uint64_t address, std::string_view inst_bytes,
+                               InstructionSummary &summary) const override;
+
   // Maximum number of bytes in an instruction.
   uint64_t MaxInstructionSize(void) const override;
 
+  // Fuse the `ADRP+ADD` and `ADRP+LDR` idioms used to materialize, or load
+  // from, the addresses of globals.
+  bool MayFuseWithNextInstruction(const Instruction &inst) const override;
+  bool FuseWithNextInstruction(Instruction &inst,
+                               const Instruction &next_inst) const override;
+
   llvm::Triple Triple(void) const override;
   llvm::DataLayout DataLayout(void) const override;
 
@@ -135,8 +150,15 @@ class AArch64Arch final : public Arch {
   void PopulateBasicBlockFunction(llvm::Module *module,
                                   llvm::Function *bb_func) const override;
 
+  // Size of the `State` structure, in bytes.
+  uint64_t StateStructSize(void) const override;
+
  private:
   AArch64Arch(void) = delete;
+
+  // Fill in the registers read and written by `inst`.
+  void AddRegisterSets(const aarch64::InstData &dinst,
+                       Instruction &inst) const;
 };
 
 AArch64Arch::AArch64Arch(llvm::LLVMContext *context_, OSName os_name_,
@@ -150,6 +172,11 @@ llvm::CallingConv::ID AArch64Arch::DefaultCallingConv(void) const {
   return llvm::CallingConv::C;
 }
 
+// Size of the `State` structure, in bytes.
+uint64_t AArch64Arch::StateStructSize(void) const {
+  return sizeof(AArch64State);
+}
+
 // Populate the `__remill_basic_block` function with variables.
 void AArch64Arch::PopulateBasicBlockFunction(llvm::Module *module,
                                              llvm::Function *bb_func) const {
@@ -458,6 +485,11 @@ void AArch64Arch::PopulateBasicBlockFunction(llvm::Module *module,
   REG(TPIDR_EL0, sr.tpidr_el0.qword, u64);
   REG(TPIDRRO_EL0, sr.tpidrro_el0.qword, u64);
 
+  REG(N, sr.n, u8);
+  REG(Z, sr.z, u8);
+  REG(C, sr.c, u8);
+  REG(V, sr.v, u8);
+
   const auto pc_arg = NthArgument(bb_func, kPCArgNum);
   const auto state_ptr_arg = NthArgument(bb_func, kStatePointerArgNum);
   llvm::StringRef next_pc_name(kNextPCVariableName.data(),
@@ -596,74 +628,101 @@ static Operand::ShiftRegister::Shift GetOperandShift(Shift s) {
   return Operand::ShiftRegister::kShiftInvalid;
 }
 
+#define REG_NAMES_0_TO_7(prefix) \
+  prefix "0", prefix "1", prefix "2", prefix "3", prefix "4", prefix "5", \
+      prefix "6", prefix "7"
+
+#define REG_NAMES_8_TO_15(prefix) \
+  prefix "8", prefix "9", prefix "10", prefix "11", prefix "12", prefix "13", \
+      prefix "14", prefix "15"
+
+#define REG_NAMES_16_TO_23(prefix) \
+  prefix "16", prefix "17", prefix "18", prefix "19", prefix "20", \
+      prefix "21", prefix "22", prefix "23"
+
+#define REG_NAMES_24_TO_31(prefix) \
+  prefix "24", prefix "25", prefix "26", prefix "27", prefix "28", \
+      prefix "29", prefix "30", prefix "31"
+
+#define REG_NAMES(prefix) \
+  { \
+    REG_NAMES_0_TO_7(prefix), REG_NAMES_8_TO_15(prefix), \
+        REG_NAMES_16_TO_23(prefix), REG_NAMES_24_TO_31(prefix) \
+  }
+
+// Register names, indexed by register number. These avoid formatting a new
+// name each time an operand is decoded. Number 31 of the `X` and `W` tables
+// isn't a real register, and is handled by `RegNameXW`.
+static const char *const kXRegNames[32] = REG_NAMES("X");
+static const char *const kWRegNames[32] = REG_NAMES("W");
+static const char *const kBRegNames[32] = REG_NAMES("B");
+static const char *const kHRegNames[32] = REG_NAMES("H");
+static const char *const kSRegNames[32] = REG_NAMES("S");
+static const char *const kDRegNames[32] = REG_NAMES("D");
+static const char *const kQRegNames[32] = REG_NAMES("Q");
+static const char *const kVRegNames[32] = REG_NAMES("V");
+
+#undef REG_NAMES
+#undef REG_NAMES_0_TO_7
+#undef REG_NAMES_8_TO_15
+#undef REG_NAMES_16_TO_23
+#undef REG_NAMES_24_TO_31
+
 // Get the name of an integer register.
-static std::string RegNameXW(Action action, RegClass rclass, RegUsage rtype,
+static const char *RegNameXW(Action action, RegClass rclass, RegUsage rtype,
                              aarch64::RegNum number_) {
   auto number = static_cast<uint8_t>(number_);
   CHECK_LE(number, 31U);
-
-  std::stringstream ss;
   CHECK(kActionReadWrite != action);
 
   if (31 == number) {
     if (rtype == kUseAsValue) {
       if (action == kActionWrite) {
-        ss << "IGNORE_WRITE_TO_XZR";
+        return "IGNORE_WRITE_TO_XZR";
       } else {
-        ss << (rclass == kRegX ? "XZR" : "WZR");
+        return rclass == kRegX ? "XZR" : "WZR";
       }
     } else {
       if (action == kActionWrite) {
-        ss << "SP";
+        return "SP";
       } else {
-        ss << (rclass == kRegX ? "SP" : "WSP");
+        return rclass == kRegX ? "SP" : "WSP";
       }
     }
+  } else if (action == kActionWrite || rclass == kRegX) {
+    return kXRegNames[number];
   } else {
-    if (action == kActionWrite) {
-      ss << "X";
-    } else {
-      ss << (rclass == kRegX ? "X" : "W");
-    }
-    ss << static_cast<unsigned>(number);
+    return kWRegNames[number];
   }
-  return ss.str();
 }
 
 // Get the name of a floating point register.
-static std::string RegNameFP(Action action, RegClass rclass, RegUsage rtype,
+static const char *RegNameFP(Action action, RegClass rclass, RegUsage rtype,
                              aarch64::RegNum number_) {
   auto number = static_cast<uint8_t>(number_);
   CHECK_LE(number, 31U);
-
-  std::stringstream ss;
   CHECK(kActionReadWrite != action);
 
   if (kActionRead == action) {
     if (kRegB == rclass) {
-      ss << "B";
+      return kBRegNames[number];
     } else if (kRegH == rclass) {
-      ss << "H";
+      return kHRegNames[number];
     } else if (kRegS == rclass) {
-      ss << "S";
+      return kSRegNames[number];
     } else if (kRegD == rclass) {
-      ss << "D";
+      return kDRegNames[number];
     } else if (kRegQ == rclass) {
-      ss << "Q";
+      return kQRegNames[number];
     } else {
       CHECK(kRegV == rclass);
-      ss << "V";
     }
-  } else {
-    ss << "V";
   }
 
-  ss << static_cast<unsigned>(number);
-
-  return ss.str();
+  return kVRegNames[number];
 }
 
-static std::string RegName(Action action, RegClass rclass, RegUsage rtype,
+static const char *RegName(Action action, RegClass rclass, RegUsage rtype,
                            aarch64::RegNum number) {
   switch (rclass) {
     case kRegX:
@@ -709,9 +768,8 @@ static uint64_t WriteRegSize(RegClass rclass) {
 // This gives us a register operand. If we have an operand like `<Xn|SP>`,
 // then the usage is `kTypeUsage`, otherwise (i.e. `<Xn>`), the usage is
 // a `kTypeValue`.
-static Operand::Register Reg(Action action, RegClass rclass, RegUsage rtype,
-                             aarch64::RegNum reg_num) {
-  Operand::Register reg;
+static void SetReg(Operand::Register &reg, Action action, RegClass rclass,
+                   RegUsage rtype, aarch64::RegNum reg_num) {
   if (kActionWrite == action) {
     reg.name = RegName(action, rclass, rtype, reg_num);
     reg.size = WriteRegSize(rclass);
@@ -721,26 +779,33 @@ static Operand::Register Reg(Action action, RegClass rclass, RegUsage rtype,
   } else {
     LOG(FATAL) << "Reg function only takes a simple read or write action.";
   }
+}
+
+static Operand::Register Reg(Action action, RegClass rclass, RegUsage rtype,
+                             aarch64::RegNum reg_num) {
+  Operand::Register reg;
+  SetReg(reg, action, rclass, rtype, reg_num);
   return reg;
 }
 
+// Register operands are by far the most common, so they're built in place
+// rather than copied into `inst.operands`.
 static void AddRegOperand(Instruction &inst, Action action, RegClass rclass,
                           RegUsage rtype, aarch64::RegNum reg_num) {
-  Operand op;
-  op.type = Operand::kTypeRegister;
-
   if (kActionWrite == action || kActionReadWrite == action) {
-    op.reg = Reg(kActionWrite, rclass, rtype, reg_num);
+    auto &op = inst.operands.emplace_back();
+    op.type = Operand::kTypeRegister;
+    SetReg(op.reg, kActionWrite, rclass, rtype, reg_num);
     op.size = op.reg.size;
     op.action = Operand::kActionWrite;
-    inst.operands.push_back(op);
   }
 
   if (kActionRead == action || kActionReadWrite == action) {
-    op.reg = Reg(kActionRead, rclass, rtype, reg_num);
+    auto &op = inst.operands.emplace_back();
+    op.type = Operand::kTypeRegister;
+    SetReg(op.reg, kActionRead, rclass, rtype, reg_num);
     op.size = op.reg.size;
     op.action = Operand::kActionRead;
-    inst.operands.push_back(op);
   }
 }
 
@@ -809,7 +874,10 @@ static void AddImmOperand(Instruction &inst, uint64_t val,
   inst.operands.push_back(op);
 }
 
-static void AddMonitorOperand(Instruction &inst) {
+// Adds the exclusive monitor of a load- or store-exclusive instruction: the
+// address last loaded by an exclusive load, and the (zero-extended) value
+// that it loaded.
+static void AddMonitorOperands(Instruction &inst) {
   Operand op;
   op.action = Operand::kActionWrite;
   op.reg.name = "MONITOR";
@@ -817,6 +885,9 @@ static void AddMonitorOperand(Instruction &inst) {
   op.size = 64;
   op.type = Operand::kTypeRegister;
   inst.operands.push_back(op);
+
+  op.reg.name = "MONITOR_VALUE";
+  inst.operands.push_back(op);
 }
 
 static void AddPCRegOp(Instruction &inst, Operand::Action action, int64_t disp,
@@ -1186,6 +1257,31 @@ std::string_view AArch64Arch::ProgramCounterRegisterName(void) const {
   return "PC";
 }
 
+// Decode several consecutive instructions, without making a virtual call to
+// `DecodeInstruction` for each one.
+size_t AArch64Arch::DecodeInstructions(uint64_t address,
+                                       std::string_view insts_bytes,
+                                       std::vector<Instruction> &insts,
+                                       size_t max_insts) const {
+
+  // Decoding stops at the first word that can't be an instruction, so find
+  // that word with a cheap pre-pass rather than by entering the extractor.
+  if (!(address % kInstructionSize)) {
+    const auto num_words =
+        std::min<size_t>(insts_bytes.size() / kInstructionSize, max_insts);
+    const auto num_decodable = aarch64::CountDecodableEncodings(
+        reinterpret_cast<const uint8_t *>(insts_bytes.data()), num_words);
+    insts_bytes = insts_bytes.substr(0, num_decodable * kInstructionSize);
+  }
+
+  return DecodeEachInstruction(
+      address, insts_bytes, insts, max_insts, MaxInstructionSize(),
+      [this](uint64_t inst_addr, std::string_view inst_bytes,
+             Instruction &inst) {
+        return AArch64Arch::DecodeInstruction(inst_addr, inst_bytes, inst);
+      });
+}
+
 bool AArch64Arch::DecodeInstruction(uint64_t address,
                                     std::string_view inst_bytes,
                                     Instruction &inst) const {
@@ -1201,10 +1297,14 @@ bool AArch64Arch::DecodeInstruction(uint64_t address,
 
   if (kInstructionSize != inst_bytes.size()) {
     inst.category = Instruction::kCategoryInvalid;
+    inst.decode_error = kInstructionSize > inst_bytes.size()
+                            ? DecodeError::kTruncated
+                            : DecodeError::kInvalidEncoding;
     return false;
 
   } else if (0 != (address % kInstructionSize)) {
     inst.category = Instruction::kCategoryInvalid;
+    inst.decode_error = DecodeError::kMisaligned;
     return false;
 
   } else if (!aarch64::TryExtract(bytes, dinst)) {
@@ -1251,6 +1351,190 @@ bool AArch64Arch::DecodeInstruction(uint64_t address,
     dst_ret_pc.reg.size = address_size;
   }
 
+  AddRegisterSets(dinst, inst);
+  return true;
+}
+
+// Decode only the length, category, and direct control-flow targets of an
+// instruction. This classifies the instruction by its encoding, and doesn't
+// decode its operands, and so it may accept some reserved encodings (e.g. of
+// unallocated register or immediate fields) that `DecodeInstruction` rejects.
+bool AArch64Arch::DecodeLengthAndCategory(uint64_t address,
+                                          std::string_view inst_bytes,
+                                          InstructionSummary &summary) const {
+  aarch64::InstData dinst = {};
+  auto bytes = reinterpret_cast<const uint8_t *>(inst_bytes.data());
+
+  summary = {};
+  summary.pc = address;
+  summary.next_pc = address + kInstructionSize;
+
+  if (kInstructionSize != inst_bytes.size()) {
+    summary.decode_error = kInstructionSize > inst_bytes.size()
+                               ? DecodeError::kTruncated
+                               : DecodeError::kInvalidEncoding;
+    return false;
+
+  } else if (0 != (address % kInstructionSize)) {
+    summary.decode_error = DecodeError::kMisaligned;
+    return false;
+
+  } else if (!aarch64::TryExtract(bytes, dinst)) {
+    summary.decode_error = DecodeError::kInvalidEncoding;
+    return false;
+  }
+
+  summary.category = InstCategory(dinst);
+
+  int64_t disp = 0;
+  switch (dinst.iclass) {
+    case aarch64::InstName::B:
+      if (aarch64::InstForm::B_ONLY_CONDBRANCH == dinst.iform) {
+        disp = dinst.imm19.simm19 << 2;
+      } else {
+        disp = dinst.imm26.simm26 << 2LL;
+      }
+      break;
+    case aarch64::InstName::BL: disp = dinst.imm26.simm26 << 2LL; break;
+    case aarch64::InstName::CBZ:
+    case aarch64::InstName::CBNZ: disp = dinst.imm19.simm19 << 2; break;
+    case aarch64::InstName::TBZ:
+    case aarch64::InstName::TBNZ: disp = dinst.imm14.simm14 << 2; break;
+    default: return true;
+  }
+
+  summary.branch_taken_pc =
+      static_cast<uint64_t>(static_cast<int64_t>(address) + disp);
+  if (Instruction::kCategoryDirectJump != summary.category) {
+    summary.branch_not_taken_pc = summary.next_pc;
+  }
+  return true;
+}
+
+// Fill in the registers read and written by `inst`. The condition flags are
+// never operands, so they are added based on the instruction class.
+void AArch64Arch::AddRegisterSets(const aarch64::InstData &dinst,
+                                  Instruction &inst) const {
+  AddOperandRegisters(inst);
+
+  auto reads_flags = false;
+  auto writes_flags = false;
+  switch (dinst.iclass) {
+    case aarch64::InstName::ADC:
+    case aarch64::InstName::SBC:
+      AddRegistersByName(inst.regs_read, {"C"});
+      break;
+    case aarch64::InstName::ADCS:
+    case aarch64::InstName::SBCS:
+      AddRegistersByName(inst.regs_read, {"C"});
+      writes_flags = true;
+      break;
+    case aarch64::InstName::ADDS:
+    case aarch64::InstName::SUBS:
+    case aarch64::InstName::ANDS:
+    case aarch64::InstName::BICS:
+    case aarch64::InstName::FCMP:
+    case aarch64::InstName::FCMPE: writes_flags = true; break;
+    case aarch64::InstName::CCMP:
+    case aarch64::InstName::CCMN:
+    case aarch64::InstName::FCCMP:
+    case aarch64::InstName::FCCMPE:
+      reads_flags = true;
+      writes_flags = true;
+      break;
+    case aarch64::InstName::CSEL:
+    case aarch64::InstName::CSINC:
+    case aarch64::InstName::CSINV:
+    case aarch64::InstName::CSNEG:
+    case aarch64::InstName::FCSEL: reads_flags = true; break;
+    case aarch64::InstName::B:
+      reads_flags = aarch64::InstForm::B_ONLY_CONDBRANCH == dinst.iform;
+      break;
+
+    // Conservatively assume that system register accesses touch `NZCV`.
+    case aarch64::InstName::MRS: reads_flags = true; break;
+    case aarch64::InstName::MSR: writes_flags = true; break;
+    default: break;
+  }
+
+  if (reads_flags) {
+    AddRegistersByName(inst.regs_read, {"N", "Z", "C", "V"});
+  }
+  if (writes_flags) {
+    AddRegistersByName(inst.regs_written, {"N", "Z", "C", "V"});
+  }
+}
+
+bool AArch64Arch::MayFuseWithNextInstruction(const Instruction &inst) const {
+  return inst.function == "ADRP_ONLY_PCRELADDR";
+}
+
+// Fuses an `ADRP` with a following `ADD` or `LDR` that overwrites the register
+// written by the `ADRP`, e.g.
+//
+//    adrp  x0, sym
+//    add   x0, x0, :lo12:sym
+//
+// into a single PC-relative `ADR` or `LDR` (literal), with a displacement
+// that accounts for the page alignment of the `ADRP`. Idioms that leave the
+// page address live in a register aren't fused.
+bool AArch64Arch::FuseWithNextInstruction(Instruction &inst,
+                                          const Instruction &next_inst) const {
+  if (inst.function != "ADRP_ONLY_PCRELADDR" || next_inst.pc != inst.next_pc ||
+      inst.operands.size() != 2 || next_inst.operands.size() != 2) {
+    return false;
+  }
+
+  const auto &page_reg = inst.operands[0].reg.name;
+  const auto page = static_cast<int64_t>(inst.pc & ~4095ULL) +
+                    inst.operands[1].addr.displacement;
+  const auto pc = static_cast<int64_t>(inst.pc);
+
+  const auto &dst = next_inst.operands[0];
+  const auto &src = next_inst.operands[1];
+  if (dst.type != Operand::kTypeRegister || page_reg == "XZR") {
+    return false;
+  }
+
+  // `ADD <Xd>, <Xd>, #<imm>` becomes `ADR <Xd>, <page + imm>`.
+  if (next_inst.function == "ADD_64_ADDSUB_IMM") {
+    if (next_inst.operands.size() != 3 || dst.reg.name != page_reg ||
+        src.reg.name != page_reg) {
+      return false;
+    }
+    const auto imm = static_cast<int64_t>(next_inst.operands[2].imm.val);
+    inst.operands.pop_back();
+    AddPCDisp(inst, page + imm - pc);
+    inst.function = "ADRP_ADD_64_FUSED";
+
+  // `LDR <Xt>, [<Xt>, #<pimm>]` or `LDR <Wt>, [<Xt>, #<pimm>]` becomes a
+  // literal load from `page + pimm`.
+  } else if (next_inst.function == "LDR_64_LDST_POS" ||
+             next_inst.function == "LDR_32_LDST_POS") {
+    if (src.type != Operand::kTypeAddress ||
+        src.addr.base_reg.name != page_reg ||
+        dst.reg.name.substr(1) != page_reg.substr(1)) {
+      return false;
+    }
+    auto mem = src;
+    mem.addr.base_reg = Operand::Register();
+    mem.addr.base_reg.name = "PC";
+    mem.addr.base_reg.size = 64;
+    mem.addr.displacement = page + src.addr.displacement - pc;
+    inst.operands.clear();
+    inst.operands.push_back(dst);
+    inst.operands.push_back(mem);
+    inst.function = next_inst.function == "LDR_64_LDST_POS"
+                        ? "ADRP_LDR_64_FUSED"
+                        : "ADRP_LDR_32_FUSED";
+
+  } else {
+    return false;
+  }
+
+  AddOperandRegisters(inst);
+  inst.bytes.append(next_inst.bytes);
+  inst.next_pc = next_inst.next_pc;
   return true;
 }
 
@@ -2134,9 +2418,8 @@ static void SetConditionalFunctionName(const InstData &data, Instruction &inst,
     cond = data.cond;
   }
 
-  std::stringstream ss;
-  ss << inst.function << "_" << CondName(cond);
-  inst.function = ss.str();
+  inst.function += '_';
+  inst.function += CondName(cond);
 }
 
 // B.<cond>  <label>
@@ -3551,14 +3834,12 @@ static_assert(sizeof(SystemReg) == sizeof(uint64_t),
               "Invalid packing of `union SystemReg`.");
 
 static bool AppendSysRegName(Instruction &inst, SystemReg bits) {
-  std::stringstream ss;
-  ss << inst.function << "_";
-
+  const char *name = nullptr;
   switch (bits.name) {
-    case SystemReg::kFPCR: ss << "FPCR"; break;
-    case SystemReg::kFPSR: ss << "FPSR"; break;
-    case SystemReg::kTPIDR_EL0: ss << "TPIDR_EL0"; break;
-    case SystemReg::kTPIDRRO_EL0: ss << "TPIDRRO_EL0"; break;
+    case SystemReg::kFPCR: name = "_FPCR"; break;
+    case SystemReg::kFPSR: name = "_FPSR"; break;
+    case SystemReg::kTPIDR_EL0: name = "_TPIDR_EL0"; break;
+    case SystemReg::kTPIDRRO_EL0: name = "_TPIDRRO_EL0"; break;
     default:
       LOG(ERROR) << "Unrecognized system register " << std::hex << bits.flat
                  << " with op0=" << bits.op0 << ", op1=" << bits.op1
@@ -3567,7 +3848,7 @@ static bool AppendSysRegName(Instruction &inst, SystemReg bits) {
       return false;
   }
 
-  inst.function = ss.str();
+  inst.function += name;
   return true;
 }
 
@@ -4073,9 +4354,7 @@ bool TryDecodeCCMN_64_CONDCMP_IMM(const InstData &data, Instruction &inst) {
 
 // ORR  <Vd>.<T>, <Vn>.<T>, <Vm>.<T>
 bool TryDecodeORR_ASIMDSAME_ONLY(const InstData &data, Instruction &inst) {
-  std::stringstream ss;
-  ss << inst.function << "_" << (data.Q ? "16B" : "8B");
-  inst.function = ss.str();
+  inst.function += (data.Q ? "_16B" : "_8B");
   AddRegOperand(inst, kActionWrite, kRegV, kUseAsValue, data.Rd);
   AddRegOperand(inst, kActionRead, kRegV, kUseAsValue, data.Rn);
   AddRegOperand(inst, kActionRead, kRegV, kUseAsValue, data.Rm);
@@ -4167,9 +4446,8 @@ bool TryDecodeREV64_ASIMDMISC_R(const InstData &, Instruction &) {
 
 static void AddQArrangementSpecifier(const InstData &data, Instruction &inst,
                                      const char *if_Q, const char *if_not_Q) {
-  std::stringstream ss;
-  ss << inst.function << "_" << (data.Q ? if_Q : if_not_Q);
-  inst.function = ss.str();
+  inst.function += '_';
+  inst.function += (data.Q ? if_Q : if_not_Q);
 }
 
 static const char *ArrangementSpecifier(uint64_t total_size,
@@ -4199,10 +4477,8 @@ static const char *ArrangementSpecifier(uint64_t total_size,
 
 static void AddArrangementSpecifier(Instruction &inst, uint64_t total_size,
                                     uint64_t element_size) {
-  std::stringstream ss;
-  ss << inst.function;
-  ss << "_" << ArrangementSpecifier(total_size, element_size);
-  inst.function = ss.str();
+  inst.function += '_';
+  inst.function += ArrangementSpecifier(total_size, element_size);
 }
 
 // DUP  <Vd>.<T>, <R><n>
@@ -4222,6 +4498,23 @@ bool TryDecodeDUP_ASIMDINS_DR_R(const InstData &data, Instruction &inst) {
   return true;
 }
 
+// DUP  <Vd>.<T>, <Vn>.<Ts>[<index>]
+bool TryDecodeDUP_ASIMDINS_DV_V(const InstData &data, Instruction &inst) {
+  uint64_t size = 0;
+  if (!LeastSignificantSetBit(data.imm5.uimm, &size) || size > 3) {
+    return false;  // `if size > 3 then UnallocatedEncoding();`
+  } else if (size == 3 && !data.Q) {
+    return false;  // `if size == 3 && Q == '0' then ReservedValue();`
+  }
+
+  AddArrangementSpecifier(inst, data.Q ? 128 : 64, 8UL << size);
+  AddRegOperand(inst, kActionWrite, data.Q ? kRegQ : kRegD, kUseAsValue,
+                data.Rd);
+  AddRegOperand(inst, kActionRead, kRegV, kUseAsValue, data.Rn);
+  AddImmOperand(inst, data.imm5.uimm >> (size + 1));
+  return true;
+}
+
 // ADD  <Vd>.<T>, <Vn>.<T>, <Vm>.<T>
 bool TryDecodeADD_ASIMDSAME_ONLY(const InstData &data, Instruction &inst) {
   if (0x3 == data.size && !data.Q) {
@@ -4236,6 +4529,14 @@ bool TryDecodeSUB_ASIMDSAME_ONLY(const InstData &data, Instruction &inst) {
   return TryDecodeADD_ASIMDSAME_ONLY(data, inst);
 }
 
+// MUL  <Vd>.<T>, <Vn>.<T>, <Vm>.<T>
+bool TryDecodeMUL_ASIMDSAME_ONLY(const InstData &data, Instruction &inst) {
+  if (0x3 == data.size) {
+    return false;  // `if size == '11' then ReservedValue();`.
+  }
+  return TryDecodeADD_ASIMDSAME_ONLY(data, inst);
+}
+
 static bool TryDecodeLDnSTnOpcode(uint8_t opcode, uint64_t *rpt,
                                   uint64_t *selem) {
   switch (opcode) {
@@ -4282,6 +4583,41 @@ bool TryDecodeEXT_ASIMDEXT_ONLY(const InstData &data, Instruction &inst) {
   return true;
 }
 
+// TBL  <Vd>.<Ta>, { <Vn>.16B, ... }, <Vm>.<Ta>
+static bool TryDecodeTBL(const InstData &data, Instruction &inst) {
+  AddQArrangementSpecifier(data, inst, "16B", "8B");
+  AddRegOperand(inst, kActionWrite, data.Q ? kRegQ : kRegD, kUseAsValue,
+                data.Rd);
+  auto n = static_cast<uint8_t>(data.Rn);
+  for (uint8_t i = 0; i <= data.len; ++i) {
+    auto nn = static_cast<aarch64::RegNum>((n + i) % 32);
+    AddRegOperand(inst, kActionRead, kRegV, kUseAsValue, nn);
+  }
+  AddRegOperand(inst, kActionRead, data.Q ? kRegQ : kRegD, kUseAsValue,
+                data.Rm);
+  return true;
+}
+
+// TBL  <Vd>.<Ta>, { <Vn>.16B }, <Vm>.<Ta>
+bool TryDecodeTBL_ASIMDTBL_L1_1(const InstData &data, Instruction &inst) {
+  return TryDecodeTBL(data, inst);
+}
+
+// TBL  <Vd>.<Ta>, { <Vn>.16B, <Vn+1>.16B }, <Vm>.<Ta>
+bool TryDecodeTBL_ASIMDTBL_L2_2(const InstData &data, Instruction &inst) {
+  return TryDecodeTBL(data, inst);
+}
+
+// TBL  <Vd>.<Ta>, { <Vn>.16B, <Vn+1>.16B, <Vn+2>.16B }, <Vm>.<Ta>
+bool TryDecodeTBL_ASIMDTBL_L3_3(const InstData &data, Instruction &inst) {
+  return TryDecodeTBL(data, inst);
+}
+
+// TBL  <Vd>.<Ta>, { <Vn>.16B, <Vn+1>.16B, <Vn+2>.16B, <Vn+3>.16B }, <Vm>.<Ta>
+bool TryDecodeTBL_ASIMDTBL_L4_4(const InstData &data, Instruction &inst) {
+  return TryDecodeTBL(data, inst);
+}
+
 // Load/store one or more data structures.
 bool TryDecodeLDnSTn(const InstData &data, Instruction &inst,
                      uint64_t *total_num_bytes) {
@@ -4472,16 +4808,13 @@ bool TryDecodeUMOV_ASIMDINS_W_W(const InstData &data, Instruction &inst) {
   } else if (data.Q && size < 3) {
     return false;
   }
-  std::stringstream ss;
-  ss << inst.function;
   switch (size) {
-    case 0: ss << "_B"; break;
-    case 1: ss << "_H"; break;
-    case 2: ss << "_S"; break;
-    case 3: ss << "_D"; break;
+    case 0: inst.function += "_B"; break;
+    case 1: inst.function += "_H"; break;
+    case 2: inst.function += "_S"; break;
+    case 3: inst.function += "_D"; break;
     default: return false;
   }
-  inst.function = ss.str();
   AddRegOperand(inst, kActionWrite, data.Q ? kRegX : kRegW, kUseAsValue,
                 data.Rd);
   AddRegOperand(inst, kActionRead, kRegV, kUseAsValue, data.Rn);
@@ -4502,15 +4835,12 @@ bool TryDecodeSMOV_ASIMDINS_W_W(const InstData &data, Instruction &inst) {
   } else if (size == 2 && !data.Q) {
     return false;
   }
-  std::stringstream ss;
-  ss << inst.function;
   switch (size) {
-    case 0: ss << "_B"; break;
-    case 1: ss << "_H"; break;
-    case 2: ss << "_S"; break;
+    case 0: inst.function += "_B"; break;
+    case 1: inst.function += "_H"; break;
+    case 2: inst.function += "_S"; break;
     default: return false;
   }
-  inst.function = ss.str();
   AddRegOperand(inst, kActionWrite, data.Q ? kRegX : kRegW, kUseAsValue,
                 data.Rd);
   AddRegOperand(inst, kActionRead, kRegV, kUseAsValue, data.Rn);
@@ -4720,16 +5050,13 @@ bool TryDecodeINS_ASIMDINS_IR_R(const InstData &data, Instruction &inst) {
   if (!LeastSignificantSetBit(data.imm5.uimm, &size) || size > 3) {
     return false;
   }
-  std::stringstream ss;
-  ss << inst.function;
   switch (size) {
-    case 0: ss << "_B"; break;
-    case 1: ss << "_H"; break;
-    case 2: ss << "_S"; break;
-    case 3: ss << "_D"; break;
+    case 0: inst.function += "_B"; break;
+    case 1: inst.function += "_H"; break;
+    case 2: inst.function += "_S"; break;
+    case 3: inst.function += "_D"; break;
     default: return false;
   }
-  inst.function = ss.str();
 
   AddRegOperand(inst, kActionWrite, kRegV, kUseAsValue, data.Rd);
   AddImmOperand(inst, data.imm5.uimm >> (size + 1));
@@ -4830,7 +5157,7 @@ bool TryDecodeLDXR_LR32_LDSTEXCL(const InstData &data, Instruction &inst) {
   inst.is_atomic_read_modify_write = true;
   AddRegOperand(inst, kActionWrite, kRegW, kUseAsValue, data.Rt);
   AddBasePlusOffsetMemOp(inst, kActionRead, 32, data.Rn, 0);
-  AddMonitorOperand(inst);
+  AddMonitorOperands(inst);
   return true;
 }
 
@@ -4839,7 +5166,7 @@ bool TryDecodeLDXR_LR64_LDSTEXCL(const InstData &data, Instruction &inst) {
   inst.is_atomic_read_modify_write = true;
   AddRegOperand(inst, kActionWrite, kRegX, kUseAsValue, data.Rt);
   AddBasePlusOffsetMemOp(inst, kActionRead, 64, data.Rn, 0);
-  AddMonitorOperand(inst);
+  AddMonitorOperands(inst);
   return true;
 }
 
@@ -4849,7 +5176,7 @@ bool TryDecodeSTLXR_SR32_LDSTEXCL(const InstData &data, Instruction &inst) {
   AddRegOperand(inst, kActionWrite, kRegW, kUseAsValue, data.Rs);
   AddRegOperand(inst, kActionRead, kRegW, kUseAsValue, data.Rt);
   AddBasePlusOffsetMemOp(inst, kActionWrite, 32, data.Rn, 0);
-  AddMonitorOperand(inst);
+  AddMonitorOperands(inst);
   return true;
 }
 
@@ -4859,10 +5186,20 @@ bool TryDecodeSTLXR_SR64_LDSTEXCL(const InstData &data, Instruction &inst) {
   AddRegOperand(inst, kActionWrite, kRegW, kUseAsValue, data.Rs);
   AddRegOperand(inst, kActionRead, kRegX, kUseAsValue, data.Rt);
   AddBasePlusOffsetMemOp(inst, kActionWrite, 64, data.Rn, 0);
-  AddMonitorOperand(inst);
+  AddMonitorOperands(inst);
   return true;
 }
 
+// STXR  <Ws>, <Wt>, [<Xn|SP>{,#0}]
+bool TryDecodeSTXR_SR32_LDSTEXCL(const InstData &data, Instruction &inst) {
+  return TryDecodeSTLXR_SR32_LDSTEXCL(data, inst);
+}
+
+// STXR  <Ws>, <Xt>, [<Xn|SP>{,#0}]
+bool TryDecodeSTXR_SR64_LDSTEXCL(const InstData &data, Instruction &inst) {
+  return TryDecodeSTLXR_SR64_LDSTEXCL(data, inst);
+}
+
 static uint64_t ConcatABCDEFGHToU8(const InstData &data) {
   uint64_t imm = data.a;
   imm = (imm << 1) | data.b;
@@ -0,0 +1,143 @@
+/*
+ * Copyright (c) 2020 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+
+#if defined(__SSSE3__)
+#  include <tmmintrin.h>
+#elif defined(__aarch64__)
+#  include <arm_neon.h>
+#endif
+
+#define REMILL_AARCH_STRICT_REGNUM
+
+#include "Decode.h"
+
+namespace remill {
+namespace aarch64 {
+namespace {
+
+// Encoding group of each value of `op0`, i.e. bits 28:25 of an instruction.
+static constexpr EncodingGroup kGroupByOp0[16] = {
+    EncodingGroup::kUnallocated,  // 0000
+    EncodingGroup::kUnallocated,  // 0001
+    EncodingGroup::kSVE,  // 0010
+    EncodingGroup::kUnallocated,  // 0011
+    EncodingGroup::kLoadStore,  // 0100
+    EncodingGroup::kDataProcessingRegister,  // 0101
+    EncodingGroup::kLoadStore,  // 0110
+    EncodingGroup::kDataProcessingSIMDFP,  // 0111
+    EncodingGroup::kDataProcessingImmediate,  // 1000
+    EncodingGroup::kDataProcessingImmediate,  // 1001
+    EncodingGroup::kBranchExceptionSystem,  // 1010
+    EncodingGroup::kBranchExceptionSystem,  // 1011
+    EncodingGroup::kLoadStore,  // 1100
+    EncodingGroup::kDataProcessingRegister,  // 1101
+    EncodingGroup::kLoadStore,  // 1110
+    EncodingGroup::kDataProcessingSIMDFP,  // 1111
+};
+
+// Words are classified in blocks of this many words.
+static constexpr size_t kBlockSize = 64;
+
+// Bits 28:25 of a little-endian instruction word are bits 4:1 of its last
+// byte.
+static inline uint8_t Op0(const uint8_t *bytes) {
+  return static_cast<uint8_t>((bytes[3] >> 1u) & 0xFu);
+}
+
+static inline bool IsDecodable(EncodingGroup group) {
+  return group != EncodingGroup::kUnallocated && group != EncodingGroup::kSVE;
+}
+
+}  // namespace
+
+// Classify `num_words` consecutive little-endian instruction words. Sixteen
+// words at a time, the last byte of each word is gathered into a vector, and
+// `op0` is used as an index into `kGroupByOp0` with a byte shuffle.
+void ClassifyEncodings(const uint8_t *bytes, size_t num_words,
+                       EncodingGroup *groups) {
+  size_t i = 0;
+
+#if defined(__SSSE3__)
+  const auto table =
+      _mm_loadu_si128(reinterpret_cast<const __m128i *>(kGroupByOp0));
+  const auto low_nibble = _mm_set1_epi8(0xF);
+  const auto last_bytes = _mm_setr_epi8(3, 7, 11, 15, -1, -1, -1, -1, -1, -1,
+                                        -1, -1, -1, -1, -1, -1);
+  for (; i + 16u <= num_words; i += 16u) {
+    auto words = reinterpret_cast<const __m128i *>(&(bytes[i * 4u]));
+    auto b0 = _mm_shuffle_epi8(_mm_loadu_si128(&(words[0])), last_bytes);
+    auto b1 = _mm_shuffle_epi8(_mm_loadu_si128(&(words[1])), last_bytes);
+    auto b2 = _mm_shuffle_epi8(_mm_loadu_si128(&(words[2])), last_bytes);
+    auto b3 = _mm_shuffle_epi8(_mm_loadu_si128(&(words[3])), last_bytes);
+    auto last = _mm_or_si128(
+        _mm_or_si128(b0, _mm_slli_si128(b1, 4)),
+        _mm_or_si128(_mm_slli_si128(b2, 8), _mm_slli_si128(b3, 12)));
+    auto op0 = _mm_and_si128(_mm_srli_epi16(last, 1), low_nibble);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(&(groups[i])),
+                     _mm_shuffle_epi8(table, op0));
+  }
+
+#elif defined(__aarch64__)
+  const auto table = vld1q_u8(reinterpret_cast<const uint8_t *>(kGroupByOp0));
+  for (; i + 16u <= num_words; i += 16u) {
+    auto words = vld4q_u8(&(bytes[i * 4u]));
+    auto op0 = vandq_u8(vshrq_n_u8(words.val[3], 1), vdupq_n_u8(0xF));
+    vst1q_u8(reinterpret_cast<uint8_t *>(&(groups[i])),
+             vqtbl1q_u8(table, op0));
+  }
+#endif
+
+  for (; i < num_words; ++i) {
+    groups[i] = kGroupByOp0[Op0(&(bytes[i * 4u]))];
+  }
+}
+
+// Returns the number of leading words that may be decodable instructions.
+size_t CountDecodableEncodings(const uint8_t *bytes, size_t num_words) {
+  EncodingGroup groups[kBlockSize];
+  for (size_t base = 0; base < num_words; base += kBlockSize) {
+    const auto block_size = std::min(kBlockSize, num_words - base);
+    ClassifyEncodings(&(bytes[base * 4u]), block_size, groups);
+    for (size_t i = 0; i < block_size; ++i) {
+      if (!IsDecodable(groups[i])) {
+        return base + i;
+      }
+    }
+  }
+  return num_words;
+}
+
+// Find the words in the branch, exception, and system encoding group.
+size_t FindBranchExceptionSystemEncodings(const uint8_t *bytes,
+                                          size_t num_words,
+                                          uint32_t *indices) {
+  EncodingGroup groups[kBlockSize];
+  size_t num_found = 0;
+  for (size_t base = 0; base < num_words; base += kBlockSize) {
+    const auto block_size = std::min(kBlockSize, num_words - base);
+    ClassifyEncodings(&(bytes[base * 4u]), block_size, groups);
+    for (size_t i = 0; i < block_size; ++i) {
+      indices[num_found] = static_cast<uint32_t>(base + i);
+      num_found += groups[i] == EncodingGroup::kBranchExceptionSystem;
+    }
+  }
+  return num_found;
+}
+
+}  // namespace aarch64
+}  // namespace remill
@@ -4898,82 +4898,6 @@ bool TryDecodeAESE_B_CRYPTOAES(const InstData &, Instruction &) {
   return false;
 }
 
-// STXR STXR_SR32_ldstexcl:
-//   0 x Rt       0
-//   1 x Rt       1
-//   2 x Rt       2
-//   3 x Rt       3
-//   4 x Rt       4
-//   5 x Rn       0
-//   6 x Rn       1
-//   7 x Rn       2
-//   8 x Rn       3
-//   9 x Rn       4
-//  10 1 Rt2      0
-//  11 1 Rt2      1
-//  12 1 Rt2      2
-//  13 1 Rt2      3
-//  14 1 Rt2      4
-//  15 0 o0       0
-//  16 x Rs       0
-//  17 x Rs       1
-//  18 x Rs       2
-//  19 x Rs       3
-//  20 x Rs       4
-//  21 0 o1       0
-//  22 0 L        0
-//  23 0 o2       0
-//  24 0
-//  25 0
-//  26 0
-//  27 1
-//  28 0
-//  29 0
-//  30 0 size     0
-//  31 1 size     1
-// STXR  <Ws>, <Wt>, [<Xn|SP>{,#0}]
-bool TryDecodeSTXR_SR32_LDSTEXCL(const InstData &, Instruction &) {
-  return false;
-}
-
-// STXR STXR_SR64_ldstexcl:
-//   0 x Rt       0
-//   1 x Rt       1
-//   2 x Rt       2
-//   3 x Rt       3
-//   4 x Rt       4
-//   5 x Rn       0
-//   6 x Rn       1
-//   7 x Rn       2
-//   8 x Rn       3
-//   9 x Rn       4
-//  10 1 Rt2      0
-//  11 1 Rt2      1
-//  12 1 Rt2      2
-//  13 1 Rt2      3
-//  14 1 Rt2      4
-//  15 0 o0       0
-//  16 x Rs       0
-//  17 x Rs       1
-//  18 x Rs       2
-//  19 x Rs       3
-//  20 x Rs       4
-//  21 0 o1       0
-//  22 0 L        0
-//  23 0 o2       0
-//  24 0
-//  25 0
-//  26 0
-//  27 1
-//  28 0
-//  29 0
-//  30 1 size     0
-//  31 1 size     1
-// STXR  <Ws>, <Xt>, [<Xn|SP>{,#0}]
-bool TryDecodeSTXR_SR64_LDSTEXCL(const InstData &, Instruction &) {
-  return false;
-}
-
 // CMLT CMLT_asisdmisc_Z:
 //   0 x Rd       0
 //   1 x Rd       1
@@ -16072,158 +15996,6 @@ bool TryDecodeSHA1P_QSV_CRYPTOSHA3(const InstData &, Instruction &) {
   return false;
 }
 
-// TBL TBL_asimdtbl_L2_2:
-//   0 x Rd       0
-//   1 x Rd       1
-//   2 x Rd       2
-//   3 x Rd       3
-//   4 x Rd       4
-//   5 x Rn       0
-//   6 x Rn       1
-//   7 x Rn       2
-//   8 x Rn       3
-//   9 x Rn       4
-//  10 0
-//  11 0
-//  12 0 op       0
-//  13 1 len      0
-//  14 0 len      1
-//  15 0
-//  16 x Rm       0
-//  17 x Rm       1
-//  18 x Rm       2
-//  19 x Rm       3
-//  20 x Rm       4
-//  21 0
-//  22 0 op2      0
-//  23 0 op2      1
-//  24 0
-//  25 1
-//  26 1
-//  27 1
-//  28 0
-//  29 0
-//  30 x Q        0
-//  31 0
-// TBL  <Vd>.<Ta>, { <Vn>.16B, <Vn+1>.16B }, <Vm>.<Ta>
-bool TryDecodeTBL_ASIMDTBL_L2_2(const InstData &, Instruction &) {
-  return false;
-}
-
-// TBL TBL_asimdtbl_L3_3:
-//   0 x Rd       0
-//   1 x Rd       1
-//   2 x Rd       2
-//   3 x Rd       3
-//   4 x Rd       4
-//   5 x Rn       0
-//   6 x Rn       1
-//   7 x Rn       2
-//   8 x Rn       3
-//   9 x Rn       4
-//  10 0
-//  11 0
-//  12 0 op       0
-//  13 0 len      0
-//  14 1 len      1
-//  15 0
-//  16 x Rm       0
-//  17 x Rm       1
-//  18 x Rm       2
-//  19 x Rm       3
-//  20 x Rm       4
-//  21 0
-//  22 0 op2      0
-//  23 0 op2      1
-//  24 0
-//  25 1
-//  26 1
-//  27 1
-//  28 0
-//  29 0
-//  30 x Q        0
-//  31 0
-// TBL  <Vd>.<Ta>, { <Vn>.16B, <Vn+1>.16B, <Vn+2>.16B }, <Vm>.<Ta>
-bool TryDecodeTBL_ASIMDTBL_L3_3(const InstData &, Instruction &) {
-  return false;
-}
-
-// TBL TBL_asimdtbl_L4_4:
-//   0 x Rd       0
-//   1 x Rd       1
-//   2 x Rd       2
-//   3 x Rd       3
-//   4 x Rd       4
-//   5 x Rn       0
-//   6 x Rn       1
-//   7 x Rn       2
-//   8 x Rn       3
-//   9 x Rn       4
-//  10 0
-//  11 0
-//  12 0 op       0
-//  13 1 len      0
-//  14 1 len      1
-//  15 0
-//  16 x Rm       0
-//  17 x Rm       1
-//  18 x Rm       2
-//  19 x Rm       3
-//  20 x Rm       4
-//  21 0
-//  22 0 op2      0
-//  23 0 op2      1
-//  24 0
-//  25 1
-//  26 1
-//  27 1
-//  28 0
-//  29 0
-//  30 x Q        0
-//  31 0
-// TBL  <Vd>.<Ta>, { <Vn>.16B, <Vn+1>.16B, <Vn+2>.16B, <Vn+3>.16B }, <Vm>.<Ta>
-bool TryDecodeTBL_ASIMDTBL_L4_4(const InstData &, Instruction &) {
-  return false;
-}
-
-// TBL TBL_asimdtbl_L1_1:
-//   0 x Rd       0
-//   1 x Rd       1
-//   2 x Rd       2
-//   3 x Rd       3
-//   4 x Rd       4
-//   5 x Rn       0
-//   6 x Rn       1
-//   7 x Rn       2
-//   8 x Rn       3
-//   9 x Rn       4
-//  10 0
-//  11 0
-//  12 0 op       0
-//  13 0 len      0
-//  14 0 len      1
-//  15 0
-//  16 x Rm       0
-//  17 x Rm       1
-//  18 x Rm       2
-//  19 x Rm       3
-//  20 x Rm       4
-//  21 0
-//  22 0 op2      0
-//  23 0 op2      1
-//  24 0
-//  25 1
-//  26 1
-//  27 1
-//  28 0
-//  29 0
-//  30 x Q        0
-//  31 0
-// TBL  <Vd>.<Ta>, { <Vn>.16B }, <Vm>.<Ta>
-bool TryDecodeTBL_ASIMDTBL_L1_1(const InstData &, Instruction &) {
-  return false;
-}
-
 // FMAXNMP FMAXNMP_asisdpair_only_H:
 //   0 x Rd       0
 //   1 x Rd       1
@@ -21164,44 +20936,6 @@ bool TryDecodeDUP_ASISDONE_ONLY(const InstData &, Instruction &) {
   return false;
 }
 
-// DUP DUP_asimdins_DV_v:
-//   0 x Rd       0
-//   1 x Rd       1
-//   2 x Rd       2
-//   3 x Rd       3
-//   4 x Rd       4
-//   5 x Rn       0
-//   6 x Rn       1
-//   7 x Rn       2
-//   8 x Rn       3
-//   9 x Rn       4
-//  10 1
-//  11 0 imm4     0
-//  12 0 imm4     1
-//  13 0 imm4     2
-//  14 0 imm4     3
-//  15 0
-//  16 x imm5     0
-//  17 x imm5     1
-//  18 x imm5     2
-//  19 x imm5     3
-//  20 x imm5     4
-//  21 0
-//  22 0
-//  23 0
-//  24 0
-//  25 1
-//  26 1
-//  27 1
-//  28 0
-//  29 0 op       0
-//  30 x Q        0
-//  31 0
-// DUP  <Vd>.<T>, <Vn>.<Ts>[<index>]
-bool TryDecodeDUP_ASIMDINS_DV_V(const InstData &, Instruction &) {
-  return false;
-}
-
 // STLRH STLRH_SL32_ldstexcl:
 //   0 x Rt       0
 //   1 x Rt       1
@@ -41305,44 +41039,6 @@ bool TryDecodeFCVTNU_64D_FLOAT2INT(const InstData &, Instruction &) {
   return false;
 }
 
-// MUL MUL_asimdsame_only:
-//   0 x Rd       0
-//   1 x Rd       1
-//   2 x Rd       2
-//   3 x Rd       3
-//   4 x Rd       4
-//   5 x Rn       0
-//   6 x Rn       1
-//   7 x Rn       2
-//   8 x Rn       3
-//   9 x Rn       4
-//  10 1
-//  11 1 opcode   0
-//  12 1 opcode   1
-//  13 0 opcode   2
-//  14 0 opcode   3
-//  15 1 opcode   4
-//  16 x Rm       0
-//  17 x Rm       1
-//  18 x Rm       2
-//  19 x Rm       3
-//  20 x Rm       4
-//  21 1
-//  22 x size     0
-//  23 x size     1
-//  24 0
-//  25 1
-//  26 1
-//  27 1
-//  28 0
-//  29 0 U        0
-//  30 x Q        0
-//  31 0
-// MUL  <Vd>.<T>, <Vn>.<T>, <Vm>.<T>
-bool TryDecodeMUL_ASIMDSAME_ONLY(const InstData &, Instruction &) {
-  return false;
-}
-
 // CMTST CMTST_asisdsame_only:
 //   0 x Rd       0
 //   1 x Rd       1
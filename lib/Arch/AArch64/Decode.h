@@ -16,6 +16,7 @@
 
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
 
 namespace remill {
@@ -7105,5 +7106,35 @@ const char *InstFormToString(InstForm iform);
 bool TryExtract(const uint8_t *bytes, InstData &data);
 bool TryDecode(const InstData &data, Instruction &inst);
 
+// The top-level encoding groups of A64 instructions, selected by bits 28:25
+// (`op0`) of an instruction word.
+enum class EncodingGroup : uint8_t {
+  kUnallocated,
+  kSVE,
+  kDataProcessingImmediate,
+  kBranchExceptionSystem,
+  kLoadStore,
+  kDataProcessingRegister,
+  kDataProcessingSIMDFP,
+};
+
+// Classify `num_words` consecutive little-endian instruction words, starting
+// at `bytes`, into `groups`. This is meant for scanning large amounts of code,
+// and is written so that the compiler can vectorize it.
+void ClassifyEncodings(const uint8_t *bytes, size_t num_words,
+                       EncodingGroup *groups);
+
+// Returns the number of leading words among the `num_words` words starting at
+// `bytes` that may be decodable instructions, i.e. that are not in the
+// unallocated or SVE encoding groups, which we don't support.
+size_t CountDecodableEncodings(const uint8_t *bytes, size_t num_words);
+
+// Fill `indices` with the indices of the words among the `num_words` words
+// starting at `bytes` that are in the branch, exception, and system encoding
+// group, and return how many there are. `indices` must have room for
+// `num_words` entries.
+size_t FindBranchExceptionSystemEncodings(const uint8_t *bytes,
+                                          size_t num_words, uint32_t *indices);
+
 }  // namespace aarch64
 }  // namespace remill
@@ -270,6 +270,10 @@ DEF_ISEL(LDR_64_LDST_IMMPRE) = LoadUpdateIndex<R64W, M64>;
 DEF_ISEL(LDR_64_LDST_REGOFF) = LoadFromOffset<R64W, M64>;
 DEF_ISEL(LDR_64_LOADLIT) = Load<R64W, M64>;
 
+// Fused `ADRP+LDR` idioms, see `AArch64Arch::FuseWithNextInstruction`.
+DEF_ISEL(ADRP_LDR_32_FUSED) = Load<R32W, M32>;
+DEF_ISEL(ADRP_LDR_64_FUSED) = Load<R64W, M64>;
+
 DEF_ISEL(LDURB_32_LDST_UNSCALED) = Load<R32W, M8>;
 DEF_ISEL(LDURH_32_LDST_UNSCALED) = Load<R32W, M16>;
 DEF_ISEL(LDUR_32_LDST_UNSCALED) = Load<R32W, M32>;
@@ -287,22 +291,26 @@ DEF_ISEL(MOVZ_64_MOVEWIDE) = Load<R64W, I64>;
 namespace {
 
 template <typename D, typename S>
-DEF_SEM(LDXR, D dst, S src, R64W monitor) {
-  WriteZExt(dst, Read(src));
+DEF_SEM(LDXR, D dst, S src, R64W monitor, R64W monitor_value) {
+  auto val = Read(src);
+  WriteZExt(dst, val);
   Write(monitor, AddressOf(src));
+  Write(monitor_value, ZExtTo<uint64_t>(val));
   return memory;
 }
 
 template <typename D, typename S>
-DEF_SEM(LDAXR, D dst, S src, R64W monitor) {
+DEF_SEM(LDAXR, D dst, S src, R64W monitor, R64W monitor_value) {
   memory = __remill_barrier_load_store(memory);
-  WriteZExt(dst, Read(src));
+  auto val = Read(src);
+  WriteZExt(dst, val);
   Write(monitor, AddressOf(src));
+  Write(monitor_value, ZExtTo<uint64_t>(val));
   return memory;
 }
 
 template <typename S, typename D>
-DEF_SEM(STLXR, R32W dst1, S src1, D dst2, R64W monitor) {
+DEF_SEM(STXR, R32W dst1, S src1, D dst2, R64W monitor, R64W) {
   auto old_addr = Read(monitor);
   if (old_addr == AddressOf(dst2)) {
     WriteZExt(dst2, Read(src1));
@@ -311,10 +319,42 @@ DEF_SEM(STLXR, R32W dst1, S src1, D dst2, R64W monitor) {
     WriteZExt(dst1, 1_u32);  // Store failed.
   }
   Write(monitor, 0_u64);
+  return memory;
+}
+
+template <typename S, typename D>
+DEF_SEM(STLXR, R32W dst1, S src1, D dst2, R64W monitor, R64W monitor_value) {
+  memory = STXR<S, D>(memory, state, dst1, src1, dst2, monitor, monitor_value);
   memory = __remill_barrier_store_store(memory);
   return memory;
 }
 
+// Native variants, used by `InstructionLifter::SetNativeAtomics`. The store
+// is a compare-exchange of the value loaded by the exclusive load, and so it
+// only succeeds if no other thread changed the memory in between, e.g. when
+// the lifted code runs on many cores at once.
+template <typename S, typename D>
+DEF_SEM(STXR_NATIVE, R32W dst1, S src1, D dst2, R64W monitor,
+        R64W monitor_value) {
+  auto succeeded = false;
+  if (Read(monitor) == AddressOf(dst2)) {
+    auto new_val = Read(src1);
+    auto expected = TruncTo<decltype(new_val)>(Read(monitor_value));
+    succeeded = UCmpXchg(dst2, expected, new_val);
+  }
+  WriteZExt(dst1, Select<uint32_t>(succeeded, 0_u32, 1_u32));
+  Write(monitor, 0_u64);
+  return memory;
+}
+
+template <typename S, typename D>
+DEF_SEM(STLXR_NATIVE, R32W dst1, S src1, D dst2, R64W monitor,
+        R64W monitor_value) {
+  memory = __remill_barrier_store_store(memory);
+  memory = STXR_NATIVE<S, D>(memory, state, dst1, src1, dst2, monitor,
+                             monitor_value);
+  return memory;
+}
 
 }  // namespace
 
@@ -322,8 +362,14 @@ DEF_ISEL(LDXR_LR32_LDSTEXCL) = LDXR<R32W, M32>;
 DEF_ISEL(LDXR_LR64_LDSTEXCL) = LDXR<R64W, M64>;
 DEF_ISEL(LDAXR_LR32_LDSTEXCL) = LDAXR<R32W, M32>;
 DEF_ISEL(LDAXR_LR64_LDSTEXCL) = LDAXR<R64W, M64>;
+DEF_ISEL(STXR_SR32_LDSTEXCL) = STXR<R32, M32W>;
+DEF_ISEL(STXR_SR64_LDSTEXCL) = STXR<R64, M64W>;
 DEF_ISEL(STLXR_SR32_LDSTEXCL) = STLXR<R32, M32W>;
 DEF_ISEL(STLXR_SR64_LDSTEXCL) = STLXR<R64, M64W>;
+DEF_ISEL(STXR_SR32_LDSTEXCL_NATIVE) = STXR_NATIVE<R32, M32W>;
+DEF_ISEL(STXR_SR64_LDSTEXCL_NATIVE) = STXR_NATIVE<R64, M64W>;
+DEF_ISEL(STLXR_SR32_LDSTEXCL_NATIVE) = STLXR_NATIVE<R32, M32W>;
+DEF_ISEL(STLXR_SR64_LDSTEXCL_NATIVE) = STLXR_NATIVE<R64, M64W>;
 
 namespace {
 
@@ -479,6 +525,9 @@ DEF_ISEL(ADRP_ONLY_PCRELADDR) = ADRP;
 
 DEF_ISEL(ADR_ONLY_PCRELADDR) = Load<R64W, I64>;
 
+// Fused `ADRP+ADD` idiom, see `AArch64Arch::FuseWithNextInstruction`.
+DEF_ISEL(ADRP_ADD_64_FUSED) = Load<R64W, I64>;
+
 namespace {
 
 DEF_SEM(LDR_B, V128W dst, MV8 src) {
@@ -795,13 +844,72 @@ DEF_ISEL(LD1_ASISDLSE_R1_1V_2D) = LD1_SINGLE_64<MV128>;
 
 namespace {
 
+// The whole vector type of `kNumBytes` bytes, if any, for accessing several
+// consecutive vectors in memory at once.
+template <size_t kNumBytes>
+struct MultiVecType {
+  struct Type {
+    uint8_t bytes[kNumBytes];
+  };
+};
+
+template <>
+struct MultiVecType<16> {
+  typedef vec128_t Type;
+};
+
+template <>
+struct MultiVecType<32> {
+  typedef vec256_t Type;
+};
+
+template <>
+struct MultiVecType<64> {
+  typedef vec512_t Type;
+};
+
+template <typename V, size_t kNumVecs>
+union MultiVec {
+  typename MultiVecType<sizeof(V) * kNumVecs>::Type whole;
+  V vecs[kNumVecs];
+};
+
+// Read `kNumVecs` consecutive vectors with one whole vector memory access.
+// Returns `false` if there is no whole vector type of their total size, in
+// which case the vectors must be read one at a time.
+template <typename V, size_t kNumVecs>
+ALWAYS_INLINE static bool ReadMultiVec(Memory *memory, addr_t addr,
+                                       V (&vecs)[kNumVecs]) {
+  MultiVec<V, kNumVecs> multi;
+  if (!_ReadVecMemory(memory, addr, multi.whole)) {
+    return false;
+  }
+  _Pragma("unroll") for (size_t i = 0; i < kNumVecs; ++i) {
+    vecs[i] = multi.vecs[i];
+  }
+  return true;
+}
+
+template <typename V, size_t kNumVecs>
+ALWAYS_INLINE static bool WriteMultiVec(Memory *&memory, addr_t addr,
+                                        const V (&vecs)[kNumVecs]) {
+  MultiVec<V, kNumVecs> multi;
+  _Pragma("unroll") for (size_t i = 0; i < kNumVecs; ++i) {
+    multi.vecs[i] = vecs[i];
+  }
+  return _WriteVecMemory(memory, addr, multi.whole);
+}
+
 #define MAKE_LD1(esize) \
   template <typename S> \
   DEF_SEM(LD1_PAIR_##esize, V128W dst1, V128W dst2, S src) { \
-    auto elems1 = UReadV##esize(src); \
-    auto elems2 = UReadV##esize(GetElementPtr(src, 1U)); \
-    UWriteV##esize(dst1, elems1); \
-    UWriteV##esize(dst2, elems2); \
+    decltype(UReadV##esize(src)) elems[2]; \
+    if (!ReadMultiVec(memory, src.addr, elems)) { \
+      elems[0] = UReadV##esize(src); \
+      elems[1] = UReadV##esize(GetElementPtr(src, 1U)); \
+    } \
+    UWriteV##esize(dst1, elems[0]); \
+    UWriteV##esize(dst2, elems[1]); \
     return memory; \
   }
 
@@ -831,10 +939,12 @@ namespace {
 #define MAKE_ST1(esize) \
   template <typename D> \
   DEF_SEM(ST1_PAIR_##esize, V##esize src1, V##esize src2, D dst) { \
-    auto elems1 = UReadV##esize(src1); \
-    auto elems2 = UReadV##esize(src2); \
-    UWriteV##esize(dst, elems1); \
-    UWriteV##esize(GetElementPtr(dst, 1U), elems2); \
+    const decltype(UReadV##esize(src1)) elems[2] = {UReadV##esize(src1), \
+                                                    UReadV##esize(src2)}; \
+    if (!WriteMultiVec(memory, dst.addr, elems)) { \
+      UWriteV##esize(dst, elems[0]); \
+      UWriteV##esize(GetElementPtr(dst, 1U), elems[1]); \
+    } \
     return memory; \
   }
 
@@ -928,14 +1038,17 @@ namespace {
   template <typename S> \
   DEF_SEM(LD1_QUAD_##esize, V128W dst1, V128W dst2, V128W dst3, V128W dst4, \
           S src) { \
-    auto elems1 = UReadV##esize(src); \
-    auto elems2 = UReadV##esize(GetElementPtr(src, 1U)); \
-    auto elems3 = UReadV##esize(GetElementPtr(src, 2U)); \
-    auto elems4 = UReadV##esize(GetElementPtr(src, 3U)); \
-    UWriteV##esize(dst1, elems1); \
-    UWriteV##esize(dst2, elems2); \
-    UWriteV##esize(dst3, elems3); \
-    UWriteV##esize(dst4, elems4); \
+    decltype(UReadV##esize(src)) elems[4]; \
+    if (!ReadMultiVec(memory, src.addr, elems)) { \
+      elems[0] = UReadV##esize(src); \
+      elems[1] = UReadV##esize(GetElementPtr(src, 1U)); \
+      elems[2] = UReadV##esize(GetElementPtr(src, 2U)); \
+      elems[3] = UReadV##esize(GetElementPtr(src, 3U)); \
+    } \
+    UWriteV##esize(dst1, elems[0]); \
+    UWriteV##esize(dst2, elems[1]); \
+    UWriteV##esize(dst3, elems[2]); \
+    UWriteV##esize(dst4, elems[3]); \
     return memory; \
   }
 
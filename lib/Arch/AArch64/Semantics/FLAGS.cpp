@@ -154,6 +154,14 @@ ALWAYS_INLINE static void SetFPSRStatusFlags(State &state, int mask) {
   state.sr.ioc |= static_cast<uint64_t>(0 != (mask & FE_INVALID));
 }
 
+// Fold the exceptions that the host FPU has raised since they were last
+// tested into the status flags, before the status register is read or
+// written. This is a no-op unless the exceptions of the operations are
+// deferred; see `FPExceptionLowering::kDefer`.
+ALWAYS_INLINE static void SyncFPSRStatusFlags(State &state) {
+  SetFPSRStatusFlags(state, __remill_fpu_exception_test_and_clear(0, 0));
+}
+
 template <typename F, typename T>
 ALWAYS_INLINE static auto CheckedFloatUnaryOp(State &state, F func, T arg1)
     -> decltype(func(arg1)) {
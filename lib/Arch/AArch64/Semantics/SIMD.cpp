@@ -124,15 +124,19 @@ DEF_ISEL(FMOV_V64I_FLOAT2INT) = FMOV_UInt64ToVector;
 
 namespace {
 
+// Returns a vector with every element set to `val`.
+template <typename V>
+ALWAYS_INLINE static V SplatVector(typename VectorType<V>::BT val) {
+  using BT = typename VectorType<V>::BT;
+  typename NativeVectorType<BT, VectorType<V>::kNumElems>::Type zeros = {};
+  return FromNativeVector<V>(zeros + val);
+}
+
 #define MAKE_DUP(size) \
   template <typename V> \
   DEF_SEM(DUP_##size, V128W dst, R64 src) { \
     auto val = TruncTo<uint##size##_t>(Read(src)); \
-    V vec = {}; \
-    _Pragma("unroll") for (auto &element : vec.elems) { \
-      element = val; \
-    } \
-    UWriteV##size(dst, vec); \
+    UWriteV##size(dst, SplatVector<V>(val)); \
     return memory; \
   }
 
@@ -143,6 +147,21 @@ MAKE_DUP(64)
 
 #undef MAKE_DUP
 
+#define MAKE_DUP_ELEM(size) \
+  template <typename V> \
+  DEF_SEM(DUP_ELEM_##size, V128W dst, V128 src, I64 index) { \
+    auto val = UExtractV##size(UReadV##size(src), Read(index)); \
+    UWriteV##size(dst, SplatVector<V>(val)); \
+    return memory; \
+  }
+
+MAKE_DUP_ELEM(8)
+MAKE_DUP_ELEM(16)
+MAKE_DUP_ELEM(32)
+MAKE_DUP_ELEM(64)
+
+#undef MAKE_DUP_ELEM
+
 }  // namespace
 
 DEF_ISEL(DUP_ASIMDINS_DR_R_8B) = DUP_8<uint8v8_t>;
@@ -153,6 +172,14 @@ DEF_ISEL(DUP_ASIMDINS_DR_R_2S) = DUP_32<uint32v2_t>;
 DEF_ISEL(DUP_ASIMDINS_DR_R_4S) = DUP_32<uint32v4_t>;
 DEF_ISEL(DUP_ASIMDINS_DR_R_2D) = DUP_64<uint64v2_t>;
 
+DEF_ISEL(DUP_ASIMDINS_DV_V_8B) = DUP_ELEM_8<uint8v8_t>;
+DEF_ISEL(DUP_ASIMDINS_DV_V_16B) = DUP_ELEM_8<uint8v16_t>;
+DEF_ISEL(DUP_ASIMDINS_DV_V_4H) = DUP_ELEM_16<uint16v4_t>;
+DEF_ISEL(DUP_ASIMDINS_DV_V_8H) = DUP_ELEM_16<uint16v8_t>;
+DEF_ISEL(DUP_ASIMDINS_DV_V_2S) = DUP_ELEM_32<uint32v2_t>;
+DEF_ISEL(DUP_ASIMDINS_DV_V_4S) = DUP_ELEM_32<uint32v4_t>;
+DEF_ISEL(DUP_ASIMDINS_DV_V_2D) = DUP_ELEM_64<uint64v2_t>;
+
 namespace {
 
 template <typename T>
@@ -168,18 +195,37 @@ ALWAYS_INLINE static T UMax(T lhs, T rhs) {
 #define SMin UMin
 #define SMax UMax
 
+// Element-wise minimum and maximum of whole vectors, by selecting between
+// the elements of `lhs` and `rhs` with a comparison mask.
+#define MAKE_MIN_MAX(prefix, size) \
+  template <typename T> \
+  ALWAYS_INLINE static T prefix##MinV##size(const T &lhs, const T &rhs) { \
+    auto lhs_is_min = prefix##CmpGtV##size(rhs, lhs); \
+    return prefix##OrV##size(prefix##AndV##size(lhs, lhs_is_min), \
+                             prefix##AndNV##size(rhs, lhs_is_min)); \
+  } \
+  template <typename T> \
+  ALWAYS_INLINE static T prefix##MaxV##size(const T &lhs, const T &rhs) { \
+    auto lhs_is_max = prefix##CmpGtV##size(lhs, rhs); \
+    return prefix##OrV##size(prefix##AndV##size(lhs, lhs_is_max), \
+                             prefix##AndNV##size(rhs, lhs_is_max)); \
+  }
+
+MAKE_MIN_MAX(U, 8)
+MAKE_MIN_MAX(U, 16)
+MAKE_MIN_MAX(U, 32)
+MAKE_MIN_MAX(S, 8)
+MAKE_MIN_MAX(S, 16)
+MAKE_MIN_MAX(S, 32)
+
+#undef MAKE_MIN_MAX
+
 #define MAKE_BROADCAST(op, prefix, binop, size) \
   template <typename S, typename V> \
   DEF_SEM(op##_##size, V128W dst, S src1, S src2) { \
     auto vec1 = prefix##ReadV##size(src1); \
     auto vec2 = prefix##ReadV##size(src2); \
-    V sum = {}; \
-    _Pragma("unroll") for (size_t i = 0, max_i = NumVectorElems(sum); \
-                           i < max_i; ++i) { \
-      sum.elems[i] = prefix##binop(prefix##ExtractV##size(vec1, i), \
-                                   prefix##ExtractV##size(vec2, i)); \
-    } \
-    prefix##WriteV##size(dst, sum); \
+    prefix##WriteV##size(dst, prefix##binop##V##size(vec1, vec2)); \
     return memory; \
   }
 
@@ -193,6 +239,10 @@ MAKE_BROADCAST(SUB, U, Sub, 16)
 MAKE_BROADCAST(SUB, U, Sub, 32)
 MAKE_BROADCAST(SUB, U, Sub, 64)
 
+MAKE_BROADCAST(MUL, U, Mul, 8)
+MAKE_BROADCAST(MUL, U, Mul, 16)
+MAKE_BROADCAST(MUL, U, Mul, 32)
+
 MAKE_BROADCAST(UMIN, U, Min, 8)
 MAKE_BROADCAST(UMIN, U, Min, 16)
 MAKE_BROADCAST(UMIN, U, Min, 32)
@@ -229,6 +279,13 @@ DEF_ISEL(SUB_ASIMDSAME_ONLY_2S) = SUB_32<V64, uint32v2_t>;
 DEF_ISEL(SUB_ASIMDSAME_ONLY_4S) = SUB_32<V128, uint32v4_t>;
 DEF_ISEL(SUB_ASIMDSAME_ONLY_2D) = SUB_64<V128, uint64v2_t>;
 
+DEF_ISEL(MUL_ASIMDSAME_ONLY_8B) = MUL_8<V64, uint8v8_t>;
+DEF_ISEL(MUL_ASIMDSAME_ONLY_16B) = MUL_8<V128, uint8v16_t>;
+DEF_ISEL(MUL_ASIMDSAME_ONLY_4H) = MUL_16<V64, uint16v4_t>;
+DEF_ISEL(MUL_ASIMDSAME_ONLY_8H) = MUL_16<V128, uint16v8_t>;
+DEF_ISEL(MUL_ASIMDSAME_ONLY_2S) = MUL_32<V64, uint32v2_t>;
+DEF_ISEL(MUL_ASIMDSAME_ONLY_4S) = MUL_32<V128, uint32v4_t>;
+
 DEF_ISEL(UMIN_ASIMDSAME_ONLY_8B) = UMIN_8<V64, uint8v8_t>;
 DEF_ISEL(UMIN_ASIMDSAME_ONLY_16B) = UMIN_8<V128, uint8v16_t>;
 DEF_ISEL(UMIN_ASIMDSAME_ONLY_4H) = UMIN_16<V64, uint16v4_t>;
@@ -259,22 +316,46 @@ DEF_ISEL(SMAX_ASIMDSAME_ONLY_4S) = SMAX_32<V128, int32v4_t>;
 
 namespace {
 
+// Whole vector comparisons. Each element of the result has all of its bits
+// set if the comparison holds for the corresponding elements, and is zero
+// otherwise. The signed comparisons take signed vectors.
+#define MAKE_VEC_CMPS(prefix, size) \
+  template <typename T> \
+  ALWAYS_INLINE static T prefix##CmpLtV##size(const T &lhs, const T &rhs) { \
+    return prefix##CmpGtV##size(rhs, lhs); \
+  } \
+  template <typename T> \
+  ALWAYS_INLINE static T prefix##CmpLteV##size(const T &lhs, const T &rhs) { \
+    return prefix##NotV##size(prefix##CmpGtV##size(lhs, rhs)); \
+  } \
+  template <typename T> \
+  ALWAYS_INLINE static T prefix##CmpGteV##size(const T &lhs, const T &rhs) { \
+    return prefix##NotV##size(prefix##CmpGtV##size(rhs, lhs)); \
+  } \
+  template <typename T> \
+  ALWAYS_INLINE static T prefix##CmpTstV##size(const T &lhs, const T &rhs) { \
+    return prefix##NotV##size( \
+        prefix##CmpEqV##size(prefix##AndV##size(lhs, rhs), T{})); \
+  }
+
+MAKE_VEC_CMPS(U, 8)
+MAKE_VEC_CMPS(U, 16)
+MAKE_VEC_CMPS(U, 32)
+MAKE_VEC_CMPS(U, 64)
+MAKE_VEC_CMPS(S, 8)
+MAKE_VEC_CMPS(S, 16)
+MAKE_VEC_CMPS(S, 32)
+MAKE_VEC_CMPS(S, 64)
+
+#undef MAKE_VEC_CMPS
+
 #define MAKE_CMP_BROADCAST(op, prefix, binop, size) \
   template <typename S, typename V> \
   DEF_SEM(op##_##size, V128W dst, S src1, I##size imm) { \
     auto vec1 = prefix##ReadV##size(src1); \
-    auto ucmp_val = Read(imm); \
-    auto cmp_val = Signed(ucmp_val); \
-    decltype(ucmp_val) zeros = 0; \
-    decltype(ucmp_val) ones = ~zeros; \
-    V res = {}; \
-    _Pragma("unroll") for (size_t i = 0, max_i = NumVectorElems(res); \
-                           i < max_i; ++i) { \
-      res.elems[i] = \
-          Select(prefix##binop(prefix##ExtractV##size(vec1, i), cmp_val), \
-                 ones, zeros); \
-    } \
-    UWriteV##size(dst, res); \
+    auto cmp_vec = SplatVector<decltype(vec1)>(Signed(Read(imm))); \
+    auto res = prefix##binop##V##size(vec1, cmp_vec); \
+    UWriteV##size(dst, FromNativeVector<V>(ToNativeVector(res))); \
     return memory; \
   }
 
@@ -362,24 +443,11 @@ namespace {
   DEF_SEM(op##_##size, V128W dst, S src1, S src2) { \
     auto vec1 = prefix##ReadV##size(src1); \
     auto vec2 = prefix##ReadV##size(src2); \
-    uint##size##_t zeros = 0; \
-    uint##size##_t ones = ~zeros; \
-    V res = {}; \
-    _Pragma("unroll") for (size_t i = 0, max_i = NumVectorElems(res); \
-                           i < max_i; ++i) { \
-      res.elems[i] = Select(prefix##binop(prefix##ExtractV##size(vec1, i), \
-                                          prefix##ExtractV##size(vec2, i)), \
-                            ones, zeros); \
-    } \
-    UWriteV##size(dst, res); \
+    auto res = prefix##binop##V##size(vec1, vec2); \
+    UWriteV##size(dst, FromNativeVector<V>(ToNativeVector(res))); \
     return memory; \
   }
 
-template <typename T>
-ALWAYS_INLINE static bool UCmpTst(T lhs, T rhs) {
-  return UCmpNeq(UAnd(lhs, rhs), T(0));
-}
-
 MAKE_CMP_BROADCAST(CMPEQ, S, CmpEq, 8)
 MAKE_CMP_BROADCAST(CMPEQ, S, CmpEq, 16)
 MAKE_CMP_BROADCAST(CMPEQ, S, CmpEq, 32)
@@ -840,26 +908,102 @@ DEF_ISEL(NOT_ASIMDMISC_R_16B) = NOT_8<V128>;
 
 namespace {
 
-template <typename T, size_t count>
-DEF_SEM(EXT, V128W dst, T src1, T src2, I32 src3) {
-  auto lsb = Read(src3);
-  auto vn = UReadV8(src1);
-  auto vm = UReadV8(src2);
-  uint8v16_t result = {};
-  _Pragma("unroll") for (size_t i = 0, max_i = count; i + lsb < max_i; ++i) {
-    result.elems[count - 1 - i] = UExtractV8(vm, i + lsb);
+// The result is the bytes of `Vm:Vn` starting at byte `lsb` of `Vn`, and so
+// is a funnel shift of the whole registers, rather than a per-byte shuffle.
+#define MAKE_EXT(size) \
+  DEF_SEM(EXT_##size, V128W dst, V##size src1, V##size src2, I32 src3) { \
+    auto shift = static_cast<uint##size##_t>(Read(src3)) * 8; \
+    auto vn = UExtractV##size(UReadV##size(src1), 0); \
+    auto vm = UExtractV##size(UReadV##size(src2), 0); \
+    uint##size##v1_t result = {}; \
+    result.elems[0] = shift ? (vn >> shift) | (vm << (size - shift)) : vn; \
+    UWriteV##size(dst, result); \
+    return memory; \
   }
-  _Pragma("unroll") for (size_t i = lsb; i < count; ++i) {
-    result.elems[count - 1 - i] = UExtractV8(vn, i - lsb);
+
+MAKE_EXT(64)
+MAKE_EXT(128)
+
+#undef MAKE_EXT
+
+}  //  namespace
+
+DEF_ISEL(EXT_ASIMDEXT_ONLY_8B) = EXT_64;
+DEF_ISEL(EXT_ASIMDEXT_ONLY_16B) = EXT_128;
+
+namespace {
+
+// Copy the bytes of one table register into `table`.
+ALWAYS_INLINE static void CopyTable(uint8_t *table, const uint8v16_t &reg) {
+  _Pragma("unroll") for (size_t i = 0; i < 16; ++i) {
+    table[i] = reg.elems[i];
+  }
+}
+
+// Look up each byte of `indices` in `table`, where out-of-range indices
+// select zero. The indices are only known at runtime, and so unlike the
+// other permutes, this can't be one whole vector shuffle.
+template <typename V, typename I, size_t kNumBytes>
+ALWAYS_INLINE static V TableLookup(const uint8_t (&table)[kNumBytes],
+                                   const I &indices) {
+  V res = {};
+  _Pragma("unroll") for (size_t i = 0, max_i = NumVectorElems(res);
+                         i < max_i; ++i) {
+    const auto index = indices.elems[i];
+    res.elems[i] = index < kNumBytes ? table[index] : 0;
   }
-  UWriteV8(dst, result);
+  return res;
+}
+
+template <typename S, typename V>
+DEF_SEM(TBL_1, V128W dst, V128 src1, S indices) {
+  uint8_t table[16];
+  CopyTable(&(table[0]), UReadV8(src1));
+  UWriteV8(dst, TableLookup<V>(table, UReadV8(indices)));
   return memory;
 }
 
-}  //  namespace
+template <typename S, typename V>
+DEF_SEM(TBL_2, V128W dst, V128 src1, V128 src2, S indices) {
+  uint8_t table[32];
+  CopyTable(&(table[0]), UReadV8(src1));
+  CopyTable(&(table[16]), UReadV8(src2));
+  UWriteV8(dst, TableLookup<V>(table, UReadV8(indices)));
+  return memory;
+}
+
+template <typename S, typename V>
+DEF_SEM(TBL_3, V128W dst, V128 src1, V128 src2, V128 src3, S indices) {
+  uint8_t table[48];
+  CopyTable(&(table[0]), UReadV8(src1));
+  CopyTable(&(table[16]), UReadV8(src2));
+  CopyTable(&(table[32]), UReadV8(src3));
+  UWriteV8(dst, TableLookup<V>(table, UReadV8(indices)));
+  return memory;
+}
+
+template <typename S, typename V>
+DEF_SEM(TBL_4, V128W dst, V128 src1, V128 src2, V128 src3, V128 src4,
+        S indices) {
+  uint8_t table[64];
+  CopyTable(&(table[0]), UReadV8(src1));
+  CopyTable(&(table[16]), UReadV8(src2));
+  CopyTable(&(table[32]), UReadV8(src3));
+  CopyTable(&(table[48]), UReadV8(src4));
+  UWriteV8(dst, TableLookup<V>(table, UReadV8(indices)));
+  return memory;
+}
+
+}  // namespace
 
-DEF_ISEL(EXT_ASIMDEXT_ONLY_8B) = EXT<V64, 8>;
-DEF_ISEL(EXT_ASIMDEXT_ONLY_16B) = EXT<V128, 16>;
+DEF_ISEL(TBL_ASIMDTBL_L1_1_8B) = TBL_1<V64, uint8v8_t>;
+DEF_ISEL(TBL_ASIMDTBL_L1_1_16B) = TBL_1<V128, uint8v16_t>;
+DEF_ISEL(TBL_ASIMDTBL_L2_2_8B) = TBL_2<V64, uint8v8_t>;
+DEF_ISEL(TBL_ASIMDTBL_L2_2_16B) = TBL_2<V128, uint8v16_t>;
+DEF_ISEL(TBL_ASIMDTBL_L3_3_8B) = TBL_3<V64, uint8v8_t>;
+DEF_ISEL(TBL_ASIMDTBL_L3_3_16B) = TBL_3<V128, uint8v16_t>;
+DEF_ISEL(TBL_ASIMDTBL_L4_4_8B) = TBL_4<V64, uint8v8_t>;
+DEF_ISEL(TBL_ASIMDTBL_L4_4_16B) = TBL_4<V128, uint8v16_t>;
 
 
 // TODO(pag):
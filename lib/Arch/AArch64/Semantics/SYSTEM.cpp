@@ -29,6 +29,7 @@ DEF_SEM(Breakpoint, I32 imm) {
 }
 
 DEF_SEM(DoMRS_RS_SYSTEM_FPSR, R64W dest) {
+  SyncFPSRStatusFlags(state);
   auto fpsr = state.fpsr;
   fpsr.ixc = state.sr.ixc;
   fpsr.ofc = state.sr.ofc;
@@ -41,6 +42,7 @@ DEF_SEM(DoMRS_RS_SYSTEM_FPSR, R64W dest) {
 }
 
 DEF_SEM(DoMSR_SR_SYSTEM_FPSR, R64 src) {
+  SyncFPSRStatusFlags(state);
   FPSR fpsr;
   WriteZExt(fpsr.flat, Read(src));
   fpsr._res0 = 0;
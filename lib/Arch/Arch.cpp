@@ -20,6 +20,7 @@
 #include <glog/logging.h>
 #include <llvm/ADT/APInt.h>
 #include <llvm/ADT/SmallVector.h>
+#include <llvm/ADT/StringMap.h>
 #include <llvm/IR/BasicBlock.h>
 #include <llvm/IR/Function.h>
 #include <llvm/IR/IRBuilder.h>
@@ -30,7 +31,11 @@
 #include <llvm/IR/Module.h>
 
 #include <algorithm>
+#include <map>
 #include <memory>
+#include <mutex>
+#include <optional>
+#include <tuple>
 #include <unordered_map>
 #include <unordered_set>
 
@@ -48,10 +53,66 @@ DEFINE_string(arch, REMILL_ARCH,
               "Valid architectures: x86, amd64 (with or without "
               "`_avx` or `_avx512` appended), aarch64, aarch32");
 
+DEFINE_bool(log_decode_failures, false,
+            "Log the address, bytes, and reason of every instruction that "
+            "fails to decode.");
+
 DECLARE_string(os);
 
 namespace remill {
 
+// The description of the registers of an architecture that doesn't depend on
+// an `llvm::LLVMContext`, i.e. their names, offsets, sizes, and the registers
+// at each offset of `State`. Once it is complete, a table is shared, without
+// being modified, by the `ArchImpl`s of every context with the same
+// architecture, so that only the first of them builds it.
+class RegisterTable {
+ public:
+  struct Entry {
+    std::string name;
+    uint64_t offset;
+    uint64_t size;
+  };
+
+  // Indexed by `Register::index`.
+  std::vector<Entry> regs;
+
+  // One plus the index of the register at each byte offset of `State`, or
+  // zero if there is none.
+  std::vector<uint32_t> reg_by_offset;
+
+  // Indexes of the registers, by name, used while the table is built.
+  llvm::StringMap<unsigned> reg_by_name;
+
+  // Flat, open-addressed table of registers by name, used by
+  // `Arch::RegisterByName` once the register table is complete. Each slot
+  // holds the hash of a register's name and one plus its `Register::index`,
+  // or zero if the slot is empty. The seed of the hash is chosen, where
+  // possible, so that no two names land in the same slot, and so a lookup
+  // is one hash and one string comparison.
+  struct NameSlot {
+    uint32_t hash;
+    uint32_t index_plus_one;
+  };
+
+  std::vector<NameSlot> reg_name_table;
+  uint32_t reg_name_seed{0};
+
+  static uint32_t HashName(std::string_view name, uint32_t seed);
+
+  // Build `reg_name_table` from `regs`.
+  void BuildNameTable(void);
+
+  // Returns the index of the register named `name`, or `kNotFound`.
+  unsigned FindByName(std::string_view name) const;
+
+  // Copy of the first `num_regs` registers of this table, without the name
+  // table.
+  std::shared_ptr<RegisterTable> Prefix(size_t num_regs) const;
+
+  static constexpr unsigned kNotFound = ~0u;
+};
+
 class ArchImpl {
  public:
   // State type.
@@ -63,14 +124,157 @@ class ArchImpl {
   // Lifted function type.
   llvm::FunctionType *lifted_function_type{nullptr};
 
+  // Data layout of the semantics module, used to index into `state_type`.
+  std::optional<llvm::DataLayout> data_layout;
+
   // Metadata type ID for remill registers.
   unsigned reg_md_id{0};
 
+  // Whether or not the registers were built by `InitWithoutSemanticsModule`,
+  // in which case `state_type` is only an array of bytes.
+  bool without_semantics{false};
+
+  // The registers of this context, indexed by `Register::index`. These are
+  // the first `registers.size()` registers of `table`.
   std::vector<std::unique_ptr<Register>> registers;
-  std::vector<const Register *> reg_by_offset;
-  std::unordered_map<std::string, const Register *> reg_by_name;
+
+  // The context-independent description of the registers. This is either
+  // `own_table`, or a complete table shared with other contexts, whose
+  // registers are added again, in the same order, by
+  // `PopulateBasicBlockFunction`.
+  std::shared_ptr<const RegisterTable> table;
+  std::shared_ptr<RegisterTable> own_table;
+
+  // Returns the table, first copying the part of a shared table that
+  // describes `registers`, so that it can be modified.
+  RegisterTable &MutableTable(void);
 };
 
+// FNV-1a, mixed with `seed`.
+uint32_t RegisterTable::HashName(std::string_view name, uint32_t seed) {
+  uint32_t hash = 2166136261u ^ (seed * 0x9E3779B9u);
+  for (auto ch : name) {
+    hash ^= static_cast<uint8_t>(ch);
+    hash *= 16777619u;
+  }
+  return hash ^ (hash >> 15);
+}
+
+// Build `reg_name_table` from `regs`.
+void RegisterTable::BuildNameTable(void) {
+  reg_name_table.clear();
+  if (regs.empty()) {
+    return;
+  }
+
+  // Keep the load factor at or below one quarter, so that a collision-free
+  // seed is usually found within a few tries.
+  size_t num_slots = 1;
+  while (num_slots < regs.size() * 4u) {
+    num_slots <<= 1u;
+  }
+  const auto mask = static_cast<uint32_t>(num_slots - 1u);
+
+  std::vector<bool> used(num_slots);
+  auto is_perfect = [&](uint32_t seed) {
+    used.assign(num_slots, false);
+    for (const auto &reg : regs) {
+      const auto slot = HashName(reg.name, seed) & mask;
+      if (used[slot]) {
+        return false;
+      }
+      used[slot] = true;
+    }
+    return true;
+  };
+
+  // If there's no perfect seed, then fall back on linear probing with the
+  // first seed.
+  reg_name_seed = 0;
+  for (uint32_t seed = 0; seed < 256u; ++seed) {
+    if (is_perfect(seed)) {
+      reg_name_seed = seed;
+      break;
+    }
+  }
+
+  reg_name_table.assign(num_slots, NameSlot{0, 0});
+  for (uint32_t index = 0; index < regs.size(); ++index) {
+    const auto hash = HashName(regs[index].name, reg_name_seed);
+    auto slot = hash & mask;
+    while (reg_name_table[slot].index_plus_one) {
+      slot = (slot + 1u) & mask;
+    }
+    reg_name_table[slot].hash = hash;
+    reg_name_table[slot].index_plus_one = index + 1u;
+  }
+}
+
+// Returns the index of the register named `name`, or `kNotFound`.
+unsigned RegisterTable::FindByName(std::string_view name) const {
+  if (reg_name_table.empty()) {
+    const auto it = reg_by_name.find(llvm::StringRef(name.data(), name.size()));
+    return it == reg_by_name.end() ? kNotFound : it->second;
+  }
+
+  const auto mask = static_cast<uint32_t>(reg_name_table.size() - 1u);
+  const auto hash = HashName(name, reg_name_seed);
+  for (auto slot = hash & mask;; slot = (slot + 1u) & mask) {
+    const auto &entry = reg_name_table[slot];
+    if (!entry.index_plus_one) {
+      return kNotFound;
+    }
+    if (entry.hash == hash) {
+      const auto index = entry.index_plus_one - 1u;
+      if (regs[index].name == name) {
+        return index;
+      }
+    }
+  }
+}
+
+// Copy of the first `num_regs` registers of this table.
+std::shared_ptr<RegisterTable> RegisterTable::Prefix(size_t num_regs) const {
+  auto prefix = std::make_shared<RegisterTable>();
+  prefix->regs.assign(regs.begin(), regs.begin() + num_regs);
+  prefix->reg_by_offset.resize(reg_by_offset.size());
+  for (uint32_t index = 0; index < num_regs; ++index) {
+    const auto &reg = prefix->regs[index];
+    prefix->reg_by_name[reg.name] = index;
+    for (auto i = reg.offset; i < (reg.offset + reg.size); ++i) {
+      prefix->reg_by_offset[i] = index + 1u;
+    }
+  }
+  return prefix;
+}
+
+// Returns the table, first copying the part of a shared table that
+// describes `registers`.
+RegisterTable &ArchImpl::MutableTable(void) {
+  if (!own_table) {
+    own_table = table->Prefix(registers.size());
+    table = own_table;
+  }
+  return *own_table;
+}
+
+namespace {
+
+// Register tables that are shared by the architectures of all contexts.
+struct RegisterTableCache {
+  using Key = std::tuple<OSName, ArchName, bool>;
+
+  std::mutex lock;
+  std::map<Key, std::shared_ptr<const RegisterTable>> tables;
+};
+
+static RegisterTableCache &GetRegisterTableCache(void) {
+  static RegisterTableCache cache;
+  return cache;
+}
+
+}  // namespace
+
 namespace {
 
 static unsigned AddressSize(ArchName arch_name) {
@@ -102,6 +306,188 @@ Arch::Arch(llvm::LLVMContext *context_, OSName os_name_, ArchName arch_name_)
 
 Arch::~Arch(void) {}
 
+// Decode up to `max_insts` consecutive instructions from `insts_bytes`.
+size_t Arch::DecodeInstructions(uint64_t address, std::string_view insts_bytes,
+                                std::vector<Instruction> &insts,
+                                size_t max_insts) const {
+  return DecodeEachInstruction(
+      address, insts_bytes, insts, max_insts, MaxInstructionSize(),
+      [this](uint64_t inst_addr, std::string_view inst_bytes,
+             Instruction &inst) {
+        return DecodeInstruction(inst_addr, inst_bytes, inst);
+      });
+}
+
+// Decode an instruction, and report why it couldn't be decoded if decoding
+// fails.
+DecodeResult Arch::TryDecodeInstruction(uint64_t address,
+                                        std::string_view instr_bytes,
+                                        Instruction &inst) const {
+  inst.decode_error = DecodeError::kNone;
+  if (DecodeInstruction(address, instr_bytes, inst) && !inst.bytes.empty()) {
+    return {DecodeError::kNone, static_cast<uint32_t>(inst.bytes.size())};
+  }
+
+  if (DecodeError::kNone == inst.decode_error) {
+    inst.decode_error = DecodeError::kInvalidEncoding;
+  }
+
+  // Skip to the next aligned address, or past the end of the bytes if there
+  // aren't enough of them left for an instruction.
+  const auto align = MinInstructionAlign();
+  uint64_t skip = align - (address % align);
+  if (DecodeError::kTruncated == inst.decode_error ||
+      skip > instr_bytes.size()) {
+    skip = instr_bytes.size();
+  }
+  return {inst.decode_error, static_cast<uint32_t>(skip)};
+}
+
+// Decode only the length, category, and direct control-flow targets of an
+// instruction. By default, this decodes the whole instruction.
+bool Arch::DecodeLengthAndCategory(uint64_t address,
+                                   std::string_view instr_bytes,
+                                   InstructionSummary &summary) const {
+  static thread_local Instruction inst;
+  inst.Reset();
+  inst.decode_error = DecodeError::kNone;
+  const auto ok = DecodeInstruction(address, instr_bytes, inst);
+  summary.pc = address;
+  summary.next_pc = ok ? inst.next_pc : address;
+  summary.branch_taken_pc = inst.branch_taken_pc;
+  summary.branch_not_taken_pc = inst.branch_not_taken_pc;
+  summary.category = ok ? inst.category : Instruction::kCategoryInvalid;
+  summary.has_branch_taken_delay_slot = inst.has_branch_taken_delay_slot;
+  summary.has_branch_not_taken_delay_slot =
+      inst.has_branch_not_taken_delay_slot;
+  summary.decode_error = inst.decode_error;
+  if (!ok && DecodeError::kNone == summary.decode_error) {
+    summary.decode_error = DecodeError::kInvalidEncoding;
+  }
+  return ok;
+}
+
+// Implements `DecodeInstructions` in terms of `decode`.
+size_t Arch::DecodeEachInstruction(
+    uint64_t address, std::string_view insts_bytes,
+    std::vector<Instruction> &insts, size_t max_insts, size_t max_inst_size,
+    llvm::function_ref<bool(uint64_t, std::string_view, Instruction &)> decode,
+    bool has_delay_slots) const {
+  size_t num_insts = 0;
+  size_t offset = 0;
+  uint64_t delayed_pc = 0;
+  bool next_is_delayed = false;
+  while (num_insts < max_insts && offset < insts_bytes.size()) {
+    if (num_insts == insts.size()) {
+      insts.emplace_back();
+    }
+
+    auto &inst = insts[num_insts];
+    inst.Reset();
+    inst.in_delay_slot = next_is_delayed && delayed_pc == address + offset;
+    if (!decode(address + offset, insts_bytes.substr(offset, max_inst_size),
+                inst) ||
+        inst.bytes.empty()) {
+      break;
+    }
+
+    offset += inst.bytes.size();
+    num_insts += 1;
+
+    // Decode the delay slot of `inst` as such, so that the two come out
+    // together.
+    next_is_delayed =
+        has_delay_slots && !inst.in_delay_slot && MayHaveDelaySlot(inst);
+    delayed_pc = inst.delayed_pc;
+  }
+
+  insts.resize(num_insts);
+  return num_insts;
+}
+
+// Add the registers named `names` to `regs`.
+void Arch::AddRegistersByName(
+    RegisterSet &regs, std::initializer_list<std::string_view> names) const {
+  for (auto name : names) {
+    if (name.empty()) {
+      continue;
+    } else if (auto reg = RegisterByName(name)) {
+      regs.Insert(reg);
+    }
+  }
+}
+
+// Add the registers used by `expr` to `regs`.
+static void AddExpressionRegisters(const Arch *arch, RegisterSet &regs,
+                                   const OperandExpression *expr) {
+  if (!expr) {
+    return;
+  } else if (auto llvm_op = std::get_if<LLVMOpExpr>(expr)) {
+    AddExpressionRegisters(arch, regs, llvm_op->op1);
+    AddExpressionRegisters(arch, regs, llvm_op->op2);
+  } else if (auto reg = std::get_if<const Register *>(expr)) {
+    if (*reg) {
+      regs.Insert(*reg);
+    }
+  } else if (auto name = std::get_if<std::string>(expr)) {
+    if (auto named_reg = arch->RegisterByName(*name)) {
+      regs.Insert(named_reg);
+    }
+  }
+}
+
+// Fill in the register sets of `inst` from its operands.
+void Arch::AddOperandRegisters(Instruction &inst) const {
+  inst.regs_read.Clear();
+  inst.regs_written.Clear();
+  if (impl->registers.empty()) {
+    return;
+  }
+
+  for (const auto &op : inst.operands) {
+    auto &regs = Operand::kActionWrite == op.action ? inst.regs_written
+                                                     : inst.regs_read;
+    switch (op.type) {
+      case Operand::kTypeRegister:
+        AddRegistersByName(regs, {op.reg.name});
+        break;
+      case Operand::kTypeShiftRegister:
+        AddRegistersByName(inst.regs_read, {op.shift_reg.reg.name});
+        break;
+      case Operand::kTypeAddress:
+        AddRegistersByName(inst.regs_read,
+                           {op.addr.base_reg.name, op.addr.index_reg.name,
+                            op.addr.segment_base_reg.name});
+        break;
+
+      // The registers inside of a larger expression are only read.
+      case Operand::kTypeExpression:
+      case Operand::kTypeRegisterExpression:
+      case Operand::kTypeImmediateExpression:
+      case Operand::kTypeAddressExpression:
+        if (op.expr && std::holds_alternative<LLVMOpExpr>(*op.expr)) {
+          AddExpressionRegisters(this, inst.regs_read, op.expr);
+        } else {
+          AddExpressionRegisters(this, regs, op.expr);
+        }
+        break;
+      default: break;
+    }
+  }
+}
+
+uint64_t Arch::MinInstructionAlign(void) const {
+  switch (arch_name) {
+    case kArchX86:
+    case kArchX86_AVX:
+    case kArchX86_AVX512:
+    case kArchAMD64:
+    case kArchAMD64_AVX:
+    case kArchAMD64_AVX512: return 1;
+    default: return 4;
+  }
+}
+
 // Returns `true` if memory access are little endian byte ordered.
 bool Arch::MemoryAccessIsLittleEndian(void) const {
   return true;
@@ -118,6 +504,22 @@ bool Arch::NextInstructionIsDelayed(const Instruction &, const Instruction &,
   return false;
 }
 
+// Returns `true` if `inst` might begin an idiom that can be fused with the
+// instruction that follows it.
+bool Arch::MayFuseWithNextInstruction(const Instruction &) const {
+  return false;
+}
+
+// Tries to fuse `inst` with the instruction that follows it.
+bool Arch::FuseWithNextInstruction(Instruction &, const Instruction &) const {
+  return false;
+}
+
+// Returns `true` if `inst` is a predicated instruction.
+bool Arch::IsPredicated(const Instruction &) const {
+  return false;
+}
+
 llvm::Triple Arch::BasicTriple(void) const {
   llvm::Triple triple;
   switch (os_name) {
@@ -268,11 +670,14 @@ llvm::FunctionType *Arch::LiftedFunctionType(void) const {
 // Return information about the register at offset `offset` in the `State`
 // structure.
 const Register *Arch::RegisterAtStateOffset(uint64_t offset) const {
-  auto &reg_by_offset = impl->reg_by_offset;
+  const auto &reg_by_offset = impl->table->reg_by_offset;
   if (offset >= reg_by_offset.size()) {
     return nullptr;
+  } else if (const auto index_plus_one = reg_by_offset[offset];
+             !index_plus_one || index_plus_one > impl->registers.size()) {
+    return nullptr;
   } else {
-    return reg_by_offset[offset];  // May be `nullptr`.
+    return impl->registers[index_plus_one - 1u].get();
   }
 }
 
@@ -283,55 +688,77 @@ void Arch::ForEachRegister(std::function<void(const Register *)> cb) const {
   }
 }
 
+// Number of registers, i.e. one more than the largest `Register::index`.
+unsigned Arch::NumRegisters(void) const {
+  return static_cast<unsigned>(impl->registers.size());
+}
+
+// Return information about a register, given its dense index.
+const Register *Arch::RegisterById(unsigned index) const {
+  if (index >= impl->registers.size()) {
+    return nullptr;
+  } else {
+    return impl->registers[index].get();
+  }
+}
+
 // Return information about a register, given its name.
-const Register *Arch::RegisterByName(std::string_view name_) const {
-  std::string name(name_.data(), name_.size());
-  auto [curr_val_it, added] =
-      impl->reg_by_name.emplace(std::move(name), nullptr);
-  if (added) {
+//
+// NOTE(pag): This doesn't modify the register table, so that it is safe to
+//            call concurrently.
+const Register *Arch::RegisterByName(std::string_view name) const {
+  const auto index = impl->table->FindByName(name);
+  if (index >= impl->registers.size()) {
     return nullptr;
   } else {
-    return curr_val_it->second;
+    return impl->registers[index].get();
   }
 }
 
 namespace {
 
-// NOTE(lukas): Structure that allows global caching of `Arch` objects,
-//              as key llvm::LLVMContext * is used. Eventually this should
-//              be removed in favor of Arch::Build/Get* but some old code may
-//              depend on this caching behaviour.
-struct AvailableArchs {
-  using ArchMap =
-      std::unordered_map<llvm::LLVMContext *, std::unique_ptr<const Arch>>;
-
-  static ArchMap cached;
-
-  static const Arch *GetOrCreate(llvm::LLVMContext *ctx, OSName os,
-                                 ArchName name) {
-    auto &arch = cached[ctx];
-    if (!arch) {
-      arch = Create(ctx, os, name);
-    }
-    return arch.get();
-  }
-
-  static const Arch *Get(llvm::LLVMContext *ctx) {
-    if (auto arch_it = cached.find(ctx); arch_it != cached.end())
-      return arch_it->second.get();
-    return nullptr;
-  }
+// Architectures that are shared via `Arch::GetCached`.
+struct ArchCache {
+  using Key = std::tuple<llvm::LLVMContext *, OSName, ArchName>;
 
-  static Arch::ArchPtr Create(llvm::LLVMContext *ctx, OSName os,
-                              ArchName name) {
-    return Arch::Build(ctx, os, name);
-  }
+  std::mutex lock;
+  std::map<Key, std::weak_ptr<const Arch>> archs;
 };
 
-AvailableArchs::ArchMap AvailableArchs::cached = {};
+static ArchCache &GetArchCache(void) {
+  static ArchCache cache;
+  return cache;
+}
 
 }  // namespace
 
+// Returns the architecture for `os` and `arch_name` within `context`, sharing
+// it with any other callers that currently hold one.
+auto Arch::GetCached(llvm::LLVMContext *context, OSName os,
+                     ArchName arch_name) -> SharedArchPtr {
+  auto &cache = GetArchCache();
+  std::lock_guard<std::mutex> locker(cache.lock);
+  auto &cached_arch = cache.archs[{context, os, arch_name}];
+  if (auto arch = cached_arch.lock()) {
+    return arch;
+  }
+
+  SharedArchPtr arch(Build(context, os, arch_name));
+  cached_arch = arch;
+
+  // Drop the entries of released architectures, so that the cache doesn't
+  // keep growing as contexts come and go.
+  for (auto it = cache.archs.begin(); it != cache.archs.end();) {
+    if (it->second.expired()) {
+      it = cache.archs.erase(it);
+    } else {
+      ++it;
+    }
+  }
+
+  return arch;
+}
+
 remill::Arch::ArchPtr Arch::GetModuleArch(const llvm::Module &module) {
   const llvm::Triple triple = llvm::Triple(module.getTargetTriple());
   return remill::Arch::Build(&module.getContext(), GetOSName(triple),
@@ -416,11 +843,15 @@ Register::Register(const std::string &name_, uint64_t offset_, uint64_t size_,
       offset(offset_),
       size(size_),
       type(type_),
-      constant_name(
-          llvm::ConstantDataArray::getString(type->getContext(), name_)),
       parent(parent_),
       arch(arch_) {}
 
+// Returns an LLVM constant that represents this register's name.
+llvm::Constant *Register::ConstantName(void) const {
+  InitLazyValues();
+  return constant_name;
+}
+
 // Returns the enclosing register of size AT LEAST `size`, or `nullptr`.
 const Register *Register::EnclosingRegisterOfSize(uint64_t size_) const {
   auto enclosing = this;
@@ -496,7 +927,7 @@ FinishAddressOf(llvm::IRBuilder<> &ir, const llvm::DataLayout &dl,
 
   CHECK_LT(gep_offset, state_size);
 
-  const auto index_type = reg->gep_index_list[0]->getType();
+  const auto index_type = llvm::Type::getInt32Ty(reg->type->getContext());
   const auto goal_ptr_type = llvm::PointerType::get(reg->type, addr_space);
 
   // Best case: we've found a value field in the structure that
@@ -557,6 +988,19 @@ FinishAddressOf(llvm::IRBuilder<> &ir, const llvm::DataLayout &dl,
 
 }  // namespace
 
+// Fill in the name constant and GEP indexes of this register on first use.
+void Register::InitLazyValues(void) const {
+  std::call_once(lazy_init, [this](void) {
+    auto &context = type->getContext();
+    constant_name = llvm::ConstantDataArray::getString(context, name);
+    gep_index_list.push_back(
+        llvm::Constant::getNullValue(llvm::Type::getInt32Ty(context)));
+    std::tie(gep_offset, gep_type_at_offset) =
+        BuildIndexes(*(arch->data_layout), arch->state_type, 0, offset,
+                     gep_index_list);
+  });
+}
+
 // Generate a GEP that will let us load/store to this register, given
 // a `State *`.
 llvm::Value *Register::AddressOf(llvm::Value *state_ptr,
@@ -582,6 +1026,7 @@ llvm::Value *Register::AddressOf(llvm::Value *state_ptr,
   const auto module = ir.GetInsertBlock()->getParent()->getParent();
   const auto &dl = module->getDataLayout();
 
+  InitLazyValues();
   llvm::Value *gep = nullptr;
   if (auto const_state_ptr = llvm::dyn_cast<llvm::Constant>(state_ptr);
       const_state_ptr) {
@@ -650,54 +1095,71 @@ const Register *Arch::AddRegister(const char *reg_name_, llvm::Type *val_type,
                                   size_t offset,
                                   const char *parent_reg_name) const {
 
-  const std::string reg_name(reg_name_);
-  auto &reg = impl->reg_by_name[reg_name];
-  if (reg) {
-    return reg;
+  const std::string_view reg_name(reg_name_);
+  auto &registers = impl->registers;
+  const auto index = impl->table->FindByName(reg_name);
+  if (index < registers.size()) {
+    return registers[index].get();
   }
 
-  const auto dl = this->DataLayout();
+  const auto &dl = *(impl->data_layout);
 
   // If this is a sub-register, then link it in.
   const Register *parent_reg = nullptr;
   if (parent_reg_name) {
-    parent_reg = impl->reg_by_name[parent_reg_name];
+    parent_reg = RegisterByName(parent_reg_name);
   }
 
-  llvm::SmallVector<llvm::Value *, 8> gep_index_list;
-  gep_index_list.push_back(
-      llvm::Constant::getNullValue(llvm::Type::getInt32Ty(*context)));
-
-  auto [gep_offset, gep_type_at_offset] =
-      BuildIndexes(dl, impl->state_type, 0, offset, gep_index_list);
-
+  // Registers without a type take that of the field at `offset`.
   if (!val_type) {
+    llvm::SmallVector<llvm::Value *, 8> gep_index_list;
+    gep_index_list.push_back(
+        llvm::Constant::getNullValue(llvm::Type::getInt32Ty(*context)));
+    auto [gep_offset, gep_type_at_offset] =
+        BuildIndexes(dl, impl->state_type, 0, offset, gep_index_list);
     CHECK_EQ(gep_offset, offset);
     val_type = gep_type_at_offset;
   }
 
-  auto reg_impl = new Register(reg_name, offset, dl.getTypeAllocSize(val_type),
-                               val_type, parent_reg, impl.get());
-  reg_impl->gep_index_list = std::move(gep_index_list);
-  reg_impl->gep_offset = gep_offset;
-  reg_impl->gep_type_at_offset = gep_type_at_offset;
-  reg = reg_impl;
-  impl->registers.emplace_back(reg_impl);
+  // Registers are added in the same order in every context, so this is
+  // usually the next register of a shared table.
+  const auto size = dl.getTypeAllocSize(val_type);
+  const auto in_table = index == registers.size() &&
+                        impl->table->regs[index].offset == offset &&
+                        impl->table->regs[index].size == size;
+
+  auto reg = new Register(std::string(reg_name), offset, size, val_type,
+                          parent_reg, impl.get());
+  reg->index = static_cast<unsigned>(registers.size());
 
   if (parent_reg) {
     const_cast<Register *>(reg->parent)->children.push_back(reg);
   }
 
+  if (in_table) {
+    registers.emplace_back(reg);
+    return reg;
+  }
+
+  auto &table = impl->MutableTable();
+  registers.emplace_back(reg);
+  table.regs.push_back({reg->name, offset, size});
+  table.reg_by_name[reg->name] = reg->index;
+
+  // Registers added after the name table was built must be findable too.
+  if (!table.reg_name_table.empty()) {
+    table.BuildNameTable();
+  }
+
   // Provide easy access to registers at specific offsets in the `State`
   // structure.
   for (auto i = reg->offset; i < (reg->offset + reg->size); ++i) {
-    auto &reg_at_offset = impl->reg_by_offset[i];
-    if (!reg_at_offset) {
-      reg_at_offset = reg;
-    } else if (reg_at_offset) {
-      CHECK_EQ(reg_at_offset->EnclosingRegister(), reg->EnclosingRegister());
-      reg_at_offset = reg;
+    auto &index_at_offset = table.reg_by_offset[i];
+    if (index_at_offset) {
+      CHECK_EQ(registers[index_at_offset - 1u]->EnclosingRegister(),
+               reg->EnclosingRegister());
     }
+    index_at_offset = reg->index + 1u;
   }
 
   return reg;
@@ -706,9 +1168,19 @@ const Register *Arch::AddRegister(const char *reg_name_, llvm::Type *val_type,
 // Get all of the register information from the prepared module.
 void Arch::InitFromSemanticsModule(llvm::Module *module) const {
   if (impl) {
+    CHECK(!impl->without_semantics)
+        << "Cannot use semantics with an architecture initialized by "
+        << "`InitWithoutSemanticsModule`";
     return;
   }
 
+  InitRegisters(module, false /* without_semantics */);
+}
+
+// Build the register table of this context from `module`. The description
+// of the registers is only built by the first context of each architecture,
+// and is shared by the later ones, which only add their types.
+void Arch::InitRegisters(llvm::Module *module, bool without_semantics) const {
   impl.reset(new ArchImpl);
   CHECK(!impl->state_type);
 
@@ -719,8 +1191,26 @@ void Arch::InitFromSemanticsModule(llvm::Module *module) const {
   const auto state_type =
       llvm::dyn_cast<llvm::StructType>(state_ptr_type->getPointerElementType());
 
+  const RegisterTableCache::Key table_key{os_name, arch_name,
+                                          without_semantics};
+  auto &table_cache = GetRegisterTableCache();
+  {
+    std::lock_guard<std::mutex> locker(table_cache.lock);
+    if (auto it = table_cache.tables.find(table_key);
+        it != table_cache.tables.end()) {
+      impl->table = it->second;
+    }
+  }
+
+  if (!impl->table) {
+    impl->own_table = std::make_shared<RegisterTable>();
+    impl->own_table->reg_by_offset.resize(dl.getTypeAllocSize(state_type));
+    impl->table = impl->own_table;
+  }
+
+  impl->without_semantics = without_semantics;
   impl->state_type = state_type;
-  impl->reg_by_offset.resize(dl.getTypeAllocSize(state_type));
+  impl->data_layout.emplace(dl);
   impl->memory_type = llvm::dyn_cast<llvm::PointerType>(
       NthArgument(basic_block, kMemoryPointerArgNum)->getType());
   impl->lifted_function_type = basic_block->getFunctionType();
@@ -755,6 +1245,12 @@ void Arch::InitFromSemanticsModule(llvm::Module *module) const {
     ir.CreateAlloca(addr, nullptr, "RETURN_PC");
     ir.CreateAlloca(addr, nullptr, "MONITOR");
 
+    // The value loaded by the last load-exclusive, which the native variants
+    // of the store-exclusives compare against.
+    if (IsAArch64()) {
+      ir.CreateAlloca(addr, nullptr, "MONITOR_VALUE");
+    }
+
     // NOTE(pag): `PC` and `NEXT_PC` are handled by
     //            `PopulateBasicBlockFunction`.
 
@@ -770,11 +1266,59 @@ void Arch::InitFromSemanticsModule(llvm::Module *module) const {
     ir.CreateRet(memory);
 
   } else {
-    CHECK(!impl->reg_by_name.empty());
+    CHECK(!impl->registers.empty());
+  }
+
+  // A shared table must describe exactly the registers of this context.
+  if (!impl->own_table &&
+      impl->registers.size() != impl->table->regs.size()) {
+    impl->MutableTable();
+  }
+
+  // Share the table that this context built with the later contexts.
+  if (impl->own_table) {
+    impl->own_table->BuildNameTable();
+    std::lock_guard<std::mutex> locker(table_cache.lock);
+    auto &shared_table = table_cache.tables[table_key];
+    if (!shared_table) {
+      shared_table = impl->own_table;
+      impl->own_table.reset();
+    }
   }
 
   CHECK(BlockHasSpecialVars(basic_block))
       << "Unable to locate required variables in `__remill_basic_block`.";
 }
 
+// Build the register table without a semantics module.
+void Arch::InitWithoutSemanticsModule(void) const {
+  if (impl) {
+    return;
+  }
+
+  // Model just enough of a semantics module for `PopulateBasicBlockFunction`
+  // to add the registers; nothing in `module` outlives this function.
+  llvm::Module module("remill_decode_only", *context);
+  PrepareModuleDataLayout(&module);
+
+  const auto byte_type = llvm::Type::getInt8Ty(*context);
+  const auto state_type = llvm::StructType::create(
+      *context, {llvm::ArrayType::get(byte_type, StateStructSize())},
+      "struct.DecodeOnlyState", true /* packed */);
+  const auto memory_type =
+      llvm::StructType::create(*context, "struct.DecodeOnlyMemory");
+
+  llvm::Type *param_types[kNumBlockArgs] = {};
+  param_types[kStatePointerArgNum] = llvm::PointerType::get(state_type, 0);
+  param_types[kPCArgNum] = llvm::Type::getIntNTy(*context, address_size);
+  param_types[kMemoryPointerArgNum] = llvm::PointerType::get(memory_type, 0);
+
+  const auto func_type = llvm::FunctionType::get(
+      param_types[kMemoryPointerArgNum], param_types, false);
+  llvm::Function::Create(func_type, llvm::GlobalValue::ExternalLinkage,
+                         "__remill_basic_block", &module);
+
+  InitRegisters(&module, true /* without_semantics */);
+}
+
 }  // namespace remill
@@ -0,0 +1,390 @@
+/*
+ * Copyright (c) 2020 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "remill/Arch/CompactInstruction.h"
+
+#include <glog/logging.h>
+
+#include <deque>
+#include <limits>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "remill/Arch/Arch.h"
+
+namespace remill {
+namespace {
+
+struct StringInterner {
+  StringInterner(void) {
+    strings.emplace_back();
+    ids.emplace(strings.back(), 0u);
+  }
+
+  std::mutex lock;
+
+  // A `std::deque` never moves its elements when it grows, so the keys of
+  // `ids` remain valid.
+  std::deque<std::string> strings;
+  std::unordered_map<std::string_view, uint32_t> ids;
+};
+
+static StringInterner &Interner(void) {
+  static StringInterner interner;
+  return interner;
+}
+
+template <typename T>
+static bool Fits(uint64_t val) {
+  return val <= std::numeric_limits<T>::max();
+}
+
+static bool CompactReg(const Operand::Register &reg, CompactRegister &out) {
+  if (!Fits<uint16_t>(reg.size)) {
+    return false;
+  }
+  out.name_id = InternString(reg.name);
+  out.size = static_cast<uint16_t>(reg.size);
+  return true;
+}
+
+static void ExpandReg(const CompactRegister &reg, Operand::Register &out) {
+  out.name.assign(InternedString(reg.name_id));
+  out.size = reg.size;
+  out.arch_reg = nullptr;
+}
+
+// Flatten the expression tree rooted at `expr` into `cinst`, placing operands
+// before their uses. Expressions shared between operands are only stored
+// once.
+static bool CompactExpr(const OperandExpression *expr,
+                        CompactInstruction &cinst,
+                        const OperandExpression **seen, uint8_t &index) {
+  if (!expr) {
+    index = CompactInstruction::kNoExpression;
+    return true;
+  }
+
+  for (uint8_t i = 0; i < cinst.num_exprs; ++i) {
+    if (seen[i] == expr) {
+      index = i;
+      return true;
+    }
+  }
+
+  CompactExpression node = {};
+  node.op1 = CompactInstruction::kNoExpression;
+  node.op2 = CompactInstruction::kNoExpression;
+  node.type = expr->type;
+
+  if (auto llvm_op = std::get_if<LLVMOpExpr>(expr)) {
+    if (!Fits<uint8_t>(llvm_op->llvm_opcode) ||
+        !CompactExpr(llvm_op->op1, cinst, seen, node.op1) ||
+        !CompactExpr(llvm_op->op2, cinst, seen, node.op2)) {
+      return false;
+    }
+    node.kind = CompactExpression::kLLVMOp;
+    node.llvm_opcode = static_cast<uint8_t>(llvm_op->llvm_opcode);
+
+  } else if (auto reg_op = std::get_if<const Register *>(expr)) {
+    node.kind = CompactExpression::kRegister;
+    node.reg = *reg_op;
+
+  } else if (auto const_op = std::get_if<llvm::Constant *>(expr)) {
+    node.kind = CompactExpression::kConstant;
+    node.constant = *const_op;
+
+  } else if (auto var_op = std::get_if<std::string>(expr)) {
+    node.kind = CompactExpression::kVariable;
+    node.name_id = InternString(*var_op);
+
+  } else {
+    return false;
+  }
+
+  if (cinst.num_exprs >= CompactInstruction::kMaxNumExpr) {
+    return false;
+  }
+
+  index = cinst.num_exprs++;
+  seen[index] = expr;
+  cinst.exprs[index] = node;
+  return true;
+}
+
+}  // namespace
+
+// Returns a small integer that uniquely identifies `str`.
+uint32_t InternString(std::string_view str) {
+  if (str.empty()) {
+    return 0;
+  }
+
+  auto &interner = Interner();
+  std::lock_guard<std::mutex> locker(interner.lock);
+  auto it = interner.ids.find(str);
+  if (it != interner.ids.end()) {
+    return it->second;
+  }
+
+  const auto id = static_cast<uint32_t>(interner.strings.size());
+  interner.strings.emplace_back(str);
+  interner.ids.emplace(interner.strings.back(), id);
+  return id;
+}
+
+// Returns the string that was interned as `id`.
+std::string_view InternedString(uint32_t id) {
+  if (!id) {
+    return {};
+  }
+
+  auto &interner = Interner();
+  std::lock_guard<std::mutex> locker(interner.lock);
+  CHECK_LT(id, interner.strings.size())
+      << "Invalid interned string ID " << id;
+  return interner.strings[id];
+}
+
+// Try to compact `inst` into this instruction.
+// Compact the register set `regs` into the `num_regs` indices of `ids`.
+static bool CompactRegs(const RegisterSet &regs, uint16_t *ids,
+                        uint8_t &num_regs) {
+  auto fits = true;
+  num_regs = 0;
+  regs.ForEachIndex([&](unsigned index) {
+    if (num_regs >= CompactInstruction::kMaxNumRegs ||
+        !Fits<uint16_t>(index)) {
+      fits = false;
+    } else {
+      ids[num_regs++] = static_cast<uint16_t>(index);
+    }
+  });
+  return fits;
+}
+
+// Expand the `num_regs` register indices of `ids` into `regs`.
+static void ExpandRegs(const Arch *arch, const uint16_t *ids, uint8_t num_regs,
+                       RegisterSet &regs) {
+  for (uint8_t i = 0; i < num_regs; ++i) {
+    if (auto reg = arch->RegisterById(ids[i])) {
+      regs.Insert(reg);
+    }
+  }
+}
+
+bool CompactInstruction::Compact(const Instruction &inst) {
+  if (inst.bytes.size() > kMaxNumBytes ||
+      inst.operands.size() > kMaxNumOperands) {
+    return false;
+  }
+
+  pc = inst.pc;
+  next_pc = inst.next_pc;
+  delayed_pc = inst.delayed_pc;
+  branch_taken_pc = inst.branch_taken_pc;
+  branch_not_taken_pc = inst.branch_not_taken_pc;
+  arch = inst.arch;
+  segment_override = inst.segment_override;
+  function_id = InternString(inst.function);
+  arch_name = inst.arch_name;
+  category = inst.category;
+  is_atomic_read_modify_write = inst.is_atomic_read_modify_write;
+  has_branch_taken_delay_slot = inst.has_branch_taken_delay_slot;
+  has_branch_not_taken_delay_slot = inst.has_branch_not_taken_delay_slot;
+  in_delay_slot = inst.in_delay_slot;
+
+  num_bytes = static_cast<uint8_t>(inst.bytes.size());
+  inst.bytes.copy(reinterpret_cast<char *>(bytes), num_bytes);
+
+  if (!CompactRegs(inst.regs_read, regs_read, num_regs_read) ||
+      !CompactRegs(inst.regs_written, regs_written, num_regs_written)) {
+    return false;
+  }
+
+  const OperandExpression *seen[kMaxNumExpr] = {};
+  num_exprs = 0;
+  num_operands = 0;
+
+  for (const auto &op : inst.operands) {
+    auto &cop = operands[num_operands++];
+    cop = {};
+
+    if (!Fits<uint32_t>(op.size) || !Fits<uint16_t>(op.shift_reg.shift_size) ||
+        !Fits<uint16_t>(op.shift_reg.extract_size) ||
+        !Fits<uint16_t>(op.addr.address_size) ||
+        op.addr.scale > std::numeric_limits<int32_t>::max() ||
+        op.addr.scale < std::numeric_limits<int32_t>::min()) {
+      return false;
+    }
+
+    cop.type = op.type;
+    cop.action = op.action;
+    cop.size = static_cast<uint32_t>(op.size);
+
+    switch (op.type) {
+      case Operand::kTypeRegister:
+      case Operand::kTypeRegisterExpression:
+        if (!CompactReg(op.reg, cop.reg)) {
+          return false;
+        }
+        break;
+
+      case Operand::kTypeShiftRegister:
+        if (!CompactReg(op.shift_reg.reg, cop.reg)) {
+          return false;
+        }
+        cop.shift_size = static_cast<uint16_t>(op.shift_reg.shift_size);
+        cop.extract_size = static_cast<uint16_t>(op.shift_reg.extract_size);
+        cop.shift_first = op.shift_reg.shift_first;
+        cop.shift_op = op.shift_reg.shift_op;
+        cop.extend_op = op.shift_reg.extend_op;
+        break;
+
+      case Operand::kTypeImmediate:
+      case Operand::kTypeImmediateExpression:
+        cop.val = op.imm.val;
+        cop.is_signed = op.imm.is_signed;
+        break;
+
+      case Operand::kTypeAddress:
+      case Operand::kTypeAddressExpression:
+        if (!CompactReg(op.addr.segment_base_reg, cop.segment_base_reg) ||
+            !CompactReg(op.addr.base_reg, cop.base_reg) ||
+            !CompactReg(op.addr.index_reg, cop.index_reg)) {
+          return false;
+        }
+        cop.scale = static_cast<int32_t>(op.addr.scale);
+        cop.val = static_cast<uint64_t>(op.addr.displacement);
+        cop.address_size = static_cast<uint16_t>(op.addr.address_size);
+        cop.addr_kind = op.addr.kind;
+        break;
+
+      case Operand::kTypeInvalid:
+      case Operand::kTypeExpression: break;
+    }
+
+    if (!CompactExpr(op.expr, *this, seen, cop.expr)) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+// Expand this instruction into `inst`.
+void CompactInstruction::Expand(Instruction &inst) const {
+  inst.Reset();
+  inst.pc = pc;
+  inst.next_pc = next_pc;
+  inst.delayed_pc = delayed_pc;
+  inst.branch_taken_pc = branch_taken_pc;
+  inst.branch_not_taken_pc = branch_not_taken_pc;
+  inst.arch = arch;
+  inst.segment_override = segment_override;
+  inst.function.assign(Function());
+  inst.bytes.assign(Bytes());
+  inst.arch_name = arch_name;
+  inst.category = category;
+  inst.is_atomic_read_modify_write = is_atomic_read_modify_write;
+  inst.has_branch_taken_delay_slot = has_branch_taken_delay_slot;
+  inst.has_branch_not_taken_delay_slot = has_branch_not_taken_delay_slot;
+  inst.in_delay_slot = in_delay_slot;
+
+  if (arch) {
+    ExpandRegs(arch, regs_read, num_regs_read, inst.regs_read);
+    ExpandRegs(arch, regs_written, num_regs_written, inst.regs_written);
+  }
+
+  // Operands of each expression are stored before it, so they have always
+  // been expanded by the time they're needed.
+  OperandExpression *expanded[kMaxNumExpr] = {};
+  auto get_expr = [&](uint8_t index) -> OperandExpression * {
+    return index == kNoExpression ? nullptr : expanded[index];
+  };
+
+  for (uint8_t i = 0; i < num_exprs; ++i) {
+    const auto &node = exprs[i];
+    auto expr = inst.AllocateExpression();
+    switch (node.kind) {
+      case CompactExpression::kLLVMOp:
+        expr->emplace<LLVMOpExpr>(LLVMOpExpr{
+            node.llvm_opcode, get_expr(node.op1), get_expr(node.op2)});
+        break;
+      case CompactExpression::kRegister:
+        expr->emplace<const Register *>(node.reg);
+        break;
+      case CompactExpression::kConstant:
+        expr->emplace<llvm::Constant *>(node.constant);
+        break;
+      case CompactExpression::kVariable:
+        expr->emplace<std::string>(InternedString(node.name_id));
+        break;
+      case CompactExpression::kInvalid:
+        LOG(FATAL) << "Invalid compact expression";
+        break;
+    }
+    expr->type = node.type;
+    expanded[i] = expr;
+  }
+
+  inst.operands.resize(num_operands);
+  for (uint8_t i = 0; i < num_operands; ++i) {
+    const auto &cop = operands[i];
+    auto &op = inst.operands[i];
+    op.type = cop.type;
+    op.action = cop.action;
+    op.size = cop.size;
+    op.expr = get_expr(cop.expr);
+
+    switch (cop.type) {
+      case Operand::kTypeRegister:
+      case Operand::kTypeRegisterExpression: ExpandReg(cop.reg, op.reg); break;
+
+      case Operand::kTypeShiftRegister:
+        ExpandReg(cop.reg, op.shift_reg.reg);
+        op.shift_reg.shift_size = cop.shift_size;
+        op.shift_reg.extract_size = cop.extract_size;
+        op.shift_reg.shift_first = cop.shift_first;
+        op.shift_reg.shift_op = cop.shift_op;
+        op.shift_reg.extend_op = cop.extend_op;
+        break;
+
+      case Operand::kTypeImmediate:
+      case Operand::kTypeImmediateExpression:
+        op.imm.val = cop.val;
+        op.imm.is_signed = cop.is_signed;
+        break;
+
+      case Operand::kTypeAddress:
+      case Operand::kTypeAddressExpression:
+        ExpandReg(cop.segment_base_reg, op.addr.segment_base_reg);
+        ExpandReg(cop.base_reg, op.addr.base_reg);
+        ExpandReg(cop.index_reg, op.addr.index_reg);
+        op.addr.scale = cop.scale;
+        op.addr.displacement = static_cast<int64_t>(cop.val);
+        op.addr.address_size = cop.address_size;
+        op.addr.kind = cop.addr_kind;
+        break;
+
+      case Operand::kTypeInvalid:
+      case Operand::kTypeExpression: break;
+    }
+  }
+}
+
+}  // namespace remill
@@ -20,6 +20,7 @@
 #include <llvm/IR/Instruction.h>
 #include <llvm/IR/Instructions.h>
 
+#include <algorithm>
 #include <iomanip>
 #include <sstream>
 
@@ -29,6 +30,67 @@
 
 namespace remill {
 
+void RegisterSet::Insert(const Register *reg) {
+  const auto word = reg->index / 64u;
+  if (word >= words.size()) {
+    words.resize(word + 1u, 0);
+  }
+  words[word] |= 1ull << (reg->index % 64u);
+}
+
+bool RegisterSet::Contains(const Register *reg) const {
+  const auto word = reg->index / 64u;
+  return word < words.size() && ((words[word] >> (reg->index % 64u)) & 1u);
+}
+
+// Returns `true` if some register is in both this set and `that`.
+bool RegisterSet::Intersects(const RegisterSet &that) const {
+  const auto size = std::min(words.size(), that.words.size());
+  for (size_t i = 0; i < size; ++i) {
+    if (words[i] & that.words[i]) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool RegisterSet::Empty(void) const {
+  for (auto word : words) {
+    if (word) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Remove all registers, retaining the storage.
+void RegisterSet::Clear(void) {
+  std::fill(words.begin(), words.end(), 0);
+}
+
+RegisterSet &RegisterSet::operator|=(const RegisterSet &that) {
+  if (that.words.size() > words.size()) {
+    words.resize(that.words.size(), 0);
+  }
+  for (size_t i = 0; i < that.words.size(); ++i) {
+    words[i] |= that.words[i];
+  }
+  return *this;
+}
+
+// Sets are equal if they have the same registers, regardless of how much
+// storage they have.
+bool RegisterSet::operator==(const RegisterSet &that) const {
+  const auto &small = words.size() < that.words.size() ? words : that.words;
+  const auto &big = words.size() < that.words.size() ? that.words : words;
+  for (size_t i = 0; i < big.size(); ++i) {
+    if (big[i] != (i < small.size() ? small[i] : 0)) {
+      return false;
+    }
+  }
+  return true;
+}
+
 std::string OperandExpression::Serialize(void) const {
   std::stringstream ss;
   if (auto llvm_op = std::get_if<LLVMOpExpr>(this)) {
@@ -301,6 +363,16 @@ std::string Condition::Serialize(void) const {
   return ss.str();
 }
 
+const char *GetDecodeErrorName(DecodeError error) {
+  switch (error) {
+    case DecodeError::kNone: return "none";
+    case DecodeError::kTruncated: return "truncated";
+    case DecodeError::kMisaligned: return "misaligned";
+    case DecodeError::kInvalidEncoding: return "invalid encoding";
+    case DecodeError::kUnsupported: return "unsupported";
+  }
+  return "unknown";
+}
 
 Instruction::Instruction(void)
     : pc(0),
@@ -314,8 +386,64 @@ Instruction::Instruction(void)
       has_branch_taken_delay_slot(false),
       has_branch_not_taken_delay_slot(false),
       in_delay_slot(false),
+      decode_error(DecodeError::kNone),
       category(Instruction::kCategoryInvalid) {}
 
+Instruction::Instruction(const Instruction &that) : Instruction() {
+  *this = that;
+}
+
+Instruction &Instruction::operator=(const Instruction &that) {
+  if (this == &that) {
+    return *this;
+  }
+
+  function = that.function;
+  bytes = that.bytes;
+  pc = that.pc;
+  next_pc = that.next_pc;
+  delayed_pc = that.delayed_pc;
+  branch_taken_pc = that.branch_taken_pc;
+  branch_not_taken_pc = that.branch_not_taken_pc;
+  arch_name = that.arch_name;
+  arch = that.arch;
+  is_atomic_read_modify_write = that.is_atomic_read_modify_write;
+  has_branch_taken_delay_slot = that.has_branch_taken_delay_slot;
+  has_branch_not_taken_delay_slot = that.has_branch_not_taken_delay_slot;
+  in_delay_slot = that.in_delay_slot;
+  decode_error = that.decode_error;
+  segment_override = that.segment_override;
+  regs_read = that.regs_read;
+  regs_written = that.regs_written;
+  category = that.category;
+  operands = that.operands;
+  next_expr_index = that.next_expr_index;
+
+  // Operand expressions refer to each other (and are referred to by the
+  // operands) by pointer, so those pointers need to be moved over to refer
+  // into `exprs` of this instruction.
+  auto rebase = [&that, this](OperandExpression *expr) -> OperandExpression * {
+    if (expr >= &(that.exprs[0]) && expr < &(that.exprs[kMaxNumExpr])) {
+      return &(exprs[expr - &(that.exprs[0])]);
+    }
+    return expr;
+  };
+
+  for (auto i = 0u; i < next_expr_index; ++i) {
+    exprs[i] = that.exprs[i];
+    if (auto llvm_op = std::get_if<LLVMOpExpr>(&(exprs[i]))) {
+      llvm_op->op1 = rebase(llvm_op->op1);
+      llvm_op->op2 = rebase(llvm_op->op2);
+    }
+  }
+
+  for (auto &op : operands) {
+    op.expr = rebase(op.expr);
+  }
+
+  return *this;
+}
+
 void Instruction::Reset(void) {
   pc = 0;
   next_pc = 0;
@@ -327,8 +455,11 @@ void Instruction::Reset(void) {
   has_branch_taken_delay_slot = false;
   has_branch_not_taken_delay_slot = false;
   in_delay_slot = false;
+  decode_error = DecodeError::kNone;
   category = Instruction::kCategoryInvalid;
   arch = nullptr;
+  regs_read.Clear();
+  regs_written.Clear();
   operands.clear();
   function.clear();
   bytes.clear();
@@ -361,7 +492,14 @@ OperandExpression *Instruction::EmplaceConstant(llvm::Constant *val) {
 OperandExpression *Instruction::EmplaceVariable(std::string_view var_name,
                                                 llvm::Type *type) {
   auto expr = AllocateExpression();
-  expr->emplace<std::string>(var_name.data(), var_name.size());
+
+  // Reuse the storage of a name left behind by a previously decoded
+  // instruction, if any.
+  if (auto name = std::get_if<std::string>(expr)) {
+    name->assign(var_name.data(), var_name.size());
+  } else {
+    expr->emplace<std::string>(var_name.data(), var_name.size());
+  }
   expr->type = type;
   return expr;
 }
@@ -0,0 +1,638 @@
+/*
+ * Copyright (c) 2020 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "remill/Arch/InstructionArchive.h"
+
+#include <glog/logging.h>
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/DerivedTypes.h>
+#include <llvm/Support/MemoryBuffer.h>
+
+#include <algorithm>
+#include <cstring>
+
+#include "remill/Arch/Arch.h"
+#include "remill/Arch/CompactInstruction.h"
+#include "remill/BC/Version.h"
+#include "remill/OS/FileSystem.h"
+
+namespace remill {
+namespace {
+
+// The layout of an archive is:
+//
+//    Header:   magic, version, arch name, number of instructions, offset of
+//              the index, number of strings, and offset of the strings.
+//    Records:  one per instruction, each aligned to `kRecordAlign` bytes.
+//    Index:    (PC, record offset) of each instruction, sorted by PC.
+//    Strings:  (offset, size) of each string; then the strings. String ID
+//              `n` is the `n - 1`th string, and ID `0` is the empty string.
+//
+// A record is a fixed-size part, laid out as:
+//
+//      0   PC, next PC, delayed PC, branch taken PC, branch not taken PC
+//     40   string ID of the semantics function
+//     44   string ID of the segment override register
+//     48   category, flags, number of bytes, operands, expressions, registers
+//          read, and registers written, and the arch name
+//     56   bytes, padded to 16
+//
+// followed by `kOperandSize` bytes per operand, `kExprSize` bytes per
+// operand expression, and then the string IDs of the registers read and
+// written. Expressions are flattened as in `CompactInstruction`, so that the
+// operands of an expression come before it.
+//
+// All integers are little-endian.
+static constexpr char kMagic[8] = {'R', 'E', 'M', 'I', 'L', 'L', 'I', 'A'};
+static constexpr uint32_t kVersion = 1;
+static constexpr size_t kHeaderSize = 48;
+static constexpr size_t kIndexEntrySize = 16;
+static constexpr size_t kStringEntrySize = 8;
+static constexpr size_t kRecordSize = 72;
+static constexpr size_t kOperandSize = 64;
+static constexpr size_t kExprSize = 24;
+static constexpr size_t kRegisterSize = 8;
+static constexpr uint64_t kRecordAlign = 8;
+
+// Flags of a record.
+static constexpr uint8_t kIsAtomicReadModifyWrite = 1u << 0;
+static constexpr uint8_t kHasBranchTakenDelaySlot = 1u << 1;
+static constexpr uint8_t kHasBranchNotTakenDelaySlot = 1u << 2;
+static constexpr uint8_t kInDelaySlot = 1u << 3;
+
+// Flags of an operand.
+static constexpr uint8_t kShiftFirst = 1u << 0;
+static constexpr uint8_t kIsSigned = 1u << 1;
+
+// The type of an expression that has the type of its register.
+static constexpr uint32_t kRegisterType = ~0u;
+
+static void AppendLE(std::string &out, uint64_t val, unsigned size) {
+  for (auto i = 0u; i < size; ++i) {
+    out.push_back(static_cast<char>(val >> (i * 8u)));
+  }
+}
+
+static uint64_t ReadLE(const char *data, unsigned size) {
+  uint64_t val = 0;
+  for (auto i = 0u; i < size; ++i) {
+    val |= static_cast<uint64_t>(static_cast<uint8_t>(data[i])) << (i * 8u);
+  }
+  return val;
+}
+
+static std::string EncodeHeader(uint32_t arch_name, uint64_t num_insts,
+                                uint64_t index_offset, uint64_t num_strings,
+                                uint64_t strings_offset) {
+  std::string header(kMagic, sizeof(kMagic));
+  AppendLE(header, kVersion, 4);
+  AppendLE(header, arch_name, 4);
+  AppendLE(header, num_insts, 8);
+  AppendLE(header, index_offset, 8);
+  AppendLE(header, num_strings, 8);
+  AppendLE(header, strings_offset, 8);
+  return header;
+}
+
+}  // namespace
+
+InstructionArchiveWriter::InstructionArchiveWriter(std::string_view path_)
+    : path(path_.data(), path_.size()),
+      tmp_path(path + ".tmp"),
+      out(tmp_path, std::ios::binary | std::ios::trunc) {
+
+  // The header is rewritten once the index has been written.
+  out << EncodeHeader(0, 0, 0, 0, 0);
+  ok = static_cast<bool>(out);
+  LOG_IF(ERROR, !ok) << "Could not create instruction archive " << tmp_path;
+}
+
+InstructionArchiveWriter::~InstructionArchiveWriter(void) {
+  if (!finished) {
+    out.close();
+    RemoveFile(tmp_path);
+  }
+}
+
+// Returns the ID of `str` in the string table.
+uint32_t InstructionArchiveWriter::StringId(std::string_view str) {
+  if (str.empty()) {
+    return 0;
+  }
+  auto [it, added] = string_ids.emplace(std::string(str), 0u);
+  if (added) {
+    strings.emplace_back(str);
+    it->second = static_cast<uint32_t>(strings.size());
+  }
+  return it->second;
+}
+
+// Add `inst` to the archive.
+bool InstructionArchiveWriter::AddInstruction(const Instruction &inst) {
+  CHECK(!finished) << "Can't add instructions to a finished archive";
+  if (!ok || !inst.IsValid() || !inst.arch || pcs.count(inst.pc)) {
+    return false;
+  }
+
+  const auto inst_arch_name = static_cast<uint32_t>(inst.arch->arch_name);
+  if (!index.empty() && inst_arch_name != arch_name) {
+    LOG(ERROR) << "Instruction at " << std::hex << inst.pc << std::dec
+               << " was decoded for another architecture than the other "
+               << "instructions of archive " << path;
+    return false;
+  }
+
+  CompactInstruction cinst;
+  if (!cinst.Compact(inst)) {
+    return false;
+  }
+
+  std::string record;
+  AppendLE(record, cinst.pc, 8);
+  AppendLE(record, cinst.next_pc, 8);
+  AppendLE(record, cinst.delayed_pc, 8);
+  AppendLE(record, cinst.branch_taken_pc, 8);
+  AppendLE(record, cinst.branch_not_taken_pc, 8);
+  AppendLE(record, StringId(inst.function), 4);
+  AppendLE(record,
+           StringId(inst.segment_override ? inst.segment_override->name : ""),
+           4);
+
+  uint8_t flags = 0;
+  flags |= cinst.is_atomic_read_modify_write ? kIsAtomicReadModifyWrite : 0;
+  flags |= cinst.has_branch_taken_delay_slot ? kHasBranchTakenDelaySlot : 0;
+  flags |=
+      cinst.has_branch_not_taken_delay_slot ? kHasBranchNotTakenDelaySlot : 0;
+  flags |= cinst.in_delay_slot ? kInDelaySlot : 0;
+  AppendLE(record, cinst.category, 1);
+  AppendLE(record, flags, 1);
+  AppendLE(record, cinst.num_bytes, 1);
+  AppendLE(record, cinst.num_operands, 1);
+  AppendLE(record, cinst.num_exprs, 1);
+  AppendLE(record, cinst.num_regs_read, 1);
+  AppendLE(record, cinst.num_regs_written, 1);
+  AppendLE(record, cinst.arch_name, 1);
+  record.append(reinterpret_cast<const char *>(cinst.bytes), cinst.num_bytes);
+  record.append(16u - cinst.num_bytes, '\0');
+
+  auto append_reg = [&](const CompactRegister &reg) {
+    AppendLE(record, StringId(InternedString(reg.name_id)), 4);
+    AppendLE(record, reg.size, 4);
+  };
+
+  for (uint8_t i = 0; i < cinst.num_operands; ++i) {
+    const auto &op = cinst.operands[i];
+    AppendLE(record, op.type, 1);
+    AppendLE(record, op.action, 1);
+    AppendLE(record, op.shift_op, 1);
+    AppendLE(record, op.extend_op, 1);
+    AppendLE(record, op.addr_kind, 1);
+    uint8_t op_flags = 0;
+    op_flags |= op.shift_first ? kShiftFirst : 0;
+    op_flags |= op.is_signed ? kIsSigned : 0;
+    AppendLE(record, op_flags, 1);
+    AppendLE(record, op.expr, 1);
+    AppendLE(record, 0, 1);
+    AppendLE(record, op.shift_size, 2);
+    AppendLE(record, op.extract_size, 2);
+    AppendLE(record, op.address_size, 2);
+    AppendLE(record, 0, 2);
+    AppendLE(record, op.size, 4);
+    AppendLE(record, static_cast<uint32_t>(op.scale), 4);
+    AppendLE(record, op.val, 8);
+    append_reg(op.reg);
+    append_reg(op.segment_base_reg);
+    append_reg(op.base_reg);
+    append_reg(op.index_reg);
+  }
+
+  // Only integer constants and types can be stored by value.
+  for (uint8_t i = 0; i < cinst.num_exprs; ++i) {
+    const auto &expr = cinst.exprs[i];
+    uint32_t name_id = 0;
+    uint32_t type = 0;
+    uint32_t val_size = 0;
+    uint64_t val = 0;
+    if (expr.kind == CompactExpression::kVariable) {
+      name_id = StringId(InternedString(expr.name_id));
+    } else if (expr.kind == CompactExpression::kRegister) {
+      if (!expr.reg) {
+        return false;
+      }
+      name_id = StringId(expr.reg->name);
+    } else if (expr.kind == CompactExpression::kConstant) {
+      auto ci = llvm::dyn_cast_or_null<llvm::ConstantInt>(expr.constant);
+      if (!ci || ci->getBitWidth() > 64) {
+        return false;
+      }
+      val_size = ci->getBitWidth();
+      val = ci->getZExtValue();
+    }
+
+    if (!expr.type) {
+      type = 0;
+    } else if (expr.kind == CompactExpression::kRegister &&
+               expr.type == expr.reg->type) {
+      type = kRegisterType;
+    } else if (auto int_type = llvm::dyn_cast<llvm::IntegerType>(expr.type)) {
+      type = int_type->getBitWidth();
+    } else {
+      return false;
+    }
+
+    AppendLE(record, expr.kind, 1);
+    AppendLE(record, expr.llvm_opcode, 1);
+    AppendLE(record, expr.op1, 1);
+    AppendLE(record, expr.op2, 1);
+    AppendLE(record, name_id, 4);
+    AppendLE(record, type, 4);
+    AppendLE(record, val_size, 4);
+    AppendLE(record, val, 8);
+  }
+
+  auto append_regs = [&](const uint16_t *ids, uint8_t num_regs) {
+    for (uint8_t i = 0; i < num_regs; ++i) {
+      const auto reg = inst.arch->RegisterById(ids[i]);
+      AppendLE(record, StringId(reg ? reg->name : ""), 4);
+    }
+  };
+  append_regs(cinst.regs_read, cinst.num_regs_read);
+  append_regs(cinst.regs_written, cinst.num_regs_written);
+  record.append((kRecordAlign - (record.size() % kRecordAlign)) % kRecordAlign,
+                '\0');
+
+  const auto offset = static_cast<uint64_t>(out.tellp());
+  out << record;
+  ok = static_cast<bool>(out);
+  if (!ok) {
+    LOG(ERROR) << "Could not write instruction archive " << tmp_path;
+    return false;
+  }
+
+  arch_name = inst_arch_name;
+  index.emplace_back(cinst.pc, offset);
+  pcs.insert(cinst.pc);
+  return true;
+}
+
+// Write the index and the string table, and move the archive into place.
+bool InstructionArchiveWriter::Finish(void) {
+  CHECK(!finished) << "Instruction archive " << path << " was already finished";
+  if (!ok) {
+    return false;
+  }
+
+  std::sort(index.begin(), index.end());
+
+  std::string tables;
+  for (auto [pc, offset] : index) {
+    AppendLE(tables, pc, 8);
+    AppendLE(tables, offset, 8);
+  }
+
+  const auto index_offset = static_cast<uint64_t>(out.tellp());
+  const auto strings_offset = index_offset + tables.size();
+  uint64_t string_offset = 0;
+  for (const auto &str : strings) {
+    AppendLE(tables, string_offset, 4);
+    AppendLE(tables, str.size(), 4);
+    string_offset += str.size();
+  }
+  for (const auto &str : strings) {
+    tables += str;
+  }
+
+  out << tables;
+  out.seekp(0);
+  out << EncodeHeader(arch_name, index.size(), index_offset, strings.size(),
+                      strings_offset);
+  out.close();
+  if (!out) {
+    LOG(ERROR) << "Could not write instruction archive " << tmp_path;
+    return false;
+  }
+
+  MoveFile(tmp_path, path);
+  finished = true;
+  return true;
+}
+
+InstructionArchive::~InstructionArchive(void) {}
+
+InstructionArchive::InstructionArchive(
+    const Arch *arch_, std::unique_ptr<llvm::MemoryBuffer> buffer_)
+    : arch(arch_),
+      buffer(std::move(buffer_)) {}
+
+// Map the archive at `path`.
+std::unique_ptr<InstructionArchive>
+InstructionArchive::Open(const Arch *arch, std::string_view path) {
+  const llvm::StringRef file_name(path.data(), path.size());
+#if LLVM_VERSION_NUMBER >= LLVM_VERSION(13, 0)
+  auto maybe_buffer = llvm::MemoryBuffer::getFile(
+      file_name, false /* IsText */, false /* RequiresNullTerminator */);
+#else
+  auto maybe_buffer = llvm::MemoryBuffer::getFile(
+      file_name, -1 /* FileSize */, false /* RequiresNullTerminator */);
+#endif
+  if (!maybe_buffer) {
+    LOG(ERROR) << "Could not open instruction archive " << path << ": "
+               << maybe_buffer.getError().message();
+    return nullptr;
+  }
+
+  auto buffer = std::move(maybe_buffer.get());
+  const auto data = buffer->getBufferStart();
+  const auto size = buffer->getBufferSize();
+  if (size < kHeaderSize || memcmp(data, kMagic, sizeof(kMagic)) ||
+      ReadLE(&(data[8]), 4) != kVersion) {
+    LOG(ERROR) << "File " << path << " is not an instruction archive";
+    return nullptr;
+  }
+
+  const auto arch_name = ReadLE(&(data[12]), 4);
+  const auto num_insts = ReadLE(&(data[16]), 8);
+  const auto index_offset = ReadLE(&(data[24]), 8);
+  const auto num_strings = ReadLE(&(data[32]), 8);
+  const auto strings_offset = ReadLE(&(data[40]), 8);
+  if (num_insts && arch_name != static_cast<uint64_t>(arch->arch_name)) {
+    LOG(ERROR) << "Instruction archive " << path
+               << " was written for another architecture";
+    return nullptr;
+  }
+
+  if (index_offset > size || num_insts > size / kIndexEntrySize ||
+      strings_offset != index_offset + num_insts * kIndexEntrySize ||
+      strings_offset > size || num_strings > size / kStringEntrySize ||
+      num_strings * kStringEntrySize > size - strings_offset) {
+    LOG(ERROR) << "Instruction archive " << path << " is truncated";
+    return nullptr;
+  }
+
+  std::unique_ptr<InstructionArchive> archive(
+      new InstructionArchive(arch, std::move(buffer)));
+  archive->num_insts = num_insts;
+  archive->num_strings = num_strings;
+  archive->index = &(data[index_offset]);
+  archive->string_table = &(data[strings_offset]);
+  archive->strings = &(archive->string_table[num_strings * kStringEntrySize]);
+  archive->strings_size =
+      size - strings_offset - num_strings * kStringEntrySize;
+  return archive;
+}
+
+// Number of instructions in the archive.
+size_t InstructionArchive::NumInstructions(void) const {
+  return num_insts;
+}
+
+// Returns the record of the instruction at `pc`, or `nullptr`.
+const char *InstructionArchive::FindRecord(uint64_t pc) const {
+  size_t low = 0;
+  size_t high = num_insts;
+  while (low < high) {
+    const auto mid = low + (high - low) / 2;
+    if (ReadLE(&(index[mid * kIndexEntrySize]), 8) < pc) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  if (low >= num_insts || ReadLE(&(index[low * kIndexEntrySize]), 8) != pc) {
+    return nullptr;
+  }
+
+  // Records are stored before the index.
+  const auto offset = ReadLE(&(index[low * kIndexEntrySize + 8]), 8);
+  const auto records_end =
+      static_cast<uint64_t>(index - buffer->getBufferStart());
+  if (offset < kHeaderSize || offset > records_end ||
+      kRecordSize > records_end - offset) {
+    return nullptr;
+  }
+  const auto record = &(buffer->getBufferStart()[offset]);
+  const auto var_size =
+      ReadLE(&(record[51]), 1) * kOperandSize +
+      ReadLE(&(record[52]), 1) * kExprSize +
+      (ReadLE(&(record[53]), 1) + ReadLE(&(record[54]), 1)) * 4;
+  if (var_size > records_end - offset - kRecordSize) {
+    return nullptr;
+  }
+  return record;
+}
+
+// Returns `true` if the archive contains an instruction at `pc`.
+bool InstructionArchive::HasInstruction(uint64_t pc) const {
+  return FindRecord(pc) != nullptr;
+}
+
+// Sets `str` to the string with the ID `id`.
+bool InstructionArchive::GetString(uint32_t id, std::string_view &str) const {
+  if (!id) {
+    str = {};
+    return true;
+  } else if (id > num_strings) {
+    return false;
+  }
+  const auto entry = &(string_table[(id - 1u) * kStringEntrySize]);
+  const auto offset = ReadLE(entry, 4);
+  const auto size = ReadLE(&(entry[4]), 4);
+  if (offset > strings_size || size > strings_size - offset) {
+    return false;
+  }
+  str = std::string_view(&(strings[offset]), size);
+  return true;
+}
+
+// Expand the instruction at `pc` into `inst`.
+bool InstructionArchive::LoadInstruction(uint64_t pc, Instruction &inst) const {
+  const auto record = FindRecord(pc);
+  if (!record) {
+    return false;
+  }
+
+  CompactInstruction cinst = {};
+  cinst.pc = ReadLE(&(record[0]), 8);
+  cinst.next_pc = ReadLE(&(record[8]), 8);
+  cinst.delayed_pc = ReadLE(&(record[16]), 8);
+  cinst.branch_taken_pc = ReadLE(&(record[24]), 8);
+  cinst.branch_not_taken_pc = ReadLE(&(record[32]), 8);
+  cinst.arch = arch;
+
+  std::string_view str;
+  if (!GetString(static_cast<uint32_t>(ReadLE(&(record[40]), 4)), str)) {
+    return false;
+  }
+  cinst.function_id = InternString(str);
+
+  if (!GetString(static_cast<uint32_t>(ReadLE(&(record[44]), 4)), str)) {
+    return false;
+  } else if (!str.empty()) {
+    cinst.segment_override = arch->RegisterByName(str);
+    if (!cinst.segment_override) {
+      return false;
+    }
+  }
+
+  const auto flags = static_cast<uint8_t>(record[49]);
+  cinst.category = static_cast<Instruction::Category>(record[48]);
+  cinst.is_atomic_read_modify_write = flags & kIsAtomicReadModifyWrite;
+  cinst.has_branch_taken_delay_slot = flags & kHasBranchTakenDelaySlot;
+  cinst.has_branch_not_taken_delay_slot = flags & kHasBranchNotTakenDelaySlot;
+  cinst.in_delay_slot = flags & kInDelaySlot;
+  cinst.num_bytes = static_cast<uint8_t>(record[50]);
+  cinst.num_operands = static_cast<uint8_t>(record[51]);
+  cinst.num_exprs = static_cast<uint8_t>(record[52]);
+  cinst.num_regs_read = static_cast<uint8_t>(record[53]);
+  cinst.num_regs_written = static_cast<uint8_t>(record[54]);
+  cinst.arch_name = static_cast<ArchName>(record[55]);
+  if (cinst.num_bytes > CompactInstruction::kMaxNumBytes ||
+      cinst.num_operands > CompactInstruction::kMaxNumOperands ||
+      cinst.num_exprs > CompactInstruction::kMaxNumExpr ||
+      cinst.num_regs_read > CompactInstruction::kMaxNumRegs ||
+      cinst.num_regs_written > CompactInstruction::kMaxNumRegs) {
+    return false;
+  }
+  memcpy(cinst.bytes, &(record[56]), cinst.num_bytes);
+
+  auto read_reg = [&](const char *data, CompactRegister &reg) {
+    if (!GetString(static_cast<uint32_t>(ReadLE(data, 4)), str)) {
+      return false;
+    }
+    reg.name_id = InternString(str);
+    reg.size = static_cast<uint16_t>(ReadLE(&(data[4]), 4));
+    return true;
+  };
+
+  auto is_expr = [&](uint8_t expr, uint8_t num_exprs) {
+    return expr == CompactInstruction::kNoExpression || expr < num_exprs;
+  };
+
+  auto data = &(record[kRecordSize]);
+  for (uint8_t i = 0; i < cinst.num_operands; ++i, data += kOperandSize) {
+    auto &op = cinst.operands[i];
+    op.type = static_cast<Operand::Type>(data[0]);
+    op.action = static_cast<Operand::Action>(data[1]);
+    op.shift_op = static_cast<Operand::ShiftRegister::Shift>(data[2]);
+    op.extend_op = static_cast<Operand::ShiftRegister::Extend>(data[3]);
+    op.addr_kind = static_cast<Operand::Address::Kind>(data[4]);
+    op.shift_first = data[5] & kShiftFirst;
+    op.is_signed = data[5] & kIsSigned;
+    op.expr = static_cast<uint8_t>(data[6]);
+    op.shift_size = static_cast<uint16_t>(ReadLE(&(data[8]), 2));
+    op.extract_size = static_cast<uint16_t>(ReadLE(&(data[10]), 2));
+    op.address_size = static_cast<uint16_t>(ReadLE(&(data[12]), 2));
+    op.size = static_cast<uint32_t>(ReadLE(&(data[16]), 4));
+    op.scale = static_cast<int32_t>(ReadLE(&(data[20]), 4));
+    op.val = ReadLE(&(data[24]), 8);
+    if (!is_expr(op.expr, cinst.num_exprs) ||
+        !read_reg(&(data[32]), op.reg) ||
+        !read_reg(&(data[32 + kRegisterSize]), op.segment_base_reg) ||
+        !read_reg(&(data[32 + 2 * kRegisterSize]), op.base_reg) ||
+        !read_reg(&(data[32 + 3 * kRegisterSize]), op.index_reg)) {
+      return false;
+    }
+  }
+
+  auto &context = *arch->context;
+  for (uint8_t i = 0; i < cinst.num_exprs; ++i, data += kExprSize) {
+    auto &expr = cinst.exprs[i];
+    expr.kind = static_cast<CompactExpression::Kind>(data[0]);
+    expr.llvm_opcode = static_cast<uint8_t>(data[1]);
+    expr.op1 = static_cast<uint8_t>(data[2]);
+    expr.op2 = static_cast<uint8_t>(data[3]);
+    if (!is_expr(expr.op1, i) || !is_expr(expr.op2, i) ||
+        !GetString(static_cast<uint32_t>(ReadLE(&(data[4]), 4)), str)) {
+      return false;
+    }
+
+    const auto type = static_cast<uint32_t>(ReadLE(&(data[8]), 4));
+    const auto val_size = static_cast<uint32_t>(ReadLE(&(data[12]), 4));
+    switch (expr.kind) {
+      case CompactExpression::kLLVMOp: break;
+      case CompactExpression::kRegister:
+        expr.reg = arch->RegisterByName(str);
+        if (!expr.reg) {
+          return false;
+        }
+        break;
+      case CompactExpression::kConstant:
+        if (!val_size || val_size > 64) {
+          return false;
+        }
+        expr.constant = llvm::ConstantInt::get(
+            llvm::IntegerType::get(context, val_size), ReadLE(&(data[16]), 8));
+        break;
+      case CompactExpression::kVariable:
+        expr.name_id = InternString(str);
+        break;
+      default: return false;
+    }
+
+    if (!type) {
+      expr.type = nullptr;
+    } else if (type == kRegisterType) {
+      if (expr.kind != CompactExpression::kRegister) {
+        return false;
+      }
+      expr.type = expr.reg->type;
+    } else if (type <= llvm::IntegerType::MAX_INT_BITS) {
+      expr.type = llvm::IntegerType::get(context, type);
+    } else {
+      return false;
+    }
+  }
+
+  auto read_regs = [&](uint16_t *ids, uint8_t num_regs) {
+    for (uint8_t i = 0; i < num_regs; ++i, data += 4) {
+      if (!GetString(static_cast<uint32_t>(ReadLE(data, 4)), str)) {
+        return false;
+      }
+      const auto reg = arch->RegisterByName(str);
+      if (!reg) {
+        return false;
+      }
+      ids[i] = static_cast<uint16_t>(reg->index);
+    }
+    return true;
+  };
+  if (!read_regs(cinst.regs_read, cinst.num_regs_read) ||
+      !read_regs(cinst.regs_written, cinst.num_regs_written)) {
+    return false;
+  }
+
+  cinst.Expand(inst);
+  return true;
+}
+
+bool InstructionArchive::TryGetInstruction(const Arch *arch_, uint64_t addr,
+                                           std::string_view bytes,
+                                           Instruction &inst) {
+  if (arch_ != arch || !LoadInstruction(addr, inst)) {
+    return false;
+  }
+
+  // The bytes in memory may have changed since the archive was written.
+  const std::string_view archived_bytes(inst.bytes);
+  return bytes.substr(0, archived_bytes.size()) == archived_bytes;
+}
+
+// Does nothing; archives are read-only.
+void InstructionArchive::AddInstruction(const Arch *, uint64_t,
+                                        const Instruction &) {}
+
+}  // namespace remill
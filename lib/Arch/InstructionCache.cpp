@@ -0,0 +1,187 @@
+/*
+ * Copyright (c) 2020 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "remill/Arch/InstructionCache.h"
+
+#include "remill/Arch/Arch.h"
+
+namespace remill {
+
+InstructionCache::~InstructionCache(void) {}
+
+SimpleInstructionCache::~SimpleInstructionCache(void) {}
+
+// Try to find an instruction at `addr` that was decoded by `arch`, and whose
+// bytes are a prefix of `bytes`.
+bool SimpleInstructionCache::TryGetInstruction(const Arch *arch, uint64_t addr,
+                                               std::string_view bytes,
+                                               Instruction &inst) {
+  auto inst_it = instructions.find(Key(arch, addr));
+  if (inst_it == instructions.end()) {
+    return false;
+  }
+
+  // The bytes in memory may have changed (e.g. patched or self-modifying
+  // code) since we decoded this instruction.
+  const auto &cached_inst = inst_it->second;
+  const std::string_view cached_bytes(cached_inst.bytes);
+  if (bytes.substr(0, cached_bytes.size()) != cached_bytes) {
+    return false;
+  }
+
+  inst = cached_inst;
+  return true;
+}
+
+// Record that decoding the bytes at `addr` with `arch` produced `inst`.
+void SimpleInstructionCache::AddInstruction(const Arch *arch, uint64_t addr,
+                                            const Instruction &inst) {
+  instructions[Key(arch, addr)] = inst;
+}
+
+// Forget all cached instructions.
+void SimpleInstructionCache::Clear(void) {
+  instructions.clear();
+}
+
+CompactInstructionCache::~CompactInstructionCache(void) {}
+
+// Try to find an instruction at `addr` that was decoded by `arch`, and whose
+// bytes are a prefix of `bytes`.
+bool CompactInstructionCache::TryGetInstruction(const Arch *arch,
+                                                uint64_t addr,
+                                                std::string_view bytes,
+                                                Instruction &inst) {
+  const Key key(arch, addr);
+  auto compact_it = compact_instructions.find(key);
+  if (compact_it != compact_instructions.end()) {
+    const auto &cached_inst = compact_it->second;
+    const auto cached_bytes = cached_inst.Bytes();
+    if (bytes.substr(0, cached_bytes.size()) != cached_bytes) {
+      return false;
+    }
+    cached_inst.Expand(inst);
+    return true;
+  }
+
+  auto inst_it = instructions.find(key);
+  if (inst_it == instructions.end()) {
+    return false;
+  }
+
+  const auto &cached_inst = inst_it->second;
+  const std::string_view cached_bytes(cached_inst.bytes);
+  if (bytes.substr(0, cached_bytes.size()) != cached_bytes) {
+    return false;
+  }
+
+  inst = cached_inst;
+  return true;
+}
+
+// Record that decoding the bytes at `addr` with `arch` produced `inst`.
+void CompactInstructionCache::AddInstruction(const Arch *arch, uint64_t addr,
+                                             const Instruction &inst) {
+  const Key key(arch, addr);
+  CompactInstruction compact_inst;
+  if (compact_inst.Compact(inst)) {
+    instructions.erase(key);
+    compact_instructions[key] = compact_inst;
+  } else {
+    compact_instructions.erase(key);
+    instructions[key] = inst;
+  }
+}
+
+// Forget all cached instructions.
+void CompactInstructionCache::Clear(void) {
+  compact_instructions.clear();
+  instructions.clear();
+}
+
+BytePatternInstructionCache::~BytePatternInstructionCache(void) {}
+
+BytePatternInstructionCache::Key
+BytePatternInstructionCache::MakeKey(const Arch *arch, uint64_t addr,
+                                     std::string_view bytes) {
+
+  // FNV-1a. Collisions are caught by comparing the cached bytes.
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  for (auto byte : bytes) {
+    hash = (hash ^ static_cast<uint8_t>(byte)) * 0x100000001b3ULL;
+  }
+  return Key{arch, addr & 3u, hash};
+}
+
+// Try to find an instruction decoded by `arch` whose bytes are a prefix of
+// `bytes`, and relocate it to `addr`.
+bool BytePatternInstructionCache::TryGetInstruction(const Arch *arch,
+                                                    uint64_t addr,
+                                                    std::string_view bytes,
+                                                    Instruction &inst) {
+  for (auto lengths = cached_lengths; lengths; lengths &= lengths - 1u) {
+    const auto len = static_cast<size_t>(__builtin_ctzll(lengths));
+    if (len > bytes.size()) {
+      break;
+    }
+
+    const auto prefix = bytes.substr(0, len);
+    auto inst_it = instructions.find(MakeKey(arch, addr, prefix));
+    if (inst_it == instructions.end() ||
+        std::string_view(inst_it->second.bytes) != prefix) {
+      continue;
+    }
+
+    const auto &cached_inst = inst_it->second;
+    const auto delta = addr - cached_inst.pc;
+    const auto mask = 32 == arch->address_size ? 0xFFFFFFFFULL : ~0ULL;
+    const auto relocate = [=](uint64_t pc) -> uint64_t {
+      return pc ? ((pc + delta) & mask) : 0;
+    };
+
+    inst = cached_inst;
+    inst.pc = addr;
+    inst.next_pc = relocate(cached_inst.next_pc);
+    inst.delayed_pc = relocate(cached_inst.delayed_pc);
+    inst.branch_taken_pc = relocate(cached_inst.branch_taken_pc);
+    inst.branch_not_taken_pc = relocate(cached_inst.branch_not_taken_pc);
+    return true;
+  }
+
+  return false;
+}
+
+// Record that decoding the bytes at `addr` with `arch` produced `inst`.
+void BytePatternInstructionCache::AddInstruction(const Arch *arch,
+                                                 uint64_t addr,
+                                                 const Instruction &inst) {
+  const auto len = inst.bytes.size();
+  if (!len || len >= 64u || inst.in_delay_slot || arch->IsSPARC32() ||
+      arch->IsSPARC64()) {
+    return;
+  }
+
+  instructions[MakeKey(arch, addr, inst.bytes)] = inst;
+  cached_lengths |= 1ULL << len;
+}
+
+// Forget all cached instructions.
+void BytePatternInstructionCache::Clear(void) {
+  instructions.clear();
+  cached_lengths = 0;
+}
+
+}  // namespace remill
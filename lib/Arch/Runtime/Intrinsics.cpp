@@ -53,6 +53,24 @@ extern "C" void __remill_mark_as_used(const void *);
   USED(__remill_write_memory_f80);
   USED(__remill_write_memory_f128);
 
+  USED(__remill_read_memory_v128);
+  USED(__remill_read_memory_v256);
+  USED(__remill_read_memory_v512);
+
+  USED(__remill_write_memory_v128);
+  USED(__remill_write_memory_v256);
+  USED(__remill_write_memory_v512);
+
+  USED(__remill_copy_memory_8);
+  USED(__remill_copy_memory_16);
+  USED(__remill_copy_memory_32);
+  USED(__remill_copy_memory_64);
+
+  USED(__remill_fill_memory_8);
+  USED(__remill_fill_memory_16);
+  USED(__remill_fill_memory_32);
+  USED(__remill_fill_memory_64);
+
   USED(__remill_barrier_load_load);
   USED(__remill_barrier_load_store);
   USED(__remill_barrier_store_load);
@@ -16,6 +16,7 @@
 
 #include "remill/Arch/Arch.h"
 
+#include <gflags/gflags.h>
 #include <glog/logging.h>
 
 #include "Decode.h"
@@ -32,6 +33,8 @@
 
 // clang-format on
 
+DECLARE_bool(log_decode_failures);
+
 namespace remill {
 namespace sparc {
 namespace {
@@ -162,6 +165,9 @@ class SPARC32Arch final : public Arch {
   void PopulateBasicBlockFunction(llvm::Module *module,
                                   llvm::Function *bb_func) const override;
 
+  // Size of the `State` structure, in bytes.
+  uint64_t StateStructSize(void) const override;
+
   llvm::Triple Triple(void) const final;
   llvm::DataLayout DataLayout(void) const final;
 
@@ -169,6 +175,16 @@ class SPARC32Arch final : public Arch {
   bool DecodeInstruction(uint64_t address, std::string_view instr_bytes,
                          Instruction &inst) const final;
 
+  // Decode several consecutive instructions.
+  size_t DecodeInstructions(uint64_t address, std::string_view insts_bytes,
+                            std::vector<Instruction> &insts,
+                            size_t max_insts) const final;
+
+  // Decode only the length, category, and direct control-flow targets of an
+  // instruction.
+  bool DecodeLengthAndCategory(uint64_t address, std::string_view inst_bytes,
+                               InstructionSummary &summary) const final;
+
   // Returns `true` if memory access are little endian byte ordered.
   bool MemoryAccessIsLittleEndian(void) const final {
     return false;
@@ -183,8 +199,17 @@ class SPARC32Arch final : public Arch {
   virtual bool NextInstructionIsDelayed(const Instruction &inst,
                                         const Instruction &next_inst,
                                         bool branch_taken_path) const final;
+
+ private:
+  // Fill in the registers read and written by `inst`.
+  void AddRegisterSets(Instruction &inst) const;
 };
 
+// Size of the `State` structure, in bytes.
+uint64_t SPARC32Arch::StateStructSize(void) const {
+  return sizeof(SPARCState);
+}
+
 // Populate the `__remill_basic_block` function with variables.
 void SPARC32Arch::PopulateBasicBlockFunction(llvm::Module *module,
                                              llvm::Function *bb_func) const {
@@ -376,7 +401,8 @@ void SPARC32Arch::PopulateBasicBlockFunction(llvm::Module *module,
   CHECK(window_type->isStructTy());
 
   auto window = ir.CreateAlloca(window_type, nullptr, "WINDOW");
-  ir.CreateAlloca(prev_window_link->type, nullptr, "PREV_WINDOW");
+  auto prev_window =
+      ir.CreateAlloca(prev_window_link->type, nullptr, "PREV_WINDOW");
 
   // `WINDOW_LINK = &(WINDOW->prev_window);`
   llvm::Value *gep_indexes[2] = {zero_u32, llvm::ConstantInt::get(u32, 33)};
@@ -385,6 +411,9 @@ void SPARC32Arch::PopulateBasicBlockFunction(llvm::Module *module,
   auto nullptr_window = llvm::Constant::getNullValue(prev_window_link->type);
   ir.CreateStore(nullptr_window, window_link, false);
 
+  // A trace starts without holding a window; `SAVE` and `RESTORE` check it.
+  ir.CreateStore(nullptr_window, prev_window, false);
+
   ir.CreateStore(zero_u8, ir.CreateAlloca(u8, nullptr, "IGNORE_BRANCH_TAKEN"),
                  false);
   ir.CreateStore(zero_u32, ir.CreateAlloca(u32, nullptr, "IGNORE_PC"), false);
@@ -436,6 +465,114 @@ bool SPARC32Arch::NextInstructionIsDelayed(const Instruction &inst,
   }
 }
 
+// Decode several consecutive instructions, without making a virtual call to
+// `DecodeInstruction` for each one.
+size_t SPARC32Arch::DecodeInstructions(uint64_t address,
+                                       std::string_view insts_bytes,
+                                       std::vector<Instruction> &insts,
+                                       size_t max_insts) const {
+  return DecodeEachInstruction(
+      address, insts_bytes, insts, max_insts, MaxInstructionSize(),
+      [this](uint64_t inst_addr, std::string_view inst_bytes,
+             Instruction &inst) {
+        return SPARC32Arch::DecodeInstruction(inst_addr, inst_bytes, inst);
+      },
+      true /* has_delay_slots */);
+}
+
+// Fill in the registers read and written by `inst`. The condition codes are
+// never operands, so they are added based on the name of the semantics.
+void SPARC32Arch::AddRegisterSets(Instruction &inst) const {
+  static const std::string_view kICC[] = {"icc_c", "icc_v", "icc_z", "icc_n"};
+  static const std::string_view kXCC[] = {"xcc_c", "xcc_v", "xcc_z", "xcc_n"};
+
+  AddOperandRegisters(inst);
+
+  auto add_ccs = [this](RegisterSet &regs, const std::string_view(&ccs)[4]) {
+    AddRegistersByName(regs, {ccs[0], ccs[1], ccs[2], ccs[3]});
+  };
+
+  std::string_view func = inst.function;
+  auto ends_with = [func](std::string_view suffix) {
+    return func.size() >= suffix.size() &&
+           func.substr(func.size() - suffix.size()) == suffix;
+  };
+
+  // E.g. `ADDcc`, `ADDXcc`, `MULScc`.
+  if (ends_with("cc")) {
+    add_ccs(inst.regs_written, kICC);
+    add_ccs(inst.regs_written, kXCC);
+  }
+
+  // E.g. `ADDX`, `SUBXcc`.
+  if (func.substr(0, 4) == "ADDX" || func.substr(0, 4) == "SUBX") {
+    AddRegistersByName(inst.regs_read, {"icc_c"});
+  } else if (func == "MULScc") {
+    AddRegistersByName(inst.regs_read, {"icc_n", "icc_v"});
+  } else if (func == "RDCCR") {
+    add_ccs(inst.regs_read, kICC);
+    add_ccs(inst.regs_read, kXCC);
+  } else if (func == "WRCCR") {
+    add_ccs(inst.regs_written, kICC);
+    add_ccs(inst.regs_written, kXCC);
+
+  // Conditional traps, e.g. `TNE` or `TNE_sync`, test either condition code.
+  } else if (func.size() > 1 && func[0] == 'T' && !ends_with("cc")) {
+    add_ccs(inst.regs_read, kICC);
+    add_ccs(inst.regs_read, kXCC);
+  }
+
+  // Conditional branches and moves, e.g. `BNE_icc`, `MOVNE_xcc`,
+  // `FBUL_fcc0`, and floating-point compares, e.g. `FCMPS_fcc1`.
+  if (ends_with("_icc")) {
+    add_ccs(inst.regs_read, kICC);
+  } else if (ends_with("_xcc")) {
+    add_ccs(inst.regs_read, kXCC);
+  } else if (func.size() > 5 && func.substr(func.size() - 5, 4) == "_fcc") {
+    std::string fcc = "ccf_";
+    fcc += func.substr(func.size() - 4);
+    if (func.substr(0, 4) == "FCMP") {
+      AddRegistersByName(inst.regs_written, {fcc});
+    } else {
+      AddRegistersByName(inst.regs_read, {fcc});
+    }
+  }
+}
+
+// Decode only the length, category, and direct control-flow targets of an
+// instruction. Arithmetic (`op=10`) and memory (`op=11`) instructions are
+// classified by their top-level opcode fields alone; this may accept some
+// unallocated `op3` encodings that `DecodeInstruction` rejects. Everything
+// else, i.e. branches, calls, `SETHI`, and the `SET` pseudo-operations, is
+// fully decoded.
+bool SPARC32Arch::DecodeLengthAndCategory(uint64_t address,
+                                          std::string_view inst_bytes,
+                                          InstructionSummary &summary) const {
+  if (!(address % 4) &&
+      (4 == inst_bytes.size() || 8 == inst_bytes.size())) {
+    const auto bytes = reinterpret_cast<const uint8_t *>(inst_bytes.data());
+    const auto bits = (static_cast<uint32_t>(bytes[0]) << 24u) |
+                      (static_cast<uint32_t>(bytes[1]) << 16u) |
+                      (static_cast<uint32_t>(bytes[2]) << 8u) |
+                      static_cast<uint32_t>(bytes[3]);
+    const auto op = bits >> 30u;
+    const auto op3 = (bits >> 19u) & 0x3Fu;
+
+    // `JMPL`, `RETT`, and `Tcc` are the only control-flow instructions
+    // with `op=10`.
+    if (0b11 == op || (0b10 == op && op3 != 0b111000 && op3 != 0b111001 &&
+                       op3 != 0b111010)) {
+      summary = {};
+      summary.pc = address;
+      summary.next_pc = address + 4;
+      summary.category = Instruction::kCategoryNormal;
+      return true;
+    }
+  }
+
+  return Arch::DecodeLengthAndCategory(address, inst_bytes, summary);
+}
+
 // Decode an instruction.
 bool SPARC32Arch::DecodeInstruction(uint64_t address,
                                     std::string_view inst_bytes,
@@ -452,10 +589,13 @@ bool SPARC32Arch::DecodeInstruction(uint64_t address,
   inst.has_branch_not_taken_delay_slot = false;
 
   if (address % 4) {
+    inst.decode_error = DecodeError::kMisaligned;
     return false;
   }
 
   if (inst_bytes.size() != 4 && inst_bytes.size() != 8) {
+    inst.decode_error = inst_bytes.size() < 4 ? DecodeError::kTruncated
+                                              : DecodeError::kInvalidEncoding;
     return false;
   }
 
@@ -468,10 +608,14 @@ bool SPARC32Arch::DecodeInstruction(uint64_t address,
   if (!sparc32::TryDecode(inst)) {
     inst.category = Instruction::kCategoryInvalid;
     inst.operands.clear();
-    LOG(ERROR) << "Unable to decode: " << inst.Serialize();
+    inst.decode_error = DecodeError::kInvalidEncoding;
+    LOG_IF(ERROR, FLAGS_log_decode_failures)
+        << "Unable to decode: " << inst.Serialize();
     return false;
   }
 
+  AddRegisterSets(inst);
+
   //  LOG(ERROR) << inst.Serialize();
 
   return inst.IsValid();
@@ -14,6 +14,7 @@
  * limitations under the License.
  */
 
+#include <gflags/gflags.h>
 #include <glog/logging.h>
 
 #include <bitset>
@@ -21,6 +22,8 @@
 #include "../SPARC32/Decode.h"
 #include "Decode.h"
 
+DECLARE_bool(log_decode_failures);
+
 namespace remill {
 using namespace remill::sparc;
 namespace sparc64 {
@@ -2596,7 +2599,8 @@ static bool TryDecode_op00(Instruction &inst, uint32_t bits) {
   auto index = (bits >> 22u) & 0x7u;
   auto func = kop00_op2Level[index];
   if (!func) {
-    LOG(ERROR) << "OP=00 op2=" << std::bitset<3>(index);
+    LOG_IF(ERROR, FLAGS_log_decode_failures)
+        << "OP=00 op2=" << std::bitset<3>(index);
     return false;
   }
   return func(inst, bits);
@@ -2611,7 +2615,8 @@ static bool TryDecode_op10(Instruction &inst, uint32_t bits) {
   auto index = (bits >> 19u) & 0x3Fu;
   auto func = kop10_op3Level[index];
   if (!func) {
-    LOG(ERROR) << "OP=10 op3=" << std::bitset<6>(index);
+    LOG_IF(ERROR, FLAGS_log_decode_failures)
+        << "OP=10 op3=" << std::bitset<6>(index);
     return false;
   }
   return func(inst, bits);
@@ -2621,7 +2626,8 @@ static bool TryDecode_op11(Instruction &inst, uint32_t bits) {
   auto index = (bits >> 19u) & 0x3Fu;
   auto func = kop11_op3Level[index];
   if (!func) {
-    LOG(ERROR) << "OP=11 op3=" << std::bitset<6>(index);
+    LOG_IF(ERROR, FLAGS_log_decode_failures)
+        << "OP=11 op3=" << std::bitset<6>(index);
     return false;
   }
   return func(inst, bits);
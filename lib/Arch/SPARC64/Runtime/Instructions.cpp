@@ -125,8 +125,10 @@
 #define INTERRUPT_VECTOR state.hyper_call_vector
 #define HYPER_CALL_VECTOR state.hyper_call_vector
 
+// Bias of the stack and frame pointers; the stack save area of a frame, where
+// its register window is spilled, starts at `%sp + SPARC_STACKBIAS`.
 #if ADDRESS_SIZE_BITS == 64
-#  define SPARC_STACKBIAS 0
+#  define SPARC_STACKBIAS 2047
 #else
 #  define SPARC_STACKBIAS 0
 #endif
@@ -147,6 +149,37 @@ DEF_SEM(HandleInvalidInstruction) {
   return memory;
 }
 
+// Spill `window`, which holds the locals and ins of the caller of the current
+// function, to the stack save area of the caller's frame. The caller's stack
+// pointer is the current frame pointer. This is what the OS's window overflow
+// trap handler does.
+DEF_HELPER(SPILL_WINDOW_TO_STACK, RegisterWindow *window)->void {
+  const addr_t save_area =
+      UAdd(Read(REG_FP), static_cast<addr_t>(SPARC_STACKBIAS));
+  const addr_t size = static_cast<addr_t>(sizeof(addr_t));
+  Write(WritePtr<addr_t>(save_area + 0 * size), window->l0);
+  Write(WritePtr<addr_t>(save_area + 1 * size), window->l1);
+  Write(WritePtr<addr_t>(save_area + 2 * size), window->l2);
+  Write(WritePtr<addr_t>(save_area + 3 * size), window->l3);
+  Write(WritePtr<addr_t>(save_area + 4 * size), window->l4);
+  Write(WritePtr<addr_t>(save_area + 5 * size), window->l5);
+  Write(WritePtr<addr_t>(save_area + 6 * size), window->l6);
+  Write(WritePtr<addr_t>(save_area + 7 * size), window->l7);
+  Write(WritePtr<addr_t>(save_area + 8 * size), window->i0);
+  Write(WritePtr<addr_t>(save_area + 9 * size), window->i1);
+  Write(WritePtr<addr_t>(save_area + 10 * size), window->i2);
+  Write(WritePtr<addr_t>(save_area + 11 * size), window->i3);
+  Write(WritePtr<addr_t>(save_area + 12 * size), window->i4);
+  Write(WritePtr<addr_t>(save_area + 13 * size), window->i5);
+  Write(WritePtr<addr_t>(save_area + 14 * size), window->i6);
+  Write(WritePtr<addr_t>(save_area + 15 * size), window->i7);
+}
+
+// `window` is the `WINDOW` variable of the lifted function, and so once the
+// semantics are inlined, a `SAVE` and `RESTORE` in the same function only
+// rename registers. The function holds one window at a time; an older window
+// overflows to the stack, and so does a window that is still held when leaving
+// the function's trace (see `SPILL_WINDOW`).
 DEF_HELPER(SAVE_WINDOW, RegisterWindow *window, RegisterWindow *&prev_window)
     ->void {
 
@@ -155,6 +188,10 @@ DEF_HELPER(SAVE_WINDOW, RegisterWindow *window, RegisterWindow *&prev_window)
   //  window->prev_window = state.window;
   //  state.window = window;
 
+  if (prev_window) {
+    SPILL_WINDOW_TO_STACK(memory, state, prev_window);
+  }
+
   prev_window = window;
 
   window->l0 = Read(REG_L0);
@@ -188,17 +225,22 @@ DEF_HELPER(SAVE_WINDOW, RegisterWindow *window, RegisterWindow *&prev_window)
 
 DEF_HELPER(RESTORE_WINDOW, RegisterWindow *&prev_window)->void {
 
+  // The caller's window was saved by a `SAVE` in another trace, and so it is
+  // either in the window list kept by the runtime, or in the stack save area
+  // of the caller's frame, whose stack pointer is the current frame pointer.
+  // This is what the OS's window underflow trap handler does.
   const auto window = prev_window ? prev_window : state.window;
-  if (!window) {
-    memory = __remill_sync_hyper_call(state, memory,
-                                      SyncHyperCall::kSPARCWindowUnderflow);
-    return;
-  }
+  const addr_t save_area =
+      UAdd(Read(REG_FP), static_cast<addr_t>(SPARC_STACKBIAS));
+  const addr_t size = static_cast<addr_t>(sizeof(addr_t));
 
   // TODO(pag): This next line should be uncommented for correctness, but then
   //            it means not as nice bitcode for mcsema.
   //  state.window = window->prev_window;
 
+  // The window is no longer held by this function.
+  prev_window = nullptr;
+
   // Move input register to output
   Write(REG_O0, REG_I0);
   Write(REG_O1, REG_I1);
@@ -209,6 +251,26 @@ DEF_HELPER(RESTORE_WINDOW, RegisterWindow *&prev_window)->void {
   Write(REG_O6, REG_I6);
   Write(REG_O7, REG_I7);
 
+  if (!window) {
+    Write(REG_L0, Read(ReadPtr<addr_t>(save_area + 0 * size)));
+    Write(REG_L1, Read(ReadPtr<addr_t>(save_area + 1 * size)));
+    Write(REG_L2, Read(ReadPtr<addr_t>(save_area + 2 * size)));
+    Write(REG_L3, Read(ReadPtr<addr_t>(save_area + 3 * size)));
+    Write(REG_L4, Read(ReadPtr<addr_t>(save_area + 4 * size)));
+    Write(REG_L5, Read(ReadPtr<addr_t>(save_area + 5 * size)));
+    Write(REG_L6, Read(ReadPtr<addr_t>(save_area + 6 * size)));
+    Write(REG_L7, Read(ReadPtr<addr_t>(save_area + 7 * size)));
+    Write(REG_I0, Read(ReadPtr<addr_t>(save_area + 8 * size)));
+    Write(REG_I1, Read(ReadPtr<addr_t>(save_area + 9 * size)));
+    Write(REG_I2, Read(ReadPtr<addr_t>(save_area + 10 * size)));
+    Write(REG_I3, Read(ReadPtr<addr_t>(save_area + 11 * size)));
+    Write(REG_I4, Read(ReadPtr<addr_t>(save_area + 12 * size)));
+    Write(REG_I5, Read(ReadPtr<addr_t>(save_area + 13 * size)));
+    Write(REG_I6, Read(ReadPtr<addr_t>(save_area + 14 * size)));
+    Write(REG_I7, Read(ReadPtr<addr_t>(save_area + 15 * size)));
+    return;
+  }
+
   Write(REG_L0, window->l0);
   Write(REG_L1, window->l1);
   Write(REG_L2, window->l2);
@@ -228,8 +290,21 @@ DEF_HELPER(RESTORE_WINDOW, RegisterWindow *&prev_window)->void {
   Write(REG_I7, window->i7);
 }
 
+// Spill the window held by the lifted function, if any, before leaving its
+// trace, so that a `RESTORE` in another trace finds it on the stack.
+DEF_SEM(SPILL_WINDOW, RegisterWindow *&prev_window) {
+  if (prev_window) {
+    SPILL_WINDOW_TO_STACK(memory, state, prev_window);
+    prev_window = nullptr;
+  }
+  return memory;
+}
+
 }  // namespace
 
+// Not a real instruction; see `SPILL_WINDOW`.
+DEF_ISEL(SPILL_WINDOW) = SPILL_WINDOW;
+
 // Takes the place of an unsupported instruction.
 DEF_ISEL(UNSUPPORTED_INSTRUCTION) = HandleUnsupported;
 DEF_ISEL(INVALID_INSTRUCTION) = HandleInvalidInstruction;
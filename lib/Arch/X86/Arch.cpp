@@ -16,6 +16,7 @@
 
 #include "remill/Arch/Arch.h"
 
+#include <gflags/gflags.h>
 #include <glog/logging.h>
 #include <llvm/ADT/Triple.h>
 #include <llvm/IR/Attributes.h>
@@ -24,11 +25,13 @@
 #include <llvm/IR/IRBuilder.h>
 #include <llvm/IR/Module.h>
 
+#include <array>
 #include <iomanip>
 #include <map>
 #include <memory>
 #include <sstream>
 #include <string>
+#include <vector>
 
 #include "XED.h"
 #include "remill/Arch/Instruction.h"
@@ -47,6 +50,8 @@
 
 // clang-format on
 
+DECLARE_bool(log_decode_failures);
+
 namespace remill {
 namespace {
 
@@ -321,30 +326,79 @@ std::map<xed_iform_enum_t, xed_iform_enum_t> kUnlockedIform = {
     {XED_IFORM_NEG_LOCK_MEMv, XED_IFORM_NEG_MEMv},
 };
 
-// Name of this instruction function.
-static std::string InstructionFunctionName(const xed_decoded_inst_t *xedd) {
+// Pre-computed instruction function names for an iform.
+struct IFormNames {
+  xed_iform_enum_t unlocked_iform{XED_IFORM_INVALID};
+  bool has_unlocked_iform{false};
+
+  // The iform's name, e.g. `ADD_GPRv_GPRv`.
+  std::string name;
+
+  // The names for each effective operand size of scalable iforms, e.g.
+  // `ADD_GPRv_GPRv_8`, ..., `ADD_GPRv_GPRv_64`.
+  std::array<std::string, 4> scalable_names;
+};
+
+// Returns the table of pre-computed instruction function names, indexed by
+// iform. This is built once, so that decoding an instruction doesn't need to
+// format its instruction function name.
+static const std::vector<IFormNames> &IFormNameTable(void) {
+  static const std::vector<IFormNames> table = [] {
+    std::vector<IFormNames> names(XED_IFORM_LAST);
+    for (auto i = 0u; i < names.size(); ++i) {
+      const auto iform = static_cast<xed_iform_enum_t>(i);
+      auto &entry = names[i];
+      entry.name = xed_iform_enum_t2str(iform);
+      for (auto j = 0u; j < entry.scalable_names.size(); ++j) {
+        entry.scalable_names[j] = entry.name + "_" + std::to_string(8u << j);
+      }
+
+      // If this instuction is marked as atomic via the `LOCK` prefix then we
+      // want to remove it because we will already be surrounding the call to
+      // the semantics function with the atomic begin/end intrinsics.
+      if (auto it = kUnlockedIform.find(iform); it != kUnlockedIform.end()) {
+        entry.unlocked_iform = it->second;
+        entry.has_unlocked_iform = true;
+      }
+    }
+    return names;
+  }();
+  return table;
+}
 
-  // If this instuction is marked as atomic via the `LOCK` prefix then we want
-  // to remove it because we will already be surrounding the call to the
-  // semantics function with the atomic begin/end intrinsics.
+// Set `function` to the name of this instruction function. This reuses the
+// storage of `function`.
+static void SetInstructionFunctionName(const xed_decoded_inst_t *xedd,
+                                       std::string &function) {
+  const auto &table = IFormNameTable();
   auto iform = xed_decoded_inst_get_iform_enum(xedd);
   if (xed_operand_values_has_lock_prefix(xedd)) {
-    CHECK(kUnlockedIform.count(iform))
+    CHECK(table[iform].has_unlocked_iform)
         << xed_iform_enum_t2str(iform) << " has no unlocked iform mapping.";
-    iform = kUnlockedIform[iform];
+    iform = table[iform].unlocked_iform;
   }
 
-  std::stringstream ss;
-  std::string iform_name = xed_iform_enum_t2str(iform);
-  ss << iform_name;
+  const auto &names = table[iform];
 
   // Some instructions are "scalable", i.e. there are variants of the
   // instruction for each effective operand size. We represent these in
   // the semantics files with `_<size>`, so we need to look up the correct
   // selection.
   if (xed_decoded_inst_get_attribute(xedd, XED_ATTRIBUTE_SCALABLE)) {
-    ss << "_";
-    ss << xed_decoded_inst_get_operand_width(xedd);
+    const auto width = xed_decoded_inst_get_operand_width(xedd);
+    switch (width) {
+      case 8: function.assign(names.scalable_names[0]); break;
+      case 16: function.assign(names.scalable_names[1]); break;
+      case 32: function.assign(names.scalable_names[2]); break;
+      case 64: function.assign(names.scalable_names[3]); break;
+      default:
+        function.assign(names.name);
+        function += '_';
+        function += std::to_string(width);
+        break;
+    }
+  } else {
+    function.assign(names.name);
   }
 
   // Suffix the ISEL function name with the segment or control register names,
@@ -353,23 +407,29 @@ static std::string InstructionFunctionName(const xed_decoded_inst_t *xedd) {
   if (XED_IFORM_MOV_SEG_MEMw == iform || XED_IFORM_MOV_SEG_GPR16 == iform ||
       XED_IFORM_MOV_CR_CR_GPR32 == iform ||
       XED_IFORM_MOV_CR_CR_GPR64 == iform) {
-    ss << "_";
-    ss << xed_reg_enum_t2str(xed_decoded_inst_get_reg(xedd, XED_OPERAND_REG0));
+    function += '_';
+    function +=
+        xed_reg_enum_t2str(xed_decoded_inst_get_reg(xedd, XED_OPERAND_REG0));
   }
-
-  return ss.str();
 }
 
-// Decode an instruction into the XED instuction format.
-static bool DecodeXED(xed_decoded_inst_t *xedd, const xed_state_t *mode,
-                      std::string_view inst_bytes, uint64_t address) {
+// Decode an instruction into the XED instuction format. Returns why the
+// instruction couldn't be decoded, if it couldn't be.
+static DecodeError DecodeXED(xed_decoded_inst_t *xedd,
+                             std::string_view inst_bytes, uint64_t address) {
   auto num_bytes = inst_bytes.size();
   auto bytes = reinterpret_cast<const uint8_t *>(inst_bytes.data());
-  xed_decoded_inst_zero_set_mode(xedd, mode);
+  xed_decoded_inst_zero_keep_mode(xedd);
   xed_decoded_inst_set_input_chip(xedd, XED_CHIP_INVALID);
   auto err = xed_decode(xedd, bytes, static_cast<uint32_t>(num_bytes));
 
-  if (XED_ERROR_NONE != err) {
+  if (XED_ERROR_NONE == err) {
+    return DecodeError::kNone;
+  }
+
+  // Formatting the bytes is comparatively expensive, and sweeps over data
+  // can fail to decode millions of times, so only do it when asked.
+  if (FLAGS_log_decode_failures) {
     std::stringstream ss;
     for (auto b : inst_bytes) {
       ss << ' ' << std::hex << std::setw(2) << std::setfill('0')
@@ -378,10 +438,14 @@ static bool DecodeXED(xed_decoded_inst_t *xedd, const xed_state_t *mode,
     LOG(ERROR) << "Unable to decode instruction at " << std::hex << address
                << " with bytes" << ss.str()
                << " and error: " << xed_error_enum_t2str(err) << std::dec;
-    return false;
   }
 
-  return true;
+  switch (err) {
+    case XED_ERROR_BUFFER_TOO_SHORT: return DecodeError::kTruncated;
+    case XED_ERROR_INVALID_FOR_CHIP:
+    case XED_ERROR_INVALID_MODE: return DecodeError::kUnsupported;
+    default: return DecodeError::kInvalidEncoding;
+  }
 }
 
 // Variable operand for a read register.
@@ -601,10 +665,51 @@ static void DecodeRegister(Instruction &inst, const xed_decoded_inst_t *xedd,
 
   if (xed_operand_read(xedo)) {
     read_op.action = Operand::kActionRead;
+
+    // The write mask `k0` means that no elements are masked, rather than
+    // the value of `k0`.
+    if (XED_REG_K0 == reg &&
+        XED_NONTERMINAL_MASK1 == xed_operand_nonterminal_name(xedo)) {
+      read_op.type = Operand::kTypeImmediate;
+      read_op.size = 64;
+      read_op.imm.is_signed = false;
+      read_op.imm.val = ~0ULL;
+    }
     inst.operands.push_back(read_op);
   }
 }
 
+// Masked AVX-512 instructions also read the old value of their destination
+// register, whose masked elements are kept (merge-masking) unless they are
+// zeroed (zero-masking). These come after the other operands, so that the
+// semantics can combine the result with them under the write mask.
+static void DecodeMaskedDestination(Instruction &inst,
+                                    const xed_decoded_inst_t *xedd) {
+  const auto xedi = xed_decoded_inst_inst(xedd);
+  const auto xedo = xed_inst_operand(xedi, 0);
+  const auto op_name = xed_operand_name(xedo);
+
+  // E.g. a masked store to memory.
+  if (XED_OPERAND_REG0 != op_name) {
+    return;
+  }
+
+  Operand dst_op = {};
+  dst_op.type = Operand::kTypeRegister;
+  dst_op.action = Operand::kActionRead;
+  dst_op.reg = RegOp(xed_decoded_inst_get_reg(xedd, op_name));
+  dst_op.size = dst_op.reg.size;
+  inst.operands.push_back(dst_op);
+
+  Operand zeroing_op = {};
+  zeroing_op.type = Operand::kTypeImmediate;
+  zeroing_op.action = Operand::kActionRead;
+  zeroing_op.size = 8;
+  zeroing_op.imm.is_signed = false;
+  zeroing_op.imm.val = xed_decoded_inst_zeroing(xedd) ? 1 : 0;
+  inst.operands.push_back(zeroing_op);
+}
+
 // Condition variable.
 static void DecodeConditionalInterrupt(Instruction &inst) {
   inst.operands.emplace_back();
@@ -802,6 +907,16 @@ class X86Arch final : public Arch {
   bool DecodeInstruction(uint64_t address, std::string_view inst_bytes,
                          Instruction &inst) const override;
 
+  // Decode several consecutive instructions.
+  size_t DecodeInstructions(uint64_t address, std::string_view insts_bytes,
+                            std::vector<Instruction> &insts,
+                            size_t max_insts) const override;
+
+  // Decode only the length, category, and direct control-flow targets of an
+  // instruction.
+  bool DecodeLengthAndCategory(uint64_t address, std::string_view inst_bytes,
+                               InstructionSummary &summary) const override;
+
   // Maximum number of bytes in an instruction.
   uint64_t MaxInstructionSize(void) const override;
 
@@ -815,20 +930,42 @@ class X86Arch final : public Arch {
   void PopulateBasicBlockFunction(llvm::Module *module,
                                   llvm::Function *bb_func) const override;
 
+  // Size of the `State` structure, in bytes.
+  uint64_t StateStructSize(void) const override;
+
  private:
   X86Arch(void) = delete;
+
+  // Decode an instruction using `xedd`, whose machine mode is already set.
+  bool DecodeXEDInstruction(uint64_t address, std::string_view inst_bytes,
+                            Instruction &inst, xed_decoded_inst_t *xedd) const;
+
+  // Fill in the registers read and written by `inst`, including the ones
+  // that `xedd` uses implicitly.
+  void DecodeRegisterSets(Instruction &inst,
+                          const xed_decoded_inst_t *xedd) const;
+
+  // Returns the machine mode for decoding instructions.
+  const xed_state_t *XEDState(void) const;
 };
 
 X86Arch::X86Arch(llvm::LLVMContext *context_, OSName os_name_,
                  ArchName arch_name_)
     : Arch(context_, os_name_, arch_name_) {
 
-  static bool xed_is_initialized = false;
-  if (!xed_is_initialized) {
+  // NOTE(pag): Function-local statics are initialized exactly once, even
+  //            when several threads are building `X86Arch`s concurrently,
+  //            e.g. in the `ParallelTraceLifter`.
+  static const bool xed_is_initialized = [] {
     DLOG(INFO) << "Initializing XED tables";
     xed_tables_init();
-    xed_is_initialized = true;
-  }
+    return true;
+  }();
+  (void) xed_is_initialized;
+
+  // Build the table of instruction function names up-front, rather than on
+  // the first decode.
+  (void) IFormNameTable();
 }
 
 X86Arch::~X86Arch(void) {}
@@ -945,9 +1082,80 @@ llvm::DataLayout X86Arch::DataLayout(void) const {
   return llvm::DataLayout(dl);
 }
 
+// Returns the machine mode for decoding instructions.
+const xed_state_t *X86Arch::XEDState(void) const {
+  return 32 == address_size ? &kXEDState32 : &kXEDState64;
+}
+
 // Decode an instuction.
 bool X86Arch::DecodeInstruction(uint64_t address, std::string_view inst_bytes,
                                 Instruction &inst) const {
+  xed_decoded_inst_t xedd;
+  xed_decoded_inst_zero_set_mode(&xedd, XEDState());
+  return DecodeXEDInstruction(address, inst_bytes, inst, &xedd);
+}
+
+// Decode several consecutive instructions. This sets up XED's machine mode
+// once for all of the instructions.
+size_t X86Arch::DecodeInstructions(uint64_t address,
+                                   std::string_view insts_bytes,
+                                   std::vector<Instruction> &insts,
+                                   size_t max_insts) const {
+  xed_decoded_inst_t xedd;
+  xed_decoded_inst_zero_set_mode(&xedd, XEDState());
+  return DecodeEachInstruction(
+      address, insts_bytes, insts, max_insts, MaxInstructionSize(),
+      [this, &xedd](uint64_t inst_addr, std::string_view inst_bytes,
+                    Instruction &inst) {
+        return DecodeXEDInstruction(inst_addr, inst_bytes, inst, &xedd);
+      });
+}
+
+// Decode only the length, category, and direct control-flow targets of an
+// instruction. This skips the operands, the register sets, and the semantics
+// function name, which are most of the cost of `DecodeInstruction`.
+bool X86Arch::DecodeLengthAndCategory(uint64_t address,
+                                      std::string_view inst_bytes,
+                                      InstructionSummary &summary) const {
+  xed_decoded_inst_t xedd;
+  xed_decoded_inst_zero_set_mode(&xedd, XEDState());
+
+  summary = {};
+  summary.pc = address;
+  summary.next_pc = address;
+  summary.decode_error = DecodeXED(&xedd, inst_bytes, address);
+  if (DecodeError::kNone != summary.decode_error) {
+    return false;
+  }
+
+  summary.next_pc = address + xed_decoded_inst_get_length(&xedd);
+  summary.category = CreateCategory(&xedd);
+
+  switch (summary.category) {
+    case Instruction::kCategoryDirectJump:
+    case Instruction::kCategoryDirectFunctionCall:
+    case Instruction::kCategoryConditionalBranch: {
+      const auto disp =
+          static_cast<int64_t>(xed_decoded_inst_get_branch_displacement(&xedd));
+      summary.branch_taken_pc = static_cast<uint64_t>(
+          static_cast<int64_t>(summary.next_pc) + disp);
+      summary.branch_not_taken_pc = summary.next_pc;
+      break;
+    }
+    case Instruction::kCategoryIndirectFunctionCall:
+      summary.branch_not_taken_pc = summary.next_pc;
+      break;
+    default: break;
+  }
+
+  return true;
+}
+
+// Decode an instuction using `xedd`, whose machine mode is already set.
+bool X86Arch::DecodeXEDInstruction(uint64_t address,
+                                   std::string_view inst_bytes,
+                                   Instruction &inst,
+                                   xed_decoded_inst_t *xedd) const {
 
   inst.pc = address;
   inst.arch = this;
@@ -955,13 +1163,8 @@ bool X86Arch::DecodeInstruction(uint64_t address, std::string_view inst_bytes,
   inst.category = Instruction::kCategoryInvalid;
   inst.operands.clear();
 
-  xed_decoded_inst_t xedd_;
-  xed_decoded_inst_t *xedd = &xedd_;
-  auto mode = 32 == address_size ? &kXEDState32 : &kXEDState64;
-
-  if (!DecodeXED(xedd, mode, inst_bytes, address)) {
-    LOG(ERROR) << "DecodeXED() could not decode the following opcodes: "
-               << inst.Serialize();
+  inst.decode_error = DecodeXED(xedd, inst_bytes, address);
+  if (DecodeError::kNone != inst.decode_error) {
     return false;
   }
 
@@ -990,7 +1193,7 @@ bool X86Arch::DecodeInstruction(uint64_t address, std::string_view inst_bytes,
 
   auto iform = xed_decoded_inst_get_iform_enum(xedd);
 
-  inst.function = InstructionFunctionName(xedd);
+  SetInstructionFunctionName(xedd, inst.function);
 
   // Lift the operands. This creates the arguments for us to call the
   // instuction implementation.
@@ -1010,6 +1213,11 @@ bool X86Arch::DecodeInstruction(uint64_t address, std::string_view inst_bytes,
     }
   }
 
+  // Masked AVX-512 instructions merge into, or zero, their destination.
+  if (xed_decoded_inst_get_attribute(xedd, XED_ATTRIBUTE_MASKOP_EVEX)) {
+    DecodeMaskedDestination(inst, xedd);
+  }
+
   // Control flow operands update the next program counter.
   if (inst.IsControlFlow()) {
     inst.operands.emplace_back();
@@ -1084,13 +1292,17 @@ bool X86Arch::DecodeInstruction(uint64_t address, std::string_view inst_bytes,
                << std::dec;
   }
 
+  DecodeRegisterSets(inst, xedd);
+
   // Make sure we disallow decoding of AVX instructions when running with non-
   // AVX arch specified. Same thing for AVX512 instructions.
   switch (xed_decoded_inst_get_isa_set(xedd)) {
     case XED_ISA_SET_INVALID:
     case XED_ISA_SET_LAST:
-      LOG(ERROR) << "Instruction decode of " << xed_iform_enum_t2str(iform)
-                 << " failed because XED_ISA_SET_LAST.";
+      LOG_IF(ERROR, FLAGS_log_decode_failures)
+          << "Instruction decode of " << xed_iform_enum_t2str(iform)
+          << " failed because XED_ISA_SET_LAST.";
+      inst.decode_error = DecodeError::kUnsupported;
       return false;
 
     case XED_ISA_SET_AVX:
@@ -1099,12 +1311,14 @@ bool X86Arch::DecodeInstruction(uint64_t address, std::string_view inst_bytes,
     case XED_ISA_SET_AVXAES:
     case XED_ISA_SET_AVX_GFNI: {
       auto supp = kArchAMD64 != inst.arch_name && kArchX86 != inst.arch_name;
-      LOG_IF(ERROR, !supp) << "Instruction decode of "
-                           << xed_iform_enum_t2str(iform)
-                           << " failed because the current arch is specified "
-                           << "as " << GetArchName(inst.arch_name)
-                           << " but what is needed is "
-                           << "the _avx or _avx512 variant.";
+      LOG_IF(ERROR, !supp && FLAGS_log_decode_failures)
+          << "Instruction decode of " << xed_iform_enum_t2str(iform)
+          << " failed because the current arch is specified "
+          << "as " << GetArchName(inst.arch_name) << " but what is needed is "
+          << "the _avx or _avx512 variant.";
+      if (!supp) {
+        inst.decode_error = DecodeError::kUnsupported;
+      }
       return supp;
     }
 
@@ -1164,13 +1378,14 @@ bool X86Arch::DecodeInstruction(uint64_t address, std::string_view inst_bytes,
       const auto supp = kArchAMD64_AVX512 == inst.arch_name ||
                         kArchX86_AVX512 == inst.arch_name;
       if (!supp) {
-        LOG(ERROR) << "Instruction decode of " << xed_iform_enum_t2str(iform)
-                   << " failed because the current arch is specified "
-                   << "as " << GetArchName(inst.arch_name)
-                   << " but what is needed is "
-                   << "the _avx512 variant.";
+        LOG_IF(ERROR, FLAGS_log_decode_failures)
+            << "Instruction decode of " << xed_iform_enum_t2str(iform)
+            << " failed because the current arch is specified "
+            << "as " << GetArchName(inst.arch_name) << " but what is needed is "
+            << "the _avx512 variant.";
         inst.Reset();
         inst.category = Instruction::kCategoryInvalid;
+        inst.decode_error = DecodeError::kUnsupported;
         return false;
       }
       break;
@@ -1181,6 +1396,95 @@ bool X86Arch::DecodeInstruction(uint64_t address, std::string_view inst_bytes,
   return true;
 }
 
+// Fill in the registers read and written by `inst`. On top of the registers
+// named by its operands, these are the registers of the operands that XED
+// suppresses (e.g. the stack pointer of a `PUSH`, or `RAX` of a `CPUID`), and
+// the flags that XED says are read, written, or left undefined.
+void X86Arch::DecodeRegisterSets(Instruction &inst,
+                                 const xed_decoded_inst_t *xedd) const {
+  AddOperandRegisters(inst);
+
+  const auto sp_name = StackPointerRegisterName();
+  auto add_reg = [&](xed_reg_enum_t reg, bool is_read, bool is_written) {
+    std::string_view name;
+    switch (reg) {
+      case XED_REG_INVALID: return;
+      case XED_REG_STACKPUSH:
+      case XED_REG_STACKPOP:
+        name = sp_name;
+        is_read = is_written = true;
+        break;
+      default: name = xed_reg_enum_t2str(reg); break;
+    }
+    if (is_read) {
+      AddRegistersByName(inst.regs_read, {name});
+    }
+    if (is_written) {
+      AddRegistersByName(inst.regs_written, {name});
+    }
+  };
+
+  const auto xedi = xed_decoded_inst_inst(xedd);
+  const auto num_operands = xed_decoded_inst_noperands(xedd);
+  for (auto i = 0U; i < num_operands; ++i) {
+    const auto xedo = xed_inst_operand(xedi, i);
+    if (XED_OPVIS_SUPPRESSED != xed_operand_operand_visibility(xedo)) {
+      continue;
+    }
+
+    switch (const auto op_name = xed_operand_name(xedo)) {
+      case XED_OPERAND_AGEN:
+      case XED_OPERAND_MEM0:
+      case XED_OPERAND_MEM1: {
+        const auto mem_index = XED_OPERAND_MEM1 == op_name ? 1u : 0u;
+        add_reg(xed_decoded_inst_get_base_reg(xedd, mem_index), true, false);
+        add_reg(xed_decoded_inst_get_index_reg(xedd, mem_index), true, false);
+        break;
+      }
+
+      case XED_OPERAND_BASE0:
+      case XED_OPERAND_BASE1:
+      case XED_OPERAND_REG:
+      case XED_OPERAND_REG0:
+      case XED_OPERAND_REG1:
+      case XED_OPERAND_REG2:
+      case XED_OPERAND_REG3:
+      case XED_OPERAND_REG4:
+      case XED_OPERAND_REG5:
+      case XED_OPERAND_REG6:
+      case XED_OPERAND_REG7:
+      case XED_OPERAND_REG8:
+        add_reg(xed_decoded_inst_get_reg(xedd, op_name),
+                xed_operand_read(xedo), xed_operand_written(xedo));
+        break;
+
+      default: break;
+    }
+  }
+
+  const auto rfi = xed_decoded_inst_get_rflags_info(xedd);
+  if (!rfi) {
+    return;
+  }
+
+  const auto read = xed_simple_flag_get_read_flag_set(rfi);
+  const auto written = xed_simple_flag_get_written_flag_set(rfi);
+  const auto undefined = xed_simple_flag_get_undefined_flag_set(rfi);
+  auto add_flags = [this](RegisterSet &regs, const xed_flag_set_t *flags) {
+    if (!flags) {
+      return;
+    }
+    const auto &f = flags->s;
+    AddRegistersByName(regs, {f.cf ? "CF" : "", f.pf ? "PF" : "",
+                              f.af ? "AF" : "", f.zf ? "ZF" : "",
+                              f.sf ? "SF" : "", f.df ? "DF" : "",
+                              f.of ? "OF" : ""});
+  };
+  add_flags(inst.regs_read, read);
+  add_flags(inst.regs_written, written);
+  add_flags(inst.regs_written, undefined);
+}
+
 static const std::string_view kSPNames[] = {"RSP", "ESP"};
 static const std::string_view kPCNames[] = {"RIP", "EIP"};
 
@@ -1194,6 +1498,11 @@ std::string_view X86Arch::ProgramCounterRegisterName(void) const {
   return kPCNames[IsX86()];
 }
 
+// Size of the `State` structure, in bytes.
+uint64_t X86Arch::StateStructSize(void) const {
+  return sizeof(State);
+}
+
 // Populate the `__remill_basic_block` function with variables.
 void X86Arch::PopulateBasicBlockFunction(llvm::Module *module,
                                          llvm::Function *bb_func) const {
@@ -1492,6 +1801,17 @@ void X86Arch::PopulateBasicBlockFunction(llvm::Module *module,
     SUB_REG(XMM31, vec[31].xmm, v128, YMM31);
   }
 
+  if (has_avx512) {
+    REG(K0, k.elems[0].val, u64);
+    REG(K1, k.elems[1].val, u64);
+    REG(K2, k.elems[2].val, u64);
+    REG(K3, k.elems[3].val, u64);
+    REG(K4, k.elems[4].val, u64);
+    REG(K5, k.elems[5].val, u64);
+    REG(K6, k.elems[6].val, u64);
+    REG(K7, k.elems[7].val, u64);
+  }
+
   REG(ST0, st.elems[0].val, f64);
   REG(ST1, st.elems[1].val, f64);
   REG(ST2, st.elems[2].val, f64);
@@ -132,6 +132,17 @@
 #define HYPER_CALL state.hyper_call
 #define INTERRUPT_VECTOR state.hyper_call_vector
 
+// When the runtime is built as shards (see `SHARDS` in `add_runtime`), each
+// shard is compiled with `REMILL_SEMANTICS_SHARD_<category>=1` for each of
+// its categories, and only defines the instructions of those categories. The
+// helpers are defined by every shard. `BASE` is the category of the
+// instructions that are defined in this file.
+#ifdef REMILL_SEMANTICS_SHARD
+#  define REMILL_HAS_SEMANTICS(category) REMILL_SEMANTICS_SHARD_##category
+#else
+#  define REMILL_HAS_SEMANTICS(category) 1
+#endif
+
 namespace {
 
 // Takes the place of an unsupported instruction.
@@ -150,10 +161,14 @@ DEF_SEM(HandleInvalidInstruction) {
 
 }  // namespace
 
+#if REMILL_HAS_SEMANTICS(BASE)
+
 // Takes the place of an unsupported instruction.
 DEF_ISEL(UNSUPPORTED_INSTRUCTION) = HandleUnsupported;
 DEF_ISEL(INVALID_INSTRUCTION) = HandleInvalidInstruction;
 
+#endif
+
 namespace {
 template <typename T>
 DEF_HELPER(PopFromStack)->T {
@@ -200,37 +215,101 @@ DEF_HELPER(SquareRoot32, float32_t src_float)->float32_t {
 // clang-format off
 #include "lib/Arch/X86/Semantics/FLAGS.cpp"
 
-#include "lib/Arch/X86/Semantics/AVX.cpp"
-#include "lib/Arch/X86/Semantics/BINARY.cpp"
-#include "lib/Arch/X86/Semantics/BITBYTE.cpp"
-#include "lib/Arch/X86/Semantics/CALL_RET.cpp"
-#include "lib/Arch/X86/Semantics/CMOV.cpp"
-#include "lib/Arch/X86/Semantics/COND_BR.cpp"
-#include "lib/Arch/X86/Semantics/CONVERT.cpp"
-#include "lib/Arch/X86/Semantics/DATAXFER.cpp"
-#include "lib/Arch/X86/Semantics/DECIMAL.cpp"
-#include "lib/Arch/X86/Semantics/FLAGOP.cpp"
-#include "lib/Arch/X86/Semantics/FMA.cpp"
-#include "lib/Arch/X86/Semantics/INTERRUPT.cpp"
-#include "lib/Arch/X86/Semantics/IO.cpp"
-#include "lib/Arch/X86/Semantics/LOGICAL.cpp"
-#include "lib/Arch/X86/Semantics/MISC.cpp"
-#include "lib/Arch/X86/Semantics/MMX.cpp"
-#include "lib/Arch/X86/Semantics/NOP.cpp"
-#include "lib/Arch/X86/Semantics/POP.cpp"
-#include "lib/Arch/X86/Semantics/PREFETCH.cpp"
-#include "lib/Arch/X86/Semantics/PUSH.cpp"
-#include "lib/Arch/X86/Semantics/ROTATE.cpp"
-#include "lib/Arch/X86/Semantics/RTM.cpp"
-#include "lib/Arch/X86/Semantics/SEMAPHORE.cpp"
-#include "lib/Arch/X86/Semantics/SHIFT.cpp"
-#include "lib/Arch/X86/Semantics/SSE.cpp"
-#include "lib/Arch/X86/Semantics/STRINGOP.cpp"
-#include "lib/Arch/X86/Semantics/SYSCALL.cpp"
-#include "lib/Arch/X86/Semantics/SYSTEM.cpp"
-#include "lib/Arch/X86/Semantics/UNCOND_BR.cpp"
-#include "lib/Arch/X86/Semantics/X87.cpp"
-#include "lib/Arch/X86/Semantics/XOP.cpp"
-#include "lib/Arch/X86/Semantics/XSAVE.cpp"
+#if REMILL_HAS_SEMANTICS(AVX)
+#  include "lib/Arch/X86/Semantics/AVX.cpp"
+#endif
+#if REMILL_HAS_SEMANTICS(BINARY)
+#  include "lib/Arch/X86/Semantics/BINARY.cpp"
+#endif
+#if REMILL_HAS_SEMANTICS(BITBYTE)
+#  include "lib/Arch/X86/Semantics/BITBYTE.cpp"
+#endif
+#if REMILL_HAS_SEMANTICS(CALL_RET)
+#  include "lib/Arch/X86/Semantics/CALL_RET.cpp"
+#endif
+#if REMILL_HAS_SEMANTICS(CMOV)
+#  include "lib/Arch/X86/Semantics/CMOV.cpp"
+#endif
+#if REMILL_HAS_SEMANTICS(COND_BR)
+#  include "lib/Arch/X86/Semantics/COND_BR.cpp"
+#endif
+#if REMILL_HAS_SEMANTICS(CONVERT)
+#  include "lib/Arch/X86/Semantics/CONVERT.cpp"
+#endif
+#if REMILL_HAS_SEMANTICS(DATAXFER)
+#  include "lib/Arch/X86/Semantics/DATAXFER.cpp"
+#endif
+#if REMILL_HAS_SEMANTICS(DECIMAL)
+#  include "lib/Arch/X86/Semantics/DECIMAL.cpp"
+#endif
+#if REMILL_HAS_SEMANTICS(FLAGOP)
+#  include "lib/Arch/X86/Semantics/FLAGOP.cpp"
+#endif
+#if REMILL_HAS_SEMANTICS(FMA)
+#  include "lib/Arch/X86/Semantics/FMA.cpp"
+#endif
+#if REMILL_HAS_SEMANTICS(INTERRUPT)
+#  include "lib/Arch/X86/Semantics/INTERRUPT.cpp"
+#endif
+#if REMILL_HAS_SEMANTICS(IO)
+#  include "lib/Arch/X86/Semantics/IO.cpp"
+#endif
+#if REMILL_HAS_SEMANTICS(LOGICAL)
+#  include "lib/Arch/X86/Semantics/LOGICAL.cpp"
+#endif
+#if REMILL_HAS_SEMANTICS(MISC)
+#  include "lib/Arch/X86/Semantics/MISC.cpp"
+#endif
+#if REMILL_HAS_SEMANTICS(MMX)
+#  include "lib/Arch/X86/Semantics/MMX.cpp"
+#endif
+#if REMILL_HAS_SEMANTICS(NOP)
+#  include "lib/Arch/X86/Semantics/NOP.cpp"
+#endif
+#if REMILL_HAS_SEMANTICS(POP)
+#  include "lib/Arch/X86/Semantics/POP.cpp"
+#endif
+#if REMILL_HAS_SEMANTICS(PREFETCH)
+#  include "lib/Arch/X86/Semantics/PREFETCH.cpp"
+#endif
+#if REMILL_HAS_SEMANTICS(PUSH)
+#  include "lib/Arch/X86/Semantics/PUSH.cpp"
+#endif
+#if REMILL_HAS_SEMANTICS(ROTATE)
+#  include "lib/Arch/X86/Semantics/ROTATE.cpp"
+#endif
+#if REMILL_HAS_SEMANTICS(RTM)
+#  include "lib/Arch/X86/Semantics/RTM.cpp"
+#endif
+#if REMILL_HAS_SEMANTICS(SEMAPHORE)
+#  include "lib/Arch/X86/Semantics/SEMAPHORE.cpp"
+#endif
+#if REMILL_HAS_SEMANTICS(SHIFT)
+#  include "lib/Arch/X86/Semantics/SHIFT.cpp"
+#endif
+#if REMILL_HAS_SEMANTICS(SSE)
+#  include "lib/Arch/X86/Semantics/SSE.cpp"
+#endif
+#if REMILL_HAS_SEMANTICS(STRINGOP)
+#  include "lib/Arch/X86/Semantics/STRINGOP.cpp"
+#endif
+#if REMILL_HAS_SEMANTICS(SYSCALL)
+#  include "lib/Arch/X86/Semantics/SYSCALL.cpp"
+#endif
+#if REMILL_HAS_SEMANTICS(SYSTEM)
+#  include "lib/Arch/X86/Semantics/SYSTEM.cpp"
+#endif
+#if REMILL_HAS_SEMANTICS(UNCOND_BR)
+#  include "lib/Arch/X86/Semantics/UNCOND_BR.cpp"
+#endif
+#if REMILL_HAS_SEMANTICS(X87)
+#  include "lib/Arch/X86/Semantics/X87.cpp"
+#endif
+#if REMILL_HAS_SEMANTICS(XOP)
+#  include "lib/Arch/X86/Semantics/XOP.cpp"
+#endif
+#if REMILL_HAS_SEMANTICS(XSAVE)
+#  include "lib/Arch/X86/Semantics/XSAVE.cpp"
+#endif
 
 // clang-format on
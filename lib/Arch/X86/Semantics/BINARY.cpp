@@ -18,21 +18,6 @@
 
 namespace {
 
-template <typename Tag, typename T>
-ALWAYS_INLINE static void WriteFlagsIncDec(State &state, T lhs, T rhs, T res) {
-  FLAG_PF = ParityFlag(res);
-  FLAG_AF = AuxCarryFlag(lhs, rhs, res);
-  FLAG_ZF = ZeroFlag(res);
-  FLAG_SF = SignFlag(res);
-  FLAG_OF = Overflow<Tag>::Flag(lhs, rhs, res);
-}
-
-template <typename Tag, typename T>
-ALWAYS_INLINE static void WriteFlagsAddSub(State &state, T lhs, T rhs, T res) {
-  FLAG_CF = Carry<Tag>::Flag(lhs, rhs, res);
-  WriteFlagsIncDec<Tag>(state, lhs, rhs, res);
-}
-
 template <typename D, typename S1, typename S2>
 DEF_SEM(ADD, D dst, S1 src1, S2 src2) {
   auto lhs = Read(src1);
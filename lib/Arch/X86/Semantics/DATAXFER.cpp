@@ -84,6 +84,42 @@ DEF_SEM(MOVDQx, D dst, S src) {
   return memory;
 }
 
+#if HAS_FEATURE_AVX512
+template <typename D, typename S, typename V>
+DEF_SEM(MOVxPS_MASK, D dst, R64 mask, S src, V dst_src, I8 zeroing) {
+  const auto mask_val = Read(mask);
+  FWriteV32(dst, MaskV(mask_val, FMaskedReadV32(mask_val, src),
+                       FReadV32(dst_src), Read(zeroing)));
+  return memory;
+}
+
+template <typename D, typename S, typename V>
+DEF_SEM(MOVxPD_MASK, D dst, R64 mask, S src, V dst_src, I8 zeroing) {
+  const auto mask_val = Read(mask);
+  FWriteV64(dst, MaskV(mask_val, FMaskedReadV64(mask_val, src),
+                       FReadV64(dst_src), Read(zeroing)));
+  return memory;
+}
+
+#  define MAKE_MOVDQx_MASK(size) \
+    template <typename D, typename S, typename V> \
+    DEF_SEM(MOVDQx##size##_MASK, D dst, R64 mask, S src, V dst_src, \
+            I8 zeroing) { \
+      const auto mask_val = Read(mask); \
+      UWriteV##size(dst, \
+                    MaskV(mask_val, UMaskedReadV##size(mask_val, src), \
+                          UReadV##size(dst_src), Read(zeroing))); \
+      return memory; \
+    }
+
+MAKE_MOVDQx_MASK(8)
+MAKE_MOVDQx_MASK(16)
+MAKE_MOVDQx_MASK(32)
+MAKE_MOVDQx_MASK(64)
+
+#  undef MAKE_MOVDQx_MASK
+#endif  // HAS_FEATURE_AVX512
+
 template <typename D, typename S>
 DEF_SEM(MOVLPS, D dst, S src) {
   auto src_vec = FReadV32(src);
@@ -279,17 +315,14 @@ DEF_ISEL(VMOVAPS_MEMqq_YMMqq) = MOVxPS<MV256W, VV256>;
 DEF_ISEL(VMOVAPS_YMMqq_YMMqq_29) = MOVxPS<VV256W, VV256>;
 #  if HAS_FEATURE_AVX512
 
-//4102 VMOVAPS VMOVAPS_ZMMf32_MASKmskw_ZMMf32_AVX512 DATAXFER AVX512EVEX AVX512F_512 ATTRIBUTES: MASKOP_EVEX
-//4103 VMOVAPS VMOVAPS_ZMMf32_MASKmskw_MEMf32_AVX512 DATAXFER AVX512EVEX AVX512F_512 ATTRIBUTES: AVX_REQUIRES_ALIGNMENT DISP8_FULLMEM MASKOP_EVEX MEMORY_FAULT_SUPPRESSION REQUIRES_ALIGNMENT
-//4104 VMOVAPS VMOVAPS_ZMMf32_MASKmskw_ZMMf32_AVX512 DATAXFER AVX512EVEX AVX512F_512 ATTRIBUTES: MASKOP_EVEX
+DEF_ISEL(VMOVAPS_ZMMf32_MASKmskw_ZMMf32_AVX512) = MOVxPS_MASK<VV512W, V512, V512>;
+DEF_ISEL(VMOVAPS_ZMMf32_MASKmskw_MEMf32_AVX512) = MOVxPS_MASK<VV512W, MV512, V512>;
 //4105 VMOVAPS VMOVAPS_MEMf32_MASKmskw_ZMMf32_AVX512 DATAXFER AVX512EVEX AVX512F_512 ATTRIBUTES: AVX_REQUIRES_ALIGNMENT DISP8_FULLMEM MASKOP_EVEX MEMORY_FAULT_SUPPRESSION REQUIRES_ALIGNMENT
-//4106 VMOVAPS VMOVAPS_XMMf32_MASKmskw_XMMf32_AVX512 DATAXFER AVX512EVEX AVX512F_128 ATTRIBUTES: MASKOP_EVEX
-//4107 VMOVAPS VMOVAPS_XMMf32_MASKmskw_MEMf32_AVX512 DATAXFER AVX512EVEX AVX512F_128 ATTRIBUTES: AVX_REQUIRES_ALIGNMENT DISP8_FULLMEM MASKOP_EVEX MEMORY_FAULT_SUPPRESSION REQUIRES_ALIGNMENT
-//4108 VMOVAPS VMOVAPS_XMMf32_MASKmskw_XMMf32_AVX512 DATAXFER AVX512EVEX AVX512F_128 ATTRIBUTES: MASKOP_EVEX
+DEF_ISEL(VMOVAPS_XMMf32_MASKmskw_XMMf32_AVX512) = MOVxPS_MASK<VV128W, V128, V128>;
+DEF_ISEL(VMOVAPS_XMMf32_MASKmskw_MEMf32_AVX512) = MOVxPS_MASK<VV128W, MV128, V128>;
 //4109 VMOVAPS VMOVAPS_MEMf32_MASKmskw_XMMf32_AVX512 DATAXFER AVX512EVEX AVX512F_128 ATTRIBUTES: AVX_REQUIRES_ALIGNMENT DISP8_FULLMEM MASKOP_EVEX MEMORY_FAULT_SUPPRESSION REQUIRES_ALIGNMENT
-//4110 VMOVAPS VMOVAPS_YMMf32_MASKmskw_YMMf32_AVX512 DATAXFER AVX512EVEX AVX512F_256 ATTRIBUTES: MASKOP_EVEX
-//4111 VMOVAPS VMOVAPS_YMMf32_MASKmskw_MEMf32_AVX512 DATAXFER AVX512EVEX AVX512F_256 ATTRIBUTES: AVX_REQUIRES_ALIGNMENT DISP8_FULLMEM MASKOP_EVEX MEMORY_FAULT_SUPPRESSION REQUIRES_ALIGNMENT
-//4112 VMOVAPS VMOVAPS_YMMf32_MASKmskw_YMMf32_AVX512 DATAXFER AVX512EVEX AVX512F_256 ATTRIBUTES: MASKOP_EVEX
+DEF_ISEL(VMOVAPS_YMMf32_MASKmskw_YMMf32_AVX512) = MOVxPS_MASK<VV256W, V256, V256>;
+DEF_ISEL(VMOVAPS_YMMf32_MASKmskw_MEMf32_AVX512) = MOVxPS_MASK<VV256W, MV256, V256>;
 //4113 VMOVAPS VMOVAPS_MEMf32_MASKmskw_YMMf32_AVX512 DATAXFER AVX512EVEX AVX512F_256 ATTRIBUTES: AVX_REQUIRES_ALIGNMENT DISP8_FULLMEM MASKOP_EVEX MEMORY_FAULT_SUPPRESSION REQUIRES_ALIGNMENT
 #  endif  // HAS_FEATURE_AVX512
 #endif  // HAS_FEATURE_AVX
@@ -323,17 +356,14 @@ DEF_ISEL(VMOVUPS_MEMqq_YMMqq) = MOVxPS<MV256W, VV256>;
 DEF_ISEL(VMOVUPS_YMMqq_YMMqq_11) = MOVxPS<VV256W, VV256>;
 #  if HAS_FEATURE_AVX512
 
-//4954 VMOVUPS VMOVUPS_ZMMf32_MASKmskw_ZMMf32_AVX512 DATAXFER AVX512EVEX AVX512F_512 ATTRIBUTES: MASKOP_EVEX
-//4955 VMOVUPS VMOVUPS_ZMMf32_MASKmskw_MEMf32_AVX512 DATAXFER AVX512EVEX AVX512F_512 ATTRIBUTES: DISP8_FULLMEM MASKOP_EVEX MEMORY_FAULT_SUPPRESSION
-//4956 VMOVUPS VMOVUPS_ZMMf32_MASKmskw_ZMMf32_AVX512 DATAXFER AVX512EVEX AVX512F_512 ATTRIBUTES: MASKOP_EVEX
+DEF_ISEL(VMOVUPS_ZMMf32_MASKmskw_ZMMf32_AVX512) = MOVxPS_MASK<VV512W, V512, V512>;
+DEF_ISEL(VMOVUPS_ZMMf32_MASKmskw_MEMf32_AVX512) = MOVxPS_MASK<VV512W, MV512, V512>;
 //4957 VMOVUPS VMOVUPS_MEMf32_MASKmskw_ZMMf32_AVX512 DATAXFER AVX512EVEX AVX512F_512 ATTRIBUTES: DISP8_FULLMEM MASKOP_EVEX MEMORY_FAULT_SUPPRESSION
-//4958 VMOVUPS VMOVUPS_XMMf32_MASKmskw_XMMf32_AVX512 DATAXFER AVX512EVEX AVX512F_128 ATTRIBUTES: MASKOP_EVEX
-//4959 VMOVUPS VMOVUPS_XMMf32_MASKmskw_MEMf32_AVX512 DATAXFER AVX512EVEX AVX512F_128 ATTRIBUTES: DISP8_FULLMEM MASKOP_EVEX MEMORY_FAULT_SUPPRESSION
-//4960 VMOVUPS VMOVUPS_XMMf32_MASKmskw_XMMf32_AVX512 DATAXFER AVX512EVEX AVX512F_128 ATTRIBUTES: MASKOP_EVEX
+DEF_ISEL(VMOVUPS_XMMf32_MASKmskw_XMMf32_AVX512) = MOVxPS_MASK<VV128W, V128, V128>;
+DEF_ISEL(VMOVUPS_XMMf32_MASKmskw_MEMf32_AVX512) = MOVxPS_MASK<VV128W, MV128, V128>;
 //4961 VMOVUPS VMOVUPS_MEMf32_MASKmskw_XMMf32_AVX512 DATAXFER AVX512EVEX AVX512F_128 ATTRIBUTES: DISP8_FULLMEM MASKOP_EVEX MEMORY_FAULT_SUPPRESSION
-//4962 VMOVUPS VMOVUPS_YMMf32_MASKmskw_YMMf32_AVX512 DATAXFER AVX512EVEX AVX512F_256 ATTRIBUTES: MASKOP_EVEX
-//4963 VMOVUPS VMOVUPS_YMMf32_MASKmskw_MEMf32_AVX512 DATAXFER AVX512EVEX AVX512F_256 ATTRIBUTES: DISP8_FULLMEM MASKOP_EVEX MEMORY_FAULT_SUPPRESSION
-//4964 VMOVUPS VMOVUPS_YMMf32_MASKmskw_YMMf32_AVX512 DATAXFER AVX512EVEX AVX512F_256 ATTRIBUTES: MASKOP_EVEX
+DEF_ISEL(VMOVUPS_YMMf32_MASKmskw_YMMf32_AVX512) = MOVxPS_MASK<VV256W, V256, V256>;
+DEF_ISEL(VMOVUPS_YMMf32_MASKmskw_MEMf32_AVX512) = MOVxPS_MASK<VV256W, MV256, V256>;
 //4965 VMOVUPS VMOVUPS_MEMf32_MASKmskw_YMMf32_AVX512 DATAXFER AVX512EVEX AVX512F_256 ATTRIBUTES: DISP8_FULLMEM MASKOP_EVEX MEMORY_FAULT_SUPPRESSION
 #  endif  // HAS_FEATURE_AVX512
 #endif  // HAS_FEATURE_AVX
@@ -354,17 +384,14 @@ DEF_ISEL(VMOVAPD_MEMqq_YMMqq) = MOVxPD<MV256W, VV256>;
 DEF_ISEL(VMOVAPD_YMMqq_YMMqq_29) = MOVxPD<VV256W, VV256>;
 #  if HAS_FEATURE_AVX512
 
-//5585 VMOVAPD VMOVAPD_ZMMf64_MASKmskw_ZMMf64_AVX512 DATAXFER AVX512EVEX AVX512F_512 ATTRIBUTES: MASKOP_EVEX
-//5586 VMOVAPD VMOVAPD_ZMMf64_MASKmskw_MEMf64_AVX512 DATAXFER AVX512EVEX AVX512F_512 ATTRIBUTES: AVX_REQUIRES_ALIGNMENT DISP8_FULLMEM MASKOP_EVEX MEMORY_FAULT_SUPPRESSION REQUIRES_ALIGNMENT
-//5587 VMOVAPD VMOVAPD_ZMMf64_MASKmskw_ZMMf64_AVX512 DATAXFER AVX512EVEX AVX512F_512 ATTRIBUTES: MASKOP_EVEX
+DEF_ISEL(VMOVAPD_ZMMf64_MASKmskw_ZMMf64_AVX512) = MOVxPD_MASK<VV512W, V512, V512>;
+DEF_ISEL(VMOVAPD_ZMMf64_MASKmskw_MEMf64_AVX512) = MOVxPD_MASK<VV512W, MV512, V512>;
 //5588 VMOVAPD VMOVAPD_MEMf64_MASKmskw_ZMMf64_AVX512 DATAXFER AVX512EVEX AVX512F_512 ATTRIBUTES: AVX_REQUIRES_ALIGNMENT DISP8_FULLMEM MASKOP_EVEX MEMORY_FAULT_SUPPRESSION REQUIRES_ALIGNMENT
-//5589 VMOVAPD VMOVAPD_XMMf64_MASKmskw_XMMf64_AVX512 DATAXFER AVX512EVEX AVX512F_128 ATTRIBUTES: MASKOP_EVEX
-//5590 VMOVAPD VMOVAPD_XMMf64_MASKmskw_MEMf64_AVX512 DATAXFER AVX512EVEX AVX512F_128 ATTRIBUTES: AVX_REQUIRES_ALIGNMENT DISP8_FULLMEM MASKOP_EVEX MEMORY_FAULT_SUPPRESSION REQUIRES_ALIGNMENT
-//5591 VMOVAPD VMOVAPD_XMMf64_MASKmskw_XMMf64_AVX512 DATAXFER AVX512EVEX AVX512F_128 ATTRIBUTES: MASKOP_EVEX
+DEF_ISEL(VMOVAPD_XMMf64_MASKmskw_XMMf64_AVX512) = MOVxPD_MASK<VV128W, V128, V128>;
+DEF_ISEL(VMOVAPD_XMMf64_MASKmskw_MEMf64_AVX512) = MOVxPD_MASK<VV128W, MV128, V128>;
 //5592 VMOVAPD VMOVAPD_MEMf64_MASKmskw_XMMf64_AVX512 DATAXFER AVX512EVEX AVX512F_128 ATTRIBUTES: AVX_REQUIRES_ALIGNMENT DISP8_FULLMEM MASKOP_EVEX MEMORY_FAULT_SUPPRESSION REQUIRES_ALIGNMENT
-//5593 VMOVAPD VMOVAPD_YMMf64_MASKmskw_YMMf64_AVX512 DATAXFER AVX512EVEX AVX512F_256 ATTRIBUTES: MASKOP_EVEX
-//5594 VMOVAPD VMOVAPD_YMMf64_MASKmskw_MEMf64_AVX512 DATAXFER AVX512EVEX AVX512F_256 ATTRIBUTES: AVX_REQUIRES_ALIGNMENT DISP8_FULLMEM MASKOP_EVEX MEMORY_FAULT_SUPPRESSION REQUIRES_ALIGNMENT
-//5595 VMOVAPD VMOVAPD_YMMf64_MASKmskw_YMMf64_AVX512 DATAXFER AVX512EVEX AVX512F_256 ATTRIBUTES: MASKOP_EVEX
+DEF_ISEL(VMOVAPD_YMMf64_MASKmskw_YMMf64_AVX512) = MOVxPD_MASK<VV256W, V256, V256>;
+DEF_ISEL(VMOVAPD_YMMf64_MASKmskw_MEMf64_AVX512) = MOVxPD_MASK<VV256W, MV256, V256>;
 //5596 VMOVAPD VMOVAPD_MEMf64_MASKmskw_YMMf64_AVX512 DATAXFER AVX512EVEX AVX512F_256 ATTRIBUTES: AVX_REQUIRES_ALIGNMENT DISP8_FULLMEM MASKOP_EVEX MEMORY_FAULT_SUPPRESSION REQUIRES_ALIGNMENT
 #  endif  // HAS_FEATURE_AVX512
 #endif  // HAS_FEATURE_AVX
@@ -398,17 +425,14 @@ DEF_ISEL(VMOVUPD_MEMqq_YMMqq) = MOVxPD<MV256W, VV256>;
 DEF_ISEL(VMOVUPD_YMMqq_YMMqq_11) = MOVxPD<VV256W, VV256>;
 #  if HAS_FEATURE_AVX512
 
-//4991 VMOVUPD VMOVUPD_ZMMf64_MASKmskw_ZMMf64_AVX512 DATAXFER AVX512EVEX AVX512F_512 ATTRIBUTES: MASKOP_EVEX
-//4992 VMOVUPD VMOVUPD_ZMMf64_MASKmskw_MEMf64_AVX512 DATAXFER AVX512EVEX AVX512F_512 ATTRIBUTES: DISP8_FULLMEM MASKOP_EVEX MEMORY_FAULT_SUPPRESSION
-//4993 VMOVUPD VMOVUPD_ZMMf64_MASKmskw_ZMMf64_AVX512 DATAXFER AVX512EVEX AVX512F_512 ATTRIBUTES: MASKOP_EVEX
+DEF_ISEL(VMOVUPD_ZMMf64_MASKmskw_ZMMf64_AVX512) = MOVxPD_MASK<VV512W, V512, V512>;
+DEF_ISEL(VMOVUPD_ZMMf64_MASKmskw_MEMf64_AVX512) = MOVxPD_MASK<VV512W, MV512, V512>;
 //4994 VMOVUPD VMOVUPD_MEMf64_MASKmskw_ZMMf64_AVX512 DATAXFER AVX512EVEX AVX512F_512 ATTRIBUTES: DISP8_FULLMEM MASKOP_EVEX MEMORY_FAULT_SUPPRESSION
-//4995 VMOVUPD VMOVUPD_XMMf64_MASKmskw_XMMf64_AVX512 DATAXFER AVX512EVEX AVX512F_128 ATTRIBUTES: MASKOP_EVEX
-//4996 VMOVUPD VMOVUPD_XMMf64_MASKmskw_MEMf64_AVX512 DATAXFER AVX512EVEX AVX512F_128 ATTRIBUTES: DISP8_FULLMEM MASKOP_EVEX MEMORY_FAULT_SUPPRESSION
-//4997 VMOVUPD VMOVUPD_XMMf64_MASKmskw_XMMf64_AVX512 DATAXFER AVX512EVEX AVX512F_128 ATTRIBUTES: MASKOP_EVEX
+DEF_ISEL(VMOVUPD_XMMf64_MASKmskw_XMMf64_AVX512) = MOVxPD_MASK<VV128W, V128, V128>;
+DEF_ISEL(VMOVUPD_XMMf64_MASKmskw_MEMf64_AVX512) = MOVxPD_MASK<VV128W, MV128, V128>;
 //4998 VMOVUPD VMOVUPD_MEMf64_MASKmskw_XMMf64_AVX512 DATAXFER AVX512EVEX AVX512F_128 ATTRIBUTES: DISP8_FULLMEM MASKOP_EVEX MEMORY_FAULT_SUPPRESSION
-//4999 VMOVUPD VMOVUPD_YMMf64_MASKmskw_YMMf64_AVX512 DATAXFER AVX512EVEX AVX512F_256 ATTRIBUTES: MASKOP_EVEX
-//5000 VMOVUPD VMOVUPD_YMMf64_MASKmskw_MEMf64_AVX512 DATAXFER AVX512EVEX AVX512F_256 ATTRIBUTES: DISP8_FULLMEM MASKOP_EVEX MEMORY_FAULT_SUPPRESSION
-//5001 VMOVUPD VMOVUPD_YMMf64_MASKmskw_YMMf64_AVX512 DATAXFER AVX512EVEX AVX512F_256 ATTRIBUTES: MASKOP_EVEX
+DEF_ISEL(VMOVUPD_YMMf64_MASKmskw_YMMf64_AVX512) = MOVxPD_MASK<VV256W, V256, V256>;
+DEF_ISEL(VMOVUPD_YMMf64_MASKmskw_MEMf64_AVX512) = MOVxPD_MASK<VV256W, MV256, V256>;
 //5002 VMOVUPD VMOVUPD_MEMf64_MASKmskw_YMMf64_AVX512 DATAXFER AVX512EVEX AVX512F_256 ATTRIBUTES: DISP8_FULLMEM MASKOP_EVEX MEMORY_FAULT_SUPPRESSION
 #  endif  // HAS_FEATURE_AVX512
 #endif  // HAS_FEATURE_AVX
@@ -460,6 +484,44 @@ DEF_ISEL(VMOVDQA_YMMqq_MEMqq) = MOVDQx<VV256W, MV256>;
 DEF_ISEL(VMOVDQA_YMMqq_YMMqq_6F) = MOVDQx<VV256W, VV256>;
 DEF_ISEL(VMOVDQA_MEMqq_YMMqq) = MOVDQx<MV256W, VV256>;
 DEF_ISEL(VMOVDQA_YMMqq_YMMqq_7F) = MOVDQx<VV256W, VV256>;
+#  if HAS_FEATURE_AVX512
+DEF_ISEL(VMOVDQA32_XMMu32_MASKmskw_XMMu32_AVX512) = MOVDQx32_MASK<VV128W, V128, V128>;
+DEF_ISEL(VMOVDQA32_XMMu32_MASKmskw_MEMu32_AVX512) = MOVDQx32_MASK<VV128W, MV128, V128>;
+DEF_ISEL(VMOVDQA32_YMMu32_MASKmskw_YMMu32_AVX512) = MOVDQx32_MASK<VV256W, V256, V256>;
+DEF_ISEL(VMOVDQA32_YMMu32_MASKmskw_MEMu32_AVX512) = MOVDQx32_MASK<VV256W, MV256, V256>;
+DEF_ISEL(VMOVDQA32_ZMMu32_MASKmskw_ZMMu32_AVX512) = MOVDQx32_MASK<VV512W, V512, V512>;
+DEF_ISEL(VMOVDQA32_ZMMu32_MASKmskw_MEMu32_AVX512) = MOVDQx32_MASK<VV512W, MV512, V512>;
+DEF_ISEL(VMOVDQA64_XMMu64_MASKmskw_XMMu64_AVX512) = MOVDQx64_MASK<VV128W, V128, V128>;
+DEF_ISEL(VMOVDQA64_XMMu64_MASKmskw_MEMu64_AVX512) = MOVDQx64_MASK<VV128W, MV128, V128>;
+DEF_ISEL(VMOVDQA64_YMMu64_MASKmskw_YMMu64_AVX512) = MOVDQx64_MASK<VV256W, V256, V256>;
+DEF_ISEL(VMOVDQA64_YMMu64_MASKmskw_MEMu64_AVX512) = MOVDQx64_MASK<VV256W, MV256, V256>;
+DEF_ISEL(VMOVDQA64_ZMMu64_MASKmskw_ZMMu64_AVX512) = MOVDQx64_MASK<VV512W, V512, V512>;
+DEF_ISEL(VMOVDQA64_ZMMu64_MASKmskw_MEMu64_AVX512) = MOVDQx64_MASK<VV512W, MV512, V512>;
+DEF_ISEL(VMOVDQU8_XMMu8_MASKmskw_XMMu8_AVX512) = MOVDQx8_MASK<VV128W, V128, V128>;
+DEF_ISEL(VMOVDQU8_XMMu8_MASKmskw_MEMu8_AVX512) = MOVDQx8_MASK<VV128W, MV128, V128>;
+DEF_ISEL(VMOVDQU8_YMMu8_MASKmskw_YMMu8_AVX512) = MOVDQx8_MASK<VV256W, V256, V256>;
+DEF_ISEL(VMOVDQU8_YMMu8_MASKmskw_MEMu8_AVX512) = MOVDQx8_MASK<VV256W, MV256, V256>;
+DEF_ISEL(VMOVDQU8_ZMMu8_MASKmskw_ZMMu8_AVX512) = MOVDQx8_MASK<VV512W, V512, V512>;
+DEF_ISEL(VMOVDQU8_ZMMu8_MASKmskw_MEMu8_AVX512) = MOVDQx8_MASK<VV512W, MV512, V512>;
+DEF_ISEL(VMOVDQU16_XMMu16_MASKmskw_XMMu16_AVX512) = MOVDQx16_MASK<VV128W, V128, V128>;
+DEF_ISEL(VMOVDQU16_XMMu16_MASKmskw_MEMu16_AVX512) = MOVDQx16_MASK<VV128W, MV128, V128>;
+DEF_ISEL(VMOVDQU16_YMMu16_MASKmskw_YMMu16_AVX512) = MOVDQx16_MASK<VV256W, V256, V256>;
+DEF_ISEL(VMOVDQU16_YMMu16_MASKmskw_MEMu16_AVX512) = MOVDQx16_MASK<VV256W, MV256, V256>;
+DEF_ISEL(VMOVDQU16_ZMMu16_MASKmskw_ZMMu16_AVX512) = MOVDQx16_MASK<VV512W, V512, V512>;
+DEF_ISEL(VMOVDQU16_ZMMu16_MASKmskw_MEMu16_AVX512) = MOVDQx16_MASK<VV512W, MV512, V512>;
+DEF_ISEL(VMOVDQU32_XMMu32_MASKmskw_XMMu32_AVX512) = MOVDQx32_MASK<VV128W, V128, V128>;
+DEF_ISEL(VMOVDQU32_XMMu32_MASKmskw_MEMu32_AVX512) = MOVDQx32_MASK<VV128W, MV128, V128>;
+DEF_ISEL(VMOVDQU32_YMMu32_MASKmskw_YMMu32_AVX512) = MOVDQx32_MASK<VV256W, V256, V256>;
+DEF_ISEL(VMOVDQU32_YMMu32_MASKmskw_MEMu32_AVX512) = MOVDQx32_MASK<VV256W, MV256, V256>;
+DEF_ISEL(VMOVDQU32_ZMMu32_MASKmskw_ZMMu32_AVX512) = MOVDQx32_MASK<VV512W, V512, V512>;
+DEF_ISEL(VMOVDQU32_ZMMu32_MASKmskw_MEMu32_AVX512) = MOVDQx32_MASK<VV512W, MV512, V512>;
+DEF_ISEL(VMOVDQU64_XMMu64_MASKmskw_XMMu64_AVX512) = MOVDQx64_MASK<VV128W, V128, V128>;
+DEF_ISEL(VMOVDQU64_XMMu64_MASKmskw_MEMu64_AVX512) = MOVDQx64_MASK<VV128W, MV128, V128>;
+DEF_ISEL(VMOVDQU64_YMMu64_MASKmskw_YMMu64_AVX512) = MOVDQx64_MASK<VV256W, V256, V256>;
+DEF_ISEL(VMOVDQU64_YMMu64_MASKmskw_MEMu64_AVX512) = MOVDQx64_MASK<VV256W, MV256, V256>;
+DEF_ISEL(VMOVDQU64_ZMMu64_MASKmskw_ZMMu64_AVX512) = MOVDQx64_MASK<VV512W, V512, V512>;
+DEF_ISEL(VMOVDQU64_ZMMu64_MASKmskw_MEMu64_AVX512) = MOVDQx64_MASK<VV512W, MV512, V512>;
+#  endif  // HAS_FEATURE_AVX512
 #endif  // HAS_FEATURE_AVX
 
 DEF_ISEL(MOVLPS_MEMq_XMMps) = MOVLPS<MV64W, V128>;
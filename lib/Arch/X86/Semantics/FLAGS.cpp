@@ -170,6 +170,24 @@ struct Carry<tag_sub> {
   }
 };
 
+// Updates the arithmetic flags after an increment or decrement.
+template <typename Tag, typename T>
+ALWAYS_INLINE static void WriteFlagsIncDec(State &state, T lhs, T rhs, T res) {
+  FLAG_PF = ParityFlag(res);
+  FLAG_AF = AuxCarryFlag(lhs, rhs, res);
+  FLAG_ZF = ZeroFlag(res);
+  FLAG_SF = SignFlag(res);
+  FLAG_OF = Overflow<Tag>::Flag(lhs, rhs, res);
+}
+
+// Updates the arithmetic flags after an addition or subtraction. This is also
+// used by the `CMPXCHG` and `CMPS` semantics.
+template <typename Tag, typename T>
+ALWAYS_INLINE static void WriteFlagsAddSub(State &state, T lhs, T rhs, T res) {
+  FLAG_CF = Carry<Tag>::Flag(lhs, rhs, res);
+  WriteFlagsIncDec<Tag>(state, lhs, rhs, res);
+}
+
 }  // namespace
 
 #define ClearArithFlags() \
@@ -192,6 +210,39 @@ ALWAYS_INLINE static void SetFPSRStatusFlags(State &state, int mask) {
   state.sw.ze |= static_cast<uint8_t>(0 != (mask & FE_DIVBYZERO));
 }
 
+// Fold the exceptions that the host FPU has raised since they were last
+// tested into the status flags, before the status register is read or
+// written. This is a no-op unless the exceptions of the operations are
+// deferred; see `FPExceptionLowering::kDefer`.
+ALWAYS_INLINE static void SyncFPSRStatusFlags(State &state) {
+  SetFPSRStatusFlags(state, __remill_fpu_exception_test_and_clear(0, 0));
+}
+
+#if HAS_FEATURE_FAST_X87
+
+// The fast x87 semantics don't test the host FPU exceptions around each
+// operation, which would keep the operations from being optimized.
+template <typename F, typename T>
+ALWAYS_INLINE static auto CheckedFloatUnaryOp(State &, F func, T arg1)
+    -> decltype(func(arg1)) {
+  return func(arg1);
+}
+
+template <typename F1, typename F2, typename T>
+ALWAYS_INLINE static auto CheckedFloatUnaryOp2(State &, F1 func1, F2 func2,
+                                               T arg1)
+    -> decltype(func2(func1(arg1))) {
+  return func2(func1(arg1));
+}
+
+template <typename F, typename T>
+ALWAYS_INLINE static auto CheckedFloatBinOp(State &, F func, T arg1, T arg2)
+    -> decltype(func(arg1, arg2)) {
+  return func(arg1, arg2);
+}
+
+#else
+
 template <typename F, typename T>
 ALWAYS_INLINE static auto CheckedFloatUnaryOp(State &state, F func, T arg1)
     -> decltype(func(arg1)) {
@@ -243,3 +294,5 @@ ALWAYS_INLINE static auto CheckedFloatBinOp(State &state, F func, T arg1,
   SetFPSRStatusFlags(state, new_except);
   return res;
 }
+
+#endif  // HAS_FEATURE_FAST_X87
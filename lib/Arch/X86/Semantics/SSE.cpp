@@ -397,16 +397,7 @@ namespace {
   DEF_SEM(PCMP##suffix, D dst, S1 src1, S2 src2) { \
     auto src1_vec = SReadV##size(src1); \
     auto src2_vec = SReadV##size(src2); \
-    auto dst_vec = SClearV##size(SReadV##size(dst)); \
-    auto num_elems = NumVectorElems(src1_vec); \
-    _Pragma("unroll") for (std::size_t i = 0; i < num_elems; ++i) { \
-      auto src1_elem = SExtractV##size(src1_vec, i); \
-      auto src2_elem = SExtractV##size(src2_vec, i); \
-      auto res = Select<int##size##_t>(op(src1_elem, src2_elem), -1_s##size, \
-                                       0_s##size); \
-      dst_vec = SInsertV##size(dst_vec, i, res); \
-    } \
-    SWriteV##size(dst, dst_vec); \
+    SWriteV##size(dst, op##V##size(src1_vec, src2_vec)); \
     return memory; \
   }
 
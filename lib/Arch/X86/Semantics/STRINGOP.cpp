@@ -164,35 +164,132 @@ IF_64BIT(MAKE_CMPS(CMPSQ, uint64_t))
 
 #undef MAKE_MOVS
 
-#define MAKE_REP(base) \
+// Returns `true` if the `count` elements of `el_size` bytes starting at `addr`
+// don't wrap around the end of the address space.
+ALWAYS_INLINE static bool IsBulkRange(addr_t addr, addr_t count,
+                                      addr_t el_size) {
+  const addr_t max_count = UDiv(addr_t(~addr_t(0)), el_size);
+  return BAnd(UCmpLte(count, max_count),
+              UCmpGte(UAdd(addr, UMul(count, el_size)), addr));
+}
+
+// Returns `true` if the `count` elements of `el_size` bytes starting at `dst`
+// and at `src` neither overlap nor wrap around.
+ALWAYS_INLINE static bool AreDisjointBulkRanges(addr_t dst, addr_t src,
+                                                addr_t count, addr_t el_size) {
+  const addr_t num_bytes = UMul(count, el_size);
+  return BAnd(BAnd(IsBulkRange(dst, count, el_size),
+                   IsBulkRange(src, count, el_size)),
+              BOr(UCmpLte(UAdd(dst, num_bytes), src),
+                  UCmpLte(UAdd(src, num_bytes), dst)));
+}
+
+// Runs `base` once per element, counting down `count_reg` and `XCX`. This is
+// how the `REP` variants below handle the ranges they can't access in bulk.
+#define REP_EACH_ELEMENT(base, count_reg) \
+  while (UCmpNeq(count_reg, 0)) { \
+    memory = Do##base(memory, state); \
+    count_reg = USub(count_reg, 1); \
+    Write(REG_XCX, count_reg); \
+  }
+
+// Forward `REP LODS` only reads the last element into the accumulator.
+#define MAKE_REP_LODS(base, type, write_sel) \
   namespace { \
   DEF_SEM(Do##REP_##base) { \
     auto count_reg = Read(REG_XCX); \
-    while (UCmpNeq(count_reg, 0)) { \
-      memory = Do##base(memory, state); \
-      count_reg = USub(count_reg, 1); \
-      Write(REG_XCX, count_reg); \
+    const addr_t src_addr = Read(REG_XSI); \
+    const addr_t el_size = sizeof(type); \
+    if (BAnd(BAnd(UCmpNeq(count_reg, addr_t(0)), BNot(FLAG_DF)), \
+             IsBulkRange(src_addr, count_reg, el_size))) { \
+      const addr_t num_bytes = UMul(count_reg, el_size); \
+      const addr_t last_addr = UAdd(src_addr, USub(num_bytes, el_size)); \
+      WriteZExt(state.gpr.rax.write_sel, \
+                Read(ReadPtr<type>(last_addr _IF_32BIT(REG_DS_BASE)))); \
+      Write(REG_XSI, UAdd(src_addr, num_bytes)); \
+      Write(REG_XCX, addr_t(0)); \
+      return memory; \
+    } \
+    REP_EACH_ELEMENT(base, count_reg); \
+    return memory; \
+  } \
+  } \
+  DEF_ISEL(REP_##base) = Do##REP_##base;
+
+MAKE_REP_LODS(LODSB, uint8_t, byte.low)
+MAKE_REP_LODS(LODSW, uint16_t, word)
+MAKE_REP_LODS(LODSD, uint32_t, IF_64BIT_ELSE(qword, dword))
+IF_64BIT(MAKE_REP_LODS(LODSQ, uint64_t, qword))
+
+#undef MAKE_REP_LODS
+
+// Forward `REP MOVS` and `REP STOS` are lifted as one bulk memory intrinsic,
+// rather than as a loop of element-sized reads and writes. Backward ones, i.e.
+// when the direction flag is set, still loop, as do `REP MOVS` whose source
+// and destination overlap.
+#define MAKE_REP_MOVS(base, type, size) \
+  namespace { \
+  DEF_SEM(Do##REP_##base) { \
+    auto count_reg = Read(REG_XCX); \
+    const addr_t src_addr = Read(REG_XSI); \
+    const addr_t dst_addr = Read(REG_XDI); \
+    const addr_t el_size = sizeof(type); \
+    const addr_t dst = \
+        AddressOf(WritePtr<type>(dst_addr _IF_32BIT(REG_ES_BASE))); \
+    const addr_t src = \
+        AddressOf(ReadPtr<type>(src_addr _IF_32BIT(REG_DS_BASE))); \
+    if (BAnd(BAnd(UCmpNeq(count_reg, addr_t(0)), BNot(FLAG_DF)), \
+             AreDisjointBulkRanges(dst, src, count_reg, el_size))) { \
+      const addr_t num_bytes = UMul(count_reg, el_size); \
+      memory = __remill_copy_memory_##size(memory, dst, src, count_reg); \
+      Write(REG_XDI, UAdd(dst_addr, num_bytes)); \
+      Write(REG_XSI, UAdd(src_addr, num_bytes)); \
+      Write(REG_XCX, addr_t(0)); \
+      return memory; \
+    } \
+    REP_EACH_ELEMENT(base, count_reg); \
+    return memory; \
+  } \
+  } \
+  DEF_ISEL(REP_##base) = Do##REP_##base;
+
+MAKE_REP_MOVS(MOVSB, uint8_t, 8)
+MAKE_REP_MOVS(MOVSW, uint16_t, 16)
+MAKE_REP_MOVS(MOVSD, uint32_t, 32)
+IF_64BIT(MAKE_REP_MOVS(MOVSQ, uint64_t, 64))
+
+#undef MAKE_REP_MOVS
+
+#define MAKE_REP_STOS(base, type, size, read_sel) \
+  namespace { \
+  DEF_SEM(Do##REP_##base) { \
+    auto count_reg = Read(REG_XCX); \
+    const addr_t dst_addr = Read(REG_XDI); \
+    const addr_t el_size = sizeof(type); \
+    const addr_t dst = \
+        AddressOf(WritePtr<type>(dst_addr _IF_32BIT(REG_ES_BASE))); \
+    if (BAnd(BAnd(UCmpNeq(count_reg, addr_t(0)), BNot(FLAG_DF)), \
+             IsBulkRange(dst, count_reg, el_size))) { \
+      const addr_t num_bytes = UMul(count_reg, el_size); \
+      const type val = Read(state.gpr.rax.read_sel); \
+      memory = __remill_fill_memory_##size(memory, dst, val, count_reg); \
+      Write(REG_XDI, UAdd(dst_addr, num_bytes)); \
+      Write(REG_XCX, addr_t(0)); \
+      return memory; \
     } \
+    REP_EACH_ELEMENT(base, count_reg); \
     return memory; \
   } \
   } \
   DEF_ISEL(REP_##base) = Do##REP_##base;
 
-MAKE_REP(LODSB)
-MAKE_REP(LODSW)
-MAKE_REP(LODSD)
-IF_64BIT(MAKE_REP(LODSQ))
-
-MAKE_REP(MOVSB)
-MAKE_REP(MOVSW)
-MAKE_REP(MOVSD)
-IF_64BIT(MAKE_REP(MOVSQ))
-
-MAKE_REP(STOSB)
-MAKE_REP(STOSW)
-MAKE_REP(STOSD)
-IF_64BIT(MAKE_REP(STOSQ))
-#undef MAKE_REP
+MAKE_REP_STOS(STOSB, uint8_t, 8, byte.low)
+MAKE_REP_STOS(STOSW, uint16_t, 16, word)
+MAKE_REP_STOS(STOSD, uint32_t, 32, dword)
+IF_64BIT(MAKE_REP_STOS(STOSQ, uint64_t, 64, qword))
+
+#undef MAKE_REP_STOS
+#undef REP_EACH_ELEMENT
 
 #define MAKE_REPE(base) \
   namespace { \
@@ -16,6 +16,15 @@
 
 #pragma once
 
+// The fast x87 semantics don't track the top of stack in the status word.
+#if HAS_FEATURE_FAST_X87
+#  define UPDATE_X87_TOP(delta)
+#else
+#  define UPDATE_X87_TOP(delta) \
+    state.x87.fxsave.swd.top = \
+        static_cast<uint16_t>((state.x87.fxsave.swd.top + (delta)) % 8)
+#endif
+
 #define PUSH_X87_STACK(x) \
   do { \
     auto __x = x; \
@@ -27,8 +36,7 @@
     state.st.elems[2].val = state.st.elems[1].val; \
     state.st.elems[1].val = state.st.elems[0].val; \
     state.st.elems[0].val = __x; \
-    state.x87.fxsave.swd.top = \
-        static_cast<uint16_t>((state.x87.fxsave.swd.top + 7) % 8); \
+    UPDATE_X87_TOP(7); \
   } while (false)
 
 
@@ -45,29 +53,42 @@
     state.st.elems[5].val = state.st.elems[6].val; \
     state.st.elems[6].val = state.st.elems[7].val; \
     state.st.elems[7].val = __x; \
-    state.x87.fxsave.swd.top = \
-        static_cast<uint16_t>((state.x87.fxsave.swd.top + 9) % 8); \
+    UPDATE_X87_TOP(9); \
     __x; \
   })
 
 namespace {
 
-#define SetFPUIpOp() \
-  do { \
-    state.x87.fxsave.fop = Read(fop); \
-    IF_32BIT(state.x87.fxsave32.ip = Read(pc);) \
-    IF_32BIT(state.x87.fxsave32.cs.flat = state.seg.cs.flat;) \
-    IF_64BIT(state.x87.fxsave64.ip = Read(pc);) \
-  } while (false)
+// The fast x87 semantics don't track the last instruction and data pointers,
+// or the last opcode.
+#if HAS_FEATURE_FAST_X87
+#  define SetFPUIpOp() \
+    do { \
+      (void) pc; \
+      (void) fop; \
+    } while (false)
+#  define SetFPUDp(mem) \
+    do { \
+      (void) mem; \
+    } while (false)
+#else
+#  define SetFPUIpOp() \
+    do { \
+      state.x87.fxsave.fop = Read(fop); \
+      IF_32BIT(state.x87.fxsave32.ip = Read(pc);) \
+      IF_32BIT(state.x87.fxsave32.cs.flat = state.seg.cs.flat;) \
+      IF_64BIT(state.x87.fxsave64.ip = Read(pc);) \
+    } while (false)
 
 // TODO(pag): Assume for now that FPU instructions only access memory via the
 //            `DS` data segment selector.
-#define SetFPUDp(mem) \
-  do { \
-    IF_32BIT(state.x87.fxsave32.dp = AddressOf(mem);) \
-    IF_32BIT(state.x87.fxsave32.ds.flat = state.seg.ds.flat;) \
-    IF_64BIT(state.x87.fxsave64.dp = AddressOf(mem);) \
-  } while (false)
+#  define SetFPUDp(mem) \
+    do { \
+      IF_32BIT(state.x87.fxsave32.dp = AddressOf(mem);) \
+      IF_32BIT(state.x87.fxsave32.ds.flat = state.seg.ds.flat;) \
+      IF_64BIT(state.x87.fxsave64.dp = AddressOf(mem);) \
+    } while (false)
+#endif  // HAS_FEATURE_FAST_X87
 
 #define DEF_FPU_SEM(name, ...) DEF_SEM(name, ##__VA_ARGS__, PC pc, I16 fop)
 
@@ -1260,6 +1281,7 @@ namespace {
 
 template <typename D>
 DEF_SEM(FNSTSW, D dst) {
+  SyncFPSRStatusFlags(state);
   auto &sw = state.x87.fxsave.swd;
   sw.c0 = state.sw.c0;
   sw.c1 = state.sw.c1;
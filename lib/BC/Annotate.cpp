@@ -16,6 +16,13 @@
 
 #include "remill/BC/Annotate.h"
 
+#include <llvm/IR/ValueHandle.h>
+
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <mutex>
+
 namespace remill {
 
 const std::string BaseFunction::metadata_value = "base";
@@ -56,11 +63,366 @@ const std::string Semantics::metadata_value =
 
 #if LLVM_VERSION_NUMBER >= LLVM_VERSION(4, 0)
 
+namespace {
+
+// Drops its function from an `OriginIndex` or `TieIndex` when the function
+// is deleted.
+template <typename IndexImpl>
+class IndexHandle final : public llvm::CallbackVH {
+ public:
+  IndexHandle(llvm::Function *func_, IndexImpl *impl_)
+      : llvm::CallbackVH(func_),
+        func(func_),
+        impl(impl_) {}
+
+  void deleted(void) override {
+    impl->Erase(func);  // Destroys `this`.
+  }
+
+ private:
+  llvm::Function *const func;
+  IndexImpl *const impl;
+};
+
+// The live `OriginIndex` of each module. `gNumOriginIndexes` lets `Annotate`
+// skip the lock when there are no indexes. The lock also guards the live
+// `TieIndex`es.
+static std::mutex gOriginIndexesLock;
+static std::atomic<unsigned> gNumOriginIndexes{0};
+
+static std::unordered_map<const llvm::Module *, OriginIndex *> &
+OriginIndexes(void) {
+  static std::unordered_map<const llvm::Module *, OriginIndex *> indexes;
+  return indexes;
+}
+
+// Returns the origin value of `func`, or `nullptr` if it doesn't have one.
+static llvm::MDString *GetOriginValue(llvm::Function *func) {
+  auto node = func->getMetadata(BaseFunction::metadata_kind);
+  if (!node || node->getNumOperands() != 1) {
+    return nullptr;
+  }
+  return llvm::dyn_cast<llvm::MDString>(node->getOperand(0));
+}
+
+}  // namespace
+
+struct OriginIndex::Impl {
+  explicit Impl(llvm::Module &module_) : module(module_) {}
+
+  void Insert(llvm::Function *func, unsigned id);
+  void Erase(llvm::Function *func);
+
+  llvm::Module &module;
+
+  // The origin value of each origin ID, and the functions with that value.
+  std::vector<std::string> values;
+  std::vector<std::vector<llvm::Function *>> funcs;
+  std::unordered_map<std::string, unsigned> value_ids;
+
+  // The origin ID of each indexed function, and its position in `funcs`.
+  struct Entry {
+    unsigned id;
+    unsigned pos;
+    std::unique_ptr<IndexHandle<Impl>> handle;
+  };
+  std::unordered_map<llvm::Function *, Entry> entries;
+};
+
+void OriginIndex::Impl::Insert(llvm::Function *func, unsigned id) {
+  auto &bucket = funcs[id];
+  auto &entry = entries[func];
+  entry.id = id;
+  entry.pos = static_cast<unsigned>(bucket.size());
+  entry.handle.reset(new IndexHandle<Impl>(func, this));
+  bucket.push_back(func);
+}
+
+void OriginIndex::Impl::Erase(llvm::Function *func) {
+  auto it = entries.find(func);
+  if (it == entries.end()) {
+    return;
+  }
+
+  // Swap the last function of the bucket into the place of `func`.
+  auto &bucket = funcs[it->second.id];
+  const auto pos = it->second.pos;
+  if (pos + 1u != bucket.size()) {
+    bucket[pos] = bucket.back();
+    entries.find(bucket[pos])->second.pos = pos;
+  }
+  bucket.pop_back();
+  entries.erase(it);
+}
+
+OriginIndex::OriginIndex(llvm::Module &module) : impl(new Impl(module)) {
+  Rebuild();
+
+  std::lock_guard<std::mutex> locker(gOriginIndexesLock);
+  auto &index = OriginIndexes()[&module];
+  LOG_IF(FATAL, index) << "Module " << module.getName().str()
+                       << " already has an origin index";
+  index = this;
+  gNumOriginIndexes.fetch_add(1u);
+}
+
+OriginIndex::~OriginIndex(void) {
+  std::lock_guard<std::mutex> locker(gOriginIndexesLock);
+  OriginIndexes().erase(&(impl->module));
+  gNumOriginIndexes.fetch_sub(1u);
+}
+
+OriginIndex *OriginIndex::Get(const llvm::Module *module) {
+  if (!gNumOriginIndexes.load(std::memory_order_acquire)) {
+    return nullptr;
+  }
+  std::lock_guard<std::mutex> locker(gOriginIndexesLock);
+  const auto &indexes = OriginIndexes();
+  auto it = indexes.find(module);
+  return it != indexes.end() ? it->second : nullptr;
+}
+
+// Re-read the origin type of `func`.
+void OriginIndex::Update(llvm::Function *func) {
+  auto value = func->getParent() == &(impl->module) ? GetOriginValue(func)
+                                                     : nullptr;
+  if (!value) {
+    impl->Erase(func);
+    return;
+  }
+
+  auto [id_it, added] = impl->value_ids.emplace(
+      value->getString().str(), static_cast<unsigned>(impl->values.size()));
+  const auto id = id_it->second;
+  if (added) {
+    impl->values.push_back(id_it->first);
+    impl->funcs.emplace_back();
+  }
+
+  auto entry_it = impl->entries.find(func);
+  if (entry_it != impl->entries.end()) {
+    if (entry_it->second.id == id) {
+      return;
+    }
+    impl->Erase(func);
+  }
+  impl->Insert(func, id);
+}
+
+// Re-read the origin types of every function in the module.
+void OriginIndex::Rebuild(void) {
+  impl->entries.clear();
+  for (auto &bucket : impl->funcs) {
+    bucket.clear();
+  }
+  for (auto &func : impl->module) {
+    Update(&func);
+  }
+}
+
+// Add the functions whose origin value contains any of `values` to `result`.
+// Functions moved into another module since they were indexed are skipped.
+void OriginIndex::GetFunctions(const std::string *const *values,
+                               size_t num_values,
+                               std::vector<llvm::Function *> &result) const {
+  for (auto id = 0u; id < impl->values.size(); ++id) {
+    const llvm::StringRef origin_value = impl->values[id];
+    auto matches = false;
+    for (size_t i = 0; i < num_values && !matches; ++i) {
+      matches = origin_value.contains(*(values[i]));
+    }
+    if (!matches) {
+      continue;
+    }
+    for (auto func : impl->funcs[id]) {
+      if (func->getParent() == &(impl->module)) {
+        result.push_back(func);
+      }
+    }
+  }
+}
+
+// Update the `OriginIndex` of the module of `func`, if there is one.
+void UpdateOriginIndex(llvm::Function *func) {
+  if (auto index = OriginIndex::Get(func->getParent())) {
+    index->Update(func);
+  }
+}
+
+namespace {
+
+// The live `TieIndex` of each module and tie kind.
+static std::atomic<unsigned> gNumTieIndexes{0};
+
+static std::map<std::pair<const llvm::Module *, std::string>, TieIndex *> &
+TieIndexes(void) {
+  static std::map<std::pair<const llvm::Module *, std::string>, TieIndex *>
+      indexes;
+  return indexes;
+}
+
+}  // namespace
+
+struct TieIndex::Impl {
+  Impl(llvm::Module &module_, const std::string &kind_)
+      : module(module_),
+        kind(kind_) {}
+
+  void Insert(llvm::Function *func, llvm::Function *tied_to);
+  void EraseTie(llvm::Function *func);
+  void Erase(llvm::Function *func);
+  void Track(llvm::Function *func);
+  void Untrack(llvm::Function *func);
+
+  llvm::Module &module;
+  const std::string kind;
+
+  // Each function that is tied to another, and its inverse.
+  std::unordered_map<llvm::Function *, llvm::Function *> tied;
+  std::unordered_map<llvm::Function *, std::vector<llvm::Function *>>
+      tied_from;
+
+  // Deletion handles of the functions in `tied` or `tied_from`.
+  std::unordered_map<llvm::Function *, std::unique_ptr<IndexHandle<Impl>>>
+      handles;
+};
+
+void TieIndex::Impl::Track(llvm::Function *func) {
+  auto &handle = handles[func];
+  if (!handle) {
+    handle.reset(new IndexHandle<Impl>(func, this));
+  }
+}
+
+// Drop the handle of `func` if it isn't part of any tie anymore.
+void TieIndex::Impl::Untrack(llvm::Function *func) {
+  if (!tied.count(func) && !tied_from.count(func)) {
+    handles.erase(func);
+  }
+}
+
+void TieIndex::Impl::Insert(llvm::Function *func, llvm::Function *tied_to) {
+  tied.emplace(func, tied_to);
+  tied_from[tied_to].push_back(func);
+  Track(func);
+  Track(tied_to);
+}
+
+// Remove the tie from `func`, but not the ties to it.
+void TieIndex::Impl::EraseTie(llvm::Function *func) {
+  auto it = tied.find(func);
+  if (it == tied.end()) {
+    return;
+  }
+  const auto tied_to = it->second;
+  tied.erase(it);
+
+  auto from_it = tied_from.find(tied_to);
+  auto &from = from_it->second;
+  from.erase(std::find(from.begin(), from.end(), func));
+  if (from.empty()) {
+    tied_from.erase(from_it);
+  }
+  Untrack(func);
+  Untrack(tied_to);
+}
+
+// Remove every tie from and to `func`.
+void TieIndex::Impl::Erase(llvm::Function *func) {
+  EraseTie(func);
+  auto from_it = tied_from.find(func);
+  if (from_it != tied_from.end()) {
+    const auto from = std::move(from_it->second);
+    tied_from.erase(from_it);
+    for (auto from_func : from) {
+      tied.erase(from_func);
+      Untrack(from_func);
+    }
+  }
+  handles.erase(func);
+}
+
+TieIndex::TieIndex(llvm::Module &module, const std::string &kind)
+    : impl(new Impl(module, kind)) {
+  Rebuild();
+
+  std::lock_guard<std::mutex> locker(gOriginIndexesLock);
+  auto &index = TieIndexes()[{&module, kind}];
+  LOG_IF(FATAL, index) << "Module " << module.getName().str()
+                       << " already has an index of " << kind << " ties";
+  index = this;
+  gNumTieIndexes.fetch_add(1u);
+}
+
+TieIndex::~TieIndex(void) {
+  std::lock_guard<std::mutex> locker(gOriginIndexesLock);
+  TieIndexes().erase({&(impl->module), impl->kind});
+  gNumTieIndexes.fetch_sub(1u);
+}
+
+TieIndex *TieIndex::Get(const llvm::Module *module, const std::string &kind) {
+  if (!gNumTieIndexes.load(std::memory_order_acquire)) {
+    return nullptr;
+  }
+  std::lock_guard<std::mutex> locker(gOriginIndexesLock);
+  const auto &indexes = TieIndexes();
+  auto it = indexes.find({module, kind});
+  return it != indexes.end() ? it->second : nullptr;
+}
+
+// Returns the function that `func` is tied to, or `nullptr`.
+llvm::Function *TieIndex::GetTied(llvm::Function *func) const {
+  auto it = impl->tied.find(func);
+  return it != impl->tied.end() ? it->second : nullptr;
+}
+
+// Returns the functions that are tied to `func`.
+const std::vector<llvm::Function *> &
+TieIndex::GetTiedFrom(llvm::Function *func) const {
+  static const std::vector<llvm::Function *> kNoFuncs;
+  auto it = impl->tied_from.find(func);
+  return it != impl->tied_from.end() ? it->second : kNoFuncs;
+}
+
+const std::unordered_map<llvm::Function *, llvm::Function *> &
+TieIndex::Ties(void) const {
+  return impl->tied;
+}
+
+// Re-read the tie of `func`.
+void TieIndex::Update(llvm::Function *func) {
+  impl->EraseTie(func);
+  if (func->getParent() != &(impl->module)) {
+    return;
+  }
+  if (auto tied_to = remill::GetTied(func, impl->kind)) {
+    impl->Insert(func, tied_to);
+  }
+}
+
+// Re-read the ties of every function in the module.
+void TieIndex::Rebuild(void) {
+  impl->tied.clear();
+  impl->tied_from.clear();
+  impl->handles.clear();
+  for (auto &func : impl->module) {
+    Update(&func);
+  }
+}
+
+// Update the `TieIndex` of ties of `kind` in the module of `func`, if any.
+void UpdateTieIndex(llvm::Function *func, const std::string &kind) {
+  if (auto index = TieIndex::Get(func->getParent(), kind)) {
+    index->Update(func);
+  }
+}
+
 llvm::MDNode *TieFunction(llvm::Function *first, llvm::Function *second,
                           const std::string &kind) {
   auto &C = first->getContext();
   auto node = llvm::MDNode::get(C, llvm::ConstantAsMetadata::get(second));
   first->setMetadata(kind, node);
+  UpdateTieIndex(first, kind);
   return node;
 }
 
@@ -81,7 +443,8 @@ llvm::Function *GetTied(llvm::Function *func, const std::string &kind) {
     return nullptr;
   }
 
-  auto casted = llvm::dyn_cast<llvm::ConstantAsMetadata>(node->getOperand(0));
+  auto casted =
+      llvm::dyn_cast_or_null<llvm::ConstantAsMetadata>(node->getOperand(0));
 
   if (!casted) {
     DLOG(INFO) << func->getName().str() << " with kind " << kind
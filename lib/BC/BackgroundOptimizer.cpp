@@ -0,0 +1,175 @@
+/*
+ * Copyright (c) 2020 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "remill/BC/BackgroundOptimizer.h"
+
+#include <glog/logging.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
+#include <llvm/IRReader/IRReader.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/SourceMgr.h>
+
+#include <algorithm>
+
+#include "remill/BC/Util.h"
+
+namespace remill {
+
+BackgroundTraceOptimizer::BackgroundTraceOptimizer(
+    const OptimizationGuide &guide_, unsigned num_threads,
+    OptimizedTraceCallback on_optimized_)
+    : guide(guide_),
+      on_optimized(std::move(on_optimized_)) {
+
+  // Dead store elimination needs the `State` structure of the semantics
+  // module, and the statistics aren't safe to update from another thread.
+  guide.eliminate_dead_stores = false;
+  guide.stats = nullptr;
+
+  if (!num_threads) {
+    num_threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+
+  workers.reserve(num_threads);
+  for (auto i = 0u; i < num_threads; ++i) {
+    auto worker = std::make_unique<Worker>();
+    worker->context = std::make_unique<llvm::LLVMContext>();
+    worker->thread = std::thread([this, ptr = worker.get()](void) {
+      Run(*ptr);
+    });
+    workers.push_back(std::move(worker));
+  }
+}
+
+BackgroundTraceOptimizer::~BackgroundTraceOptimizer(void) {
+  {
+    std::lock_guard<std::mutex> locker(lock);
+    stop = true;
+  }
+  jobs_cv.notify_all();
+
+  for (auto &worker : workers) {
+    worker->thread.join();
+  }
+}
+
+// Queue a copy of the trace `func`.
+void BackgroundTraceOptimizer::Submit(uint64_t addr, llvm::Function *func) {
+  const auto source_module = func->getParent();
+  std::unique_ptr<llvm::Module> trace_module(
+      new llvm::Module(func->getName(), func->getContext()));
+  trace_module->setDataLayout(source_module->getDataLayout());
+  trace_module->setTargetTriple(source_module->getTargetTriple());
+
+  // The trace is linked with the traces that call it, and that it calls, by
+  // name once the optimized traces are merged.
+  const auto copy = llvm::Function::Create(
+      func->getFunctionType(), llvm::GlobalValue::ExternalLinkage,
+      func->getName(), trace_module.get());
+  copy->copyAttributesFrom(func);
+  CloneFunctionInto(func, copy);
+
+  Submit(addr, std::move(trace_module));
+}
+
+// Queue `trace_module`. The module is in a context that is still used by the
+// lifter, and so its bitcode is written here, and only read back on a worker
+// thread.
+void BackgroundTraceOptimizer::Submit(
+    uint64_t addr, std::unique_ptr<llvm::Module> trace_module) {
+  Job job;
+  job.addr = addr;
+  job.name = trace_module->getModuleIdentifier();
+
+  BitcodeStoreOptions options;
+  options.verify = false;
+  StoreModuleToBuffer(trace_module.get(), job.bitcode, options);
+  trace_module.reset();
+
+  {
+    std::lock_guard<std::mutex> locker(lock);
+    jobs.push_back(std::move(job));
+  }
+  jobs_cv.notify_one();
+}
+
+// Wait for every queued trace to be optimized.
+void BackgroundTraceOptimizer::Wait(void) {
+  std::unique_lock<std::mutex> locker(lock);
+  idle_cv.wait(locker, [this] { return jobs.empty() && !num_busy; });
+}
+
+// Move the optimized traces into `dest_module`.
+void BackgroundTraceOptimizer::MergeInto(llvm::Module *dest_module) {
+  Wait();
+
+  std::vector<llvm::Module *> modules;
+  for (auto &worker : workers) {
+    for (auto &[addr, module] : worker->traces) {
+      modules.push_back(module.get());
+    }
+  }
+
+  MergeModulesInto(modules, dest_module);
+
+  for (auto &worker : workers) {
+    worker->traces.clear();
+  }
+}
+
+// Read each queued trace into the context of `worker`, and optimize it, until
+// the optimizer is destroyed.
+void BackgroundTraceOptimizer::Run(Worker &worker) {
+  for (;;) {
+    Job job;
+    {
+      std::unique_lock<std::mutex> locker(lock);
+      jobs_cv.wait(locker, [this] { return stop || !jobs.empty(); });
+      if (jobs.empty()) {
+        return;
+      }
+      job = std::move(jobs.front());
+      jobs.pop_front();
+      num_busy += 1;
+    }
+
+    llvm::SMDiagnostic err;
+    auto module = llvm::parseIR(
+        llvm::MemoryBufferRef(
+            llvm::StringRef(job.bitcode.data(), job.bitcode.size()),
+            job.name),
+        err, *(worker.context));
+    CHECK(module) << "Unable to parse bitcode of trace " << job.name << ": "
+                  << err.getMessage().str();
+    job.bitcode.clear();
+
+    OptimizeBareModule(module.get(), guide);
+    if (on_optimized) {
+      on_optimized(job.addr, module.get());
+    }
+    worker.traces.emplace_back(job.addr, std::move(module));
+
+    {
+      std::lock_guard<std::mutex> locker(lock);
+      num_busy -= 1;
+    }
+    idle_cv.notify_all();
+  }
+}
+
+}  // namespace remill
@@ -0,0 +1,223 @@
+/*
+ * Copyright (c) 2020 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "remill/BC/CodeGen.h"
+
+#include <glog/logging.h>
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/Bitcode/BitcodeReader.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/LegacyPassManager.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/TargetSelect.h>
+#include <llvm/Support/raw_ostream.h>
+#include <llvm/Target/TargetMachine.h>
+#include <llvm/Target/TargetOptions.h>
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "remill/BC/Util.h"
+#include "remill/BC/Version.h"
+
+#if LLVM_VERSION_NUMBER >= LLVM_VERSION(14, 0)
+#  include <llvm/MC/TargetRegistry.h>
+#else
+#  include <llvm/Support/TargetRegistry.h>
+#endif
+
+namespace remill {
+namespace {
+
+// Register every target that LLVM was built with, once.
+static void InitializeTargets(void) {
+  static std::once_flag gInitOnce;
+  std::call_once(gInitOnce, [](void) {
+    llvm::InitializeAllTargetInfos();
+    llvm::InitializeAllTargets();
+    llvm::InitializeAllTargetMCs();
+    llvm::InitializeAllAsmPrinters();
+  });
+}
+
+static llvm::CodeGenOpt::Level OptLevel(unsigned opt_level) {
+  switch (opt_level) {
+    case 0: return llvm::CodeGenOpt::None;
+    case 1: return llvm::CodeGenOpt::Less;
+    case 2: return llvm::CodeGenOpt::Default;
+    default: return llvm::CodeGenOpt::Aggressive;
+  }
+}
+
+// Compile the module serialized in `bitcode` into a native object file at
+// `file_name`, within a context of its own. Returns an error message, or an
+// empty string on success.
+static std::string CompileBitcode(llvm::StringRef bitcode,
+                                  const std::string &file_name,
+                                  const CodeGenOptions &options) {
+  llvm::LLVMContext context;
+  auto maybe_module = llvm::parseBitcodeFile(
+      llvm::MemoryBufferRef(bitcode, file_name), context);
+  if (!maybe_module) {
+    return llvm::toString(maybe_module.takeError());
+  }
+  const auto module = std::move(maybe_module.get());
+
+  std::string error;
+  const auto &triple = module->getTargetTriple();
+  const auto target = llvm::TargetRegistry::lookupTarget(triple, error);
+  if (!target) {
+    return error;
+  }
+
+  // Target machines aren't thread-safe, so each compilation makes its own.
+  std::unique_ptr<llvm::TargetMachine> machine(target->createTargetMachine(
+      triple, options.cpu, options.features, llvm::TargetOptions(),
+      options.position_independent ? llvm::Reloc::PIC_ : llvm::Reloc::Static,
+      llvm::None, OptLevel(options.opt_level)));
+  if (!machine) {
+    return "Unable to create a target machine for " + triple;
+  }
+  if (module->getDataLayout().isDefault()) {
+    module->setDataLayout(machine->createDataLayout());
+  }
+
+  llvm::SmallVector<char, 0> object;
+  llvm::raw_svector_ostream object_os(object);
+  llvm::legacy::PassManager pass_manager;
+#if LLVM_VERSION_NUMBER >= LLVM_VERSION(10, 0)
+  const auto file_type = llvm::CGFT_ObjectFile;
+#else
+  const auto file_type = llvm::TargetMachine::CGFT_ObjectFile;
+#endif
+  if (machine->addPassesToEmitFile(pass_manager, object_os, nullptr,
+                                   file_type)) {
+    return "Target " + triple + " can't emit object files";
+  }
+  pass_manager.run(*module);
+
+  std::error_code ec;
+#if LLVM_VERSION_NUMBER < LLVM_VERSION(7, 0)
+  llvm::raw_fd_ostream file(file_name, ec, llvm::sys::fs::F_None);
+#else
+  llvm::raw_fd_ostream file(file_name, ec, llvm::sys::fs::OF_None);
+#endif
+  if (ec) {
+    return ec.message();
+  }
+  file.write(object.data(), object.size());
+  file.close();
+  if (file.has_error()) {
+    file.clear_error();
+    return "Unable to write the object file";
+  }
+  return {};
+}
+
+// Compile each module serialized in `bitcodes` into the file at the same
+// index of `file_names`, on up to `options.num_threads` threads.
+static bool CompileBitcodes(
+    const std::vector<llvm::SmallVector<char, 0>> &bitcodes,
+    const std::vector<std::string> &file_names, const CodeGenOptions &options,
+    bool allow_failure) {
+  InitializeTargets();
+
+  std::vector<std::string> errors(bitcodes.size());
+  std::atomic<size_t> next_part(0);
+  auto compile = [&](void) {
+    for (auto i = next_part++; i < bitcodes.size(); i = next_part++) {
+      const auto &bitcode = bitcodes[i];
+      errors[i] = CompileBitcode(
+          llvm::StringRef(bitcode.data(), bitcode.size()), file_names[i],
+          options);
+    }
+  };
+
+  auto num_threads = options.num_threads;
+  if (!num_threads) {
+    num_threads = std::thread::hardware_concurrency();
+  }
+  num_threads = std::max<size_t>(1u, std::min<size_t>(num_threads,
+                                                      bitcodes.size()));
+  std::vector<std::thread> threads;
+  for (auto t = 1u; t < num_threads; ++t) {
+    threads.emplace_back(compile);
+  }
+  compile();
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  auto ret = true;
+  for (size_t i = 0; i < errors.size(); ++i) {
+    if (!errors[i].empty()) {
+      const auto message =
+          "Unable to emit object file " + file_names[i] + ": " + errors[i];
+      LOG_IF(FATAL, !allow_failure) << message;
+      LOG(ERROR) << message;
+      ret = false;
+    }
+  }
+  return ret;
+}
+
+}  // namespace
+
+// Compile `module` into a native object file at `file_name`.
+bool EmitObjectFile(llvm::Module *module, std::string_view file_name,
+                    const CodeGenOptions &options, bool allow_failure) {
+  std::vector<llvm::SmallVector<char, 0>> bitcodes(1);
+  if (!StoreModuleToBuffer(module, bitcodes[0], {}, allow_failure)) {
+    return false;
+  }
+  return CompileBitcodes(bitcodes, {std::string(file_name)}, options,
+                         allow_failure);
+}
+
+// Compile `module` into one native object file per element of `parts`.
+bool EmitObjectFiles(llvm::Module *module,
+                     const std::vector<std::vector<llvm::Function *>> &parts,
+                     const std::vector<std::string> &file_names,
+                     const CodeGenOptions &options, bool allow_failure) {
+  CHECK_EQ(parts.size(), file_names.size());
+  if (parts.size() == 1) {
+    return EmitObjectFile(module, file_names[0], options, allow_failure);
+  } else if (parts.empty()) {
+    return true;
+  }
+
+  // The parts share the context of `module`, and so they are serialized on
+  // this thread; everything after that happens in the contexts of the
+  // compiling threads.
+  std::vector<llvm::SmallVector<char, 0>> bitcodes(parts.size());
+  {
+    auto split_modules = SplitModule(module, parts);
+    for (size_t i = 0; i < split_modules.size(); ++i) {
+      if (!StoreModuleToBuffer(split_modules[i].get(), bitcodes[i], {},
+                               allow_failure)) {
+        return false;
+      }
+    }
+  }
+
+  return CompileBitcodes(bitcodes, file_names, options, allow_failure);
+}
+
+}  // namespace remill
@@ -0,0 +1,164 @@
+/*
+ * Copyright (c) 2020 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "remill/BC/ConcurrentTraceManager.h"
+
+#include <llvm/IR/Function.h>
+#include <llvm/IR/Module.h>
+
+#include <algorithm>
+
+#include "remill/BC/Util.h"
+
+namespace remill {
+
+// Add the executable bytes `bytes` of the segment starting at `base`.
+void ConcurrentTraceTable::AddExecutableSegment(uint64_t base,
+                                                std::string bytes) {
+  auto it = std::upper_bound(
+      segments.begin(), segments.end(), base,
+      [](uint64_t addr, const Segment &seg) { return addr < seg.base; });
+  segments.insert(it, Segment{base, std::move(bytes)});
+}
+
+ConcurrentTraceTable::Shard &ConcurrentTraceTable::ShardFor(uint64_t addr) {
+  return shards[(addr ^ (addr >> 12)) % kNumShards];
+}
+
+const ConcurrentTraceTable::Shard &
+ConcurrentTraceTable::ShardFor(uint64_t addr) const {
+  return shards[(addr ^ (addr >> 12)) % kNumShards];
+}
+
+// Declare that a trace starts at `addr`.
+void ConcurrentTraceTable::DeclareTrace(uint64_t addr) {
+  auto &shard = ShardFor(addr);
+  std::lock_guard<std::mutex> locker(shard.lock);
+  shard.declared.insert(addr);
+}
+
+// Returns `true` if `DeclareTrace` was called with `addr`.
+bool ConcurrentTraceTable::IsTraceDeclared(uint64_t addr) const {
+  auto &shard = ShardFor(addr);
+  std::lock_guard<std::mutex> locker(shard.lock);
+  return shard.declared.count(addr) != 0;
+}
+
+// Claim the trace at `addr` for `owner`.
+bool ConcurrentTraceTable::TryClaimTrace(uint64_t addr, unsigned owner) {
+  auto &shard = ShardFor(addr);
+  std::lock_guard<std::mutex> locker(shard.lock);
+  return shard.owners.emplace(addr, owner).first->second == owner;
+}
+
+// Returns the owner of the trace at `addr`, if it has been claimed.
+std::optional<unsigned> ConcurrentTraceTable::TraceOwner(uint64_t addr) const {
+  auto &shard = ShardFor(addr);
+  std::lock_guard<std::mutex> locker(shard.lock);
+  if (auto it = shard.owners.find(addr); it != shard.owners.end()) {
+    return it->second;
+  }
+  return std::nullopt;
+}
+
+// Returns a view of up to `size` executable bytes starting at `addr`.
+std::string_view ConcurrentTraceTable::ExecutableBytes(uint64_t addr,
+                                                       size_t size) const {
+  auto it = std::upper_bound(
+      segments.begin(), segments.end(), addr,
+      [](uint64_t addr, const Segment &seg) { return addr < seg.base; });
+  if (it == segments.begin()) {
+    return {};
+  }
+
+  const auto &seg = *--it;
+  const auto offset = addr - seg.base;
+  if (offset >= seg.bytes.size()) {
+    return {};
+  }
+
+  return std::string_view(seg.bytes).substr(offset, size);
+}
+
+ConcurrentTraceManager::ConcurrentTraceManager(ConcurrentTraceTable &table_,
+                                               unsigned owner_,
+                                               llvm::Module *module_)
+    : table(table_),
+      owner(owner_),
+      module(module_) {}
+
+ConcurrentTraceManager::~ConcurrentTraceManager(void) {}
+
+void ConcurrentTraceManager::SetLiftedTraceDefinition(
+    uint64_t addr, llvm::Function *lifted_func) {
+  traces[addr] = lifted_func;
+}
+
+llvm::Function *ConcurrentTraceManager::GetLiftedTraceDeclaration(
+    uint64_t addr) {
+  if (auto it = traces.find(addr); it != traces.end()) {
+    return it->second;
+  }
+
+  // Call into the traces of other owners rather than duplicating their code.
+  if (table.IsTraceDeclared(addr)) {
+    return DeclareExternalTrace(addr);
+  } else if (auto trace_owner = table.TraceOwner(addr);
+             trace_owner && *trace_owner != owner) {
+    return DeclareExternalTrace(addr);
+  } else {
+    return nullptr;
+  }
+}
+
+llvm::Function *ConcurrentTraceManager::GetLiftedTraceDefinition(
+    uint64_t addr) {
+  if (auto it = traces.find(addr); it != traces.end()) {
+    return it->second;
+  } else if (table.TryClaimTrace(addr, owner)) {
+    return nullptr;
+  } else {
+    return DeclareExternalTrace(addr);
+  }
+}
+
+bool ConcurrentTraceManager::TryReadExecutableByte(uint64_t addr,
+                                                   uint8_t *byte) {
+  const auto bytes = table.ExecutableBytes(addr, 1);
+  if (bytes.empty()) {
+    return false;
+  }
+  *byte = static_cast<uint8_t>(bytes[0]);
+  return true;
+}
+
+std::string_view
+ConcurrentTraceManager::TryReadExecutableBytes(uint64_t addr, size_t size,
+                                               std::string &) {
+  return table.ExecutableBytes(addr, size);
+}
+
+// Declare the trace at `addr` in `module`. Its definition is in the module
+// of whichever owner lifts it.
+llvm::Function *ConcurrentTraceManager::DeclareExternalTrace(uint64_t addr) {
+  const auto func = DeclareLiftedFunction(module, TraceName(addr));
+  if (func->isDeclaration()) {
+    func->setLinkage(llvm::GlobalValue::ExternalLinkage);
+  }
+  return func;
+}
+
+}  // namespace remill
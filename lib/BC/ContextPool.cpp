@@ -0,0 +1,225 @@
+/*
+ * Copyright (c) 2020 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "remill/BC/ContextPool.h"
+
+#include <glog/logging.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
+
+#if defined(__GLIBC__)
+#  include <malloc.h>
+#endif
+#if defined(__linux__)
+#  include <unistd.h>
+#endif
+
+#include <fstream>
+#include <utility>
+
+#include "remill/Arch/Arch.h"
+#include "remill/BC/Util.h"
+
+namespace remill {
+
+// A pooled context. The members are destroyed in reverse order, so that the
+// semantics module and the architecture go before their context.
+struct ContextPool::Entry {
+  std::unique_ptr<llvm::LLVMContext> context;
+  Arch::SharedArchPtr arch;
+  std::unique_ptr<llvm::Module> semantics;
+  size_t num_leases{0};
+  bool retired{false};
+};
+
+namespace {
+
+// Returns the resident set size of this process, in bytes, or zero if it
+// can't be measured.
+static uint64_t ResidentBytes(void) {
+#if defined(__linux__)
+  std::ifstream statm("/proc/self/statm");
+  uint64_t size_pages = 0;
+  uint64_t resident_pages = 0;
+  if (statm >> size_pages >> resident_pages) {
+    return resident_pages * static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+  }
+#endif
+  return 0;
+}
+
+// Give the memory of dropped contexts back to the operating system, so that
+// the resident set size goes down, rather than only holding steady.
+static void TrimHeap(void) {
+#if defined(__GLIBC__)
+  malloc_trim(0);
+#endif
+}
+
+}  // namespace
+
+ContextPool::Lease::Lease(ContextPool *pool_, std::unique_ptr<Entry> entry_)
+    : pool(pool_),
+      entry(std::move(entry_)) {}
+
+ContextPool::Lease::Lease(Lease &&that) noexcept
+    : pool(that.pool),
+      entry(std::move(that.entry)) {}
+
+ContextPool::Lease &ContextPool::Lease::operator=(Lease &&that) noexcept {
+  if (this != &that) {
+    if (entry) {
+      pool->Release(std::move(entry));
+    }
+    pool = that.pool;
+    entry = std::move(that.entry);
+  }
+  return *this;
+}
+
+// Returns the context to its pool.
+ContextPool::Lease::~Lease(void) {
+  if (entry) {
+    pool->Release(std::move(entry));
+  }
+}
+
+llvm::LLVMContext *ContextPool::Lease::Context(void) const {
+  return entry->context.get();
+}
+
+const Arch *ContextPool::Lease::GetArch(void) const {
+  return entry->arch.get();
+}
+
+llvm::Module *ContextPool::Lease::Semantics(void) const {
+  return entry->semantics.get();
+}
+
+// Drop the context rather than recycle it once it is returned.
+void ContextPool::Lease::Retire(void) {
+  entry->retired = true;
+}
+
+ContextPool::ContextPool(OSName os_name_, ArchName arch_name_,
+                         const ContextPoolLimits &limits_)
+    : os_name(os_name_),
+      arch_name(arch_name_),
+      limits(limits_) {}
+
+ContextPool::~ContextPool(void) {
+  CHECK_EQ(num_leased, 0u)
+      << "Context pool destroyed while some of its contexts are leased";
+}
+
+// Lease an idle context, or a new one if there are none.
+ContextPool::Lease ContextPool::Acquire(void) {
+  std::unique_ptr<Entry> entry;
+  {
+    std::lock_guard<std::mutex> locker(lock);
+    ++num_leased;
+    if (!idle.empty()) {
+      entry = std::move(idle.back());
+      idle.pop_back();
+    }
+  }
+
+  // Loading the semantics is slow, so it's done without holding the lock.
+  if (!entry) {
+    entry.reset(new Entry);
+    entry->context.reset(new llvm::LLVMContext);
+    entry->arch = Arch::GetCached(entry->context.get(), os_name, arch_name);
+    CHECK(entry->arch != nullptr)
+        << "Unable to build architecture " << GetArchName(arch_name)
+        << " for a pooled context";
+    entry->semantics = LoadArchSemantics(entry->arch.get());
+    CHECK(entry->semantics != nullptr)
+        << "Unable to load the semantics of " << GetArchName(arch_name)
+        << " into a pooled context";
+
+    std::lock_guard<std::mutex> locker(lock);
+    ++num_created;
+  }
+
+  entry->num_leases += 1;
+  return Lease(this, std::move(entry));
+}
+
+// Return `entry` to the pool, or drop it.
+void ContextPool::Release(std::unique_ptr<Entry> entry) {
+  auto drop = entry->retired ||
+              (limits.max_leases && entry->num_leases >= limits.max_leases);
+
+  // The contexts that are idle hold on to as much as this one, so they are
+  // dropped too.
+  auto drop_idle = false;
+  if (!drop && limits.max_resident_bytes &&
+      ResidentBytes() > limits.max_resident_bytes) {
+    drop = true;
+    drop_idle = true;
+  }
+
+  std::vector<std::unique_ptr<Entry>> dropped;
+  {
+    std::lock_guard<std::mutex> locker(lock);
+    --num_leased;
+    if (drop_idle) {
+      dropped.swap(idle);
+    }
+    if (!drop && limits.max_idle && idle.size() >= limits.max_idle) {
+      drop = true;
+    }
+    if (drop) {
+      dropped.push_back(std::move(entry));
+    } else {
+      idle.push_back(std::move(entry));
+    }
+    num_dropped += dropped.size();
+  }
+
+  // Contexts are destroyed without holding the lock, as that can take a
+  // while.
+  if (!dropped.empty()) {
+    dropped.clear();
+    TrimHeap();
+  }
+}
+
+// Drop every idle context.
+void ContextPool::Clear(void) {
+  std::vector<std::unique_ptr<Entry>> dropped;
+  {
+    std::lock_guard<std::mutex> locker(lock);
+    dropped.swap(idle);
+    num_dropped += dropped.size();
+  }
+  if (!dropped.empty()) {
+    dropped.clear();
+    TrimHeap();
+  }
+}
+
+size_t ContextPool::NumCreated(void) const {
+  std::lock_guard<std::mutex> locker(lock);
+  return num_created;
+}
+
+size_t ContextPool::NumDropped(void) const {
+  std::lock_guard<std::mutex> locker(lock);
+  return num_dropped;
+}
+
+}  // namespace remill
@@ -18,8 +18,12 @@
 
 #include <gflags/gflags.h>
 #include <glog/logging.h>
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/ADT/Hashing.h>
+#include <llvm/ADT/PostOrderIterator.h>
 #include <llvm/IR/BasicBlock.h>
 #include <llvm/IR/CFG.h>
+#include <llvm/IR/Constants.h>
 #include <llvm/IR/DerivedTypes.h>
 #include <llvm/IR/InlineAsm.h>
 #include <llvm/IR/InstVisitor.h>
@@ -27,9 +31,19 @@
 #include <llvm/IR/Module.h>
 #include <llvm/Transforms/Utils/Local.h>
 
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
 #include <cstdio>
+#include <deque>
 #include <fstream>
+#include <functional>
 #include <iostream>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <sstream>
+#include <thread>
 #include <unordered_map>
 #include <unordered_set>
 #include <utility>
@@ -39,6 +53,7 @@
 #include "remill/BC/ABI.h"
 #include "remill/BC/Compat/CallSite.h"
 #include "remill/BC/Compat/VectorType.h"
+#include "remill/BC/Statistics.h"
 #include "remill/BC/Util.h"
 #include "remill/OS/FileSystem.h"
 
@@ -62,20 +77,306 @@ DEFINE_bool(log_dse_stats, false,
 DEFINE_bool(name_register_variables, false,
             "Try to apply a register's name to its GEP variable.");
 
+DEFINE_bool(export_state_summaries, false,
+            "Attach summaries of the State slots that each lifted function "
+            "may read or write as metadata, when dead store elimination "
+            "fully analyzes the function.");
+
+DEFINE_bool(use_state_summaries, false,
+            "Use the State slot summaries attached to lifted functions as "
+            "the live sets of calls to them, instead of treating every slot "
+            "as live.");
+
+DEFINE_uint32(dse_num_threads, 1,
+              "Number of threads on which to solve the live sets of lifted "
+              "functions during dead store elimination.");
+
 namespace remill {
 namespace {
 
-static constexpr size_t kMaxNumSlots = 256;
+// The slot index of padding bytes in the `State` structure.
+static constexpr uint64_t kPaddingSlot = ~0u;
 
-using ValueToOffset = std::unordered_map<llvm::Value *, uint64_t>;
 using InstToOffset = std::unordered_map<llvm::Instruction *, uint64_t>;
-using LiveSet = std::bitset<kMaxNumSlots>;
 
-// TODO(pag): Map to `LiveSet` pointers. The common cases are:
-//            - all set
-//            - none set
-//            - one set
-using InstToLiveSet = std::unordered_map<llvm::Instruction *, LiveSet>;
+// The offsets into the `State` structure of the values of one function, and
+// the values known not to point into `State`. The arguments, instructions,
+// and operands of the function are numbered densely once, and the rest is
+// kept in flat vectors indexed by those numbers, so that revisiting an
+// instruction indexes vectors rather than hashing its operands.
+class ValueOffsets {
+ public:
+  static constexpr unsigned kNoNumber = ~0u;
+
+  // Number the values of `func`, forgetting everything about the values of
+  // the last function.
+  void Reset(llvm::Function *func);
+
+  // Returns the number of `val`, or `kNoNumber` if `val` isn't used in the
+  // function.
+  inline unsigned NumberOf(llvm::Value *val) const {
+    const auto it = numbers.find(val);
+    return it == numbers.end() ? kNoNumber : it->second;
+  }
+
+  inline unsigned NumValues(void) const {
+    return static_cast<unsigned>(infos.size());
+  }
+
+  inline llvm::Value *ValueOf(unsigned n) const {
+    return infos[n].val;
+  }
+
+  // Returns the number of the `i`th operand of the instruction numbered `n`.
+  inline unsigned OperandOf(unsigned n, unsigned i) const {
+    return operands[infos[n].first_operand + i];
+  }
+
+  // Returns the offset of the value numbered `n`, or `nullptr` if it isn't
+  // known to point into `State`.
+  inline const uint64_t *Find(unsigned n) const {
+    return infos[n].has_offset ? &(infos[n].offset) : nullptr;
+  }
+
+  inline const uint64_t *Find(llvm::Value *val) const {
+    const auto n = NumberOf(val);
+    return n == kNoNumber ? nullptr : Find(n);
+  }
+
+  // Set the offset of the value numbered `n`, unless it already has one.
+  inline void Emplace(unsigned n, uint64_t offset) {
+    auto &info = infos[n];
+    if (!info.has_offset) {
+      info.has_offset = true;
+      info.offset = offset;
+    }
+  }
+
+  inline bool IsExcluded(unsigned n) const {
+    return infos[n].excluded;
+  }
+
+  inline bool IsExcluded(llvm::Value *val) const {
+    const auto n = NumberOf(val);
+    return n != kNoNumber && IsExcluded(n);
+  }
+
+  // Mark the value numbered `n` as not pointing into `State`.
+  inline void Exclude(unsigned n) {
+    if (!infos[n].excluded) {
+      infos[n].excluded = true;
+      num_excluded += 1;
+    }
+  }
+
+  inline size_t NumExcluded(void) const {
+    return num_excluded;
+  }
+
+ private:
+  struct Info {
+    llvm::Value *val;
+    uint64_t offset;
+    unsigned first_operand;
+    bool has_offset;
+    bool excluded;
+  };
+
+  llvm::DenseMap<llvm::Value *, unsigned> numbers;
+  std::vector<Info> infos;
+  std::vector<unsigned> operands;
+  size_t num_excluded{0};
+};
+
+void ValueOffsets::Reset(llvm::Function *func) {
+  numbers.clear();
+  infos.clear();
+  operands.clear();
+  num_excluded = 0;
+
+  auto add = [this](llvm::Value *val) {
+    const auto n = static_cast<unsigned>(infos.size());
+    const auto [it, added] = numbers.try_emplace(val, n);
+    if (added) {
+      infos.push_back(Info{val, 0, 0, false, false});
+    }
+    return it->second;
+  };
+
+  // Number all instructions before any operands, so that the instructions
+  // are numbered in order even if they're used before they're defined, e.g.
+  // by PHI nodes. The other operands, e.g. constants, are numbered last.
+  for (auto &arg : func->args()) {
+    add(&arg);
+  }
+  for (auto &block : *func) {
+    for (auto &inst : block) {
+      add(&inst);
+    }
+  }
+
+  auto n = static_cast<unsigned>(func->arg_size());
+  for (auto &block : *func) {
+    for (auto &inst : block) {
+      const auto first_operand = static_cast<unsigned>(operands.size());
+      for (auto &op : inst.operands()) {
+        operands.push_back(add(op.get()));
+      }
+      infos[n++].first_operand = first_operand;
+    }
+  }
+}
+
+// A set of slot indices, as a bit vector. The bits past the end of `words`
+// are zero, and `words` never ends in a zero word, so that equal sets have
+// equal representations regardless of how they were built.
+class LiveSet {
+ public:
+  inline bool Test(uint64_t i) const {
+    const auto word = i / 64u;
+    return word < words.size() && ((words[word] >> (i % 64u)) & 1u);
+  }
+
+  void Set(uint64_t i);
+  void Reset(uint64_t i);
+
+  // Sets the first `num_slots` bits, i.e. all slots of the `State`.
+  void SetAll(size_t num_slots);
+
+  inline void Clear(void) {
+    words.clear();
+  }
+
+  size_t Count(void) const;
+
+  // Calls `cb` with the index of each set bit, in increasing order, skipping
+  // over zero words.
+  template <typename CB>
+  void ForEach(CB cb) const {
+    for (size_t w = 0; w < words.size(); ++w) {
+      for (auto word = words[w]; word; word &= word - 1u) {
+        cb(w * 64u + static_cast<uint64_t>(__builtin_ctzll(word)));
+      }
+    }
+  }
+
+  LiveSet &operator|=(const LiveSet &that);
+
+  inline bool operator==(const LiveSet &that) const {
+    return words == that.words;
+  }
+
+  inline bool operator!=(const LiveSet &that) const {
+    return words != that.words;
+  }
+
+  inline size_t Hash(void) const {
+    return llvm::hash_combine_range(words.begin(), words.end());
+  }
+
+ private:
+  void Trim(void);
+
+  std::vector<uint64_t> words;
+};
+
+void LiveSet::Set(uint64_t i) {
+  const auto word = i / 64u;
+  if (word >= words.size()) {
+    words.resize(word + 1u, 0u);
+  }
+  words[word] |= uint64_t(1) << (i % 64u);
+}
+
+void LiveSet::Reset(uint64_t i) {
+  const auto word = i / 64u;
+  if (word < words.size()) {
+    words[word] &= ~(uint64_t(1) << (i % 64u));
+    Trim();
+  }
+}
+
+void LiveSet::SetAll(size_t num_slots) {
+  words.assign(num_slots / 64u, ~uint64_t(0));
+  if (num_slots % 64u) {
+    words.push_back((uint64_t(1) << (num_slots % 64u)) - 1u);
+  }
+}
+
+size_t LiveSet::Count(void) const {
+  size_t count = 0;
+  for (auto word : words) {
+    count += static_cast<size_t>(__builtin_popcountll(word));
+  }
+  return count;
+}
+
+LiveSet &LiveSet::operator|=(const LiveSet &that) {
+  if (that.words.size() > words.size()) {
+    words.resize(that.words.size(), 0u);
+  }
+  for (size_t w = 0; w < that.words.size(); ++w) {
+    words[w] |= that.words[w];
+  }
+  return *this;
+}
+
+void LiveSet::Trim(void) {
+  while (!words.empty() && !words.back()) {
+    words.pop_back();
+  }
+}
+
+struct LiveSetHash {
+  inline size_t operator()(const LiveSet &set) const {
+    return set.Hash();
+  }
+};
+
+// Hash-conses the live sets of calls, so that calls with equal live sets
+// share them. The common cases are that all slots, no slots, or only the
+// few slots of some ABI are live.
+class LiveSetPool {
+ public:
+  explicit LiveSetPool(size_t num_slots_);
+
+  // Returns the shared copy of `set`.
+  const LiveSet *Intern(const LiveSet &set);
+
+  // The number of slots in the `State` structure.
+  const size_t num_slots;
+
+  // The sets of no slots and of all slots.
+  const LiveSet *none;
+  const LiveSet *all;
+
+ private:
+  std::unordered_set<LiveSet, LiveSetHash> sets;
+};
+
+LiveSetPool::LiveSetPool(size_t num_slots_) : num_slots(num_slots_) {
+  LiveSet set;
+  none = Intern(set);
+  set.SetAll(num_slots);
+  all = Intern(set);
+}
+
+const LiveSet *LiveSetPool::Intern(const LiveSet &set) {
+  return &*(sets.insert(set).first);
+}
+
+// The live slots of each call, i.e. the slots that the call might read.
+using InstToLiveSet = std::unordered_map<llvm::Instruction *, const LiveSet *>;
+
+// Returns the number of slots in the `State` structure described by `slots`.
+static size_t NumSlots(const std::vector<StateSlot> &slots) {
+  for (auto it = slots.rbegin(); it != slots.rend(); ++it) {
+    if (it->index != kPaddingSlot) {
+      return it->index + 1u;
+    }
+  }
+  return 0;
+}
 
 // Struct to keep track of how murderous the dead store eliminator is.
 struct KillCounter {
@@ -92,6 +393,28 @@ struct KillCounter {
   uint64_t fwd_failed;
 };
 
+// Dead store elimination statistics of one lifted function.
+struct FunctionKillCounter {
+  KillCounter stats = {};
+  bool analyzed{false};
+  bool cached{false};
+  double analysis_seconds{0};
+};
+
+static void AddKillCounts(KillCounter &to, const KillCounter &from) {
+  to.failed_funcs += from.failed_funcs;
+  to.num_stores += from.num_stores;
+  to.dead_stores += from.dead_stores;
+  to.removed_insts += from.removed_insts;
+  to.fwd_loads += from.fwd_loads;
+  to.fwd_stores += from.fwd_stores;
+  to.fwd_perfect += from.fwd_perfect;
+  to.fwd_truncated += from.fwd_truncated;
+  to.fwd_casted += from.fwd_casted;
+  to.fwd_reordered += from.fwd_reordered;
+  to.fwd_failed += from.fwd_failed;
+}
+
 // Return true if the given function is a lifted function
 // (and not the `__remill_basic_block`).
 static bool IsLiftedFunction(llvm::Function *func,
@@ -162,7 +485,7 @@ void StateVisitor::Visit(llvm::Type *ty) {
                    << LLVMThingToString(ty) << " has padding";
         CHECK_LT(offset, elem_offset);
         for (auto j = offset; j < elem_offset; ++j) {
-          offset_to_slot.emplace_back(~0u, ~0u, ~0u);
+          offset_to_slot.emplace_back(kPaddingSlot, ~0u, ~0u);
         }
         offset = elem_offset;
       }
@@ -229,12 +552,11 @@ void StateVisitor::VisitSequentialType(T *seq_ty) {
   }
 }
 
-// Try to get the offset associated with some value.
-static bool TryGetOffset(llvm::Value *val, const ValueToOffset &state_offset,
+// Try to get the offset associated with the value numbered `n`.
+static bool TryGetOffset(unsigned n, const ValueOffsets &state_offset,
                          uint64_t *offset_out) {
-  auto ptr = state_offset.find(val);
-  if (ptr != state_offset.end()) {
-    *offset_out = ptr->second;
+  if (auto ptr = state_offset.Find(n)) {
+    *offset_out = *ptr;
     return true;
 
   } else {
@@ -242,10 +564,10 @@ static bool TryGetOffset(llvm::Value *val, const ValueToOffset &state_offset,
   }
 }
 
-// Try to get the offset associated with some value, or if the value is
-// a constant integer, get that instead.
-static bool TryGetOffsetOrConst(llvm::Value *val,
-                                const ValueToOffset &state_offset,
+// Try to get the offset associated with some value, numbered `n`, or if the
+// value is a constant integer, get that instead.
+static bool TryGetOffsetOrConst(llvm::Value *val, unsigned n,
+                                const ValueOffsets &state_offset,
                                 uint64_t *offset_out) {
   if (auto const_val = llvm::dyn_cast<llvm::ConstantInt>(val)) {
     const auto &val_apint = const_val->getValue();
@@ -259,7 +581,7 @@ static bool TryGetOffsetOrConst(llvm::Value *val,
       return false;
     }
   } else {
-    return TryGetOffset(val, state_offset, offset_out);
+    return TryGetOffset(n, state_offset, offset_out);
   }
 }
 
@@ -297,22 +619,25 @@ static bool TryCombineOffsets(uint64_t lhs_offset, OpType op_type,
   return (*out_offset) < max_offset;
 }
 
-static LiveSet GetLiveSetFromArgs(llvm::iterator_range<llvm::Use *> args,
-                                  const ValueToOffset &val_to_offset,
-                                  const std::vector<StateSlot> &state_slots) {
+static const LiveSet *
+GetLiveSetFromArgs(llvm::iterator_range<llvm::Use *> args,
+                   const ValueOffsets &val_to_offset,
+                   const std::vector<StateSlot> &state_slots,
+                   LiveSetPool &live_sets) {
   LiveSet live;
-  live.reset();
   for (auto &arg_it : args) {
     auto arg = arg_it->stripPointerCasts();
-    const auto offset_it = val_to_offset.find(arg);
-    if (offset_it == val_to_offset.end()) {
+    const auto offset_ptr = val_to_offset.Find(arg);
+    if (!offset_ptr) {
       continue;
     }
-    const auto offset = offset_it->second;
+    const auto offset = *offset_ptr;
 
     // If we access a single non-zero offset, mark just that offset.
     if (offset != 0) {
-      live.set(state_slots[offset].index);
+      if (state_slots[offset].index != kPaddingSlot) {
+        live.Set(state_slots[offset].index);
+      }
 
     // If we access offset `0`, then maybe we're actually passing
     // a state pointer, in which anything can be changed, so we want
@@ -323,11 +648,10 @@ static LiveSet GetLiveSetFromArgs(llvm::iterator_range<llvm::Use *> args,
     // Typically this case is hit when we have a call to another lifted
     // function.
     } else {
-      live.set();
-      break;
+      return live_sets.all;
     }
   }
-  return live;
+  return live_sets.Intern(live);
 }
 
 // Visits instructions and propagates information about where in the
@@ -341,11 +665,15 @@ struct ForwardAliasVisitor
                       const std::vector<StateSlot> &offset_to_slot_,
                       InstToLiveSet &live_args_,
                       InstToOffset &state_access_offset_,
-                      llvm::LLVMContext &context);
+                      LiveSetPool &live_sets_, llvm::LLVMContext &context);
 
   bool Analyze(const remill::Arch *arch, KillCounter &stats,
                llvm::Function *func);
 
+  // Whether the last successful `Analyze` found the offsets of all pointers
+  // into `State`.
+  bool complete{false};
+
  protected:
   friend class llvm::InstVisitor<ForwardAliasVisitor, VisitResult>;
 
@@ -368,22 +696,40 @@ struct ForwardAliasVisitor
                         const char *extension);
 
  private:
-  void AddInstruction(llvm::Instruction *inst);
+  void AddInstruction(llvm::Instruction *inst, unsigned n);
   virtual VisitResult visitBinaryOp_(llvm::BinaryOperator &inst, OpType op);
 
+  // Visit the instruction numbered `n`.
+  VisitResult VisitNumbered(unsigned n);
+
+  // Returns the number of the `i`th operand of the instruction being visited.
+  inline unsigned Operand(unsigned i) const {
+    return state_offset.OperandOf(curr, i);
+  }
+
  public:
   const llvm::DataLayout dl;
   const std::vector<StateSlot> &offset_to_slot;
-  ValueToOffset state_offset;
+  ValueOffsets state_offset;
   InstToOffset &state_access_offset;
   InstToLiveSet &live_args;
-  std::unordered_set<llvm::Value *> exclude;
+  LiveSetPool &live_sets;
   std::unordered_set<llvm::Value *> missing;
-  std::vector<llvm::Instruction *> curr_wl;
-  std::vector<llvm::Instruction *> pending_wl;
+  std::vector<unsigned> curr_wl;
+  std::vector<unsigned> pending_wl;
   std::vector<llvm::Instruction *> calls;
   llvm::Value *state_ptr;
   unsigned reg_md_id;
+
+  // The number of the instruction being visited.
+  unsigned curr{0};
+
+ private:
+  // Returns the live set of `call` given by the summary of its callee, or
+  // `nullptr` if there is no usable summary.
+  const LiveSet *GetLiveSetFromSummary(llvm::CallInst &call);
+
+  std::unordered_map<llvm::Function *, const LiveSet *> summary_live_sets;
 };
 
 // Stream a slot of the DOT digraph.
@@ -440,6 +786,66 @@ static void StreamPHIToDOT(std::ostream &dot, llvm::PHINode &phi_node) {
   }
 }
 
+// Writes DOT digraph files on a background thread, so that dead store
+// elimination doesn't wait on the file system. Queued files are finished
+// when the program exits.
+class DOTFileWriter {
+ public:
+  static DOTFileWriter &Get(void) {
+    static DOTFileWriter writer;
+    return writer;
+  }
+
+  void Write(std::string path, std::string contents) {
+    {
+      std::lock_guard<std::mutex> locker(lock);
+      pending.emplace_back(std::move(path), std::move(contents));
+    }
+    cond.notify_one();
+  }
+
+  ~DOTFileWriter(void) {
+    {
+      std::lock_guard<std::mutex> locker(lock);
+      done = true;
+    }
+    cond.notify_one();
+    thread.join();
+  }
+
+ private:
+  DOTFileWriter(void) : thread([this] { Run(); }) {}
+
+  void Run(void) {
+    std::unique_lock<std::mutex> locker(lock);
+    while (true) {
+      cond.wait(locker, [this] { return done || !pending.empty(); });
+      if (pending.empty()) {
+        return;
+      }
+      auto file = std::move(pending.front());
+      pending.pop_front();
+      locker.unlock();
+
+      std::ofstream dot(file.first);
+      dot << file.second;
+      if (!dot) {
+        LOG(ERROR) << "Unable to write DOT digraph file " << file.first;
+      }
+
+      locker.lock();
+    }
+  }
+
+  std::mutex lock;
+  std::condition_variable cond;
+  std::deque<std::pair<std::string, std::string>> pending;
+  bool done{false};
+
+  // Started last, once the rest of the writer is initialized.
+  std::thread thread;
+};
+
 // Generate a DOT digraph file representing the offsets.
 void ForwardAliasVisitor::CreateDOTDigraph(const remill::Arch *arch,
                                            llvm::Function *func,
@@ -454,7 +860,7 @@ void ForwardAliasVisitor::CreateDOTDigraph(const remill::Arch *arch,
   }
   fname << extension;
 
-  std::ofstream dot(fname.str());
+  std::stringstream dot;
   dot << "digraph {" << std::endl
       << "node [shape=none margin=0 nojustify=false labeljust=l]" << std::endl;
 
@@ -469,11 +875,11 @@ void ForwardAliasVisitor::CreateDOTDigraph(const remill::Arch *arch,
 
     // Then print out one row per instruction.
     for (auto &inst : *block) {
+      const auto n = state_offset.NumberOf(&inst);
 
       dot << "<tr>";
-      if (state_offset.count(&inst)) {
-        auto offset = state_offset[&inst];
-        dot << "<td>" << offset << "</td><td> </td>";
+      if (auto offset_ptr = state_offset.Find(&inst)) {
+        dot << "<td>" << *offset_ptr << "</td><td> </td>";
 
       } else if (state_access_offset.count(&inst)) {
         auto offset = state_access_offset[&inst];
@@ -491,14 +897,14 @@ void ForwardAliasVisitor::CreateDOTDigraph(const remill::Arch *arch,
         StreamSlot(arch, context, dot, slot, inst_size);
         dot << "</td>";
 
-      } else if (exclude.count(&inst)) {
+      } else if (state_offset.IsExcluded(&inst)) {
         dot << "<td>----</td><td> </td>";
       } else {
         dot << "<td> </td><td> </td>";
       }
 
       // Highlight nodes in yellow that remain in the pending work list.
-      if (std::count(pending_wl.begin(), pending_wl.end(), &inst)) {
+      if (std::count(pending_wl.begin(), pending_wl.end(), n)) {
         if (missing.count(&inst)) {
           dot << "<td align=\"left\" bgcolor=\"red\">";
         } else {
@@ -542,20 +948,23 @@ void ForwardAliasVisitor::CreateDOTDigraph(const remill::Arch *arch,
     }
   }
   dot << "}" << std::endl;
+  DOTFileWriter::Get().Write(fname.str(), dot.str());
 }
 
 ForwardAliasVisitor::ForwardAliasVisitor(
     const llvm::DataLayout &dl_, const std::vector<StateSlot> &offset_to_slot_,
     InstToLiveSet &live_args_, InstToOffset &state_access_offset_,
-    llvm::LLVMContext &context)
+    LiveSetPool &live_sets_, llvm::LLVMContext &context)
     : dl(dl_),
       offset_to_slot(offset_to_slot_),
       state_access_offset(state_access_offset_),
       live_args(live_args_),
+      live_sets(live_sets_),
       state_ptr(nullptr),
       reg_md_id(context.getMDKindID("remill_register")) {}
 
-void ForwardAliasVisitor::AddInstruction(llvm::Instruction *inst) {
+void ForwardAliasVisitor::AddInstruction(llvm::Instruction *inst,
+                                         unsigned n) {
 
   if (!inst->getMetadata(reg_md_id)) {
     if (FLAGS_dot_output_dir.empty()) {
@@ -569,26 +978,31 @@ void ForwardAliasVisitor::AddInstruction(llvm::Instruction *inst) {
   }
 
   if (llvm::isa<llvm::StoreInst>(inst)) {
-    curr_wl.push_back(inst);
+    curr_wl.push_back(n);
 
   } else if (llvm::isa<llvm::LoadInst>(inst)) {
-    curr_wl.push_back(inst);
+    curr_wl.push_back(n);
 
   // TODO(pag): What about `alloca`d `State` structures? Would need to adjust
   //            how the FAV handles code without the typical prototype.
   } else if (llvm::isa<llvm::AllocaInst>(inst)) {
-    exclude.emplace(inst);
+    state_offset.Exclude(n);
 
   } else if (llvm::isa<llvm::CallInst>(inst) ||
              llvm::isa<llvm::InvokeInst>(inst)) {
-    exclude.emplace(inst);
+    state_offset.Exclude(n);
     calls.push_back(inst);
 
   } else {
-    curr_wl.push_back(inst);
+    curr_wl.push_back(n);
   }
 }
 
+VisitResult ForwardAliasVisitor::VisitNumbered(unsigned n) {
+  curr = n;
+  return visit(llvm::cast<llvm::Instruction>(state_offset.ValueOf(n)));
+}
+
 // Iterate through the current worklist, updating the `state_offset` and
 // `state_access_offset` according to the instructions in the list. Any
 // instruction that is not currently interpretable (some of its pointers
@@ -598,12 +1012,10 @@ void ForwardAliasVisitor::AddInstruction(llvm::Instruction *inst) {
 bool ForwardAliasVisitor::Analyze(const remill::Arch *arch, KillCounter &stats,
                                   llvm::Function *func) {
   curr_wl.clear();
-  exclude.clear();
   calls.clear();
-  state_offset.clear();
   pending_wl.clear();
 
-  std::vector<llvm::Instruction *> order_of_progress;
+  std::vector<unsigned> order_of_progress;
 
   state_ptr = LoadStatePointer(func);
   auto memory_ptr = LoadMemoryPointerArg(func);
@@ -614,17 +1026,19 @@ bool ForwardAliasVisitor::Analyze(const remill::Arch *arch, KillCounter &stats,
     return false;
   }
 
-  state_offset.emplace(state_ptr, 0);
-  exclude.emplace(memory_ptr);
-  exclude.emplace(pc);
+  state_offset.Reset(func);
+  state_offset.Emplace(state_offset.NumberOf(state_ptr), 0);
+  state_offset.Exclude(state_offset.NumberOf(memory_ptr));
+  state_offset.Exclude(state_offset.NumberOf(pc));
 
-  for (auto &block : *func) {
-    for (auto &inst : block) {
-      AddInstruction(&inst);
+  for (auto n = 0u; n < state_offset.NumValues(); ++n) {
+    const auto val = state_offset.ValueOf(n);
+    if (auto inst = llvm::dyn_cast<llvm::Instruction>(val)) {
+      AddInstruction(inst, n);
     }
   }
 
-  std::vector<llvm::Instruction *> next_wl;
+  std::vector<unsigned> next_wl;
   const auto num_insts = curr_wl.size();
   next_wl.reserve(num_insts);
   order_of_progress.reserve(num_insts);
@@ -635,23 +1049,23 @@ bool ForwardAliasVisitor::Analyze(const remill::Arch *arch, KillCounter &stats,
     missing.clear();
     progress = false;
 
-    const auto old_exclude_count = exclude.size();
+    const auto old_exclude_count = state_offset.NumExcluded();
 
     // Visit most instructions; this doesn't visit calls.
-    for (auto inst : curr_wl) {
-      switch (visit(inst)) {
+    for (auto n : curr_wl) {
+      switch (VisitNumbered(n)) {
         case VisitResult::Progress:
-          order_of_progress.push_back(inst);
+          order_of_progress.push_back(n);
           progress = true;
           break;
-        case VisitResult::Incomplete: pending_wl.push_back(inst); break;
-        case VisitResult::NoProgress: next_wl.push_back(inst); break;
+        case VisitResult::Incomplete: pending_wl.push_back(n); break;
+        case VisitResult::NoProgress: next_wl.push_back(n); break;
         case VisitResult::Ignored: break;
         case VisitResult::Error: return false;
       }
     }
 
-    progress = progress || old_exclude_count < exclude.size();
+    progress = progress || old_exclude_count < state_offset.NumExcluded();
     curr_wl.swap(pending_wl);
     curr_wl.insert(curr_wl.end(), next_wl.begin(), next_wl.end());
     next_wl.clear();
@@ -669,11 +1083,11 @@ bool ForwardAliasVisitor::Analyze(const remill::Arch *arch, KillCounter &stats,
   curr_wl.clear();
 
   // Do one final pass through, in the order in which progress was made.
-  for (auto inst : order_of_progress) {
-    switch (visit(inst)) {
+  for (auto n : order_of_progress) {
+    switch (VisitNumbered(n)) {
       case VisitResult::Progress: break;
-      case VisitResult::Incomplete: pending_wl.push_back(inst); break;
-      case VisitResult::NoProgress: next_wl.push_back(inst); break;
+      case VisitResult::Incomplete: pending_wl.push_back(n); break;
+      case VisitResult::NoProgress: next_wl.push_back(n); break;
       case VisitResult::Ignored: break;
       case VisitResult::Error: return false;
     }
@@ -690,7 +1104,8 @@ bool ForwardAliasVisitor::Analyze(const remill::Arch *arch, KillCounter &stats,
   //
   // One place where this happens is when there is a `select` to choose
   // what index into an array to use.
-  if (!pending_wl.empty()) {
+  complete = pending_wl.empty();
+  if (!complete) {
     stats.failed_funcs++;
 
     DLOG(WARNING) << "Alias analysis failed to complete on function `"
@@ -701,9 +1116,11 @@ bool ForwardAliasVisitor::Analyze(const remill::Arch *arch, KillCounter &stats,
   }
 
   auto &context = func->getContext();
-  for (auto [val, offset] : state_offset) {
+  for (auto n = 0u; n < state_offset.NumValues(); ++n) {
+    const auto offset_ptr = state_offset.Find(n);
+    const auto val = state_offset.ValueOf(n);
     const auto inst = llvm::dyn_cast<llvm::Instruction>(val);
-    if (!inst) {
+    if (!offset_ptr || !inst) {
       continue;
     }
 
@@ -711,7 +1128,7 @@ bool ForwardAliasVisitor::Analyze(const remill::Arch *arch, KillCounter &stats,
     if (!val_type->isPointerTy()) {
       continue;
     }
-    auto reg = arch->RegisterAtStateOffset(offset);
+    auto reg = arch->RegisterAtStateOffset(*offset_ptr);
     if (!reg) {
       continue;
     }
@@ -728,10 +1145,10 @@ bool ForwardAliasVisitor::Analyze(const remill::Arch *arch, KillCounter &stats,
     // Create the node for a `remill_register` annotation if it's missing.
     if (!inst->getMetadata(reg_md_id)) {
 #if LLVM_VERSION_NUMBER >= LLVM_VERSION(3, 6)
-      auto reg_name_md = llvm::ValueAsMetadata::get(reg->constant_name);
+      auto reg_name_md = llvm::ValueAsMetadata::get(reg->ConstantName());
       auto reg_name_node = llvm::MDNode::get(context, reg_name_md);
 #else
-      auto reg_name_node = llvm::MDNode::get(*context, reg.constant_name);
+      auto reg_name_node = llvm::MDNode::get(*context, reg.ConstantName());
 #endif
       inst->setMetadata(reg_md_id, reg_name_node);
     }
@@ -769,33 +1186,33 @@ bool ForwardAliasVisitor::Analyze(const remill::Arch *arch, KillCounter &stats,
 }
 
 VisitResult ForwardAliasVisitor::visitInstruction(llvm::Instruction &I) {
-  exclude.insert(&I);
+  state_offset.Exclude(curr);
   return VisitResult::Progress;
 }
 
 VisitResult ForwardAliasVisitor::visitAllocaInst(llvm::AllocaInst &I) {
-  exclude.insert(&I);
+  state_offset.Exclude(curr);
   return VisitResult::Progress;
 }
 
 // Visit a load instruction and update the alias map.
 VisitResult ForwardAliasVisitor::visitLoadInst(llvm::LoadInst &inst) {
-  auto val = inst.getPointerOperand();
+  const auto val = Operand(llvm::LoadInst::getPointerOperandIndex());
 
   // Special case: loaded value is itself a `State` pointer. Not sure if
   // this ever comes up, but if it does then we want to treat all `State`
   // structures as aliasing.
   if (inst.getType() == state_ptr->getType()) {
-    state_offset.emplace(&inst, 0);
+    state_offset.Emplace(curr, 0);
     return VisitResult::Progress;
 
-  } else if (exclude.count(val)) {
-    exclude.emplace(&inst);
+  } else if (state_offset.IsExcluded(val)) {
+    state_offset.Exclude(curr);
     return VisitResult::Progress;
 
   } else {
-    auto ptr = state_offset.find(val);
-    if (ptr == state_offset.end()) {
+    auto ptr = state_offset.Find(val);
+    if (!ptr) {
       return VisitResult::NoProgress;
 
     // The `State` structure doesn't contain pointers, so loaded values
@@ -803,8 +1220,8 @@ VisitResult ForwardAliasVisitor::visitLoadInst(llvm::LoadInst &inst) {
     // this could happen where an index into a vector register is stored
     // in another register. We don't handle that yet.
     } else {
-      state_access_offset.emplace(&inst, ptr->second);
-      exclude.emplace(&inst);
+      state_access_offset.emplace(&inst, *ptr);
+      state_offset.Exclude(curr);
       return VisitResult::Progress;
     }
   }
@@ -816,23 +1233,23 @@ VisitResult ForwardAliasVisitor::visitStoreInst(llvm::StoreInst &inst) {
   // If we're storing a pointer into the `State` structure into the `State`
   // structure then just bail out because that shouldn't even be possible
   // and is not allowed by the Remill design.
-  if (state_offset.count(inst.getOperand(0))) {
+  if (state_offset.Find(Operand(0))) {
     return VisitResult::Error;
   }
 
-  auto addr = inst.getPointerOperand();
-  if (exclude.count(addr)) {
-    exclude.insert(&inst);
+  const auto addr = Operand(llvm::StoreInst::getPointerOperandIndex());
+  if (state_offset.IsExcluded(addr)) {
+    state_offset.Exclude(curr);
     return VisitResult::Progress;
   }
 
-  auto ptr = state_offset.find(addr);
-  if (ptr == state_offset.end()) {
+  auto ptr = state_offset.Find(addr);
+  if (!ptr) {
     return VisitResult::NoProgress;
   }
 
   // loads mean we now have an alias to the pointer
-  state_access_offset.emplace(&inst, ptr->second);
+  state_access_offset.emplace(&inst, *ptr);
   return VisitResult::Progress;
 }
 
@@ -840,15 +1257,15 @@ VisitResult ForwardAliasVisitor::visitStoreInst(llvm::StoreInst &inst) {
 VisitResult
 ForwardAliasVisitor::visitGetElementPtrInst(llvm::GetElementPtrInst &inst) {
 
-  auto val = inst.getPointerOperand();
+  const auto val = Operand(llvm::GetElementPtrInst::getPointerOperandIndex());
 
-  if (exclude.count(val)) {
-    exclude.insert(&inst);
+  if (state_offset.IsExcluded(val)) {
+    state_offset.Exclude(curr);
     return VisitResult::Progress;
   }
 
-  auto ptr = state_offset.find(val);
-  if (ptr == state_offset.end()) {
+  auto ptr = state_offset.Find(val);
+  if (!ptr) {
     return VisitResult::NoProgress;
   }
 
@@ -858,40 +1275,40 @@ ForwardAliasVisitor::visitGetElementPtrInst(llvm::GetElementPtrInst &inst) {
     return VisitResult::Error;
   }
 
-  // the final offset (adding the ptr->second value to the const_offset)
+  // the final offset (adding the *ptr value to the const_offset)
   uint64_t offset = 0;
-  if (!TryCombineOffsets(ptr->second, OpType::Plus,
+  if (!TryCombineOffsets(*ptr, OpType::Plus,
                          static_cast<uint64_t>(const_offset.getSExtValue()),
                          offset_to_slot.size(), &offset)) {
 
     LOG(WARNING) << "Out of bounds GEP operation: " << LLVMThingToString(&inst)
-                 << " on base " << LLVMThingToString(val)
+                 << " on base " << LLVMThingToString(inst.getPointerOperand())
                  << " with inferred offset " << static_cast<int64_t>(offset)
-                 << " (" << ptr->second << " + " << const_offset.getSExtValue()
+                 << " (" << *ptr << " + " << const_offset.getSExtValue()
                  << ")"
                  << " and max allowed offset of " << offset_to_slot.size();
     return VisitResult::Error;
   }
 
-  state_offset.emplace(&inst, offset);
+  state_offset.Emplace(curr, offset);
   return VisitResult::Progress;
 }
 
 // Visit a cast instruction and update the offset map. This could be
 // a `bitcast`, `inttoptr`, `ptrtoint`, etc.
 VisitResult ForwardAliasVisitor::visitCastInst(llvm::CastInst &inst) {
-  auto addr = inst.getOperand(0);
-  if (exclude.count(addr)) {
-    exclude.insert(&inst);
+  const auto addr = Operand(0);
+  if (state_offset.IsExcluded(addr)) {
+    state_offset.Exclude(curr);
     return VisitResult::Progress;
   }
 
-  auto ptr = state_offset.find(addr);
-  if (ptr == state_offset.end()) {
+  auto ptr = state_offset.Find(addr);
+  if (!ptr) {
     return VisitResult::NoProgress;
 
   } else {
-    state_offset.emplace(&inst, ptr->second);
+    state_offset.Emplace(curr, *ptr);
     return VisitResult::Progress;
   }
 }
@@ -912,6 +1329,8 @@ VisitResult ForwardAliasVisitor::visitBinaryOp_(llvm::BinaryOperator &inst,
 
   auto lhs_val = inst.getOperand(0);
   auto rhs_val = inst.getOperand(1);
+  const auto lhs = Operand(0);
+  const auto rhs = Operand(1);
   auto num_excluded = 0;
   auto num_offsets = 0;
   auto num_consts = 0;
@@ -919,10 +1338,10 @@ VisitResult ForwardAliasVisitor::visitBinaryOp_(llvm::BinaryOperator &inst,
   uint64_t rhs_offset = 0;
   auto ret = VisitResult::NoProgress;
 
-  if (exclude.count(lhs_val)) {
+  if (state_offset.IsExcluded(lhs)) {
     num_excluded += 1;
 
-  } else if (TryGetOffsetOrConst(lhs_val, state_offset, &lhs_offset)) {
+  } else if (TryGetOffsetOrConst(lhs_val, lhs, state_offset, &lhs_offset)) {
     if (llvm::isa<llvm::Constant>(lhs_val)) {
       num_consts += 1;
     } else {
@@ -932,7 +1351,7 @@ VisitResult ForwardAliasVisitor::visitBinaryOp_(llvm::BinaryOperator &inst,
   // It's a constant that isn't an integer, e.g. a costant expression on a
   // global.
   } else if (llvm::isa<llvm::Constant>(lhs_val)) {
-    exclude.emplace(lhs_val);
+    state_offset.Exclude(lhs);
     num_excluded += 1;
 
   } else {
@@ -942,10 +1361,10 @@ VisitResult ForwardAliasVisitor::visitBinaryOp_(llvm::BinaryOperator &inst,
     ret = VisitResult::Incomplete;
   }
 
-  if (exclude.count(rhs_val)) {
+  if (state_offset.IsExcluded(rhs)) {
     num_excluded += 1;
 
-  } else if (TryGetOffsetOrConst(rhs_val, state_offset, &rhs_offset)) {
+  } else if (TryGetOffsetOrConst(rhs_val, rhs, state_offset, &rhs_offset)) {
     if (llvm::isa<llvm::Constant>(rhs_val)) {
       num_consts += 1;
     } else {
@@ -955,7 +1374,7 @@ VisitResult ForwardAliasVisitor::visitBinaryOp_(llvm::BinaryOperator &inst,
   // It's a constant that isn't an integer, e.g. a costant expression on a
   // global.
   } else if (llvm::isa<llvm::Constant>(rhs_val)) {
-    exclude.emplace(lhs_val);
+    state_offset.Exclude(lhs);
     num_excluded += 1;
 
   } else {
@@ -966,7 +1385,7 @@ VisitResult ForwardAliasVisitor::visitBinaryOp_(llvm::BinaryOperator &inst,
   }
 
   if (num_excluded) {
-    exclude.emplace(&inst);
+    state_offset.Exclude(curr);
     if (2 <= (num_offsets + num_excluded + num_consts)) {
       return VisitResult::Progress;
     } else {
@@ -990,7 +1409,7 @@ VisitResult ForwardAliasVisitor::visitBinaryOp_(llvm::BinaryOperator &inst,
       return VisitResult::Error;
     }
 
-    state_offset.emplace(&inst, offset);
+    state_offset.Emplace(curr, offset);
     return VisitResult::Progress;
 
   } else if (2 == (num_offsets + num_excluded)) {
@@ -1005,11 +1424,14 @@ VisitResult ForwardAliasVisitor::visitBinaryOp_(llvm::BinaryOperator &inst,
 VisitResult ForwardAliasVisitor::visitSelect(llvm::SelectInst &inst) {
   auto true_val = inst.getTrueValue();
   auto false_val = inst.getFalseValue();
-  auto true_ptr = state_offset.find(true_val);
-  auto false_ptr = state_offset.find(false_val);
-  auto in_exclude_set = exclude.count(true_val) || exclude.count(false_val);
-  auto in_state_offset =
-      true_ptr != state_offset.end() || false_ptr != state_offset.end();
+  const auto true_num = Operand(1);
+  const auto false_num = Operand(2);
+  auto true_ptr = state_offset.Find(true_num);
+  auto false_ptr = state_offset.Find(false_num);
+  auto true_excluded = state_offset.IsExcluded(true_num);
+  auto false_excluded = state_offset.IsExcluded(false_num);
+  auto in_exclude_set = true_excluded || false_excluded;
+  auto in_state_offset = true_ptr || false_ptr;
 
   // Fail if the two values are inconsistent.
   if (in_state_offset && in_exclude_set) {
@@ -1017,24 +1439,24 @@ VisitResult ForwardAliasVisitor::visitSelect(llvm::SelectInst &inst) {
 
   // At least one of the selected values points into `State`.
   } else if (in_state_offset) {
-    if (true_ptr == state_offset.end()) {
+    if (!true_ptr) {
       if (!FLAGS_dot_output_dir.empty()) {
         missing.emplace(true_val);
       }
-      state_offset.emplace(&inst, false_ptr->second);
+      state_offset.Emplace(curr, *false_ptr);
       return VisitResult::Incomplete;  // Wait for the other to be found.
 
-    } else if (false_ptr == state_offset.end()) {
+    } else if (!false_ptr) {
       if (!FLAGS_dot_output_dir.empty()) {
         missing.emplace(false_val);
       }
-      state_offset.emplace(&inst, true_ptr->second);
+      state_offset.Emplace(curr, *true_ptr);
       return VisitResult::Incomplete;  // Wait for the other to be found.
 
     // Both point into `State`.
     } else {
-      if (true_ptr->second == false_ptr->second) {
-        state_offset.emplace(&inst, true_ptr->second);
+      if (*true_ptr == *false_ptr) {
+        state_offset.Emplace(curr, *true_ptr);
         return VisitResult::Progress;
 
       } else {
@@ -1045,8 +1467,8 @@ VisitResult ForwardAliasVisitor::visitSelect(llvm::SelectInst &inst) {
   // At least one of the values being selected definitely does not point
   // into the `State` structure.
   } else if (in_exclude_set) {
-    exclude.insert(&inst);
-    if (exclude.count(true_val) != exclude.count(false_val)) {
+    state_offset.Exclude(curr);
+    if (true_excluded != false_excluded) {
       return VisitResult::Incomplete;  // Wait for the other to be found.
 
     } else {
@@ -1056,7 +1478,7 @@ VisitResult ForwardAliasVisitor::visitSelect(llvm::SelectInst &inst) {
   // One or both values are constant.
   } else if (llvm::isa<llvm::Constant>(true_val) ||
              llvm::isa<llvm::Constant>(false_val)) {
-    exclude.emplace(&inst);
+    state_offset.Exclude(curr);
     return VisitResult::Progress;
 
   // The status of the values being selected are as-of-yet unknown.
@@ -1078,7 +1500,8 @@ VisitResult ForwardAliasVisitor::visitPHINode(llvm::PHINode &inst) {
 
   for (unsigned i = 0; i < num_vals; ++i) {
     auto operand = inst.getIncomingValue(i);
-    if (exclude.count(operand)) {
+    const auto operand_num = Operand(i);
+    if (state_offset.IsExcluded(operand_num)) {
       num_in_exclude_set += 1;
       continue;
 
@@ -1087,11 +1510,11 @@ VisitResult ForwardAliasVisitor::visitPHINode(llvm::PHINode &inst) {
       continue;
     }
 
-    auto ptr = state_offset.find(operand);
+    auto ptr = state_offset.Find(operand_num);
 
     // The status of the incoming value is unknown, so we can't yet mark
     // handling this PHI as being complete.
-    if (ptr == state_offset.end()) {
+    if (!ptr) {
       if (!FLAGS_dot_output_dir.empty()) {
         missing.emplace(operand);
       }
@@ -1102,11 +1525,11 @@ VisitResult ForwardAliasVisitor::visitPHINode(llvm::PHINode &inst) {
 
     // This is the first incoming value that points into `State`.
     if (1 == num_in_state_offset) {
-      offset = ptr->second;
+      offset = *ptr;
 
     // This is the Nth incoming value that points into `State`, let's
     // make sure that it aggrees with the others.
-    } else if (ptr->second != offset) {
+    } else if (*ptr != offset) {
       return VisitResult::Error;
     }
   }
@@ -1122,12 +1545,12 @@ VisitResult ForwardAliasVisitor::visitPHINode(llvm::PHINode &inst) {
   // assume that all will match. This lets us have the algorithm progress
   // in the presence of loops.
   } else if (num_in_state_offset) {
-    state_offset.emplace(&inst, offset);
+    state_offset.Emplace(curr, offset);
     return (complete ? VisitResult::Progress : VisitResult::Incomplete);
 
   // Similar case to above, but at least one thing is in the exclude set.
   } else if (num_in_exclude_set || num_consts) {
-    exclude.insert(&inst);
+    state_offset.Exclude(curr);
     return (complete ? VisitResult::Progress : VisitResult::Incomplete);
 
   } else {
@@ -1146,7 +1569,7 @@ VisitResult ForwardAliasVisitor::visitCallInst(llvm::CallInst &inst) {
     if (auto func = llvm::dyn_cast<llvm::Function>(const_val); func) {
       if (func->hasFnAttribute(llvm::Attribute::ReadNone) ||
           func->hasFnAttribute(llvm::Attribute::ReadOnly)) {
-        live_args[&inst].reset();
+        live_args[&inst] = live_sets.none;
         return VisitResult::Ignored;
       }
     }
@@ -1164,70 +1587,126 @@ VisitResult ForwardAliasVisitor::visitCallInst(llvm::CallInst &inst) {
         name == "__mcsema_printf") {
 
       // Don't let this affect anything.
-      live_args[&inst].reset();
+      live_args[&inst] = live_sets.none;
       return VisitResult::Ignored;
 
     } else if (name.startswith("__mcsema")) {
-      live_args[&inst].set();
+      live_args[&inst] = live_sets.all;
       return VisitResult::Ignored;
     }
 
   // Don't let this affect anything.
   } else if (llvm::isa<llvm::InlineAsm>(val)) {
-    live_args[&inst].reset();
+    live_args[&inst] = live_sets.none;
     return VisitResult::Ignored;
 
   // It's an indirect call.
   } else {
-    live_args[&inst].set();
+    live_args[&inst] = live_sets.all;
+    return VisitResult::Ignored;
+  }
+
+  if (auto live = GetLiveSetFromSummary(inst)) {
+    live_args.emplace(&inst, live);
     return VisitResult::Ignored;
   }
 
   // If we have not seen this instruction before, add it.
   auto args = inst.arg_operands();
-  auto live = GetLiveSetFromArgs(args, state_offset, offset_to_slot);
-  live_args.emplace(&inst, std::move(live));
+  live_args.emplace(
+      &inst, GetLiveSetFromArgs(args, state_offset, offset_to_slot, live_sets));
   return VisitResult::Ignored;
 }
 
+// The summary is only used for calls that pass the `State` pointer itself as
+// the `State` argument, and no other pointers into `State`. The callee may
+// read or write any slot in its summary, and so they're all live.
+const LiveSet *
+ForwardAliasVisitor::GetLiveSetFromSummary(llvm::CallInst &call) {
+  auto callee = call.getCalledFunction();
+  if (!FLAGS_use_state_summaries || !callee ||
+      call.arg_size() <= kStatePointerArgNum) {
+    return nullptr;
+  }
+
+  for (auto i = 0u; i < call.arg_size(); ++i) {
+    auto arg = call.getArgOperand(i)->stripPointerCasts();
+    auto offset_ptr = state_offset.Find(arg);
+    if (i == kStatePointerArgNum) {
+      if (!offset_ptr || *offset_ptr) {
+        return nullptr;
+      }
+    } else if (offset_ptr) {
+      return nullptr;
+    }
+  }
+
+  auto [it, added] = summary_live_sets.emplace(callee, nullptr);
+  if (added) {
+    if (auto summary = GetStateSlotSummary(callee)) {
+      LiveSet live;
+      for (const auto &ranges : {summary->reads, summary->writes}) {
+        for (auto [begin, end] : ranges) {
+          for (auto i = begin; i < end && i < offset_to_slot.size(); ++i) {
+            if (offset_to_slot[i].index != kPaddingSlot) {
+              live.Set(offset_to_slot[i].index);
+            }
+          }
+          if (end > offset_to_slot.size()) {
+            live.SetAll(live_sets.num_slots);
+          }
+        }
+      }
+      it->second = live_sets.Intern(live);
+    }
+  }
+  return it->second;
+}
+
 VisitResult ForwardAliasVisitor::visitInvokeInst(llvm::InvokeInst &inst) {
   auto val =
       compat::llvm::CallSite(&inst).getCalledValue()->stripPointerCasts();
   if (llvm::isa<llvm::InlineAsm>(val)) {
-    live_args[&inst].set();  // Weird to invoke inline assembly.
+    live_args[&inst] = live_sets.all;  // Weird to invoke inline assembly.
 
   } else if (auto func = llvm::dyn_cast<llvm::Constant>(val);
              func && func->getName().startswith("__mcsema")) {
-    live_args[&inst].set();
+    live_args[&inst] = live_sets.all;
 
   // If we have not seen this instruction before, add it.
   } else {
     auto args = inst.arg_operands();
-    auto live = GetLiveSetFromArgs(args, state_offset, offset_to_slot);
-    live_args.emplace(&inst, std::move(live));
+    live_args.emplace(&inst, GetLiveSetFromArgs(args, state_offset,
+                                                offset_to_slot, live_sets));
   }
   return VisitResult::Ignored;
 }
 
 class LiveSetBlockVisitor {
  public:
-  llvm::Module &module;
+  const std::vector<llvm::Function *> &funcs;
   InstToLiveSet debug_live_args_at_call;
   const InstToLiveSet &live_args;
   InstToOffset &state_access_offset;
   const std::vector<StateSlot> &offset_to_slot;
-  std::vector<llvm::BasicBlock *> curr_wl;
   std::unordered_map<llvm::BasicBlock *, LiveSet> block_map;
   std::vector<llvm::Instruction *> to_remove;
   const llvm::Function *bb_func;
+  const size_t num_slots;
+
+  // If non-null, then the stores, dead stores, and removed instructions of
+  // each function are also counted here.
+  std::unordered_map<llvm::Function *, FunctionKillCounter> *func_stats;
 
-  LiveSetBlockVisitor(llvm::Module &module_, const InstToLiveSet &live_args_,
+  LiveSetBlockVisitor(const std::vector<llvm::Function *> &funcs_,
+                      const InstToLiveSet &live_args_,
                       InstToOffset &state_access_offset_,
                       const std::vector<StateSlot> &state_slots_,
                       const llvm::Function *bb_func_,
                       const llvm::DataLayout *dl_);
 
   void FindLiveInsts(KillCounter &stats);
+  void FindLiveInsts(llvm::Function *func, KillCounter &stats);
   void CollectDeadInsts(KillCounter &stats);
   bool VisitBlock(llvm::BasicBlock *block, KillCounter &stats);
   bool DeleteDeadInsts(KillCounter &stats);
@@ -1240,67 +1719,121 @@ class LiveSetBlockVisitor {
 };
 
 LiveSetBlockVisitor::LiveSetBlockVisitor(
-    llvm::Module &module_, const InstToLiveSet &live_args_,
-    InstToOffset &state_access_offset_,
+    const std::vector<llvm::Function *> &funcs_,
+    const InstToLiveSet &live_args_, InstToOffset &state_access_offset_,
     const std::vector<StateSlot> &state_slots_, const llvm::Function *bb_func_,
     const llvm::DataLayout *dl_)
-    : module(module_),
+    : funcs(funcs_),
       live_args(live_args_),
       state_access_offset(state_access_offset_),
       offset_to_slot(state_slots_),
-      curr_wl(),
       block_map(),
       to_remove(),
       bb_func(bb_func_),
+      num_slots(NumSlots(state_slots_)),
+      func_stats(nullptr),
       on_remove_pass(false),
-      dl(dl_) {
-  for (auto &func : module) {
-    for (auto &block : func) {
-      auto succ_begin_it = llvm::succ_begin(&block);
-      auto succ_end_it = llvm::succ_end(&block);
-      if (succ_begin_it == succ_end_it) {
-        curr_wl.push_back(&block);
-      }
+      dl(dl_) {}
+
+// Solve the live sets of the blocks of every function in `funcs`. The live
+// set of a block only depends on those of its successors, and on the live
+// sets of its calls, which are already known. Functions are thus independent
+// of one another, and are solved on up to `--dse_num_threads` threads.
+void LiveSetBlockVisitor::FindLiveInsts(KillCounter &stats) {
+
+  // Create every block's entry up front, so that solvers running in parallel
+  // only ever update existing entries.
+  for (auto func : funcs) {
+    for (auto &block : *func) {
+      block_map[&block];
+    }
+  }
+
+  const auto num_threads = std::min<size_t>(
+      std::max<size_t>(FLAGS_dse_num_threads, 1), funcs.size());
+  if (num_threads <= 1) {
+    for (auto func : funcs) {
+      FindLiveInsts(func, stats);
+    }
+    return;
+  }
+
+  // `llvm::DataLayout` lazily caches the layouts of structure types, which
+  // isn't thread-safe; compute the layouts of stored types ahead of time.
+  for (auto [inst, offset] : state_access_offset) {
+    if (auto store_inst = llvm::dyn_cast<llvm::StoreInst>(inst)) {
+      (void) dl->getTypeAllocSize(store_inst->getOperand(0)->getType());
+    }
+  }
+
+  // Only the removal pass updates `stats`.
+  std::atomic<size_t> next_func(0);
+  auto solve = [&](void) {
+    KillCounter unused_stats = {};
+    for (size_t i = 0; (i = next_func.fetch_add(1)) < funcs.size();) {
+      FindLiveInsts(funcs[i], unused_stats);
     }
+  };
+
+  std::vector<std::thread> threads;
+  threads.reserve(num_threads);
+  for (size_t i = 0; i < num_threads; ++i) {
+    threads.emplace_back(solve);
+  }
+  for (auto &thread : threads) {
+    thread.join();
   }
 }
 
-// Visit the basic blocks in the worklist and update the block_map.
-void LiveSetBlockVisitor::FindLiveInsts(KillCounter &stats) {
-  std::vector<llvm::BasicBlock *> next_wl;
-  while (!curr_wl.empty()) {
-    for (auto block : curr_wl) {
-
-      // If we change the live slots state of the block, then add the
-      // block's predecessors to the next work list.
-      if (VisitBlock(block, stats)) {
-        int num_preds = 0;
-        auto pred_it = llvm::pred_begin(block);
-        auto pred_end = llvm::pred_end(block);
-        for (; pred_it != pred_end; ++pred_it) {
-          auto pred = *pred_it;
-          next_wl.push_back(pred);
-          num_preds++;
-        }
+// Solve the live sets of the blocks of `func`. The work list visits blocks in
+// post-order, i.e. in reverse post-order of the reversed CFG, so the
+// successors of a block are usually visited before it, and it never holds a
+// block more than once.
+void LiveSetBlockVisitor::FindLiveInsts(llvm::Function *func,
+                                        KillCounter &stats) {
+  std::vector<llvm::BasicBlock *> blocks;
+  std::unordered_map<llvm::BasicBlock *, unsigned> block_order;
+  for (auto block : llvm::post_order(&(func->getEntryBlock()))) {
+    block_order.emplace(block, blocks.size());
+    blocks.push_back(block);
+  }
 
-        // If we've visited an entry block, add its callers to the
-        // next work list.
-        if (!num_preds) {
-          auto func = block->getParent();
-          for (auto user : func->users()) {
-            if (auto inst = llvm::dyn_cast<llvm::Instruction>(user)) {
-              if (llvm::isa<llvm::CallInst>(inst) ||
-                  llvm::isa<llvm::InvokeInst>(inst)) {
-                next_wl.push_back(inst->getParent());
-              }
-            }
-          }
-        }
-      }
+  // Blocks that are unreachable from the entry block.
+  for (auto &block : *func) {
+    if (block_order.emplace(&block, blocks.size()).second) {
+      blocks.push_back(&block);
     }
+  }
 
-    curr_wl.swap(next_wl);
-    next_wl.clear();
+  std::priority_queue<unsigned, std::vector<unsigned>, std::greater<unsigned>>
+      work_list;
+  std::vector<bool> in_work_list(blocks.size(), false);
+  for (unsigned i = 0; i < blocks.size(); ++i) {
+    if (llvm::succ_begin(blocks[i]) == llvm::succ_end(blocks[i])) {
+      work_list.push(i);
+      in_work_list[i] = true;
+    }
+  }
+
+  while (!work_list.empty()) {
+    const auto i = work_list.top();
+    work_list.pop();
+    in_work_list[i] = false;
+
+    // If we change the live slots state of the block, then revisit the
+    // block's predecessors.
+    if (!VisitBlock(blocks[i], stats)) {
+      continue;
+    }
+    auto pred_it = llvm::pred_begin(blocks[i]);
+    auto pred_end = llvm::pred_end(blocks[i]);
+    for (; pred_it != pred_end; ++pred_it) {
+      const auto pred = block_order.at(*pred_it);
+      if (!in_work_list[pred]) {
+        work_list.push(pred);
+        in_work_list[pred] = true;
+      }
+    }
   }
 }
 
@@ -1317,7 +1850,7 @@ bool LiveSetBlockVisitor::VisitBlock(llvm::BasicBlock *block,
         llvm::isa<llvm::UnreachableInst>(inst) ||
         llvm::isa<llvm::IndirectBrInst>(inst) ||
         llvm::isa<llvm::ResumeInst>(inst)) {
-      live.set();
+      live.SetAll(num_slots);
 
 #if LLVM_VERSION_NUMBER >= LLVM_VERSION(3, 8)
     } else if (llvm::isa<llvm::CatchSwitchInst>(inst) ||
@@ -1325,7 +1858,7 @@ bool LiveSetBlockVisitor::VisitBlock(llvm::BasicBlock *block,
                llvm::isa<llvm::CatchPadInst>(inst) ||
                llvm::isa<llvm::CleanupPadInst>(inst) ||
                llvm::isa<llvm::CleanupReturnInst>(inst)) {
-      live.set();
+      live.SetAll(num_slots);
 #endif
 
     // Update the live set from the successors. If a successors has not
@@ -1337,7 +1870,7 @@ bool LiveSetBlockVisitor::VisitBlock(llvm::BasicBlock *block,
       auto succ_end = llvm::succ_end(block);
       for (; succ_it != succ_end; succ_it++) {
         auto succ = *succ_it;
-        live |= block_map[succ];
+        live |= block_map.at(succ);
       }
 
     // This could be a call to another lifted function or control-flow
@@ -1350,10 +1883,10 @@ bool LiveSetBlockVisitor::VisitBlock(llvm::BasicBlock *block,
       // function.
       auto arg_live_it = live_args.find(inst);
       if (arg_live_it == live_args.end()) {
-        live.set();
+        live.SetAll(num_slots);
 
       } else {
-        live |= arg_live_it->second;
+        live |= *(arg_live_it->second);
       }
 
     } else if (auto store_inst = llvm::dyn_cast<llvm::StoreInst>(inst)) {
@@ -1371,7 +1904,7 @@ bool LiveSetBlockVisitor::VisitBlock(llvm::BasicBlock *block,
       const auto &state_slot = offset_to_slot[offset_ptr->second];
       auto slot_num = state_slot.index;
 
-      if (!live.test(slot_num)) {
+      if (!live.Test(slot_num)) {
         if (on_remove_pass) {
           to_remove.push_back(inst);
         }
@@ -1379,7 +1912,7 @@ bool LiveSetBlockVisitor::VisitBlock(llvm::BasicBlock *block,
       // We're storing to all the bytes, so kill it. Ignore partial stores
       // (that would revive it) because it's already marked as live.
       } else if (val_size == state_slot.size) {
-        live.reset(slot_num);
+        live.Reset(slot_num);
       }
 
     // Loads from slots revive the slots.
@@ -1387,12 +1920,12 @@ bool LiveSetBlockVisitor::VisitBlock(llvm::BasicBlock *block,
       auto offset_ptr = state_access_offset.find(inst);
       if (offset_ptr != state_access_offset.end()) {
         auto slot_num = offset_to_slot[offset_ptr->second].index;
-        live.set(slot_num);
+        live.Set(slot_num);
       }
     }
   }
 
-  auto &old_live_on_entry = block_map[block];
+  auto &old_live_on_entry = block_map.at(block);
   if (old_live_on_entry != live) {
     old_live_on_entry = live;
     return true;
@@ -1403,10 +1936,17 @@ bool LiveSetBlockVisitor::VisitBlock(llvm::BasicBlock *block,
 
 void LiveSetBlockVisitor::CollectDeadInsts(KillCounter &stats) {
   on_remove_pass = true;
-  for (auto &func : module) {
-    for (auto &block : func) {
+  for (auto func : funcs) {
+    const auto num_stores = stats.num_stores;
+    const auto num_dead = to_remove.size();
+    for (auto &block : *func) {
       VisitBlock(&block, stats);
     }
+    if (func_stats) {
+      auto &func_kills = (*func_stats)[func].stats;
+      func_kills.num_stores += stats.num_stores - num_stores;
+      func_kills.dead_stores += to_remove.size() - num_dead;
+    }
   }
   on_remove_pass = false;
 }
@@ -1419,6 +1959,9 @@ bool LiveSetBlockVisitor::DeleteDeadInsts(KillCounter &stats) {
     stats.removed_insts++;
     auto inst = to_remove.back();
     to_remove.pop_back();
+    if (func_stats) {
+      (*func_stats)[inst->getFunction()].stats.removed_insts++;
+    }
 
     if (!inst->getType()->isVoidTy()) {
       inst->replaceAllUsesWith(llvm::UndefValue::get(inst->getType()));
@@ -1455,7 +1998,7 @@ void LiveSetBlockVisitor::CreateDOTDigraph(const remill::Arch *arch,
   }
   fname << extension;
 
-  std::ofstream dot(fname.str());
+  std::stringstream dot;
   dot << "digraph {" << std::endl
       << "node [shape=none margin=0 nojustify=false labeljust=l]" << std::endl;
 
@@ -1466,7 +2009,7 @@ void LiveSetBlockVisitor::CreateDOTDigraph(const remill::Arch *arch,
       auto offset_ptr = state_access_offset.find(&inst);
       if (offset_ptr != state_access_offset.end()) {
         const auto &slot = offset_to_slot[offset_ptr->second];
-        used.set(slot.index);
+        used.Set(slot.index);
       }
     }
   }
@@ -1504,7 +2047,7 @@ void LiveSetBlockVisitor::CreateDOTDigraph(const remill::Arch *arch,
     }
 
     if (!num_succs) {
-      exit_live.set();
+      exit_live.SetAll(num_slots);
     }
 
     dot << "b" << reinterpret_cast<uintptr_t>(block)
@@ -1514,7 +2057,7 @@ void LiveSetBlockVisitor::CreateDOTDigraph(const remill::Arch *arch,
     dot << "<tr><td align=\"left\" colspan=\"3\">";
     auto sep = "dead: ";
     for (uint64_t i = 0; i < slots.size(); i++) {
-      if (used.test(i) && !blive.test(i) && slots[i]) {
+      if (used.Test(i) && !blive.Test(i) && slots[i]) {
         dot << sep;
         StreamSlot(arch, context, dot, *(slots[i]), slots[i]->size);
         sep = ", ";
@@ -1527,11 +2070,11 @@ void LiveSetBlockVisitor::CreateDOTDigraph(const remill::Arch *arch,
 
       // First row, print out the DEAD slots on entry.
       if (debug_live_args_at_call.count(&inst)) {
-        const auto &clive = debug_live_args_at_call[&inst];
+        const auto &clive = *(debug_live_args_at_call[&inst]);
         dot << "<tr><td align=\"left\" colspan=\"3\">";
         sep = "dead: ";
         for (uint64_t i = 0; i < slots.size(); i++) {
-          if (used.test(i) && !clive.test(i)) {
+          if (used.Test(i) && !clive.Test(i)) {
             dot << sep;
             StreamSlot(arch, context, dot, *(slots[i]), slots[i]->size);
             sep = ", ";
@@ -1593,7 +2136,7 @@ void LiveSetBlockVisitor::CreateDOTDigraph(const remill::Arch *arch,
     dot << "<tr><td align=\"left\" colspan=\"3\">";
     sep = "dead: ";
     for (uint64_t i = 0; i < slots.size(); i++) {
-      if (used.test(i) && !exit_live.test(i)) {
+      if (used.Test(i) && !exit_live.Test(i)) {
         dot << sep;
         StreamSlot(arch, context, dot, *(slots[i]), slots[i]->size);
         sep = ", ";
@@ -1604,52 +2147,92 @@ void LiveSetBlockVisitor::CreateDOTDigraph(const remill::Arch *arch,
     dot << "</table>>];" << std::endl;
   }
   dot << "}" << std::endl;
+  DOTFileWriter::Get().Write(fname.str(), dot.str());
 }
 
+// Forwards values between the loads and stores to `State` within each block.
+// Nothing is forwarded across blocks, and so there is no need for a dominator
+// tree: within a block, an instruction dominates the ones that come after it.
 class ForwardingBlockVisitor {
  public:
   llvm::Function &func;
-  llvm::DominatorTree &dominator_tree;
   InstToOffset &state_access_offset;
   const std::vector<StateSlot> &state_slots;
   const InstToLiveSet &live_args;
   const llvm::FunctionType *lifted_func_ty;
+  const size_t num_slots;
 
   ForwardingBlockVisitor(llvm::Function &func_,
-                         llvm::DominatorTree &dominator_tree_,
                          InstToOffset &state_access_offset_,
                          const std::vector<StateSlot> &state_slots_,
                          const InstToLiveSet &live_args_,
                          const llvm::DataLayout *dl_);
 
-  void Visit(const ValueToOffset &val_to_offset, KillCounter &stats);
-  void VisitBlock(llvm::BasicBlock *block, const ValueToOffset &val_to_offset,
+  void Visit(const ValueOffsets &val_to_offset, KillCounter &stats);
+  void VisitBlock(llvm::BasicBlock *block, const ValueOffsets &val_to_offset,
                   KillCounter &stats);
 
  private:
+  // Returns `true` if `block` loads a slot that an earlier load or store in
+  // `block` already accesses, i.e. if there may be something to forward.
+  bool HasCandidates(llvm::BasicBlock *block);
+
   const llvm::DataLayout *dl;
+  std::unordered_set<uint64_t> seen_slots;
 };
 
 ForwardingBlockVisitor::ForwardingBlockVisitor(
-    llvm::Function &func_, llvm::DominatorTree &dominator_tree_,
-    InstToOffset &state_access_offset_,
+    llvm::Function &func_, InstToOffset &state_access_offset_,
     const std::vector<StateSlot> &state_slots_, const InstToLiveSet &live_args_,
     const llvm::DataLayout *dl_)
     : func(func_),
-      dominator_tree(dominator_tree_),
       state_access_offset(state_access_offset_),
       state_slots(state_slots_),
       live_args(live_args_),
       lifted_func_ty(func.getFunctionType()),
+      num_slots(NumSlots(state_slots_)),
       dl(dl_) {}
 
-void ForwardingBlockVisitor::Visit(const ValueToOffset &val_to_offset,
+void ForwardingBlockVisitor::Visit(const ValueOffsets &val_to_offset,
                                    KillCounter &stats) {
 
-  // If any visit makes progress, continue the loop.
   for (auto &block : func) {
-    VisitBlock(&block, val_to_offset, stats);
+    if (HasCandidates(&block)) {
+      VisitBlock(&block, val_to_offset, stats);
+    }
+  }
+}
+
+bool ForwardingBlockVisitor::HasCandidates(llvm::BasicBlock *block) {
+  seen_slots.clear();
+  for (auto &inst : *block) {
+    if (!llvm::isa<llvm::LoadInst>(inst) && !llvm::isa<llvm::StoreInst>(inst)) {
+      continue;
+    }
+    auto offset_ptr = state_access_offset.find(&inst);
+    if (offset_ptr == state_access_offset.end()) {
+      continue;
+    }
+    const auto index = state_slots[offset_ptr->second].index;
+    if (!seen_slots.insert(index).second && llvm::isa<llvm::LoadInst>(inst)) {
+      return true;
+    }
   }
+  return false;
+}
+
+// Returns `true` if `inst` comes before `other` in their block.
+static bool ComesBefore(llvm::Instruction *inst, llvm::Instruction *other) {
+#if LLVM_VERSION_NUMBER >= LLVM_VERSION(11, 0)
+  return inst->comesBefore(other);
+#else
+  for (auto it = other->getIterator(); it != other->getParent()->begin();) {
+    if (&*(--it) == inst) {
+      return true;
+    }
+  }
+  return false;
+#endif
 }
 
 static llvm::Value *ConvertToSameSizedType(llvm::Value *val,
@@ -1694,7 +2277,7 @@ static llvm::Value *ConvertToSameSizedType(llvm::Value *val,
 }
 
 void ForwardingBlockVisitor::VisitBlock(llvm::BasicBlock *block,
-                                        const ValueToOffset &val_to_offset,
+                                        const ValueOffsets &val_to_offset,
                                         KillCounter &stats) {
   auto empty_name = llvm::Twine::createNull();
   std::unordered_map<uint64_t, llvm::LoadInst *> slot_to_load;
@@ -1714,16 +2297,12 @@ void ForwardingBlockVisitor::VisitBlock(llvm::BasicBlock *block,
         slot_to_load.clear();
 
       } else {
-        const auto count = live_args_it->second.count();
-        if (count == kMaxNumSlots) {
+        const auto &live = *(live_args_it->second);
+        if (live.Count() >= num_slots) {
           slot_to_load.clear();
 
-        } else if (count) {
-          for (auto i = 0u; i < kMaxNumSlots; ++i) {
-            if (live_args_it->second.test(i)) {
-              slot_to_load.erase(i);
-            }
-          }
+        } else {
+          live.ForEach([&](uint64_t i) { slot_to_load.erase(i); });
         }
       }
 
@@ -1820,7 +2399,7 @@ void ForwardingBlockVisitor::VisitBlock(llvm::BasicBlock *block,
       auto &load_ref = slot_to_load[state_slot.index];
 
       // If the slot is not dominating the load, update it.
-      if (load_ref && !dominator_tree.dominates(load_inst, load_ref)) {
+      if (load_ref && !ComesBefore(load_inst, load_ref)) {
         load_ref = nullptr;
       }
 
@@ -1912,8 +2491,143 @@ void ForwardingBlockVisitor::VisitBlock(llvm::BasicBlock *block,
   }
 }
 
+// Returns the `[begin, end)` byte ranges of the slots in `set`, where
+// `slot_by_index` maps slot indices to slots.
+static std::vector<std::pair<uint64_t, uint64_t>>
+GetSlotRanges(const LiveSet &set,
+              const std::vector<const StateSlot *> &slot_by_index) {
+  std::vector<std::pair<uint64_t, uint64_t>> ranges;
+  set.ForEach([&](uint64_t i) {
+    if (i >= slot_by_index.size() || !slot_by_index[i]) {
+      return;
+    }
+    const auto slot = slot_by_index[i];
+    if (!ranges.empty() && ranges.back().second == slot->offset) {
+      ranges.back().second += slot->size;
+    } else {
+      ranges.emplace_back(slot->offset, slot->offset + slot->size);
+    }
+  });
+  return ranges;
+}
+
+// Summarize the slots that `func` may read or write, given the final
+// offsets of its loads and stores, and the live sets of its calls. A call
+// may both read and write the slots in its live set.
+static StateSlotSummary
+SummarizeFunction(llvm::Function &func, const InstToOffset &state_access_offset,
+                  const InstToLiveSet &live_args,
+                  const std::vector<StateSlot> &slots,
+                  const std::vector<const StateSlot *> &slot_by_index) {
+  LiveSet reads;
+  LiveSet writes;
+  for (auto &block : func) {
+    for (auto &inst : block) {
+      if (llvm::isa<llvm::CallInst>(inst) ||
+          llvm::isa<llvm::InvokeInst>(inst)) {
+        auto live_it = live_args.find(&inst);
+        if (live_it == live_args.end()) {
+          reads.SetAll(slot_by_index.size());
+          writes.SetAll(slot_by_index.size());
+        } else {
+          reads |= *(live_it->second);
+          writes |= *(live_it->second);
+        }
+        continue;
+      }
+
+      auto offset_it = state_access_offset.find(&inst);
+      if (offset_it == state_access_offset.end()) {
+        continue;
+      }
+      const auto index = slots[offset_it->second].index;
+      if (index == kPaddingSlot) {
+        continue;
+      } else if (llvm::isa<llvm::LoadInst>(inst)) {
+        reads.Set(index);
+      } else if (llvm::isa<llvm::StoreInst>(inst)) {
+        writes.Set(index);
+      }
+    }
+  }
+
+  StateSlotSummary summary;
+  summary.reads = GetSlotRanges(reads, slot_by_index);
+  summary.writes = GetSlotRanges(writes, slot_by_index);
+  return summary;
+}
+
+// Returns a hash of the instructions of `func` and their operands. Analyses
+// of `func` are only reused if this hash doesn't change.
+static llvm::hash_code FingerprintFunction(llvm::Function &func) {
+  auto hash = llvm::hash_value(func.size());
+  for (auto &block : func) {
+    hash = llvm::hash_combine(hash, &block);
+    for (auto &inst : block) {
+      hash = llvm::hash_combine(hash, &inst, inst.getOpcode(), inst.getType());
+      for (auto &op : inst.operands()) {
+        hash = llvm::hash_combine(hash, op.get());
+      }
+    }
+  }
+  return hash;
+}
+
+// The analyses of one lifted function, as of when its fingerprint was
+// `fingerprint`.
+struct FunctionAnalysis {
+  llvm::hash_code fingerprint;
+  bool valid{false};
+  bool analyzed{false};
+  bool complete{false};
+  ValueOffsets state_offset;
+  InstToOffset state_access_offset;
+  InstToLiveSet live_args;
+};
+
 }  // namespace
 
+class DeadStoreAnalysisCache::Impl {
+ public:
+  Impl(const remill::Arch *arch_, llvm::Module *module_)
+      : arch(arch_),
+        module(module_),
+        dl(module),
+        slots(StateSlots(arch, module)),
+        live_sets(NumSlots(slots)) {}
+
+  const remill::Arch *const arch;
+  llvm::Module *const module;
+  const llvm::DataLayout dl;
+  const std::vector<StateSlot> slots;
+
+  // The live sets of the calls in `funcs`.
+  LiveSetPool live_sets;
+
+  std::unordered_map<llvm::Function *, FunctionAnalysis> funcs;
+};
+
+DeadStoreAnalysisCache::DeadStoreAnalysisCache(const remill::Arch *arch,
+                                               llvm::Module *module)
+    : impl(new Impl(arch, module)) {}
+
+DeadStoreAnalysisCache::~DeadStoreAnalysisCache(void) {}
+
+// Returns the `State` slots of the module, like `StateSlots`.
+const std::vector<StateSlot> &DeadStoreAnalysisCache::Slots(void) const {
+  return impl->slots;
+}
+
+// Forget the analyses of `func`, e.g. before deleting it.
+void DeadStoreAnalysisCache::Invalidate(llvm::Function *func) {
+  impl->funcs.erase(func);
+}
+
+// Forget the analyses of all functions.
+void DeadStoreAnalysisCache::InvalidateAll(void) {
+  impl->funcs.clear();
+}
+
 // Returns a covering vector of `StateSlots` for the module's `State` type.
 // This vector contains one entry per byte of the `State` type.
 std::vector<StateSlot> StateSlots(const remill::Arch *arch,
@@ -1934,7 +2648,6 @@ std::vector<StateSlot> StateSlots(const remill::Arch *arch,
   StateVisitor vis(&dl, num_bytes);
   vis.Visit(type);
   CHECK_EQ(vis.offset_to_slot.size(), num_bytes);
-  CHECK_LT(vis.index, kMaxNumSlots);
 
   std::vector<StateSlot> offset_to_slot;
   offset_to_slot = std::move(vis.offset_to_slot);
@@ -1942,69 +2655,192 @@ std::vector<StateSlot> StateSlots(const remill::Arch *arch,
 }
 
 // Analyze a module, discover aliasing loads and stores, and remove dead
-// stores into the `State` structure.
-void RemoveDeadStores(const remill::Arch *arch, llvm::Module *module,
-                      llvm::Function *bb_func,
-                      const std::vector<StateSlot> &slots,
-                      llvm::Function *ds_func) {
+// stores into the `State` structure. If `cached_funcs` is non-null, then the
+// analyses of functions that haven't changed are reused from it, and it is
+// updated with the analyses of all other visited functions.
+//
+// If `interrupt` fires, then nothing is removed. The cached analyses of the
+// functions changed by forwarding are left behind, and are recomputed when
+// next visited, as their fingerprints no longer match.
+static LiftOutcome
+EliminateDeadStores(const remill::Arch *arch, llvm::Module *module,
+                    llvm::Function *bb_func,
+                    const std::vector<StateSlot> &slots,
+                    const llvm::DataLayout &dl, LiveSetPool &live_sets,
+                    const std::vector<llvm::Function *> *only_funcs,
+                    LiftStatistics *lift_stats,
+                    std::unordered_map<llvm::Function *, FunctionAnalysis>
+                        *cached_funcs,
+                    const LiftInterrupt *interrupt) {
   if (FLAGS_disable_dead_store_elimination) {
-    return;
+    return LiftOutcome::kComplete;
   }
 
+  StatisticsTimer timer(lift_stats ? &(lift_stats->dse_seconds) : nullptr);
+  TraceEventSpan span(lift_stats ? lift_stats->events : nullptr,
+                      "dead_store_elimination");
+  StatisticsAllocationScope allocs(
+      lift_stats ? &(lift_stats->dse_alloc_bytes) : nullptr,
+      lift_stats ? &(lift_stats->dse_allocs) : nullptr);
+
   const auto print_dot = !FLAGS_dot_output_dir.empty();
 
   KillCounter stats = {};
-  const llvm::DataLayout dl(module);
 
   InstToLiveSet live_args;
   InstToOffset state_access_offset;
+  std::vector<std::pair<llvm::Function *, FunctionAnalysis *>> visited;
+  std::unordered_set<llvm::Function *> complete_funcs;
+
+  const auto collect_func_stats =
+      lift_stats && lift_stats->collect_dse_function_stats;
+  std::unordered_map<llvm::Function *, FunctionKillCounter> func_stats;
+
+  // If `only_funcs` is set, only apply DSE to those functions.
+  std::vector<llvm::Function *> lifted_funcs;
+  if (only_funcs) {
+    std::unordered_set<llvm::Function *> seen;
+    for (auto func : *only_funcs) {
+      if (IsLiftedFunction(func, bb_func) && seen.insert(func).second) {
+        lifted_funcs.push_back(func);
+      }
+    }
+  } else {
+    for (auto &func : *module) {
+      if (IsLiftedFunction(&func, bb_func)) {
+        lifted_funcs.push_back(&func);
+      }
+    }
+  }
 
-  for (auto &func : *module) {
-    if (!IsLiftedFunction(&func, bb_func)) {
-      continue;
+  for (auto func_ptr : lifted_funcs) {
+    auto &func = *func_ptr;
+    if (interrupt) {
+      if (auto outcome = interrupt->Check();
+          outcome != LiftOutcome::kComplete) {
+        return outcome;
+      }
     }
 
-    // If ds_func is set, only apply DSE on that function
-    if (ds_func && ds_func != &func) {
+    // Count into the function's own statistics if they're being collected,
+    // and add them to the totals afterwards.
+    auto func_kills = collect_func_stats ? &(func_stats[&func]) : nullptr;
+    auto &kills = func_kills ? func_kills->stats : stats;
+    StatisticsTimer func_timer(func_kills ? &(func_kills->analysis_seconds)
+                                          : nullptr);
+
+    if (!cached_funcs) {
+      ForwardAliasVisitor fav(dl, slots, live_args, state_access_offset,
+                              live_sets, func.getContext());
+
+      // If the analysis succeeds for this function, then do store-to-load
+      // and load-to-load forwarding.
+      if (fav.Analyze(arch, kills, &func)) {
+        if (func_kills) {
+          func_kills->analyzed = true;
+        }
+        if (fav.complete) {
+          complete_funcs.insert(&func);
+        }
+        if (print_dot) {
+          fav.CreateDOTDigraph(arch, &func, ".offsets.dot");
+        }
+
+        if (!FLAGS_disable_register_forwarding) {
+          ForwardingBlockVisitor fbv(func, state_access_offset, slots,
+                                     live_args, &dl);
+          fbv.Visit(fav.state_offset, kills);
+        }
+      }
       continue;
     }
 
-    ForwardAliasVisitor fav(dl, slots, live_args, state_access_offset,
-                            func.getContext());
-
-    // If the analysis succeeds for this function, then do store-to-load
-    // and load-to-load forwarding.
-    if (fav.Analyze(arch, stats, &func)) {
-      if (print_dot) {
+    // A cached analysis of an unchanged function is from a run in which
+    // forwarding and dead store elimination didn't change it either, so
+    // forwarding would find nothing new.
+    const auto fingerprint = FingerprintFunction(func);
+    auto &analysis = (*cached_funcs)[&func];
+    auto reused = true;
+    if (!analysis.valid || analysis.fingerprint != fingerprint) {
+      reused = false;
+      analysis = FunctionAnalysis();
+      analysis.fingerprint = fingerprint;
+      analysis.valid = true;
+
+      ForwardAliasVisitor fav(dl, slots, analysis.live_args,
+                              analysis.state_access_offset, live_sets,
+                              func.getContext());
+      analysis.analyzed = fav.Analyze(arch, kills, &func);
+      analysis.complete = analysis.analyzed && fav.complete;
+      if (analysis.analyzed && print_dot) {
         fav.CreateDOTDigraph(arch, &func, ".offsets.dot");
       }
+      analysis.state_offset = std::move(fav.state_offset);
 
-      if (!FLAGS_disable_register_forwarding) {
-        llvm::DominatorTree dominator_tree(func);
-        ForwardingBlockVisitor fbv(func, dominator_tree, state_access_offset,
-                                   slots, live_args, &dl);
-        fbv.Visit(fav.state_offset, stats);
+      if (analysis.analyzed && !FLAGS_disable_register_forwarding) {
+        ForwardingBlockVisitor fbv(func, analysis.state_access_offset, slots,
+                                   analysis.live_args, &dl);
+        fbv.Visit(analysis.state_offset, kills);
       }
     }
+
+    if (func_kills) {
+      func_kills->analyzed = analysis.analyzed;
+      func_kills->cached = reused;
+    }
+
+    live_args.insert(analysis.live_args.begin(), analysis.live_args.end());
+    state_access_offset.insert(analysis.state_access_offset.begin(),
+                               analysis.state_access_offset.end());
+    visited.emplace_back(&func, &analysis);
+    if (analysis.complete) {
+      complete_funcs.insert(&func);
+    }
+  }
+
+  for (auto &[func, func_kills] : func_stats) {
+    AddKillCounts(stats, func_kills.stats);
   }
 
-  // Perform live set analysis
-  LiveSetBlockVisitor visitor(*module, live_args, state_access_offset, slots,
-                              bb_func, &dl);
+  // Perform live set analysis. Other functions don't need to be revisited, as
+  // the live sets of their calls don't depend on the bodies of the callees.
+  LiveSetBlockVisitor visitor(lifted_funcs, live_args, state_access_offset,
+                              slots, bb_func, &dl);
+  if (collect_func_stats) {
+    visitor.func_stats = &func_stats;
+  }
 
   visitor.FindLiveInsts(stats);
   visitor.CollectDeadInsts(stats);
 
   if (print_dot) {
-    for (auto &func : *module) {
-      if (IsLiftedFunction(&func, bb_func)) {
-        visitor.CreateDOTDigraph(arch, &func, ".dot");
-      }
+    for (auto func : lifted_funcs) {
+      visitor.CreateDOTDigraph(arch, func, ".dot");
     }
   }
 
   visitor.DeleteDeadInsts(stats);
 
+  // Summarize the fully analyzed functions, as they are after dead store
+  // elimination. The metadata doesn't affect the fingerprints of functions.
+  if (FLAGS_export_state_summaries) {
+    std::vector<const StateSlot *> slot_by_index(NumSlots(slots), nullptr);
+    for (auto &slot : slots) {
+      if (slot.index != kPaddingSlot) {
+        slot_by_index[slot.index] = &slot;
+      }
+    }
+    for (auto func : lifted_funcs) {
+      if (complete_funcs.count(func)) {
+        SetStateSlotSummary(func, SummarizeFunction(*func, state_access_offset,
+                                                    live_args, slots,
+                                                    slot_by_index));
+      } else {
+        ClearStateSlotSummary(func);
+      }
+    }
+  }
+
   LOG_IF(ERROR, FLAGS_log_dse_stats)
       << "Candidate stores: " << stats.num_stores << "; "
       << "Dead stores: " << stats.dead_stores << "; "
@@ -2017,6 +2853,186 @@ void RemoveDeadStores(const remill::Arch *arch, llvm::Module *module,
       << "Forwarded by reordering: " << stats.fwd_reordered << "; "
       << "Could not forward: " << stats.fwd_failed << "; "
       << "Unanalyzed functions: " << stats.failed_funcs;
+
+  if (lift_stats) {
+    lift_stats->dse_num_stores += stats.num_stores;
+    lift_stats->dse_dead_stores += stats.dead_stores;
+    lift_stats->dse_removed_insts += stats.removed_insts;
+    lift_stats->dse_forwarded_loads += stats.fwd_loads;
+    lift_stats->dse_forwarded_stores += stats.fwd_stores;
+    lift_stats->dse_failed_funcs += stats.failed_funcs;
+  }
+
+  if (collect_func_stats) {
+    for (auto func : lifted_funcs) {
+      const auto &func_kills = func_stats[func];
+      DeadStoreFunctionStatistics func_stat;
+      func_stat.name = func->getName().str();
+      func_stat.analyzed = func_kills.analyzed;
+      func_stat.cached = func_kills.cached;
+      func_stat.num_stores = func_kills.stats.num_stores;
+      func_stat.dead_stores = func_kills.stats.dead_stores;
+      func_stat.removed_insts = func_kills.stats.removed_insts;
+      func_stat.forwarded_loads = func_kills.stats.fwd_loads;
+      func_stat.forwarded_stores = func_kills.stats.fwd_stores;
+      func_stat.forwarded_perfect = func_kills.stats.fwd_perfect;
+      func_stat.forwarded_truncated = func_kills.stats.fwd_truncated;
+      func_stat.forwarded_casted = func_kills.stats.fwd_casted;
+      func_stat.forwarded_reordered = func_kills.stats.fwd_reordered;
+      func_stat.failed_forwards = func_kills.stats.fwd_failed;
+      func_stat.analysis_seconds = func_kills.analysis_seconds;
+      lift_stats->dse_function_stats.push_back(std::move(func_stat));
+    }
+  }
+
+  if (!cached_funcs) {
+    return LiftOutcome::kComplete;
+  }
+
+  // Forwarding and dead store elimination invalidate the analyses of the
+  // functions that they change.
+  for (auto [func, analysis] : visited) {
+    if (FingerprintFunction(*func) != analysis->fingerprint) {
+      cached_funcs->erase(func);
+    }
+  }
+
+  // Forget the functions that are no longer in the module. This is skipped
+  // when only some functions are processed, so that the cost of incremental
+  // DSE doesn't grow with the size of the module.
+  if (only_funcs) {
+    return LiftOutcome::kComplete;
+  }
+  std::unordered_set<llvm::Function *> module_funcs;
+  for (auto &func : *module) {
+    module_funcs.insert(&func);
+  }
+  for (auto it = cached_funcs->begin(); it != cached_funcs->end();) {
+    if (module_funcs.count(it->first)) {
+      ++it;
+    } else {
+      it = cached_funcs->erase(it);
+    }
+  }
+  return LiftOutcome::kComplete;
+}
+
+// Analyze a module, discover aliasing loads and stores, and remove dead
+// stores into the `State` structure.
+LiftOutcome RemoveDeadStores(const remill::Arch *arch, llvm::Module *module,
+                            llvm::Function *bb_func,
+                            const std::vector<StateSlot> &slots,
+                            llvm::Function *ds_func,
+                            LiftStatistics *lift_stats,
+                            const LiftInterrupt *interrupt) {
+  const llvm::DataLayout dl(module);
+  LiveSetPool live_sets(NumSlots(slots));
+  if (ds_func) {
+    const std::vector<llvm::Function *> only_funcs = {ds_func};
+    return EliminateDeadStores(arch, module, bb_func, slots, dl, live_sets,
+                               &only_funcs, lift_stats, nullptr, interrupt);
+  } else {
+    return EliminateDeadStores(arch, module, bb_func, slots, dl, live_sets,
+                               nullptr, lift_stats, nullptr, interrupt);
+  }
+}
+
+// Like above, but reuses and updates the analyses in `cache`.
+LiftOutcome RemoveDeadStores(const remill::Arch *arch, llvm::Module *module,
+                            llvm::Function *bb_func,
+                            DeadStoreAnalysisCache &cache,
+                            llvm::Function *ds_func,
+                            LiftStatistics *lift_stats,
+                            const LiftInterrupt *interrupt) {
+  if (ds_func) {
+    const std::vector<llvm::Function *> only_funcs = {ds_func};
+    return RemoveDeadStores(arch, module, bb_func, cache, only_funcs,
+                            lift_stats, interrupt);
+  }
+  CHECK_EQ(cache.impl->arch, arch);
+  CHECK_EQ(cache.impl->module, module);
+  return EliminateDeadStores(arch, module, bb_func, cache.impl->slots,
+                             cache.impl->dl, cache.impl->live_sets, nullptr,
+                             lift_stats, &(cache.impl->funcs), interrupt);
+}
+
+namespace {
+
+static const char * const kStateReadsKind = "remill.state.reads";
+static const char * const kStateWritesKind = "remill.state.writes";
+
+// Returns the ranges in the metadata node `node`, or `false` if it's not a
+// valid list of ranges.
+static bool GetRanges(llvm::MDNode *node,
+                      std::vector<std::pair<uint64_t, uint64_t>> &ranges) {
+  if (!node || node->getNumOperands() % 2) {
+    return false;
+  }
+  for (auto i = 0u; i < node->getNumOperands(); i += 2) {
+    auto begin = llvm::mdconst::dyn_extract<llvm::ConstantInt>(
+        node->getOperand(i));
+    auto end = llvm::mdconst::dyn_extract<llvm::ConstantInt>(
+        node->getOperand(i + 1));
+    if (!begin || !end || begin->getZExtValue() > end->getZExtValue()) {
+      return false;
+    }
+    ranges.emplace_back(begin->getZExtValue(), end->getZExtValue());
+  }
+  return true;
+}
+
+static llvm::MDNode *
+GetRangesNode(llvm::LLVMContext &context,
+              const std::vector<std::pair<uint64_t, uint64_t>> &ranges) {
+  const auto i64_type = llvm::Type::getInt64Ty(context);
+  std::vector<llvm::Metadata *> ops;
+  for (auto [begin, end] : ranges) {
+    ops.push_back(
+        llvm::ConstantAsMetadata::get(llvm::ConstantInt::get(i64_type, begin)));
+    ops.push_back(
+        llvm::ConstantAsMetadata::get(llvm::ConstantInt::get(i64_type, end)));
+  }
+  return llvm::MDNode::get(context, ops);
+}
+
+}  // namespace
+
+// Returns the `State` slot summary attached to `func`, if any.
+std::optional<StateSlotSummary> GetStateSlotSummary(llvm::Function *func) {
+  StateSlotSummary summary;
+  if (!GetRanges(func->getMetadata(kStateReadsKind), summary.reads) ||
+      !GetRanges(func->getMetadata(kStateWritesKind), summary.writes)) {
+    return std::nullopt;
+  }
+  return summary;
+}
+
+// Attach `summary` to `func`, replacing any existing summary.
+void SetStateSlotSummary(llvm::Function *func,
+                         const StateSlotSummary &summary) {
+  auto &context = func->getContext();
+  func->setMetadata(kStateReadsKind, GetRangesNode(context, summary.reads));
+  func->setMetadata(kStateWritesKind, GetRangesNode(context, summary.writes));
+}
+
+// Remove the `State` slot summary from `func`.
+void ClearStateSlotSummary(llvm::Function *func) {
+  func->setMetadata(kStateReadsKind, nullptr);
+  func->setMetadata(kStateWritesKind, nullptr);
+}
+
+// Incrementally remove dead stores from only the functions `funcs`.
+LiftOutcome RemoveDeadStores(const remill::Arch *arch, llvm::Module *module,
+                            llvm::Function *bb_func,
+                            DeadStoreAnalysisCache &cache,
+                            const std::vector<llvm::Function *> &funcs,
+                            LiftStatistics *lift_stats,
+                            const LiftInterrupt *interrupt) {
+  CHECK_EQ(cache.impl->arch, arch);
+  CHECK_EQ(cache.impl->module, module);
+  return EliminateDeadStores(arch, module, bb_func, cache.impl->slots,
+                             cache.impl->dl, cache.impl->live_sets, &funcs,
+                             lift_stats, &(cache.impl->funcs), interrupt);
 }
 
 }  // namespace remill
@@ -0,0 +1,438 @@
+/*
+ * Copyright (c) 2020 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <glog/logging.h>
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/DerivedTypes.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
+#include <remill/BC/Disassembler.h>
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <unordered_set>
+#include <utility>
+
+#include "remill/Arch/Arch.h"
+#include "remill/Arch/CompactInstruction.h"
+#include "remill/Arch/InstructionCache.h"
+#include "remill/Arch/Name.h"
+#include "remill/BC/Util.h"
+
+namespace remill {
+namespace {
+
+// Linear sweeps over fixed-width instruction sets are split into units of at
+// most this many bytes, so that large ranges can be shared among workers.
+// Variable-width instruction sets can't be split without losing track of
+// instruction boundaries, so each range is its own unit.
+static constexpr uint64_t kMaxSweepUnitSize = 64 * 1024;
+
+// Number of instructions decoded per call to `Arch::DecodeInstructions`.
+static constexpr size_t kDecodeBatchSize = 64;
+
+static DisassembledInstruction Summarize(const Instruction &inst) {
+  DisassembledInstruction summary = {};
+  summary.pc = inst.pc;
+  summary.branch_taken_pc = inst.branch_taken_pc;
+  summary.branch_not_taken_pc = inst.branch_not_taken_pc;
+  summary.size = static_cast<uint32_t>(inst.bytes.size());
+  summary.category = inst.category;
+  return summary;
+}
+
+// Bytes `[begin, end)` of `range` that are swept by a single worker.
+struct SweepUnit {
+  const ExecutableRange *range;
+  uint64_t begin;
+  uint64_t end;
+};
+
+// The instructions found by sweeping one `SweepUnit` on a worker thread.
+struct SweepResult {
+  std::vector<DisassembledInstruction> summaries;
+
+  // Compacted forms of the decoded instructions, which still refer to the
+  // registers and constants of the worker's `Arch`.
+  std::vector<CompactInstruction> insts;
+
+  // Addresses of decoded instructions that couldn't be compacted.
+  std::vector<uint64_t> uncompacted_pcs;
+};
+
+// A worker thread's own copy of the architecture.
+struct SweepWorker {
+  std::unique_ptr<llvm::LLVMContext> context;
+  Arch::ArchPtr arch;
+};
+
+// Decode the instructions of `unit` one after the other, calling `callback`
+// with each. Instructions decoded as delay slots are summarized, but not
+// cached, as the cache is also used for non-delayed decoding.
+static void Sweep(const Arch *arch, const SweepUnit &unit,
+                  std::vector<Instruction> &insts,
+                  const std::function<void(const Instruction &)> &callback) {
+  const auto align = arch->MinInstructionAlign();
+  const auto &range = *unit.range;
+  auto offset = unit.begin;
+  while (offset < unit.end) {
+    const auto num_insts = arch->DecodeInstructions(
+        range.address + offset, range.bytes.substr(offset, unit.end - offset),
+        insts, kDecodeBatchSize);
+
+    for (const auto &inst : insts) {
+      callback(inst);
+      offset += inst.bytes.size();
+    }
+
+    // Decoding stopped early, so the bytes at `offset` can't be decoded.
+    if (num_insts < kDecodeBatchSize && offset < unit.end) {
+      offset += align;
+    }
+  }
+}
+
+// Sweep units on a worker thread until none are left.
+static void SweepOnWorker(const Arch *main_arch, bool keep_insts,
+                          const std::vector<SweepUnit> &units,
+                          std::atomic<size_t> &next_unit,
+                          std::vector<SweepResult> &results,
+                          SweepWorker &worker) {
+  worker.context.reset(new llvm::LLVMContext);
+  worker.arch = Arch::Build(worker.context.get(), main_arch->os_name,
+                            main_arch->arch_name);
+  worker.arch->InitWithoutSemanticsModule();
+
+  std::vector<Instruction> insts;
+  for (auto i = next_unit.fetch_add(1); i < units.size();
+       i = next_unit.fetch_add(1)) {
+    auto &result = results[i];
+    Sweep(worker.arch.get(), units[i], insts,
+          [&result, keep_insts](const Instruction &inst) {
+            result.summaries.push_back(Summarize(inst));
+            if (!keep_insts || inst.in_delay_slot) {
+              return;
+            }
+            result.insts.emplace_back();
+            if (!result.insts.back().Compact(inst)) {
+              result.insts.pop_back();
+              result.uncompacted_pcs.push_back(inst.pc);
+            }
+          });
+  }
+}
+
+static llvm::Type *RetargetType(llvm::Type *type, llvm::LLVMContext &context) {
+  if (auto int_type = llvm::dyn_cast_or_null<llvm::IntegerType>(type)) {
+    return llvm::IntegerType::get(context, int_type->getBitWidth());
+  }
+  return nullptr;
+}
+
+// Make `inst`, decoded by another copy of `arch`, refer to the registers and
+// constants of `arch`. Returns `false` if it can't be re-targeted, in which
+// case the instruction must be decoded again.
+static bool Retarget(CompactInstruction &inst, const Arch *arch) {
+  auto &context = *arch->context;
+
+  // Copies of the same architecture number their registers identically, so
+  // try the register with the same index first.
+  auto retarget_reg = [arch](const Register *reg) -> const Register * {
+    if (auto same = arch->RegisterById(reg->index);
+        same && same->name == reg->name) {
+      return same;
+    }
+    return arch->RegisterByName(reg->name);
+  };
+
+  inst.arch = arch;
+  if (inst.segment_override) {
+    inst.segment_override = retarget_reg(inst.segment_override);
+    if (!inst.segment_override) {
+      return false;
+    }
+  }
+
+  for (auto i = 0u; i < inst.num_exprs; ++i) {
+    auto &expr = inst.exprs[i];
+    switch (expr.kind) {
+      case CompactExpression::kRegister:
+        expr.reg = retarget_reg(expr.reg);
+        if (!expr.reg) {
+          return false;
+        }
+        expr.type = expr.reg->type;
+        break;
+
+      case CompactExpression::kConstant:
+        if (auto ci = llvm::dyn_cast<llvm::ConstantInt>(expr.constant)) {
+          expr.constant = llvm::ConstantInt::get(context, ci->getValue());
+          expr.type = expr.constant->getType();
+        } else {
+          return false;
+        }
+        break;
+
+      case CompactExpression::kLLVMOp:
+      case CompactExpression::kVariable:
+        expr.type = RetargetType(expr.type, context);
+        if (!expr.type) {
+          return false;
+        }
+        break;
+
+      case CompactExpression::kInvalid: return false;
+    }
+  }
+  return true;
+}
+
+// Add the addresses of the instructions that can execute after `inst` to
+// `work_list`. This mirrors how the `TraceLifter` follows control flow.
+static void AddSuccessors(const Instruction &inst,
+                          std::vector<uint64_t> &work_list) {
+  switch (inst.category) {
+    case Instruction::kCategoryInvalid:
+    case Instruction::kCategoryError:
+    case Instruction::kCategoryIndirectJump:
+    case Instruction::kCategoryFunctionReturn: break;
+
+    case Instruction::kCategoryNormal:
+    case Instruction::kCategoryNoOp:
+    case Instruction::kCategoryAsyncHyperCall:
+    case Instruction::kCategoryConditionalAsyncHyperCall:
+      work_list.push_back(inst.next_pc);
+      break;
+
+    case Instruction::kCategoryDirectJump:
+      work_list.push_back(inst.branch_taken_pc);
+      break;
+
+    case Instruction::kCategoryIndirectFunctionCall:
+    case Instruction::kCategoryConditionalIndirectFunctionCall:
+    case Instruction::kCategoryConditionalIndirectJump:
+    case Instruction::kCategoryConditionalFunctionReturn:
+      work_list.push_back(inst.branch_not_taken_pc);
+      break;
+
+    case Instruction::kCategoryDirectFunctionCall:
+    case Instruction::kCategoryConditionalDirectFunctionCall:
+    case Instruction::kCategoryConditionalBranch:
+      work_list.push_back(inst.branch_taken_pc);
+      work_list.push_back(inst.branch_not_taken_pc);
+      break;
+  }
+}
+
+static void SortIndex(DisassemblyIndex &index) {
+  auto &insts = index.instructions;
+  std::sort(insts.begin(), insts.end(),
+            [](const DisassembledInstruction &a,
+               const DisassembledInstruction &b) { return a.pc < b.pc; });
+  insts.erase(std::unique(insts.begin(), insts.end(),
+                          [](const DisassembledInstruction &a,
+                             const DisassembledInstruction &b) {
+                            return a.pc == b.pc;
+                          }),
+              insts.end());
+}
+
+}  // namespace
+
+// Returns the instruction starting at `pc`, or `nullptr` if there is none.
+const DisassembledInstruction *DisassemblyIndex::Find(uint64_t pc) const {
+  auto it = std::lower_bound(
+      instructions.begin(), instructions.end(), pc,
+      [](const DisassembledInstruction &inst, uint64_t addr) {
+        return inst.pc < addr;
+      });
+  if (it == instructions.end() || it->pc != pc) {
+    return nullptr;
+  }
+  return &*it;
+}
+
+Disassembler::Disassembler(const Arch *arch_, InstructionCache *cache_,
+                           unsigned num_workers_)
+    : arch(arch_),
+      cache(cache_),
+      num_workers(num_workers_
+                      ? num_workers_
+                      : std::max(1u, std::thread::hardware_concurrency())) {}
+
+// Decode every instruction in `ranges`, one after the other.
+DisassemblyIndex
+Disassembler::LinearSweep(const std::vector<ExecutableRange> &ranges) {
+  const auto unit_size =
+      arch->MinInstructionAlign() == 1 ? UINT64_MAX : kMaxSweepUnitSize;
+
+  std::vector<SweepUnit> units;
+  for (const auto &range : ranges) {
+    for (uint64_t begin = 0; begin < range.bytes.size();) {
+      const auto end =
+          begin + std::min<uint64_t>(unit_size, range.bytes.size() - begin);
+      units.push_back({&range, begin, end});
+      begin = end;
+    }
+  }
+
+  DisassemblyIndex index;
+
+  // Sweep everything on this thread, with the caller's `arch`.
+  if (num_workers <= 1 || units.size() <= 1) {
+    std::vector<Instruction> insts;
+    for (const auto &unit : units) {
+      Sweep(arch, unit, insts, [&index, this](const Instruction &inst) {
+        index.instructions.push_back(Summarize(inst));
+        if (cache && !inst.in_delay_slot) {
+          cache->AddInstruction(arch, inst.pc, inst);
+        }
+      });
+    }
+    SortIndex(index);
+    return index;
+  }
+
+  const auto num_threads =
+      static_cast<unsigned>(std::min<size_t>(num_workers, units.size()));
+  std::vector<SweepResult> results(units.size());
+  std::vector<SweepWorker> sweep_workers(num_threads);
+  std::vector<std::thread> threads;
+  std::atomic<size_t> next_unit(0);
+
+  threads.reserve(num_threads);
+  for (auto i = 0u; i < num_threads; ++i) {
+    threads.emplace_back(SweepOnWorker, arch, cache != nullptr,
+                         std::cref(units), std::ref(next_unit),
+                         std::ref(results), std::ref(sweep_workers[i]));
+  }
+
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  // Move the decoded instructions over to `arch`. This needs the workers'
+  // contexts to still be alive.
+  Instruction inst;
+  for (size_t i = 0; i < units.size(); ++i) {
+    auto &result = results[i];
+    index.instructions.insert(index.instructions.end(),
+                              result.summaries.begin(), result.summaries.end());
+    if (!cache) {
+      continue;
+    }
+
+    const auto &unit = units[i];
+    auto redecode = [&](uint64_t pc) {
+      const auto offset = pc - unit.range->address;
+      const auto size =
+          std::min<uint64_t>(arch->MaxInstructionSize(), unit.end - offset);
+      inst.Reset();
+      if (arch->DecodeInstruction(pc, unit.range->bytes.substr(offset, size),
+                                  inst)) {
+        cache->AddInstruction(arch, pc, inst);
+      }
+    };
+
+    for (auto &cinst : result.insts) {
+      if (Retarget(cinst, arch)) {
+        cinst.Expand(inst);
+        cache->AddInstruction(arch, inst.pc, inst);
+      } else {
+        redecode(cinst.pc);
+      }
+    }
+
+    for (auto pc : result.uncompacted_pcs) {
+      redecode(pc);
+    }
+  }
+
+  SortIndex(index);
+  return index;
+}
+
+// Decode the instructions in `ranges` that are reachable from `roots`.
+DisassemblyIndex
+Disassembler::RecursiveDescent(const std::vector<ExecutableRange> &ranges_,
+                               const std::vector<uint64_t> &roots) {
+  std::vector<ExecutableRange> ranges(ranges_);
+  std::sort(ranges.begin(), ranges.end(),
+            [](const ExecutableRange &a, const ExecutableRange &b) {
+              return a.address < b.address;
+            });
+
+  // Find the bytes starting at `pc`, up to the end of the enclosing range.
+  auto read_bytes = [&ranges, this](uint64_t pc) -> std::string_view {
+    auto it = std::upper_bound(
+        ranges.begin(), ranges.end(), pc,
+        [](uint64_t addr, const ExecutableRange &range) {
+          return addr < range.address;
+        });
+    if (it == ranges.begin()) {
+      return {};
+    }
+    --it;
+    const auto offset = pc - it->address;
+    if (offset >= it->bytes.size()) {
+      return {};
+    }
+    return it->bytes.substr(offset, arch->MaxInstructionSize());
+  };
+
+  DisassemblyIndex index;
+  Instruction inst;
+  std::unordered_set<uint64_t> seen;
+  std::vector<uint64_t> work_list(roots.rbegin(), roots.rend());
+
+  auto decode = [&](uint64_t pc) {
+    const auto bytes = read_bytes(pc);
+    inst.Reset();
+    if (bytes.empty() || !arch->DecodeInstruction(pc, bytes, inst)) {
+      return false;
+    }
+    index.instructions.push_back(Summarize(inst));
+    if (cache) {
+      cache->AddInstruction(arch, pc, inst);
+    }
+    return true;
+  };
+
+  while (!work_list.empty()) {
+    const auto pc = work_list.back();
+    work_list.pop_back();
+    if (!seen.insert(pc).second || !decode(pc)) {
+      continue;
+    }
+
+    AddSuccessors(inst, work_list);
+
+    // Delay slots are decoded, but not followed, as their fall-through isn't
+    // necessarily reachable. They are followed if they're also reached some
+    // other way.
+    if (arch->MayHaveDelaySlot(inst) && !seen.count(inst.delayed_pc)) {
+      decode(inst.delayed_pc);
+    }
+  }
+
+  SortIndex(index);
+  return index;
+}
+
+}  // namespace remill
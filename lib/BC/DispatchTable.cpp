@@ -0,0 +1,165 @@
+/*
+ * Copyright (c) 2020 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "remill/BC/DispatchTable.h"
+
+#include <glog/logging.h>
+#include <llvm/IR/BasicBlock.h>
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/DerivedTypes.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/GlobalVariable.h>
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/Intrinsics.h>
+#include <llvm/IR/Module.h>
+
+#include <algorithm>
+
+#include "remill/BC/ABI.h"
+#include "remill/BC/Util.h"
+
+namespace remill {
+namespace {
+
+// Place the entries of `sorted`, starting at `next`, into the subtree of
+// `tree` rooted at `k`.
+static void FillEytzinger(
+    const std::vector<std::pair<uint64_t, llvm::Function *>> &sorted,
+    size_t &next, size_t k,
+    std::vector<std::pair<uint64_t, llvm::Function *>> &tree) {
+  if (k < tree.size()) {
+    FillEytzinger(sorted, next, 2 * k, tree);
+    tree[k] = sorted[next++];
+    FillEytzinger(sorted, next, 2 * k + 1, tree);
+  }
+}
+
+// Define a constant array of `elems` named `name` in `module`.
+static llvm::GlobalVariable *
+DefineConstantArray(llvm::Module *module, llvm::Type *elem_type,
+                    const std::vector<llvm::Constant *> &elems,
+                    const char *name) {
+  const auto type = llvm::ArrayType::get(elem_type, elems.size());
+  return new llvm::GlobalVariable(
+      *module, type, true, llvm::GlobalValue::ExternalLinkage,
+      llvm::ConstantArray::get(type, elems), name);
+}
+
+}  // namespace
+
+// Add a constant table that maps the entry addresses of `traces` to their
+// lifted functions to `module`, along with a function that looks them up.
+llvm::Function *AddDispatchTable(
+    llvm::Module *module,
+    const std::vector<std::pair<uint64_t, llvm::Function *>> &traces) {
+  if (traces.empty()) {
+    return nullptr;
+  }
+
+  auto sorted = traces;
+  std::sort(sorted.begin(), sorted.end(),
+            [](const auto &a, const auto &b) { return a.first < b.first; });
+  sorted.erase(std::unique(sorted.begin(), sorted.end(),
+                           [](const auto &a, const auto &b) {
+                             return a.first == b.first;
+                           }),
+               sorted.end());
+
+  const auto func_type = sorted.front().second->getFunctionType();
+  const auto func_ptr_type = llvm::PointerType::getUnqual(func_type);
+  const auto pc_type =
+      llvm::cast<llvm::IntegerType>(func_type->getParamType(kPCArgNum));
+
+  std::vector<std::pair<uint64_t, llvm::Function *>> tree(sorted.size() + 1);
+  size_t next = 0;
+  FillEytzinger(sorted, next, 1, tree);
+
+  std::vector<llvm::Constant *> pcs;
+  std::vector<llvm::Constant *> funcs;
+  pcs.push_back(llvm::ConstantInt::get(pc_type, 0));
+  funcs.push_back(llvm::ConstantPointerNull::get(func_ptr_type));
+  for (size_t k = 1; k < tree.size(); ++k) {
+    const auto [pc, func] = tree[k];
+    CHECK(func->getFunctionType() == func_type)
+        << "Trace " << func->getName().str()
+        << " doesn't have the type of a lifted function";
+    pcs.push_back(llvm::ConstantInt::get(pc_type, pc));
+    funcs.push_back(llvm::ConstantExpr::getBitCast(func, func_ptr_type));
+  }
+
+  const auto pcs_var =
+      DefineConstantArray(module, pc_type, pcs, kDispatchTablePCsName);
+  const auto funcs_var = DefineConstantArray(module, func_ptr_type, funcs,
+                                             kDispatchTableTracesName);
+
+  auto &context = module->getContext();
+  const auto index_type = llvm::Type::getInt64Ty(context);
+  const auto size = llvm::ConstantInt::get(index_type, sorted.size());
+  new llvm::GlobalVariable(*module, index_type, true,
+                           llvm::GlobalValue::ExternalLinkage, size,
+                           kDispatchTableSizeName);
+
+  const auto lookup = llvm::Function::Create(
+      llvm::FunctionType::get(func_ptr_type, {pc_type}, false),
+      llvm::GlobalValue::ExternalLinkage, kDispatchLookupName, module);
+  lookup->addFnAttr(llvm::Attribute::NoUnwind);
+  const auto pc = NthArgument(lookup, 0);
+
+  const auto entry = llvm::BasicBlock::Create(context, "", lookup);
+  const auto loop = llvm::BasicBlock::Create(context, "", lookup);
+  const auto body = llvm::BasicBlock::Create(context, "", lookup);
+  const auto done = llvm::BasicBlock::Create(context, "", lookup);
+
+  llvm::IRBuilder<> ir(entry);
+  ir.CreateBr(loop);
+
+  // Descend the tree, going right when the key is less than `pc`.
+  ir.SetInsertPoint(loop);
+  const auto k = ir.CreatePHI(index_type, 2);
+  k->addIncoming(llvm::ConstantInt::get(index_type, 1), entry);
+  ir.CreateCondBr(ir.CreateICmpULE(k, size), body, done);
+
+  ir.SetInsertPoint(body);
+  const auto key = ir.CreateLoad(
+      pc_type, ir.CreateInBoundsGEP(pcs_var->getValueType(), pcs_var,
+                                    {ir.getInt64(0), k}));
+  const auto right = ir.CreateZExt(ir.CreateICmpULT(key, pc), index_type);
+  k->addIncoming(ir.CreateAdd(ir.CreateShl(k, 1), right), body);
+  ir.CreateBr(loop);
+
+  // Undo the right turns taken below the last left turn, which was at the
+  // lower bound of `pc`. This is entry zero if there were no left turns.
+  ir.SetInsertPoint(done);
+  const auto cttz = llvm::Intrinsic::getDeclaration(
+      module, llvm::Intrinsic::cttz, {index_type});
+  const auto num_rights = ir.CreateCall(cttz, {ir.CreateNot(k), ir.getFalse()});
+  const auto found =
+      ir.CreateLShr(k, ir.CreateAdd(num_rights, ir.getInt64(1)));
+  const auto found_pc = ir.CreateLoad(
+      pc_type, ir.CreateInBoundsGEP(pcs_var->getValueType(), pcs_var,
+                                    {ir.getInt64(0), found}));
+  const auto found_func = ir.CreateLoad(
+      func_ptr_type,
+      ir.CreateInBoundsGEP(funcs_var->getValueType(), funcs_var,
+                           {ir.getInt64(0), found}));
+  ir.CreateRet(ir.CreateSelect(ir.CreateICmpEQ(found_pc, pc), found_func,
+                               llvm::ConstantPointerNull::get(func_ptr_type)));
+
+  return lookup;
+}
+
+}  // namespace remill
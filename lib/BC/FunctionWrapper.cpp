@@ -0,0 +1,164 @@
+/*
+ * Copyright (c) 2020 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "remill/BC/FunctionWrapper.h"
+
+#include <glog/logging.h>
+#include <llvm/IR/BasicBlock.h>
+#include <llvm/IR/DataLayout.h>
+#include <llvm/IR/DerivedTypes.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Transforms/Utils/Cloning.h>
+
+#include <unordered_set>
+#include <utility>
+
+#include "remill/Arch/Arch.h"
+#include "remill/BC/ABI.h"
+#include "remill/BC/Compat/Cloning.h"
+#include "remill/BC/StateEscape.h"
+#include "remill/BC/Util.h"
+#include "remill/BC/Version.h"
+
+namespace remill {
+namespace {
+
+// Returns a pointer to the byte at `offset` in the structure at `ptr`.
+static llvm::Value *BytePointer(llvm::IRBuilder<> &ir, llvm::Value *ptr,
+                                uint64_t offset) {
+  const auto byte_ptr = ir.CreateBitCast(ptr, ir.getInt8PtrTy());
+  return ir.CreateConstInBoundsGEP1_64(ir.getInt8Ty(), byte_ptr, offset);
+}
+
+// Copy `size` bytes at `offset` from the structure at `src` to the structure
+// at `dst`.
+static void CopyBytes(llvm::IRBuilder<> &ir, llvm::Value *dst,
+                      llvm::Value *src, uint64_t offset, uint64_t size) {
+  const auto dst_ptr = BytePointer(ir, dst, offset);
+  const auto src_ptr = BytePointer(ir, src, offset);
+#if LLVM_VERSION_NUMBER >= LLVM_VERSION(10, 0)
+  ir.CreateMemCpy(dst_ptr, llvm::MaybeAlign(1), src_ptr, llvm::MaybeAlign(1),
+                  size);
+#else
+  ir.CreateMemCpy(dst_ptr, 1, src_ptr, 1, size);
+#endif
+}
+
+// Returns the first call in `func` to a trace of `traces` that hasn't yet
+// been inlined.
+static llvm::CallInst *
+FindTraceCall(llvm::Function *func,
+              const std::unordered_set<llvm::Function *> &traces,
+              const std::unordered_set<llvm::Function *> &inlined) {
+  for (auto &block : *func) {
+    for (auto &inst : block) {
+      if (auto call = llvm::dyn_cast<llvm::CallInst>(&inst)) {
+        if (auto callee = call->getCalledFunction();
+            callee && traces.count(callee) && !inlined.count(callee)) {
+          return call;
+        }
+      }
+    }
+  }
+  return nullptr;
+}
+
+}  // namespace
+
+// Create a function named `name` that runs the traces `traces` on a private
+// copy of the `State` structure.
+llvm::Function *
+CreateFunctionWrapper(const Arch *arch,
+                      const std::vector<llvm::Function *> &traces,
+                      const FunctionABI &abi, std::string_view name) {
+  if (traces.empty()) {
+    return nullptr;
+  }
+
+  // The ranges of `State` that are written back on return.
+  std::vector<std::pair<uint64_t, uint64_t>> live_out;
+  for (auto reg_name : {arch->ProgramCounterRegisterName(),
+                        arch->StackPointerRegisterName()}) {
+    const auto reg = arch->RegisterByName(reg_name);
+    CHECK(reg != nullptr) << "Unknown register " << reg_name;
+    live_out.emplace_back(reg->offset, reg->size);
+  }
+  for (const auto &reg_name : abi.live_out_registers) {
+    const auto reg = arch->RegisterByName(reg_name);
+    if (!reg) {
+      LOG(ERROR) << "Unknown live-out register " << reg_name;
+      return nullptr;
+    }
+    live_out.emplace_back(reg->offset, reg->size);
+  }
+
+  const auto entry_trace = traces.front();
+  const auto module = entry_trace->getParent();
+  const auto state_type = arch->StateStructType();
+  const auto state_size =
+      module->getDataLayout().getTypeAllocSize(state_type);
+
+  auto func = llvm::Function::Create(
+      arch->LiftedFunctionType(), llvm::GlobalValue::ExternalLinkage,
+      std::string(name), module);
+  func->setAttributes(entry_trace->getAttributes());
+
+  const auto state = NthArgument(func, kStatePointerArgNum);
+  const auto pc = NthArgument(func, kPCArgNum);
+  const auto memory = NthArgument(func, kMemoryPointerArgNum);
+
+  auto &context = module->getContext();
+  const auto block = llvm::BasicBlock::Create(context, "", func);
+  llvm::IRBuilder<> ir(block);
+  const auto local_state =
+      ir.CreateAlloca(state_type, nullptr, "local_state");
+  CopyBytes(ir, local_state, state, 0, state_size);
+  const auto call = ir.CreateCall(entry_trace, {local_state, pc, memory});
+  for (auto [offset, size] : live_out) {
+    CopyBytes(ir, state, local_state, offset, size);
+  }
+  ir.CreateRet(call);
+
+  // Inline each trace once. The traces are passed the private `State`
+  // structure, and so their code now accesses it instead of `State`.
+  std::unordered_set<llvm::Function *> trace_funcs(traces.begin(),
+                                                   traces.end());
+  std::unordered_set<llvm::Function *> inlined;
+  while (auto trace_call = FindTraceCall(func, trace_funcs, inlined)) {
+    inlined.insert(trace_call->getCalledFunction());
+    llvm::InlineFunctionInfo info;
+#if LLVM_VERSION_NUMBER >= LLVM_VERSION(11, 0)
+    const auto ok = llvm::InlineFunction(trace_call, info).isSuccess();
+#else
+    const auto ok = static_cast<bool>(llvm::InlineFunction(trace_call, info));
+#endif
+    if (!ok) {
+      LOG(ERROR) << "Unable to inline trace "
+                 << trace_call->getCalledFunction()->getName().str()
+                 << " into " << func->getName().str();
+    }
+  }
+
+  // Spill the private `State` structure around the calls that remain, and
+  // pass them `State`.
+  PrivatizeState(local_state, {}, state);
+  return func;
+}
+
+}  // namespace remill
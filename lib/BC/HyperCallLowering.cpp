@@ -0,0 +1,184 @@
+/*
+ * Copyright (c) 2020 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "remill/BC/HyperCallLowering.h"
+
+#include <glog/logging.h>
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/Intrinsics.h>
+#include <llvm/IR/Module.h>
+
+#include <string_view>
+#include <vector>
+
+#include "remill/Arch/Arch.h"
+#include "remill/Arch/Runtime/HyperCall.h"
+
+namespace remill {
+namespace {
+
+// Reads and writes the 32-bit general purpose registers of the `State`
+// structure at `state_ptr`.
+class RegisterAccessor {
+ public:
+  RegisterAccessor(const Arch *arch_, llvm::IRBuilder<> &ir_,
+                   llvm::Value *state_ptr_)
+      : arch(arch_),
+        ir(ir_),
+        state_ptr(state_ptr_) {}
+
+  // Returns the value of the 32-bit register `name`, e.g. `EAX`.
+  llvm::Value *Read(std::string_view name) {
+    const auto reg = arch->RegisterByName(name);
+    CHECK(reg != nullptr) << "Unknown register " << name;
+    return ir.CreateLoad(reg->type, reg->AddressOf(state_ptr, ir));
+  }
+
+  // Writes `val` to the 32-bit register `name`, e.g. `EAX`. On AMD64, this
+  // zeroes the upper half of the enclosing 64-bit register.
+  void Write(std::string_view name, llvm::Value *val) {
+    auto reg = arch->RegisterByName(name);
+    CHECK(reg != nullptr) << "Unknown register " << name;
+    if (arch->IsAMD64()) {
+      reg = reg->EnclosingRegisterOfSize(8);
+      CHECK(reg != nullptr) << "No 64-bit register encloses " << name;
+    }
+    ir.CreateStore(ir.CreateZExtOrTrunc(val, reg->type),
+                   reg->AddressOf(state_ptr, ir));
+  }
+
+ private:
+  const Arch *const arch;
+  llvm::IRBuilder<> &ir;
+  llvm::Value *const state_ptr;
+};
+
+// Replace `RDTSC` or `RDTSCP` with a read of the host's cycle counter.
+static void LowerReadTSC(const SyncHyperCallLowering &lowering,
+                         RegisterAccessor &regs, llvm::IRBuilder<> &ir,
+                         bool is_rdtscp) {
+  const auto module = ir.GetInsertBlock()->getModule();
+  const auto read_cycle_counter = llvm::Intrinsic::getDeclaration(
+      module, llvm::Intrinsic::readcyclecounter);
+  const auto tsc = ir.CreateCall(read_cycle_counter);
+  const auto i32 = ir.getInt32Ty();
+  regs.Write("EAX", ir.CreateTrunc(tsc, i32));
+  regs.Write("EDX", ir.CreateTrunc(ir.CreateLShr(tsc, 32), i32));
+  if (is_rdtscp) {
+    regs.Write("ECX", ir.getInt32(lowering.tsc_aux));
+  }
+}
+
+// Replace `CPUID` with a lookup in the table of `lowering`.
+static void LowerCPUID(const SyncHyperCallLowering &lowering,
+                       RegisterAccessor &regs, llvm::IRBuilder<> &ir) {
+  const auto leaf = regs.Read("EAX");
+  const auto sub_leaf = regs.Read("ECX");
+
+  llvm::Value *vals[4] = {ir.getInt32(0), ir.getInt32(0), ir.getInt32(0),
+                          ir.getInt32(0)};
+
+  // The entries of specific sub-leaves are selected last, so that they take
+  // precedence over those of any sub-leaf.
+  for (auto any_sub_leaf : {true, false}) {
+    for (const auto &[key, entry] : lowering.cpuid) {
+      const auto [entry_leaf, entry_sub_leaf] = key;
+      if (any_sub_leaf !=
+          (entry_sub_leaf == SyncHyperCallLowering::kAnySubLeaf)) {
+        continue;
+      }
+
+      auto matches = ir.CreateICmpEQ(leaf, ir.getInt32(entry_leaf));
+      if (!any_sub_leaf) {
+        matches = ir.CreateAnd(
+            matches, ir.CreateICmpEQ(sub_leaf, ir.getInt32(entry_sub_leaf)));
+      }
+
+      const uint32_t entry_vals[4] = {entry.eax, entry.ebx, entry.ecx,
+                                      entry.edx};
+      for (auto i = 0u; i < 4u; ++i) {
+        vals[i] = ir.CreateSelect(matches, ir.getInt32(entry_vals[i]),
+                                  vals[i]);
+      }
+    }
+  }
+
+  regs.Write("EAX", vals[0]);
+  regs.Write("EBX", vals[1]);
+  regs.Write("ECX", vals[2]);
+  regs.Write("EDX", vals[3]);
+}
+
+}  // namespace
+
+// Replace the calls in `module` to `__remill_sync_hyper_call` with the hyper
+// calls selected by `lowering` with inline code.
+uint64_t LowerSyncHyperCalls(const Arch *arch, llvm::Module *module,
+                             const SyncHyperCallLowering &lowering) {
+  const auto hyper_call = module->getFunction("__remill_sync_hyper_call");
+  if (!hyper_call || !(arch->IsX86() || arch->IsAMD64())) {
+    return 0;
+  }
+
+  std::vector<std::pair<llvm::CallInst *, SyncHyperCall::Name>> calls;
+  for (auto user : hyper_call->users()) {
+    const auto call = llvm::dyn_cast<llvm::CallInst>(user);
+    if (!call || call->getCalledFunction() != hyper_call ||
+        call->arg_size() != 3) {
+      continue;
+    }
+    const auto name = llvm::dyn_cast<llvm::ConstantInt>(call->getArgOperand(2));
+    if (!name) {
+      continue;
+    }
+    switch (const auto id = static_cast<SyncHyperCall::Name>(
+                name->getZExtValue())) {
+      case SyncHyperCall::kX86ReadTSC:
+      case SyncHyperCall::kX86ReadTSCP:
+        if (lowering.read_tsc) {
+          calls.emplace_back(call, id);
+        }
+        break;
+      case SyncHyperCall::kX86CPUID:
+        if (!lowering.cpuid.empty()) {
+          calls.emplace_back(call, id);
+        }
+        break;
+      default: break;
+    }
+  }
+
+  for (auto [call, id] : calls) {
+    llvm::IRBuilder<> ir(call);
+    RegisterAccessor regs(arch, ir, call->getArgOperand(0));
+    if (id == SyncHyperCall::kX86CPUID) {
+      LowerCPUID(lowering, regs, ir);
+    } else {
+      LowerReadTSC(lowering, regs, ir, id == SyncHyperCall::kX86ReadTSCP);
+    }
+
+    // The hyper call returns the memory pointer that it's given.
+    call->replaceAllUsesWith(call->getArgOperand(1));
+    call->eraseFromParent();
+  }
+
+  return calls.size();
+}
+
+}  // namespace remill
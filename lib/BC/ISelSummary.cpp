@@ -0,0 +1,359 @@
+/*
+ * Copyright (c) 2020 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "remill/BC/ISelSummary.h"
+
+#include <glog/logging.h>
+#include <llvm/Analysis/ValueTracking.h>
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/DataLayout.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/GlobalVariable.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/IntrinsicInst.h>
+#include <llvm/IR/Metadata.h>
+#include <llvm/IR/Module.h>
+#include <llvm/IR/Operator.h>
+
+#include <algorithm>
+#include <map>
+
+#include "remill/BC/Util.h"
+
+namespace remill {
+namespace {
+
+static const char * const kISelFlagsKind = "remill.isel.flags";
+static const char * const kISelStateReadsKind = "remill.isel.state.reads";
+static const char * const kISelStateWritesKind = "remill.isel.state.writes";
+static const char * const kISelArgReadsKind = "remill.isel.arg.reads";
+static const char * const kISelArgWritesKind = "remill.isel.arg.writes";
+
+// The argument number of the `State` structure in a semantics function.
+static constexpr unsigned kSemanticsStateArgNum = 1;
+
+// Summarizes the accesses of one semantics function.
+class SemanticsSummarizer {
+ public:
+  explicit SemanticsSummarizer(llvm::Function *sem_)
+      : sem(sem_),
+        dl(sem->getParent()->getDataLayout()) {}
+
+  ISelSummary Summarize(void);
+
+ private:
+  // Record a read or a write of `size` bytes at `ptr`.
+  void AddAccess(llvm::Value *ptr, uint64_t size, bool is_write);
+
+  // Record that `ptr` is passed to a call that may read and write any of
+  // the object that it points into.
+  void AddEscape(llvm::Value *ptr);
+
+  void VisitCall(llvm::CallBase *call);
+
+  llvm::Function *const sem;
+  const llvm::DataLayout &dl;
+
+  ISelSummary summary;
+
+  // Byte ranges read and written through each argument, by argument number.
+  std::map<unsigned, uint64_t> arg_reads;
+  std::map<unsigned, uint64_t> arg_writes;
+};
+
+// Returns the value that `ptr` points into, and the constant offset of `ptr`
+// from it, if known.
+static std::pair<llvm::Value *, std::optional<int64_t>>
+FindPointerBase(llvm::Value *ptr, const llvm::DataLayout &dl) {
+  int64_t offset = 0;
+  auto base = llvm::GetPointerBaseWithConstantOffset(ptr, offset, dl);
+  std::optional<int64_t> known_offset = offset;
+  while (auto gep = llvm::dyn_cast<llvm::GEPOperator>(base)) {
+    known_offset.reset();
+    base = llvm::GetPointerBaseWithConstantOffset(gep->getPointerOperand(),
+                                                  offset, dl);
+  }
+  return {base, known_offset};
+}
+
+// Merge the overlapping and adjacent ranges of `ranges`.
+static void
+MergeRanges(std::vector<std::pair<uint64_t, uint64_t>> &ranges) {
+  std::sort(ranges.begin(), ranges.end());
+  std::vector<std::pair<uint64_t, uint64_t>> merged;
+  for (auto [begin, end] : ranges) {
+    if (!merged.empty() && begin <= merged.back().second) {
+      merged.back().second = std::max(merged.back().second, end);
+    } else {
+      merged.emplace_back(begin, end);
+    }
+  }
+  ranges.swap(merged);
+}
+
+void SemanticsSummarizer::AddAccess(llvm::Value *ptr, uint64_t size,
+                                    bool is_write) {
+  const auto [base, offset] = FindPointerBase(ptr, dl);
+  if (llvm::isa<llvm::AllocaInst>(base)) {
+    return;
+  }
+
+  if (auto gv = llvm::dyn_cast<llvm::GlobalVariable>(base);
+      gv && gv->isConstant() && !is_write) {
+    return;
+  }
+
+  const auto arg = llvm::dyn_cast<llvm::Argument>(base);
+  if (!arg || !offset || *offset < 0) {
+    summary.precise = false;
+    return;
+  }
+
+  const auto begin = static_cast<uint64_t>(*offset);
+  if (arg->getArgNo() == kSemanticsStateArgNum) {
+    auto &ranges = is_write ? summary.state_writes : summary.state_reads;
+    ranges.emplace_back(begin, begin + size);
+  } else {
+    auto &extents = is_write ? arg_writes : arg_reads;
+    auto &extent = extents[arg->getArgNo()];
+    extent = std::max(extent, begin + size);
+  }
+}
+
+void SemanticsSummarizer::AddEscape(llvm::Value *ptr) {
+  const auto [base, offset] = FindPointerBase(ptr, dl);
+  if (!llvm::isa<llvm::AllocaInst>(base)) {
+    summary.precise = false;
+  }
+}
+
+void SemanticsSummarizer::VisitCall(llvm::CallBase *call) {
+  if (auto mem_set = llvm::dyn_cast<llvm::MemSetInst>(call)) {
+    if (auto len = llvm::dyn_cast<llvm::ConstantInt>(mem_set->getLength())) {
+      AddAccess(mem_set->getDest(), len->getZExtValue(), true);
+    } else {
+      AddEscape(mem_set->getDest());
+    }
+    return;
+
+  } else if (auto mem_copy = llvm::dyn_cast<llvm::MemTransferInst>(call)) {
+    if (auto len = llvm::dyn_cast<llvm::ConstantInt>(mem_copy->getLength())) {
+      AddAccess(mem_copy->getDest(), len->getZExtValue(), true);
+      AddAccess(mem_copy->getSource(), len->getZExtValue(), false);
+    } else {
+      AddEscape(mem_copy->getDest());
+      AddEscape(mem_copy->getSource());
+    }
+    return;
+  }
+
+  const auto callee = call->getCalledFunction();
+  if (!callee || !callee->isDeclaration()) {
+    // Semantics functions are compiled with their helpers inlined, so calls
+    // to defined functions are rare, and are treated as doing anything.
+    summary.reads_memory = true;
+    summary.writes_memory = true;
+    summary.has_control_flow = true;
+    summary.has_hyper_calls = true;
+    summary.precise = false;
+    return;
+  }
+
+  const auto name = callee->getName();
+  if (name.startswith("__remill_read_memory_")) {
+    summary.reads_memory = true;
+  } else if (name.startswith("__remill_write_memory_")) {
+    summary.writes_memory = true;
+  } else if (name.startswith("__remill_compare_exchange_memory_") ||
+             name.startswith("__remill_fetch_and_")) {
+    summary.reads_memory = true;
+    summary.writes_memory = true;
+  } else if (name.endswith("_hyper_call")) {
+    summary.has_hyper_calls = true;
+  }
+
+  if (callee->doesNotAccessMemory()) {
+    return;
+  }
+
+  // Memory is accessed through the memory pointer, which isn't a pointer to
+  // anything in the semantics function.
+  const auto mem_ptr_type = sem->getFunctionType()->getParamType(0);
+  for (auto &arg : call->args()) {
+    if (arg->getType()->isPointerTy() && arg->getType() != mem_ptr_type) {
+      AddEscape(arg);
+    }
+  }
+}
+
+ISelSummary SemanticsSummarizer::Summarize(void) {
+  summary.reads_memory = false;
+  summary.writes_memory = false;
+  summary.has_control_flow = sem->size() > 1;
+  summary.has_hyper_calls = false;
+  summary.precise = true;
+
+  for (auto &block : *sem) {
+    for (auto &inst : block) {
+      if (auto load = llvm::dyn_cast<llvm::LoadInst>(&inst)) {
+        AddAccess(load->getPointerOperand(),
+                  dl.getTypeStoreSize(load->getType()), false);
+
+      } else if (auto store = llvm::dyn_cast<llvm::StoreInst>(&inst)) {
+        AddAccess(store->getPointerOperand(),
+                  dl.getTypeStoreSize(store->getValueOperand()->getType()),
+                  true);
+
+        // The address of something stored to memory may be accessed later.
+        if (store->getValueOperand()->getType()->isPointerTy()) {
+          AddEscape(store->getValueOperand());
+        }
+
+      } else if (auto call = llvm::dyn_cast<llvm::CallBase>(&inst)) {
+        VisitCall(call);
+
+      } else if (inst.mayReadOrWriteMemory()) {
+        summary.precise = false;  // E.g. atomics on operands.
+      }
+    }
+  }
+
+  MergeRanges(summary.state_reads);
+  MergeRanges(summary.state_writes);
+  summary.arg_reads.assign(arg_reads.begin(), arg_reads.end());
+  summary.arg_writes.assign(arg_writes.begin(), arg_writes.end());
+  return summary;
+}
+
+// Returns the pairs of integers in the metadata node `node`, or `false` if
+// it's not a valid list of pairs.
+template <typename T>
+static bool GetPairs(llvm::MDNode *node,
+                     std::vector<std::pair<T, uint64_t>> &pairs) {
+  if (!node || node->getNumOperands() % 2) {
+    return false;
+  }
+  for (auto i = 0u; i < node->getNumOperands(); i += 2) {
+    auto first = llvm::mdconst::dyn_extract<llvm::ConstantInt>(
+        node->getOperand(i));
+    auto second = llvm::mdconst::dyn_extract<llvm::ConstantInt>(
+        node->getOperand(i + 1));
+    if (!first || !second) {
+      return false;
+    }
+    pairs.emplace_back(static_cast<T>(first->getZExtValue()),
+                       second->getZExtValue());
+  }
+  return true;
+}
+
+template <typename T>
+static llvm::MDNode *
+GetPairsNode(llvm::LLVMContext &context,
+             const std::vector<std::pair<T, uint64_t>> &pairs) {
+  const auto i64_type = llvm::Type::getInt64Ty(context);
+  std::vector<llvm::Metadata *> ops;
+  for (auto [first, second] : pairs) {
+    ops.push_back(
+        llvm::ConstantAsMetadata::get(llvm::ConstantInt::get(i64_type, first)));
+    ops.push_back(llvm::ConstantAsMetadata::get(
+        llvm::ConstantInt::get(i64_type, second)));
+  }
+  return llvm::MDNode::get(context, ops);
+}
+
+}  // namespace
+
+// Summarize what the semantics function `sem` may do.
+ISelSummary SummarizeSemantics(llvm::Function *sem) {
+  if (sem->isDeclaration() || sem->arg_size() <= kSemanticsStateArgNum) {
+    return {};
+  }
+  return SemanticsSummarizer(sem).Summarize();
+}
+
+// Attach the summary of each `ISEL_` variable's semantics function in
+// `module` to the variable.
+unsigned AnnotateISelSummaries(llvm::Module *module) {
+  auto &context = module->getContext();
+  const auto i1_type = llvm::Type::getInt1Ty(context);
+  auto num_annotated = 0u;
+  ForEachISel(module, [&](llvm::GlobalVariable *isel, llvm::Function *sem) {
+    if (!sem || !isel->getName().startswith("ISEL_")) {
+      return;
+    }
+
+    const auto summary = SummarizeSemantics(sem);
+    llvm::Metadata *flags[] = {
+        llvm::ConstantAsMetadata::get(
+            llvm::ConstantInt::get(i1_type, summary.reads_memory)),
+        llvm::ConstantAsMetadata::get(
+            llvm::ConstantInt::get(i1_type, summary.writes_memory)),
+        llvm::ConstantAsMetadata::get(
+            llvm::ConstantInt::get(i1_type, summary.has_control_flow)),
+        llvm::ConstantAsMetadata::get(
+            llvm::ConstantInt::get(i1_type, summary.has_hyper_calls)),
+        llvm::ConstantAsMetadata::get(
+            llvm::ConstantInt::get(i1_type, summary.precise))};
+    isel->setMetadata(kISelFlagsKind, llvm::MDNode::get(context, flags));
+    isel->setMetadata(kISelStateReadsKind,
+                      GetPairsNode(context, summary.state_reads));
+    isel->setMetadata(kISelStateWritesKind,
+                      GetPairsNode(context, summary.state_writes));
+    isel->setMetadata(kISelArgReadsKind,
+                      GetPairsNode(context, summary.arg_reads));
+    isel->setMetadata(kISelArgWritesKind,
+                      GetPairsNode(context, summary.arg_writes));
+    num_annotated += 1;
+  });
+  return num_annotated;
+}
+
+// Returns the summary attached to `isel` by `AnnotateISelSummaries`, if any.
+std::optional<ISelSummary> GetISelSummary(const llvm::GlobalVariable *isel) {
+  auto flags = isel->getMetadata(kISelFlagsKind);
+  if (!flags || flags->getNumOperands() != 5) {
+    return std::nullopt;
+  }
+
+  bool values[5] = {};
+  for (auto i = 0u; i < 5u; ++i) {
+    auto flag =
+        llvm::mdconst::dyn_extract<llvm::ConstantInt>(flags->getOperand(i));
+    if (!flag) {
+      return std::nullopt;
+    }
+    values[i] = !flag->isZero();
+  }
+
+  ISelSummary summary;
+  summary.reads_memory = values[0];
+  summary.writes_memory = values[1];
+  summary.has_control_flow = values[2];
+  summary.has_hyper_calls = values[3];
+  summary.precise = values[4];
+  if (!GetPairs(isel->getMetadata(kISelStateReadsKind), summary.state_reads) ||
+      !GetPairs(isel->getMetadata(kISelStateWritesKind),
+                summary.state_writes) ||
+      !GetPairs(isel->getMetadata(kISelArgReadsKind), summary.arg_reads) ||
+      !GetPairs(isel->getMetadata(kISelArgWritesKind), summary.arg_writes)) {
+    return std::nullopt;
+  }
+  return summary;
+}
+
+}  // namespace remill
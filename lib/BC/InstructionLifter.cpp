@@ -20,8 +20,8 @@ namespace remill {
 namespace {
 
 // Try to find the function that implements this semantics.
-llvm::Function *GetInstructionFunction(llvm::Module *module,
-                                       std::string_view function) {
+llvm::Function *FindInstructionFunction(llvm::Module *module,
+                                        std::string_view function) {
   std::stringstream ss;
   ss << "ISEL_" << function;
   auto isel_name = ss.str();
@@ -41,180 +41,2297 @@ llvm::Function *GetInstructionFunction(llvm::Module *module,
   return llvm::dyn_cast_or_null<llvm::Function>(sem);
 }
 
+// Read the body of `sem` if it's from a lazily loaded semantics module.
+static llvm::Function *Materialize(llvm::Function *sem) {
+  if (sem && sem->isMaterializable()) {
+    CHECK(MaterializeFunction(sem))
+        << "Unable to read the body of semantics function "
+        << sem->getName().str();
+  }
+  return sem;
+}
+
+// Find the semantics function of `function` in `semantics_module`, and
+// declare it in `module` if that's a different (thin) module.
+static llvm::Function *FindAndDeclareInstructionFunction(
+    llvm::Module *module, llvm::Module *semantics_module,
+    std::string_view function) {
+  const auto sem =
+      Materialize(FindInstructionFunction(semantics_module, function));
+  if (sem && module != semantics_module) {
+    return DeclareISelInModule(function, sem, module);
+  }
+  return sem;
+}
+
+// Semantics functions are passed the memory pointer, then the `State`
+// pointer, and then their operands.
+enum : unsigned { kISelStatePointerArgNum = 1, kISelFirstOperandArgNum = 2 };
+
+// Gives the instructions added to the end of `block` while the scope is live,
+// and that don't have a debug location, one in `sp` that encodes the address
+// of the instruction being lifted. See
+// `InstructionLifter::SetGuestPCDebugLocations`.
+class GuestPCDebugLocationScope {
+ public:
+  GuestPCDebugLocationScope(llvm::DISubprogram *sp, uint64_t pc,
+                            llvm::BasicBlock *block_)
+      : block(sp ? block_ : nullptr),
+        last(block && !block->empty() ? &(block->back()) : nullptr) {
+    if (block) {
+      loc = llvm::DILocation::get(sp->getContext(),
+                                  static_cast<unsigned>(pc),
+                                  static_cast<unsigned>((pc >> 32) & 0xFFFFu),
+                                  sp);
+    }
+  }
+
+  ~GuestPCDebugLocationScope(void) {
+    if (!block) {
+      return;
+    }
+
+    // If the last instruction was removed, then fall back on every
+    // instruction of `block` without a location.
+    auto it = block->begin();
+    if (auto last_inst = llvm::dyn_cast_or_null<llvm::Instruction>(last);
+        last_inst && last_inst->getParent() == block) {
+      it = std::next(last_inst->getIterator());
+    }
+    for (auto end = block->end(); it != end; ++it) {
+      if (!it->getDebugLoc()) {
+        it->setDebugLoc(loc);
+      }
+    }
+  }
+
+ private:
+  llvm::BasicBlock *const block;
+  llvm::WeakVH last;
+  llvm::DebugLoc loc;
+};
+
+}  // namespace
+
+SemanticsIndex::SemanticsIndex(llvm::Module *semantics_module_)
+    : semantics_module(semantics_module_) {
+  ForEachISel(semantics_module, [this](llvm::GlobalVariable *isel,
+                                       llvm::Function *sem) {
+    const auto name = isel->getName();
+    if (sem && isel->isConstant() && name.startswith("ISEL_")) {
+      isel_funcs[name.drop_front(5)] = sem;
+      if (auto summary = GetISelSummary(isel); summary && summary->precise) {
+        isel_summaries[sem->getName()] = std::move(*summary);
+      }
+    }
+  });
+}
+
+InstructionLifterSharedState::InstructionLifterSharedState(
+    const Arch *arch_, const IntrinsicTable *intrinsics_,
+    llvm::Module *semantics_module_)
+    : arch(arch_),
+      word_type(llvm::Type::getIntNTy(
+          intrinsics_->async_hyper_call->getContext(), arch->address_size)),
+      intrinsics(intrinsics_),
+      module(intrinsics->async_hyper_call->getParent()),
+      semantics_module(semantics_module_ ? semantics_module_ : module),
+      invalid_instruction(FindAndDeclareInstructionFunction(
+          module, semantics_module, kInvalidInstructionISelName)),
+      unsupported_instruction(FindAndDeclareInstructionFunction(
+          module, semantics_module, kUnsupportedInstructionISelName)),
+      index(std::make_shared<SemanticsIndex>(semantics_module)) {
+
+  CHECK(invalid_instruction != nullptr)
+      << kInvalidInstructionISelName << " doesn't exist";
+
+  CHECK(unsupported_instruction != nullptr)
+      << kUnsupportedInstructionISelName << " doesn't exist";
+
+  if (auto reg = arch->RegisterByName(arch->ProgramCounterRegisterName());
+      reg) {
+    pc_reg = reg->EnclosingRegister();
+  }
+
+  arch->ForEachRegister([this](const Register *reg) {
+    reg_address_template.push_back(reg);
+  });
+  std::stable_sort(reg_address_template.begin(), reg_address_template.end(),
+                   [](const Register *a, const Register *b) {
+                     return a->offset < b->offset;
+                   });
+}
+
+// Create the state of lifting into the module of `intrinsics_` with the
+// semantics index and register layout of `tmpl`. Only the two fallback
+// semantics functions are looked up.
+InstructionLifterSharedState::InstructionLifterSharedState(
+    const InstructionLifterSharedState &tmpl,
+    const IntrinsicTable *intrinsics_, llvm::Module *semantics_module_)
+    : arch(tmpl.arch),
+      word_type(llvm::Type::getIntNTy(
+          intrinsics_->async_hyper_call->getContext(), arch->address_size)),
+      intrinsics(intrinsics_),
+      module(intrinsics->async_hyper_call->getParent()),
+      semantics_module(semantics_module_ ? semantics_module_ : module),
+      invalid_instruction(FindAndDeclareInstructionFunction(
+          module, semantics_module, kInvalidInstructionISelName)),
+      unsupported_instruction(FindAndDeclareInstructionFunction(
+          module, semantics_module, kUnsupportedInstructionISelName)),
+      index(tmpl.index),
+      pc_reg(tmpl.pc_reg),
+      reg_address_template(tmpl.reg_address_template) {
+
+  CHECK(invalid_instruction != nullptr)
+      << kInvalidInstructionISelName << " doesn't exist";
+
+  CHECK(unsupported_instruction != nullptr)
+      << kUnsupportedInstructionISelName << " doesn't exist";
+}
+
+InstructionLifter::Impl::Impl(
+    std::shared_ptr<const InstructionLifterSharedState> shared_)
+    : shared(std::move(shared_)),
+      arch(shared->arch),
+      word_type(shared->word_type),
+      intrinsics(shared->intrinsics),
+      module(shared->module),
+      invalid_instruction(shared->invalid_instruction),
+      unsupported_instruction(shared->unsupported_instruction),
+      pc_reg(shared->pc_reg) {}
+
+// Returns `true` if the name `reg_name` refers to `PC`, `NEXT_PC`, or to
+// (part of) the program counter register.
+bool InstructionLifter::Impl::IsPCName(std::string_view reg_name) const {
+  if (reg_name.empty()) {
+    return false;
+  } else if (reg_name == kPCVariableName || reg_name == kNextPCVariableName ||
+             reg_name == arch->ProgramCounterRegisterName()) {
+    return true;
+  } else if (!pc_reg) {
+    return false;
+  } else if (auto reg = arch->RegisterByName(reg_name); reg) {
+    return reg->EnclosingRegister() == pc_reg;
+  } else {
+    return false;
+  }
+}
+
+// Returns `true` if the operand expression `expr` refers to the program
+// counter.
+bool InstructionLifter::Impl::ObservesPC(const OperandExpression *expr) const {
+  if (!expr) {
+    return false;
+  } else if (auto llvm_op = std::get_if<LLVMOpExpr>(expr)) {
+    return ObservesPC(llvm_op->op1) || ObservesPC(llvm_op->op2);
+  } else if (auto reg = std::get_if<const Register *>(expr)) {
+    return *reg && IsPCName((*reg)->name);
+  } else if (auto name = std::get_if<std::string>(expr)) {
+    return IsPCName(*name);
+  } else {
+    return false;
+  }
+}
+
+// Returns `true` if any operand of `inst` reads or writes the program
+// counter.
+bool InstructionLifter::Impl::ObservesPC(const Instruction &inst) const {
+  for (const auto &op : inst.operands) {
+    switch (op.type) {
+      case Operand::kTypeRegister:
+        if (IsPCName(op.reg.name)) {
+          return true;
+        }
+        break;
+      case Operand::kTypeShiftRegister:
+        if (IsPCName(op.shift_reg.reg.name)) {
+          return true;
+        }
+        break;
+      case Operand::kTypeAddress:
+        if (IsPCName(op.addr.base_reg.name) ||
+            IsPCName(op.addr.index_reg.name) ||
+            IsPCName(op.addr.segment_base_reg.name)) {
+          return true;
+        }
+        break;
+      case Operand::kTypeExpression:
+      case Operand::kTypeRegisterExpression:
+      case Operand::kTypeImmediateExpression:
+      case Operand::kTypeAddressExpression:
+        if (ObservesPC(op.expr)) {
+          return true;
+        }
+        break;
+      default: break;
+    }
+  }
+  return false;
+}
+
+// Try to find the function that implements the semantics of the instruction
+// function `function`.
+llvm::Function *
+InstructionLifter::Impl::GetInstructionFunction(std::string_view function) {
+  if (auto sem = GetKnownInstructionFunction(function)) {
+    return sem;
+  }
+
+  // We've already looked for this and not found it.
+  const llvm::StringRef name(function.data(), function.size());
+  if (auto missing_it = missing_isels.find(name);
+      missing_it != missing_isels.end()) {
+    missing_it->second += 1;
+    return nullptr;
+  }
+
+  if (auto sem = FindExtraInstructionFunction(function)) {
+    return sem;
+  }
+  missing_isels[name] = 1;
+  return nullptr;
+}
+
+// Try to find the function that implements the semantics of the instruction
+// function `function` among those that this lifter already knows about.
+llvm::Function *InstructionLifter::Impl::GetKnownInstructionFunction(
+    std::string_view function) {
+  const llvm::StringRef name(function.data(), function.size());
+  const auto &index = *(shared->index);
+  const auto &isel_funcs = index.isel_funcs;
+  if (auto isel_it = isel_funcs.find(name); isel_it != isel_funcs.end()) {
+    auto sem = llvm::dyn_cast_or_null<llvm::Function>(isel_it->second);
+
+    // The index is of the module that `shared->semantics_module` is a clone
+    // of, and so the semantics function is found in the clone by name.
+    if (sem && index.semantics_module != shared->semantics_module) {
+      sem = shared->semantics_module->getFunction(sem->getName());
+    }
+    if (sem) {
+      return DeclareISel(function, Materialize(sem));
+    }
+  }
+
+  if (auto extra_it = extra_isel_funcs.find(name);
+      extra_it != extra_isel_funcs.end()) {
+    if (auto sem = llvm::dyn_cast_or_null<llvm::Function>(extra_it->second)) {
+      return DeclareISel(function, Materialize(sem));
+    }
+  }
+
+  return nullptr;
+}
+
+// Look for the semantics function `function` in the semantics module, e.g.
+// because it was added to the module after we built the table, or because it
+// isn't a `constexpr` variable.
+llvm::Function *InstructionLifter::Impl::FindExtraInstructionFunction(
+    std::string_view function) {
+  const auto sem = Materialize(
+      FindInstructionFunction(shared->semantics_module, function));
+  if (!sem) {
+    return nullptr;
+  }
+  extra_isel_funcs[llvm::StringRef(function.data(), function.size())] = sem;
+  return DeclareISel(function, sem);
+}
+
+// Try to find the function that implements the semantics of `inst`,
+// preferring the native variant of an atomic instruction's semantics. Most
+// atomic instructions don't have a native variant, and so a missing one isn't
+// reported as missing semantics.
+llvm::Function *
+InstructionLifter::Impl::GetInstructionFunction(const Instruction &inst) {
+  if (native_atomics && inst.is_atomic_read_modify_write) {
+    auto [native_it, added] = native_isel_names.try_emplace(inst.function);
+    if (added) {
+      native_it->second = inst.function + "_NATIVE";
+    }
+    if (const auto &native_name = native_it->second; !native_name.empty()) {
+      if (auto native = GetKnownInstructionFunction(native_name)) {
+        return native;
+      } else if (auto native = FindExtraInstructionFunction(native_name)) {
+        return native;
+      }
+      native_it->second.clear();
+    }
+  }
+  return GetInstructionFunction(inst.function);
+}
+
+// Returns `sem`, or its declaration in `module` if it's from a separate
+// semantics module.
+llvm::Function *
+InstructionLifter::Impl::DeclareISel(std::string_view function,
+                                     llvm::Function *sem) {
+  if (shared->semantics_module == module) {
+    return sem;
+  }
+
+  auto &decl = isel_decls[sem];
+  if (auto func = llvm::dyn_cast_or_null<llvm::Function>(decl)) {
+    return func;
+  }
+
+  const auto func = DeclareISelInModule(function, sem, module);
+  decl = func;
+  return func;
+}
+
+InstructionLifter::~InstructionLifter(void) {
+  impl->ClearTemplates();
+}
+
+InstructionLifter::InstructionLifter(const Arch *arch_,
+                                     const IntrinsicTable *intrinsics_)
+    : InstructionLifter(
+          std::make_shared<InstructionLifterSharedState>(arch_, intrinsics_)) {}
+
+InstructionLifter::InstructionLifter(const Arch *arch_,
+                                     const IntrinsicTable *intrinsics_,
+                                     llvm::Module *semantics_module_)
+    : InstructionLifter(std::make_shared<InstructionLifterSharedState>(
+          arch_, intrinsics_, semantics_module_)) {}
+
+InstructionLifter::InstructionLifter(
+    std::shared_ptr<const InstructionLifterSharedState> shared_)
+    : impl(new Impl(std::move(shared_))) {}
+
+InstructionLifter::InstructionLifter(
+    const std::shared_ptr<const InstructionLifterSharedState> &tmpl,
+    const IntrinsicTable *intrinsics_, llvm::Module *semantics_module_)
+    : InstructionLifter(std::make_shared<InstructionLifterSharedState>(
+          *tmpl, intrinsics_, semantics_module_)) {}
+
+// Returns the immutable state of this lifter, which can be used to create
+// other lifters for the same architecture and module.
+std::shared_ptr<const InstructionLifterSharedState>
+InstructionLifter::SharedState(void) const {
+  return impl->shared;
+}
+
+// Count ISEL lookups into `stats`, or stop counting if `stats` is null.
+void InstructionLifter::SetStatistics(LiftStatistics *stats) {
+  impl->stats = stats;
+}
+
+namespace {
+
+static const char *LiftStatusName(LiftStatus status) {
+  switch (status) {
+    case kLiftedInvalidInstruction: return "invalid";
+    case kLiftedUnsupportedInstruction: return "unsupported";
+    case kLiftedLifterError: return "lifter_error";
+    case kLiftedUnknownISEL: return "unknown_isel";
+    case kLiftedMismatchedISEL: return "mismatched_isel";
+    case kLiftedInstruction: return "lifted";
+  }
+  return "unknown";
+}
+
 }  // namespace
 
-InstructionLifter::Impl::Impl(const Arch *arch_,
-                              const IntrinsicTable *intrinsics_)
-    : arch(arch_),
-      word_type(llvm::Type::getIntNTy(
-          intrinsics_->async_hyper_call->getContext(), arch->address_size)),
-      intrinsics(intrinsics_),
-      module(intrinsics->async_hyper_call->getParent()),
-      invalid_instruction(
-          GetInstructionFunction(module, kInvalidInstructionISelName)),
-      unsupported_instruction(
-          GetInstructionFunction(module, kUnsupportedInstructionISelName)) {
+// Invoke `cb` on the number of times that each semantics function has been
+// lifted with each status.
+void InstructionLifter::ForEachLiftStatus(
+    std::function<void(std::string_view, LiftStatus, uint64_t)> cb) const {
+  for (const auto &entry : impl->status_counts) {
+    const auto name = entry.getKey();
+    for (auto i = 0u; i < entry.getValue().size(); ++i) {
+      if (const auto count = entry.getValue()[i]; count) {
+        cb(std::string_view(name.data(), name.size()),
+           static_cast<LiftStatus>(i), count);
+      }
+    }
+  }
+}
+
+// Print out `ForEachLiftStatus` as CSV, with the most frequent first.
+void InstructionLifter::PrintLiftStatuses(std::ostream &os) const {
+  std::vector<std::tuple<uint64_t, std::string_view, LiftStatus>> rows;
+  ForEachLiftStatus(
+      [&rows](std::string_view name, LiftStatus status, uint64_t count) {
+        rows.emplace_back(count, name, status);
+      });
+
+  std::sort(rows.begin(), rows.end(), [](const auto &a, const auto &b) {
+    return std::get<0>(a) > std::get<0>(b);
+  });
+
+  os << "isel,status,count\n";
+  for (const auto &[count, name, status] : rows) {
+    os << name << ',' << LiftStatusName(status) << ',' << count << '\n';
+  }
+}
+
+// Forget the counts of `ForEachLiftStatus`.
+void InstructionLifter::ClearLiftStatuses(void) {
+  impl->status_counts.clear();
+}
+
+// Enable or disable removing overwritten `State` stores from lifted blocks.
+void InstructionLifter::SetEliminateDeadStateStores(bool enabled) {
+  impl->eliminate_dead_state_stores = enabled;
+}
+
+// Enable or disable tracking the stack pointer symbolically within blocks
+// lifted by `LiftBlock`.
+void InstructionLifter::SetFoldStackPointerDeltas(bool enabled) {
+  impl->fold_sp_deltas = enabled;
+}
+
+// Enable or disable merging writes to sub-registers within blocks lifted by
+// `LiftBlock`.
+void InstructionLifter::SetMergeSubRegisterWrites(bool enabled) {
+  impl->merge_sub_reg_writes = enabled;
+}
+
+// Enable or disable specializing semantics functions to constant operands.
+void InstructionLifter::SetSpecializeSemantics(bool enabled) {
+  impl->specialize_semantics = enabled;
+}
+
+// Enable or disable splicing the bodies of semantics functions into lifted
+// blocks.
+void InstructionLifter::SetInlineSemantics(bool enabled) {
+  impl->inline_semantics = enabled;
+}
+
+// Enable or disable forwarding of register values within a block.
+void InstructionLifter::SetHoistRegisterAddresses(bool enabled) {
+  impl->hoist_reg_addresses = enabled;
+}
+
+void InstructionLifter::SetRegisterValueForwarding(bool enabled) {
+  impl->forward_reg_values = enabled;
+  impl->last_block = nullptr;
+  impl->InvalidateRegValues();
+  impl->addr_memo.clear();
+  impl->expr_memo.clear();
+}
+
+// Enable or disable loading segment base registers once per function.
+void InstructionLifter::SetInvariantSegmentBases(bool enabled) {
+  impl->invariant_segment_bases = enabled;
+}
+
+// Enable or disable lifting dead register writes of `LiftBlock` into scratch
+// space.
+void InstructionLifter::SetSkipDeadRegisterWrites(bool enabled) {
+  impl->skip_dead_reg_writes = enabled;
+}
+
+// Enable or disable adding the variables of `__remill_basic_block` to lifted
+// functions on first use.
+void InstructionLifter::SetLazyBlockVariables(bool enabled) {
+  impl->lazy_block_vars = enabled;
+}
+
+// Enable or disable stamping out copies of the IR lifted for identical
+// instructions.
+void InstructionLifter::SetInstructionTemplates(bool enabled) {
+  impl->instruction_templates = enabled;
+}
+
+// Forget all recorded instruction templates.
+void InstructionLifter::ClearInstructionTemplates(void) {
+  impl->ClearTemplates();
+}
+
+// Enable or disable lifting atomic instructions with the native variants of
+// their semantics.
+void InstructionLifter::SetNativeAtomics(bool enabled) {
+  impl->native_atomics = enabled;
+}
+
+// Enable or disable giving lifted instructions debug locations that encode
+// their addresses.
+void InstructionLifter::SetGuestPCDebugLocations(bool enabled) {
+  impl->guest_pc_debug_locs = enabled;
+}
+
+// Returns a hash of the settings of this lifter that change the lifted IR.
+// The invariant segment bases are left out, as the `TraceLifter` sets them
+// from its `TraceManager` before each trace.
+uint64_t InstructionLifter::OptionsHash(void) const {
+  const bool options[] = {impl->eliminate_dead_state_stores,
+                          impl->fold_sp_deltas,
+                          impl->merge_sub_reg_writes,
+                          impl->specialize_semantics,
+                          impl->inline_semantics,
+                          impl->hoist_reg_addresses,
+                          impl->forward_reg_values,
+                          impl->skip_dead_reg_writes,
+                          impl->lazy_block_vars,
+                          impl->instruction_templates,
+                          impl->native_atomics,
+                          impl->guest_pc_debug_locs};
+  uint64_t hash = 0;
+  for (auto option : options) {
+    hash = (hash << 1u) | option;
+  }
+  return hash;
+}
+
+// Lift a single instruction into a basic block. `is_delayed` signifies that
+// this instruction will execute within the delay slot of another instruction.
+LiftStatus InstructionLifter::LiftIntoBlock(Instruction &inst,
+                                            llvm::BasicBlock *block,
+                                            bool is_delayed) {
+  return LiftIntoBlock(inst, block,
+                       NthArgument(block->getParent(), kStatePointerArgNum),
+                       is_delayed);
+}
+
+// Lift a single instruction into a basic block.
+LiftStatus InstructionLifter::LiftIntoBlock(Instruction &arch_inst,
+                                            llvm::BasicBlock *block,
+                                            llvm::Value *state_ptr,
+                                            bool is_delayed) {
+  const auto stats = impl->stats;
+  StatisticsAllocationScope allocs(stats ? &(stats->lift_alloc_bytes) : nullptr,
+                                   stats ? &(stats->lift_allocs) : nullptr);
+
+  llvm::Function *const func = block->getParent();
+  llvm::Module *const module = func->getParent();
+  llvm::Function *isel_func = nullptr;
+  auto status = kLiftedInstruction;
+
+  // Cache invalidation.
+  CHECK_EQ(impl->module, module)
+      << "InstructionLifter isn't using the correct module!";
+  impl->ResetCacheIfNewFunction(func);
+
+  GuestPCDebugLocationScope guest_pc_loc(
+      impl->guest_pc_debug_locs ? impl->GuestSubprogram(func, arch_inst.pc)
+                                : nullptr,
+      arch_inst.pc, block);
+
+  if (arch_inst.IsValid()) {
+    isel_func = impl->GetInstructionFunction(arch_inst);
+    if (impl->stats) {
+      impl->stats->num_isel_lookups += 1;
+      impl->stats->num_missing_isels += !isel_func;
+    }
+  } else {
+    isel_func = impl->invalid_instruction;
+    arch_inst.operands.clear();
+    status = kLiftedInvalidInstruction;
+  }
+
+  // Only log the first instance of each missing semantics function; some
+  // binaries contain huge numbers of unsupported instructions.
+  if (!isel_func) {
+    if (1 == impl->missing_isels.lookup(arch_inst.function)) {
+      LOG(ERROR) << "Missing semantics for instruction "
+                 << arch_inst.Serialize()
+                 << "; further instances of " << arch_inst.function
+                 << " will not be reported";
+    }
+    isel_func = impl->unsupported_instruction;
+    arch_inst.operands.clear();
+    status = kLiftedUnsupportedInstruction;
+  }
+
+  // Copy the IR lifted for an identical instruction, if any. Otherwise,
+  // remember where this instruction's IR starts, so that it can become the
+  // template.
+  std::string template_key;
+  llvm::Instruction *template_start = nullptr;
+  const auto use_template =
+      impl->instruction_templates && !impl->block_ssa && !is_delayed &&
+      kLiftedInstruction == status && !impl->forward_reg_values &&
+      !impl->specialize_semantics;
+  if (use_template) {
+    Impl::TemplateKey(arch_inst, template_key);
+    if (impl->StampTemplate(*this, template_key, block, state_ptr)) {
+      if (impl->stats) {
+        impl->stats->num_template_insts += 1;
+      }
+      impl->CountLiftStatus(arch_inst, status);
+      return status;
+    }
+    template_start = block->empty() ? nullptr : &(block->back());
+  }
+
+  llvm::IRBuilder<> ir(block);
+  const auto mem_ptr_ref =
+      LoadRegAddress(block, state_ptr, kMemoryVariableName);
+  const auto pc_ref = LoadRegAddress(block, state_ptr, kPCVariableName);
+  const auto next_pc_ref =
+      LoadRegAddress(block, state_ptr, kNextPCVariableName);
+
+  // Within `LiftBlock`, the memory pointer is threaded through the block as
+  // an SSA value, and is only stored back to `MEMORY` at the end of the block.
+  const auto ssa = impl->block_ssa;
+  auto load_mem = [&](void) -> llvm::Value * {
+    return ssa ? ssa->mem : ir.CreateLoad(mem_ptr_ref);
+  };
+  auto store_mem = [&](llvm::Value *mem) {
+    if (ssa) {
+      ssa->mem = mem;
+    } else {
+      ir.CreateStore(mem, mem_ptr_ref);
+    }
+  };
+
+  // Store any deferred updates of `PC` and `NEXT_PC`.
+  auto materialize_pc = [&](void) {
+    if (ssa && ssa->pc_is_dirty) {
+      ir.CreateStore(ssa->pc, pc_ref);
+      ir.CreateStore(ssa->next_pc, next_pc_ref);
+      ssa->pc_is_dirty = false;
+    }
+  };
+
+  // Delay slots and anything unusual observe `PC` and `NEXT_PC` through the
+  // `State` structure.
+  if (ssa && (is_delayed || status != kLiftedInstruction)) {
+    ssa->materialize_pc = true;
+  }
+
+  // Delayed instructions read `PC` and `NEXT_PC` from the `State` structure.
+  if (is_delayed) {
+    materialize_pc();
+  }
+
+  llvm::Value *const next_pc = ssa && ssa->next_pc && !is_delayed
+                                   ? ssa->next_pc
+                                   : ir.CreateLoad(next_pc_ref);
+
+  // A delayed no-op only completes the delayed update of the program counter
+  // (see below), and so it needs neither a semantics function, nor to be
+  // marked as a delay slot.
+  if (is_delayed && kLiftedInstruction == status &&
+      Instruction::kCategoryNoOp == arch_inst.category &&
+      arch_inst.operands.empty()) {
+    ir.CreateStore(next_pc, pc_ref);
+    ir.CreateStore(next_pc, next_pc_ref);
+    if (impl->forward_reg_values) {
+      impl->InvalidateRegValues(impl->pc_reg);
+    }
+    if (ssa) {
+      ssa->pc = nullptr;
+      ssa->next_pc = nullptr;
+    }
+    impl->CountLiftStatus(arch_inst, status);
+    return status;
+  }
+
+  // If this instruction appears within a delay slot, then we're going to assume
+  // that the prior instruction updated `PC` to the target of the CTI, and that
+  // the value in `NEXT_PC` on entry to this instruction represents the actual
+  // address of this instruction, so we'll swap `PC` and `NEXT_PC`.
+  //
+  // TODO(pag): An alternate approach may be to call some kind of `DELAY_SLOT`
+  //            semantics function.
+  if (is_delayed) {
+    llvm::Value *temp_args[] = {load_mem()};
+    store_mem(ir.CreateCall(impl->intrinsics->delay_slot_begin, temp_args));
+
+    // Leave `PC` and `NEXT_PC` alone; we assume that the semantics have done
+    // the right thing initializing `PC` and `NEXT_PC` for the delay slots.
+
+  } else {
+
+    // Update the current program counter. Control-flow instructions may update
+    // the program counter in the semantics code.
+    const auto new_next_pc = ir.CreateAdd(
+        next_pc,
+        llvm::ConstantInt::get(impl->word_type, arch_inst.bytes.size()));
+
+    if (ssa) {
+      ssa->pc = next_pc;
+      ssa->next_pc = new_next_pc;
+      ssa->pc_is_dirty = true;
+      if (ssa->materialize_pc) {
+        materialize_pc();
+      }
+    } else {
+      ir.CreateStore(next_pc, pc_ref);
+      ir.CreateStore(new_next_pc, next_pc_ref);
+    }
+  }
+
+  // `PC` and `NEXT_PC` alias the program counter register.
+  if (impl->forward_reg_values) {
+    impl->InvalidateRegValues(impl->pc_reg);
+  }
+
+  // Begin an atomic block.
+  if (arch_inst.is_atomic_read_modify_write) {
+    llvm::Value *temp_args[] = {load_mem()};
+    store_mem(ir.CreateCall(impl->intrinsics->atomic_begin, temp_args));
+  }
+
+  std::vector<llvm::Value *> args;
+  args.reserve(arch_inst.operands.size() + 2);
+
+  // First two arguments to an instruction semantics function are the
+  // state pointer, and a pointer to the memory pointer.
+  args.push_back(nullptr);
+  args.push_back(state_ptr);
+
+  auto isel_func_type = isel_func->getFunctionType();
+  auto arg_num = 2U;
+
+  for (auto &op : arch_inst.operands) {
+    if (!(arg_num < isel_func_type->getNumParams())) {
+      impl->CountLiftStatus(arch_inst, kLiftedMismatchedISEL);
+      return kLiftedMismatchedISEL;
+    }
+
+    auto arg = NthArgument(isel_func, arg_num);
+    auto arg_type = arg->getType();
+    auto operand = LiftOperand(arch_inst, block, state_ptr, arg, op);
+    arg_num += 1;
+    auto op_type = operand->getType();
+    CHECK(op_type == arg_type)
+        << "Lifted operand " << op.Serialize() << " to " << arch_inst.function
+        << " does not have the correct type. Expected "
+        << LLVMThingToString(arg_type) << " but got "
+        << LLVMThingToString(op_type) << ".";
+
+    args.push_back(operand);
+  }
+
+  // Pass in current value of the memory pointer.
+  args[0] = load_mem();
+
+  // Call the function that implements the instruction semantics.
+  if (impl->specialize_semantics) {
+    isel_func = impl->GetSpecialization(isel_func, args);
+  }
+
+  llvm::Function *inline_body = nullptr;
+  if (impl->inline_semantics) {
+    inline_body = impl->GetInlineBody(isel_func);
+  }
+
+  if (!inline_body) {
+    store_mem(ir.CreateCall(isel_func, args));
+
+  // Splice the pre-optimized body of the semantics function into the block.
+  // The body is a single block ending in a `ret`, so the inliner merges it
+  // into `block` without splitting it. The handle tracks the call's
+  // replacement, i.e. the returned memory pointer.
+  } else {
+    const auto call = ir.CreateCall(inline_body, args);
+    llvm::WeakTrackingVH new_mem(call);
+    llvm::InlineFunctionInfo info;
+    (void) llvm::InlineFunction(call, info);
+    store_mem(new_mem);
+  }
+
+  if (impl->forward_reg_values) {
+    impl->InvalidateRegValuesWrittenBy(arch_inst, isel_func);
+  }
+
+  // End an atomic block.
+  if (arch_inst.is_atomic_read_modify_write) {
+    llvm::Value *temp_args[] = {load_mem()};
+    store_mem(ir.CreateCall(impl->intrinsics->atomic_end, temp_args));
+  }
+
+  // Restore the true target of the delayed branch.
+  if (is_delayed) {
+
+    // This is the delayed update of the program counter.
+    ir.CreateStore(next_pc, pc_ref);
+
+    // We don't know what the `NEXT_PC` is going to be because of the next
+    // instruction size is unknown (really, it's likely to be
+    // `arch->MaxInstructionSize()`), and for normal instructions, before they
+    // are lifted, we do the `PC = NEXT_PC + size`, so this is fine.
+    ir.CreateStore(next_pc, next_pc_ref);
+
+    llvm::Value *temp_args[] = {load_mem()};
+    store_mem(ir.CreateCall(impl->intrinsics->delay_slot_end, temp_args));
+
+    if (impl->forward_reg_values) {
+      impl->InvalidateRegValues(impl->pc_reg);
+    }
+  }
+
+  // The semantics of control-flow instructions (and of delayed instructions)
+  // decide the next program counter, so it must be reloaded by whatever
+  // follows.
+  if (ssa && (is_delayed || arch_inst.IsControlFlow())) {
+    ssa->pc = nullptr;
+    ssa->next_pc = nullptr;
+  }
+
+  // NOTE(pag): Instructions lifted into an empty block aren't recorded, as
+  //            register addresses may have been inserted at the start of
+  //            the block, and would be mistaken for part of the template.
+  if (use_template && template_start) {
+    impl->RecordTemplate(template_key, block, template_start, state_ptr);
+  }
+
+  impl->CountLiftStatus(arch_inst, status);
+  return status;
+}
+
+// Lift a sequence of decoded instructions into `block`, in order.
+LiftStatus
+InstructionLifter::LiftBlock(llvm::MutableArrayRef<Instruction> insts,
+                             llvm::BasicBlock *block, llvm::Value *state_ptr,
+                             size_t *num_lifted) {
+  CHECK(!impl->block_ssa) << "Nested calls to LiftBlock are not supported";
+
+  const auto mem_ptr_ref =
+      LoadRegAddress(block, state_ptr, kMemoryVariableName);
+  const auto pc_ref = LoadRegAddress(block, state_ptr, kPCVariableName);
+  const auto next_pc_ref =
+      LoadRegAddress(block, state_ptr, kNextPCVariableName);
+
+  llvm::IRBuilder<> ir(block);
+  Impl::BlockSSAState ssa;
+  ssa.mem = ir.CreateLoad(mem_ptr_ref);
+  impl->block_ssa = &ssa;
+
+  std::vector<uint64_t> dead_writes;
+  if (impl->skip_dead_reg_writes) {
+    impl->FindDeadRegisterWrites(insts, dead_writes);
+  }
+
+  auto status = kLiftedInstruction;
+  size_t i = 0;
+  for (; i < insts.size(); ++i) {
+    auto &inst = insts[i];
+    ssa.materialize_pc = !inst.IsValid() || inst.IsControlFlow() ||
+                         impl->ObservesPC(inst);
+    ssa.dead_writes = dead_writes.empty() ? 0 : dead_writes[i];
+    status = LiftIntoBlock(inst, block, state_ptr, false);
+    if (kLiftedInstruction != status) {
+      break;
+    }
+  }
+
+  // Everything after the block observes `MEMORY`, `PC`, and `NEXT_PC`.
+  ir.SetInsertPoint(block);
+  if (ssa.pc_is_dirty) {
+    ir.CreateStore(ssa.pc, pc_ref);
+    ir.CreateStore(ssa.next_pc, next_pc_ref);
+  }
+  ir.CreateStore(ssa.mem, mem_ptr_ref);
+  impl->block_ssa = nullptr;
+
+  if (impl->fold_sp_deltas) {
+    impl->FoldStackPointerDeltas(block, state_ptr);
+  }
+
+  if (impl->merge_sub_reg_writes) {
+    impl->MergeSubRegisterWrites(block, state_ptr);
+  }
+
+  if (impl->eliminate_dead_state_stores) {
+    impl->EliminateDeadStateStores(block, state_ptr);
+  }
+
+  if (num_lifted) {
+    *num_lifted = i + (i < insts.size() ? 1 : 0);
+  }
+  return status;
+}
+
+// Lift a sequence of decoded instructions into `block`, in order.
+LiftStatus
+InstructionLifter::LiftBlock(llvm::MutableArrayRef<Instruction> insts,
+                             llvm::BasicBlock *block, size_t *num_lifted) {
+  return LiftBlock(insts, block,
+                   NthArgument(block->getParent(), kStatePointerArgNum),
+                   num_lifted);
+}
+
+// Fill `key` with the parts of `inst` that determine the IR that
+// `LiftIntoBlock` emits for it.
+void InstructionLifter::Impl::TemplateKey(const Instruction &inst,
+                                          std::string &key) {
+  key.clear();
+  key.reserve(64 + 32 * inst.operands.size());
+  key.append(inst.function);
+  key.push_back('\0');
+
+  auto append_int = [&key](uint64_t val) {
+    key.append(reinterpret_cast<const char *>(&val), sizeof(val));
+  };
+  auto append_reg = [&](const Operand::Register &reg) {
+    key.append(reg.name);
+    key.push_back('\0');
+    append_int(reg.size);
+  };
+
+  append_int(inst.bytes.size());
+  append_int(inst.is_atomic_read_modify_write);
+  for (const auto &op : inst.operands) {
+    append_int(op.type);
+    append_int(op.action);
+    append_int(op.size);
+    switch (op.type) {
+      case Operand::kTypeRegister: append_reg(op.reg); break;
+      case Operand::kTypeShiftRegister:
+        append_reg(op.shift_reg.reg);
+        append_int(op.shift_reg.shift_size);
+        append_int(op.shift_reg.extract_size);
+        append_int(op.shift_reg.shift_first);
+        append_int(op.shift_reg.shift_op);
+        append_int(op.shift_reg.extend_op);
+        break;
+      case Operand::kTypeImmediate:
+        append_int(op.imm.val);
+        append_int(op.imm.is_signed);
+        break;
+      case Operand::kTypeAddress:
+        append_reg(op.addr.segment_base_reg);
+        append_reg(op.addr.base_reg);
+        append_reg(op.addr.index_reg);
+        append_int(static_cast<uint64_t>(op.addr.scale));
+        append_int(static_cast<uint64_t>(op.addr.displacement));
+        append_int(op.addr.address_size);
+        append_int(op.addr.kind);
+        break;
+      case Operand::kTypeExpression:
+      case Operand::kTypeRegisterExpression:
+      case Operand::kTypeImmediateExpression:
+      case Operand::kTypeAddressExpression:
+        if (op.expr) {
+          key.append(op.expr->Serialize());
+        }
+        key.push_back('\0');
+        break;
+      default: break;
+    }
+  }
+}
+
+// Forget the templates if `template_func` has been removed.
+void InstructionLifter::Impl::ResetTemplatesIfRemoved(void) {
+  if (has_template_func && !template_func) {
+    templates.clear();
+    has_template_func = false;
+  }
+}
+
+// Clone the template `key`, if any, into the end of `block`.
+bool InstructionLifter::Impl::StampTemplate(const InstructionLifter &lifter,
+                                            const std::string &key,
+                                            llvm::BasicBlock *block,
+                                            llvm::Value *state_ptr) {
+  ResetTemplatesIfRemoved();
+  const auto tmpl_it = templates.find(key);
+  if (tmpl_it == templates.end() || !tmpl_it->second.block) {
+    return false;
+  }
+
+  const auto &tmpl = tmpl_it->second;
+  const auto tmpl_block = llvm::cast<llvm::BasicBlock>(tmpl.block);
+  const auto tmpl_state_ptr = NthArgument(tmpl_block->getParent(), 0);
+  if (tmpl_state_ptr->getType() != state_ptr->getType()) {
+    return false;
+  }
+
+  // Map the placeholders to the addresses of their registers or variables
+  // in `block`'s function.
+  llvm::ValueToValueMapTy value_map;
+  value_map[tmpl_state_ptr] = state_ptr;
+  auto tmpl_inst = tmpl_block->begin();
+  for (const auto &var_name : tmpl.var_names) {
+    const auto var_ptr = lifter.LoadRegAddress(block, state_ptr, var_name);
+    if (var_ptr->getType() != tmpl_inst->getType()) {
+      return false;
+    }
+    value_map[&*tmpl_inst] = var_ptr;
+    ++tmpl_inst;
+  }
+
+  const auto tmpl_end = tmpl_block->getTerminator()->getIterator();
+  for (; tmpl_inst != tmpl_end; ++tmpl_inst) {
+    const auto inst = tmpl_inst->clone();
+    block->getInstList().push_back(inst);
+    value_map[&*tmpl_inst] = inst;
+    llvm::RemapInstruction(inst, value_map,
+                           llvm::RF_NoModuleLevelChanges |
+                               llvm::RF_IgnoreMissingLocals);
+  }
+  return true;
+}
+
+// Record the instructions of `block` after `last_inst` as the template `key`.
+// Values from outside of those instructions must be constants, the `State`
+// pointer, or the addresses of registers and variables known to the caches
+// of this lifter. Otherwise, e.g. if the IR uses an invariant register value
+// (see `SetInvariantSegmentBases`), the key is marked as having no template.
+void InstructionLifter::Impl::RecordTemplate(const std::string &key,
+                                             llvm::BasicBlock *block,
+                                             llvm::Instruction *last_inst,
+                                             llvm::Value *state_ptr) {
+  ResetTemplatesIfRemoved();
+  auto [tmpl_it, added] = templates.try_emplace(key);
+  if (!added) {
+    return;
+  }
+
+  std::vector<llvm::Instruction *> insts;
+  llvm::SmallPtrSet<llvm::Instruction *, 32> inst_set;
+  for (auto inst = last_inst->getNextNode(); inst;
+       inst = inst->getNextNode()) {
+    if (!llvm::isa<llvm::DbgInfoIntrinsic>(inst)) {
+      insts.push_back(inst);
+      inst_set.insert(inst);
+    }
+  }
+
+  // The names of the registers and variables of the function, by address.
+  llvm::DenseMap<llvm::Value *, std::string_view> var_names;
+  for (const auto &entry : reg_ptr_cache) {
+    if (entry.second) {
+      var_names.try_emplace(entry.second,
+                            std::string_view(entry.first().data(),
+                                             entry.first().size()));
+    }
+  }
+  for (auto i = 0u; i < reg_ptr_by_index.size(); ++i) {
+    if (auto reg = arch->RegisterById(i); reg && reg_ptr_by_index[i]) {
+      var_names.try_emplace(reg_ptr_by_index[i], reg->name);
+    }
+  }
+
+  std::vector<llvm::Value *> var_ptrs;
+  for (auto inst : insts) {
+    if (llvm::isa<llvm::PHINode>(inst) || inst->isTerminator()) {
+      return;
+    }
+    for (auto &op : inst->operands()) {
+      const auto val = op.get();
+      if (llvm::isa<llvm::Constant>(val) || llvm::isa<llvm::InlineAsm>(val) ||
+          val == state_ptr) {
+        continue;
+      } else if (auto md = llvm::dyn_cast<llvm::MetadataAsValue>(val)) {
+        if (llvm::isa<llvm::LocalAsMetadata>(md->getMetadata())) {
+          return;
+        }
+      } else if (auto op_inst = llvm::dyn_cast<llvm::Instruction>(val);
+                 op_inst && inst_set.count(op_inst)) {
+        continue;
+      } else if (!var_names.count(val) || !val->getType()->isPointerTy()) {
+        return;
+      } else if (std::find(var_ptrs.begin(), var_ptrs.end(), val) ==
+                 var_ptrs.end()) {
+        var_ptrs.push_back(val);
+      }
+    }
+  }
+
+  if (insts.empty()) {
+    return;
+  }
+
+  auto &context = module->getContext();
+  auto func = llvm::cast_or_null<llvm::Function>(
+      static_cast<llvm::Value *>(template_func));
+  if (!func) {
+    const auto func_type = llvm::FunctionType::get(
+        llvm::Type::getVoidTy(context), {state_ptr->getType()}, false);
+    func = llvm::Function::Create(func_type, llvm::GlobalValue::PrivateLinkage,
+                                  "__remill_instruction_templates", module);
+    llvm::ReturnInst::Create(context,
+                             llvm::BasicBlock::Create(context, "", func));
+    template_func = func;
+    has_template_func = true;
+
+  } else if (NthArgument(func, 0)->getType() != state_ptr->getType()) {
+    return;
+  }
+
+  auto &tmpl = tmpl_it->second;
+  const auto tmpl_block = llvm::BasicBlock::Create(context, "", func);
+  llvm::ValueToValueMapTy value_map;
+  value_map[state_ptr] = NthArgument(func, 0);
+  for (auto var_ptr : var_ptrs) {
+    const auto ptr_type = llvm::cast<llvm::PointerType>(var_ptr->getType());
+    value_map[var_ptr] = new llvm::AllocaInst(
+        ptr_type->getPointerElementType(), ptr_type->getAddressSpace(),
+        llvm::Twine::createNull(), tmpl_block);
+    tmpl.var_names.emplace_back(var_names[var_ptr]);
+  }
+
+  for (auto inst : insts) {
+    const auto tmpl_inst = inst->clone();
+    tmpl_inst->setDebugLoc(llvm::DebugLoc());
+    tmpl_block->getInstList().push_back(tmpl_inst);
+    value_map[inst] = tmpl_inst;
+    llvm::RemapInstruction(tmpl_inst, value_map,
+                           llvm::RF_NoModuleLevelChanges |
+                               llvm::RF_IgnoreMissingLocals);
+  }
+
+  llvm::ReturnInst::Create(context, tmpl_block);
+  tmpl.block = tmpl_block;
+}
+
+// Remove `template_func` from the module, and forget all templates.
+void InstructionLifter::Impl::ClearTemplates(void) {
+  if (auto func = llvm::cast_or_null<llvm::Function>(
+          static_cast<llvm::Value *>(template_func))) {
+    func->eraseFromParent();
+  }
+  template_func = nullptr;
+  has_template_func = false;
+  templates.clear();
+}
+
+// If `func` isn't `last_func`, then clear out the caches of registers.
+void InstructionLifter::Impl::ResetCacheIfNewFunction(llvm::Function *func) {
+  if (func != last_func) {
+    reg_ptr_cache.clear();
+    reg_ptr_by_index.assign(arch->NumRegisters(), nullptr);
+    func_vars.clear();
+    func_vars_indexed = false;
+    last_func = func;
+    reg_addresses_hoisted = false;
+    invariant_reg_vals.assign(arch->NumRegisters(), nullptr);
+    scratch_reg_ptrs.assign(arch->NumRegisters(), nullptr);
+    last_block = nullptr;
+    InvalidateRegValues();
+    addr_memo.clear();
+    expr_memo.clear();
+
+    CHECK_EQ(func->getParent(), module);
+  }
+}
+
+// Returns the subprogram of `func` in which its guest PC debug locations are
+// scoped, creating it if need be.
+llvm::DISubprogram *
+InstructionLifter::Impl::GuestSubprogram(llvm::Function *func, uint64_t pc) {
+  if (auto sp = func->getSubprogram()) {
+    return sp;
+  }
+
+  // Every lifted function of `module` shares one compile unit, whose only
+  // file stands in for the guest program.
+  if (!di_builder) {
+    di_builder = std::make_unique<llvm::DIBuilder>(*module);
+    di_file = di_builder->createFile("<guest>", ".");
+    di_builder->createCompileUnit(llvm::dwarf::DW_LANG_C, di_file, "remill",
+                                  true /* isOptimized */, "", 0, "",
+                                  llvm::DICompileUnit::LineTablesOnly);
+    di_func_type = di_builder->createSubroutineType(
+        di_builder->getOrCreateTypeArray({}));
+    if (!module->getModuleFlag("Debug Info Version")) {
+      module->addModuleFlag(llvm::Module::Warning, "Debug Info Version",
+                            llvm::DEBUG_METADATA_VERSION);
+    }
+  }
+
+  const auto line = static_cast<unsigned>(pc);
+  const auto sp = di_builder->createFunction(
+      di_file, func->getName(), func->getName(), di_file, line, di_func_type,
+      line, llvm::DINode::FlagZero, llvm::DISubprogram::SPFlagDefinition);
+  di_builder->finalizeSubprogram(sp);
+  func->setSubprogram(sp);
+  return sp;
+}
+
+// Find the variable `name` of `last_func` through `func_vars`.
+llvm::Value *InstructionLifter::Impl::FindVar(std::string_view name_) {
+  if (!func_vars_indexed) {
+    func_vars_indexed = true;
+    if (!last_func->empty()) {
+      for (auto &inst : last_func->getEntryBlock()) {
+        if (inst.hasName()) {
+          func_vars.try_emplace(inst.getName(), &inst);
+        }
+      }
+    }
+    for (auto &arg : last_func->args()) {
+      if (arg.hasName()) {
+        func_vars.try_emplace(arg.getName(), &arg);
+      }
+    }
+  }
+
+  const llvm::StringRef name(name_.data(), name_.size());
+  if (auto var = func_vars.lookup(name)) {
+    return var;
+  }
+
+  if (lazy_block_vars) {
+    if (auto var = CloneBlockVariableInto(last_func, name_)) {
+      func_vars.try_emplace(name, var);
+      return var;
+    }
+  }
+
+  return module->getGlobalVariable(name);
+}
+
+// Fill in `reg_ptr_by_index` with the address of every register in
+// `shared->reg_address_template`, computed from `state_ptr` at the start of
+// `func`'s entry block.
+void InstructionLifter::Impl::HoistRegisterAddresses(llvm::Function *func,
+                                                     llvm::Value *state_ptr) {
+  reg_addresses_hoisted = true;
+
+  // Only the `State` pointer argument is available at the start of the entry
+  // block; otherwise the addresses are computed one at a time, as needed.
+  auto state_arg = llvm::dyn_cast<llvm::Argument>(state_ptr);
+  if (!state_arg || state_arg->getParent() != func) {
+    return;
+  }
+
+  // Variables in the function shadow registers of the same name.
+  llvm::StringSet<> shadowed;
+  for (auto &inst : func->getEntryBlock()) {
+    if (inst.hasName()) {
+      shadowed.insert(inst.getName());
+    }
+  }
+  for (auto &arg : func->args()) {
+    if (arg.hasName()) {
+      shadowed.insert(arg.getName());
+    }
+  }
+  if (lazy_block_vars) {
+    for (auto &inst : BasicBlockFunction(module)->getEntryBlock()) {
+      if (inst.hasName()) {
+        shadowed.insert(inst.getName());
+      }
+    }
+  }
+
+  auto &entry_block = func->getEntryBlock();
+  llvm::IRBuilder<> ir(&entry_block, entry_block.getFirstInsertionPt());
+  for (auto reg : shared->reg_address_template) {
+    auto &reg_ptr = reg_ptr_by_index[reg->index];
+    if (reg_ptr || shadowed.count(reg->name) ||
+        module->getGlobalVariable(reg->name)) {
+      continue;
+    }
+    reg_ptr = reg->AddressOf(state_ptr, ir);
+  }
+}
+
+// Returns the architectural register named by `reg`.
+const Register *
+InstructionLifter::Impl::ResolveRegister(Operand::Register &reg) const {
+  if (!reg.arch_reg || reg.arch_reg->name != reg.name) {
+    reg.arch_reg = arch->RegisterByName(reg.name);
+  }
+  return reg.arch_reg;
+}
+
+// Returns `true` if `call` might read from the `State` structure.
+static bool MayReadState(llvm::CallInst *call, llvm::Type *mem_ptr_type) {
+  if (call->doesNotAccessMemory()) {
+    return false;
+  }
+
+  // Remill's intrinsics, e.g. memory accesses, only observe the `State`
+  // structure if they're given a pointer that might point into it.
+  const auto callee = call->getCalledFunction();
+  if (!callee || !callee->isDeclaration() ||
+      !callee->getName().startswith("__remill_")) {
+    return true;
+  }
+
+  for (auto &arg : call->args()) {
+    const auto arg_type = arg->getType();
+    if (arg_type->isPointerTy() && arg_type != mem_ptr_type &&
+        !llvm::isa<llvm::AllocaInst>(arg->stripInBoundsOffsets())) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Remove the bytes of `State` that `call`, a call to a semantics function, may
+// read according to its `summary` from `overwritten`. Returns `false` if the
+// call may read bytes that can't be located.
+static bool EraseSummarizedReads(llvm::CallInst *call,
+                                 const ISelSummary &summary,
+                                 llvm::Value *state_ptr,
+                                 const llvm::DataLayout &dl,
+                                 std::unordered_set<int64_t> &overwritten) {
+  if (call->arg_size() < 2 || call->getArgOperand(1) != state_ptr) {
+    return false;
+  }
+
+  for (auto [begin, end] : summary.state_reads) {
+    for (auto i = begin; i < end; ++i) {
+      overwritten.erase(static_cast<int64_t>(i));
+    }
+  }
+
+  for (auto [arg_num, size] : summary.arg_reads) {
+    if (arg_num >= call->arg_size()) {
+      return false;
+    }
+    int64_t offset = 0;
+    const auto base = llvm::GetPointerBaseWithConstantOffset(
+        call->getArgOperand(arg_num), offset, dl);
+    if (base == state_ptr) {
+      for (auto i = offset; i < offset + static_cast<int64_t>(size); ++i) {
+        overwritten.erase(i);
+      }
+    } else if (!llvm::isa<llvm::AllocaInst>(base)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Remove stores to the `State` structure in `block` that are overwritten
+// later in `block` before being read.
+void InstructionLifter::Impl::EliminateDeadStateStores(llvm::BasicBlock *block,
+                                                       llvm::Value *state_ptr) {
+  const llvm::DataLayout dl(module);
+  const auto mem_ptr_type =
+      NthArgument(block->getParent(), kMemoryPointerArgNum)->getType();
+
+  // Bytes of `State` that are written before they're next read, as of the
+  // current instruction in the backward walk.
+  std::unordered_set<int64_t> overwritten;
+  std::vector<llvm::StoreInst *> dead_stores;
+
+  for (auto it = block->rbegin(); it != block->rend(); ++it) {
+    if (auto store = llvm::dyn_cast<llvm::StoreInst>(&*it)) {
+      int64_t offset = 0;
+      const auto base = llvm::GetPointerBaseWithConstantOffset(
+          store->getPointerOperand(), offset, dl);
+      if (base != state_ptr) {
+        continue;
+      }
+
+      const auto size = static_cast<int64_t>(
+          dl.getTypeStoreSize(store->getValueOperand()->getType()));
+      auto is_dead = store->isSimple();
+      for (auto i = offset; i < offset + size; ++i) {
+        is_dead = overwritten.count(i) && is_dead;
+        overwritten.insert(i);
+      }
+
+      if (is_dead) {
+        dead_stores.push_back(store);
+      }
+
+    } else if (auto load = llvm::dyn_cast<llvm::LoadInst>(&*it)) {
+      int64_t offset = 0;
+      const auto base = llvm::GetPointerBaseWithConstantOffset(
+          load->getPointerOperand(), offset, dl);
+      if (base == state_ptr) {
+        const auto size =
+            static_cast<int64_t>(dl.getTypeStoreSize(load->getType()));
+        for (auto i = offset; i < offset + size; ++i) {
+          overwritten.erase(i);
+        }
+      } else if (!llvm::isa<llvm::AllocaInst>(base)) {
+        overwritten.clear();
+      }
+
+    } else if (auto call = llvm::dyn_cast<llvm::CallInst>(&*it)) {
+
+      // Calls to summarized semantics functions only read some of `State`.
+      const auto callee = call->getCalledFunction();
+      const auto &summaries = shared->index->isel_summaries;
+      if (auto summary_it =
+              callee ? summaries.find(callee->getName()) : summaries.end();
+          summary_it != summaries.end() &&
+          EraseSummarizedReads(call, summary_it->second, state_ptr, dl,
+                               overwritten)) {
+        continue;
+      }
+
+      if (MayReadState(call, mem_ptr_type)) {
+        overwritten.clear();
+      }
+
+    } else if (it->mayReadFromMemory()) {
+      overwritten.clear();
+    }
+  }
+
+  for (auto store : dead_stores) {
+    const auto val = store->getValueOperand();
+    store->eraseFromParent();
+    llvm::RecursivelyDeleteTriviallyDeadInstructions(val);
+  }
+}
+
+// Rewrite the stack pointer values computed in `block` as constant offsets
+// from a base stack pointer value, i.e. the stack pointer on entry to `block`,
+// or the last value stored to it by something other than an addition or a
+// subtraction, and forward stores of the stack pointer to later loads of it.
+void InstructionLifter::Impl::FoldStackPointerDeltas(llvm::BasicBlock *block,
+                                                     llvm::Value *state_ptr) {
+  const auto sp_reg = arch->RegisterByName(arch->StackPointerRegisterName());
+  if (!sp_reg) {
+    return;
+  }
+
+  const llvm::DataLayout dl(module);
+  const auto mem_ptr_type =
+      NthArgument(block->getParent(), kMemoryPointerArgNum)->getType();
+  const auto sp_begin = static_cast<int64_t>(sp_reg->offset);
+  const auto sp_end = sp_begin + static_cast<int64_t>(sp_reg->size);
+
+  // Stack pointer values, as a base value plus a constant.
+  std::unordered_map<llvm::Value *, std::pair<llvm::Value *, int64_t>> deltas;
+
+  // The value in the stack pointer register, if it's known.
+  llvm::Value *sp_val = nullptr;
+
+  // Returns the kind of access to the `State` structure of `size` bytes at
+  // `ptr`: `1` if it accesses exactly the stack pointer, `-1` if it might
+  // access part of it, and `0` if it doesn't.
+  auto sp_access = [&](llvm::Value *ptr, llvm::Type *type) {
+    int64_t offset = 0;
+    const auto base = llvm::GetPointerBaseWithConstantOffset(ptr, offset, dl);
+    if (base != state_ptr) {
+      return llvm::isa<llvm::AllocaInst>(base) ? 0 : -1;
+    }
+    const auto size = static_cast<int64_t>(dl.getTypeStoreSize(type));
+    if (offset == sp_begin && size == (sp_end - sp_begin) &&
+        type->isIntegerTy()) {
+      return 1;
+    } else if (offset < sp_end && sp_begin < offset + size) {
+      return -1;
+    } else {
+      return 0;
+    }
+  };
+
+  std::vector<llvm::Instruction *> dead;
+  for (auto &inst : *block) {
+    if (auto load = llvm::dyn_cast<llvm::LoadInst>(&inst)) {
+      const auto kind = sp_access(load->getPointerOperand(), load->getType());
+      if (kind != 1 || !load->isSimple()) {
+        continue;
+      } else if (sp_val && sp_val->getType() == load->getType()) {
+        load->replaceAllUsesWith(sp_val);
+        dead.push_back(load);
+      } else {
+        sp_val = load;
+        deltas[load] = {load, 0};
+      }
+
+    } else if (auto store = llvm::dyn_cast<llvm::StoreInst>(&inst)) {
+      const auto val = store->getValueOperand();
+      const auto kind = sp_access(store->getPointerOperand(), val->getType());
+      if (kind == 1 && store->isSimple()) {
+        sp_val = val;
+        deltas.emplace(val, std::make_pair(val, 0));
+      } else if (kind) {
+        sp_val = nullptr;
+      }
+
+    } else if (auto binop = llvm::dyn_cast<llvm::BinaryOperator>(&inst)) {
+      const auto opcode = binop->getOpcode();
+      if (opcode != llvm::Instruction::Add &&
+          opcode != llvm::Instruction::Sub) {
+        continue;
+      }
+
+      // Look for `val + c`, `c + val`, or `val - c`, where `val` is a stack
+      // pointer value.
+      auto lhs = binop->getOperand(0);
+      auto rhs = llvm::dyn_cast<llvm::ConstantInt>(binop->getOperand(1));
+      if (!rhs && opcode == llvm::Instruction::Add) {
+        rhs = llvm::dyn_cast<llvm::ConstantInt>(lhs);
+        lhs = binop->getOperand(1);
+      }
+      auto delta_it = deltas.find(lhs);
+      if (!rhs || delta_it == deltas.end() || rhs->getBitWidth() > 64) {
+        continue;
+      }
+
+      const auto [base, delta] = delta_it->second;
+      const auto c = rhs->getSExtValue();
+      const auto new_delta = static_cast<int64_t>(
+          opcode == llvm::Instruction::Add
+              ? static_cast<uint64_t>(delta) + static_cast<uint64_t>(c)
+              : static_cast<uint64_t>(delta) - static_cast<uint64_t>(c));
+
+      if (!new_delta) {
+        binop->replaceAllUsesWith(base);
+        dead.push_back(binop);
+        continue;
+      }
+
+      deltas[binop] = {base, new_delta};
+      if (lhs != base) {
+        const auto type = binop->getType();
+        binop->setOperand(0, base);
+        binop->setOperand(
+            1, llvm::ConstantInt::get(
+                   type,
+                   static_cast<uint64_t>(opcode == llvm::Instruction::Add
+                                             ? new_delta
+                                             : -new_delta),
+                   true));
+        binop->dropPoisonGeneratingFlags();
+      }
+
+    } else if (auto call = llvm::dyn_cast<llvm::CallInst>(&inst)) {
+      if (MayReadState(call, mem_ptr_type)) {
+        sp_val = nullptr;
+      }
+
+    } else if (inst.mayWriteToMemory()) {
+      sp_val = nullptr;
+    }
+  }
+
+  for (auto inst : dead) {
+    if (inst->use_empty()) {
+      llvm::RecursivelyDeleteTriviallyDeadInstructions(inst);
+    }
+  }
+}
+
+// Keep the values of the integer registers written in `block` in SSA form,
+// merging writes to their sub-registers, and only store them back to the
+// `State` structure at the end of `block`, or before something else that
+// might access them.
+void InstructionLifter::Impl::MergeSubRegisterWrites(llvm::BasicBlock *block,
+                                                     llvm::Value *state_ptr) {
+  const llvm::DataLayout dl(module);
+  const auto mem_ptr_type =
+      NthArgument(block->getParent(), kMemoryPointerArgNum)->getType();
+
+  // The current value of an enclosing register, and whether or not it still
+  // needs to be stored back. Indexed by the offset of the register, so that
+  // registers are stored back in a deterministic order.
+  struct RegValue {
+    const Register *reg{nullptr};
+    llvm::Value *val{nullptr};
+    bool dirty{false};
+  };
+  std::map<uint64_t, RegValue> values;
+
+  llvm::IRBuilder<> ir(block);
+
+  // Store back the tracked registers overlapping the bytes `[begin, end)`
+  // before `inst`, and forget their values if `inst` might change them.
+  auto flush = [&](llvm::Instruction *inst, uint64_t begin, uint64_t end,
+                   bool forget) {
+    for (auto it = values.begin(); it != values.end();) {
+      auto &rv = it->second;
+      if (rv.reg->offset >= end || begin >= rv.reg->offset + rv.reg->size) {
+        ++it;
+        continue;
+      }
+      if (rv.dirty) {
+        ir.SetInsertPoint(inst);
+        ir.CreateStore(rv.val, rv.reg->AddressOf(state_ptr, ir));
+        rv.dirty = false;
+      }
+      it = forget ? values.erase(it) : std::next(it);
+    }
+  };
+
+  auto flush_all = [&](llvm::Instruction *inst, bool forget) {
+    flush(inst, 0, ~0ull, forget);
+  };
+
+  // Returns the enclosing register of an integer access of `type` to `ptr`,
+  // if the access is to the `State` structure, and entirely within one
+  // enclosing integer register of at most 64 bits. `offset` is set to the
+  // offset of the access in the `State` structure, or to `-1` if `ptr` might
+  // not point into the `State` structure. Sets `begin` and `end` to the range
+  // of bytes accessed in the `State` structure.
+  auto classify = [&](llvm::Value *ptr, llvm::Type *type, bool &is_state,
+                      uint64_t &begin, uint64_t &end) -> const Register * {
+    int64_t offset = 0;
+    const auto base = llvm::GetPointerBaseWithConstantOffset(ptr, offset, dl);
+    is_state = base == state_ptr;
+    if (!is_state || offset < 0) {
+      is_state = is_state || !llvm::isa<llvm::AllocaInst>(base);
+      begin = 0;
+      end = ~0ull;
+      return nullptr;
+    }
+
+    begin = static_cast<uint64_t>(offset);
+    end = begin + dl.getTypeStoreSize(type);
+    const auto sub_reg = arch->RegisterAtStateOffset(begin);
+    if (!sub_reg || !type->isIntegerTy()) {
+      return nullptr;
+    }
+
+    const auto reg = sub_reg->EnclosingRegister();
+    if (!reg->type->isIntegerTy() || reg->size > 8 || begin < reg->offset ||
+        end > reg->offset + reg->size ||
+        dl.getTypeStoreSize(reg->type) != reg->size) {
+      return nullptr;
+    }
+    return reg;
+  };
+
+  // Returns the shift amount of the bytes `[begin, end)` within `reg`.
+  auto shift_of = [&](const Register *reg, uint64_t begin, uint64_t end) {
+    return 8u * (dl.isLittleEndian() ? begin - reg->offset
+                                     : reg->offset + reg->size - end);
+  };
+
+  std::vector<llvm::Instruction *> dead;
+  for (auto &inst : *block) {
+    if (auto load = llvm::dyn_cast<llvm::LoadInst>(&inst)) {
+      bool is_state = false;
+      uint64_t begin = 0, end = 0;
+      const auto reg = classify(load->getPointerOperand(), load->getType(),
+                                is_state, begin, end);
+      auto it = reg ? values.find(reg->offset) : values.end();
+      if (it == values.end() || !load->isSimple()) {
+        if (is_state) {
+          flush(load, begin, end, false);
+        }
+        continue;
+      }
+
+      // Extract the value of the sub-register.
+      ir.SetInsertPoint(load);
+      llvm::Value *val = it->second.val;
+      if (const auto shift = shift_of(reg, begin, end)) {
+        val = ir.CreateLShr(val, shift);
+      }
+      if (val->getType() != load->getType()) {
+        val = ir.CreateTrunc(val, load->getType());
+      }
+      load->replaceAllUsesWith(val);
+      dead.push_back(load);
+
+    } else if (auto store = llvm::dyn_cast<llvm::StoreInst>(&inst)) {
+      const auto val = store->getValueOperand();
+      bool is_state = false;
+      uint64_t begin = 0, end = 0;
+      const auto reg = classify(store->getPointerOperand(), val->getType(),
+                                is_state, begin, end);
+      if (!reg || !store->isSimple()) {
+        if (is_state) {
+          flush(store, begin, end, true);
+        }
+        continue;
+      }
+
+      auto &rv = values[reg->offset];
+      rv.reg = reg;
+      rv.dirty = true;
+      dead.push_back(store);
+
+      // A full-width write replaces the value of the register.
+      if (begin == reg->offset && end == reg->offset + reg->size &&
+          val->getType() == reg->type) {
+        rv.val = val;
+        continue;
+      }
+
+      // Merge the write into the value of the register, loading the register
+      // first if it isn't yet tracked.
+      ir.SetInsertPoint(store);
+      if (!rv.val) {
+        rv.val = ir.CreateLoad(reg->type, reg->AddressOf(state_ptr, ir));
+      }
+      const auto reg_bits = static_cast<unsigned>(reg->size * 8u);
+      const auto shift = shift_of(reg, begin, end);
+      const auto mask = llvm::APInt::getBitsSet(
+          reg_bits, shift,
+          shift + static_cast<unsigned>((end - begin) * 8u));
+      auto merged = ir.CreateZExt(val, reg->type);
+      if (shift) {
+        merged = ir.CreateShl(merged, shift);
+      }
+      rv.val = ir.CreateOr(
+          ir.CreateAnd(rv.val, llvm::ConstantInt::get(reg->type, ~mask)),
+          merged);
+
+    } else if (auto call = llvm::dyn_cast<llvm::CallInst>(&inst)) {
+      if (MayReadState(call, mem_ptr_type)) {
+        flush_all(call, true);
+      }
+
+    } else if (inst.mayWriteToMemory()) {
+      flush_all(&inst, true);
+
+    } else if (inst.mayReadFromMemory()) {
+      flush_all(&inst, false);
+    }
+  }
+
+  // Everything after the block observes the registers.
+  if (auto term = block->getTerminator()) {
+    flush_all(term, true);
+  } else {
+    for (auto &[offset, rv] : values) {
+      if (rv.dirty) {
+        ir.SetInsertPoint(block);
+        ir.CreateStore(rv.val, rv.reg->AddressOf(state_ptr, ir));
+      }
+    }
+  }
+
+  for (auto inst : dead) {
+    inst->eraseFromParent();
+  }
+}
+
+// Find the register write operands of `insts` that are dead, i.e. that are
+// overwritten by later instructions of `insts` before being read. This is a
+// backward walk tracking the bytes of `State` that are overwritten before
+// they're next read, like `EliminateDeadStateStores`, but over the operands of
+// the decoded instructions and the `StateAccesses` of their semantics instead
+// of over lifted code.
+void InstructionLifter::Impl::FindDeadRegisterWrites(
+    llvm::MutableArrayRef<Instruction> insts, std::vector<uint64_t> &dead) {
+  dead.assign(insts.size(), 0);
+
+  std::unordered_set<int64_t> overwritten;
+  auto kill = [&](int64_t begin, int64_t end) {
+    for (auto i = begin; i < end; ++i) {
+      overwritten.insert(i);
+    }
+  };
+  auto read = [&](int64_t begin, int64_t end) {
+    for (auto i = begin; i < end; ++i) {
+      overwritten.erase(i);
+    }
+  };
+  auto read_reg = [&](const Register *reg) {
+    read(static_cast<int64_t>(reg->offset),
+         static_cast<int64_t>(reg->offset + reg->size));
+  };
+
+  // Returns `false` if `name` might not name a register, e.g. if it names a
+  // variable of the lifted function.
+  auto read_name = [&](const std::string &name) {
+    if (name.empty()) {
+      return true;
+    } else if (auto reg = arch->RegisterByName(name)) {
+      read_reg(reg);
+      return true;
+    } else if (IsPCName(name) && pc_reg) {
+      read_reg(pc_reg);
+      return true;
+    } else {
+      return false;
+    }
+  };
+
+  std::function<bool(const OperandExpression *)> read_expr =
+      [&](const OperandExpression *expr) {
+        if (!expr) {
+          return true;
+        } else if (auto llvm_op = std::get_if<LLVMOpExpr>(expr)) {
+          return read_expr(llvm_op->op1) && read_expr(llvm_op->op2);
+        } else if (auto reg = std::get_if<const Register *>(expr)) {
+          if (*reg) {
+            read_reg(*reg);
+          }
+          return true;
+        } else if (auto name = std::get_if<std::string>(expr)) {
+          return read_name(*name);
+        } else {
+          return true;
+        }
+      };
+
+  for (auto i = insts.size(); i--;) {
+    auto &inst = insts[i];
+    const auto isel_func =
+        inst.IsValid() ? GetInstructionFunction(inst) : nullptr;
+    if (!isel_func || inst.is_atomic_read_modify_write ||
+        inst.operands.size() > 64 ||
+        isel_func->arg_size() <
+            inst.operands.size() + kISelFirstOperandArgNum) {
+      overwritten.clear();
+      continue;
+    }
+
+    const auto &accesses = GetStateAccesses(isel_func);
+    auto arg_num = static_cast<unsigned>(kISelFirstOperandArgNum);
+    auto reads_all = accesses.reads_all;
+
+    // The registers written by the operands are dead if all of their bytes
+    // are overwritten later. Writes to part of the program counter are never
+    // dead, because `PC` and `NEXT_PC` are tracked separately.
+    for (auto j = 0u; j < inst.operands.size(); ++j, ++arg_num) {
+      auto &op = inst.operands[j];
+      if (Operand::kActionWrite != op.action ||
+          Operand::kTypeRegister != op.type) {
+        continue;
+      }
+      const auto reg = ResolveRegister(op.reg);
+      if (!reg) {
+        continue;
+      }
+      const auto outer = reg->EnclosingRegister();
+      const auto begin = static_cast<int64_t>(outer->offset);
+      const auto end = static_cast<int64_t>(outer->offset + outer->size);
+      auto is_dead = outer != pc_reg;
+      for (auto b = begin; b < end && is_dead; ++b) {
+        is_dead = overwritten.count(b) != 0;
+      }
+      if (is_dead) {
+        dead[i] |= 1ull << j;
+      }
 
-  CHECK(invalid_instruction != nullptr)
-      << kInvalidInstructionISelName << " doesn't exist";
+      // Only writes that always happen kill what the register held before.
+      const auto size = accesses.arg_kills[arg_num];
+      if (size >= static_cast<int64_t>(reg->size)) {
+        kill(static_cast<int64_t>(reg->offset),
+             static_cast<int64_t>(reg->offset) + size);
+      }
+    }
 
-  CHECK(unsupported_instruction != nullptr)
-      << kUnsupportedInstructionISelName << " doesn't exist";
+    for (auto [begin, end] : accesses.kill_ranges) {
+      kill(begin, end);
+    }
+
+    // Everything read by the operands, or by the semantics, is live before
+    // the instruction.
+    for (auto &op : inst.operands) {
+      switch (op.type) {
+        case Operand::kTypeRegister:
+          if (Operand::kActionRead == op.action) {
+            reads_all = reads_all || !read_name(op.reg.name);
+          }
+          break;
+        case Operand::kTypeShiftRegister:
+          reads_all = reads_all || !read_name(op.shift_reg.reg.name);
+          break;
+        case Operand::kTypeAddress:
+          reads_all = reads_all || !read_name(op.addr.base_reg.name) ||
+                      !read_name(op.addr.index_reg.name) ||
+                      !read_name(op.addr.segment_base_reg.name);
+          break;
+        case Operand::kTypeExpression:
+        case Operand::kTypeRegisterExpression:
+        case Operand::kTypeImmediateExpression:
+        case Operand::kTypeAddressExpression:
+          reads_all = reads_all || !read_expr(op.expr);
+          break;
+        default: break;
+      }
+    }
+
+    if (reads_all) {
+      overwritten.clear();
+    } else {
+      for (auto [begin, end] : accesses.read_ranges) {
+        read(begin, end);
+      }
+    }
+  }
+}
+
+// Returns `true` if `op` of `inst` writes to a dead register.
+bool InstructionLifter::Impl::IsDeadWrite(const Instruction &inst,
+                                          const Operand &op) const {
+  if (!block_ssa || !block_ssa->dead_writes || inst.operands.empty()) {
+    return false;
+  }
+  const auto j = static_cast<uint64_t>(&op - inst.operands.data());
+  return j < inst.operands.size() && ((block_ssa->dead_writes >> j) & 1);
 }
 
-InstructionLifter::~InstructionLifter(void) {}
+// Returns the address of scratch space in `func`'s entry block, that can
+// stand in for `reg`'s enclosing register.
+llvm::Value *InstructionLifter::Impl::ScratchRegAddress(llvm::Function *func,
+                                                        const Register *reg) {
+  auto &ptr = scratch_reg_ptrs[reg->index];
+  if (ptr) {
+    return ptr;
+  }
 
-InstructionLifter::InstructionLifter(const Arch *arch_,
-                                     const IntrinsicTable *intrinsics_)
-    : impl(new Impl(arch_, intrinsics_)) {}
+  auto &entry_block = func->getEntryBlock();
+  const auto outer = reg->EnclosingRegister();
+  if (outer == reg) {
+    llvm::IRBuilder<> ir(&entry_block, entry_block.begin());
+    ptr = ir.CreateAlloca(reg->type, nullptr, "dead_" + reg->name);
+    return ptr;
+  }
 
-// Lift a single instruction into a basic block. `is_delayed` signifies that
-// this instruction will execute within the delay slot of another instruction.
-LiftStatus InstructionLifter::LiftIntoBlock(Instruction &inst,
-                                            llvm::BasicBlock *block,
-                                            bool is_delayed) {
-  return LiftIntoBlock(inst, block,
-                       NthArgument(block->getParent(), kStatePointerArgNum),
-                       is_delayed);
+  // Point to where `reg` is within the scratch space of its enclosing
+  // register.
+  const auto outer_ptr =
+      llvm::cast<llvm::Instruction>(ScratchRegAddress(func, outer));
+  llvm::IRBuilder<> ir(outer_ptr->getNextNode());
+  const auto byte_ptr = ir.CreateBitCast(outer_ptr, ir.getInt8PtrTy());
+  const auto reg_ptr = ir.CreateConstInBoundsGEP1_64(
+      ir.getInt8Ty(), byte_ptr, reg->offset - outer->offset);
+  ptr = ir.CreateBitCast(reg_ptr, llvm::PointerType::get(reg->type, 0));
+  return ptr;
 }
 
-// Lift a single instruction into a basic block.
-LiftStatus InstructionLifter::LiftIntoBlock(Instruction &arch_inst,
-                                            llvm::BasicBlock *block,
-                                            llvm::Value *state_ptr,
-                                            bool is_delayed) {
+// Run some cheap cleanup passes over a copy of a semantics function.
+void InstructionLifter::Impl::CleanUpSemanticsCopy(llvm::Function *func) {
+  llvm::legacy::FunctionPassManager func_manager(module);
+  func_manager.add(llvm::createSROAPass());
+  func_manager.add(llvm::createSCCPPass());
+  func_manager.add(llvm::createEarlyCSEPass());
+  func_manager.add(llvm::createCFGSimplificationPass());
+  func_manager.doInitialization();
+  func_manager.run(*func);
+  func_manager.doFinalization();
+}
 
-  llvm::Function *const func = block->getParent();
-  llvm::Module *const module = func->getParent();
-  llvm::Function *isel_func = nullptr;
-  auto status = kLiftedInstruction;
+// Returns a version of `isel_func` specialized to the constant arguments in
+// `args`, and removes those arguments from `args`. Returns `isel_func` and
+// leaves `args` alone if there is no such specialization (yet).
+llvm::Function *
+InstructionLifter::Impl::GetSpecialization(llvm::Function *isel_func,
+                                           std::vector<llvm::Value *> &args) {
+  if (isel_func->isDeclaration() || isel_func->isVarArg()) {
+    return isel_func;
+  }
 
-  // Cache invalidation.
-  if (func != impl->last_func) {
-    impl->reg_ptr_cache.clear();
-    impl->last_func = func;
+  // The first two arguments are the memory and state pointers.
+  std::vector<llvm::Constant *> consts(args.size(), nullptr);
+  auto has_consts = false;
+  for (auto i = 2u; i < args.size(); ++i) {
+    if (llvm::isa<llvm::ConstantInt>(args[i]) ||
+        llvm::isa<llvm::ConstantFP>(args[i])) {
+      consts[i] = llvm::cast<llvm::Constant>(args[i]);
+      has_consts = true;
+    }
+  }
 
-    CHECK_EQ(impl->module, module)
-        << "InstructionLifter isn't using the correct module!";
+  if (!has_consts) {
+    return isel_func;
   }
 
-  if (arch_inst.IsValid()) {
-    isel_func = GetInstructionFunction(module, arch_inst.function);
-  } else {
-    isel_func = impl->invalid_instruction;
-    arch_inst.operands.clear();
-    status = kLiftedInvalidInstruction;
+  auto &spec = specializations[std::make_pair(isel_func, consts)];
+  auto spec_func = llvm::dyn_cast_or_null<llvm::Function>(spec.func);
+  if (!spec_func) {
+
+    // Only specialize operand values that repeat, and don't let things like
+    // branch targets produce an unbounded number of variants.
+    auto &num_variants = num_specializations[isel_func];
+    if (++spec.num_uses < kMinSpecializationUses ||
+        num_variants >= kMaxSpecializationsPerISel) {
+      return isel_func;
+    }
+
+    // Mapping arguments to constants removes them from the copy's signature.
+    llvm::ValueToValueMapTy value_map;
+    for (auto i = 2u; i < consts.size(); ++i) {
+      if (consts[i]) {
+        value_map[NthArgument(isel_func, i)] = consts[i];
+      }
+    }
+
+    spec_func = llvm::CloneFunction(isel_func, value_map);
+    spec_func->setName(isel_func->getName() + ".spec");
+    spec_func->setLinkage(llvm::GlobalValue::InternalLinkage);
+    spec_func->removeFnAttr(llvm::Attribute::NoInline);
+    spec_func->removeFnAttr(llvm::Attribute::OptimizeNone);
+    CleanUpSemanticsCopy(spec_func);
+    spec.func = spec_func;
+    num_variants += 1;
   }
 
-  if (!isel_func) {
-    LOG(ERROR) << "Missing semantics for instruction " << arch_inst.Serialize();
-    isel_func = impl->unsupported_instruction;
-    arch_inst.operands.clear();
-    status = kLiftedUnsupportedInstruction;
+  std::vector<llvm::Value *> spec_args;
+  spec_args.reserve(args.size());
+  for (auto i = 0u; i < args.size(); ++i) {
+    if (!consts[i]) {
+      spec_args.push_back(args[i]);
+    }
   }
+  args.swap(spec_args);
+  return spec_func;
+}
 
-  llvm::IRBuilder<> ir(block);
-  const auto mem_ptr_ref =
-      LoadRegAddress(block, state_ptr, kMemoryVariableName);
-  const auto pc_ref = LoadRegAddress(block, state_ptr, kPCVariableName);
-  const auto next_pc_ref =
-      LoadRegAddress(block, state_ptr, kNextPCVariableName);
-  const auto next_pc = ir.CreateLoad(next_pc_ref);
+// Returns a copy of `isel_func` that has been cleaned up for being inlined at
+// lift time, or `nullptr` if `isel_func` isn't a good candidate for that.
+llvm::Function *
+InstructionLifter::Impl::GetInlineBody(llvm::Function *isel_func) {
+  auto [it, inserted] = inline_bodies.try_emplace(isel_func);
+  if (!inserted) {
+    return llvm::dyn_cast_or_null<llvm::Function>(it->second);
+  }
 
-  // If this instruction appears within a delay slot, then we're going to assume
-  // that the prior instruction updated `PC` to the target of the CTI, and that
-  // the value in `NEXT_PC` on entry to this instruction represents the actual
-  // address of this instruction, so we'll swap `PC` and `NEXT_PC`.
-  //
-  // TODO(pag): An alternate approach may be to call some kind of `DELAY_SLOT`
-  //            semantics function.
-  if (is_delayed) {
-    llvm::Value *temp_args[] = {ir.CreateLoad(mem_ptr_ref)};
-    ir.CreateStore(ir.CreateCall(impl->intrinsics->delay_slot_begin, temp_args),
-                   mem_ptr_ref);
+  if (isel_func->isDeclaration() || isel_func->isVarArg()) {
+    return nullptr;
+  }
 
-    // Leave `PC` and `NEXT_PC` alone; we assume that the semantics have done
-    // the right thing initializing `PC` and `NEXT_PC` for the delay slots.
+  llvm::ValueToValueMapTy value_map;
+  const auto body = llvm::CloneFunction(isel_func, value_map);
+  body->setName(isel_func->getName() + ".inline");
+  body->setLinkage(llvm::GlobalValue::InternalLinkage);
+  body->removeFnAttr(llvm::Attribute::NoInline);
+  body->removeFnAttr(llvm::Attribute::OptimizeNone);
 
-  } else {
+  CleanUpSemanticsCopy(body);
 
-    // Update the current program counter. Control-flow instructions may update
-    // the program counter in the semantics code.
-    ir.CreateStore(next_pc, pc_ref);
-    ir.CreateStore(
-        ir.CreateAdd(next_pc, llvm::ConstantInt::get(impl->word_type,
-                                                     arch_inst.bytes.size())),
-        next_pc_ref);
+  // Only single-block bodies can be spliced into the block being lifted
+  // without splitting it.
+  if (body->size() != 1 ||
+      !llvm::isa<llvm::ReturnInst>(body->getEntryBlock().getTerminator())) {
+    body->eraseFromParent();
+    return nullptr;
   }
 
-  // Begin an atomic block.
-  if (arch_inst.is_atomic_read_modify_write) {
-    llvm::Value *temp_args[] = {ir.CreateLoad(mem_ptr_ref)};
-    ir.CreateStore(ir.CreateCall(impl->intrinsics->atomic_begin, temp_args),
-                   mem_ptr_ref);
+  it->second = body;
+  return body;
+}
+
+// Count the lifting outcome `status` for the semantics function of `inst`.
+void InstructionLifter::Impl::CountLiftStatus(const Instruction &inst,
+                                              LiftStatus status) {
+  if (stats) {
+    const auto &name =
+        inst.function.empty() ? kInvalidInstructionISelName : inst.function;
+    status_counts[name][status] += 1;
   }
+}
 
-  std::vector<llvm::Value *> args;
-  args.reserve(arch_inst.operands.size() + 2);
+// If `block` isn't `last_block`, then clear out the forwarded values and
+// memoized computations.
+void InstructionLifter::Impl::ResetValuesIfNewBlock(llvm::BasicBlock *block) {
+  if (block != last_block) {
+    InvalidateRegValues();
+    addr_memo.clear();
+    expr_memo.clear();
+    last_block = block;
+  }
+  if (reg_val_by_index.size() != arch->NumRegisters()) {
+    reg_val_by_index.assign(arch->NumRegisters(), nullptr);
+  }
+}
 
-  // First two arguments to an instruction semantics function are the
-  // state pointer, and a pointer to the memory pointer.
-  args.push_back(nullptr);
-  args.push_back(state_ptr);
+// Forget the forwarded values of all registers.
+void InstructionLifter::Impl::InvalidateRegValues(void) {
+  for (auto reg : live_reg_vals) {
+    reg_val_by_index[reg->index] = nullptr;
+  }
+  live_reg_vals.clear();
+}
 
-  auto isel_func_type = isel_func->getFunctionType();
-  auto arg_num = 2U;
+// Forget the forwarded values of registers overlapping the bytes
+// `[begin, end)` of the `State` structure.
+void InstructionLifter::Impl::InvalidateRegValues(int64_t begin, int64_t end) {
+  auto it = std::remove_if(
+      live_reg_vals.begin(), live_reg_vals.end(), [=](const Register *reg) {
+        const auto reg_begin = static_cast<int64_t>(reg->offset);
+        const auto reg_end = static_cast<int64_t>(reg->offset + reg->size);
+        if (reg_begin < end && begin < reg_end) {
+          reg_val_by_index[reg->index] = nullptr;
+          return true;
+        }
+        return false;
+      });
+  live_reg_vals.erase(it, live_reg_vals.end());
+}
 
-  for (auto &op : arch_inst.operands) {
-    if (!(arg_num < isel_func_type->getNumParams())) {
-      return kLiftedMismatchedISEL;
+// Forget the forwarded values of registers overlapping `reg`.
+void InstructionLifter::Impl::InvalidateRegValues(const Register *reg) {
+  if (reg) {
+    InvalidateRegValues(static_cast<int64_t>(reg->offset),
+                        static_cast<int64_t>(reg->offset + reg->size));
+  }
+}
+
+// Forget the forwarded values of registers that might be written by the
+// call to `isel_func` implementing `inst`.
+void InstructionLifter::Impl::InvalidateRegValuesWrittenBy(
+    Instruction &inst, llvm::Function *isel_func) {
+  if (live_reg_vals.empty()) {
+    return;
+  }
+
+  // Write operands are passed as pointers into the `State` structure.
+  for (auto &op : inst.operands) {
+    if (Operand::kActionWrite != op.action) {
+      continue;
+    } else if (Operand::kTypeRegister == op.type) {
+      if (auto reg = ResolveRegister(op.reg); reg) {
+        InvalidateRegValues(reg);
+      } else {
+        InvalidateRegValues();
+        return;
+      }
+    } else if (Operand::kTypeAddress != op.type) {
+      InvalidateRegValues();
+      return;
     }
+  }
 
-    auto arg = NthArgument(isel_func, arg_num);
-    auto arg_type = arg->getType();
-    auto operand = LiftOperand(arch_inst, block, state_ptr, arg, op);
-    arg_num += 1;
-    auto op_type = operand->getType();
-    CHECK(op_type == arg_type)
-        << "Lifted operand " << op.Serialize() << " to " << arch_inst.function
-        << " does not have the correct type. Expected "
-        << LLVMThingToString(arg_type) << " but got "
-        << LLVMThingToString(op_type) << ".";
+  // The semantics may also directly store to some parts of the `State`
+  // structure, e.g. to the arithmetic flags.
+  const auto &writes = GetStateAccesses(isel_func);
+  if (writes.clobbers_all) {
+    InvalidateRegValues();
+  } else {
+    for (auto [begin, end] : writes.ranges) {
+      InvalidateRegValues(begin, end);
+    }
+  }
+}
 
-    args.push_back(operand);
+// Returns `true` if the semantics of `inst` might write to any part of
+// `reg`. Anything unknown is assumed to write to `reg`.
+bool InstructionLifter::Impl::MayWriteRegister(Instruction &inst,
+                                               const Register *reg) {
+  const auto isel_func =
+      inst.IsValid() ? GetInstructionFunction(inst) : nullptr;
+  if (!isel_func) {
+    return true;
   }
 
-  // Pass in current value of the memory pointer.
-  args[0] = ir.CreateLoad(mem_ptr_ref);
+  const auto reg_begin = static_cast<int64_t>(reg->offset);
+  const auto reg_end = static_cast<int64_t>(reg->offset + reg->size);
+  auto overlaps = [=](const Register *written) {
+    return !written ||
+           (static_cast<int64_t>(written->offset) < reg_end &&
+            reg_begin < static_cast<int64_t>(written->offset + written->size));
+  };
+
+  for (auto &op : inst.operands) {
+    if (Operand::kActionWrite != op.action) {
+      continue;
+
+    } else if (Operand::kTypeRegister == op.type) {
+      if (overlaps(ResolveRegister(op.reg))) {
+        return true;
+      }
 
-  // Call the function that implements the instruction semantics.
-  ir.CreateStore(ir.CreateCall(isel_func, args), mem_ptr_ref);
+    // Expressions may write to registers, or to variables of the lifted
+    // function, e.g. `BRANCH_TAKEN`, that aren't registers.
+    } else if (Operand::kTypeExpression == op.type) {
+      if (!op.expr) {
+        return true;
+      } else if (auto written = std::get_if<const Register *>(op.expr)) {
+        if (overlaps(*written)) {
+          return true;
+        }
+      } else if (auto var = std::get_if<std::string>(op.expr)) {
+        if (auto written = arch->RegisterByName(*var);
+            written && overlaps(written)) {
+          return true;
+        }
+      } else {
+        return true;
+      }
 
-  // End an atomic block.
-  if (arch_inst.is_atomic_read_modify_write) {
-    llvm::Value *temp_args[] = {ir.CreateLoad(mem_ptr_ref)};
-    ir.CreateStore(ir.CreateCall(impl->intrinsics->atomic_end, temp_args),
-                   mem_ptr_ref);
+    } else if (Operand::kTypeAddress != op.type) {
+      return true;
+    }
   }
 
-  // Restore the true target of the delayed branch.
-  if (is_delayed) {
+  const auto &writes = GetStateAccesses(isel_func);
+  if (writes.clobbers_all) {
+    return true;
+  }
+  for (auto [begin, end] : writes.ranges) {
+    if (begin < reg_end && reg_begin < end) {
+      return true;
+    }
+  }
+  return false;
+}
 
-    // This is the delayed update of the program counter.
-    ir.CreateStore(next_pc, pc_ref);
+// Summarize the loads and stores that `func` performs through its `State`
+// pointer. Anything other than loads and stores through constant offsets from
+// the `State` pointer, e.g. passing it to another function, is treated as
+// possibly reading and writing all of `State`. Stores in the entry block
+// always happen, and so kill whatever was there before.
+const InstructionLifter::Impl::StateAccesses &
+InstructionLifter::Impl::GetStateAccesses(llvm::Function *func) {
+  auto &accesses = state_accesses[func];
+  if (accesses.is_valid) {
+    return accesses;
+  }
 
-    // We don't know what the `NEXT_PC` is going to be because of the next
-    // instruction size is unknown (really, it's likely to be
-    // `arch->MaxInstructionSize()`), and for normal instructions, before they
-    // are lifted, we do the `PC = NEXT_PC + size`, so this is fine.
-    ir.CreateStore(next_pc, next_pc_ref);
+  accesses.is_valid = true;
+  if (func->isDeclaration() || func->arg_size() <= kISelStatePointerArgNum) {
+    accesses.clobbers_all = true;
+    accesses.reads_all = true;
+    return accesses;
+  }
+
+  const llvm::DataLayout dl(module);
+  const auto entry_block = &(func->getEntryBlock());
+  auto store_size = [&](llvm::StoreInst *store) {
+    return static_cast<int64_t>(
+        dl.getTypeStoreSize(store->getValueOperand()->getType()));
+  };
+
+  std::vector<std::pair<llvm::Value *, int64_t>> work_list;
+  work_list.emplace_back(NthArgument(func, kISelStatePointerArgNum), 0);
+
+  while (!work_list.empty() && !accesses.clobbers_all) {
+    const auto [ptr, offset] = work_list.back();
+    work_list.pop_back();
+
+    for (auto &use : ptr->uses()) {
+      const auto user = use.getUser();
+      if (auto load = llvm::dyn_cast<llvm::LoadInst>(user)) {
+        const auto size =
+            static_cast<int64_t>(dl.getTypeStoreSize(load->getType()));
+        accesses.read_ranges.emplace_back(offset, offset + size);
+
+      } else if (auto store = llvm::dyn_cast<llvm::StoreInst>(user)) {
+        if (store->getPointerOperand() != ptr) {
+          accesses.clobbers_all = true;  // The `State` pointer escapes.
+          break;
+        }
+        const auto range = std::make_pair(offset, offset + store_size(store));
+        accesses.ranges.push_back(range);
+        if (store->getParent() == entry_block) {
+          accesses.kill_ranges.push_back(range);
+        }
+
+      } else if (llvm::isa<llvm::BitCastOperator>(user)) {
+        work_list.emplace_back(user, offset);
+
+      } else if (auto gep = llvm::dyn_cast<llvm::GEPOperator>(user)) {
+        llvm::APInt gep_offset(dl.getIndexTypeSizeInBits(gep->getType()), 0);
+        if (gep->getPointerOperand() != ptr ||
+            !gep->accumulateConstantOffset(dl, gep_offset)) {
+          accesses.clobbers_all = true;
+          break;
+        }
+        work_list.emplace_back(gep, offset + gep_offset.getSExtValue());
+
+      } else {
+        accesses.clobbers_all = true;
+        break;
+      }
+    }
+  }
 
-    llvm::Value *temp_args[] = {ir.CreateLoad(mem_ptr_ref)};
-    ir.CreateStore(ir.CreateCall(impl->intrinsics->delay_slot_end, temp_args),
-                   mem_ptr_ref);
+  if (accesses.clobbers_all) {
+    accesses.reads_all = true;
+    accesses.ranges.clear();
+    accesses.read_ranges.clear();
+    accesses.kill_ranges.clear();
   }
 
-  return status;
+  // Find the stores through the other pointer arguments that always happen.
+  // These arguments are sometimes passed as integers (see
+  // `IntendedArgumentType`).
+  accesses.arg_kills.assign(func->arg_size(), 0);
+  for (auto &arg : func->args()) {
+    std::vector<llvm::Value *> ptrs = {&arg};
+    while (!ptrs.empty()) {
+      const auto ptr = ptrs.back();
+      ptrs.pop_back();
+      for (auto user : ptr->users()) {
+        if (llvm::isa<llvm::BitCastOperator>(user) ||
+            llvm::isa<llvm::IntToPtrInst>(user)) {
+          ptrs.push_back(user);
+        } else if (auto store = llvm::dyn_cast<llvm::StoreInst>(user);
+                   store && store->getPointerOperand() == ptr &&
+                   store->getParent() == entry_block) {
+          auto &size = accesses.arg_kills[arg.getArgNo()];
+          size = std::max(size, store_size(store));
+        }
+      }
+    }
+  }
+
+  return accesses;
 }
 
 // Load the address of a register.
@@ -225,61 +2342,21 @@ InstructionLifter::LoadRegAddress(llvm::BasicBlock *block,
   const auto func = block->getParent();
 
   // Invalidate the cache.
-  if (func != impl->last_func) {
-    impl->reg_ptr_cache.clear();
-    impl->last_func = func;
+  impl->ResetCacheIfNewFunction(func);
 
-    CHECK_EQ(func->getParent(), impl->module);
-  }
-
-  std::string reg_name(reg_name_.data(), reg_name_.size());
-  auto [reg_ptr_it, added] =
-      impl->reg_ptr_cache.emplace(std::move(reg_name), nullptr);
-
-  if (reg_ptr_it->second) {
-    (void) added;
-    return reg_ptr_it->second;
+  auto &reg_ptr = impl->reg_ptr_cache[llvm::StringRef(reg_name_.data(),
+                                                      reg_name_.size())];
+  if (reg_ptr) {
+    return reg_ptr;
 
   // It's already a variable in the function.
-  } else if (const auto var_ptr = FindVarInFunction(func, reg_name_, true);
-             var_ptr) {
-    reg_ptr_it->second = var_ptr;
+  } else if (const auto var_ptr = impl->FindVar(reg_name_); var_ptr) {
+    reg_ptr = var_ptr;
     return var_ptr;
 
-  // It's a register known to this architecture, so go and build a GEP to it
-  // right now. We'll try to be careful about the placement of the actual
-  // indexing instructions so that they always follow the definition of the
-  // state pointer, and thus are most likely to dominate all future uses.
+  // It's a register known to this architecture.
   } else if (auto reg = impl->arch->RegisterByName(reg_name_); reg) {
-    llvm::Value *reg_ptr = nullptr;
-
-    // The state pointer is an argument.
-    if (auto state_arg = llvm::dyn_cast<llvm::Argument>(state_ptr); state_arg) {
-      DCHECK_EQ(state_arg->getParent(), block->getParent());
-      auto &target_block = block->getParent()->getEntryBlock();
-      llvm::IRBuilder<> ir(&target_block, target_block.getFirstInsertionPt());
-      reg_ptr = reg->AddressOf(state_ptr, ir);
-
-    // The state pointer is an instruction, likely an `AllocaInst`.
-    } else if (auto state_inst = llvm::dyn_cast<llvm::Instruction>(state_ptr);
-               state_inst) {
-      llvm::IRBuilder<> ir(state_inst);
-      reg_ptr = reg->AddressOf(state_ptr, ir);
-
-    // The state pointer is a constant, likely an `llvm::GlobalVariable`.
-    } else if (auto state_const = llvm::dyn_cast<llvm::Constant>(state_ptr);
-               state_const) {
-      auto &target_block = block->getParent()->getEntryBlock();
-      llvm::IRBuilder<> ir(&target_block, target_block.getFirstInsertionPt());
-      reg_ptr = reg->AddressOf(state_ptr, ir);
-
-    // Not sure.
-    } else {
-      LOG(FATAL) << "Unsupported value type for the State pointer: "
-                 << LLVMThingToString(state_ptr);
-    }
-
-    reg_ptr_it->second = reg_ptr;
+    reg_ptr = LoadRegAddress(block, state_ptr, reg);
     return reg_ptr;
 
   } else {
@@ -288,10 +2365,76 @@ InstructionLifter::LoadRegAddress(llvm::BasicBlock *block,
   }
 }
 
+// Load the address of a register.
+llvm::Value *InstructionLifter::LoadRegAddress(llvm::BasicBlock *block,
+                                               llvm::Value *state_ptr,
+                                               const Register *reg) const {
+  const auto func = block->getParent();
+
+  // Invalidate the cache.
+  impl->ResetCacheIfNewFunction(func);
+
+  CHECK_LT(reg->index, impl->reg_ptr_by_index.size())
+      << "Register " << reg->name << " doesn't belong to this architecture";
+
+  if (impl->hoist_reg_addresses && !impl->reg_addresses_hoisted) {
+    impl->HoistRegisterAddresses(func, state_ptr);
+  }
+
+  auto &reg_ptr = impl->reg_ptr_by_index[reg->index];
+  if (reg_ptr) {
+    return reg_ptr;
+  }
+
+  // Variables in the function shadow registers of the same name.
+  if (const auto var_ptr = impl->FindVar(reg->name); var_ptr) {
+    reg_ptr = var_ptr;
+    return var_ptr;
+  }
+
+  // Go and build a GEP to the register right now. We'll try to be careful about
+  // the placement of the actual indexing instructions so that they always
+  // follow the definition of the state pointer, and thus are most likely to
+  // dominate all future uses.
+
+  // The state pointer is an argument.
+  if (auto state_arg = llvm::dyn_cast<llvm::Argument>(state_ptr); state_arg) {
+    DCHECK_EQ(state_arg->getParent(), block->getParent());
+    auto &target_block = block->getParent()->getEntryBlock();
+    llvm::IRBuilder<> ir(&target_block, target_block.getFirstInsertionPt());
+    reg_ptr = reg->AddressOf(state_ptr, ir);
+
+  // The state pointer is an instruction, likely an `AllocaInst`.
+  } else if (auto state_inst = llvm::dyn_cast<llvm::Instruction>(state_ptr);
+             state_inst) {
+    llvm::IRBuilder<> ir(state_inst);
+    reg_ptr = reg->AddressOf(state_ptr, ir);
+
+  // The state pointer is a constant, likely an `llvm::GlobalVariable`.
+  } else if (auto state_const = llvm::dyn_cast<llvm::Constant>(state_ptr);
+             state_const) {
+    auto &target_block = block->getParent()->getEntryBlock();
+    llvm::IRBuilder<> ir(&target_block, target_block.getFirstInsertionPt());
+    reg_ptr = reg->AddressOf(state_ptr, ir);
+
+  // Not sure.
+  } else {
+    LOG(FATAL) << "Unsupported value type for the State pointer: "
+               << LLVMThingToString(state_ptr);
+  }
+
+  return reg_ptr;
+}
+
 // Clear out the cache of the current register values/addresses loaded.
 void InstructionLifter::ClearCache(void) const {
   impl->reg_ptr_cache.clear();
+  impl->reg_ptr_by_index.clear();
   impl->last_func = nullptr;
+  impl->last_block = nullptr;
+  impl->InvalidateRegValues();
+  impl->addr_memo.clear();
+  impl->expr_memo.clear();
 }
 
 // Load the value of a register.
@@ -300,10 +2443,40 @@ llvm::Value *InstructionLifter::LoadRegValue(llvm::BasicBlock *block,
                                              std::string_view reg_name) const {
   auto ptr = LoadRegAddress(block, state_ptr, reg_name);
   CHECK_NOTNULL(ptr);
+
+  // Forward the value if this names an architectural register, and not some
+  // other variable in the function.
+  if (impl->forward_reg_values) {
+    if (auto reg = impl->arch->RegisterByName(reg_name);
+        reg && ptr == LoadRegAddress(block, state_ptr, reg)) {
+      return LoadRegValue(block, state_ptr, reg);
+    }
+  }
+
   auto ptr_ty = ptr->getType()->getPointerElementType();
   return new llvm::LoadInst(ptr_ty, ptr, llvm::Twine::createNull(), block);
 }
 
+// Load the value of a register.
+llvm::Value *InstructionLifter::LoadRegValue(llvm::BasicBlock *block,
+                                             llvm::Value *state_ptr,
+                                             const Register *reg) const {
+  auto ptr = LoadRegAddress(block, state_ptr, reg);
+  CHECK_NOTNULL(ptr);
+  auto ptr_ty = ptr->getType()->getPointerElementType();
+  if (!impl->forward_reg_values) {
+    return new llvm::LoadInst(ptr_ty, ptr, llvm::Twine::createNull(), block);
+  }
+
+  impl->ResetValuesIfNewBlock(block);
+  auto &val = impl->reg_val_by_index[reg->index];
+  if (!val) {
+    val = new llvm::LoadInst(ptr_ty, ptr, llvm::Twine::createNull(), block);
+    impl->live_reg_vals.push_back(reg);
+  }
+  return val;
+}
+
 // Return a register value, or zero.
 llvm::Value *InstructionLifter::LoadWordRegValOrZero(llvm::BasicBlock *block,
                                                      llvm::Value *state_ptr,
@@ -327,12 +2500,74 @@ llvm::Value *InstructionLifter::LoadWordRegValOrZero(llvm::BasicBlock *block,
       << "machine word size (" << word_type->getBitWidth() << " bits).";
 
   if (val_size < word_size) {
-    val = new llvm::ZExtInst(val, word_type, llvm::Twine::createNull(), block);
+    if (!impl->forward_reg_values) {
+      val =
+          new llvm::ZExtInst(val, word_type, llvm::Twine::createNull(), block);
+    } else {
+      impl->ResetValuesIfNewBlock(block);
+      auto &ext = impl->expr_memo[std::make_tuple(
+          static_cast<unsigned>(llvm::Instruction::ZExt), val, nullptr,
+          static_cast<llvm::Type *>(word_type))];
+      if (!ext) {
+        ext = new llvm::ZExtInst(val, word_type, llvm::Twine::createNull(),
+                                 block);
+      }
+      val = ext;
+    }
   }
 
   return val;
 }
 
+// Return the value of a register that doesn't change within the function,
+// or zero.
+llvm::Value *InstructionLifter::LoadInvariantWordRegValOrZero(
+    llvm::BasicBlock *block, llvm::Value *state_ptr, std::string_view reg_name,
+    llvm::ConstantInt *zero) {
+  const auto reg = impl->arch->RegisterByName(reg_name);
+  if (!reg) {
+    return LoadWordRegValOrZero(block, state_ptr, reg_name, zero);
+  }
+
+  const auto ptr = LoadRegAddress(block, state_ptr, reg);
+  auto &val = impl->invariant_reg_vals[reg->index];
+  if (val) {
+    return val;
+  }
+
+  // The load has to follow the computation of the register's address, which
+  // must itself be in the entry block. Variables that shadow the register
+  // are initialized later, and so can't be loaded up-front.
+  auto &entry_block = block->getParent()->getEntryBlock();
+  llvm::IRBuilder<> ir(&entry_block, entry_block.getFirstInsertionPt());
+  if (llvm::isa<llvm::AllocaInst>(ptr)) {
+    return LoadWordRegValOrZero(block, state_ptr, reg_name, zero);
+
+  } else if (auto ptr_inst = llvm::dyn_cast<llvm::Instruction>(ptr)) {
+    if (ptr_inst->getParent() != &entry_block) {
+      return LoadWordRegValOrZero(block, state_ptr, reg_name, zero);
+    } else if (auto next_inst = ptr_inst->getNextNode()) {
+      ir.SetInsertPoint(next_inst);
+    } else {
+      ir.SetInsertPoint(&entry_block);
+    }
+  }
+
+  const auto word_type = zero->getType();
+  const auto ptr_ty = ptr->getType()->getPointerElementType();
+  const auto val_type = llvm::dyn_cast<llvm::IntegerType>(ptr_ty);
+  CHECK(val_type && val_type->getBitWidth() <= word_type->getBitWidth())
+      << "Register " << reg_name << " expected to be an integer no larger "
+      << "than the machine word size.";
+
+  llvm::Value *reg_val = ir.CreateLoad(ptr_ty, ptr);
+  if (val_type != word_type) {
+    reg_val = ir.CreateZExt(reg_val, word_type);
+  }
+  val = reg_val;
+  return val;
+}
+
 llvm::Value *InstructionLifter::LiftShiftRegisterOperand(
     Instruction &inst, llvm::BasicBlock *block, llvm::Value *state_ptr,
     llvm::Argument *arg, Operand &op) {
@@ -348,7 +2583,9 @@ llvm::Value *InstructionLifter::LiftShiftRegisterOperand(
       << "for instruction at " << std::hex << inst.pc;
 
   const llvm::DataLayout data_layout(module);
-  auto reg = LoadRegValue(block, state_ptr, arch_reg.name);
+  const auto reg_info = impl->ResolveRegister(arch_reg);
+  auto reg = reg_info ? LoadRegValue(block, state_ptr, reg_info)
+                      : LoadRegValue(block, state_ptr, arch_reg.name);
   auto reg_type = reg->getType();
   auto reg_size = SizeOfTypeInBits(data_layout, reg_type);
   auto word_size = impl->arch->address_size;
@@ -509,6 +2746,33 @@ ConvertToIntendedType(Instruction &inst, Operand &op, llvm::BasicBlock *block,
   return nullptr;
 }
 
+// Apply the LLVM operation `opcode` of an operand expression.
+static llvm::Value *LiftExpressionOperation(llvm::BasicBlock *block,
+                                            unsigned opcode, llvm::Value *lhs,
+                                            llvm::Value *rhs,
+                                            llvm::Type *type) {
+  llvm::IRBuilder<> ir(block);
+  switch (opcode) {
+    case llvm::Instruction::Add: return ir.CreateAdd(lhs, rhs);
+    case llvm::Instruction::Sub: return ir.CreateSub(lhs, rhs);
+    case llvm::Instruction::Mul: return ir.CreateMul(lhs, rhs);
+    case llvm::Instruction::Shl: return ir.CreateShl(lhs, rhs);
+    case llvm::Instruction::LShr: return ir.CreateLShr(lhs, rhs);
+    case llvm::Instruction::AShr: return ir.CreateAShr(lhs, rhs);
+    case llvm::Instruction::ZExt: return ir.CreateZExt(lhs, type);
+    case llvm::Instruction::SExt: return ir.CreateSExt(lhs, type);
+    case llvm::Instruction::Trunc: return ir.CreateTrunc(lhs, type);
+    case llvm::Instruction::And: return ir.CreateAnd(lhs, rhs);
+    case llvm::Instruction::Or: return ir.CreateOr(lhs, rhs);
+    case llvm::Instruction::URem: return ir.CreateURem(lhs, rhs);
+    case llvm::Instruction::Xor: return ir.CreateXor(lhs, rhs);
+    default:
+      LOG(FATAL) << "Invalid Expression "
+                 << llvm::Instruction::getOpcodeName(opcode);
+      return nullptr;
+  }
+}
+
 }  // namespace
 
 // Load a register operand. This deals uniformly with write- and read-operands
@@ -533,7 +2797,18 @@ llvm::Value *InstructionLifter::LiftRegisterOperand(Instruction &inst,
   auto arg_type = IntendedArgumentType(arg);
 
   if (llvm::isa<llvm::PointerType>(arg_type)) {
-    auto val = LoadRegAddress(block, state_ptr, arch_reg.name);
+    const auto reg_info = impl->ResolveRegister(arch_reg);
+    llvm::Value *val = nullptr;
+    if (reg_info && impl->IsDeadWrite(inst, op)) {
+      val = impl->ScratchRegAddress(func, reg_info);
+      if (impl->stats) {
+        impl->stats->num_dead_reg_writes += 1;
+      }
+    } else if (reg_info) {
+      val = LoadRegAddress(block, state_ptr, reg_info);
+    } else {
+      val = LoadRegAddress(block, state_ptr, arch_reg.name);
+    }
     return ConvertToIntendedType(inst, op, block, val, real_arg_type);
 
   } else {
@@ -541,7 +2816,9 @@ llvm::Value *InstructionLifter::LiftRegisterOperand(Instruction &inst,
         << "Expected " << arch_reg.name << " to be an integral or float type "
         << "for instruction at " << std::hex << inst.pc;
 
-    auto val = LoadRegValue(block, state_ptr, arch_reg.name);
+    const auto reg_info = impl->ResolveRegister(arch_reg);
+    auto val = reg_info ? LoadRegValue(block, state_ptr, reg_info)
+                        : LoadRegValue(block, state_ptr, arch_reg.name);
 
     const llvm::DataLayout data_layout(module);
     auto val_type = val->getType();
@@ -721,31 +2998,30 @@ llvm::Value *InstructionLifter::LiftExpressionOperandRec(
       rhs = LiftExpressionOperandRec(inst, block, state_ptr, nullptr,
                                      llvm_op->op2);
     }
-    llvm::IRBuilder<> ir(block);
-    switch (llvm_op->llvm_opcode) {
-      case llvm::Instruction::Add: return ir.CreateAdd(lhs, rhs);
-      case llvm::Instruction::Sub: return ir.CreateSub(lhs, rhs);
-      case llvm::Instruction::Mul: return ir.CreateMul(lhs, rhs);
-      case llvm::Instruction::Shl: return ir.CreateShl(lhs, rhs);
-      case llvm::Instruction::LShr: return ir.CreateLShr(lhs, rhs);
-      case llvm::Instruction::AShr: return ir.CreateAShr(lhs, rhs);
-      case llvm::Instruction::ZExt: return ir.CreateZExt(lhs, op->type);
-      case llvm::Instruction::SExt: return ir.CreateSExt(lhs, op->type);
-      case llvm::Instruction::Trunc: return ir.CreateTrunc(lhs, op->type);
-      case llvm::Instruction::And: return ir.CreateAnd(lhs, rhs);
-      case llvm::Instruction::Or: return ir.CreateOr(lhs, rhs);
-      case llvm::Instruction::URem: return ir.CreateURem(lhs, rhs);
-      case llvm::Instruction::Xor: return ir.CreateXor(lhs, rhs);
-      default:
-        LOG(FATAL) << "Invalid Expression "
-                   << llvm::Instruction::getOpcodeName(llvm_op->llvm_opcode);
-        return nullptr;
+
+    // See `LiftAddressOperand`.
+    llvm::Value **memo = nullptr;
+    if (impl->forward_reg_values) {
+      impl->ResetValuesIfNewBlock(block);
+      memo = &(impl->expr_memo[std::make_tuple(llvm_op->llvm_opcode, lhs, rhs,
+                                               op->type)]);
+      if (*memo) {
+        return *memo;
+      }
+    }
+
+    const auto val = LiftExpressionOperation(block, llvm_op->llvm_opcode, lhs,
+                                             rhs, op->type);
+    if (memo) {
+      *memo = val;
     }
+    return val;
+
   } else if (auto reg_op = std::get_if<const Register *>(op)) {
     if (!arg || !llvm::isa<llvm::PointerType>(arg->getType())) {
-      return LoadRegValue(block, state_ptr, (*reg_op)->name);
+      return LoadRegValue(block, state_ptr, *reg_op);
     } else {
-      return LoadRegAddress(block, state_ptr, (*reg_op)->name);
+      return LoadRegAddress(block, state_ptr, *reg_op);
     }
 
   } else if (auto ci_op = std::get_if<llvm::Constant *>(op)) {
@@ -790,8 +3066,26 @@ llvm::Value *InstructionLifter::LiftAddressOperand(Instruction &inst,
       LoadWordRegValOrZero(block, state_ptr, arch_addr.index_reg.name, zero);
   auto scale = llvm::ConstantInt::get(
       word_type, static_cast<uint64_t>(arch_addr.scale), true);
-  auto segment = LoadWordRegValOrZero(block, state_ptr,
-                                      arch_addr.segment_base_reg.name, zero);
+  auto segment =
+      impl->invariant_segment_bases
+          ? LoadInvariantWordRegValOrZero(
+                block, state_ptr, arch_addr.segment_base_reg.name, zero)
+          : LoadWordRegValOrZero(block, state_ptr,
+                                 arch_addr.segment_base_reg.name, zero);
+
+  // With register value forwarding, reads of the same registers within a
+  // block produce the same values, so identical address computations can be
+  // reused.
+  Impl::AddressKey memo_key;
+  if (impl->forward_reg_values) {
+    impl->ResetValuesIfNewBlock(block);
+    memo_key = std::make_tuple(addr, index, arch_addr.scale,
+                               arch_addr.displacement, segment,
+                               arch_addr.address_size);
+    if (auto it = impl->addr_memo.find(memo_key); it != impl->addr_memo.end()) {
+      return it->second;
+    }
+  }
 
   llvm::IRBuilder<> ir(block);
 
@@ -825,6 +3119,10 @@ llvm::Value *InstructionLifter::LiftAddressOperand(Instruction &inst,
     addr = ir.CreateZExt(ir.CreateTrunc(addr, addr_type), word_type);
   }
 
+  if (impl->forward_reg_values) {
+    impl->addr_memo.emplace(memo_key, addr);
+  }
+
   return addr;
 }
 
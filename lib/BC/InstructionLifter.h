@@ -15,12 +15,20 @@
  */
 
 #include <glog/logging.h>
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/ADT/SmallPtrSet.h>
 #include <llvm/ADT/SmallVector.h>
+#include <llvm/ADT/StringMap.h>
+#include <llvm/ADT/StringSet.h>
+#include <llvm/Analysis/ValueTracking.h>
 #include <llvm/IR/BasicBlock.h>
 #include <llvm/IR/Constants.h>
+#include <llvm/IR/DIBuilder.h>
 #include <llvm/IR/DataLayout.h>
+#include <llvm/IR/DebugInfoMetadata.h>
 #include <llvm/IR/Function.h>
 #include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/InlineAsm.h>
 #include <llvm/IR/Instructions.h>
 #include <llvm/IR/IntrinsicInst.h>
 #include <llvm/IR/LegacyPassManager.h>
@@ -28,18 +36,27 @@
 #include <llvm/IR/Module.h>
 #include <llvm/IR/Operator.h>
 #include <llvm/IR/Type.h>
+#include <llvm/IR/ValueHandle.h>
 #include <llvm/Support/raw_ostream.h>
 #include <llvm/Transforms/Scalar.h>
 #include <llvm/Transforms/Utils/Cloning.h>
+#include <llvm/Transforms/Utils/Local.h>
 #include <llvm/Transforms/Utils/ValueMapper.h>
 #include <remill/BC/InstructionLifter.h>
 
+#include <algorithm>
+#include <array>
 #include <functional>
 #include <ios>
+#include <ostream>
+#include <map>
+#include <memory>
 #include <set>
 #include <sstream>
 #include <string>
+#include <tuple>
 #include <unordered_map>
+#include <unordered_set>
 #include <utility>
 #include <vector>
 
@@ -47,16 +64,120 @@
 #include "remill/Arch/Instruction.h"
 #include "remill/Arch/Name.h"
 #include "remill/BC/ABI.h"
+#include "remill/BC/Compat/Cloning.h"
 #include "remill/BC/Compat/DataLayout.h"
+#include "remill/BC/Compat/ScalarTransforms.h"
+#include "remill/BC/ISelSummary.h"
 #include "remill/BC/IntrinsicTable.h"
+#include "remill/BC/Statistics.h"
 #include "remill/BC/Util.h"
 #include "remill/OS/OS.h"
 
 namespace remill {
 
+// The semantics functions of a semantics module, found by walking all of its
+// `ISEL_` variables. This is the slow part of creating a lifter, and so it is
+// only done once per semantics module, and the index is shared by the
+// lifters of every module made from it, e.g. of each thin module that refers
+// to it, or of each clone of it.
+struct SemanticsIndex {
+  explicit SemanticsIndex(llvm::Module *semantics_module_);
+
+  // The indexed module.
+  llvm::Module *const semantics_module;
+
+  // Maps instruction function names (e.g. `ADD_GPRv_GPRv_32`, without the
+  // `ISEL_` prefix) to their semantics functions in `semantics_module`. This
+  // is built once, so that lifting an instruction doesn't need to build a
+  // name and look it up in the module's symbol table. The entries are weak
+  // handles so that semantics functions that are later deleted, e.g. by
+  // `OptimizeModule`, fall back on a slow lookup instead of dangling.
+  llvm::StringMap<llvm::WeakTrackingVH> isel_funcs;
+
+  // Maps the names of semantics functions to the precise summaries attached
+  // to their `ISEL_` variables, if the semantics were built with them (see
+  // `REMILL_SUMMARIZE_SEMANTICS`).
+  llvm::StringMap<ISelSummary> isel_summaries;
+};
+
+// The parts of an `InstructionLifter` that don't change once they are built.
+// Nothing here is modified after construction, so one of these can be shared
+// by many `InstructionLifter`s, including ones on different threads.
+class InstructionLifterSharedState {
+ public:
+  InstructionLifterSharedState(const Arch *arch_,
+                               const IntrinsicTable *intrinsics_,
+                               llvm::Module *semantics_module_ = nullptr);
+
+  // Create the state of lifting into the module of `intrinsics_` with the
+  // semantics index and register layout of `tmpl`. See the `InstructionLifter`
+  // constructor of the same form.
+  InstructionLifterSharedState(const InstructionLifterSharedState &tmpl,
+                               const IntrinsicTable *intrinsics_,
+                               llvm::Module *semantics_module_);
+
+  // Architecture being used for lifting.
+  const Arch *const arch;
+
+  // Machine word type for this architecture.
+  llvm::IntegerType *const word_type;
+
+  // Set of intrinsics.
+  const IntrinsicTable *const intrinsics;
+
+  llvm::Module *const module;
+
+  // The module whose `ISEL_` variables name the semantics functions. This is
+  // `module`, unless lifting into a thin module (see `CreateThinModule`), in
+  // which case the semantics functions are declared in `module` as they are
+  // used.
+  llvm::Module *const semantics_module;
+
+  llvm::Function *const invalid_instruction;
+  llvm::Function *const unsupported_instruction;
+
+  // The semantics functions of `semantics_module`, or of the semantics
+  // module of which `semantics_module` is a clone, in which case they are
+  // found in `semantics_module` by name.
+  const std::shared_ptr<const SemanticsIndex> index;
+
+  // The largest register enclosing the program counter register, or `nullptr`.
+  const Register *pc_reg{nullptr};
+
+  // The registers whose addresses are computed up-front when
+  // `InstructionLifter::SetHoistRegisterAddresses` is enabled, ordered by
+  // their offsets in the `State` structure.
+  std::vector<const Register *> reg_address_template;
+
+ private:
+  InstructionLifterSharedState(void) = delete;
+  InstructionLifterSharedState(const InstructionLifterSharedState &) = delete;
+};
+
 class InstructionLifter::Impl {
  public:
-  Impl(const Arch *arch_, const IntrinsicTable *intrinsics_);
+  explicit Impl(std::shared_ptr<const InstructionLifterSharedState> shared_);
+
+  // Try to find the function that implements the semantics of the instruction
+  // function `function`.
+  llvm::Function *GetInstructionFunction(std::string_view function);
+
+  // Try to find the function that implements the semantics of `inst`. This
+  // is the native variant of the semantics of an atomic instruction, if
+  // `native_atomics` is enabled and there is one.
+  llvm::Function *GetInstructionFunction(const Instruction &inst);
+
+  // Try to find the function that implements the semantics of the instruction
+  // function `function` among those that this lifter already knows about.
+  // Unlike `GetInstructionFunction`, this doesn't count missing semantics.
+  llvm::Function *GetKnownInstructionFunction(std::string_view function);
+
+  // Look for the semantics function `function` in the semantics module. This
+  // is slow, and doesn't count missing semantics either.
+  llvm::Function *FindExtraInstructionFunction(std::string_view function);
+
+  // Immutable state, possibly shared with other lifters.
+  const std::shared_ptr<const InstructionLifterSharedState> shared;
 
   // Architecture being used for lifting.
   const Arch *const arch;
@@ -67,16 +188,366 @@ class InstructionLifter::Impl {
   // Set of intrinsics.
   const IntrinsicTable *const intrinsics;
 
-  // Cache of looked up registers inside of `last_func`.
-  std::unordered_map<std::string, llvm::Value *> reg_ptr_cache;
+  // If `func` isn't `last_func`, then clear out the caches of registers.
+  void ResetCacheIfNewFunction(llvm::Function *func);
+
+  // Returns the architectural register named by `reg`, and remembers it in
+  // `reg.arch_reg`. Returns `nullptr` if `reg` doesn't name a register.
+  const Register *ResolveRegister(Operand::Register &reg) const;
+
+  // Cache of looked up registers and variables inside of `last_func`, by
+  // name. This is a `StringMap` so that lookups don't allocate.
+  llvm::StringMap<llvm::Value *> reg_ptr_cache;
+
+  // Cache of looked up registers inside of `last_func`, indexed by
+  // `Register::index`.
+  std::vector<llvm::Value *> reg_ptr_by_index;
+
+  // The named values of `last_func`'s entry block and its named arguments,
+  // by name. This is built by the first `FindVar` in `last_func`,
+  // e.g. from the register variables of `__remill_basic_block`, so that each
+  // register lookup doesn't scan the whole entry block.
+  llvm::StringMap<llvm::Value *> func_vars;
+  bool func_vars_indexed{false};
+
+  // Find the variable `name` of `last_func`, like `FindVarInFunction`, but
+  // through `func_vars`. Variables added to the entry block after the index
+  // is built aren't found, except for those added by `FindVar` itself.
+  llvm::Value *FindVar(std::string_view name);
+
+  // See `InstructionLifter::SetLazyBlockVariables`. When enabled, `FindVar`
+  // clones missing variables of `__remill_basic_block` into `last_func`.
+  bool lazy_block_vars{false};
 
   // The function into which we're lifting. If This gets out of date, we
-  // clear out `reg_ptr_cache`.
+  // clear out `reg_ptr_cache`, `reg_ptr_by_index`, and `func_vars`.
   llvm::Function *last_func{nullptr};
 
+  // See `InstructionLifter::SetHoistRegisterAddresses`.
+  bool hoist_reg_addresses{false};
+
+  // Whether or not the register addresses of `last_func` have been hoisted.
+  bool reg_addresses_hoisted{false};
+
+  // Fill in `reg_ptr_by_index` with the address of every register in
+  // `shared->reg_address_template`, computed from `state_ptr` at the start
+  // of `func`'s entry block.
+  void HoistRegisterAddresses(llvm::Function *func, llvm::Value *state_ptr);
+
   llvm::Module *const module;
   llvm::Function *const invalid_instruction;
   llvm::Function *const unsupported_instruction;
+
+  // Semantics functions found in `shared->semantics_module` that weren't in
+  // `shared->index`. This is per-lifter so that the shared table is
+  // never modified.
+  llvm::StringMap<llvm::WeakTrackingVH> extra_isel_funcs;
+
+  // Declarations in `module` of the semantics functions of a separate
+  // `shared->semantics_module`, indexed by the semantics functions.
+  std::unordered_map<llvm::Function *, llvm::WeakTrackingVH> isel_decls;
+
+  // Returns `sem`, or its declaration in `module` if it's from a separate
+  // semantics module.
+  llvm::Function *DeclareISel(std::string_view function, llvm::Function *sem);
+
+  // Optional statistics, see `LiftStatistics`.
+  LiftStatistics *stats{nullptr};
+
+  // Number of times each semantics function was lifted with each status. This
+  // is only maintained when `stats` is non-null.
+  llvm::StringMap<std::array<uint64_t, kLiftedInstruction + 1>> status_counts;
+
+  // Count the lifting outcome `status` for the semantics function of `inst`.
+  void CountLiftStatus(const Instruction &inst, LiftStatus status);
+
+  // Semantics functions that we looked for and didn't find, and the number of
+  // times that they've been looked up. Further lookups of these fail fast.
+  llvm::StringMap<uint64_t> missing_isels;
+
+  // The name of the native variant of the semantics of each atomic
+  // instruction function, or an empty name if there is no native variant.
+  // See `InstructionLifter::SetNativeAtomics`.
+  llvm::StringMap<std::string> native_isel_names;
+
+  // Whether or not to splice semantics function bodies into lifted blocks.
+  // See `InstructionLifter::SetInlineSemantics`.
+  bool inline_semantics{false};
+
+  // Maps semantics functions to their cleaned-up copies for inlining at lift
+  // time. A null handle means that the semantics function can't be inlined.
+  std::unordered_map<llvm::Function *, llvm::WeakTrackingVH> inline_bodies;
+
+  // Returns a copy of `isel_func` that has been cleaned up for being inlined
+  // at lift time, or `nullptr` if `isel_func` isn't a good candidate for that.
+  llvm::Function *GetInlineBody(llvm::Function *isel_func);
+
+  // Whether or not to specialize semantics functions to constant operands.
+  // See `InstructionLifter::SetSpecializeSemantics`.
+  bool specialize_semantics{false};
+
+  // A tuple of constant operands must be seen this many times before its
+  // specialization is created.
+  static constexpr unsigned kMinSpecializationUses = 2;
+
+  // Limit on the number of specializations of any one semantics function.
+  static constexpr unsigned kMaxSpecializationsPerISel = 64;
+
+  struct Specialization {
+    llvm::WeakTrackingVH func;
+    unsigned num_uses{0};
+  };
+
+  // Specializations of semantics functions, keyed by the function and by the
+  // constant value (or `nullptr`) passed for each argument.
+  std::map<std::pair<llvm::Function *, std::vector<llvm::Constant *>>,
+           Specialization>
+      specializations;
+
+  // Number of specializations created for each semantics function.
+  std::unordered_map<llvm::Function *, unsigned> num_specializations;
+
+  // Returns a version of `isel_func` specialized to the constant arguments in
+  // `args`, and removes those arguments from `args`. Returns `isel_func` and
+  // leaves `args` alone if there is no such specialization (yet).
+  llvm::Function *GetSpecialization(llvm::Function *isel_func,
+                                    std::vector<llvm::Value *> &args);
+
+  // Run some cheap cleanup passes over a copy of a semantics function.
+  void CleanUpSemanticsCopy(llvm::Function *func);
+
+  // Whether or not `LiftBlock` removes overwritten `State` stores. See
+  // `InstructionLifter::SetEliminateDeadStateStores`.
+  bool eliminate_dead_state_stores{false};
+
+  // Remove stores to the `State` structure in `block` that are overwritten
+  // later in `block` before being read.
+  void EliminateDeadStateStores(llvm::BasicBlock *block,
+                                llvm::Value *state_ptr);
+
+  // Whether or not `LiftBlock` folds stack pointer updates. See
+  // `InstructionLifter::SetFoldStackPointerDeltas`.
+  bool fold_sp_deltas{false};
+
+  // Rewrite the stack pointer values computed in `block` as constant offsets
+  // from a base stack pointer value, and forward stores of the stack pointer
+  // to later loads of it.
+  void FoldStackPointerDeltas(llvm::BasicBlock *block, llvm::Value *state_ptr);
+
+  // Whether or not `LiftBlock` merges sub-register writes. See
+  // `InstructionLifter::SetMergeSubRegisterWrites`.
+  bool merge_sub_reg_writes{false};
+
+  // Keep the values of the integer registers written in `block` in SSA
+  // form, merging writes to their sub-registers, and only store them back to
+  // the `State` structure where something else might observe them.
+  void MergeSubRegisterWrites(llvm::BasicBlock *block, llvm::Value *state_ptr);
+
+  // The values of `MEMORY`, `PC`, and `NEXT_PC` while lifting a block with
+  // `LiftBlock`. These are kept as SSA values across the instructions of the
+  // block, instead of being stored to and reloaded from their variables by
+  // each instruction.
+  struct BlockSSAState {
+    llvm::Value *mem{nullptr};
+    llvm::Value *pc{nullptr};
+    llvm::Value *next_pc{nullptr};
+
+    // `pc` and `next_pc` have not yet been stored to `PC` and `NEXT_PC`.
+    bool pc_is_dirty{false};
+
+    // The next lifted instruction must store `PC` and `NEXT_PC` before its
+    // semantics are called.
+    bool materialize_pc{true};
+
+    // Bit `i` is set if the register written by operand `i` of the next
+    // lifted instruction is dead. See `FindDeadRegisterWrites`.
+    uint64_t dead_writes{0};
+  };
+
+  // Whether or not `LiftBlock` skips dead register writes. See
+  // `InstructionLifter::SetSkipDeadRegisterWrites`.
+  bool skip_dead_reg_writes{false};
+
+  // Scratch space of `last_func` that dead writes to registers go to, indexed
+  // by the `Register::index` of the enclosing register.
+  std::vector<llvm::Value *> scratch_reg_ptrs;
+
+  // Set bit `j` of `dead[i]` if operand `j` of `insts[i]` writes to a register
+  // that is fully overwritten by a later instruction of `insts` before being
+  // read. Everything is assumed to be live after the last instruction.
+  void FindDeadRegisterWrites(llvm::MutableArrayRef<Instruction> insts,
+                              std::vector<uint64_t> &dead);
+
+  // Returns `true` if `op` of `inst` writes to a dead register.
+  bool IsDeadWrite(const Instruction &inst, const Operand &op) const;
+
+  // Returns the address of scratch space in `func`'s entry block, that can
+  // stand in for `reg`'s enclosing register.
+  llvm::Value *ScratchRegAddress(llvm::Function *func, const Register *reg);
+
+  // Whether or not segment base registers are loaded once per function. See
+  // `InstructionLifter::SetInvariantSegmentBases`.
+  bool invariant_segment_bases{false};
+
+  // Values of invariant registers loaded into the entry block of `last_func`,
+  // indexed by `Register::index`.
+  std::vector<llvm::Value *> invariant_reg_vals;
+
+  // Whether or not to forward register values loaded within a block to later
+  // reads of the same registers in that block. See
+  // `InstructionLifter::SetRegisterValueForwarding`.
+  bool forward_reg_values{false};
+
+  // The block into which `reg_val_by_index` values were loaded.
+  llvm::BasicBlock *last_block{nullptr};
+
+  // Values of registers loaded into `last_block`, indexed by
+  // `Register::index`, and the registers with a non-null entry.
+  std::vector<llvm::Value *> reg_val_by_index;
+  std::vector<const Register *> live_reg_vals;
+
+  // Memoized address and expression operand computations in `last_block`,
+  // used along with register value forwarding. These are keyed on the SSA
+  // values of their inputs, so writing to a register, which leads to a new
+  // load of that register, implicitly invalidates the computations using its
+  // old value.
+  using AddressKey = std::tuple<llvm::Value *, llvm::Value *, int64_t, int64_t,
+                                llvm::Value *, uint64_t>;
+  using ExpressionKey =
+      std::tuple<unsigned, llvm::Value *, llvm::Value *, llvm::Type *>;
+
+  std::map<AddressKey, llvm::Value *> addr_memo;
+  std::map<ExpressionKey, llvm::Value *> expr_memo;
+
+  // Summary of the parts of the `State` structure that a semantics function
+  // may directly load from or store to through its `State` pointer argument.
+  struct StateAccesses {
+    bool is_valid{false};
+    bool clobbers_all{false};
+    bool reads_all{false};
+
+    // Byte ranges that may be stored to.
+    llvm::SmallVector<std::pair<int64_t, int64_t>, 4> ranges;
+
+    // Byte ranges that may be loaded from.
+    llvm::SmallVector<std::pair<int64_t, int64_t>, 4> read_ranges;
+
+    // Byte ranges that are always stored to, i.e. in the entry block.
+    llvm::SmallVector<std::pair<int64_t, int64_t>, 4> kill_ranges;
+
+    // Number of bytes always stored through each pointer argument, e.g. a
+    // register write operand, indexed by argument number.
+    llvm::SmallVector<int64_t, 4> arg_kills;
+  };
+
+  std::unordered_map<llvm::Function *, StateAccesses> state_accesses;
+
+  // If `block` isn't `last_block`, then clear out the forwarded values and
+  // memoized computations.
+  void ResetValuesIfNewBlock(llvm::BasicBlock *block);
+
+  // Forget the forwarded values of all registers.
+  void InvalidateRegValues(void);
+
+  // Forget the forwarded values of registers overlapping the bytes
+  // `[begin, end)` of the `State` structure.
+  void InvalidateRegValues(int64_t begin, int64_t end);
+
+  // Forget the forwarded values of registers overlapping `reg`.
+  void InvalidateRegValues(const Register *reg);
+
+  // Forget the forwarded values of registers that might be written by the
+  // call to `isel_func` implementing `inst`.
+  void InvalidateRegValuesWrittenBy(Instruction &inst,
+                                    llvm::Function *isel_func);
+
+  // Returns `true` if the semantics of `inst` might write to any part of
+  // `reg`. Anything unknown is assumed to write to `reg`.
+  bool MayWriteRegister(Instruction &inst, const Register *reg);
+
+  // Summarize the loads and stores that `func` performs through its `State`
+  // pointer and its pointer arguments.
+  const StateAccesses &GetStateAccesses(llvm::Function *func);
+
+  // Non-null only during `LiftBlock`.
+  BlockSSAState *block_ssa{nullptr};
+
+  // Whether or not to stamp out copies of the IR lifted for identical
+  // instructions. See `InstructionLifter::SetInstructionTemplates`.
+  bool instruction_templates{false};
+
+  // Whether or not to prefer the native variants of the semantics of atomic
+  // instructions. See `InstructionLifter::SetNativeAtomics`.
+  bool native_atomics{false};
+
+  // Whether or not to give the lifted instructions debug locations that
+  // encode their addresses. See `InstructionLifter::SetGuestPCDebugLocations`.
+  bool guest_pc_debug_locs{false};
+
+  // Returns the subprogram of `func` in which its guest PC debug locations
+  // are scoped, creating it, and the compile unit of `module`, if need be.
+  // `pc` is the address of the first instruction lifted into `func`.
+  llvm::DISubprogram *GuestSubprogram(llvm::Function *func, uint64_t pc);
+
+  // Creates the compile unit and subprograms of the guest PC debug locations.
+  std::unique_ptr<llvm::DIBuilder> di_builder;
+  llvm::DIFile *di_file{nullptr};
+  llvm::DISubroutineType *di_func_type{nullptr};
+
+  // The IR lifted for an instruction, as a block of `template_func`. The
+  // block starts with one placeholder `alloca` per register or variable whose
+  // address the IR uses, named by `var_names`, and it ends with a `ret`. The
+  // `State` pointer is the argument of `template_func`. A null `block` means
+  // that the IR lifted for the instruction can't be made into a template.
+  struct InstructionTemplate {
+    llvm::WeakVH block;
+    std::vector<std::string> var_names;
+  };
+
+  // Templates, keyed by `TemplateKey`.
+  std::unordered_map<std::string, InstructionTemplate> templates;
+
+  // The private function holding the blocks of `templates`. If it is removed
+  // from the module, e.g. by global dead code elimination, then all templates
+  // are forgotten.
+  llvm::WeakVH template_func;
+  bool has_template_func{false};
+
+  // Forget the templates if `template_func` has been removed.
+  void ResetTemplatesIfRemoved(void);
+
+  // Fill `key` with the parts of `inst` that determine the IR that
+  // `LiftIntoBlock` emits for it: its semantics function, size, and operands.
+  static void TemplateKey(const Instruction &inst, std::string &key);
+
+  // Clone the template `key`, if any, into the end of `block`. Returns
+  // `false` if there is no usable template.
+  bool StampTemplate(const InstructionLifter &lifter, const std::string &key,
+                     llvm::BasicBlock *block, llvm::Value *state_ptr);
+
+  // Record the instructions of `block` after `last_inst` as the template
+  // `key`.
+  void RecordTemplate(const std::string &key, llvm::BasicBlock *block,
+                      llvm::Instruction *last_inst, llvm::Value *state_ptr);
+
+  // Remove `template_func` from the module, and forget all templates.
+  void ClearTemplates(void);
+
+  // The largest register enclosing the program counter register, or `nullptr`.
+  const Register *const pc_reg;
+
+  // Returns `true` if the name `reg_name` refers to `PC`, `NEXT_PC`, or to
+  // (part of) the program counter register.
+  bool IsPCName(std::string_view reg_name) const;
+
+  // Returns `true` if any operand of `inst` reads or writes the program
+  // counter, and so `PC` and `NEXT_PC` must be up-to-date in the `State`
+  // structure before `inst` is lifted.
+  bool ObservesPC(const Instruction &inst) const;
+
+  // Returns `true` if the operand expression `expr` refers to the program
+  // counter.
+  bool ObservesPC(const OperandExpression *expr) const;
 };
 
 }  // namespace remill
@@ -29,10 +29,8 @@
 namespace remill {
 namespace {
 
-// Find a specific function.
-static llvm::Function *FindIntrinsic(llvm::Module *module, const char *name) {
-  auto function = FindFunction(module, name);
-  CHECK(nullptr != function) << "Unable to find intrinsic: " << name;
+// Give the intrinsic `function` the attributes of an intrinsic.
+static void InitIntrinsic(llvm::Function *function) {
 
   // We don't want calls to memory intrinsics to be duplicated because then
   // they might have the wrong side effects!
@@ -46,7 +44,13 @@ static llvm::Function *FindIntrinsic(llvm::Module *module, const char *name) {
   function->removeFnAttr(llvm::Attribute::InlineHint);
   function->addFnAttr(llvm::Attribute::OptimizeNone);
   function->addFnAttr(llvm::Attribute::NoInline);
+}
 
+// Find a specific function.
+static llvm::Function *FindIntrinsic(llvm::Module *module, const char *name) {
+  auto function = FindFunction(module, name);
+  CHECK(nullptr != function) << "Unable to find intrinsic: " << name;
+  InitIntrinsic(function);
   return function;
 }
 
@@ -61,6 +65,26 @@ static llvm::Function *FindPureIntrinsic(llvm::Module *module,
   return function;
 }
 
+// Find the function of `module` with the name of `tmpl`, an intrinsic of
+// another module, and give it the attributes of `tmpl`. In the same context,
+// they are shared rather than being built again.
+static llvm::Function *RebindIntrinsic(llvm::Module *module,
+                                       const llvm::Function *tmpl) {
+  const auto name = tmpl->getName();
+  auto function = module->getFunction(name);
+  CHECK(nullptr != function) << "Unable to find intrinsic: " << name.str();
+  if (&(function->getContext()) == &(tmpl->getContext())) {
+    function->setAttributes(tmpl->getAttributes());
+    function->setLinkage(llvm::GlobalValue::ExternalLinkage);
+  } else {
+    InitIntrinsic(function);
+    if (tmpl->doesNotAccessMemory()) {
+      function->addFnAttr(llvm::Attribute::ReadNone);
+    }
+  }
+  return function;
+}
+
 }  // namespace
 
 IntrinsicTable::IntrinsicTable(llvm::Module *module)
@@ -97,6 +121,24 @@ IntrinsicTable::IntrinsicTable(llvm::Module *module)
       write_memory_f128(
           FindPureIntrinsic(module, "__remill_write_memory_f128")),
 
+      read_memory_v128(FindIntrinsic(module, "__remill_read_memory_v128")),
+      read_memory_v256(FindIntrinsic(module, "__remill_read_memory_v256")),
+      read_memory_v512(FindIntrinsic(module, "__remill_read_memory_v512")),
+
+      write_memory_v128(FindIntrinsic(module, "__remill_write_memory_v128")),
+      write_memory_v256(FindIntrinsic(module, "__remill_write_memory_v256")),
+      write_memory_v512(FindIntrinsic(module, "__remill_write_memory_v512")),
+
+      copy_memory_8(FindIntrinsic(module, "__remill_copy_memory_8")),
+      copy_memory_16(FindIntrinsic(module, "__remill_copy_memory_16")),
+      copy_memory_32(FindIntrinsic(module, "__remill_copy_memory_32")),
+      copy_memory_64(FindIntrinsic(module, "__remill_copy_memory_64")),
+
+      fill_memory_8(FindIntrinsic(module, "__remill_fill_memory_8")),
+      fill_memory_16(FindIntrinsic(module, "__remill_fill_memory_16")),
+      fill_memory_32(FindIntrinsic(module, "__remill_fill_memory_32")),
+      fill_memory_64(FindIntrinsic(module, "__remill_fill_memory_64")),
+
       // Memory barriers.
       barrier_load_load(
           FindPureIntrinsic(module, "__remill_barrier_load_load")),
@@ -130,4 +172,61 @@ IntrinsicTable::IntrinsicTable(llvm::Module *module)
   (void) FindIntrinsic(module, "__remill_intrinsics");
 }
 
+// Bind the intrinsics of `module`, which has the same intrinsics as the module
+// of `tmpl`.
+IntrinsicTable::IntrinsicTable(const IntrinsicTable &tmpl,
+                               llvm::Module *module)
+    : error(RebindIntrinsic(module, tmpl.error)),
+      function_call(RebindIntrinsic(module, tmpl.function_call)),
+      function_return(RebindIntrinsic(module, tmpl.function_return)),
+      jump(RebindIntrinsic(module, tmpl.jump)),
+      missing_block(RebindIntrinsic(module, tmpl.missing_block)),
+      async_hyper_call(RebindIntrinsic(module, tmpl.async_hyper_call)),
+      read_memory_8(RebindIntrinsic(module, tmpl.read_memory_8)),
+      read_memory_16(RebindIntrinsic(module, tmpl.read_memory_16)),
+      read_memory_32(RebindIntrinsic(module, tmpl.read_memory_32)),
+      read_memory_64(RebindIntrinsic(module, tmpl.read_memory_64)),
+      write_memory_8(RebindIntrinsic(module, tmpl.write_memory_8)),
+      write_memory_16(RebindIntrinsic(module, tmpl.write_memory_16)),
+      write_memory_32(RebindIntrinsic(module, tmpl.write_memory_32)),
+      write_memory_64(RebindIntrinsic(module, tmpl.write_memory_64)),
+      read_memory_f32(RebindIntrinsic(module, tmpl.read_memory_f32)),
+      read_memory_f64(RebindIntrinsic(module, tmpl.read_memory_f64)),
+      read_memory_f80(RebindIntrinsic(module, tmpl.read_memory_f80)),
+      read_memory_f128(RebindIntrinsic(module, tmpl.read_memory_f128)),
+      write_memory_f32(RebindIntrinsic(module, tmpl.write_memory_f32)),
+      write_memory_f64(RebindIntrinsic(module, tmpl.write_memory_f64)),
+      write_memory_f80(RebindIntrinsic(module, tmpl.write_memory_f80)),
+      write_memory_f128(RebindIntrinsic(module, tmpl.write_memory_f128)),
+      read_memory_v128(RebindIntrinsic(module, tmpl.read_memory_v128)),
+      read_memory_v256(RebindIntrinsic(module, tmpl.read_memory_v256)),
+      read_memory_v512(RebindIntrinsic(module, tmpl.read_memory_v512)),
+      write_memory_v128(RebindIntrinsic(module, tmpl.write_memory_v128)),
+      write_memory_v256(RebindIntrinsic(module, tmpl.write_memory_v256)),
+      write_memory_v512(RebindIntrinsic(module, tmpl.write_memory_v512)),
+      copy_memory_8(RebindIntrinsic(module, tmpl.copy_memory_8)),
+      copy_memory_16(RebindIntrinsic(module, tmpl.copy_memory_16)),
+      copy_memory_32(RebindIntrinsic(module, tmpl.copy_memory_32)),
+      copy_memory_64(RebindIntrinsic(module, tmpl.copy_memory_64)),
+      fill_memory_8(RebindIntrinsic(module, tmpl.fill_memory_8)),
+      fill_memory_16(RebindIntrinsic(module, tmpl.fill_memory_16)),
+      fill_memory_32(RebindIntrinsic(module, tmpl.fill_memory_32)),
+      fill_memory_64(RebindIntrinsic(module, tmpl.fill_memory_64)),
+      barrier_load_load(RebindIntrinsic(module, tmpl.barrier_load_load)),
+      barrier_load_store(RebindIntrinsic(module, tmpl.barrier_load_store)),
+      barrier_store_load(RebindIntrinsic(module, tmpl.barrier_store_load)),
+      barrier_store_store(RebindIntrinsic(module, tmpl.barrier_store_store)),
+      atomic_begin(RebindIntrinsic(module, tmpl.atomic_begin)),
+      atomic_end(RebindIntrinsic(module, tmpl.atomic_end)),
+      delay_slot_begin(RebindIntrinsic(module, tmpl.delay_slot_begin)),
+      delay_slot_end(RebindIntrinsic(module, tmpl.delay_slot_end)),
+      undefined_8(RebindIntrinsic(module, tmpl.undefined_8)),
+      undefined_16(RebindIntrinsic(module, tmpl.undefined_16)),
+      undefined_32(RebindIntrinsic(module, tmpl.undefined_32)),
+      undefined_64(RebindIntrinsic(module, tmpl.undefined_64)),
+      undefined_f32(RebindIntrinsic(module, tmpl.undefined_f32)),
+      undefined_f64(RebindIntrinsic(module, tmpl.undefined_f64)) {
+  (void) FindIntrinsic(module, "__remill_intrinsics");
+}
+
 }  // namespace remill
@@ -0,0 +1,32 @@
+/*
+ * Copyright (c) 2020 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "remill/BC/LiftOptions.h"
+
+namespace remill {
+
+// Returns the name of `status`.
+const char *LiftOutcomeName(LiftOutcome status) {
+  switch (status) {
+    case LiftOutcome::kComplete: return "complete";
+    case LiftOutcome::kCancelled: return "cancelled";
+    case LiftOutcome::kDeadlineExceeded: return "deadline_exceeded";
+    case LiftOutcome::kBudgetExhausted: return "budget_exhausted";
+  }
+  return "unknown";
+}
+
+}  // namespace remill
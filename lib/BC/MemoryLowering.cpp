@@ -0,0 +1,904 @@
+/*
+ * Copyright (c) 2020 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "remill/BC/MemoryLowering.h"
+
+#include <glog/logging.h>
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/DataLayout.h>
+#include <llvm/IR/DerivedTypes.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/Module.h>
+
+#include <algorithm>
+#include <map>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "remill/Arch/Arch.h"
+#include "remill/BC/Version.h"
+
+namespace remill {
+namespace {
+
+enum class LoweringKind {
+  kRead,
+  kReadF80,
+  kReadF128,
+  kWrite,
+  kWriteF80,
+  kWriteF128,
+  kCopy,
+  kFill,
+  kFence,
+  kPassThrough
+};
+
+struct Lowering {
+  LoweringKind kind;
+
+  // Element size, in bytes, of copies.
+  uint64_t elem_size;
+
+  // Ordering of fences.
+  llvm::AtomicOrdering ordering;
+};
+
+static const std::unordered_map<std::string, Lowering> &Lowerings(void) {
+  using K = LoweringKind;
+  using O = llvm::AtomicOrdering;
+  static const std::unordered_map<std::string, Lowering> kLowerings = {
+      {"__remill_read_memory_8", {K::kRead, 0, O::NotAtomic}},
+      {"__remill_read_memory_16", {K::kRead, 0, O::NotAtomic}},
+      {"__remill_read_memory_32", {K::kRead, 0, O::NotAtomic}},
+      {"__remill_read_memory_64", {K::kRead, 0, O::NotAtomic}},
+      {"__remill_read_memory_f32", {K::kRead, 0, O::NotAtomic}},
+      {"__remill_read_memory_f64", {K::kRead, 0, O::NotAtomic}},
+      {"__remill_read_memory_f80", {K::kReadF80, 0, O::NotAtomic}},
+      {"__remill_read_memory_f128", {K::kReadF128, 0, O::NotAtomic}},
+      {"__remill_read_memory_v128", {K::kRead, 0, O::NotAtomic}},
+      {"__remill_read_memory_v256", {K::kRead, 0, O::NotAtomic}},
+      {"__remill_read_memory_v512", {K::kRead, 0, O::NotAtomic}},
+      {"__remill_write_memory_8", {K::kWrite, 0, O::NotAtomic}},
+      {"__remill_write_memory_16", {K::kWrite, 0, O::NotAtomic}},
+      {"__remill_write_memory_32", {K::kWrite, 0, O::NotAtomic}},
+      {"__remill_write_memory_64", {K::kWrite, 0, O::NotAtomic}},
+      {"__remill_write_memory_f32", {K::kWrite, 0, O::NotAtomic}},
+      {"__remill_write_memory_f64", {K::kWrite, 0, O::NotAtomic}},
+      {"__remill_write_memory_f80", {K::kWriteF80, 0, O::NotAtomic}},
+      {"__remill_write_memory_f128", {K::kWriteF128, 0, O::NotAtomic}},
+      {"__remill_write_memory_v128", {K::kWrite, 0, O::NotAtomic}},
+      {"__remill_write_memory_v256", {K::kWrite, 0, O::NotAtomic}},
+      {"__remill_write_memory_v512", {K::kWrite, 0, O::NotAtomic}},
+      {"__remill_copy_memory_8", {K::kCopy, 1, O::NotAtomic}},
+      {"__remill_copy_memory_16", {K::kCopy, 2, O::NotAtomic}},
+      {"__remill_copy_memory_32", {K::kCopy, 4, O::NotAtomic}},
+      {"__remill_copy_memory_64", {K::kCopy, 8, O::NotAtomic}},
+      {"__remill_fill_memory_8", {K::kFill, 1, O::NotAtomic}},
+      {"__remill_barrier_load_load", {K::kFence, 0, O::Acquire}},
+      {"__remill_barrier_load_store", {K::kFence, 0, O::Acquire}},
+      {"__remill_barrier_store_load",
+       {K::kFence, 0, O::SequentiallyConsistent}},
+      {"__remill_barrier_store_store", {K::kFence, 0, O::Release}},
+      {"__remill_atomic_begin", {K::kFence, 0, O::SequentiallyConsistent}},
+      {"__remill_atomic_end", {K::kFence, 0, O::SequentiallyConsistent}},
+      {"__remill_delay_slot_begin", {K::kPassThrough, 0, O::NotAtomic}},
+      {"__remill_delay_slot_end", {K::kPassThrough, 0, O::NotAtomic}},
+  };
+  return kLowerings;
+}
+
+// Guest memory may be accessed at any alignment.
+template <typename T>
+static void SetUnaligned(T *inst) {
+#if LLVM_VERSION_NUMBER >= LLVM_VERSION(11, 0)
+  inst->setAlignment(llvm::Align(1));
+#elif LLVM_VERSION_NUMBER >= LLVM_VERSION(10, 0)
+  inst->setAlignment(llvm::MaybeAlign(1));
+#else
+  inst->setAlignment(1);
+#endif
+}
+
+class MemoryLowerer {
+ public:
+  MemoryLowerer(llvm::Module *module_, llvm::Constant *base_);
+
+  // Lower `call`, which calls an intrinsic lowered like `lowering`.
+  void Lower(llvm::CallInst *call, const Lowering &lowering);
+
+ private:
+  // Returns a pointer to the guest address `addr` of type `type`.
+  llvm::Value *GuestPointer(llvm::IRBuilder<> &ir, llvm::Value *addr,
+                            llvm::Type *type, uint64_t offset = 0);
+
+  llvm::Value *Load(llvm::IRBuilder<> &ir, llvm::Type *type,
+                    llvm::Value *addr);
+  void Store(llvm::IRBuilder<> &ir, llvm::Value *val, llvm::Value *addr,
+             uint64_t offset = 0);
+  void Copy(llvm::IRBuilder<> &ir, llvm::Value *dst, llvm::Value *src,
+            llvm::Value *size);
+
+  llvm::LLVMContext &context;
+  const llvm::DataLayout &dl;
+  llvm::Constant *const base;
+  const unsigned addr_space;
+  llvm::IntegerType *const byte_type;
+  llvm::IntegerType *const intptr_type;
+};
+
+MemoryLowerer::MemoryLowerer(llvm::Module *module_, llvm::Constant *base_)
+    : context(module_->getContext()),
+      dl(module_->getDataLayout()),
+      base(base_),
+      addr_space(base_ ? base_->getType()->getPointerAddressSpace() : 0),
+      byte_type(llvm::Type::getInt8Ty(context)),
+      intptr_type(dl.getIntPtrType(context, addr_space)) {}
+
+llvm::Value *MemoryLowerer::GuestPointer(llvm::IRBuilder<> &ir,
+                                         llvm::Value *addr, llvm::Type *type,
+                                         uint64_t offset) {
+  addr = ir.CreateZExtOrTrunc(addr, intptr_type);
+  if (offset) {
+    addr = ir.CreateAdd(addr, llvm::ConstantInt::get(intptr_type, offset));
+  }
+
+  const auto byte_ptr_type = llvm::PointerType::get(byte_type, addr_space);
+  llvm::Value *ptr = nullptr;
+  if (base) {
+    ptr = ir.CreateGEP(byte_type,
+                       llvm::ConstantExpr::getPointerCast(base, byte_ptr_type),
+                       addr);
+  } else {
+    ptr = ir.CreateIntToPtr(addr, byte_ptr_type);
+  }
+  return ir.CreatePointerCast(ptr, llvm::PointerType::get(type, addr_space));
+}
+
+llvm::Value *MemoryLowerer::Load(llvm::IRBuilder<> &ir, llvm::Type *type,
+                                 llvm::Value *addr) {
+  auto load = ir.CreateLoad(type, GuestPointer(ir, addr, type));
+  SetUnaligned(load);
+  return load;
+}
+
+void MemoryLowerer::Store(llvm::IRBuilder<> &ir, llvm::Value *val,
+                          llvm::Value *addr, uint64_t offset) {
+  auto store =
+      ir.CreateStore(val, GuestPointer(ir, addr, val->getType(), offset));
+  SetUnaligned(store);
+}
+
+void MemoryLowerer::Copy(llvm::IRBuilder<> &ir, llvm::Value *dst,
+                         llvm::Value *src, llvm::Value *size) {
+#if LLVM_VERSION_NUMBER >= LLVM_VERSION(10, 0)
+  ir.CreateMemCpy(dst, llvm::MaybeAlign(1), src, llvm::MaybeAlign(1), size);
+#else
+  ir.CreateMemCpy(dst, 1, src, 1, size);
+#endif
+}
+
+void MemoryLowerer::Lower(llvm::CallInst *call, const Lowering &lowering) {
+  llvm::IRBuilder<> ir(call);
+
+  // Vectors may be returned through a pointer argument, which comes before
+  // the `Memory *`.
+  const unsigned first_arg = call->hasStructRetAttr() ? 1 : 0;
+  const auto mem_ptr = call->getArgOperand(first_arg);
+  const auto num_args = call->arg_size();
+  llvm::Value *addr = nullptr;
+  if (first_arg + 1 < num_args) {
+    addr = call->getArgOperand(first_arg + 1);
+  }
+
+  llvm::Value *res = mem_ptr;
+  switch (lowering.kind) {
+    case LoweringKind::kRead:
+      if (first_arg) {
+        const auto ret_ptr = call->getArgOperand(0);
+#if LLVM_VERSION_NUMBER >= LLVM_VERSION(13, 0)
+        const auto ret_type =
+            call->getCalledFunction()->getParamStructRetType(0);
+#else
+        const auto ret_type = ret_ptr->getType()->getPointerElementType();
+#endif
+        Copy(ir, ret_ptr, GuestPointer(ir, addr, byte_type),
+             llvm::ConstantInt::get(intptr_type,
+                                    dl.getTypeStoreSize(ret_type)));
+        res = nullptr;
+      } else {
+        res = Load(ir, call->getType(), addr);
+      }
+      break;
+
+    case LoweringKind::kReadF80:
+      res = ir.CreateFPTrunc(
+          Load(ir, llvm::Type::getX86_FP80Ty(context), addr), call->getType());
+      break;
+
+    case LoweringKind::kReadF128:
+      res = ir.CreateFPTrunc(Load(ir, llvm::Type::getFP128Ty(context), addr),
+                             call->getType());
+      break;
+
+    // Vectors may be passed as several arguments, or through a pointer
+    // argument, depending on the ABI.
+    case LoweringKind::kWrite: {
+      uint64_t offset = 0;
+      for (auto i = first_arg + 2; i < num_args; ++i) {
+        const auto val = call->getArgOperand(i);
+        if (call->paramHasAttr(i, llvm::Attribute::ByVal)) {
+#if LLVM_VERSION_NUMBER >= LLVM_VERSION(12, 0)
+          const auto val_type = call->getParamByValType(i);
+#else
+          const auto val_type = val->getType()->getPointerElementType();
+#endif
+          const auto size = dl.getTypeStoreSize(val_type);
+          Copy(ir, GuestPointer(ir, addr, byte_type, offset), val,
+               llvm::ConstantInt::get(intptr_type, size));
+          offset += size;
+        } else {
+          Store(ir, val, addr, offset);
+          offset += dl.getTypeStoreSize(val->getType());
+        }
+      }
+      break;
+    }
+
+    case LoweringKind::kWriteF80:
+      Store(ir,
+            ir.CreateFPExt(call->getArgOperand(first_arg + 2),
+                           llvm::Type::getX86_FP80Ty(context)),
+            addr);
+      break;
+
+    case LoweringKind::kWriteF128:
+      Store(ir,
+            ir.CreateFPExt(call->getArgOperand(first_arg + 2),
+                           llvm::Type::getFP128Ty(context)),
+            addr);
+      break;
+
+    case LoweringKind::kCopy: {
+      const auto src = call->getArgOperand(first_arg + 2);
+      const auto count = ir.CreateZExtOrTrunc(
+          call->getArgOperand(first_arg + 3), intptr_type);
+      const auto elem_size =
+          llvm::ConstantInt::get(intptr_type, lowering.elem_size);
+      Copy(ir, GuestPointer(ir, addr, byte_type),
+           GuestPointer(ir, src, byte_type), ir.CreateMul(count, elem_size));
+      break;
+    }
+
+    case LoweringKind::kFill: {
+      const auto val = call->getArgOperand(first_arg + 2);
+      const auto count = ir.CreateZExtOrTrunc(
+          call->getArgOperand(first_arg + 3), intptr_type);
+#if LLVM_VERSION_NUMBER >= LLVM_VERSION(10, 0)
+      ir.CreateMemSet(GuestPointer(ir, addr, byte_type), val, count,
+                      llvm::MaybeAlign(1));
+#else
+      ir.CreateMemSet(GuestPointer(ir, addr, byte_type), val, count, 1);
+#endif
+      break;
+    }
+
+    case LoweringKind::kFence: ir.CreateFence(lowering.ordering); break;
+
+    case LoweringKind::kPassThrough: break;
+  }
+
+  if (res && !call->getType()->isVoidTy()) {
+    call->replaceAllUsesWith(res);
+  }
+  call->eraseFromParent();
+}
+
+// Returns `true` if `func` is one of remill's intrinsics that takes a pointer,
+// e.g. a `Memory *`.
+static bool IsIntrinsicTakingPointer(const llvm::Function &func) {
+  if (!func.isDeclaration() || !func.getName().startswith("__remill_")) {
+    return false;
+  }
+  for (auto &arg : func.args()) {
+    if (arg.getType()->isPointerTy()) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Lower the calls to the intrinsics in `module` for which `filter` returns
+// a lowering.
+template <typename Filter>
+static uint64_t LowerIntrinsics(llvm::Module *module, llvm::Constant *base,
+                                Filter filter) {
+  const auto &lowerings = Lowerings();
+  MemoryLowerer lowerer(module, base);
+  std::vector<llvm::CallInst *> calls;
+  uint64_t num_lowered = 0;
+
+  for (auto &func : *module) {
+    if (!func.isDeclaration()) {
+      continue;
+    }
+
+    auto lowering_it = lowerings.find(func.getName().str());
+    if (lowering_it == lowerings.end()) {
+      continue;
+    }
+
+    const std::optional<Lowering> lowering = filter(lowering_it->second);
+    if (!lowering) {
+      continue;
+    }
+
+    calls.clear();
+    for (auto user : func.users()) {
+      if (auto call = llvm::dyn_cast<llvm::CallInst>(user);
+          call && call->getCalledFunction() == &func) {
+        calls.push_back(call);
+      }
+    }
+
+    for (auto call : calls) {
+      lowerer.Lower(call, *lowering);
+    }
+    num_lowered += calls.size();
+  }
+
+  return num_lowered;
+}
+
+// A guest address, split into a base and a constant offset.
+struct AddressParts {
+  llvm::Value *base;
+  uint64_t offset;
+};
+
+// Split `addr` into a base address plus a constant.
+static AddressParts SplitAddress(llvm::Value *addr) {
+  uint64_t offset = 0;
+  while (auto bin = llvm::dyn_cast<llvm::BinaryOperator>(addr)) {
+    const auto rhs = llvm::dyn_cast<llvm::ConstantInt>(bin->getOperand(1));
+    if (!rhs || rhs->getBitWidth() > 64) {
+      break;
+    } else if (bin->getOpcode() == llvm::Instruction::Add) {
+      offset += rhs->getZExtValue();
+    } else if (bin->getOpcode() == llvm::Instruction::Sub) {
+      offset -= rhs->getZExtValue();
+    } else {
+      break;
+    }
+    addr = bin->getOperand(0);
+  }
+  if (auto ci = llvm::dyn_cast<llvm::ConstantInt>(addr);
+      ci && ci->getBitWidth() <= 64) {
+    return {nullptr, offset + ci->getZExtValue()};
+  }
+  return {addr, offset};
+}
+
+// Returns the number of bytes of guest memory accessed by `call`, which calls
+// an intrinsic that is lowered like `lowering`.
+static uint64_t AccessSize(const llvm::DataLayout &dl, llvm::CallInst *call,
+                           const Lowering &lowering) {
+  switch (lowering.kind) {
+    case LoweringKind::kReadF80:
+    case LoweringKind::kWriteF80: return 10;
+    case LoweringKind::kReadF128:
+    case LoweringKind::kWriteF128: return 16;
+    case LoweringKind::kRead:
+      return dl.getTypeStoreSize(call->getType()).getFixedSize();
+    default:
+      return dl.getTypeStoreSize(call->getArgOperand(2)->getType())
+          .getFixedSize();
+  }
+}
+
+// Returns `true` if the `size_a` bytes at `addr_a` can't overlap the `size_b`
+// bytes at `addr_b`.
+static bool AreDisjoint(llvm::Value *addr_a, uint64_t size_a,
+                        llvm::Value *addr_b, uint64_t size_b,
+                        const DisjointMemoryFunc &disjoint) {
+  const auto a = SplitAddress(addr_a);
+  const auto b = SplitAddress(addr_b);
+  const auto addr_size = addr_a->getType()->getIntegerBitWidth();
+  const auto mask = addr_size >= 64 ? ~0ull : (1ull << addr_size) - 1ull;
+  if (a.base == b.base) {
+
+    // The distances between the two accesses, in both directions, modulo
+    // the size of the address space.
+    const auto a_to_b = (b.offset - a.offset) & mask;
+    const auto b_to_a = (a.offset - b.offset) & mask;
+    if (a_to_b >= size_a && b_to_a >= size_b) {
+      return true;
+    }
+  }
+  return disjoint && disjoint(addr_a, size_a, addr_b, size_b);
+}
+
+// A call to an 8-, 16-, or 32-bit integer memory access intrinsic that might
+// be merged with the calls that access the memory next to it.
+struct NarrowAccess {
+  llvm::CallInst *call;
+  llvm::Value *base;
+  uint64_t offset;
+  uint64_t size;
+
+  // Position of `call` in its basic block.
+  size_t order;
+};
+
+// Returns the integer memory read or write intrinsic of `size` bytes in
+// `module`, if it is declared.
+static llvm::Function *IntegerIntrinsic(llvm::Module *module, bool is_write,
+                                        uint64_t size) {
+  return module->getFunction(
+      std::string(is_write ? "__remill_write_memory_"
+                           : "__remill_read_memory_") +
+      std::to_string(size * 8));
+}
+
+// Returns the size of the narrow integer access of `call`, or zero if `call`
+// isn't one.
+static uint64_t NarrowAccessSize(llvm::CallInst *call, bool is_write) {
+  const auto callee = call->getCalledFunction();
+  if (!callee || !callee->isDeclaration()) {
+    return 0;
+  }
+  const auto name = callee->getName();
+  const llvm::StringRef prefix =
+      is_write ? "__remill_write_memory_" : "__remill_read_memory_";
+  if (!name.startswith(prefix)) {
+    return 0;
+  }
+  const auto bits = name.substr(prefix.size());
+  if (bits == "8") {
+    return 1;
+  } else if (bits == "16") {
+    return 2;
+  } else if (bits == "32") {
+    return 4;
+  } else {
+    return 0;
+  }
+}
+
+// Returns the end of the longest run of `accesses`, sorted by offset, that
+// starts at `begin`, covers contiguous memory, and has two or more accesses
+// that are 2, 4, or 8 bytes in total. Returns `begin` if there is none.
+static size_t FindContiguousRun(const std::vector<NarrowAccess> &accesses,
+                                size_t begin) {
+  auto run_end = begin;
+  auto end_offset = accesses[begin].offset + accesses[begin].size;
+  for (auto i = begin + 1; i < accesses.size(); ++i) {
+    const auto &access = accesses[i];
+    const auto total = end_offset - accesses[begin].offset + access.size;
+    if (access.offset != end_offset || total > 8) {
+      break;
+    }
+    end_offset += access.size;
+    if (total == 2 || total == 4 || total == 8) {
+      run_end = i;
+    }
+  }
+  return run_end;
+}
+
+// Returns the shift, in bits, of the `size` bytes at `offset` within the
+// `total` bytes at `base_offset`.
+static uint64_t ByteShift(uint64_t base_offset, uint64_t total,
+                          uint64_t offset, uint64_t size,
+                          bool little_endian) {
+  if (little_endian) {
+    return (offset - base_offset) * 8;
+  } else {
+    return (base_offset + total - offset - size) * 8;
+  }
+}
+
+// Returns the address `offset` bytes from `base`, at the insertion point of
+// `ir`. `addr_type` is the type of the address operand of the intrinsics.
+static llvm::Value *BuildAddress(llvm::IRBuilder<> &ir, llvm::Type *addr_type,
+                                 llvm::Value *base, uint64_t offset) {
+  const auto offset_val = llvm::ConstantInt::get(addr_type, offset);
+  if (!base) {
+    return offset_val;
+  } else if (!offset) {
+    return base;
+  } else {
+    return ir.CreateAdd(base, offset_val);
+  }
+}
+
+// Merge the reads of `group`, which all take the same `Memory *` and
+// address the same base, sorted by offset.
+static uint64_t CoalesceReads(llvm::Module *module,
+                              std::vector<NarrowAccess> &group,
+                              bool little_endian) {
+  uint64_t num_removed = 0;
+  for (size_t begin = 0; begin < group.size();) {
+    const auto end = FindContiguousRun(group, begin);
+    if (end == begin) {
+      begin += 1;
+      continue;
+    }
+
+    const auto &first = group[begin];
+    const auto total = group[end].offset + group[end].size - first.offset;
+    const auto wide_func = IntegerIntrinsic(module, false, total);
+    if (!wide_func) {
+      begin = end + 1;
+      continue;
+    }
+
+    // The base address dominates every read, and so the earliest of them.
+    auto earliest = &first;
+    for (auto i = begin; i <= end; ++i) {
+      if (group[i].order < earliest->order) {
+        earliest = &(group[i]);
+      }
+    }
+
+    llvm::IRBuilder<> ir(earliest->call);
+    const auto addr_type = first.call->getArgOperand(1)->getType();
+    const auto wide = ir.CreateCall(
+        wide_func, {first.call->getArgOperand(0),
+                    BuildAddress(ir, addr_type, first.base, first.offset)});
+
+    for (auto i = begin; i <= end; ++i) {
+      const auto &access = group[i];
+      const auto shift = ByteShift(first.offset, total, access.offset,
+                                   access.size, little_endian);
+      ir.SetInsertPoint(access.call);
+      auto val = shift ? ir.CreateLShr(wide, shift) : wide;
+      val = ir.CreateTrunc(val, access.call->getType());
+      access.call->replaceAllUsesWith(val);
+      access.call->eraseFromParent();
+    }
+
+    num_removed += end - begin;
+    begin = end + 1;
+  }
+  return num_removed;
+}
+
+// Merge the writes of `run`, which are consecutive in the chain of
+// `Memory *` values, don't overlap, and address the same base.
+static uint64_t CoalesceWrites(llvm::Module *module,
+                               std::vector<NarrowAccess> &run,
+                               bool little_endian) {
+  if (run.size() < 2) {
+    return 0;
+  }
+
+  auto sorted = run;
+  std::sort(sorted.begin(), sorted.end(),
+            [](const NarrowAccess &a, const NarrowAccess &b) {
+              return a.offset < b.offset;
+            });
+
+  // The last write, in chain order, of each merged group of writes, and the
+  // other writes of the group.
+  std::unordered_map<llvm::CallInst *, std::pair<size_t, size_t>> last_of;
+  std::unordered_set<llvm::CallInst *> merged;
+  uint64_t num_removed = 0;
+  for (size_t begin = 0; begin < sorted.size();) {
+    const auto end = FindContiguousRun(sorted, begin);
+    const auto total =
+        sorted[end].offset + sorted[end].size - sorted[begin].offset;
+    if (end == begin || !IntegerIntrinsic(module, true, total)) {
+      begin = end + 1;
+      continue;
+    }
+
+    auto last = &(sorted[begin]);
+    for (auto i = begin; i <= end; ++i) {
+      merged.insert(sorted[i].call);
+      if (sorted[i].order > last->order) {
+        last = &(sorted[i]);
+      }
+    }
+    last_of.emplace(last->call, std::make_pair(begin, end));
+    num_removed += end - begin;
+    begin = end + 1;
+  }
+
+  if (merged.empty()) {
+    return 0;
+  }
+
+  // Rebuild the chain, in order, with a wide write in place of the last
+  // write of each group.
+  llvm::IRBuilder<> ir(run.front().call);
+  llvm::Value *memory = run.front().call->getArgOperand(0);
+  for (auto &access : run) {
+    if (!merged.count(access.call)) {
+      access.call->setArgOperand(0, memory);
+      memory = access.call;
+      continue;
+    }
+
+    auto last_it = last_of.find(access.call);
+    if (last_it == last_of.end()) {
+      continue;
+    }
+
+    const auto [begin, end] = last_it->second;
+    const auto &first = sorted[begin];
+    const auto total = sorted[end].offset + sorted[end].size - first.offset;
+    const auto wide_type = llvm::Type::getIntNTy(ir.getContext(), total * 8);
+    ir.SetInsertPoint(access.call);
+    llvm::Value *wide_val = nullptr;
+    for (auto i = begin; i <= end; ++i) {
+      const auto &part = sorted[i];
+      const auto shift = ByteShift(first.offset, total, part.offset,
+                                   part.size, little_endian);
+      auto val = ir.CreateZExt(part.call->getArgOperand(2), wide_type);
+      if (shift) {
+        val = ir.CreateShl(val, shift);
+      }
+      wide_val = wide_val ? ir.CreateOr(wide_val, val) : val;
+    }
+
+    const auto addr_type = first.call->getArgOperand(1)->getType();
+    memory = ir.CreateCall(
+        IntegerIntrinsic(ir.GetInsertBlock()->getModule(), true, total),
+        {memory, BuildAddress(ir, addr_type, first.base, first.offset),
+         wide_val});
+  }
+
+  // If the last write of the chain wasn't merged, then it's still the end of
+  // the rebuilt chain.
+  if (memory != run.back().call) {
+    run.back().call->replaceAllUsesWith(memory);
+  }
+  for (auto it = run.rbegin(); it != run.rend(); ++it) {
+    if (merged.count(it->call)) {
+      it->call->eraseFromParent();
+    }
+  }
+  return num_removed;
+}
+
+}  // namespace
+
+// Replace the calls in `module` to the memory access intrinsics with plain
+// loads and stores into a flat guest address space.
+uint64_t LowerMemoryIntrinsics(llvm::Module *module, llvm::Constant *base) {
+  CHECK(!base || base->getType()->isPointerTy())
+      << "The base of guest memory must be a pointer";
+
+  const auto &lowerings = Lowerings();
+  const auto num_lowered = LowerIntrinsics(
+      module, base,
+      [](const Lowering &lowering) -> std::optional<Lowering> {
+        return lowering;
+      });
+
+  // The remaining intrinsics that take a `Memory *` now have to be ordered
+  // with respect to the lowered loads and stores.
+  for (auto &func : *module) {
+    if (!IsIntrinsicTakingPointer(func) ||
+        lowerings.count(func.getName().str())) {
+      continue;
+    }
+    func.removeFnAttr(llvm::Attribute::ReadNone);
+    func.removeFnAttr(llvm::Attribute::ReadOnly);
+    for (auto user : func.users()) {
+      if (auto call = llvm::dyn_cast<llvm::CallInst>(user)) {
+#if LLVM_VERSION_NUMBER >= LLVM_VERSION(14, 0)
+        call->removeFnAttr(llvm::Attribute::ReadNone);
+        call->removeFnAttr(llvm::Attribute::ReadOnly);
+#else
+        call->removeAttribute(llvm::AttributeList::FunctionIndex,
+                              llvm::Attribute::ReadNone);
+        call->removeAttribute(llvm::AttributeList::FunctionIndex,
+                              llvm::Attribute::ReadOnly);
+#endif
+      }
+    }
+  }
+
+  return num_lowered;
+}
+
+// Replace the calls in `module` to the memory barrier, atomic region, and
+// delay slot intrinsics with fences, or with nothing.
+uint64_t LowerBarrierIntrinsics(llvm::Module *module, bool single_threaded) {
+  return LowerIntrinsics(
+      module, nullptr,
+      [=](const Lowering &lowering) -> std::optional<Lowering> {
+        if (lowering.kind == LoweringKind::kPassThrough) {
+          return lowering;
+        } else if (lowering.kind != LoweringKind::kFence) {
+          return std::nullopt;
+        } else if (single_threaded) {
+          return Lowering{LoweringKind::kPassThrough, 0,
+                          llvm::AtomicOrdering::NotAtomic};
+        } else {
+          return lowering;
+        }
+      });
+}
+
+// Make the reads in `module` skip the `Memory *` of the writes that can't
+// overlap them.
+uint64_t RelaxMemoryChains(llvm::Module *module,
+                           const DisjointMemoryFunc &disjoint) {
+  const auto &lowerings = Lowerings();
+  const auto &dl = module->getDataLayout();
+
+  // Returns the lowering of `call` if it is a write intrinsic call.
+  const auto write_lowering = [&](llvm::Value *val) -> const Lowering * {
+    const auto call = llvm::dyn_cast<llvm::CallInst>(val);
+    const auto callee = call ? call->getCalledFunction() : nullptr;
+    if (!callee || !callee->isDeclaration()) {
+      return nullptr;
+    }
+    auto it = lowerings.find(callee->getName().str());
+    if (it == lowerings.end()) {
+      return nullptr;
+    }
+    switch (it->second.kind) {
+      case LoweringKind::kWrite:
+      case LoweringKind::kWriteF80:
+      case LoweringKind::kWriteF128: return &(it->second);
+      default: return nullptr;
+    }
+  };
+
+  uint64_t num_relaxed = 0;
+  for (auto &func : *module) {
+    if (!func.isDeclaration()) {
+      continue;
+    }
+
+    auto lowering_it = lowerings.find(func.getName().str());
+    if (lowering_it == lowerings.end()) {
+      continue;
+    }
+
+    const auto &lowering = lowering_it->second;
+    if (lowering.kind != LoweringKind::kRead &&
+        lowering.kind != LoweringKind::kReadF80 &&
+        lowering.kind != LoweringKind::kReadF128) {
+      continue;
+    }
+
+    for (auto user : func.users()) {
+      const auto read = llvm::dyn_cast<llvm::CallInst>(user);
+      if (!read || read->getCalledFunction() != &func) {
+        continue;
+      }
+
+      const auto read_addr = read->getArgOperand(1);
+      const auto read_size = AccessSize(dl, read, lowering);
+      const auto old_memory = read->getArgOperand(0);
+      auto memory = old_memory;
+
+      // Each write's `Memory *` dominates the write, and so it also dominates
+      // the read.
+      while (auto write = llvm::dyn_cast<llvm::CallInst>(memory)) {
+        const auto write_kind = write_lowering(write);
+        if (!write_kind || !AreDisjoint(read_addr, read_size,
+                                        write->getArgOperand(1),
+                                        AccessSize(dl, write, *write_kind),
+                                        disjoint)) {
+          break;
+        }
+        memory = write->getArgOperand(0);
+      }
+
+      if (memory != old_memory) {
+        read->setArgOperand(0, memory);
+        num_relaxed += 1;
+      }
+    }
+  }
+
+  return num_relaxed;
+}
+
+// Merge the calls in `module` to the narrow integer memory access intrinsics
+// that access adjacent guest memory into calls to wider ones.
+uint64_t CoalesceMemoryAccesses(const Arch *arch, llvm::Module *module) {
+  const auto little_endian = arch->MemoryAccessIsLittleEndian();
+  uint64_t num_removed = 0;
+
+  std::vector<std::vector<NarrowAccess>> read_groups;
+  std::map<std::pair<llvm::Value *, llvm::Value *>, size_t> read_group_index;
+  std::vector<std::vector<NarrowAccess>> write_runs;
+  for (auto &func : *module) {
+    for (auto &block : func) {
+      read_groups.clear();
+      read_group_index.clear();
+      write_runs.clear();
+
+      size_t order = 0;
+      std::vector<NarrowAccess> write_run;
+      for (auto &inst : block) {
+        order += 1;
+        auto call = llvm::dyn_cast<llvm::CallInst>(&inst);
+        if (!call) {
+          continue;
+        }
+
+        if (auto size = NarrowAccessSize(call, false)) {
+          const auto parts = SplitAddress(call->getArgOperand(1));
+          const auto key = std::make_pair(call->getArgOperand(0), parts.base);
+          auto [it, added] =
+              read_group_index.emplace(key, read_groups.size());
+          if (added) {
+            read_groups.emplace_back();
+          }
+          read_groups[it->second].push_back(
+              {call, parts.base, parts.offset, size, order});
+          continue;
+        }
+
+        const auto size = NarrowAccessSize(call, true);
+        if (!size) {
+          continue;
+        }
+
+        // Extend the run of writes if this write follows its last write in
+        // the chain, and nothing else uses the `Memory *` between them.
+        const auto parts = SplitAddress(call->getArgOperand(1));
+        NarrowAccess access = {call, parts.base, parts.offset, size, order};
+        auto extends = !write_run.empty() &&
+                       call->getArgOperand(0) == write_run.back().call &&
+                       write_run.back().call->hasOneUse() &&
+                       write_run.back().base == parts.base;
+        for (auto i = 0u; extends && i < write_run.size(); ++i) {
+          const auto &prev = write_run[i];
+          extends = prev.offset + prev.size <= access.offset ||
+                    access.offset + access.size <= prev.offset;
+        }
+        if (!extends && !write_run.empty()) {
+          write_runs.push_back(std::move(write_run));
+          write_run.clear();
+        }
+        write_run.push_back(access);
+      }
+      if (!write_run.empty()) {
+        write_runs.push_back(std::move(write_run));
+      }
+
+      for (auto &group : read_groups) {
+        std::stable_sort(group.begin(), group.end(),
+                         [](const NarrowAccess &a, const NarrowAccess &b) {
+                           return a.offset < b.offset;
+                         });
+        num_removed += CoalesceReads(module, group, little_endian);
+      }
+      for (auto &run : write_runs) {
+        num_removed += CoalesceWrites(module, run, little_endian);
+      }
+    }
+  }
+
+  return num_removed;
+}
+
+}  // namespace remill
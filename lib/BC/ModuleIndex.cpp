@@ -0,0 +1,172 @@
+/*
+ * Copyright (c) 2020 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "remill/BC/ModuleIndex.h"
+
+#include <glog/logging.h>
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/GlobalVariable.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/Module.h>
+#include <llvm/IR/ValueHandle.h>
+
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace remill {
+
+class ModuleIndex::Impl {
+ public:
+  explicit Impl(llvm::Module *module_) : module(module_) {}
+
+  void RemoveCalls(llvm::Function *func);
+
+  llvm::Module *const module;
+
+  // ISEL variables, in module order, followed by those added since. Deleted
+  // variables become null.
+  std::vector<llvm::WeakVH> isels;
+
+  // The calls to each function. Deleted calls become null.
+  std::unordered_map<llvm::Function *, std::vector<llvm::WeakVH>> callers;
+
+  // The distinct functions called by each indexed function, in the order
+  // that they are first called.
+  std::unordered_map<llvm::Function *, std::vector<llvm::Function *>> callees;
+};
+
+// Forget the calls made by `func`.
+void ModuleIndex::Impl::RemoveCalls(llvm::Function *func) {
+  auto it = callees.find(func);
+  if (it == callees.end()) {
+    return;
+  }
+
+  for (auto callee : it->second) {
+    auto &calls = callers[callee];
+    calls.erase(std::remove_if(calls.begin(), calls.end(),
+                               [=](const llvm::WeakVH &call) {
+                                 if (!call) {
+                                   return true;
+                                 }
+                                 auto inst =
+                                     llvm::cast<llvm::Instruction>(call);
+                                 return inst->getFunction() == func;
+                               }),
+                calls.end());
+  }
+  callees.erase(it);
+}
+
+ModuleIndex::~ModuleIndex(void) {}
+
+ModuleIndex::ModuleIndex(llvm::Module *module) : impl(new Impl(module)) {
+  for (auto &global : module->globals()) {
+    const auto name = global.getName();
+    if (name.startswith("ISEL_") || name.startswith("COND_")) {
+      impl->isels.emplace_back(&global);
+    }
+  }
+
+  // Functions of lazily loaded modules whose bodies haven't been read yet are
+  // left out, as reading them here would defeat lazy loading.
+  for (auto &func : *module) {
+    if (!func.empty()) {
+      AddFunction(&func);
+    }
+  }
+}
+
+// Apply `callback` to every ISEL variable.
+void ModuleIndex::ForEachISel(ISelCallback callback) const {
+  for (const auto &isel : impl->isels) {
+    if (!isel) {
+      continue;
+    }
+    auto global = llvm::cast<llvm::GlobalVariable>(isel);
+    llvm::Function *sem = nullptr;
+    if (global->hasInitializer()) {
+      sem = llvm::dyn_cast<llvm::Function>(
+          global->getInitializer()->stripPointerCasts());
+    }
+    callback(global, sem);
+  }
+}
+
+// Returns the indexed calls to `func`.
+std::vector<llvm::CallInst *>
+ModuleIndex::CallersOf(llvm::Function *func) const {
+  std::vector<llvm::CallInst *> callers;
+  auto it = impl->callers.find(func);
+  if (it == impl->callers.end()) {
+    return callers;
+  }
+
+  // A call may have since been changed to call something else.
+  for (const auto &call : it->second) {
+    if (call) {
+      auto call_inst = llvm::cast<llvm::CallInst>(call);
+      if (call_inst->getCalledFunction() == func) {
+        callers.push_back(call_inst);
+      }
+    }
+  }
+  return callers;
+}
+
+// Returns the functions directly called by `func`.
+std::vector<llvm::Function *>
+ModuleIndex::CalleesOf(llvm::Function *func) const {
+  auto it = impl->callees.find(func);
+  if (it == impl->callees.end()) {
+    return {};
+  }
+  return it->second;
+}
+
+// Index the calls made by `func`.
+void ModuleIndex::AddFunction(llvm::Function *func) {
+  CHECK_EQ(func->getParent(), impl->module);
+  impl->RemoveCalls(func);
+  if (func->isDeclaration()) {
+    return;
+  }
+
+  auto &func_callees = impl->callees[func];
+  std::unordered_set<llvm::Function *> seen;
+  for (auto &block : *func) {
+    for (auto &inst : block) {
+      if (auto call = llvm::dyn_cast<llvm::CallInst>(&inst)) {
+        if (auto callee = call->getCalledFunction()) {
+          impl->callers[callee].emplace_back(call);
+          if (seen.insert(callee).second) {
+            func_callees.push_back(callee);
+          }
+        }
+      }
+    }
+  }
+}
+
+// Index a new ISEL variable.
+void ModuleIndex::AddISel(llvm::GlobalVariable *isel) {
+  CHECK_EQ(isel->getParent(), impl->module);
+  impl->isels.emplace_back(isel);
+}
+
+}  // namespace remill
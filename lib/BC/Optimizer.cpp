@@ -22,6 +22,7 @@
 #include <llvm/IR/DataLayout.h>
 #include <llvm/IR/DebugInfo.h>
 #include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/InlineAsm.h>
 #include <llvm/IR/InstIterator.h>
 #include <llvm/IR/LLVMContext.h>
 #include <llvm/IR/LegacyPassManager.h>
@@ -29,37 +30,417 @@
 #include <llvm/IR/Metadata.h>
 #include <llvm/IR/Module.h>
 #include <llvm/IR/Type.h>
+#include <llvm/Pass.h>
 #include <llvm/Transforms/IPO.h>
 #include <llvm/Transforms/IPO/PassManagerBuilder.h>
+#include <llvm/Transforms/InstCombine/InstCombine.h>
 #include <llvm/Transforms/Scalar.h>
 #include <llvm/Transforms/Utils/Cloning.h>
 #include <llvm/Transforms/Utils/Local.h>
 #include <llvm/Transforms/Utils/ValueMapper.h>
 
+#include <algorithm>
+#include <cfenv>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
 #include "remill/Arch/Arch.h"
+#include "remill/BC/Compat/Cloning.h"
 #include "remill/BC/Compat/ScalarTransforms.h"
 #include "remill/BC/Compat/TargetLibraryInfo.h"
 #include "remill/BC/DeadStoreEliminator.h"
+#include "remill/BC/HyperCallLowering.h"
+#include "remill/BC/MemoryLowering.h"
+#include "remill/BC/StateCheckpoint.h"
+#include "remill/BC/StatePromotion.h"
+#include "remill/BC/Statistics.h"
 #include "remill/BC/Util.h"
+#include "remill/BC/Version.h"
+
+#if LLVM_VERSION_NUMBER >= LLVM_VERSION(14, 0)
+#  define REMILL_HAS_NEW_PASS_MANAGER 1
+#  include <llvm/Analysis/CGSCCPassManager.h>
+#  include <llvm/ADT/Any.h>
+#  include <llvm/Analysis/LoopAnalysisManager.h>
+#  include <llvm/Analysis/LoopInfo.h>
+#  include <llvm/Analysis/TargetLibraryInfo.h>
+#  include <llvm/IR/OptBisect.h>
+#  include <llvm/IR/PassManager.h>
+#  include <llvm/IR/PassTimingInfo.h>
+#  include <llvm/IR/Verifier.h>
+#  include <llvm/Passes/PassBuilder.h>
+#  include <llvm/Passes/StandardInstrumentations.h>
+#  include <llvm/Transforms/IPO/AlwaysInliner.h>
+#  include <llvm/Transforms/IPO/GlobalDCE.h>
+#  include <llvm/Transforms/IPO/IROutliner.h>
+#  include <llvm/Transforms/IPO/Inliner.h>
+#  include <llvm/Transforms/Scalar/ADCE.h>
+#  include <llvm/Transforms/Scalar/DeadStoreElimination.h>
+#  include <llvm/Transforms/Scalar/EarlyCSE.h>
+#  include <llvm/Transforms/Scalar/GVN.h>
+#  include <llvm/Transforms/Scalar/SROA.h>
+#  include <llvm/Transforms/Scalar/SimplifyCFG.h>
+#else
+#  define REMILL_HAS_NEW_PASS_MANAGER 0
+#endif
 
 namespace remill {
+namespace {
 
-void OptimizeModule(const remill::Arch *arch, llvm::Module *module,
-                    std::function<llvm::Function *(void)> generator,
-                    OptimizationGuide guide) {
+// Returns `true` if `guide` selects a new pass manager pipeline that is
+// available with this version of LLVM.
+static bool UseNewPassManager(const OptimizationGuide &guide) {
+  if (guide.preset == OptimizationPreset::kLegacyO3) {
+    return false;
+  }
+#if REMILL_HAS_NEW_PASS_MANAGER
+  return true;
+#else
+  LOG(WARNING) << "Optimization presets need LLVM 14 or newer; using the "
+               << "legacy -O3 pipeline instead";
+  return false;
+#endif
+}
 
-  auto bb_func = BasicBlockFunction(module);
-  auto slots = StateSlots(arch, module);
+// Tracks the time that passes spend on each function, and tells when a
+// function is over its budget. The time between two queries is attributed to
+// the function of the earlier query, i.e. to the pass that ran in between.
+class FunctionTimeBudget {
+ public:
+  explicit FunctionTimeBudget(double budget_seconds_)
+      : budget_seconds(budget_seconds_),
+        last_time(std::chrono::steady_clock::now()) {}
 
-  llvm::legacy::FunctionPassManager func_manager(module);
-  llvm::legacy::PassManager module_manager;
+  // Returns `true` if another pass may run on the function named `name`.
+  // Passes on anything other than a function have an empty `name`, and
+  // always run.
+  bool ShouldRunPass(llvm::StringRef name);
+
+ private:
+  const double budget_seconds;
+  std::string last_name;
+  std::chrono::steady_clock::time_point last_time;
+  std::unordered_map<std::string, double> spent_seconds;
+};
+
+bool FunctionTimeBudget::ShouldRunPass(llvm::StringRef name) {
+  const auto now = std::chrono::steady_clock::now();
+  if (!last_name.empty()) {
+    spent_seconds[last_name] +=
+        std::chrono::duration<double>(now - last_time).count();
+  }
+  last_time = now;
+  last_name = name.str();
+  if (name.empty()) {
+    return true;
+  }
+
+  auto &spent = spent_seconds[last_name];
+  if (spent < budget_seconds) {
+    return true;
+  }
+
+  // Only warn once per function. The function's spent time only grows
+  // between passes, which are no longer run.
+  if (spent != budget_seconds) {
+    LOG(WARNING) << "Stopped optimizing " << last_name << " after "
+                 << spent << " seconds";
+    spent = budget_seconds;
+  }
+  last_name.clear();
+  return false;
+}
+
+#if REMILL_HAS_NEW_PASS_MANAGER
+
+// Applies a `FunctionTimeBudget` to the legacy passes that run on the modules
+// of `context`, for as long as it exists.
+class LegacyTimeBudget final : public llvm::OptPassGate {
+ public:
+  LegacyTimeBudget(llvm::LLVMContext &context_, double budget_seconds)
+      : context(context_),
+        prev_gate(context.getOptPassGate()),
+        budget(budget_seconds),
+        enabled(budget_seconds > 0) {
+    if (enabled) {
+      context.setOptPassGate(*this);
+    }
+  }
+
+  ~LegacyTimeBudget(void) {
+    if (enabled) {
+      context.setOptPassGate(prev_gate);
+    }
+  }
+
+  bool isEnabled(void) const final {
+    return enabled;
+  }
+
+  // Passes on functions describe them as `function (<name>)`.
+  bool shouldRunPass(const llvm::Pass *pass, llvm::StringRef desc) final {
+    if (prev_gate.isEnabled() && !prev_gate.shouldRunPass(pass, desc)) {
+      return false;
+    }
+    llvm::StringRef name;
+    if (desc.consume_front("function (") && desc.consume_back(")")) {
+      name = desc;
+    }
+    return budget.ShouldRunPass(name);
+  }
+
+ private:
+  llvm::LLVMContext &context;
+  llvm::OptPassGate &prev_gate;
+  FunctionTimeBudget budget;
+  const bool enabled;
+};
+
+#else
+
+class LegacyTimeBudget {
+ public:
+  LegacyTimeBudget(llvm::LLVMContext &, double budget_seconds) {
+    LOG_IF(WARNING, budget_seconds > 0)
+        << "Function time budgets need LLVM 14 or newer; ignoring";
+  }
+};
+
+#endif  // REMILL_HAS_NEW_PASS_MANAGER
+
+#if REMILL_HAS_NEW_PASS_MANAGER
+
+// Returns the name of the function that a pass of the new pass manager runs
+// on, or an empty name if it runs on something bigger.
+static llvm::StringRef FunctionNameOf(llvm::Any ir) {
+  if (llvm::any_isa<const llvm::Function *>(ir)) {
+    return llvm::any_cast<const llvm::Function *>(ir)->getName();
+  } else if (llvm::any_isa<const llvm::Loop *>(ir)) {
+    return llvm::any_cast<const llvm::Loop *>(ir)
+        ->getHeader()
+        ->getParent()
+        ->getName();
+  } else {
+    return {};
+  }
+}
+
+// The analyses and pass builder used to run a preset's pipelines on one
+// module.
+class NewPassManager {
+ public:
+  NewPassManager(llvm::Module *module, const OptimizationGuide &guide_);
+
+  // Run the function part of the preset on each of `funcs`.
+  void RunFunctionPasses(const std::vector<llvm::Function *> &funcs);
+
+  // Run the module part of the preset.
+  void RunModulePasses(void);
+
+  // Run LLVM's IR outliner on the module.
+  void RunOutliner(void);
+
+ private:
+  // Add the remill-specific clean-up of lifted code to `fpm`.
+  void AddCleanupPasses(llvm::FunctionPassManager &fpm) const;
+
+  static llvm::PipelineTuningOptions TuningOptions(
+      const OptimizationGuide &guide);
+
+  llvm::Module *const module;
+  const OptimizationGuide guide;
+  llvm::TargetLibraryInfoImpl tlii;
+
+  // Skips the optional passes on `optnone` functions, e.g. cold traces, and
+  // on functions that are over their time budget.
+  llvm::PassInstrumentationCallbacks pic;
+  llvm::OptNoneInstrumentation optnone;
+  std::unique_ptr<FunctionTimeBudget> budget;
+
+  // Times each pass if `-time-passes`, i.e. `llvm::TimePassesIsEnabled`, is
+  // set, like the legacy pass manager does, and prints the timings when the
+  // pass manager is destroyed.
+  llvm::TimePassesHandler time_passes;
+
+  llvm::LoopAnalysisManager lam;
+  llvm::FunctionAnalysisManager fam;
+  llvm::CGSCCAnalysisManager cgam;
+  llvm::ModuleAnalysisManager mam;
+  llvm::PassBuilder pb;
+};
+
+llvm::PipelineTuningOptions
+NewPassManager::TuningOptions(const OptimizationGuide &guide) {
+  llvm::PipelineTuningOptions options;
+  options.LoopUnrolling = true;
+  options.SLPVectorization = guide.slp_vectorize;
+  options.LoopVectorization = guide.loop_vectorize;
+  options.MergeFunctions = false;
+  return options;
+}
+
+NewPassManager::NewPassManager(llvm::Module *module_,
+                               const OptimizationGuide &guide_)
+    : module(module_),
+      guide(guide_),
+      tlii(llvm::Triple(module->getTargetTriple())),
+      optnone(false /* DebugLogging */),
+      time_passes(llvm::TimePassesIsEnabled),
+      pb(nullptr, TuningOptions(guide_), llvm::None, &pic) {
+
+  tlii.disableAllFunctions();  // `-fno-builtin`.
+
+  optnone.registerCallbacks(pic);
+  time_passes.registerCallbacks(pic);
+  if (guide.interrupt.IsSet()) {
+    pic.registerShouldRunOptionalPassCallback(
+        [this](llvm::StringRef, llvm::Any) {
+          return guide.interrupt.Check() == LiftOutcome::kComplete;
+        });
+  }
+  if (guide.function_time_budget_seconds > 0) {
+    budget.reset(new FunctionTimeBudget(guide.function_time_budget_seconds));
+    pic.registerShouldRunOptionalPassCallback(
+        [this](llvm::StringRef, llvm::Any ir) {
+          return budget->ShouldRunPass(FunctionNameOf(ir));
+        });
+  }
+
+  // Registered first, so that it's used instead of the default.
+  fam.registerPass([this] { return llvm::TargetLibraryAnalysis(tlii); });
+  pb.registerModuleAnalyses(mam);
+  pb.registerCGSCCAnalyses(cgam);
+  pb.registerFunctionAnalyses(fam);
+  pb.registerLoopAnalyses(lam);
+  pb.crossRegisterProxies(lam, fam, cgam, mam);
+}
+
+void NewPassManager::AddCleanupPasses(llvm::FunctionPassManager &fpm) const {
+  fpm.addPass(llvm::SROAPass());
+  fpm.addPass(llvm::EarlyCSEPass(true /* UseMemorySSA */));
+  fpm.addPass(llvm::InstCombinePass());
+  fpm.addPass(llvm::SimplifyCFGPass());
+  if (guide.preset == OptimizationPreset::kFast) {
+    return;
+  }
+
+  // Stores to the `State` structure are usually overwritten by later
+  // instructions in the same trace, and GVN exposes more of them.
+  fpm.addPass(llvm::GVNPass());
+  fpm.addPass(llvm::DSEPass());
+  fpm.addPass(llvm::InstCombinePass());
+  fpm.addPass(llvm::SimplifyCFGPass());
+  fpm.addPass(llvm::ADCEPass());
+}
+
+// Run the function part of the preset on each of `funcs`.
+void NewPassManager::RunFunctionPasses(
+    const std::vector<llvm::Function *> &funcs) {
+  llvm::FunctionPassManager fpm;
+  if (guide.preset == OptimizationPreset::kMax) {
+    fpm = pb.buildFunctionSimplificationPipeline(
+        llvm::OptimizationLevel::O3, llvm::ThinOrFullLTOPhase::None);
+  } else {
+    AddCleanupPasses(fpm);
+  }
+
+  for (auto func : funcs) {
+    if (guide.interrupt.Check() != LiftOutcome::kComplete) {
+      break;
+    } else if (!func->isDeclaration()) {
+      fpm.run(*func, fam);
+    }
+  }
+}
+
+// Run the module part of the preset.
+void NewPassManager::RunModulePasses(void) {
+  llvm::ModulePassManager mpm;
+  if (guide.verify_input) {
+    mpm.addPass(llvm::VerifierPass());
+  }
+
+  if (guide.preset == OptimizationPreset::kMax) {
+    mpm.addPass(pb.buildPerModuleDefaultPipeline(llvm::OptimizationLevel::O3));
+
+  } else {
+    mpm.addPass(llvm::AlwaysInlinerPass());
+    if (guide.preset == OptimizationPreset::kBalanced) {
+      mpm.addPass(llvm::ModuleInlinerWrapperPass(llvm::getInlineParams(250)));
+    }
+
+    // Drop the semantics functions that are no longer used before cleaning
+    // up whatever is left.
+    mpm.addPass(llvm::GlobalDCEPass());
+  }
+
+  llvm::FunctionPassManager fpm;
+  AddCleanupPasses(fpm);
+  mpm.addPass(llvm::createModuleToFunctionPassAdaptor(std::move(fpm)));
+  mpm.addPass(llvm::GlobalDCEPass());
+
+  if (guide.verify_output) {
+    mpm.addPass(llvm::VerifierPass());
+  }
+
+  mpm.run(*module, mam);
+}
+
+// Run LLVM's IR outliner on the module.
+void NewPassManager::RunOutliner(void) {
+  llvm::ModulePassManager mpm;
+  mpm.addPass(llvm::IROutlinerPass());
+  if (guide.verify_output) {
+    mpm.addPass(llvm::VerifierPass());
+  }
+  mpm.run(*module, mam);
+}
+
+#endif  // REMILL_HAS_NEW_PASS_MANAGER
+
+// Run the function part of `guide.preset` on each of `funcs`.
+static void RunNewFunctionPasses(llvm::Module *module,
+                                 const std::vector<llvm::Function *> &funcs,
+                                 const OptimizationGuide &guide) {
+#if REMILL_HAS_NEW_PASS_MANAGER
+  NewPassManager(module, guide).RunFunctionPasses(funcs);
+#endif
+}
+
+// Run the module part of `guide.preset` on `module`.
+static void RunNewModulePasses(llvm::Module *module,
+                               const OptimizationGuide &guide) {
+#if REMILL_HAS_NEW_PASS_MANAGER
+  NewPassManager(module, guide).RunModulePasses();
+#endif
+}
 
+// Outline the code that repeats across the functions of `module`. This needs
+// the new pass manager, and so does nothing with older versions of LLVM.
+static void OutlineRepeatedCode(llvm::Module *module,
+                                const OptimizationGuide &guide) {
+#if REMILL_HAS_NEW_PASS_MANAGER
+  NewPassManager(module, guide).RunOutliner();
+#endif
+}
+
+// Configure `builder` with the pipelines used by `OptimizeModule` and
+// `OptimizeBareModule`.
+static void ConfigureBuilder(llvm::PassManagerBuilder &builder,
+                             llvm::Module *module,
+                             const OptimizationGuide &guide) {
   auto TLI =
       new llvm::TargetLibraryInfoImpl(llvm::Triple(module->getTargetTriple()));
 
   TLI->disableAllFunctions();  // `-fno-builtin`.
 
-  llvm::PassManagerBuilder builder;
   builder.OptLevel = 3;
   builder.SizeLevel = 0;
   builder.Inliner = llvm::createFunctionInliningPass(250);
@@ -74,20 +455,672 @@ void OptimizeModule(const remill::Arch *arch, llvm::Module *module,
 
   // TODO(pag): Not sure when this became available.
   IF_LLVM_GTE_800(builder.MergeFunctions = false;)
+}
+
+// A group of traces whose function passes run together on one thread, on
+// copies of the traces in a module with its own context.
+struct FunctionShard {
+  std::vector<llvm::Function *> funcs;
+  std::unique_ptr<llvm::LLVMContext> context;
+  std::unique_ptr<llvm::Module> module;
 
+  // The copies of `funcs` in `module`.
+  std::vector<llvm::Function *> copies;
+};
+
+// Run the function passes on the copied traces of `shard`.
+static void RunFunctionPasses(FunctionShard &shard,
+                              const OptimizationGuide &guide) {
+  TraceEventSpan span(guide.stats ? guide.stats->events : nullptr,
+                      "function_passes_shard");
+  if (UseNewPassManager(guide)) {
+    RunNewFunctionPasses(shard.module.get(), shard.copies, guide);
+    return;
+  }
+
+  llvm::legacy::FunctionPassManager func_manager(shard.module.get());
+  llvm::PassManagerBuilder builder;
+  ConfigureBuilder(builder, shard.module.get(), guide);
   builder.populateFunctionPassManager(func_manager);
-  builder.populateModulePassManager(module_manager);
+
+  LegacyTimeBudget budget(*shard.context, guide.function_time_budget_seconds);
+
+  func_manager.doInitialization();
+  for (auto copy : shard.copies) {
+    if (guide.interrupt.Check() != LiftOutcome::kComplete) {
+      break;
+    }
+    func_manager.run(*copy);
+  }
+  func_manager.doFinalization();
+}
+
+// Run the function passes on `funcs`, split across `guide.num_threads`
+// threads. Only the worker threads' own contexts are used concurrently; all
+// copying in and out of `module` happens on this thread.
+static void RunFunctionPassesInParallel(
+    llvm::Module *module, const std::vector<llvm::Function *> &funcs,
+    const OptimizationGuide &guide) {
+
+  // Internal and unnamed symbols can't be referenced from another module, so
+  // they are named, hidden, external symbols until the traces are copied
+  // back.
+  std::vector<std::pair<llvm::GlobalValue *, llvm::GlobalValue::LinkageTypes>>
+      locals;
+  std::vector<llvm::GlobalValue *> unnamed;
+  for (auto &gv : module->global_values()) {
+    if (!gv.hasName()) {
+      gv.setName("remill_unnamed");
+      unnamed.push_back(&gv);
+    }
+    if (gv.hasLocalLinkage()) {
+      locals.emplace_back(&gv, gv.getLinkage());
+      gv.setLinkage(llvm::GlobalValue::ExternalLinkage);
+      gv.setVisibility(llvm::GlobalValue::HiddenVisibility);
+    }
+  }
+
+  const auto num_shards = std::min<size_t>(guide.num_threads, funcs.size());
+  std::vector<FunctionShard> shards(num_shards);
+  for (size_t i = 0; i < num_shards; ++i) {
+    auto &shard = shards[i];
+    shard.funcs.assign(funcs.begin() + (i * funcs.size()) / num_shards,
+                       funcs.begin() + ((i + 1) * funcs.size()) / num_shards);
+    shard.context.reset(new llvm::LLVMContext);
+    shard.module.reset(new llvm::Module(module->getName(), *shard.context));
+    shard.module->setDataLayout(module->getDataLayout());
+    shard.module->setTargetTriple(module->getTargetTriple());
+
+    ContextTransferSession session(*shard.context);
+    for (auto func : shard.funcs) {
+
+      // An earlier trace may have already declared this one.
+      auto copy = shard.module->getFunction(func->getName());
+      if (!copy) {
+        const auto func_type = llvm::cast<llvm::FunctionType>(
+            RecontextualizeType(func->getFunctionType(), *shard.context));
+        copy = llvm::Function::Create(func_type, func->getLinkage(),
+                                      func->getName(), shard.module.get());
+      }
+      CloneFunctionInto(func, copy);
+      shard.copies.push_back(copy);
+    }
+  }
+
+  std::vector<std::thread> threads;
+  threads.reserve(num_shards);
+  for (auto &shard : shards) {
+    threads.emplace_back(RunFunctionPasses, std::ref(shard), std::cref(guide));
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  // The session caches types from the contexts of the shards, and so they
+  // are only destroyed once everything has been copied back.
+  {
+    ContextTransferSession session(module->getContext());
+    for (auto &shard : shards) {
+      for (size_t i = 0; i < shard.funcs.size(); ++i) {
+        shard.funcs[i]->deleteBody();
+        CloneFunctionInto(shard.copies[i], shard.funcs[i]);
+      }
+    }
+  }
+
+  for (auto &shard : shards) {
+    shard.copies.clear();
+    shard.module.reset();
+    shard.context.reset();
+  }
+
+  // Setting a local linkage also restores the default visibility.
+  for (auto [gv, linkage] : locals) {
+    gv->setLinkage(linkage);
+  }
+  for (auto gv : unnamed) {
+    gv->setName("");
+  }
+}
+
+// Run the cheap tier on the traces `funcs`: inline the calls to always-inline
+// functions, along with any such calls that they expose, then run mem2reg and
+// instruction combining.
+static void RunCheapTier(llvm::Module *module,
+                         const std::vector<llvm::Function *> &funcs) {
+  for (auto func : funcs) {
+    InlineSemanticsIntoTrace(func);
+  }
+
+  llvm::TargetLibraryInfoImpl tli(llvm::Triple(module->getTargetTriple()));
+  tli.disableAllFunctions();  // `-fno-builtin`.
+
+  llvm::legacy::FunctionPassManager func_manager(module);
+  func_manager.add(new llvm::TargetLibraryInfoWrapperPass(tli));
+  func_manager.add(llvm::createPromoteMemoryToRegisterPass());
+  func_manager.add(llvm::createInstructionCombiningPass());
+
   func_manager.doInitialization();
-  llvm::Function *func = nullptr;
-  while (nullptr != (func = generator())) {
+  for (auto func : funcs) {
     func_manager.run(*func);
   }
   func_manager.doFinalization();
-  module_manager.run(*module);
+}
+
+// Relax the chains of `Memory *` values in `module`, then merge the reads of
+// `funcs` that now take the same `Memory *` and address.
+static void RelaxMemoryChainsOf(llvm::Module *module,
+                                const std::vector<llvm::Function *> &funcs,
+                                const OptimizationGuide &guide) {
+  if (!RelaxMemoryChains(module, guide.disjoint_memory)) {
+    return;
+  }
+
+  llvm::TargetLibraryInfoImpl tli(llvm::Triple(module->getTargetTriple()));
+  tli.disableAllFunctions();  // `-fno-builtin`.
+
+  llvm::legacy::FunctionPassManager func_manager(module);
+  func_manager.add(new llvm::TargetLibraryInfoWrapperPass(tli));
+  func_manager.add(llvm::createEarlyCSEPass());
+  func_manager.add(llvm::createInstructionCombiningPass());
+
+  func_manager.doInitialization();
+  for (auto func : funcs) {
+    func_manager.run(*func);
+  }
+  func_manager.doFinalization();
+}
+
+// Merge the adjacent narrow memory accesses in `module`, then clean up the
+// shifts and truncations that rebuild the narrow values in `funcs`.
+static void
+CoalesceMemoryAccessesOf(const Arch *arch, llvm::Module *module,
+                         const std::vector<llvm::Function *> &funcs) {
+  if (!CoalesceMemoryAccesses(arch, module)) {
+    return;
+  }
+
+  llvm::TargetLibraryInfoImpl tli(llvm::Triple(module->getTargetTriple()));
+  tli.disableAllFunctions();  // `-fno-builtin`.
+
+  llvm::legacy::FunctionPassManager func_manager(module);
+  func_manager.add(new llvm::TargetLibraryInfoWrapperPass(tli));
+  func_manager.add(llvm::createInstructionCombiningPass());
+  func_manager.add(llvm::createEarlyCSEPass());
+
+  func_manager.doInitialization();
+  for (auto func : funcs) {
+    func_manager.run(*func);
+  }
+  func_manager.doFinalization();
+}
+
+// Returns the functions defined in `module` that are outside of the scope of
+// an incremental optimization of the new traces `funcs`, i.e. that aren't one
+// of `funcs`, a direct caller of one of them, or called by one of them,
+// directly or through always-inline functions. Always-inline functions, e.g.
+// the semantics functions, are never returned, as they can't be `noinline`.
+static std::vector<llvm::Function *>
+AlreadyOptimizedFunctions(llvm::Module *module,
+                          const std::vector<llvm::Function *> &funcs) {
+  std::unordered_set<llvm::Function *> scope(funcs.begin(), funcs.end());
+  std::vector<llvm::Function *> work_list(funcs.begin(), funcs.end());
+  for (auto func : funcs) {
+    for (auto user : func->users()) {
+      if (auto call = llvm::dyn_cast<llvm::CallBase>(user)) {
+        scope.insert(call->getFunction());
+      }
+    }
+  }
+
+  while (!work_list.empty()) {
+    const auto func = work_list.back();
+    work_list.pop_back();
+    for (auto &inst : llvm::instructions(*func)) {
+      auto call = llvm::dyn_cast<llvm::CallBase>(&inst);
+      auto callee = call ? call->getCalledFunction() : nullptr;
+      if (!callee || callee->isDeclaration() || !scope.insert(callee).second) {
+        continue;
+      }
+      if (callee->hasFnAttribute(llvm::Attribute::AlwaysInline)) {
+        work_list.push_back(callee);
+      }
+    }
+  }
+
+  std::vector<llvm::Function *> frozen;
+  for (auto &func : *module) {
+    if (!func.isDeclaration() && !scope.count(&func) &&
+        !func.hasFnAttribute(llvm::Attribute::AlwaysInline)) {
+      frozen.push_back(&func);
+    }
+  }
+  return frozen;
+}
+
+// Returns `true` if the trace `func` should get the full pipeline.
+static bool IsHotTrace(llvm::Function *func, const OptimizationGuide &guide) {
+  if (guide.is_hot && guide.is_hot(func)) {
+    return true;
+  }
+  size_t num_insts = 0;
+  for (auto &block : *func) {
+    num_insts += block.size();
+  }
+  return num_insts <= guide.hot_max_instructions;
+}
+
+// Replace the calls to the undefined value intrinsics in `module` as requested
+// by `guide`.
+static void LowerUndefinedValues(llvm::Module *module,
+                                 const OptimizationGuide &guide) {
+  static const char *const kUndefinedIntrinsics[] = {
+      "__remill_undefined_8",  "__remill_undefined_16",
+      "__remill_undefined_32", "__remill_undefined_64",
+      "__remill_undefined_f32", "__remill_undefined_f64"};
+
+  const auto &dl = module->getDataLayout();
+  std::vector<llvm::CallInst *> calls;
+  for (auto name : kUndefinedIntrinsics) {
+    auto func = module->getFunction(name);
+    if (!func) {
+      continue;
+    }
+
+    const auto type = func->getReturnType();
+    llvm::Constant *val = nullptr;
+    if (guide.undefined == UndefinedLowering::kConstant) {
+      const auto num_bits =
+          static_cast<unsigned>(dl.getTypeSizeInBits(type));
+      val = llvm::ConstantExpr::getBitCast(
+          llvm::ConstantInt::get(
+              llvm::Type::getIntNTy(module->getContext(), num_bits),
+              guide.undefined_constant),
+          type);
+    }
+
+    calls.clear();
+    for (auto user : func->users()) {
+      if (auto call = llvm::dyn_cast<llvm::CallInst>(user);
+          call && call->getCalledFunction() == func) {
+        calls.push_back(call);
+      }
+    }
+
+    for (auto call : calls) {
+      if (val) {
+        call->replaceAllUsesWith(val);
+      } else {
+#if LLVM_VERSION_NUMBER >= LLVM_VERSION(12, 0)
+        llvm::IRBuilder<> ir(call);
+        call->replaceAllUsesWith(
+            ir.CreateFreeze(llvm::PoisonValue::get(type)));
+#elif LLVM_VERSION_NUMBER >= LLVM_VERSION(10, 0)
+        llvm::IRBuilder<> ir(call);
+        call->replaceAllUsesWith(ir.CreateFreeze(llvm::UndefValue::get(type)));
+#else
+        call->replaceAllUsesWith(llvm::UndefValue::get(type));
+#endif
+      }
+      call->eraseFromParent();
+    }
+  }
+}
+
+// Returns `true` if `inst` is a compiler barrier, i.e. the empty inline
+// assembly of `BarrierReorder`.
+static bool IsCompilerBarrier(const llvm::Instruction &inst) {
+  auto call = llvm::dyn_cast<llvm::CallInst>(&inst);
+  if (!call || call->arg_size()) {
+    return false;
+  }
+  auto asm_val = llvm::dyn_cast<llvm::InlineAsm>(call->getCalledOperand());
+  return asm_val && asm_val->getAsmString().empty() &&
+         asm_val->hasSideEffects();
+}
+
+// Lower the calls to `__remill_fpu_exception_test_and_clear` in `module` as
+// requested by `guide`.
+//
+// The semantics test the exceptions of an operation with a call that clears
+// the exceptions, i.e. `(0, FE_ALL_EXCEPT)`, before it, and one that reads
+// them after it. They sync the exceptions into the status register with a
+// call that reads and clears nothing, i.e. `(0, 0)`, before it is read or
+// written, which is a no-op until it is lowered here to read and clear all
+// of the host's exceptions, i.e. `(FE_ALL_EXCEPT, FE_ALL_EXCEPT)`. The
+// intrinsic is declared `readnone`, but the lowered syncs really do access the
+// host's floating point environment, and so they lose that attribute.
+// Lowering a module twice is the same as lowering it once.
+static void LowerFPExceptionTests(llvm::Module *module,
+                                  const OptimizationGuide &guide) {
+  const auto func =
+      module->getFunction("__remill_fpu_exception_test_and_clear");
+  if (!func) {
+    return;
+  }
+
+  // The calls that sync the status register, and those around operations.
+  std::vector<llvm::CallInst *> syncs;
+  std::vector<llvm::CallInst *> tests;
+  for (auto user : func->users()) {
+    auto call = llvm::dyn_cast<llvm::CallInst>(user);
+    if (!call || call->getCalledFunction() != func) {
+      continue;
+    }
+    auto read_mask = llvm::dyn_cast<llvm::ConstantInt>(call->getArgOperand(0));
+    auto clear_mask = llvm::dyn_cast<llvm::ConstantInt>(call->getArgOperand(1));
+    if (read_mask && read_mask == clear_mask) {
+      syncs.push_back(call);
+    } else {
+      tests.push_back(call);
+    }
+  }
+
+  if (guide.fp_exceptions == FPExceptionLowering::kIgnore) {
+    tests.insert(tests.end(), syncs.begin(), syncs.end());
+
+  // Only the syncs remain, and they must neither be merged nor be moved
+  // across each other.
+  } else {
+    func->removeFnAttr(llvm::Attribute::ReadNone);
+    func->addFnAttr(llvm::Attribute::InaccessibleMemOnly);
+    for (auto call : syncs) {
+      const auto all_except = llvm::ConstantInt::get(
+          call->getArgOperand(0)->getType(), FE_ALL_EXCEPT);
+      call->setArgOperand(0, all_except);
+      call->setArgOperand(1, all_except);
+#if LLVM_VERSION_NUMBER >= LLVM_VERSION(14, 0)
+      call->removeFnAttr(llvm::Attribute::ReadNone);
+#else
+      call->removeAttribute(llvm::AttributeList::FunctionIndex,
+                            llvm::Attribute::ReadNone);
+#endif
+    }
+  }
+
+  // Without the tests, the barriers that keep the operations between them
+  // only keep the operations from being optimized.
+  std::unordered_set<llvm::Function *> funcs;
+  for (auto call : tests) {
+    funcs.insert(call->getFunction());
+    call->replaceAllUsesWith(llvm::ConstantInt::get(call->getType(), 0));
+    call->eraseFromParent();
+  }
+
+  std::vector<llvm::Instruction *> barriers;
+  for (auto test_func : funcs) {
+    for (auto &inst : llvm::instructions(*test_func)) {
+      if (IsCompilerBarrier(inst)) {
+        barriers.push_back(&inst);
+      }
+    }
+  }
+  for (auto inst : barriers) {
+    inst->eraseFromParent();
+  }
+}
+
+// Lower the barrier, undefined value, and floating point exception
+// intrinsics of `module` as requested by `guide`.
+static void LowerIntrinsics(llvm::Module *module,
+                            const OptimizationGuide &guide) {
+  if (guide.barriers != BarrierLowering::kKeep) {
+    LowerBarrierIntrinsics(module, guide.barriers == BarrierLowering::kRemove);
+  }
+  if (guide.undefined != UndefinedLowering::kKeep) {
+    LowerUndefinedValues(module, guide);
+  }
+  if (guide.fp_exceptions != FPExceptionLowering::kKeep) {
+    LowerFPExceptionTests(module, guide);
+  }
+}
+
+// Remove the ISEL variables of `module`, then internalize and remove the
+// semantics functions that no longer have any uses, along with the functions
+// that only they used. The `__remill_*` functions and `keep` are never
+// removed.
+static void PruneUnusedSemantics(llvm::Module *module,
+                                 const std::vector<llvm::Function *> &keep) {
+  std::vector<llvm::GlobalVariable *> isels;
+  std::vector<llvm::Function *> work_list;
+  ForEachISel(module, [&](llvm::GlobalVariable *isel, llvm::Function *sem) {
+    isels.push_back(isel);
+    if (sem) {
+      work_list.push_back(sem);
+    }
+  });
+
+  for (auto isel : isels) {
+    isel->removeDeadConstantUsers();
+    if (isel->use_empty()) {
+      isel->eraseFromParent();
+    }
+  }
+
+  const std::unordered_set<llvm::Function *> kept(keep.begin(), keep.end());
+  std::unordered_set<llvm::Function *> removed;
+  while (!work_list.empty()) {
+    const auto func = work_list.back();
+    work_list.pop_back();
+    if (removed.count(func) || kept.count(func) || func->isDeclaration() ||
+        func->getName().startswith("__remill_")) {
+      continue;
+    }
+
+    func->removeDeadConstantUsers();
+    if (!func->use_empty()) {
+      continue;
+    }
+
+    for (auto &inst : llvm::instructions(*func)) {
+      for (auto &op : inst.operands()) {
+        if (auto callee = llvm::dyn_cast<llvm::Function>(
+                op.get()->stripPointerCasts())) {
+          work_list.push_back(callee);
+        }
+      }
+    }
+
+    func->setLinkage(llvm::GlobalValue::InternalLinkage);
+    func->dropAllReferences();
+    removed.insert(func);
+  }
+
+  // The references between removed functions were dropped above, so they
+  // can be erased in any order.
+  for (auto func : removed) {
+    func->eraseFromParent();
+  }
+}
+
+}  // namespace
+
+LiftOutcome OptimizeModule(const remill::Arch *arch, llvm::Module *module,
+                          std::function<llvm::Function *(void)> generator,
+                          OptimizationGuide guide) {
+  StatisticsAllocationScope allocs(
+      guide.stats ? &(guide.stats->optimize_alloc_bytes) : nullptr,
+      guide.stats ? &(guide.stats->optimize_allocs) : nullptr);
+
+  // A thin module must always be linked, or it isn't valid.
+  if (guide.semantics) {
+    LinkSemanticsInto(module, guide.semantics);
+  }
+
+  // Returns `true` once the optimizations must stop, recording why in
+  // `outcome`.
+  auto outcome = LiftOutcome::kComplete;
+  const auto interrupted = [&](void) {
+    if (outcome == LiftOutcome::kComplete) {
+      outcome = guide.interrupt.Check();
+    }
+    return outcome != LiftOutcome::kComplete;
+  };
+
+  auto bb_func = BasicBlockFunction(module);
+
+  llvm::legacy::FunctionPassManager func_manager(module);
+  llvm::legacy::PassManager module_manager;
+
+  llvm::PassManagerBuilder builder;
+  ConfigureBuilder(builder, module, guide);
+
+  builder.populateFunctionPassManager(func_manager);
+  builder.populateModulePassManager(module_manager);
+  const auto stats = guide.stats;
+  const auto use_new_pm = UseNewPassManager(guide);
+
+  LowerIntrinsics(module, guide);
+  if (guide.sync_hyper_calls) {
+    LowerSyncHyperCalls(arch, module, *guide.sync_hyper_calls);
+  }
+
+  std::vector<llvm::Function *> funcs;
+  std::unordered_set<llvm::Function *> seen;
+  for (llvm::Function *func = nullptr; nullptr != (func = generator());) {
+    if (!func->isDeclaration() && seen.insert(func).second) {
+      funcs.push_back(func);
+    }
+  }
 
-  if (guide.eliminate_dead_stores) {
-    RemoveDeadStores(arch, module, bb_func, slots);
+  // Only the hot traces are left in `funcs`.
+  std::vector<llvm::Function *> cold_funcs;
+  if (guide.tiered && !interrupted()) {
+    StatisticsTimer timer(stats ? &(stats->function_pass_seconds) : nullptr);
+    RunCheapTier(module, funcs);
+    auto cold_begin =
+        std::stable_partition(funcs.begin(), funcs.end(), [&](auto func) {
+          return IsHotTrace(func, guide);
+        });
+    cold_funcs.assign(cold_begin, funcs.end());
+    funcs.erase(cold_begin, funcs.end());
   }
+
+  if (!interrupted()) {
+    StatisticsTimer timer(stats ? &(stats->function_pass_seconds) : nullptr);
+    TraceEventSpan span(stats ? stats->events : nullptr, "function_passes");
+    if (guide.num_threads > 1) {
+      RunFunctionPassesInParallel(module, funcs, guide);
+    } else if (use_new_pm) {
+      RunNewFunctionPasses(module, funcs, guide);
+    } else {
+      LegacyTimeBudget budget(module->getContext(),
+                              guide.function_time_budget_seconds);
+      func_manager.doInitialization();
+      for (auto func : funcs) {
+        if (interrupted()) {
+          break;
+        }
+        func_manager.run(*func);
+      }
+      func_manager.doFinalization();
+    }
+  }
+
+  if (guide.promote_state_in_loops && !interrupted()) {
+    StatisticsTimer timer(stats ? &(stats->function_pass_seconds) : nullptr);
+    for (auto func : funcs) {
+      if (interrupted()) {
+        break;
+      }
+      PromoteStateInLoops(func);
+    }
+  }
+
+  if (guide.prune_semantics) {
+    std::vector<llvm::Function *> traces(funcs);
+    traces.insert(traces.end(), cold_funcs.begin(), cold_funcs.end());
+    PruneUnusedSemantics(module, traces);
+  }
+
+  // `optnone` requires `noinline`.
+  std::vector<llvm::Function *> made_no_inline;
+  for (auto func : cold_funcs) {
+    if (!func->hasFnAttribute(llvm::Attribute::NoInline)) {
+      func->addFnAttr(llvm::Attribute::NoInline);
+      made_no_inline.push_back(func);
+    }
+    func->addFnAttr(llvm::Attribute::OptimizeNone);
+  }
+
+  // Leave the functions that were already optimized out of the module passes.
+  std::vector<llvm::Function *> made_opt_none;
+  if (guide.incremental) {
+    for (auto func : AlreadyOptimizedFunctions(module, funcs)) {
+      if (func->hasFnAttribute(llvm::Attribute::OptimizeNone)) {
+        continue;
+      }
+      if (!func->hasFnAttribute(llvm::Attribute::NoInline)) {
+        func->addFnAttr(llvm::Attribute::NoInline);
+        made_no_inline.push_back(func);
+      }
+      func->addFnAttr(llvm::Attribute::OptimizeNone);
+      made_opt_none.push_back(func);
+    }
+  }
+
+  if (!interrupted()) {
+    StatisticsTimer timer(stats ? &(stats->module_pass_seconds) : nullptr);
+    TraceEventSpan span(stats ? stats->events : nullptr, "module_passes");
+    if (use_new_pm) {
+      RunNewModulePasses(module, guide);
+    } else {
+      LegacyTimeBudget budget(module->getContext(),
+                              guide.function_time_budget_seconds);
+      module_manager.run(*module);
+    }
+  }
+
+  if (guide.relax_memory_chains && !interrupted()) {
+    StatisticsTimer timer(stats ? &(stats->function_pass_seconds) : nullptr);
+    RelaxMemoryChainsOf(module, funcs, guide);
+  }
+
+  if (guide.coalesce_memory_accesses && !interrupted()) {
+    StatisticsTimer timer(stats ? &(stats->function_pass_seconds) : nullptr);
+    CoalesceMemoryAccessesOf(arch, module, funcs);
+  }
+
+  for (auto funcs_list : {&cold_funcs, &made_opt_none}) {
+    for (auto func : *funcs_list) {
+      func->removeFnAttr(llvm::Attribute::OptimizeNone);
+    }
+  }
+  for (auto func : made_no_inline) {
+    func->removeFnAttr(llvm::Attribute::NoInline);
+  }
+
+  // The interrupt may have fired during the module passes, and skipped some
+  // of them. It fires for good, so checking it here also catches that.
+  if (interrupted() || !guide.eliminate_dead_stores) {
+    // Skip dead store elimination.
+  } else if (guide.dse_cache) {
+    outcome = RemoveDeadStores(arch, module, bb_func, *guide.dse_cache,
+                              nullptr, stats, &(guide.interrupt));
+  } else {
+    outcome = RemoveDeadStores(arch, module, bb_func,
+                              StateSlots(arch, module), nullptr, stats,
+                              &(guide.interrupt));
+  }
+
+  if (guide.track_dirty_state_lines) {
+    for (auto funcs_list : {&funcs, &cold_funcs}) {
+      for (auto func : *funcs_list) {
+        InstrumentStateDirtyLines(arch, func);
+      }
+    }
+  }
+
+  if (guide.outline_repeated_code && !interrupted()) {
+    StatisticsTimer timer(stats ? &(stats->module_pass_seconds) : nullptr);
+    TraceEventSpan span(stats ? stats->events : nullptr, "outline");
+    OutlineRepeatedCode(module, guide);
+  }
+
+  LOG_IF(WARNING, outcome != LiftOutcome::kComplete)
+      << "Stopped optimizing " << module->getName().str() << ": "
+      << LiftOutcomeName(outcome);
+  return outcome;
 }
 
 // Optimize a normal module. This might not contain special functions
@@ -97,29 +1130,25 @@ void OptimizeModule(const remill::Arch *arch, llvm::Module *module,
 //            `true`.
 void OptimizeBareModule(llvm::Module *module, OptimizationGuide guide) {
   CHECK(!guide.eliminate_dead_stores);
+  StatisticsAllocationScope allocs(
+      guide.stats ? &(guide.stats->optimize_alloc_bytes) : nullptr,
+      guide.stats ? &(guide.stats->optimize_allocs) : nullptr);
+  LowerIntrinsics(module, guide);
+  if (UseNewPassManager(guide)) {
+    std::vector<llvm::Function *> funcs;
+    for (auto &func : *module) {
+      funcs.push_back(&func);
+    }
+    RunNewFunctionPasses(module, funcs, guide);
+    RunNewModulePasses(module, guide);
+    return;
+  }
+
   llvm::legacy::FunctionPassManager func_manager(module);
   llvm::legacy::PassManager module_manager;
 
-  auto TLI =
-      new llvm::TargetLibraryInfoImpl(llvm::Triple(module->getTargetTriple()));
-
-  TLI->disableAllFunctions();  // `-fno-builtin`.
-
   llvm::PassManagerBuilder builder;
-  builder.OptLevel = 3;
-  builder.SizeLevel = 0;
-  builder.Inliner = llvm::createFunctionInliningPass(250);
-  builder.LibraryInfo = TLI;  // Deleted by `llvm::~PassManagerBuilder`.
-  builder.DisableUnrollLoops = false;  // Unroll loops!
-  IF_LLVM_LT_900(builder.DisableUnitAtATime = false;)
-  builder.RerollLoops = false;
-  builder.SLPVectorize = guide.slp_vectorize;
-  builder.LoopVectorize = guide.loop_vectorize;
-  IF_LLVM_GTE_360(builder.VerifyInput = guide.verify_input;)
-  IF_LLVM_GTE_360(builder.VerifyOutput = guide.verify_output;)
-
-  // TODO(pag): Not sure when this became available.
-  IF_LLVM_GTE_800(builder.MergeFunctions = false;)
+  ConfigureBuilder(builder, module, guide);
 
   builder.populateFunctionPassManager(func_manager);
   builder.populateModulePassManager(module_manager);
@@ -131,4 +1160,113 @@ void OptimizeBareModule(llvm::Module *module, OptimizationGuide guide) {
   module_manager.run(*module);
 }
 
+// Returns the preset named `name`, or `std::nullopt`.
+std::optional<OptimizationPreset>
+OptimizationPresetFromName(std::string_view name) {
+  if (name == "legacy") {
+    return OptimizationPreset::kLegacyO3;
+  } else if (name == "fast") {
+    return OptimizationPreset::kFast;
+  } else if (name == "balanced") {
+    return OptimizationPreset::kBalanced;
+  } else if (name == "max") {
+    return OptimizationPreset::kMax;
+  } else {
+    return std::nullopt;
+  }
+}
+
+// Returns the barrier lowering named `name`, or `std::nullopt`.
+std::optional<BarrierLowering> BarrierLoweringFromName(std::string_view name) {
+  if (name == "keep") {
+    return BarrierLowering::kKeep;
+  } else if (name == "fences") {
+    return BarrierLowering::kFences;
+  } else if (name == "remove") {
+    return BarrierLowering::kRemove;
+  } else {
+    return std::nullopt;
+  }
+}
+
+// Returns the undefined value lowering named `name`, or `std::nullopt`.
+std::optional<UndefinedLowering>
+UndefinedLoweringFromName(std::string_view name) {
+  if (name == "keep") {
+    return UndefinedLowering::kKeep;
+  } else if (name == "freeze") {
+    return UndefinedLowering::kFreeze;
+  } else if (name == "zero") {
+    return UndefinedLowering::kConstant;
+  } else {
+    return std::nullopt;
+  }
+}
+
+// Returns the floating point exception lowering named `name`, or
+// `std::nullopt`.
+std::optional<FPExceptionLowering>
+FPExceptionLoweringFromName(std::string_view name) {
+  if (name == "keep") {
+    return FPExceptionLowering::kKeep;
+  } else if (name == "defer") {
+    return FPExceptionLowering::kDefer;
+  } else if (name == "ignore") {
+    return FPExceptionLowering::kIgnore;
+  } else {
+    return std::nullopt;
+  }
+}
+
+// Inline the calls to always-inline functions into the trace `func`, along
+// with any such calls that they expose.
+void InlineSemanticsIntoTrace(llvm::Function *func) {
+  std::vector<llvm::CallInst *> calls;
+  do {
+    calls.clear();
+    for (auto &inst : llvm::instructions(*func)) {
+      auto call = llvm::dyn_cast<llvm::CallInst>(&inst);
+      if (!call) {
+        continue;
+      }
+      auto callee = call->getCalledFunction();
+      if (callee && callee != func && !callee->isDeclaration() &&
+          callee->hasFnAttribute(llvm::Attribute::AlwaysInline)) {
+        calls.push_back(call);
+      }
+    }
+    for (auto call : calls) {
+      llvm::InlineFunctionInfo info;
+      (void) llvm::InlineFunction(call, info);
+    }
+  } while (!calls.empty());
+}
+
+// Canonicalize the bodies of the semantics functions in the semantics module
+// `module`.
+void OptimizeSemantics(llvm::Module *module) {
+  llvm::TargetLibraryInfoImpl tli(llvm::Triple(module->getTargetTriple()));
+  tli.disableAllFunctions();  // `-fno-builtin`.
+
+  llvm::legacy::FunctionPassManager func_manager(module);
+  func_manager.add(new llvm::TargetLibraryInfoWrapperPass(tli));
+  func_manager.add(llvm::createSROAPass());
+  func_manager.add(llvm::createEarlyCSEPass());
+  func_manager.add(llvm::createInstructionCombiningPass());
+  func_manager.add(llvm::createCFGSimplificationPass());
+
+  func_manager.doInitialization();
+  for (auto &func : *module) {
+
+    // Leave remill's own functions, e.g. `__remill_basic_block`, as they are,
+    // along with anything that is purposefully left unoptimized.
+    if (func.isDeclaration() || func.getName().startswith("__remill") ||
+        func.hasFnAttribute(llvm::Attribute::OptimizeNone)) {
+      continue;
+    }
+    func_manager.run(func);
+  }
+  func_manager.doFinalization();
+}
+
 }  // namespace remill
@@ -0,0 +1,135 @@
+/*
+ * Copyright (c) 2020 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <remill/BC/Profile.h>
+
+#include <istream>
+#include <map>
+#include <ostream>
+#include <sstream>
+
+// Added to each sampled counter each time that it is reached.
+extern "C" uint8_t __remill_profile_sampling;
+uint8_t __remill_profile_sampling = 1;
+
+namespace remill {
+
+// Returns the name of the `ProfileCounters` of the trace named `trace_name`.
+std::string ProfileCountersName(const std::string &trace_name) {
+  return trace_name + "_profile";
+}
+
+// Turn the sampled counters on or off.
+void SetProfileSampling(bool enable) {
+  __atomic_store_n(&__remill_profile_sampling, enable ? 1 : 0,
+                   __ATOMIC_RELAXED);
+}
+
+// Add the address of the sampling byte to `runtime`.
+void AddProfileRuntime(std::unordered_map<std::string, void *> &runtime) {
+  runtime[kProfileSamplingName] = &__remill_profile_sampling;
+}
+
+// Write the counts of `counters` to `os`. The profile is a list of lines,
+// sorted by address, of the form:
+//
+//      block <hex address> <count>
+//      branch <hex address> <taken count> <not taken count>
+void WriteProfile(const std::vector<const ProfileCounters *> &counters,
+                  std::ostream &os) {
+  std::map<uint64_t, uint64_t> block_counts;
+  std::map<uint64_t, std::pair<uint64_t, uint64_t>> branch_counts;
+
+  for (auto trace_counters : counters) {
+    const auto counts = trace_counters->Counts();
+    const auto pcs = trace_counters->PCs();
+    const auto kinds = trace_counters->Kinds();
+    for (uint64_t i = 0; i < trace_counters->num_counters; ++i) {
+      switch (kinds[i]) {
+        case kProfileBlockCounter:
+          block_counts[pcs[i]] += counts[i];
+          break;
+        case kProfileBranchTakenCounter:
+          branch_counts[pcs[i]].first += counts[i];
+          break;
+        case kProfileBranchNotTakenCounter:
+          branch_counts[pcs[i]].second += counts[i];
+          break;
+      }
+    }
+  }
+
+  os << std::hex;
+  for (auto [pc, count] : block_counts) {
+    os << "block " << pc << std::dec << ' ' << count << std::hex << '\n';
+  }
+  for (auto [pc, counts] : branch_counts) {
+    os << "branch " << pc << std::dec << ' ' << counts.first << ' '
+       << counts.second << std::hex << '\n';
+  }
+  os << std::dec;
+}
+
+// Merge the counts in `is` into this profile.
+bool ExecutionProfile::Read(std::istream &is) {
+  std::string line;
+  std::string kind;
+  while (std::getline(is, line)) {
+    if (line.empty()) {
+      continue;
+    }
+
+    std::istringstream ls(line);
+    uint64_t pc = 0;
+    uint64_t taken = 0;
+    uint64_t not_taken = 0;
+    if (!(ls >> kind >> std::hex >> pc >> std::dec >> taken)) {
+      return false;
+
+    } else if (kind == "block") {
+      block_counts[pc] += taken;
+
+    } else if (kind == "branch" && (ls >> not_taken)) {
+      auto &counts = branch_counts[pc];
+      counts.first += taken;
+      counts.second += not_taken;
+
+    } else {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool ExecutionProfile::TryGetBlockCount(uint64_t addr, uint64_t *count) const {
+  if (auto it = block_counts.find(addr); it != block_counts.end()) {
+    *count = it->second;
+    return true;
+  }
+  return false;
+}
+
+bool ExecutionProfile::TryGetBranchCounts(uint64_t inst_addr, uint64_t *taken,
+                                          uint64_t *not_taken) const {
+  if (auto it = branch_counts.find(inst_addr); it != branch_counts.end()) {
+    *taken = it->second.first;
+    *not_taken = it->second.second;
+    return true;
+  }
+  return false;
+}
+
+}  // namespace remill
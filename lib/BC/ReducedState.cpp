@@ -0,0 +1,285 @@
+/*
+ * Copyright (c) 2020 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "remill/BC/ReducedState.h"
+
+#include <glog/logging.h>
+#include <llvm/ADT/APInt.h>
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/DataLayout.h>
+#include <llvm/IR/DerivedTypes.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/IntrinsicInst.h>
+#include <llvm/IR/Module.h>
+#include <llvm/IR/Operator.h>
+#include <llvm/IR/ValueHandle.h>
+#include <llvm/Transforms/Utils/Local.h>
+
+#include <algorithm>
+#include <unordered_set>
+#include <utility>
+
+#include "remill/Arch/Arch.h"
+#include "remill/BC/ABI.h"
+#include "remill/BC/Util.h"
+
+namespace remill {
+namespace {
+
+// Kept ranges are placed at the same offset modulo this alignment as in the
+// `State` structure.
+static constexpr uint64_t kReducedAlignment = 16;
+
+// An operand of an instruction that points into `State`, at `offset`.
+struct StateUse {
+  llvm::Instruction *inst;
+  unsigned operand;
+  uint64_t offset;
+};
+
+// Finds the bytes of `State` that a function accesses, and the operands that
+// must be rewritten to point into the reduced structure.
+class StateAccessFinder {
+ public:
+  StateAccessFinder(const llvm::DataLayout &dl_, uint64_t state_size_,
+                    const std::unordered_set<llvm::Function *> &funcs_)
+      : dl(dl_),
+        state_size(state_size_),
+        funcs(funcs_) {}
+
+  // Returns `false` if `func` uses its `State` pointer in a way whose
+  // accessed bytes can't be determined.
+  bool Find(llvm::Function *func);
+
+  const llvm::DataLayout &dl;
+  const uint64_t state_size;
+  const std::unordered_set<llvm::Function *> &funcs;
+
+  // Accessed byte ranges `[begin, end)`.
+  std::vector<std::pair<uint64_t, uint64_t>> accesses;
+
+  // Operands to rewrite.
+  std::vector<StateUse> uses;
+
+ private:
+  bool Access(llvm::Instruction *inst, unsigned operand, int64_t offset,
+              uint64_t size);
+};
+
+bool StateAccessFinder::Access(llvm::Instruction *inst, unsigned operand,
+                               int64_t offset, uint64_t size) {
+  if (offset < 0 || static_cast<uint64_t>(offset) + size > state_size) {
+    return false;
+  }
+  const auto begin = static_cast<uint64_t>(offset);
+  accesses.emplace_back(begin, begin + size);
+  uses.push_back({inst, operand, begin});
+  return true;
+}
+
+bool StateAccessFinder::Find(llvm::Function *func) {
+  auto state_ptr = NthArgument(func, kStatePointerArgNum);
+
+  llvm::SmallVector<std::pair<llvm::Value *, int64_t>, 16> work_list;
+  work_list.emplace_back(state_ptr, 0);
+
+  while (!work_list.empty()) {
+    const auto [ptr, offset] = work_list.pop_back_val();
+
+    for (auto &use : ptr->uses()) {
+      auto user = use.getUser();
+      const auto operand = use.getOperandNo();
+
+      if (auto gep = llvm::dyn_cast<llvm::GEPOperator>(user)) {
+        llvm::APInt delta(dl.getIndexTypeSizeInBits(gep->getType()), 0);
+        if (!gep->accumulateConstantOffset(dl, delta)) {
+          return false;
+        }
+        work_list.emplace_back(gep, offset + delta.getSExtValue());
+
+      } else if (llvm::isa<llvm::BitCastOperator>(user) ||
+                 llvm::isa<llvm::AddrSpaceCastInst>(user)) {
+        work_list.emplace_back(user, offset);
+
+      } else if (auto load = llvm::dyn_cast<llvm::LoadInst>(user)) {
+        if (!Access(load, operand, offset,
+                    dl.getTypeStoreSize(load->getType()))) {
+          return false;
+        }
+
+      } else if (auto store = llvm::dyn_cast<llvm::StoreInst>(user)) {
+        if (store->getPointerOperand() != ptr ||
+            !Access(store, operand, offset,
+                    dl.getTypeStoreSize(store->getValueOperand()->getType()))) {
+          return false;
+        }
+
+      } else if (auto mem = llvm::dyn_cast<llvm::MemIntrinsic>(user)) {
+        auto len = llvm::dyn_cast<llvm::ConstantInt>(mem->getLength());
+        if (!len || !mem->isArgOperand(&use) ||
+            !Access(mem, operand, offset, len->getZExtValue())) {
+          return false;
+        }
+
+      // Lifted functions and intrinsics are passed the whole structure.
+      } else if (auto call = llvm::dyn_cast<llvm::CallBase>(user)) {
+        auto callee = call->getCalledFunction();
+        if (offset || !call->isArgOperand(&use) || !callee ||
+            (!callee->isDeclaration() && !funcs.count(callee))) {
+          return false;
+        }
+
+      // Constant expressions that aren't GEPs or bitcasts, instructions like
+      // `ptrtoint`, `select`, and `phi`, and so on.
+      } else {
+        return false;
+      }
+    }
+  }
+
+  return true;
+}
+
+}  // namespace
+
+// Returns the offset in the reduced structure of the byte at `offset` in the
+// `State` structure, or `kNotKept` if that byte isn't kept.
+uint64_t ReducedState::ReducedOffset(uint64_t offset) const {
+  auto it = std::upper_bound(
+      ranges.begin(), ranges.end(), offset,
+      [](uint64_t off, const Range &range) { return off < range.begin; });
+  if (it == ranges.begin()) {
+    return kNotKept;
+  }
+  --it;
+  if (offset >= it->end) {
+    return kNotKept;
+  }
+  return it->reduced_offset + (offset - it->begin);
+}
+
+// Rewrite the lifted functions `funcs` so that their `State` pointer
+// arguments point to a reduced `State` structure.
+std::optional<ReducedState>
+ReduceStateStructure(const Arch *arch,
+                     const std::vector<llvm::Function *> &funcs) {
+  if (funcs.empty()) {
+    return std::nullopt;
+  }
+
+  const auto module = funcs.front()->getParent();
+  const auto &dl = module->getDataLayout();
+  const auto state_type = arch->StateStructType();
+  const auto state_size = dl.getTypeAllocSize(state_type);
+
+  const std::unordered_set<llvm::Function *> func_set(funcs.begin(),
+                                                       funcs.end());
+  StateAccessFinder finder(dl, state_size, func_set);
+  for (auto func : funcs) {
+    CHECK_EQ(func->getParent(), module);
+    if (func->isDeclaration()) {
+      continue;
+    }
+    if (!finder.Find(func)) {
+      LOG(WARNING) << "Unable to reduce the State structure: function "
+                   << func->getName().str()
+                   << " uses its State pointer in an unsupported way";
+      return std::nullopt;
+    }
+  }
+
+  // Widen each access to cover its largest enclosing register, so that the
+  // reduced structure is made of whole registers.
+  auto &accesses = finder.accesses;
+  for (auto &[begin, end] : accesses) {
+    if (auto reg = arch->RegisterAtStateOffset(begin)) {
+      reg = reg->EnclosingRegister();
+      begin = std::min(begin, reg->offset);
+      end = std::max(end, reg->offset + reg->size);
+    }
+  }
+
+  std::sort(accesses.begin(), accesses.end());
+
+  ReducedState reduced;
+  for (const auto &[begin, end] : accesses) {
+    if (!reduced.ranges.empty() && begin <= reduced.ranges.back().end) {
+      auto &last = reduced.ranges.back();
+      last.end = std::max(last.end, end);
+    } else {
+      reduced.ranges.push_back({begin, end, 0});
+    }
+  }
+
+  auto &context = module->getContext();
+  const auto byte_type = llvm::Type::getInt8Ty(context);
+  std::vector<llvm::Type *> fields;
+  for (auto &range : reduced.ranges) {
+    const auto misalign = range.begin % kReducedAlignment;
+    auto offset = reduced.size - (reduced.size % kReducedAlignment) + misalign;
+    if (offset < reduced.size) {
+      offset += kReducedAlignment;
+    }
+    if (offset > reduced.size) {
+      fields.push_back(llvm::ArrayType::get(byte_type, offset - reduced.size));
+    }
+    range.reduced_offset = offset;
+    reduced.size = offset + (range.end - range.begin);
+    fields.push_back(llvm::ArrayType::get(byte_type, range.end - range.begin));
+  }
+
+  reduced.type = llvm::StructType::get(context, fields, true /* packed */);
+
+  // Point every access at its byte in the reduced structure, cast to the
+  // type of pointer that it had before.
+  std::vector<llvm::WeakTrackingVH> dead_ptrs;
+  for (const auto &use : finder.uses) {
+    auto func = use.inst->getFunction();
+    auto state_ptr = NthArgument(func, kStatePointerArgNum);
+    auto old_ptr = use.inst->getOperand(use.operand);
+    const auto reduced_offset = reduced.ReducedOffset(use.offset);
+    CHECK_NE(reduced_offset, ReducedState::kNotKept);
+
+    llvm::IRBuilder<> ir(use.inst);
+    const auto addr_space =
+        llvm::cast<llvm::PointerType>(state_ptr->getType())->getAddressSpace();
+    auto byte_ptr = ir.CreateBitCast(
+        state_ptr, llvm::PointerType::get(byte_type, addr_space));
+    auto new_ptr = ir.CreateConstInBoundsGEP1_64(byte_type, byte_ptr,
+                                                 reduced_offset);
+    new_ptr = ir.CreatePointerCast(new_ptr, old_ptr->getType());
+    use.inst->setOperand(use.operand, new_ptr);
+
+    if (llvm::isa<llvm::Instruction>(old_ptr)) {
+      dead_ptrs.emplace_back(old_ptr);
+    }
+  }
+
+  // The same pointer may be used by many accesses, so it may already have
+  // been deleted.
+  for (auto &dead_ptr : dead_ptrs) {
+    if (dead_ptr) {
+      llvm::RecursivelyDeleteTriviallyDeadInstructions(dead_ptr);
+    }
+  }
+
+  return reduced;
+}
+
+}  // namespace remill
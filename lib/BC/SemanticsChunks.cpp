@@ -0,0 +1,404 @@
+/*
+ * Copyright (c) 2020 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "remill/BC/SemanticsChunks.h"
+
+#include <glog/logging.h>
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/GlobalAlias.h>
+#include <llvm/IR/GlobalVariable.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Linker/Linker.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/raw_ostream.h>
+#include <llvm/Transforms/Utils/Cloning.h>
+#include <llvm/Transforms/Utils/ValueMapper.h>
+
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+
+#include "remill/Arch/Arch.h"
+#include "remill/Arch/Name.h"
+#include "remill/BC/ABI.h"
+#include "remill/BC/Annotate.h"
+#include "remill/BC/Compat/BitcodeReaderWriter.h"
+#include "remill/BC/Util.h"
+#include "remill/BC/Version.h"
+
+namespace remill {
+namespace {
+
+// The split form of one semantics bitcode file.
+struct SemanticsChunkIndex {
+  std::string chunks_path;
+  std::unique_ptr<llvm::MemoryBuffer> chunks;
+
+  // Offset and size of each chunk within `chunks`.
+  std::vector<std::pair<uint64_t, uint64_t>> chunk_ranges;
+
+  // Maps the name of each defined global to the chunk that defines it.
+  std::unordered_map<std::string, unsigned> chunk_of;
+};
+
+// Call `callback` on every global value that is used by the definition of
+// `gv`, looking through constant expressions.
+template <typename T>
+static void ForEachUsedGlobal(llvm::GlobalValue *gv, T callback) {
+  std::vector<llvm::Constant *> work_list;
+  std::unordered_set<llvm::Constant *> seen;
+  auto add = [&](llvm::Value *val) {
+    if (auto c = llvm::dyn_cast<llvm::Constant>(val);
+        c && seen.insert(c).second) {
+      work_list.push_back(c);
+    }
+  };
+
+  if (auto func = llvm::dyn_cast<llvm::Function>(gv)) {
+    for (auto &block : *func) {
+      for (auto &inst : block) {
+        for (auto &op : inst.operands()) {
+          add(op.get());
+        }
+      }
+    }
+  } else if (auto var = llvm::dyn_cast<llvm::GlobalVariable>(gv)) {
+    if (var->hasInitializer()) {
+      add(var->getInitializer());
+    }
+  } else if (auto alias = llvm::dyn_cast<llvm::GlobalAlias>(gv)) {
+    add(alias->getAliasee());
+  }
+
+  while (!work_list.empty()) {
+    auto c = work_list.back();
+    work_list.pop_back();
+    if (auto used_gv = llvm::dyn_cast<llvm::GlobalValue>(c)) {
+      callback(used_gv);
+    } else {
+      for (auto &op : c->operands()) {
+        add(op.get());
+      }
+    }
+  }
+}
+
+// Returns the path of the semantics bitcode file `bc_path`, with a different
+// extension.
+static std::string ReplaceExtension(const std::string &bc_path,
+                                    std::string_view ext) {
+  auto base = bc_path;
+  if (auto dot = base.rfind(".bc"); dot != std::string::npos &&
+                                    dot + 3 == base.size()) {
+    base.resize(dot);
+  }
+  base.append(ext);
+  return base;
+}
+
+// Read the split semantics next to `bc_path`. Returns `false` if the
+// semantics weren't split.
+static bool ReadChunkIndex(const std::string &bc_path,
+                           SemanticsChunkIndex &index) {
+  const auto index_path = ReplaceExtension(bc_path, ".index");
+  std::ifstream index_file(index_path);
+  if (!index_file) {
+    return false;
+  }
+
+  index.chunks_path = ReplaceExtension(bc_path, ".chunks");
+  index.chunks = MapBitcodeFile(index.chunks_path, true /* allow_failure */);
+  if (!index.chunks) {
+    LOG(ERROR) << "Unable to read semantics chunks file " << index.chunks_path;
+    return false;
+  }
+
+  const auto chunks_size = index.chunks->getBufferSize();
+  for (std::string line; std::getline(index_file, line);) {
+    std::stringstream ss(line);
+    char kind = '\0';
+    ss >> kind;
+    if ('C' == kind) {
+      uint64_t offset = 0;
+      uint64_t size = 0;
+      ss >> offset >> size;
+      CHECK(ss && offset <= chunks_size && size <= (chunks_size - offset))
+          << "Invalid chunk entry '" << line << "' in " << index_path;
+      index.chunk_ranges.emplace_back(offset, size);
+
+    } else if ('D' == kind) {
+      std::string name;
+      unsigned chunk = 0;
+      ss >> name >> chunk;
+      CHECK(ss && chunk < index.chunk_ranges.size())
+          << "Invalid definition entry '" << line << "' in " << index_path;
+      index.chunk_of.emplace(std::move(name), chunk);
+
+    } else {
+      CHECK(line.empty()) << "Invalid entry '" << line << "' in " << index_path;
+    }
+  }
+
+  CHECK(!index.chunk_ranges.empty())
+      << "Semantics index " << index_path << " has no chunks";
+  return true;
+}
+
+// Returns the split semantics next to `bc_path`, or `nullptr` if there are
+// none. Indices are read once, and then kept in memory.
+static const SemanticsChunkIndex *GetChunkIndex(const std::string &bc_path) {
+  static std::mutex lock;
+  static std::unordered_map<std::string,
+                            std::unique_ptr<SemanticsChunkIndex>>
+      indices;
+
+  std::lock_guard<std::mutex> locker(lock);
+  auto [it, added] = indices.emplace(bc_path, nullptr);
+  if (added) {
+    std::unique_ptr<SemanticsChunkIndex> index(new SemanticsChunkIndex);
+    if (ReadChunkIndex(bc_path, *index)) {
+      it->second = std::move(index);
+    }
+  }
+  return it->second.get();
+}
+
+// Parse chunk number `chunk` of `index` into `context`.
+static std::unique_ptr<llvm::Module>
+ParseChunk(const SemanticsChunkIndex &index, unsigned chunk,
+           llvm::LLVMContext &context) {
+  const auto [offset, size] = index.chunk_ranges[chunk];
+  const llvm::MemoryBufferRef chunk_ref(
+      llvm::StringRef(index.chunks->getBufferStart() + offset, size),
+      index.chunks_path);
+
+  auto maybe_module = llvm::parseBitcodeFile(chunk_ref, context);
+  CHECK(maybe_module) << "Unable to parse chunk " << chunk << " of "
+                      << index.chunks_path << ": "
+                      << llvm::toString(maybe_module.takeError());
+  return std::move(maybe_module.get());
+}
+
+}  // namespace
+
+// Split the semantics module `module` into chunks, and write them to
+// `chunks_path` and `index_path`.
+bool SplitSemanticsModule(llvm::Module *module, std::string_view chunks_path_,
+                          std::string_view index_path_,
+                          unsigned isels_per_chunk) {
+  CHECK_LT(0u, isels_per_chunk);
+
+  // Chunk definitions can be used from other chunks, so they need names
+  // that can be linked against.
+  for (auto &gv : module->global_values()) {
+    if (gv.isDeclaration()) {
+      continue;
+    }
+    if (!gv.hasName()) {
+      gv.setName("semantics_chunk_global");
+    }
+    if (gv.hasLocalLinkage()) {
+      gv.setLinkage(llvm::GlobalValue::ExternalLinkage);
+      gv.setVisibility(llvm::GlobalValue::HiddenVisibility);
+    }
+  }
+
+  // Put the unassigned definitions used by `root` into `chunk`.
+  std::unordered_map<const llvm::GlobalValue *, unsigned> chunk_of;
+  std::vector<llvm::GlobalValue *> work_list;
+  auto assign = [&](llvm::GlobalValue *root, unsigned chunk) {
+    work_list.push_back(root);
+    while (!work_list.empty()) {
+      auto gv = work_list.back();
+      work_list.pop_back();
+      if (gv->isDeclaration() || !chunk_of.emplace(gv, chunk).second) {
+        continue;
+      }
+      ForEachUsedGlobal(gv, [&](llvm::GlobalValue *used_gv) {
+        work_list.push_back(used_gv);
+      });
+    }
+  };
+
+  // The first chunk has remill's own functions and variables, e.g. the
+  // `__remill_basic_block` function.
+  for (auto &gv : module->global_values()) {
+    if (gv.getName().startswith("__remill")) {
+      assign(&gv, 0);
+    }
+  }
+
+  unsigned num_isels = 0;
+  ForEachISel(module, [&](llvm::GlobalVariable *isel, llvm::Function *) {
+    assign(isel, 1u + (num_isels++ / isels_per_chunk));
+  });
+
+  const auto num_chunks = 1u + (num_isels + isels_per_chunk - 1) /
+                                   isels_per_chunk;
+
+  // Anything left over isn't used by any ISEL.
+  for (auto &gv : module->global_values()) {
+    if (!gv.isDeclaration()) {
+      chunk_of.emplace(&gv, 0u);
+    }
+  }
+
+  std::error_code ec;
+  const std::string chunks_path(chunks_path_.data(), chunks_path_.size());
+#if LLVM_VERSION_NUMBER < LLVM_VERSION(7, 0)
+  llvm::raw_fd_ostream chunks_os(chunks_path, ec, llvm::sys::fs::F_RW);
+#else
+  llvm::raw_fd_ostream chunks_os(chunks_path, ec, llvm::sys::fs::OF_None);
+#endif
+  if (ec) {
+    LOG(ERROR) << "Unable to open semantics chunks file " << chunks_path
+               << " for writing: " << ec.message();
+    return false;
+  }
+
+  std::stringstream index;
+  for (auto chunk = 0u; chunk < num_chunks; ++chunk) {
+    llvm::ValueToValueMapTy value_map;
+    auto chunk_module = llvm::CloneModule(
+        *module, value_map, [&](const llvm::GlobalValue *gv) {
+          const auto it = chunk_of.find(gv);
+          return it != chunk_of.end() && it->second == chunk;
+        });
+
+    // Drop the declarations of unused globals from other chunks. Otherwise
+    // every chunk would declare every ISEL, and loading a chunk would bring
+    // in declarations of ISELs that can't be used.
+    std::vector<llvm::GlobalValue *> unused;
+    for (auto &gv : chunk_module->global_values()) {
+      if (gv.isDeclaration() && gv.use_empty()) {
+        const auto orig_gv = module->getNamedValue(gv.getName());
+        if (orig_gv && !orig_gv->isDeclaration()) {
+          unused.push_back(&gv);
+        }
+      }
+    }
+    for (auto gv : unused) {
+      gv->eraseFromParent();
+    }
+
+    const auto offset = chunks_os.tell();
+#if LLVM_VERSION_NUMBER < LLVM_VERSION(7, 0)
+    llvm::WriteBitcodeToFile(chunk_module.get(), chunks_os);
+#else
+    llvm::WriteBitcodeToFile(*chunk_module, chunks_os);
+#endif
+    index << "C " << offset << ' ' << (chunks_os.tell() - offset) << '\n';
+  }
+
+  chunks_os.close();
+  if (chunks_os.has_error()) {
+    LOG(ERROR) << "Error writing semantics chunks file " << chunks_path;
+    chunks_os.clear_error();
+    return false;
+  }
+
+  for (auto &gv : module->global_values()) {
+    if (!gv.isDeclaration()) {
+      index << "D " << gv.getName().str() << ' ' << chunk_of[&gv] << '\n';
+    }
+  }
+
+  const std::string index_path(index_path_.data(), index_path_.size());
+  std::ofstream index_file(index_path);
+  index_file << index.str();
+  if (!index_file) {
+    LOG(ERROR) << "Error writing semantics index file " << index_path;
+    return false;
+  }
+
+  LOG(INFO) << "Split " << num_isels << " ISELs into " << num_chunks
+            << " chunks in " << chunks_path;
+  return true;
+}
+
+// Loads the semantics for `arch`, but only reads the chunks that are needed
+// for the instruction functions `inst_functions`.
+std::unique_ptr<llvm::Module>
+LoadArchSemanticsChunks(const Arch *arch,
+                        const std::vector<std::string> &inst_functions) {
+  const auto arch_name = GetArchName(arch->arch_name);
+  const auto bc_path = FindSemanticsBitcodeFile(arch_name);
+  const auto index = GetChunkIndex(bc_path);
+  if (!index) {
+    return LoadArchSemantics(arch);
+  }
+
+  LOG(INFO) << "Loading " << arch_name << " semantics chunks from file "
+            << index->chunks_path;
+
+  std::vector<bool> is_loaded(index->chunk_ranges.size(), false);
+  std::vector<unsigned> pending;
+  auto need = [&](std::string_view name) {
+    const auto it = index->chunk_of.find(std::string(name));
+    if (it != index->chunk_of.end() && !is_loaded[it->second]) {
+      is_loaded[it->second] = true;
+      pending.push_back(it->second);
+    }
+  };
+
+  is_loaded[0] = true;
+  auto module = ParseChunk(*index, 0, *arch->context);
+
+  std::string isel_name;
+  auto need_isel = [&](std::string_view function) {
+    isel_name.assign("ISEL_");
+    isel_name.append(function);
+    need(isel_name);
+  };
+
+  need_isel(kInvalidInstructionISelName);
+  need_isel(kUnsupportedInstructionISelName);
+  for (const auto &function : inst_functions) {
+    need_isel(function);
+  }
+
+  // Link in the needed chunks, then whatever chunks define the globals that
+  // those chunks only declare, until nothing is missing.
+  while (!pending.empty()) {
+    while (!pending.empty()) {
+      const auto chunk = pending.back();
+      pending.pop_back();
+      CHECK(!llvm::Linker::linkModules(
+          *module, ParseChunk(*index, chunk, *arch->context)))
+          << "Unable to link chunk " << chunk << " of " << index->chunks_path;
+    }
+
+    for (auto &gv : module->global_values()) {
+      if (gv.isDeclaration()) {
+        const auto name = gv.getName();
+        need(std::string_view(name.data(), name.size()));
+      }
+    }
+  }
+
+  arch->PrepareModule(module);
+  arch->InitFromSemanticsModule(module.get());
+  AnnotateFunctions<remill::Semantics>(*module);
+  return module;
+}
+
+}  // namespace remill
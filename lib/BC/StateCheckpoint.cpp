@@ -0,0 +1,268 @@
+/*
+ * Copyright (c) 2020 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "remill/BC/StateCheckpoint.h"
+
+#include <glog/logging.h>
+#include <llvm/Analysis/ValueTracking.h>
+#include <llvm/IR/DataLayout.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/IntrinsicInst.h>
+#include <llvm/IR/Module.h>
+#include <llvm/IR/Operator.h>
+
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <optional>
+#include <unordered_set>
+#include <vector>
+
+#include "remill/Arch/Arch.h"
+#include "remill/BC/ABI.h"
+#include "remill/BC/Util.h"
+#include "remill/BC/Version.h"
+
+namespace remill {
+namespace {
+
+// Where a pointer points, relative to the `State` structure.
+enum class StatePointerKind { kNotState, kKnownOffset, kUnknownOffset };
+
+// Classifies `ptr` as pointing outside of `State`, or into it at `offset`, or
+// somewhere into it.
+static StatePointerKind ClassifyPointer(llvm::Value *ptr,
+                                        llvm::Value *state_ptr,
+                                        const llvm::DataLayout &dl,
+                                        int64_t &offset) {
+  offset = 0;
+  auto base = llvm::GetPointerBaseWithConstantOffset(ptr, offset, dl);
+  if (base == state_ptr) {
+    return StatePointerKind::kKnownOffset;
+  }
+
+  // Look through variable offsets, and through the choices between pointers
+  // that the optimizer makes, for any path back to `State`.
+  std::vector<llvm::Value *> work_list = {base};
+  std::unordered_set<llvm::Value *> seen = {base};
+  while (!work_list.empty()) {
+    auto val = work_list.back()->stripPointerCasts();
+    work_list.pop_back();
+    if (val == state_ptr) {
+      return StatePointerKind::kUnknownOffset;
+    }
+
+    auto add = [&](llvm::Value *next) {
+      if (seen.insert(next).second) {
+        work_list.push_back(next);
+      }
+    };
+    if (auto gep = llvm::dyn_cast<llvm::GEPOperator>(val)) {
+      add(gep->getPointerOperand());
+    } else if (auto phi = llvm::dyn_cast<llvm::PHINode>(val)) {
+      for (auto &incoming : phi->incoming_values()) {
+        add(incoming.get());
+      }
+    } else if (auto select = llvm::dyn_cast<llvm::SelectInst>(val)) {
+      add(select->getTrueValue());
+      add(select->getFalseValue());
+    }
+  }
+  return StatePointerKind::kNotState;
+}
+
+}  // namespace
+
+// Instrument the lifted function `func` so that it sets the dirty bit of each
+// line of `State` that it writes to.
+unsigned InstrumentStateDirtyLines(const Arch *arch, llvm::Function *func) {
+  if (func->isDeclaration()) {
+    return 0;
+  }
+
+  const auto module = func->getParent();
+  const auto &dl = module->getDataLayout();
+  const auto state_ptr = NthArgument(func, kStatePointerArgNum);
+  const auto state_size = dl.getTypeAllocSize(arch->StateStructType());
+  const auto bitmap_offset = StateDirtyBitmapOffset(state_size);
+  const auto num_words = NumStateDirtyWords(state_size);
+
+  llvm::IRBuilder<> ir(func->getContext());
+  const auto i64_type = ir.getInt64Ty();
+
+  // The dirty bits to set at the next flush, by word of the bitmap.
+  std::map<uint64_t, uint64_t> pending;
+  auto pending_all = false;
+
+  // Set the pending dirty bits before `inst`.
+  auto flush = [&](llvm::Instruction *inst) {
+    if (!pending_all && pending.empty()) {
+      return;
+    }
+    ir.SetInsertPoint(inst);
+    const auto bytes = ir.CreateBitCast(state_ptr, ir.getInt8PtrTy());
+    if (pending_all) {
+      const auto bitmap = ir.CreateConstInBoundsGEP1_64(
+          ir.getInt8Ty(), bytes, bitmap_offset);
+#if LLVM_VERSION_NUMBER >= LLVM_VERSION(10, 0)
+      ir.CreateMemSet(bitmap, ir.getInt8(0xff), num_words * 8,
+                      llvm::MaybeAlign(8));
+#else
+      ir.CreateMemSet(bitmap, ir.getInt8(0xff), num_words * 8, 8);
+#endif
+    } else {
+      for (auto [word, mask] : pending) {
+        const auto word_ptr = ir.CreateBitCast(
+            ir.CreateConstInBoundsGEP1_64(ir.getInt8Ty(), bytes,
+                                          bitmap_offset + word * 8),
+            llvm::PointerType::get(i64_type, 0));
+        const auto old_bits = ir.CreateLoad(i64_type, word_ptr);
+        ir.CreateStore(ir.CreateOr(old_bits, mask), word_ptr);
+      }
+    }
+    pending.clear();
+    pending_all = false;
+  };
+
+  // Mark the `size` bytes written at `ptr`, if they're in `State`.
+  auto num_writes = 0u;
+  auto mark = [&](llvm::Value *ptr, std::optional<uint64_t> size) {
+    int64_t offset = 0;
+    switch (ClassifyPointer(ptr, state_ptr, dl, offset)) {
+      case StatePointerKind::kNotState: return;
+      case StatePointerKind::kKnownOffset:
+        if (size && 0 <= offset &&
+            static_cast<uint64_t>(offset) + *size <= state_size) {
+          const auto begin = static_cast<uint64_t>(offset) / kStateLineSize;
+          const auto end = (static_cast<uint64_t>(offset) + *size +
+                            kStateLineSize - 1) / kStateLineSize;
+          for (auto line = begin; line < end; ++line) {
+            pending[line / 64] |= 1ull << (line % 64);
+          }
+          break;
+        }
+        [[clang::fallthrough]];
+      case StatePointerKind::kUnknownOffset: pending_all = true; break;
+    }
+    num_writes += 1;
+  };
+
+  std::vector<llvm::Instruction *> insts;
+  for (auto &block : *func) {
+    insts.clear();
+    for (auto &inst : block) {
+      insts.push_back(&inst);
+    }
+
+    for (auto inst : insts) {
+      if (auto store = llvm::dyn_cast<llvm::StoreInst>(inst)) {
+        mark(store->getPointerOperand(),
+             dl.getTypeStoreSize(store->getValueOperand()->getType()));
+
+      } else if (auto rmw = llvm::dyn_cast<llvm::AtomicRMWInst>(inst)) {
+        mark(rmw->getPointerOperand(),
+             dl.getTypeStoreSize(rmw->getValOperand()->getType()));
+
+      } else if (auto cmpxchg = llvm::dyn_cast<llvm::AtomicCmpXchgInst>(inst)) {
+        mark(cmpxchg->getPointerOperand(),
+             dl.getTypeStoreSize(cmpxchg->getNewValOperand()->getType()));
+
+      } else if (auto mem = llvm::dyn_cast<llvm::MemIntrinsic>(inst)) {
+        std::optional<uint64_t> size;
+        if (auto len = llvm::dyn_cast<llvm::ConstantInt>(mem->getLength())) {
+          size = len->getZExtValue();
+        }
+        mark(mem->getDest(), size);
+
+      } else if (auto call = llvm::dyn_cast<llvm::CallBase>(inst)) {
+        if (llvm::isa<llvm::IntrinsicInst>(call)) {
+          continue;
+        }
+
+        // Lifted functions track their own writes, and remill's intrinsics
+        // that are passed `State`, e.g. the hyper calls, are implemented by
+        // the executor, which marks its own writes.
+        const auto callee = call->getCalledFunction();
+        const auto is_tracked =
+            call->getFunctionType() == func->getFunctionType() ||
+            (callee && callee->isDeclaration() &&
+             callee->getName().startswith("__remill_"));
+        if (!is_tracked) {
+          for (auto &arg : call->args()) {
+            if (arg->getType()->isPointerTy()) {
+              mark(arg.get(), std::nullopt);
+            }
+          }
+        }
+
+        // The callee may look at the bitmap, e.g. to take a snapshot.
+        flush(call);
+
+      } else if (inst->isTerminator()) {
+        flush(inst);
+      }
+    }
+  }
+
+  return num_writes;
+}
+
+// Set the dirty bits of the `size` bytes at `offset` in `State`.
+void MarkStateDirty(uint64_t *dirty, uint64_t offset, uint64_t size) {
+  if (!size) {
+    return;
+  }
+  const auto begin = offset / kStateLineSize;
+  const auto end = (offset + size + kStateLineSize - 1) / kStateLineSize;
+  for (auto line = begin; line < end; ++line) {
+    dirty[line / 64] |= 1ull << (line % 64);
+  }
+}
+
+// Clear all of the dirty bits of a `State` structure of `state_size` bytes.
+void ClearStateDirtyLines(uint64_t *dirty, size_t state_size) {
+  memset(dirty, 0, NumStateDirtyWords(state_size) * sizeof(uint64_t));
+}
+
+// Copy the dirty lines of `snapshot` to `state`, and then clear the dirty
+// bits.
+size_t RestoreDirtyStateLines(void *state, const void *snapshot,
+                              uint64_t *dirty, size_t state_size) {
+  const auto dst = reinterpret_cast<uint8_t *>(state);
+  const auto src = reinterpret_cast<const uint8_t *>(snapshot);
+  const auto num_words = NumStateDirtyWords(state_size);
+  size_t num_lines = 0;
+  for (uint64_t word = 0; word < num_words; ++word) {
+    for (auto bits = dirty[word]; bits; bits &= bits - 1) {
+      const auto line =
+          word * 64 + static_cast<uint64_t>(__builtin_ctzll(bits));
+      const auto offset = line * kStateLineSize;
+      if (offset >= state_size) {
+        break;
+      }
+      const auto size = std::min<uint64_t>(kStateLineSize, state_size - offset);
+      memcpy(&(dst[offset]), &(src[offset]), size);
+      num_lines += 1;
+    }
+    dirty[word] = 0;
+  }
+  return num_lines;
+}
+
+}  // namespace remill
@@ -0,0 +1,215 @@
+/*
+ * Copyright (c) 2020 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "remill/BC/StateEscape.h"
+
+#include <glog/logging.h>
+#include <llvm/ADT/SmallPtrSet.h>
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/DataLayout.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/IntrinsicInst.h>
+#include <llvm/IR/Module.h>
+
+#include <string>
+#include <unordered_set>
+
+#include "remill/BC/Version.h"
+
+namespace remill {
+namespace {
+
+// Returns `true` if `call` can't access the memory that it is passed in its
+// `arg_num`th argument.
+static bool IgnoresArgument(llvm::CallBase *call, unsigned arg_num) {
+  if (call->paramHasAttr(arg_num, llvm::Attribute::ReadNone) &&
+      call->paramHasAttr(arg_num, llvm::Attribute::NoCapture)) {
+    return true;
+  }
+  auto callee = call->getCalledFunction();
+  return callee && !callee->isDeclaration() && !callee->isVarArg() &&
+         arg_num < callee->arg_size() && callee->getArg(arg_num)->use_empty();
+}
+
+// Returns a pointer to the byte at `offset` in the structure at `ptr`.
+static llvm::Value *BytePointer(llvm::IRBuilder<> &ir, llvm::Value *ptr,
+                                uint64_t offset) {
+  const auto byte_ptr = ir.CreateBitCast(ptr, ir.getInt8PtrTy());
+  return ir.CreateConstInBoundsGEP1_64(ir.getInt8Ty(), byte_ptr, offset);
+}
+
+// Copy the `slots` from the structure at `src` to the structure at `dst`.
+static void CopySlots(llvm::IRBuilder<> &ir, llvm::Value *dst,
+                      llvm::Value *src, const StateSlotList &slots) {
+  for (auto [offset, size] : slots) {
+    const auto dst_ptr = BytePointer(ir, dst, offset);
+    const auto src_ptr = BytePointer(ir, src, offset);
+#if LLVM_VERSION_NUMBER >= LLVM_VERSION(10, 0)
+    ir.CreateMemCpy(dst_ptr, llvm::MaybeAlign(1), src_ptr,
+                    llvm::MaybeAlign(1), size);
+#else
+    ir.CreateMemCpy(dst_ptr, 1, src_ptr, 1, size);
+#endif
+  }
+}
+
+}  // namespace
+
+// Returns the slots of `State` that `call` may access, for code that runs
+// until it leaves the lifted code.
+std::optional<StateSlotList> ExitIntrinsicStateSlots(llvm::CallBase *call) {
+  static const std::unordered_set<std::string> kExits = {
+      "__remill_error",          "__remill_function_call",
+      "__remill_function_return", "__remill_jump",
+      "__remill_missing_block",
+  };
+  if (auto callee = call->getCalledFunction();
+      callee && kExits.count(callee->getName().str())) {
+    return StateSlotList{};
+  }
+  return std::nullopt;
+}
+
+// Returns the calls that are passed `state`, or a cast of it.
+std::vector<llvm::CallBase *> FindStateEscapes(llvm::AllocaInst *state,
+                                               bool *escapes_otherwise) {
+  std::vector<llvm::CallBase *> calls;
+  llvm::SmallPtrSet<llvm::CallBase *, 8> seen_calls;
+  llvm::SmallPtrSet<llvm::Value *, 16> seen;
+  llvm::SmallVector<llvm::Value *, 16> work_list;
+  auto escapes = false;
+
+  // Pointers into `state` at zero offset, which the calls may be passed, and
+  // pointers at other offsets, which they may not.
+  work_list.push_back(state);
+  seen.insert(state);
+  while (!work_list.empty()) {
+    const auto ptr = work_list.pop_back_val();
+    const auto is_base = ptr->stripPointerCasts() == state;
+    for (auto &use : ptr->uses()) {
+      const auto user = use.getUser();
+      if (llvm::isa<llvm::BitCastInst>(user) ||
+          llvm::isa<llvm::GetElementPtrInst>(user) ||
+          llvm::isa<llvm::AddrSpaceCastInst>(user)) {
+        if (seen.insert(user).second) {
+          work_list.push_back(user);
+        }
+
+      } else if (llvm::isa<llvm::LoadInst>(user)) {
+        continue;
+
+      } else if (auto store = llvm::dyn_cast<llvm::StoreInst>(user)) {
+        escapes = escapes || store->getValueOperand() == ptr;
+
+      } else if (auto call = llvm::dyn_cast<llvm::CallBase>(user)) {
+        if (llvm::isa<llvm::IntrinsicInst>(call)) {
+          continue;
+        } else if (!is_base || !call->isArgOperand(&use)) {
+          escapes = true;
+        } else if (seen_calls.insert(call).second) {
+          calls.push_back(call);
+        }
+
+      } else {
+        escapes = true;
+      }
+    }
+  }
+
+  if (escapes_otherwise) {
+    *escapes_otherwise = escapes;
+  }
+  return calls;
+}
+
+// Keep `state` from escaping through the calls found by `FindStateEscapes`.
+unsigned PrivatizeState(llvm::AllocaInst *state,
+                        const StateSlotsFunc &slots_of,
+                        llvm::Value *shared_state) {
+  const auto calls = FindStateEscapes(state);
+  if (calls.empty()) {
+    return 0;
+  }
+
+  const auto func = state->getFunction();
+  const auto &dl = func->getParent()->getDataLayout();
+  const auto state_type = state->getAllocatedType();
+  const StateSlotList all_slots = {
+      {0, dl.getTypeAllocSize(state_type).getFixedSize()}};
+
+  llvm::IRBuilder<> ir(state->getNextNode());
+  unsigned num_changed = 0;
+  for (auto call : calls) {
+    std::optional<StateSlotList> slots;
+    if (slots_of) {
+      slots = slots_of(call);
+    }
+
+    // Find the arguments through which `call` is passed `state`.
+    llvm::SmallVector<unsigned, 2> arg_nums;
+    auto accesses_state = false;
+    for (auto &arg : call->args()) {
+      if (arg.get()->stripPointerCasts() == state) {
+        const auto arg_num = call->getArgOperandNo(&arg);
+        arg_nums.push_back(arg_num);
+        accesses_state = accesses_state || !IgnoresArgument(call, arg_num);
+      }
+    }
+
+    if (!accesses_state || (slots && slots->empty())) {
+      for (auto arg_num : arg_nums) {
+        const auto arg = call->getArgOperand(arg_num);
+        call->setArgOperand(arg_num, llvm::UndefValue::get(arg->getType()));
+      }
+      ++num_changed;
+      continue;
+    }
+
+    if (!shared_state) {
+      ir.SetInsertPoint(state->getNextNode());
+      shared_state = ir.CreateAlloca(state_type, state->getArraySize(),
+                                     state->getName() + ".shared");
+    }
+
+    const auto &copied = slots ? *slots : all_slots;
+    ir.SetInsertPoint(call);
+    CopySlots(ir, shared_state, state, copied);
+    for (auto arg_num : arg_nums) {
+      const auto arg = call->getArgOperand(arg_num);
+      call->setArgOperand(
+          arg_num, ir.CreatePointerBitCastOrAddrSpaceCast(shared_state,
+                                                          arg->getType()));
+    }
+
+    // An `invoke` has no single place after it.
+    if (call->isTerminator()) {
+      LOG(ERROR) << "Could not copy the slots of `State` back after a call in "
+                 << func->getName().str();
+    } else {
+      ir.SetInsertPoint(call->getNextNode());
+      CopySlots(ir, state, shared_state, copied);
+    }
+    ++num_changed;
+  }
+
+  return num_changed;
+}
+
+}  // namespace remill
@@ -0,0 +1,356 @@
+/*
+ * Copyright (c) 2020 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "remill/BC/StatePromotion.h"
+
+#include <glog/logging.h>
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/ADT/SmallPtrSet.h>
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/Analysis/LoopInfo.h>
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/DataLayout.h>
+#include <llvm/IR/Dominators.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/IntrinsicInst.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Transforms/Utils/SSAUpdater.h>
+
+#include <algorithm>
+#include <map>
+#include <utility>
+#include <vector>
+
+#include "remill/BC/ABI.h"
+#include "remill/BC/Util.h"
+
+namespace remill {
+namespace {
+
+// A load or store of the `State` structure, at a known byte offset.
+struct StateAccess {
+  llvm::Instruction *inst;
+  int64_t offset;
+  llvm::Type *type;
+  uint64_t size;
+};
+
+// The accesses to the `State` structure of a function.
+struct StateAccesses {
+
+  // Loads and stores at known offsets, by instruction.
+  llvm::DenseMap<llvm::Instruction *, StateAccess> known;
+
+  // Instructions that use a pointer into `State` in any other way, e.g. calls
+  // that are passed it, and accesses at unknown offsets.
+  llvm::SmallPtrSet<llvm::Instruction *, 16> unknown;
+};
+
+// Find the uses of the `State` pointer `state_ptr`, and of the pointers
+// derived from it. Returns `false` if a pointer into `State` flows somewhere
+// that can't be tracked, e.g. into a `phi` or a `ptrtoint`.
+static bool FindStateAccesses(const llvm::DataLayout &dl,
+                              llvm::Argument *state_ptr,
+                              StateAccesses &accesses) {
+  llvm::SmallVector<std::pair<llvm::Value *, int64_t>, 32> work_list;
+  llvm::SmallPtrSet<llvm::Value *, 32> seen;
+  work_list.emplace_back(state_ptr, 0);
+
+  // Offsets of `-1` are unknown.
+  while (!work_list.empty()) {
+    const auto [ptr, offset] = work_list.pop_back_val();
+    if (!seen.insert(ptr).second) {
+      continue;
+    }
+
+    for (auto user : ptr->users()) {
+      const auto inst = llvm::dyn_cast<llvm::Instruction>(user);
+      if (!inst) {
+        return false;
+      }
+
+      if (auto gep = llvm::dyn_cast<llvm::GetElementPtrInst>(inst)) {
+        llvm::APInt gep_offset(dl.getIndexTypeSizeInBits(gep->getType()), 0);
+        if (0 <= offset && gep->accumulateConstantOffset(dl, gep_offset)) {
+          work_list.emplace_back(gep, offset + gep_offset.getSExtValue());
+        } else {
+          work_list.emplace_back(gep, -1);
+        }
+
+      } else if (llvm::isa<llvm::BitCastInst>(inst)) {
+        work_list.emplace_back(inst, offset);
+
+      } else if (auto load = llvm::dyn_cast<llvm::LoadInst>(inst)) {
+        const auto type = load->getType();
+        if (0 <= offset && load->isSimple()) {
+          accesses.known.try_emplace(
+              load, StateAccess{load, offset, type,
+                                dl.getTypeStoreSize(type).getFixedSize()});
+        } else {
+          accesses.unknown.insert(load);
+        }
+
+      } else if (auto store = llvm::dyn_cast<llvm::StoreInst>(inst)) {
+        const auto type = store->getValueOperand()->getType();
+        if (store->getValueOperand() == ptr) {
+          return false;  // The pointer escapes.
+        } else if (0 <= offset && store->isSimple()) {
+          accesses.known.try_emplace(
+              store, StateAccess{store, offset, type,
+                                 dl.getTypeStoreSize(type).getFixedSize()});
+        } else {
+          accesses.unknown.insert(store);
+        }
+
+      } else if (llvm::isa<llvm::CallBase>(inst)) {
+        accesses.unknown.insert(inst);
+
+      } else {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+// Returns `true` if the call `call`, which isn't passed a pointer into
+// `State`, can't access `State`.
+static bool CallCantAccessState(llvm::CallBase *call) {
+  if (call->doesNotAccessMemory() || llvm::isa<llvm::DbgInfoIntrinsic>(call)) {
+    return true;
+  }
+
+  // The remill intrinsics that aren't passed the `State` pointer only access
+  // the guest's memory, through `Memory *`.
+  const auto callee = call->getCalledFunction();
+  return callee && callee->getName().startswith("__remill_");
+}
+
+// Returns `true` if nothing in `loop`, other than the accesses in `accesses`,
+// may access `State`.
+static bool LoopIsPromotable(llvm::Loop *loop, const StateAccesses &accesses,
+                             bool state_is_noalias) {
+  if (!loop->getLoopPreheader() || !loop->hasDedicatedExits()) {
+    return false;
+  }
+
+  for (auto block : loop->blocks()) {
+
+    // Returning from within the loop would skip the stores in the exits.
+    if (!block->getTerminator()->getNumSuccessors()) {
+      return false;
+    }
+
+    for (auto &inst : *block) {
+      if (accesses.unknown.count(&inst)) {
+        return false;
+      } else if (accesses.known.count(&inst) ||
+                 !inst.mayReadOrWriteMemory()) {
+        continue;
+      } else if (auto call = llvm::dyn_cast<llvm::CallBase>(&inst)) {
+        if (!CallCantAccessState(call)) {
+          return false;
+        }
+      } else if (!state_is_noalias || !(llvm::isa<llvm::LoadInst>(inst) ||
+                                        llvm::isa<llvm::StoreInst>(inst))) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+// Returns a pointer to the `type` at `offset` in `State`, built by `ir`.
+static llvm::Value *SlotPointer(llvm::IRBuilder<> &ir, llvm::Value *state_ptr,
+                                int64_t offset, llvm::Type *type) {
+  const auto byte_ptr = ir.CreateBitCast(state_ptr, ir.getInt8PtrTy());
+  const auto slot_ptr =
+      ir.CreateConstInBoundsGEP1_64(ir.getInt8Ty(), byte_ptr, offset);
+  return ir.CreateBitCast(slot_ptr, llvm::PointerType::get(type, 0));
+}
+
+// Promote the accesses `slot_accesses`, all of the same slot of `State`, in
+// `loop`.
+static void PromoteSlot(llvm::Loop *loop, llvm::Value *state_ptr,
+                        const std::vector<const StateAccess *> &slot_accesses) {
+  const auto offset = slot_accesses.front()->offset;
+  const auto type = slot_accesses.front()->type;
+
+  llvm::Align align(8);
+  bool has_stores = false;
+  for (auto access : slot_accesses) {
+    if (auto load = llvm::dyn_cast<llvm::LoadInst>(access->inst)) {
+      align = std::min(align, load->getAlign());
+    } else {
+      const auto store = llvm::cast<llvm::StoreInst>(access->inst);
+      align = std::min(align, store->getAlign());
+      has_stores = true;
+    }
+  }
+
+  // The value of the slot on entry to the loop.
+  const auto preheader = loop->getLoopPreheader();
+  llvm::IRBuilder<> ir(preheader->getTerminator());
+  const auto entry_val = ir.CreateAlignedLoad(
+      type, SlotPointer(ir, state_ptr, offset, type), align);
+
+  llvm::SmallVector<llvm::PHINode *, 8> new_phis;
+  llvm::SSAUpdater ssa(&new_phis);
+  ssa.Initialize(type, "");
+  ssa.AddAvailableValue(preheader, entry_val);
+
+  llvm::SmallPtrSet<llvm::Instruction *, 16> inst_set;
+  for (auto access : slot_accesses) {
+    inst_set.insert(access->inst);
+  }
+
+  // The value of the slot at the end of each block that stores to it.
+  for (auto block : loop->blocks()) {
+    llvm::Value *last_val = nullptr;
+    for (auto &inst : *block) {
+      if (inst_set.count(&inst)) {
+        if (auto store = llvm::dyn_cast<llvm::StoreInst>(&inst)) {
+          last_val = store->getValueOperand();
+        }
+      }
+    }
+    if (last_val) {
+      ssa.AddAvailableValue(block, last_val);
+    }
+  }
+
+  // Replace the loads with the value of the slot at that point.
+  std::vector<llvm::Instruction *> dead;
+  for (auto block : loop->blocks()) {
+    llvm::Value *cur_val = nullptr;
+    for (auto &inst : *block) {
+      if (!inst_set.count(&inst)) {
+        continue;
+      } else if (auto store = llvm::dyn_cast<llvm::StoreInst>(&inst)) {
+        cur_val = store->getValueOperand();
+      } else {
+        inst.replaceAllUsesWith(cur_val ? cur_val
+                                        : ssa.GetValueInMiddleOfBlock(block));
+      }
+      dead.push_back(&inst);
+    }
+  }
+
+  // Store the final value of the slot on the way out of the loop.
+  if (has_stores) {
+    llvm::SmallVector<llvm::BasicBlock *, 4> exits;
+    loop->getUniqueExitBlocks(exits);
+    for (auto exit : exits) {
+      const auto exit_val = ssa.GetValueInMiddleOfBlock(exit);
+      ir.SetInsertPoint(exit, exit->getFirstInsertionPt());
+      ir.CreateAlignedStore(exit_val, SlotPointer(ir, state_ptr, offset, type),
+                            align);
+    }
+  }
+
+  for (auto inst : dead) {
+    inst->eraseFromParent();
+  }
+}
+
+// Promote the slots of `State` accessed in `loop`.
+static unsigned PromoteLoop(llvm::Loop *loop, llvm::Value *state_ptr,
+                            const StateAccesses &accesses) {
+
+  // The accesses in the loop, by offset.
+  std::map<int64_t, std::vector<const StateAccess *>> by_offset;
+  for (auto block : loop->blocks()) {
+    for (auto &inst : *block) {
+      if (auto it = accesses.known.find(&inst); it != accesses.known.end()) {
+        by_offset[it->second.offset].push_back(&(it->second));
+      }
+    }
+  }
+
+  // Only promote slots with a single type, that nothing else overlaps.
+  unsigned num_promoted = 0;
+  int64_t prev_end = 0;
+  for (auto it = by_offset.begin(); it != by_offset.end(); ++it) {
+    const auto &slot_accesses = it->second;
+    const auto type = slot_accesses.front()->type;
+    auto end = it->first;
+    auto same_type = true;
+    for (auto access : slot_accesses) {
+      end = std::max<int64_t>(end, it->first + access->size);
+      same_type = same_type && access->type == type;
+    }
+
+    const auto next_it = std::next(it);
+    const auto overlaps =
+        it->first < prev_end ||
+        (next_it != by_offset.end() && next_it->first < end);
+    prev_end = std::max(prev_end, end);
+
+    if (same_type && !overlaps && type->isFirstClassType() &&
+        !type->isAggregateType()) {
+      PromoteSlot(loop, state_ptr, slot_accesses);
+      num_promoted += 1;
+    }
+  }
+  return num_promoted;
+}
+
+}  // namespace
+
+// Promote the slots of the `State` structure that are accessed within the
+// loops of `func` to SSA values.
+unsigned PromoteStateInLoops(llvm::Function *func) {
+  if (func->isDeclaration() || func->arg_size() <= kStatePointerArgNum) {
+    return 0;
+  }
+
+  const auto state_ptr = NthArgument(func, kStatePointerArgNum);
+  if (!state_ptr->getType()->isPointerTy()) {
+    return 0;
+  }
+
+  llvm::DominatorTree dt(*func);
+  llvm::LoopInfo loops(dt);
+  if (loops.empty()) {
+    return 0;
+  }
+
+  const auto &dl = func->getParent()->getDataLayout();
+  const auto state_is_noalias = state_ptr->hasNoAliasAttr();
+
+  // Outer loops first; once a slot is promoted in a loop, its inner loops no
+  // longer access it. Only the instructions of the blocks change, never the
+  // control flow, so the loop info remains valid throughout.
+  unsigned num_promoted = 0;
+  for (auto loop : loops.getLoopsInPreorder()) {
+    StateAccesses accesses;
+    if (!FindStateAccesses(dl, state_ptr, accesses)) {
+      break;
+    }
+    if (LoopIsPromotable(loop, accesses, state_is_noalias)) {
+      num_promoted += PromoteLoop(loop, state_ptr, accesses);
+    }
+  }
+
+  DLOG_IF(INFO, num_promoted)
+      << "Promoted " << num_promoted << " State slots in the loops of "
+      << func->getName().str();
+  return num_promoted;
+}
+
+}  // namespace remill
@@ -0,0 +1,204 @@
+/*
+ * Copyright (c) 2020 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "remill/BC/Statistics.h"
+
+#include <atomic>
+#include <iomanip>
+#include <ios>
+#include <ostream>
+
+namespace remill {
+
+// The counters and timers of `LiftStatistics`, other than the statistics of
+// each function.
+#define REMILL_FOR_EACH_STAT(M) \
+  M(num_traces) \
+  M(num_bytes_read) \
+  M(num_decoded_insts) \
+  M(num_cached_insts) \
+  M(num_lookahead_insts) \
+  M(num_invalid_insts) \
+  M(num_lifted_insts) \
+  M(num_failed_lifts) \
+  M(num_fused_insts) \
+  M(num_blocks) \
+  M(trace_seconds) \
+  M(read_seconds) \
+  M(decode_seconds) \
+  M(lift_seconds) \
+  M(num_isel_lookups) \
+  M(num_missing_isels) \
+  M(num_dead_reg_writes) \
+  M(num_template_insts) \
+  M(function_pass_seconds) \
+  M(module_pass_seconds) \
+  M(dse_num_stores) \
+  M(dse_dead_stores) \
+  M(dse_removed_insts) \
+  M(dse_forwarded_loads) \
+  M(dse_forwarded_stores) \
+  M(dse_failed_funcs) \
+  M(dse_seconds) \
+  M(decode_alloc_bytes) \
+  M(decode_allocs) \
+  M(trace_alloc_bytes) \
+  M(trace_allocs) \
+  M(lift_alloc_bytes) \
+  M(lift_allocs) \
+  M(optimize_alloc_bytes) \
+  M(optimize_allocs) \
+  M(dse_alloc_bytes) \
+  M(dse_allocs) \
+  M(util_alloc_bytes) \
+  M(util_allocs)
+
+namespace {
+
+// Counters of the innermost `StatisticsAllocationScope` of this thread.
+static thread_local uint64_t *gAllocBytes = nullptr;
+static thread_local uint64_t *gNumAllocs = nullptr;
+
+// Small, stable IDs for the threads that record spans, in the order in which
+// they record their first span.
+static std::atomic<unsigned> gNextThreadId(1);
+
+static unsigned CurrentThreadId(void) {
+  static thread_local const unsigned id = gNextThreadId.fetch_add(1);
+  return id;
+}
+
+}  // namespace
+
+TraceEventLog::TraceEventLog(void)
+    : origin(std::chrono::steady_clock::now()) {}
+
+// Record a span named `name` on this thread from `begin` to `end`.
+void TraceEventLog::AddSpan(const char *name,
+                            std::chrono::steady_clock::time_point begin,
+                            std::chrono::steady_clock::time_point end,
+                            std::optional<uint64_t> addr) {
+  using Micros = std::chrono::duration<double, std::micro>;
+  Span span = {name, CurrentThreadId(), Micros(begin - origin).count(),
+               Micros(end - begin).count(), addr};
+  std::lock_guard<std::mutex> locker(lock);
+  spans.push_back(span);
+}
+
+// Print out all spans as complete (`"ph": "X"`) events.
+void TraceEventLog::PrintJSON(std::ostream &os) const {
+  std::lock_guard<std::mutex> locker(lock);
+
+  // Microsecond timestamps of long runs need more than the default six
+  // significant digits.
+  const auto flags = os.flags();
+  const auto precision = os.precision();
+  os << std::fixed << std::setprecision(3);
+
+  const char *sep = "";
+  os << "{\"traceEvents\": [";
+  for (const auto &span : spans) {
+    os << sep << "\n{\"name\": \"" << span.name
+       << "\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << span.thread
+       << ", \"ts\": " << span.begin_us << ", \"dur\": " << span.duration_us;
+    if (span.addr) {
+      os << ", \"args\": {\"addr\": \"0x" << std::hex << *span.addr
+         << std::dec << "\"}";
+    }
+    os << '}';
+    sep = ",";
+  }
+  os << "],\n\"displayTimeUnit\": \"ms\"}\n";
+  os.flags(flags);
+  os.precision(precision);
+}
+
+StatisticsAllocationScope::StatisticsAllocationScope(uint64_t *bytes,
+                                                     uint64_t *count)
+    : prev_bytes(gAllocBytes),
+      prev_count(gNumAllocs) {
+  if (bytes) {
+    gAllocBytes = bytes;
+    gNumAllocs = count;
+  }
+}
+
+StatisticsAllocationScope::~StatisticsAllocationScope(void) {
+  gAllocBytes = prev_bytes;
+  gNumAllocs = prev_count;
+}
+
+void CountStatisticsAllocation(size_t size) noexcept {
+  if (gAllocBytes) {
+    *gAllocBytes += size;
+    *gNumAllocs += 1;
+  }
+}
+
+void LiftStatistics::Reset(void) {
+  const auto collect = collect_dse_function_stats;
+  const auto log = events;
+  *this = LiftStatistics();
+  collect_dse_function_stats = collect;
+  events = log;
+}
+
+// Add the statistics of `other` to these.
+void LiftStatistics::Add(const LiftStatistics &other) {
+#define REMILL_ADD_STAT(name) name += other.name;
+  REMILL_FOR_EACH_STAT(REMILL_ADD_STAT)
+#undef REMILL_ADD_STAT
+  dse_function_stats.insert(dse_function_stats.end(),
+                            other.dse_function_stats.begin(),
+                            other.dse_function_stats.end());
+}
+
+// Print out all statistics as the members of one JSON object.
+void LiftStatistics::PrintJSON(std::ostream &os) const {
+  const char *sep = "";
+#define REMILL_PRINT_STAT(name) \
+  os << sep << '"' << #name << "\": " << name; \
+  sep = ", ";
+  os << '{';
+  REMILL_FOR_EACH_STAT(REMILL_PRINT_STAT)
+#undef REMILL_PRINT_STAT
+  os << '}';
+}
+
+// Print out all statistics, one per line.
+void LiftStatistics::Print(std::ostream &os) const {
+#define REMILL_PRINT_STAT(name) os << #name << ": " << name << '\n';
+  REMILL_FOR_EACH_STAT(REMILL_PRINT_STAT)
+#undef REMILL_PRINT_STAT
+
+  for (const auto &func : dse_function_stats) {
+    os << "dse_function " << func.name << ":"
+       << " analyzed=" << func.analyzed << " cached=" << func.cached
+       << " num_stores=" << func.num_stores
+       << " dead_stores=" << func.dead_stores
+       << " removed_insts=" << func.removed_insts
+       << " forwarded_loads=" << func.forwarded_loads
+       << " forwarded_stores=" << func.forwarded_stores
+       << " forwarded_perfect=" << func.forwarded_perfect
+       << " forwarded_truncated=" << func.forwarded_truncated
+       << " forwarded_casted=" << func.forwarded_casted
+       << " forwarded_reordered=" << func.forwarded_reordered
+       << " failed_forwards=" << func.failed_forwards
+       << " analysis_seconds=" << func.analysis_seconds << '\n';
+  }
+}
+
+}  // namespace remill
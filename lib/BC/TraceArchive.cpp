@@ -0,0 +1,347 @@
+/*
+ * Copyright (c) 2020 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "remill/BC/TraceArchive.h"
+
+#include <glog/logging.h>
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/Bitcode/BitcodeReader.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Support/MemoryBuffer.h>
+
+#include <algorithm>
+#include <cstring>
+
+#include "remill/Arch/Arch.h"
+#include "remill/BC/Util.h"
+#include "remill/OS/FileSystem.h"
+
+namespace remill {
+namespace {
+
+// The layout of an archive is:
+//
+//    Header:   magic, version, number of shards, number of traces, and the
+//              offset of the index.
+//    Shards:   bitcode modules, each aligned to `kShardAlign` bytes.
+//    Index:    (offset, size) of each shard; then (address, shard, name
+//              offset, name size, padding) of each trace, sorted by address;
+//              then the names of the traces.
+//
+// All integers are little-endian.
+static constexpr char kMagic[8] = {'R', 'E', 'M', 'I', 'L', 'L', 'T', 'A'};
+static constexpr uint32_t kVersion = 1;
+static constexpr size_t kHeaderSize = 32;
+static constexpr size_t kShardSize = 16;
+static constexpr size_t kEntrySize = 24;
+static constexpr uint64_t kShardAlign = 8;
+
+static void AppendLE(std::string &out, uint64_t val, unsigned size) {
+  for (auto i = 0u; i < size; ++i) {
+    out.push_back(static_cast<char>(val >> (i * 8u)));
+  }
+}
+
+static uint64_t ReadLE(const char *data, unsigned size) {
+  uint64_t val = 0;
+  for (auto i = 0u; i < size; ++i) {
+    val |= static_cast<uint64_t>(static_cast<uint8_t>(data[i])) << (i * 8u);
+  }
+  return val;
+}
+
+static std::string EncodeHeader(uint32_t num_shards, uint64_t num_traces,
+                                uint64_t index_offset) {
+  std::string header(kMagic, sizeof(kMagic));
+  AppendLE(header, kVersion, 4);
+  AppendLE(header, num_shards, 4);
+  AppendLE(header, num_traces, 8);
+  AppendLE(header, index_offset, 8);
+  return header;
+}
+
+}  // namespace
+
+TraceArchiveWriter::TraceArchiveWriter(const Arch *arch_,
+                                       std::string_view path_,
+                                       size_t traces_per_shard_)
+    : arch(arch_),
+      path(path_.data(), path_.size()),
+      tmp_path(path + ".tmp"),
+      traces_per_shard(std::max<size_t>(1, traces_per_shard_)),
+      out(tmp_path, std::ios::binary | std::ios::trunc) {
+
+  // The header is rewritten once the index has been written.
+  out << EncodeHeader(0, 0, 0);
+  ok = static_cast<bool>(out);
+  LOG_IF(ERROR, !ok) << "Could not create trace archive " << tmp_path;
+}
+
+TraceArchiveWriter::~TraceArchiveWriter(void) {
+  if (!finished) {
+    out.close();
+    RemoveFile(tmp_path);
+  }
+}
+
+// Add `func`, the lifted trace starting at `addr`, to the archive.
+bool TraceArchiveWriter::AddTrace(uint64_t addr, llvm::Function *func) {
+  CHECK(!finished) << "Can't add traces to a finished trace archive";
+  if (!ok || func->isDeclaration() || entry_index.count(addr)) {
+    return false;
+  }
+
+  if (!shard_module) {
+    shard_module = std::make_unique<llvm::Module>(
+        "shard_" + std::to_string(shards.size()), func->getContext());
+    arch->PrepareModuleDataLayout(shard_module.get());
+  }
+
+  // A trace that an earlier trace of the shard calls is already declared.
+  const auto func_name = func->getName().str();
+  auto archived_func = shard_module->getFunction(func_name);
+  if (!archived_func) {
+    archived_func = llvm::Function::Create(
+        func->getFunctionType(), llvm::GlobalValue::ExternalLinkage,
+        func_name, shard_module.get());
+  } else if (!archived_func->isDeclaration() ||
+             archived_func->getFunctionType() != func->getFunctionType()) {
+    LOG(ERROR) << "Trace archive already has a function named " << func_name;
+    return false;
+  }
+
+  CloneFunctionInto(func, archived_func);
+  archived_func->setLinkage(llvm::GlobalValue::ExternalLinkage);
+
+  entry_index.emplace(addr, entries.size());
+  entries.push_back({addr, static_cast<uint32_t>(shards.size()), func_name});
+
+  if (++shard_size >= traces_per_shard) {
+    return FlushShard();
+  }
+  return true;
+}
+
+// Serialize the shard being filled, and append it to the archive.
+bool TraceArchiveWriter::FlushShard(void) {
+  if (!shard_module) {
+    return ok;
+  }
+
+  llvm::SmallVector<char, 0> bitcode;
+  ok = ok && StoreModuleToBuffer(shard_module.get(), bitcode, {}, true);
+  shard_module.reset();
+  shard_size = 0;
+  if (!ok) {
+    return false;
+  }
+
+  const auto offset = static_cast<uint64_t>(out.tellp());
+  out.write(bitcode.data(), static_cast<std::streamsize>(bitcode.size()));
+  const auto padding = (kShardAlign - (bitcode.size() % kShardAlign)) %
+                       kShardAlign;
+  out << std::string(padding, '\0');
+  shards.push_back({offset, bitcode.size()});
+
+  ok = static_cast<bool>(out);
+  return ok;
+}
+
+// Write the last shard and the index, and move the archive into place.
+bool TraceArchiveWriter::Finish(void) {
+  CHECK(!finished) << "Trace archive " << path << " was already finished";
+  if (!FlushShard()) {
+    return false;
+  }
+
+  std::sort(entries.begin(), entries.end(),
+            [](const Entry &a, const Entry &b) { return a.addr < b.addr; });
+
+  std::string index;
+  std::string names;
+  for (const auto &shard : shards) {
+    AppendLE(index, shard.offset, 8);
+    AppendLE(index, shard.size, 8);
+  }
+  for (const auto &entry : entries) {
+    AppendLE(index, entry.addr, 8);
+    AppendLE(index, entry.shard, 4);
+    AppendLE(index, names.size(), 4);
+    AppendLE(index, entry.name.size(), 4);
+    AppendLE(index, 0, 4);
+    names += entry.name;
+  }
+  index += names;
+
+  const auto index_offset = static_cast<uint64_t>(out.tellp());
+  out << index;
+  out.seekp(0);
+  out << EncodeHeader(static_cast<uint32_t>(shards.size()), entries.size(),
+                      index_offset);
+  out.close();
+  if (!out) {
+    LOG(ERROR) << "Could not write trace archive " << tmp_path;
+    return false;
+  }
+
+  MoveFile(tmp_path, path);
+  finished = true;
+  return true;
+}
+
+TraceArchive::~TraceArchive(void) {}
+
+TraceArchive::TraceArchive(const Arch *arch_,
+                           std::unique_ptr<llvm::MemoryBuffer> buffer_)
+    : arch(arch_),
+      buffer(std::move(buffer_)) {}
+
+// Map the archive at `path`.
+std::unique_ptr<TraceArchive> TraceArchive::Open(const Arch *arch,
+                                                 std::string_view path) {
+  auto buffer = MapBitcodeFile(path, true);
+  if (!buffer) {
+    return nullptr;
+  }
+
+  const auto data = buffer->getBufferStart();
+  const auto size = buffer->getBufferSize();
+  if (size < kHeaderSize || memcmp(data, kMagic, sizeof(kMagic)) ||
+      ReadLE(&(data[8]), 4) != kVersion) {
+    LOG(ERROR) << "File " << path << " is not a trace archive";
+    return nullptr;
+  }
+
+  const auto num_shards = ReadLE(&(data[12]), 4);
+  const auto num_traces = ReadLE(&(data[16]), 8);
+  const auto index_offset = ReadLE(&(data[24]), 8);
+  const auto tables_size =
+      num_shards * kShardSize + num_traces * kEntrySize;
+  if (index_offset > size || num_traces > size ||
+      tables_size > size - index_offset) {
+    LOG(ERROR) << "Trace archive " << path << " is truncated";
+    return nullptr;
+  }
+
+  std::unique_ptr<TraceArchive> archive(
+      new TraceArchive(arch, std::move(buffer)));
+  archive->num_shards = num_shards;
+  archive->num_traces = num_traces;
+  archive->shard_table = &(data[index_offset]);
+  archive->entries = &(archive->shard_table[num_shards * kShardSize]);
+  archive->strings = &(archive->entries[num_traces * kEntrySize]);
+  archive->strings_size = size - index_offset - tables_size;
+  return archive;
+}
+
+// Number of traces in the archive.
+size_t TraceArchive::NumTraces(void) const {
+  return num_traces;
+}
+
+// Returns the index of the entry for the trace at `addr`.
+size_t TraceArchive::FindEntry(uint64_t addr) const {
+  size_t low = 0;
+  size_t high = num_traces;
+  while (low < high) {
+    const auto mid = low + (high - low) / 2;
+    const auto mid_addr = ReadLE(&(entries[mid * kEntrySize]), 8);
+    if (mid_addr < addr) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  if (low < num_traces && ReadLE(&(entries[low * kEntrySize]), 8) == addr) {
+    return low;
+  }
+  return num_traces;
+}
+
+// Returns `true` if the archive contains a trace starting at `addr`.
+bool TraceArchive::HasTrace(uint64_t addr) const {
+  return FindEntry(addr) < num_traces;
+}
+
+// The entry addresses of the traces in the archive, in increasing order.
+std::vector<uint64_t> TraceArchive::TraceAddresses(void) const {
+  std::vector<uint64_t> addrs;
+  addrs.reserve(num_traces);
+  for (size_t i = 0; i < num_traces; ++i) {
+    addrs.push_back(ReadLE(&(entries[i * kEntrySize]), 8));
+  }
+  return addrs;
+}
+
+// Load the trace starting at `addr`.
+llvm::Function *TraceArchive::LoadTrace(uint64_t addr) {
+  const auto i = FindEntry(addr);
+  if (i >= num_traces) {
+    return nullptr;
+  }
+
+  const auto entry = &(entries[i * kEntrySize]);
+  const auto shard = static_cast<uint32_t>(ReadLE(&(entry[8]), 4));
+  const auto name_offset = ReadLE(&(entry[12]), 4);
+  const auto name_size = ReadLE(&(entry[16]), 4);
+  if (shard >= num_shards || name_offset > strings_size ||
+      name_size > strings_size - name_offset) {
+    return nullptr;
+  }
+
+  auto &module = modules[shard];
+  if (!module) {
+    const auto shard_offset = ReadLE(&(shard_table[shard * kShardSize]), 8);
+    const auto shard_size = ReadLE(&(shard_table[shard * kShardSize + 8]), 8);
+    if (shard_offset > buffer->getBufferSize() ||
+        shard_size > buffer->getBufferSize() - shard_offset) {
+      return nullptr;
+    }
+
+    const llvm::MemoryBufferRef shard_buffer(
+        llvm::StringRef(&(buffer->getBufferStart()[shard_offset]),
+                        shard_size),
+        buffer->getBufferIdentifier());
+    auto maybe_module = llvm::getLazyBitcodeModule(shard_buffer, *arch->context);
+    if (!maybe_module) {
+      LOG(ERROR) << "Could not read shard " << shard << " of trace archive "
+                 << buffer->getBufferIdentifier().str() << ": "
+                 << llvm::toString(maybe_module.takeError());
+      return nullptr;
+    }
+    module = std::move(maybe_module.get());
+  }
+
+  const auto func =
+      module->getFunction(llvm::StringRef(&(strings[name_offset]), name_size));
+  if (!func) {
+    return nullptr;
+  }
+
+  // Only read the body of this trace; the traces that it calls stay
+  // declarations until they are loaded themselves.
+  if (auto err = func->materialize()) {
+    LOG(ERROR) << "Could not read trace " << func->getName().str()
+               << " from trace archive "
+               << buffer->getBufferIdentifier().str() << ": "
+               << llvm::toString(std::move(err));
+    return nullptr;
+  }
+  return func->isDeclaration() ? nullptr : func;
+}
+
+}  // namespace remill
@@ -0,0 +1,204 @@
+/*
+ * Copyright (c) 2020 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "remill/BC/TraceCache.h"
+
+#include <glog/logging.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/xxhash.h>
+
+#include <fstream>
+#include <sstream>
+
+#include "remill/Arch/Arch.h"
+#include "remill/Arch/Name.h"
+#include "remill/BC/Util.h"
+#include "remill/OS/FileSystem.h"
+#include "remill/OS/OS.h"
+#include "remill/Version/Version.h"
+
+namespace remill {
+namespace {
+
+// Mix `val` into `hash`.
+static uint64_t HashCombine(uint64_t hash, uint64_t val) {
+  return hash ^ (val + 0x9E3779B97F4A7C15ull + (hash << 6) + (hash >> 2));
+}
+
+static uint64_t HashString(std::string_view str) {
+  return llvm::xxHash64(llvm::StringRef(str.data(), str.size()));
+}
+
+}  // namespace
+
+TraceCache::~TraceCache(void) {}
+
+TraceCache::TraceCache(const Arch *arch_, std::string_view dir_)
+    : arch(arch_),
+      dir(dir_.data(), dir_.size()) {
+  CHECK(TryCreateDirectory(dir))
+      << "Could not create trace cache directory " << dir;
+
+  // The cached traces are only valid for the semantics against which they
+  // were lifted.
+  const auto arch_name = GetArchName(arch->arch_name);
+  const auto sem_path = FindSemanticsBitcodeFile(arch_name);
+  auto sem_buff = llvm::MemoryBuffer::getFile(sem_path);
+  CHECK(sem_buff) << "Could not read semantics bitcode file " << sem_path;
+
+  semantics_hash = HashString(sem_buff.get()->getBuffer());
+  semantics_hash = HashCombine(semantics_hash, HashString(arch_name));
+  semantics_hash =
+      HashCombine(semantics_hash, HashString(GetOSName(arch->os_name)));
+  semantics_hash =
+      HashCombine(semantics_hash, HashString(version::GetCommitHash()));
+}
+
+// Only use and store the traces lifted with the settings hashed into `hash`.
+void TraceCache::SetLiftOptionsHash(uint64_t hash) {
+  lift_options_hash = hash;
+}
+
+// Remember the instructions lifted into the trace at `addr`.
+void TraceCache::SetTraceInstructions(uint64_t addr,
+                                      const TraceInstructionList &insts) {
+  trace_insts[addr] = insts;
+}
+
+// Path to the file in which the trace at `addr` is stored.
+std::string TraceCache::TracePath(uint64_t addr, const char *ext) const {
+  std::stringstream ss;
+  ss << dir << PathSeparator() << GetArchName(arch->arch_name) << '_'
+     << GetOSName(arch->os_name) << '_' << std::hex << addr << ext;
+  return ss.str();
+}
+
+// Hashes the arch, OS, semantics, lifter settings, and bytes of the
+// instructions `insts`.
+bool TraceCache::HashTrace(uint64_t addr, const TraceInstructionList &insts,
+                           TraceManager &manager, uint64_t *hash) const {
+  uint64_t trace_hash = HashCombine(semantics_hash, lift_options_hash);
+  trace_hash = HashCombine(trace_hash, addr);
+  std::string buffer;
+  for (auto [inst_addr, inst_size] : insts) {
+    const auto bytes =
+        manager.TryReadExecutableBytes(inst_addr, inst_size, buffer);
+    if (bytes.size() != inst_size) {
+      return false;
+    }
+    trace_hash = HashCombine(trace_hash, inst_addr);
+    trace_hash = HashCombine(trace_hash, HashString(bytes));
+  }
+  *hash = trace_hash;
+  return true;
+}
+
+// Store `func`, the lifted trace starting at `addr`, into the cache.
+bool TraceCache::StoreTrace(uint64_t addr, llvm::Function *func,
+                            TraceManager &manager) {
+  auto insts_it = trace_insts.find(addr);
+  if (insts_it == trace_insts.end()) {
+    LOG(ERROR) << "Unknown instructions for trace at " << std::hex << addr
+               << std::dec << "; not caching it";
+    return false;
+  }
+
+  const auto &insts = insts_it->second;
+  uint64_t hash = 0;
+  if (!HashTrace(addr, insts, manager, &hash)) {
+    return false;
+  }
+
+  // Clone the trace into its own module; this declares everything that the
+  // trace references.
+  const auto func_name = func->getName().str();
+  llvm::Module module(func_name, func->getContext());
+  arch->PrepareModuleDataLayout(&module);
+  auto cached_func =
+      llvm::Function::Create(func->getFunctionType(),
+                             llvm::GlobalValue::ExternalLinkage, func_name,
+                             &module);
+  CloneFunctionInto(func, cached_func);
+  cached_func->setLinkage(llvm::GlobalValue::ExternalLinkage);
+
+  if (!StoreModuleToFile(&module, TracePath(addr, ".bc"), true)) {
+    return false;
+  }
+
+  // Write out the index last, so that a partially written cache entry is
+  // never considered valid.
+  const auto index_path = TracePath(addr, ".idx");
+  const auto tmp_path = index_path + ".tmp";
+  std::ofstream index(tmp_path, std::ios::trunc);
+  index << std::hex << hash << '\n' << func_name << '\n' << insts.size();
+  for (auto [inst_addr, inst_size] : insts) {
+    index << '\n' << inst_addr << ' ' << inst_size;
+  }
+  index << '\n';
+  index.close();
+  if (!index) {
+    RemoveFile(tmp_path);
+    return false;
+  }
+
+  MoveFile(tmp_path, index_path);
+  return true;
+}
+
+// Load a previously stored trace starting at `addr`.
+llvm::Function *TraceCache::LoadTrace(uint64_t addr, TraceManager &manager) {
+  std::ifstream index(TracePath(addr, ".idx"));
+  if (!index) {
+    return nullptr;
+  }
+
+  uint64_t expected_hash = 0;
+  std::string func_name;
+  size_t num_insts = 0;
+  index >> std::hex >> expected_hash >> func_name >> num_insts;
+
+  TraceInstructionList insts;
+  for (size_t i = 0; i < num_insts && index; ++i) {
+    uint64_t inst_addr = 0;
+    uint64_t inst_size = 0;
+    index >> inst_addr >> inst_size;
+    insts.emplace_back(inst_addr, inst_size);
+  }
+
+  uint64_t hash = 0;
+  if (!index || !HashTrace(addr, insts, manager, &hash) ||
+      hash != expected_hash) {
+    return nullptr;  // Malformed, or the bytes of the trace have changed.
+  }
+
+  auto module = LoadModuleFromFile(arch->context, TracePath(addr, ".bc"), true);
+  if (!module) {
+    return nullptr;
+  }
+
+  auto func = module->getFunction(func_name);
+  if (!func || func->isDeclaration()) {
+    return nullptr;
+  }
+
+  trace_insts[addr] = std::move(insts);
+  modules.emplace_back(std::move(module));
+  return func;
+}
+
+}  // namespace remill
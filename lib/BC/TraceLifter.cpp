@@ -14,18 +14,52 @@
  * limitations under the License.
  */
 
+#include <llvm/IR/DebugInfoMetadata.h>
+#include <llvm/IR/DerivedTypes.h>
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/MDBuilder.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Support/xxhash.h>
+#include <llvm/Transforms/Utils/Cloning.h>
 #include <remill/BC/TraceLifter.h>
 
-#include <set>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <optional>
 #include <sstream>
+#include <thread>
+#include <tuple>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
 
 #include "InstructionLifter.h"
+#include "remill/Arch/Arch.h"
+#include "remill/Arch/InstructionCache.h"
+#include "remill/BC/Compat/Cloning.h"
+#include "remill/BC/IntrinsicTable.h"
+#include "remill/BC/ModuleIndex.h"
+#include "remill/BC/Profile.h"
+#include "remill/BC/Statistics.h"
+#include "remill/BC/Util.h"
+#include "remill/BC/Version.h"
 
 namespace remill {
 namespace {}  // namespace
 
 TraceManager::~TraceManager(void) {}
 
+// Called with the instructions that were decoded while lifting the trace
+// starting at `addr`.
+void TraceManager::SetLiftedTraceInstructions(uint64_t,
+                                              const TraceInstructionList &) {}
+
 // Return an already lifted trace starting with the code at address
 // `addr`.
 llvm::Function *TraceManager::GetLiftedTraceDeclaration(uint64_t) {
@@ -47,6 +81,55 @@ void TraceManager::ForEachDevirtualizedTarget(
   // Must be extended.
 }
 
+// Fill `targets` with all known targets of the indirect jump `inst`.
+void TraceManager::GetDevirtualizedTargets(const Instruction &inst,
+                                           DevirtualizedTargetList &targets) {
+  ForEachDevirtualizedTarget(
+      inst, [&targets](uint64_t target, DevirtualizedTargetKind kind) {
+        targets.emplace_back(target, kind);
+      });
+}
+
+// Try to get the number of times that the block of instructions starting at
+// `addr` was executed.
+bool TraceManager::TryGetBlockCount(uint64_t, uint64_t *) {
+  return false;
+}
+
+// Try to get the counts of the two edges out of the conditional control-flow
+// instruction at `inst_addr`.
+bool TraceManager::TryGetBranchCounts(uint64_t, uint64_t *, uint64_t *) {
+  return false;
+}
+
+// Returns `true` if the segment base registers are never written by the
+// lifted code.
+bool TraceManager::HasInvariantSegmentBases(void) {
+  return false;
+}
+
+// Returns `true` if the code at `addr` belongs to a function that follows the
+// standard calling convention.
+bool TraceManager::IsStandardFunction(uint64_t) {
+  return false;
+}
+
+// Try to read up to `size` contiguous executable bytes starting at address
+// `addr`.
+std::string_view TraceManager::TryReadExecutableBytes(uint64_t addr,
+                                                      size_t size,
+                                                      std::string &buffer) {
+  buffer.clear();
+  for (size_t i = 0; i < size; ++i) {
+    uint8_t byte = 0;
+    if (!TryReadExecutableByte(addr + i, &byte)) {
+      break;
+    }
+    buffer.push_back(static_cast<char>(byte));
+  }
+  return buffer;
+}
+
 // Figure out the name for the trace starting at address `addr`.
 std::string TraceManager::TraceName(uint64_t addr) {
   std::stringstream ss;
@@ -56,22 +139,465 @@ std::string TraceManager::TraceName(uint64_t addr) {
 
 namespace {
 
-using DecoderWorkList = std::set<uint64_t>;  // For ordering.
+// Atomic accesses need an explicit alignment.
+template <typename T>
+static void SetAlignment(T *inst, unsigned align) {
+#if LLVM_VERSION_NUMBER >= LLVM_VERSION(11, 0)
+  inst->setAlignment(llvm::Align(align));
+#elif LLVM_VERSION_NUMBER >= LLVM_VERSION(10, 0)
+  inst->setAlignment(llvm::MaybeAlign(align));
+#else
+  inst->setAlignment(align);
+#endif
+}
+
+// Give the `ProfileCounters` of the trace `func_name` in `module`, if any,
+// external linkage, so that they can be found by the runtime.
+static void ExposeProfileCounters(llvm::Module *module,
+                                  const std::string &func_name) {
+  if (auto counters =
+          module->getGlobalVariable(ProfileCountersName(func_name), true)) {
+    counters->setLinkage(llvm::GlobalValue::ExternalLinkage);
+  }
+}
+
+// Replace the `PC`- and `NEXT_PC`-relative address operands of `inst` with
+// absolute addresses, e.g. RIP-relative operands on x86, or the targets of
+// `ADR` and literal loads on AArch64. Within a trace, `PC` and `NEXT_PC` are
+// always `inst.pc` and `inst.next_pc` when the operands of `inst` are lifted.
+static void FoldPCRelativeOperands(Instruction &inst) {
+  for (auto &op : inst.operands) {
+    if (Operand::kTypeAddress != op.type ||
+        !op.addr.index_reg.name.empty() ||
+        !op.addr.segment_base_reg.name.empty()) {
+      continue;
+    }
+
+    uint64_t base = 0;
+    if (op.addr.base_reg.name == kPCVariableName) {
+      base = inst.pc;
+    } else if (op.addr.base_reg.name == kNextPCVariableName) {
+      base = inst.next_pc;
+    } else {
+      continue;
+    }
+
+    op.addr.base_reg = Operand::Register();
+    op.addr.displacement = static_cast<int64_t>(
+        base + static_cast<uint64_t>(op.addr.displacement));
+  }
+}
+
+// Maximum number of instructions lifted under the branch of one predicated
+// instruction.
+static constexpr size_t kMaxPredicatedRunLength = 32;
+
+// Add the registers read by the operand expression `expr` to `regs`. Returns
+// `false` if `expr` reads a variable that isn't a register.
+static bool CollectRegisters(const Arch *arch, const OperandExpression *expr,
+                             std::vector<const Register *> &regs) {
+  if (!expr) {
+    return false;
+  } else if (auto llvm_op = std::get_if<LLVMOpExpr>(expr)) {
+    return CollectRegisters(arch, llvm_op->op1, regs) &&
+           (!llvm_op->op2 || CollectRegisters(arch, llvm_op->op2, regs));
+  } else if (auto reg = std::get_if<const Register *>(expr)) {
+    regs.push_back(*reg);
+    return *reg != nullptr;
+  } else if (auto name = std::get_if<std::string>(expr)) {
+    const auto named_reg = arch->RegisterByName(*name);
+    regs.push_back(named_reg);
+    return named_reg != nullptr;
+  } else {
+    return true;
+  }
+}
+
+// An ordered set of addresses, kept in a flat vector sorted in descending
+// order. The lowest address is always processed first, and so it can be
+// cheaply popped off of the back of the vector.
+class DecoderWorkList {
+ public:
+  inline bool empty(void) const {
+    return addrs.empty();
+  }
+
+  inline void clear(void) {
+    addrs.clear();
+  }
+
+  inline size_t count(uint64_t addr) const {
+    return std::binary_search(addrs.begin(), addrs.end(), addr,
+                              std::greater<uint64_t>()) ? 1u : 0u;
+  }
+
+  inline void insert(uint64_t addr) {
+    auto it = std::lower_bound(addrs.begin(), addrs.end(), addr,
+                               std::greater<uint64_t>());
+    if (it == addrs.end() || *it != addr) {
+      addrs.insert(it, addr);
+    }
+  }
+
+  // Remove and return the lowest address in the work list.
+  inline uint64_t pop(void) {
+    const auto addr = addrs.back();
+    addrs.pop_back();
+    return addr;
+  }
+
+ private:
+  std::vector<uint64_t> addrs;
+};
+
+// Maps instruction addresses to the blocks that will contain them. This is an
+// open-addressed hash table with linear probing over one flat array of slots.
+// A slot with a null block is empty; this works because every slot returned
+// by `FindOrInsert` is immediately filled in with a non-null block.
+class BlockMap {
+ public:
+  inline BlockMap(void) : slots(kMinNumSlots) {}
+
+  void clear(void) {
+    if (!num_blocks) {
+      return;
+
+    // Don't keep a huge table around for the next (likely smaller) trace.
+    } else if (slots.size() > kMinNumSlots && (num_blocks * 8) < slots.size()) {
+      std::vector<Slot>(kMinNumSlots).swap(slots);
+
+    } else {
+      std::fill(slots.begin(), slots.end(), Slot());
+    }
+    num_blocks = 0;
+  }
+
+  inline size_t size(void) const {
+    return num_blocks;
+  }
+
+  // Calls `cb` with the address and block of each entry, in no particular
+  // order.
+  template <typename CB>
+  void ForEach(CB cb) const {
+    for (const auto &slot : slots) {
+      if (slot.second) {
+        cb(slot.first, slot.second);
+      }
+    }
+  }
+
+  // Returns the block associated with `addr`, or `nullptr` if there is no
+  // block yet.
+  llvm::BasicBlock *Find(uint64_t addr) const {
+    return FindSlot(slots, addr).second;
+  }
+
+  // Returns a reference to the block associated with `addr`, which is null
+  // if there is no block yet. The caller must fill in a null block.
+  llvm::BasicBlock *&FindOrInsert(uint64_t addr) {
+    if ((num_blocks + 1) * 2 > slots.size()) {
+      Grow();
+    }
+    auto &slot = FindSlot(slots, addr);
+    if (!slot.second) {
+      slot.first = addr;
+      ++num_blocks;
+    }
+    return slot.second;
+  }
+
+ private:
+  using Slot = std::pair<uint64_t, llvm::BasicBlock *>;
+
+  static constexpr size_t kMinNumSlots = 256;
+
+  template <typename Slots>
+  static auto FindSlot(Slots &slots_, uint64_t addr)
+      -> decltype(slots_[0]) {
+    const auto mask = slots_.size() - 1u;
+    auto i = static_cast<size_t>((addr * 0x9E3779B97F4A7C15ull) >> 32) & mask;
+    for (;; i = (i + 1u) & mask) {
+      auto &slot = slots_[i];
+      if (!slot.second || slot.first == addr) {
+        return slot;
+      }
+    }
+  }
+
+  void Grow(void) {
+    std::vector<Slot> new_slots(slots.size() * 2);
+    for (const auto &slot : slots) {
+      if (slot.second) {
+        FindSlot(new_slots, slot.first) = slot;
+      }
+    }
+    slots.swap(new_slots);
+  }
+
+  std::vector<Slot> slots;
+  size_t num_blocks{0};
+};
+
+// Decodes instructions ahead of the trace lifter on a thread of its own,
+// following the fall-through and direct branch edges from the start of the
+// trace. At most `max_insts` decoded instructions wait to be taken at once.
+class LookaheadDecoder {
+ public:
+  LookaheadDecoder(const Arch *arch_, TraceManager &manager_,
+                   size_t max_inst_bytes_, size_t max_insts_)
+      : arch(arch_),
+        manager(manager_),
+        max_inst_bytes(max_inst_bytes_),
+        max_insts(max_insts_),
+        thread([this] { Run(); }) {}
+
+  ~LookaheadDecoder(void) {
+    {
+      std::lock_guard<std::mutex> locker(lock);
+      stop = true;
+    }
+    cv.notify_all();
+    thread.join();
+  }
+
+  // Forget everything decoded so far, and start decoding ahead from `addr`.
+  // Each burst of decoding is recorded as a span in `events_`, if non-null.
+  void Restart(uint64_t addr, TraceEventLog *events_) {
+    {
+      std::lock_guard<std::mutex> locker(lock);
+      events = events_;
+      ++generation;
+      work_list.clear();
+      seen.clear();
+      decoded.clear();
+      work_list.push_back(addr);
+      seen.insert(addr);
+    }
+    cv.notify_all();
+  }
+
+  // Copy the instruction decoded ahead at `addr` into `inst`, if any, and if
+  // it was decoded from a prefix of `bytes`.
+  bool TryTake(uint64_t addr, std::string_view bytes, Instruction &inst) {
+    {
+      std::lock_guard<std::mutex> locker(lock);
+      auto it = decoded.find(addr);
+      if (it == decoded.end()) {
+        return false;
+      }
+      const auto &inst_bytes = it->second.bytes;
+      if (inst_bytes.size() <= bytes.size() &&
+          bytes.substr(0, inst_bytes.size()) == inst_bytes) {
+        inst = it->second;
+      } else {
+        inst.Reset();
+      }
+      decoded.erase(it);
+    }
+    cv.notify_all();
+    return !inst.bytes.empty();
+  }
+
+ private:
+  void Run(void) {
+    std::string buffer;
+    Instruction inst;
+    std::optional<std::chrono::steady_clock::time_point> burst_begin;
+    uint64_t burst_addr = 0;
+    std::unique_lock<std::mutex> locker(lock);
+    while (true) {
+      const auto can_decode = [this] {
+        return stop || (!work_list.empty() && decoded.size() < max_insts);
+      };
+
+      // A burst ends when there is nothing left to decode, or when the
+      // lifter has fallen behind.
+      if (burst_begin && !can_decode()) {
+        if (events) {
+          events->AddSpan("decode_burst", *burst_begin,
+                          std::chrono::steady_clock::now(), burst_addr);
+        }
+        burst_begin.reset();
+      }
+      cv.wait(locker, can_decode);
+      if (stop) {
+        return;
+      }
+
+      const auto addr = work_list.back();
+      if (!burst_begin) {
+        burst_begin = std::chrono::steady_clock::now();
+        burst_addr = addr;
+      }
+      const auto gen = generation;
+      work_list.pop_back();
+      locker.unlock();
+
+      // The decoder and the manager's memory are read without the lock.
+      inst.Reset();
+      auto bytes = manager.TryReadExecutableBytes(addr, max_inst_bytes, buffer);
+      const auto ok = !bytes.empty() && arch->DecodeInstruction(
+                                            addr, bytes.substr(0, max_inst_bytes),
+                                            inst);
+
+      locker.lock();
+      if (!ok || gen != generation) {
+        continue;
+      }
+
+      decoded.emplace(addr, inst);
+      if (arch->MayHaveDelaySlot(inst)) {
+        continue;
+      }
+
+      switch (inst.category) {
+        case Instruction::kCategoryNormal:
+        case Instruction::kCategoryNoOp: Follow(inst.next_pc); break;
+        case Instruction::kCategoryDirectJump:
+          Follow(inst.branch_taken_pc);
+          break;
+        case Instruction::kCategoryConditionalBranch:
+          Follow(inst.branch_not_taken_pc);
+          Follow(inst.branch_taken_pc);
+          break;
+        case Instruction::kCategoryDirectFunctionCall:
+        case Instruction::kCategoryConditionalDirectFunctionCall:
+          Follow(inst.branch_not_taken_pc);
+          break;
+        default: break;
+      }
+    }
+  }
+
+  // Decode the instruction at `addr` later. Called with `lock` held.
+  void Follow(uint64_t addr) {
+    if (seen.insert(addr).second) {
+      work_list.push_back(addr);
+    }
+  }
+
+  const Arch *const arch;
+  TraceManager &manager;
+  const size_t max_inst_bytes;
+  const size_t max_insts;
+
+  std::mutex lock;
+  std::condition_variable cv;
+  bool stop{false};
+  uint64_t generation{0};
+  TraceEventLog *events{nullptr};
+  std::vector<uint64_t> work_list;
+  std::unordered_set<uint64_t> seen;
+  std::unordered_map<uint64_t, Instruction> decoded;
+
+  // Started last, once everything it uses is initialized.
+  std::thread thread;
+};
 
 }  // namespace
 
 class TraceLifter::Impl {
  public:
-  Impl(InstructionLifter *inst_lifter_, TraceManager *manager_);
+  using TraceModuleCallback = TraceLifter::TraceModuleCallback;
+
+  Impl(InstructionLifter *inst_lifter_, TraceManager *manager_,
+       InstructionCache *cache_);
 
   // Lift one or more traces starting from `addr`. Calls `callback` with each
   // lifted trace.
   bool Lift(uint64_t addr,
-            std::function<void(uint64_t, llvm::Function *)> callback);
+            std::function<void(uint64_t, llvm::Function *)> callback,
+            const TraceModuleCallback *release);
+
+  // Move the lifted trace `func` into its own module, and hand that module
+  // off to `release`. Returns the declaration of `func` left in `module`.
+  llvm::Function *ReleaseTrace(uint64_t addr,
+                               const TraceModuleCallback &release);
 
   // Reads the bytes of an instruction at `addr` into `state.inst_bytes`.
   bool ReadInstructionBytes(uint64_t addr);
 
+  // Decodes the instruction at `addr` from `inst_bytes` into `into`, possibly
+  // by way of `cache`.
+  void DecodeInstruction(uint64_t addr, Instruction &into);
+
+  void DecodeInstruction(uint64_t addr) {
+    DecodeInstruction(addr, inst);
+  }
+
+  // Decodes the instruction in the delay slot of `inst` from `inst_bytes`
+  // into `delayed_inst`, possibly by way of `delayed_insts`.
+  bool DecodeDelayedInstruction(void);
+
+  // Tries to fuse `inst` with the instruction that follows it.
+  void TryFuseWithNextInstruction(void);
+
+  // Lifts the run of instructions after the predicated instruction `inst`
+  // that share its predicate under a single branch. Returns `false` if there
+  // is no such run, in which case `block` isn't terminated.
+  bool LiftPredicatedRun(void);
+
+  // Look up the trace at the next program counter of `from_block`. Returns
+  // the block in which `trace` is the found trace.
+  llvm::BasicBlock *AddTraceLookup(llvm::BasicBlock *from_block,
+                                   llvm::BasicBlock *miss_block,
+                                   llvm::Value *&trace);
+
+  // Returns the unused trace table entry of `module`.
+  llvm::Constant *GetTraceTableSentinel(llvm::StructType *entry_type);
+
+  // Terminate `from_block` with a jump to the next program counter, by way
+  // of the trace table if indirect jumps are chained.
+  void AddUnknownIndirectJump(llvm::BasicBlock *from_block);
+
+  // Call the function at the next program counter of `from_block`. Returns
+  // the block that follows the call.
+  llvm::BasicBlock *AddIndirectFunctionCall(llvm::BasicBlock *from_block);
+
+  // Check that the lifted function called by `block` returned to the return
+  // address. Returns the block into which lifting continues.
+  llvm::BasicBlock *AddReturnCheck(llvm::BasicBlock *block);
+
+  // Returns `true` if the trace at `target_pc`, called by a direct call,
+  // returns straight back to its caller.
+  bool ReturnsToCaller(uint64_t target_pc);
+
+  // Terminate `block` with a function return.
+  void AddFunctionReturn(llvm::BasicBlock *block);
+
+  // Attach the profiled branch weights of `inst` to the conditional branch
+  // `br`, if the trace manager has them.
+  void AddBranchWeights(llvm::BranchInst *br);
+
+  // Terminate `block` with a branch on the `BRANCH_TAKEN` of `inst`, counting
+  // its edges if enabled.
+  llvm::BranchInst *AddConditionalBranch(llvm::BasicBlock *taken_block,
+                                         llvm::BasicBlock *not_taken_block,
+                                         llvm::BasicBlock *block);
+
+  // Add one (or the sampling byte) to a new counter of the `kind` of `pc`,
+  // if `when` is null or true, using `ir`.
+  void AddCounter(llvm::IRBuilder<> &ir, uint64_t pc, ProfileCounterKind kind,
+                  llvm::Value *when = nullptr);
+
+  // Spill the SPARC register window held by `func`, if any, before each of
+  // its exits.
+  void SpillRegisterWindows(void);
+
+  // Count the executions of each block of instructions of `func`.
+  void InstrumentBlocks(uint64_t trace_addr);
+
+  // Define the `ProfileCounters` of `func`, if it has any counters.
+  void FinishProfiling(uint64_t trace_addr);
+
+  // Order the blocks of `func` by their profiled counts.
+  void LayOutBlocks(void);
+
+  // Move the blocks of `func` that exit to `__remill_error` or
+  // `__remill_missing_block` to its end, and mark them as unlikely.
+  void SplitColdExits(void);
+
   // Return an already lifted trace starting with the code at address
   // `addr`.
   //
@@ -86,156 +612,1136 @@ class TraceLifter::Impl {
   //       within `module`.
   llvm::Function *GetLiftedTraceDefinition(uint64_t addr);
 
-  llvm::BasicBlock *GetOrCreateBlock(uint64_t block_pc) {
-    auto &block = blocks[block_pc];
-    if (!block) {
-      block = llvm::BasicBlock::Create(context, "", func);
-    }
-    return block;
+  // Returns a pointer to the timer `field` of `stats`, or `nullptr` if we
+  // are not collecting statistics.
+  double *Timer(double LiftStatistics::*field) const {
+    return stats ? &(stats->*field) : nullptr;
+  }
+
+  // Returns a pointer to the counter `field` of `stats`, or `nullptr` if we
+  // are not collecting statistics.
+  uint64_t *Counter(uint64_t LiftStatistics::*field) const {
+    return stats ? &(stats->*field) : nullptr;
+  }
+
+  // Returns `true` if the trace being lifted has reached one of its limits.
+  // Returns `true` if the lift must stop, recording why in `outcome`.
+  bool ShouldStopLifting(void) {
+    if (outcome != LiftOutcome::kComplete) {
+      return true;
+    }
+    if ((lift_options.max_instructions &&
+         (num_lifted_insts + num_trace_insts) >=
+             lift_options.max_instructions) ||
+        (lift_options.max_traces &&
+         num_lifted_traces >= lift_options.max_traces)) {
+      outcome = LiftOutcome::kBudgetExhausted;
+    } else {
+      outcome = lift_options.interrupt.Check();
+    }
+    return outcome != LiftOutcome::kComplete;
+  }
+
+  bool TraceIsTooBig(void) const {
+    return (limits.max_instructions &&
+            num_trace_insts >= limits.max_instructions) ||
+           (limits.max_blocks && blocks.size() > limits.max_blocks);
+  }
+
+  llvm::BasicBlock *GetOrCreateBlock(uint64_t block_pc) {
+    auto &block = blocks.FindOrInsert(block_pc);
+    if (!block) {
+      block = llvm::BasicBlock::Create(context, "", func);
+    }
+    return block;
+  }
+
+  llvm::BasicBlock *GetOrCreateBranchTakenBlock(void) {
+    inst_work_list.insert(inst.branch_taken_pc);
+    return GetOrCreateBlock(inst.branch_taken_pc);
+  }
+
+  llvm::BasicBlock *GetOrCreateBranchNotTakenBlock(void) {
+    CHECK(inst.branch_not_taken_pc != 0);
+    inst_work_list.insert(inst.branch_not_taken_pc);
+    return GetOrCreateBlock(inst.branch_not_taken_pc);
+  }
+
+  llvm::BasicBlock *GetOrCreateNextBlock(void) {
+    inst_work_list.insert(inst.next_pc);
+    return GetOrCreateBlock(inst.next_pc);
+  }
+
+  uint64_t PopTraceAddress(void) {
+    return trace_work_list.pop();
+  }
+
+  uint64_t PopInstructionAddress(void) {
+    return inst_work_list.pop();
+  }
+
+  const Arch *const arch;
+  InstructionLifter &inst_lifter;
+  const remill::IntrinsicTable *intrinsics;
+  llvm::LLVMContext &context;
+  llvm::Module *const module;
+  const uint64_t addr_mask;
+  TraceManager &manager;
+  InstructionCache *const cache;
+
+  llvm::Function *func;
+  llvm::BasicBlock *block;
+  llvm::SwitchInst *switch_inst;
+  const size_t max_inst_bytes;
+  std::string inst_bytes_buffer;
+  std::string_view inst_bytes;
+  Instruction inst;
+  Instruction delayed_inst;
+  Instruction fused_inst;
+
+  // Previously decoded delayed instructions, by address. The same delay slot
+  // is decoded for every trace that contains its branch.
+  std::unordered_map<uint64_t, Instruction> delayed_insts;
+
+  // Instructions following a predicated instruction that share its predicate.
+  std::vector<Instruction> predicated_insts;
+  std::vector<const Register *> predicate_regs;
+  DecoderWorkList trace_work_list;
+  DecoderWorkList inst_work_list;
+  BlockMap blocks;
+  TraceInstructionList trace_insts;
+  DevirtualizedTargetList devirt_targets;
+  std::vector<std::tuple<uint64_t, uint64_t, llvm::BasicBlock *>>
+      profiled_blocks;
+  TraceProfiling profiling;
+  std::vector<uint64_t> counter_pcs;
+  std::vector<ProfileCounterKind> counter_kinds;
+  llvm::GlobalVariable *counts_placeholder{nullptr};
+  TraceLimits limits;
+  size_t num_trace_insts{0};
+  bool fuse_insts{false};
+  bool fold_pc_relative_operands{true};
+  size_t max_lookahead_insts{0};
+  std::unique_ptr<LookaheadDecoder> lookahead;
+  bool lazy_prologue{false};
+  bool chain_indirect_jumps{false};
+  bool inline_target_caches{false};
+  bool native_call_returns{false};
+  bool split_cold_exits{false};
+
+  // Whether the returns of the trace being lifted go straight back to the
+  // caller, rather than through `__remill_function_return`.
+  bool native_returns{false};
+
+  LiftStatistics *stats{nullptr};
+  ModuleIndex *index{nullptr};
+  TraceLifter::TraceHeadCallback on_trace_head;
+  LiftOptions lift_options;
+  LiftOutcome outcome{LiftOutcome::kComplete};
+  size_t num_lifted_insts{0};
+  size_t num_lifted_traces{0};
+};
+
+TraceLifter::Impl::Impl(InstructionLifter *inst_lifter_, TraceManager *manager_,
+                        InstructionCache *cache_)
+    : arch(inst_lifter_->impl->arch),
+      inst_lifter(*inst_lifter_),
+      intrinsics(inst_lifter.impl->intrinsics),
+      context(inst_lifter.impl->word_type->getContext()),
+      module(intrinsics->async_hyper_call->getParent()),
+      addr_mask(arch->address_size >= 64 ? ~0ULL
+                                         : (~0ULL >> arch->address_size)),
+      manager(*manager_),
+      cache(cache_),
+      func(nullptr),
+      block(nullptr),
+      switch_inst(nullptr),
+      max_inst_bytes(arch->MaxInstructionSize()) {
+
+  inst_bytes_buffer.reserve(max_inst_bytes);
+}
+
+// Return an already lifted trace starting with the code at address
+// `addr`.
+llvm::Function *TraceLifter::Impl::GetLiftedTraceDeclaration(uint64_t addr) {
+  auto func = manager.GetLiftedTraceDeclaration(addr);
+  if (!func || func->getParent() == module) {
+    return func;
+  }
+
+  return nullptr;
+}
+
+// Return an already lifted trace starting with the code at address
+// `addr`.
+llvm::Function *TraceLifter::Impl::GetLiftedTraceDefinition(uint64_t addr) {
+  auto func = manager.GetLiftedTraceDefinition(addr);
+  if (!func || func->getParent() == module) {
+    return func;
+  }
+
+  CHECK_EQ(&(func->getContext()), &context);
+
+  auto func_type = llvm::dyn_cast<llvm::FunctionType>(
+      RecontextualizeType(func->getFunctionType(), context));
+
+  // Handle the different module situation by declaring the trace in
+  // this module to be external, with the idea that it will link to
+  // another module.
+  auto extern_func = module->getFunction(func->getName());
+  if (!extern_func || extern_func->getFunctionType() != func_type) {
+    extern_func = llvm::Function::Create(
+        func_type, llvm::GlobalValue::ExternalLinkage, func->getName(), module);
+
+  } else if (extern_func->isDeclaration()) {
+    extern_func->setLinkage(llvm::GlobalValue::ExternalLinkage);
+  }
+
+  return extern_func;
+}
+
+TraceLifter::~TraceLifter(void) {}
+
+TraceLifter::TraceLifter(InstructionLifter *inst_lifter_,
+                         TraceManager *manager_, InstructionCache *cache_)
+    : impl(new Impl(inst_lifter_, manager_, cache_)) {}
+
+void TraceLifter::NullCallback(uint64_t, llvm::Function *) {}
+
+// Limit the size of each trace lifted after this call.
+void TraceLifter::SetTraceLimits(const TraceLimits &limits) {
+  impl->limits = limits;
+}
+
+// Fuse idioms of consecutive instructions in each trace lifted after this
+// call.
+void TraceLifter::SetFuseInstructions(bool enable) {
+  impl->fuse_insts = enable;
+}
+
+// Fold the PC-relative operands of each trace lifted after this call into
+// absolute addresses.
+void TraceLifter::SetFoldPCRelativeOperands(bool enable) {
+  impl->fold_pc_relative_operands = enable;
+}
+
+// Decode up to `max_queued_insts` instructions ahead of the lifter on another
+// thread.
+void TraceLifter::SetLookaheadDecoding(size_t max_queued_insts) {
+  impl->max_lookahead_insts = max_queued_insts;
+  impl->lookahead.reset();
+}
+
+// Start each trace lifted after this call with a minimal prologue.
+void TraceLifter::SetLazyPrologue(bool enable) {
+  impl->lazy_prologue = enable;
+  impl->inst_lifter.SetLazyBlockVariables(enable);
+}
+
+// Chain the indirect jumps of each trace lifted after this call to their
+// target traces.
+void TraceLifter::SetChainIndirectJumps(bool enable) {
+  impl->chain_indirect_jumps = enable;
+}
+
+// Emit an inline target cache at each indirect jump and call site, and return
+// directly to the caller, in each trace lifted after this call.
+void TraceLifter::SetInlineTargetCaches(bool enable) {
+  impl->inline_target_caches = enable;
+}
+
+// Lift the direct calls to, and the returns of, standard functions as native
+// calls and returns in each trace lifted after this call.
+void TraceLifter::SetNativeCallReturns(bool enable) {
+  impl->native_call_returns = enable;
+}
+
+// Move the error and missing block exits of each trace lifted after this
+// call out of its hot paths.
+void TraceLifter::SetSplitColdExits(bool enable) {
+  impl->split_cold_exits = enable;
+}
+
+// Instrument each trace lifted after this call so that it counts its own
+// execution.
+void TraceLifter::SetProfiling(const TraceProfiling &profiling) {
+  impl->profiling = profiling;
+}
+
+// Accumulate statistics about each trace lifted after this call into `stats`.
+void TraceLifter::SetStatistics(LiftStatistics *stats) {
+  impl->stats = stats;
+  impl->inst_lifter.SetStatistics(stats);
+}
+
+// Add each trace lifted after this call to `index`.
+void TraceLifter::SetModuleIndex(ModuleIndex *index) {
+  impl->index = index;
+}
+
+// Hand off each trace head discovered after this call to `on_trace_head`.
+void TraceLifter::SetTraceHeadCallback(TraceHeadCallback on_trace_head) {
+  impl->on_trace_head = std::move(on_trace_head);
+}
+
+// Bound the work done by each call to `Lift` after this call.
+void TraceLifter::SetLiftOptions(const LiftOptions &options) {
+  impl->lift_options = options;
+}
+
+// Returns why the most recent call to `Lift` stopped.
+LiftOutcome TraceLifter::Outcome(void) const {
+  return impl->outcome;
+}
+
+// Returns a hash of the settings of this trace lifter, and of its
+// `InstructionLifter`, that change the lifted IR.
+uint64_t TraceLifter::OptionsHash(void) const {
+  const uint64_t options[] = {impl->inst_lifter.OptionsHash(),
+                              impl->limits.max_instructions,
+                              impl->limits.max_blocks,
+                              impl->profiling.count_blocks,
+                              impl->profiling.count_branches,
+                              impl->profiling.sampled,
+                              impl->fuse_insts,
+                              impl->fold_pc_relative_operands,
+                              impl->lazy_prologue,
+                              impl->chain_indirect_jumps,
+                              impl->inline_target_caches,
+                              impl->native_call_returns,
+                              impl->split_cold_exits};
+  return llvm::xxHash64(llvm::ArrayRef<uint8_t>(
+      reinterpret_cast<const uint8_t *>(options), sizeof(options)));
+}
+
+// Reads the bytes of an instruction at `addr` into `inst_bytes`.
+bool TraceLifter::Impl::ReadInstructionBytes(uint64_t addr) {
+  StatisticsTimer timer(Timer(&LiftStatistics::read_seconds));
+
+  inst_bytes = {};
+  if (addr > addr_mask) {
+    return false;  // Address is out of range.
+  }
+
+  // Don't read past the end of the address space, i.e. avoid a 32- or 64-bit
+  // address overflow.
+  const auto max_readable = addr_mask - addr;
+  const auto size =
+      max_readable < max_inst_bytes ? max_readable + 1 : max_inst_bytes;
+
+  inst_bytes = manager.TryReadExecutableBytes(addr, size, inst_bytes_buffer);
+  if (inst_bytes.size() > size) {
+    inst_bytes = inst_bytes.substr(0, size);
+  }
+
+  if (inst_bytes.size() < size) {
+    DLOG(WARNING) << "Couldn't read executable byte at " << std::hex
+                  << (addr + inst_bytes.size()) << std::dec;
+  }
+
+  if (stats) {
+    stats->num_bytes_read += inst_bytes.size();
+  }
+
+  return !inst_bytes.empty();
+}
+
+// Decodes the instruction at `addr` from `inst_bytes` into `into`.
+void TraceLifter::Impl::DecodeInstruction(uint64_t addr, Instruction &into) {
+  StatisticsTimer timer(Timer(&LiftStatistics::decode_seconds));
+  StatisticsAllocationScope allocs(
+      Counter(&LiftStatistics::decode_alloc_bytes),
+      Counter(&LiftStatistics::decode_allocs));
+  if (cache && cache->TryGetInstruction(arch, addr, inst_bytes, into)) {
+    if (stats) {
+      stats->num_cached_insts += 1;
+    }
+    return;
+  }
+
+  if (lookahead && lookahead->TryTake(addr, inst_bytes, into)) {
+    if (cache) {
+      cache->AddInstruction(arch, addr, into);
+    }
+    if (stats) {
+      stats->num_lookahead_insts += 1;
+    }
+    return;
+  }
+
+  const auto decoded = arch->DecodeInstruction(addr, inst_bytes, into);
+  if (decoded && cache) {
+    cache->AddInstruction(arch, addr, into);
+  }
+
+  if (stats) {
+    stats->num_decoded_insts += 1;
+    stats->num_invalid_insts += !decoded;
+  }
+}
+
+// Decodes the instruction in the delay slot of `inst`. Delayed instructions
+// are decoded differently than other instructions, and so they are memoized
+// here rather than in `cache`.
+bool TraceLifter::Impl::DecodeDelayedInstruction(void) {
+  StatisticsTimer timer(Timer(&LiftStatistics::decode_seconds));
+  const auto addr = inst.delayed_pc;
+  if (auto it = delayed_insts.find(addr); it != delayed_insts.end()) {
+    const auto &bytes = it->second.bytes;
+    if (bytes.size() <= inst_bytes.size() &&
+        inst_bytes.substr(0, bytes.size()) == bytes) {
+      delayed_inst = it->second;
+      if (stats) {
+        stats->num_cached_insts += 1;
+      }
+      return true;
+    }
+  }
+
+  delayed_inst.Reset();
+  const auto decoded =
+      arch->DecodeDelayedInstruction(addr, inst_bytes, delayed_inst);
+  if (decoded) {
+    delayed_insts[addr] = delayed_inst;
+  }
+  if (stats) {
+    stats->num_decoded_insts += 1;
+    stats->num_invalid_insts += !decoded;
+  }
+  return decoded;
+}
+
+// Tries to fuse `inst` with the instruction that follows it. The following
+// instruction isn't looked up in, or added to, `cache`, as a fused instruction
+// only replaces it on this path.
+void TraceLifter::Impl::TryFuseWithNextInstruction(void) {
+  if (!arch->MayFuseWithNextInstruction(inst) ||
+      !ReadInstructionBytes(inst.next_pc)) {
+    return;
+  }
+
+  fused_inst.Reset();
+  {
+    StatisticsTimer timer(Timer(&LiftStatistics::decode_seconds));
+    StatisticsAllocationScope allocs(
+        Counter(&LiftStatistics::decode_alloc_bytes),
+        Counter(&LiftStatistics::decode_allocs));
+    if (!arch->DecodeInstruction(inst.next_pc, inst_bytes, fused_inst)) {
+      return;
+    }
+  }
+
+  if (arch->FuseWithNextInstruction(inst, fused_inst) && stats) {
+    stats->num_fused_insts += 1;
+  }
+}
+
+// Lifts the run of instructions after the predicated instruction `inst` that
+// share its predicate, e.g. a run of AArch32 instructions with the same
+// condition code, under a single branch on the `BRANCH_TAKEN` of `inst`. The
+// instructions of the run are lifted with their predicate replaced by `true`,
+// so that once the semantics are inlined, their own conditional code folds
+// away. This only works if the predicate reads the same values throughout the
+// run, and so `inst` must not write to the registers that the predicate
+// reads, and the run ends at the first instruction that might. The run also
+// ends at any instruction that is the target of a branch or a trace head, as
+// those need to be lifted into blocks of their own.
+bool TraceLifter::Impl::LiftPredicatedRun(void) {
+  if (!arch->IsPredicated(inst)) {
+    return false;
+  }
+
+  predicate_regs.clear();
+  if (!CollectRegisters(arch, inst.operands[0].expr, predicate_regs)) {
+    return false;
+  }
+
+  const auto inst_lifter_impl = inst_lifter.impl.get();
+  auto may_write_predicate = [&](Instruction &pred_inst) {
+    for (auto reg : predicate_regs) {
+      if (inst_lifter_impl->MayWriteRegister(pred_inst, reg)) {
+        return true;
+      }
+    }
+    return false;
+  };
+
+  if (may_write_predicate(inst)) {
+    return false;
+  }
+
+  // Decode the run.
+  const auto predicate = inst.operands[0].Serialize();
+  const auto true_val = llvm::ConstantInt::get(llvm::Type::getInt8Ty(context),
+                                               1u, false);
+  predicated_insts.clear();
+  for (auto pc = inst.next_pc;
+       predicated_insts.size() < kMaxPredicatedRunLength;) {
+    if (blocks.Find(pc) || trace_work_list.count(pc) ||
+        GetLiftedTraceDeclaration(pc) ||
+        (limits.max_instructions &&
+         (num_trace_insts + predicated_insts.size()) >=
+             limits.max_instructions) ||
+        !ReadInstructionBytes(pc)) {
+      break;
+    }
+
+    auto &next_inst = predicated_insts.emplace_back();
+    DecodeInstruction(pc, next_inst);
+    if (!next_inst.IsValid() ||
+        (Instruction::kCategoryNormal != next_inst.category &&
+         Instruction::kCategoryNoOp != next_inst.category) ||
+        arch->MayHaveDelaySlot(next_inst) || !arch->IsPredicated(next_inst) ||
+        next_inst.operands[0].Serialize() != predicate) {
+      predicated_insts.pop_back();
+      break;
+    }
+
+    next_inst.operands[0].expr = next_inst.EmplaceConstant(true_val);
+    if (fold_pc_relative_operands) {
+      FoldPCRelativeOperands(next_inst);
+    }
+    pc = next_inst.next_pc;
+    if (may_write_predicate(next_inst)) {
+      break;
+    }
+  }
+
+  if (predicated_insts.empty()) {
+    return false;
+  }
+
+  const auto after_pc = predicated_insts.back().next_pc;
+  inst_work_list.insert(after_pc);
+  const auto after_block = GetOrCreateBlock(after_pc);
+
+  // The predicate of `inst` was false; skip over the run.
+  const auto skip_block = llvm::BasicBlock::Create(context, "", func);
+  StoreNextProgramCounter(skip_block,
+                          llvm::ConstantInt::get(inst_lifter_impl->word_type,
+                                                 after_pc, false));
+  llvm::BranchInst::Create(after_block, skip_block);
+
+  const auto run_block = llvm::BasicBlock::Create(context, "", func);
+  llvm::BranchInst::Create(run_block, skip_block, LoadBranchTaken(block),
+                           block);
+
+  const auto state_ptr = NthArgument(func, kStatePointerArgNum);
+
+  for (auto &run_inst : predicated_insts) {
+    ++num_trace_insts;
+    trace_insts.emplace_back(run_inst.pc, run_inst.bytes.size());
+
+    auto lift_status = kLiftedLifterError;
+    {
+      StatisticsTimer timer(Timer(&LiftStatistics::lift_seconds));
+      lift_status = inst_lifter.LiftIntoBlock(run_inst, run_block, state_ptr);
+    }
+    if (stats) {
+      stats->num_lifted_insts += 1;
+      stats->num_failed_lifts += kLiftedInstruction != lift_status;
+    }
+    if (kLiftedInstruction != lift_status) {
+      AddTerminatingTailCall(run_block, intrinsics->error);
+      return true;
+    }
+  }
+
+  llvm::BranchInst::Create(after_block, run_block);
+  return true;
+}
+
+// Look up the trace at the next program counter of `from_block`, first in the
+// inline target cache of this site, if enabled, and then in the trace table.
+// This is the same probe that a dynamic binary translator does of its indirect
+// branch target cache. Branches to the returned block, in which `trace` is the
+// found trace, or to `miss_block` if there is no such trace.
+llvm::BasicBlock *
+TraceLifter::Impl::AddTraceLookup(llvm::BasicBlock *from_block,
+                                  llvm::BasicBlock *miss_block,
+                                  llvm::Value *&trace) {
+  llvm::IRBuilder<> ir(from_block);
+  const auto i64_type = ir.getInt64Ty();
+  const auto entry_type =
+      llvm::StructType::get(context, {i64_type, func->getType()});
+  const auto entry_ptr_type = llvm::PointerType::get(entry_type, 0);
+  const auto table_type =
+      llvm::ArrayType::get(entry_type, kNumTraceTableEntries);
+  const auto table = module->getOrInsertGlobal(kTraceTableName, table_type);
+
+  const auto pc = ir.CreateZExtOrTrunc(LoadNextProgramCounter(from_block),
+                                       i64_type);
+  const auto hit_block = llvm::BasicBlock::Create(context, "", func);
+  const auto hit_entry =
+      llvm::PHINode::Create(entry_ptr_type, 3, "", hit_block);
+
+  // Returns `true` if `entry` is the entry of the trace at `pc`.
+  auto entry_matches = [&](llvm::Value *entry, bool acquire) {
+    llvm::Value *indexes[] = {ir.getInt32(0), ir.getInt32(0)};
+    const auto entry_pc = ir.CreateLoad(
+        i64_type, ir.CreateInBoundsGEP(entry_type, entry, indexes));
+    if (acquire) {
+      entry_pc->setAtomic(llvm::AtomicOrdering::Acquire);
+      SetAlignment(entry_pc, 8);
+    }
+    return ir.CreateICmpEQ(entry_pc, pc);
+  };
+
+  // The inline cache of this site holds pointers to the (never replaced)
+  // entries of the two most recently found traces, most recent first.
+  llvm::GlobalVariable *site = nullptr;
+  llvm::Value *site_slots[2] = {};
+  llvm::Value *site_entries[2] = {};
+  if (inline_target_caches) {
+    const auto sentinel = GetTraceTableSentinel(entry_type);
+    const auto site_type = llvm::ArrayType::get(entry_ptr_type, 2);
+    site = new llvm::GlobalVariable(
+        *module, site_type, false, llvm::GlobalValue::PrivateLinkage,
+        llvm::ConstantArray::get(site_type, {sentinel, sentinel}));
+
+    for (auto i = 0u; i < 2u; ++i) {
+      llvm::Value *indexes[] = {ir.getInt32(0), ir.getInt32(i)};
+      site_slots[i] = ir.CreateInBoundsGEP(site_type, site, indexes);
+      const auto entry = ir.CreateLoad(entry_ptr_type, site_slots[i]);
+      entry->setAtomic(llvm::AtomicOrdering::Acquire);
+      SetAlignment(entry, sizeof(void *));
+      site_entries[i] = entry;
+
+      const auto next_block = llvm::BasicBlock::Create(context, "", func);
+      ir.CreateCondBr(entry_matches(entry, false), hit_block, next_block);
+      hit_entry->addIncoming(entry, ir.GetInsertBlock());
+      ir.SetInsertPoint(next_block);
+    }
+  }
+
+  const auto index = ir.CreateAnd(ir.CreateXor(pc, ir.CreateLShr(pc, 2)),
+                                  kNumTraceTableEntries - 1);
+  llvm::Value *indexes[] = {ir.getInt64(0), index};
+  const auto entry = ir.CreateInBoundsGEP(table_type, table, indexes);
+  if (!inline_target_caches) {
+    ir.CreateCondBr(entry_matches(entry, true), hit_block, miss_block);
+    hit_entry->addIncoming(entry, ir.GetInsertBlock());
+
+  // Make the found entry the most recent one of this site.
+  } else {
+    const auto found_block = llvm::BasicBlock::Create(context, "", func);
+    ir.CreateCondBr(entry_matches(entry, true), found_block, miss_block);
+    ir.SetInsertPoint(found_block);
+    const auto older = ir.CreateStore(site_entries[0], site_slots[1]);
+    const auto newer = ir.CreateStore(entry, site_slots[0]);
+    for (auto store : {older, newer}) {
+      store->setAtomic(llvm::AtomicOrdering::Release);
+      SetAlignment(store, sizeof(void *));
+    }
+    ir.CreateBr(hit_block);
+    hit_entry->addIncoming(entry, found_block);
+  }
+
+  ir.SetInsertPoint(hit_block);
+  llvm::Value *trace_indexes[] = {ir.getInt32(0), ir.getInt32(1)};
+  trace = ir.CreateLoad(
+      func->getType(),
+      ir.CreateInBoundsGEP(entry_type, hit_entry, trace_indexes));
+  return hit_block;
+}
+
+// Returns the unused trace table entry that the inline target caches of
+// `module` start off pointing to.
+llvm::Constant *
+TraceLifter::Impl::GetTraceTableSentinel(llvm::StructType *entry_type) {
+  static constexpr auto kSentinelName = "__remill_trace_table_sentinel";
+  if (auto sentinel = module->getGlobalVariable(kSentinelName, true)) {
+    return sentinel;
+  }
+  const auto i64_type = llvm::Type::getInt64Ty(context);
+  return new llvm::GlobalVariable(
+      *module, entry_type, true, llvm::GlobalValue::PrivateLinkage,
+      llvm::ConstantStruct::get(
+          entry_type,
+          {llvm::ConstantInt::get(i64_type, kEmptyTraceTableEntry),
+           llvm::Constant::getNullValue(func->getType())}),
+      kSentinelName);
+}
+
+// Terminate `from_block` with a jump to the next program counter, by way of
+// the trace table if indirect jumps are chained.
+void TraceLifter::Impl::AddUnknownIndirectJump(llvm::BasicBlock *from_block) {
+  if (!chain_indirect_jumps && !inline_target_caches) {
+    AddTerminatingTailCall(from_block, intrinsics->jump);
+    return;
+  }
+
+  const auto miss_block = llvm::BasicBlock::Create(context, "", func);
+  AddTerminatingTailCall(miss_block, intrinsics->jump);
+
+  llvm::Value *trace = nullptr;
+  const auto hit_block = AddTraceLookup(from_block, miss_block, trace);
+  AddTerminatingTailCall(hit_block, trace);
+}
+
+// Call the function at the next program counter of `from_block`, by way of
+// the inline target cache of this site if enabled. Returns the block that
+// follows the call.
+llvm::BasicBlock *
+TraceLifter::Impl::AddIndirectFunctionCall(llvm::BasicBlock *from_block) {
+  if (!inline_target_caches) {
+    AddCall(from_block, intrinsics->function_call);
+    return from_block;
+  }
+
+  const auto miss_block = llvm::BasicBlock::Create(context, "", func);
+  const auto after_block = llvm::BasicBlock::Create(context, "", func);
+  AddCall(miss_block, intrinsics->function_call);
+  llvm::BranchInst::Create(after_block, miss_block);
+
+  llvm::Value *trace = nullptr;
+  const auto hit_block = AddTraceLookup(from_block, miss_block, trace);
+  llvm::IRBuilder<> ir(hit_block);
+  ir.CreateStore(LoadNextProgramCounter(hit_block),
+                 LoadProgramCounterRef(hit_block));
+  AddCall(hit_block, trace);
+  llvm::BranchInst::Create(after_block, AddReturnCheck(hit_block));
+  return after_block;
+}
+
+// Make sure that the lifted function called by `block` returned to the return
+// address, and tail-call `__remill_jump` if it didn't. This is what lets
+// traces lifted with inline target caches, or standard functions lifted with
+// native call returns, return directly to their caller. Returns the block
+// into which lifting continues.
+llvm::BasicBlock *TraceLifter::Impl::AddReturnCheck(llvm::BasicBlock *block) {
+  llvm::IRBuilder<> ir(block);
+  const auto pc = LoadProgramCounter(block);
+  const auto ret_pc =
+      ir.CreateLoad(pc->getType(), LoadReturnProgramCounterRef(block));
+  const auto returned_block = llvm::BasicBlock::Create(context, "", func);
+  const auto unexpected_ret_pc = llvm::BasicBlock::Create(context, "", func);
+  ir.CreateCondBr(ir.CreateICmpEQ(pc, ret_pc), returned_block,
+                  unexpected_ret_pc);
+
+  ir.SetInsertPoint(unexpected_ret_pc);
+  ir.CreateStore(pc, LoadNextProgramCounterRef(unexpected_ret_pc));
+  AddTerminatingTailCall(unexpected_ret_pc, intrinsics->jump);
+  return returned_block;
+}
+
+// Returns `true` if the trace at `target_pc`, called by a direct call,
+// returns straight back to its caller.
+bool TraceLifter::Impl::ReturnsToCaller(uint64_t target_pc) {
+  return inline_target_caches ||
+         (native_call_returns && manager.IsStandardFunction(target_pc));
+}
+
+// Terminate `block` with a function return. With inline target caches, or in
+// a standard function lifted with native call returns, the return goes
+// straight back to the caller, which checks the returned-to program counter
+// (see `AddReturnCheck`). The native stack of the lifted code thus acts as a
+// shadow stack of return addresses.
+void TraceLifter::Impl::AddFunctionReturn(llvm::BasicBlock *block) {
+  if (!native_returns) {
+    AddTerminatingTailCall(block, intrinsics->function_return);
+    return;
   }
 
-  llvm::BasicBlock *GetOrCreateBranchTakenBlock(void) {
-    inst_work_list.insert(inst.branch_taken_pc);
-    return GetOrCreateBlock(inst.branch_taken_pc);
+  llvm::IRBuilder<> ir(block);
+  ir.CreateStore(LoadNextProgramCounter(block), LoadProgramCounterRef(block));
+  ir.CreateRet(LoadMemoryPointer(block));
+}
+
+// Attach the profiled branch weights of `inst` to the conditional branch
+// `br`, if the trace manager has them.
+void TraceLifter::Impl::AddBranchWeights(llvm::BranchInst *br) {
+  uint64_t taken = 0;
+  uint64_t not_taken = 0;
+  if (!manager.TryGetBranchCounts(inst.pc, &taken, &not_taken)) {
+    return;
   }
 
-  llvm::BasicBlock *GetOrCreateBranchNotTakenBlock(void) {
-    CHECK(inst.branch_not_taken_pc != 0);
-    inst_work_list.insert(inst.branch_not_taken_pc);
-    return GetOrCreateBlock(inst.branch_not_taken_pc);
+  // Branch weights are 32 bits; keep the ratio of bigger counts.
+  while ((taken | not_taken) >> 32) {
+    taken >>= 1;
+    not_taken >>= 1;
   }
 
-  llvm::BasicBlock *GetOrCreateNextBlock(void) {
-    inst_work_list.insert(inst.next_pc);
-    return GetOrCreateBlock(inst.next_pc);
+  llvm::MDBuilder md(context);
+  br->setMetadata(llvm::LLVMContext::MD_prof,
+                  md.createBranchWeights(static_cast<uint32_t>(taken),
+                                         static_cast<uint32_t>(not_taken)));
+}
+
+// Terminate `block` with a branch on the `BRANCH_TAKEN` of `inst`, counting
+// its edges if enabled.
+llvm::BranchInst *
+TraceLifter::Impl::AddConditionalBranch(llvm::BasicBlock *taken_block,
+                                        llvm::BasicBlock *not_taken_block,
+                                        llvm::BasicBlock *block) {
+  const auto cond = LoadBranchTaken(block);
+  if (profiling.count_branches) {
+    llvm::IRBuilder<> ir(block);
+    AddCounter(ir, inst.pc, kProfileBranchTakenCounter, cond);
+    AddCounter(ir, inst.pc, kProfileBranchNotTakenCounter, ir.CreateNot(cond));
   }
+  const auto br =
+      llvm::BranchInst::Create(taken_block, not_taken_block, cond, block);
+  AddBranchWeights(br);
+  return br;
+}
 
-  uint64_t PopTraceAddress(void) {
-    auto trace_it = trace_work_list.begin();
-    const auto trace_addr = *trace_it;
-    trace_work_list.erase(trace_it);
-    return trace_addr;
+// Add one (or the sampling byte) to a new counter of the `kind` of `pc`, if
+// `when` is null or true. The counter is addressed relative to a placeholder,
+// as the size of the array of counts is only known once the trace is lifted.
+void TraceLifter::Impl::AddCounter(llvm::IRBuilder<> &ir, uint64_t pc,
+                                   ProfileCounterKind kind, llvm::Value *when) {
+  const auto i64_type = ir.getInt64Ty();
+  if (!counts_placeholder) {
+    counts_placeholder = new llvm::GlobalVariable(
+        *module, i64_type, false, llvm::GlobalValue::PrivateLinkage,
+        ir.getInt64(0));
   }
 
-  uint64_t PopInstructionAddress(void) {
-    auto inst_it = inst_work_list.begin();
-    const auto inst_addr = *inst_it;
-    inst_work_list.erase(inst_it);
-    return inst_addr;
+  const auto index = counter_pcs.size();
+  counter_pcs.push_back(pc);
+  counter_kinds.push_back(kind);
+
+  llvm::Value *amount = ir.getInt64(1);
+  if (profiling.sampled) {
+    const auto i8_type = ir.getInt8Ty();
+    amount = ir.CreateZExt(
+        ir.CreateLoad(i8_type,
+                      module->getOrInsertGlobal(kProfileSamplingName, i8_type)),
+        i64_type);
+  }
+  if (when) {
+    amount = ir.CreateSelect(when, amount, ir.getInt64(0));
   }
 
-  const Arch *const arch;
-  InstructionLifter &inst_lifter;
-  const remill::IntrinsicTable *intrinsics;
-  llvm::LLVMContext &context;
-  llvm::Module *const module;
-  const uint64_t addr_mask;
-  TraceManager &manager;
+  const auto count_ptr =
+      ir.CreateConstGEP1_64(i64_type, counts_placeholder, index);
+  ir.CreateStore(ir.CreateAdd(ir.CreateLoad(i64_type, count_ptr), amount),
+                 count_ptr);
+}
 
-  llvm::Function *func;
-  llvm::BasicBlock *block;
-  llvm::SwitchInst *switch_inst;
-  const size_t max_inst_bytes;
-  std::string inst_bytes;
-  Instruction inst;
-  Instruction delayed_inst;
-  DecoderWorkList trace_work_list;
-  DecoderWorkList inst_work_list;
-  std::map<uint64_t, llvm::BasicBlock *> blocks;
-};
+// A `SAVE` keeps the caller's register window in the `WINDOW` variable of
+// `func`, and a `RESTORE` in `func` takes it back from there, so neither
+// touches memory. A window that is still held when `func` tail-calls another
+// trace, or returns, is spilled to the stack by `SPILL_WINDOW`, so that the
+// `RESTORE` of another trace finds it there.
+void TraceLifter::Impl::SpillRegisterWindows(void) {
+  const auto prev_window = FindVarInFunction(func, "PREV_WINDOW", true);
+  const auto spill = inst_lifter.impl->GetInstructionFunction("SPILL_WINDOW");
+  if (!prev_window || !spill ||
+      spill->getFunctionType()->getNumParams() != 3) {
+    return;
+  }
 
-TraceLifter::Impl::Impl(InstructionLifter *inst_lifter_, TraceManager *manager_)
-    : arch(inst_lifter_->impl->arch),
-      inst_lifter(*inst_lifter_),
-      intrinsics(inst_lifter.impl->intrinsics),
-      context(inst_lifter.impl->word_type->getContext()),
-      module(intrinsics->async_hyper_call->getParent()),
-      addr_mask(arch->address_size >= 64 ? ~0ULL
-                                         : (~0ULL >> arch->address_size)),
-      manager(*manager_),
-      func(nullptr),
-      block(nullptr),
-      switch_inst(nullptr),
-      max_inst_bytes(arch->MaxInstructionSize()) {
+  std::vector<llvm::ReturnInst *> rets;
+  for (auto &block : *func) {
+    if (auto ret = llvm::dyn_cast<llvm::ReturnInst>(block.getTerminator())) {
+      rets.push_back(ret);
+    }
+  }
 
-  inst_bytes.reserve(max_inst_bytes);
+  const auto state_ptr = NthArgument(func, kStatePointerArgNum);
+  for (auto ret : rets) {
+    auto memory = ret->getReturnValue();
+    auto tail_call = llvm::dyn_cast<llvm::CallInst>(memory);
+
+    // Spill before the tail-call, and pass it the new memory pointer.
+    if (tail_call && tail_call->getParent() == ret->getParent()) {
+      llvm::IRBuilder<> ir(tail_call);
+      auto &mem_arg = tail_call->getArgOperandUse(kMemoryPointerArgNum);
+      mem_arg.set(ir.CreateCall(spill, {mem_arg.get(), state_ptr,
+                                        prev_window}));
+
+    } else {
+      llvm::IRBuilder<> ir(ret);
+      ret->setOperand(0, ir.CreateCall(spill, {memory, state_ptr,
+                                               prev_window}));
+    }
+  }
 }
 
-// Return an already lifted trace starting with the code at address
-// `addr`.
-llvm::Function *TraceLifter::Impl::GetLiftedTraceDeclaration(uint64_t addr) {
-  auto func = manager.GetLiftedTraceDeclaration(addr);
-  if (!func || func->getParent() == module) {
-    return func;
+// Count the executions of each block of instructions of `func`, at the block
+// of its first instruction. That is the first instruction of the trace, and
+// any instruction that isn't only reached by falling through from the one
+// before it. Blocks that tail-call other traces aren't counted, as those
+// traces count their own blocks.
+void TraceLifter::Impl::InstrumentBlocks(uint64_t trace_addr) {
+  profiled_blocks.clear();
+  for (auto [inst_pc, inst_size] : trace_insts) {
+    (void) inst_size;
+    const auto inst_block = blocks.Find(inst_pc);
+    if (!inst_block) {
+      continue;  // E.g. a delay slot, or within a predicated run.
+    }
+    auto is_leader = inst_pc == trace_addr;
+    if (!is_leader) {
+      const auto pred = inst_block->getSinglePredecessor();
+      const auto br =
+          pred ? llvm::dyn_cast<llvm::BranchInst>(pred->getTerminator())
+               : nullptr;
+      is_leader = !br || br->isConditional();
+    }
+    if (is_leader) {
+      profiled_blocks.emplace_back(inst_pc, 0, inst_block);
+    }
   }
 
-  return nullptr;
+  // Allocate the counters in address order.
+  std::sort(profiled_blocks.begin(), profiled_blocks.end(),
+            [](const auto &a, const auto &b) {
+              return std::get<0>(a) < std::get<0>(b);
+            });
+  for (auto [block_pc, unused, leader_block] : profiled_blocks) {
+    (void) unused;
+    llvm::IRBuilder<> ir(leader_block, leader_block->getFirstInsertionPt());
+    AddCounter(ir, block_pc, kProfileBlockCounter);
+  }
 }
 
-// Return an already lifted trace starting with the code at address
-// `addr`.
-llvm::Function *TraceLifter::Impl::GetLiftedTraceDefinition(uint64_t addr) {
-  auto func = manager.GetLiftedTraceDefinition(addr);
-  if (!func || func->getParent() == module) {
-    return func;
+// Define the `ProfileCounters` of `func`, if it has any counters, and point
+// the counters at it. The counters are private until the trace reaches the
+// module in which it will stay, so that they move along with it.
+void TraceLifter::Impl::FinishProfiling(uint64_t trace_addr) {
+  if (!counts_placeholder) {
+    return;
   }
 
-  CHECK_EQ(&(func->getContext()), &context);
-
-  auto func_type = llvm::dyn_cast<llvm::FunctionType>(
-      RecontextualizeType(func->getFunctionType(), context));
+  const auto num_counters = counter_pcs.size();
+  const auto i64_type = llvm::Type::getInt64Ty(context);
+  const auto i8_type = llvm::Type::getInt8Ty(context);
+  const auto counts_type = llvm::ArrayType::get(i64_type, num_counters);
+  const auto pcs_type = llvm::ArrayType::get(i64_type, num_counters);
+  const auto kinds_type = llvm::ArrayType::get(i8_type, num_counters);
+  const auto counters_type = llvm::StructType::get(
+      context, {i64_type, i64_type, counts_type, pcs_type, kinds_type});
+
+  std::vector<uint8_t> kinds(counter_kinds.begin(), counter_kinds.end());
+  const auto counters = new llvm::GlobalVariable(
+      *module, counters_type, false, llvm::GlobalValue::PrivateLinkage,
+      llvm::ConstantStruct::get(
+          counters_type,
+          {llvm::ConstantInt::get(i64_type, trace_addr),
+           llvm::ConstantInt::get(i64_type, num_counters),
+           llvm::ConstantAggregateZero::get(counts_type),
+           llvm::ConstantDataArray::get(context, counter_pcs),
+           llvm::ConstantDataArray::get(context, kinds)}),
+      ProfileCountersName(func->getName().str()));
+  SetAlignment(counters, 8);
+
+  llvm::Constant *indexes[] = {
+      llvm::ConstantInt::get(i64_type, 0),
+      llvm::ConstantInt::get(llvm::Type::getInt32Ty(context), 2),
+      llvm::ConstantInt::get(i64_type, 0)};
+  const auto counts = llvm::ConstantExpr::getInBoundsGetElementPtr(
+      counters_type, counters, indexes);
+  counts_placeholder->replaceAllUsesWith(
+      llvm::ConstantExpr::getBitCast(counts, counts_placeholder->getType()));
+  counts_placeholder->eraseFromParent();
+  counts_placeholder = nullptr;
+}
 
-  // Handle the different module situation by declaring the trace in
-  // this module to be external, with the idea that it will link to
-  // another module.
-  auto extern_func = module->getFunction(func->getName());
-  if (!extern_func || extern_func->getFunctionType() != func_type) {
-    extern_func = llvm::Function::Create(
-        func_type, llvm::GlobalValue::ExternalLinkage, func->getName(), module);
+// Give the instructions of `func` that don't have a debug location, e.g. the
+// branches and tail-calls added around the lifted instructions, one at line 0
+// of its subprogram, if it has guest PC debug locations. Calls to other
+// traces need a location for them to be inlined.
+static void AddMissingDebugLocations(llvm::Function *func) {
+  const auto sp = func->getSubprogram();
+  if (!sp) {
+    return;
+  }
+  const llvm::DebugLoc loc =
+      llvm::DILocation::get(func->getContext(), 0, 0, sp);
+  for (auto &block : *func) {
+    for (auto &inst : block) {
+      if (!inst.getDebugLoc()) {
+        inst.setDebugLoc(loc);
+      }
+    }
+  }
+}
 
-  } else if (extern_func->isDeclaration()) {
-    extern_func->setLinkage(llvm::GlobalValue::ExternalLinkage);
+// Mark the calls in `block` as cold.
+static void MarkCallsCold(llvm::BasicBlock *block) {
+  for (auto &block_inst : *block) {
+    if (auto call = llvm::dyn_cast<llvm::CallInst>(&block_inst)) {
+#if LLVM_VERSION_NUMBER >= LLVM_VERSION(14, 0)
+      call->addFnAttr(llvm::Attribute::Cold);
+#else
+      call->addAttribute(llvm::AttributeList::FunctionIndex,
+                         llvm::Attribute::Cold);
+#endif
+    }
   }
+}
 
-  return extern_func;
+// Order the blocks of `func` hot-first by their profiled counts, so that the
+// hot paths of the trace are laid out together, and move the blocks that the
+// profile says never ran to the end of `func`. The calls in those blocks are
+// marked as cold, which also makes LLVM treat the branches into them as
+// unlikely, and keeps them from being inlined into code that never runs.
+void TraceLifter::Impl::LayOutBlocks(void) {
+  profiled_blocks.clear();
+  blocks.ForEach([this](uint64_t block_pc, llvm::BasicBlock *block) {
+    uint64_t count = 0;
+    if (manager.TryGetBlockCount(block_pc, &count)) {
+      profiled_blocks.emplace_back(count, block_pc, block);
+    }
+  });
+
+  // Hottest first, and then by address, so that the layout is deterministic.
+  std::sort(profiled_blocks.begin(), profiled_blocks.end(),
+            [](const auto &a, const auto &b) {
+              return std::get<0>(a) > std::get<0>(b) ||
+                     (std::get<0>(a) == std::get<0>(b) &&
+                      std::get<1>(a) < std::get<1>(b));
+            });
+
+  auto prev_block = &(func->getEntryBlock());
+  for (auto [count, block_pc, block] : profiled_blocks) {
+    (void) block_pc;
+    if (count) {
+      block->moveAfter(prev_block);
+      prev_block = block;
+      continue;
+    }
+
+    block->moveAfter(&(func->back()));
+    MarkCallsCold(block);
+  }
 }
 
-TraceLifter::~TraceLifter(void) {}
+// Move the blocks of `func` that end by tail-calling `__remill_error` (e.g.
+// after an invalid or unsupported instruction) or `__remill_missing_block`,
+// and the blocks that can only reach them, to the end of `func`. Their calls
+// are marked as cold, and the conditional branches and switches into them
+// are weighted as unlikely, so that the hot paths of the trace are laid out
+// together, and are optimized ahead of the exits.
+void TraceLifter::Impl::SplitColdExits(void) {
+  std::unordered_set<llvm::BasicBlock *> cold_blocks;
+  for (auto &block : *func) {
+    auto ret = llvm::dyn_cast<llvm::ReturnInst>(block.getTerminator());
+    auto call = ret ? llvm::dyn_cast_or_null<llvm::CallInst>(
+                          ret->getReturnValue())
+                    : nullptr;
+    if (call && (call->getCalledFunction() == intrinsics->error ||
+                 call->getCalledFunction() == intrinsics->missing_block)) {
+      cold_blocks.insert(&block);
+    }
+  }
 
-TraceLifter::TraceLifter(InstructionLifter *inst_lifter_,
-                         TraceManager *manager_)
-    : impl(new Impl(inst_lifter_, manager_)) {}
+  // Blocks that unconditionally branch to a cold block are also cold.
+  for (auto changed = !cold_blocks.empty(); changed;) {
+    changed = false;
+    for (auto &block : *func) {
+      auto br = llvm::dyn_cast<llvm::BranchInst>(block.getTerminator());
+      if (br && br->isUnconditional() &&
+          cold_blocks.count(br->getSuccessor(0)) &&
+          &block != &(func->getEntryBlock()) &&
+          cold_blocks.insert(&block).second) {
+        changed = true;
+      }
+    }
+  }
 
-void TraceLifter::NullCallback(uint64_t, llvm::Function *) {}
+  if (cold_blocks.empty()) {
+    return;
+  }
 
-// Reads the bytes of an instruction at `addr` into `inst_bytes`.
-bool TraceLifter::Impl::ReadInstructionBytes(uint64_t addr) {
-  inst_bytes.clear();
-  for (size_t i = 0; i < max_inst_bytes; ++i) {
-    const auto byte_addr = (addr + i) & addr_mask;
-    if (byte_addr < addr) {
-      break;  // 32- or 64-bit address overflow.
+  // Weight the edges into cold blocks like `__builtin_expect` does. Weights
+  // from the profile (see `AddBranchWeights`) are kept.
+  const uint32_t kHotWeight = 2000;
+  const uint32_t kColdWeight = 1;
+  llvm::MDBuilder md(context);
+  for (auto &block : *func) {
+    const auto term = block.getTerminator();
+    if (cold_blocks.count(&block) || term->getNumSuccessors() < 2 ||
+        term->getMetadata(llvm::LLVMContext::MD_prof)) {
+      continue;
     }
-    uint8_t byte = 0;
-    if (!manager.TryReadExecutableByte(byte_addr, &byte)) {
-      DLOG(WARNING) << "Couldn't read executable byte at " << std::hex
-                    << byte_addr << std::dec;
-      break;
+
+    std::vector<uint32_t> weights;
+    auto num_cold = 0u;
+    for (auto i = 0u; i < term->getNumSuccessors(); ++i) {
+      if (cold_blocks.count(term->getSuccessor(i))) {
+        weights.push_back(kColdWeight);
+        num_cold += 1;
+      } else {
+        weights.push_back(kHotWeight);
+      }
+    }
+    if (num_cold && num_cold < weights.size() &&
+        (llvm::isa<llvm::BranchInst>(term) ||
+         llvm::isa<llvm::SwitchInst>(term))) {
+      term->setMetadata(llvm::LLVMContext::MD_prof,
+                        md.createBranchWeights(weights));
     }
-    inst_bytes.push_back(static_cast<char>(byte));
   }
-  return !inst_bytes.empty();
+
+  // Keep the cold blocks in their original order at the end of `func`.
+  std::vector<llvm::BasicBlock *> ordered_cold_blocks;
+  for (auto &block : *func) {
+    if (cold_blocks.count(&block)) {
+      ordered_cold_blocks.push_back(&block);
+    }
+  }
+  for (auto block : ordered_cold_blocks) {
+    block->moveAfter(&(func->back()));
+    MarkCallsCold(block);
+  }
 }
 
 // Lift one or more traces starting from `addr`.
 bool TraceLifter::Lift(
     uint64_t addr, std::function<void(uint64_t, llvm::Function *)> callback) {
-  return impl->Lift(addr, callback);
+  return impl->Lift(addr, callback, nullptr);
+}
+
+// Lift one or more traces starting from `addr`, releasing each one as soon
+// as it is lifted.
+bool TraceLifter::LiftStreaming(
+    uint64_t addr, TraceModuleCallback release,
+    std::function<void(uint64_t, llvm::Function *)> callback) {
+  return impl->Lift(addr, callback, &release);
+}
+
+// Move the lifted trace `func` into its own module, and hand that module
+// off to `release`.
+llvm::Function *
+TraceLifter::Impl::ReleaseTrace(uint64_t addr,
+                                const TraceModuleCallback &release) {
+  const auto func_name = func->getName().str();
+
+  // The trace will be referenced across modules, both by the declaration
+  // left behind in `module`, and by other released traces.
+  func->setLinkage(llvm::GlobalValue::ExternalLinkage);
+
+  std::unique_ptr<llvm::Module> trace_module(
+      new llvm::Module(func_name, context));
+  arch->PrepareModuleDataLayout(trace_module.get());
+  MoveFunctionIntoModule(func, trace_module.get());
+
+  const auto decl = module->getFunction(func_name);
+  CHECK(decl && decl->isDeclaration());
+
+  // The counters were copied into `trace_module`.
+  ExposeProfileCounters(trace_module.get(), func_name);
+  if (auto counters =
+          module->getGlobalVariable(ProfileCountersName(func_name), true)) {
+    counters->removeDeadConstantUsers();
+    if (counters->use_empty()) {
+      counters->eraseFromParent();
+    }
+  }
+
+  release(addr, func, std::move(trace_module));
+  return decl;
 }
 
 // Lift one or more traces starting from `addr`.
 bool TraceLifter::Impl::Lift(
-    uint64_t addr_, std::function<void(uint64_t, llvm::Function *)> callback) {
+    uint64_t addr_, std::function<void(uint64_t, llvm::Function *)> callback,
+    const TraceModuleCallback *release) {
   auto addr = addr_ & addr_mask;
   if (addr < addr_) {  // Address is out of range.
     LOG(ERROR) << "Trace address " << std::hex << addr_ << " is too big"
@@ -244,15 +1750,20 @@ bool TraceLifter::Impl::Lift(
   }
 
   // Reset the lifting state.
+  outcome = LiftOutcome::kComplete;
+  num_lifted_insts = 0;
+  num_lifted_traces = 0;
   trace_work_list.clear();
   inst_work_list.clear();
   blocks.clear();
-  inst_bytes.clear();
+  inst_bytes_buffer.clear();
+  inst_bytes = {};
   func = nullptr;
   switch_inst = nullptr;
   block = nullptr;
   inst.Reset();
   delayed_inst.Reset();
+  inst_lifter.SetInvariantSegmentBases(manager.HasInvariantSegmentBases());
 
   // Get a trace head that the manager knows about, or that we
   // will eventually tell the trace manager about.
@@ -269,10 +1780,76 @@ bool TraceLifter::Impl::Lift(
     return nullptr;
   };
 
+  // Terminate `from_block`, which ends with the indirect jump `inst`, with a
+  // `switch` over the devirtualized targets of `inst`. Unknown targets go to
+  // `__remill_jump` by way of the default case.
+  auto add_indirect_jump = [=](llvm::BasicBlock *from_block) -> void {
+    devirt_targets.clear();
+    manager.GetDevirtualizedTargets(inst, devirt_targets);
+    if (devirt_targets.empty()) {
+      AddUnknownIndirectJump(from_block);
+      return;
+    }
+
+    // Sort by address, and when an address is listed as both, prefer it as
+    // a trace head (which we later call) over a trace-local block (which
+    // we would lift into this trace). Addresses are masked first, so that
+    // two targets that only differ above the address size become one case.
+    for (auto &target : devirt_targets) {
+      target.first &= addr_mask;
+    }
+    std::sort(devirt_targets.begin(), devirt_targets.end(),
+              [](const auto &a, const auto &b) {
+                return a.first < b.first ||
+                       (a.first == b.first && a.second > b.second);
+              });
+    devirt_targets.erase(std::unique(devirt_targets.begin(),
+                                     devirt_targets.end(),
+                                     [](const auto &a, const auto &b) {
+                                       return a.first == b.first;
+                                     }),
+                         devirt_targets.end());
+
+    const auto word_type = inst_lifter.impl->word_type;
+    const auto default_block = llvm::BasicBlock::Create(context, "", func);
+    AddUnknownIndirectJump(default_block);
+
+    switch_inst = llvm::SwitchInst::Create(
+        LoadNextProgramCounter(from_block), default_block,
+        static_cast<unsigned>(devirt_targets.size()), from_block);
+
+    for (const auto &[target_pc, kind] : devirt_targets) {
+      llvm::BasicBlock *target_block = nullptr;
+      if (DevirtualizedTargetKind::kTraceHead == kind) {
+        trace_work_list.insert(target_pc);
+        target_block = llvm::BasicBlock::Create(context, "", func);
+        AddTerminatingTailCall(target_block, get_trace_decl(target_pc));
+      } else {
+        inst_work_list.insert(target_pc);
+        target_block = GetOrCreateBlock(target_pc);
+      }
+      switch_inst->addCase(llvm::ConstantInt::get(word_type, target_pc),
+                           target_block);
+    }
+  };
+
   trace_work_list.insert(addr);
   while (!trace_work_list.empty()) {
     const auto trace_addr = PopTraceAddress();
 
+    // Someone else will lift this trace, or no one will, because we ran out
+    // of time or budget. Our calls to it link with its definition, if any, by
+    // name. This comes before asking the manager for the definition, as
+    // doing so may claim the trace for us.
+    if ((trace_addr != addr && on_trace_head && on_trace_head(trace_addr)) ||
+        ShouldStopLifting()) {
+      const auto decl = module->getFunction(manager.TraceName(trace_addr));
+      if (decl && decl->isDeclaration()) {
+        decl->setLinkage(llvm::GlobalValue::ExternalLinkage);
+      }
+      continue;
+    }
+
     // Already lifted.
     func = GetLiftedTraceDefinition(trace_addr);
     if (func) {
@@ -282,8 +1859,20 @@ bool TraceLifter::Impl::Lift(
     DLOG(INFO) << "Lifting trace at address " << std::hex << trace_addr
                << std::dec;
 
+    StatisticsTimer trace_timer(Timer(&LiftStatistics::trace_seconds));
+    TraceEventSpan trace_span(stats ? stats->events : nullptr, "lift_trace",
+                              trace_addr);
+    StatisticsAllocationScope trace_allocs(
+        Counter(&LiftStatistics::trace_alloc_bytes),
+        Counter(&LiftStatistics::trace_allocs));
+
     func = get_trace_decl(trace_addr);
     blocks.clear();
+    trace_insts.clear();
+    num_trace_insts = 0;
+    native_returns = ReturnsToCaller(trace_addr);
+    counter_pcs.clear();
+    counter_kinds.clear();
 
     if (!func || !func->isDeclaration()) {
       const auto trace_name = manager.TraceName(trace_addr);
@@ -295,7 +1884,11 @@ bool TraceLifter::Impl::Lift(
     // Fill in the function, and make sure the block with all register
     // variables jumps to the block that will contain the first instruction
     // of the trace.
-    CloneBlockFunctionInto(func);
+    if (lazy_prologue) {
+      CloneBlockFunctionPrologueInto(func);
+    } else {
+      CloneBlockFunctionInto(func);
+    }
     auto state_ptr = NthArgument(func, kStatePointerArgNum);
 
     if (auto entry_block = &(func->front())) {
@@ -313,6 +1906,14 @@ bool TraceLifter::Impl::Lift(
     CHECK(inst_work_list.empty());
     inst_work_list.insert(trace_addr);
 
+    if (max_lookahead_insts) {
+      if (!lookahead) {
+        lookahead = std::make_unique<LookaheadDecoder>(
+            arch, manager, max_inst_bytes, max_lookahead_insts);
+      }
+      lookahead->Restart(trace_addr, stats ? stats->events : nullptr);
+    }
+
     // Decode instructions.
     while (!inst_work_list.empty()) {
       const auto inst_addr = PopInstructionAddress();
@@ -333,6 +1934,16 @@ bool TraceLifter::Impl::Lift(
           AddTerminatingTailCall(block, inst_as_trace);
           continue;
         }
+
+        // The trace is too big; split it here by treating this instruction
+        // as a new trace head, just as if the manager had told us about it.
+        // If we're out of time or budget, then that trace head is left as a
+        // declaration.
+        if (TraceIsTooBig() || ShouldStopLifting()) {
+          trace_work_list.insert(inst_addr);
+          AddTerminatingTailCall(block, get_trace_decl(inst_addr));
+          continue;
+        }
       }
 
       // No executable bytes here.
@@ -342,10 +1953,27 @@ bool TraceLifter::Impl::Lift(
       }
 
       inst.Reset();
-
-      (void) arch->DecodeInstruction(inst_addr, inst_bytes, inst);
-
-      auto lift_status = inst_lifter.LiftIntoBlock(inst, block, state_ptr);
+      DecodeInstruction(inst_addr);
+      if (fuse_insts && inst.IsValid()) {
+        TryFuseWithNextInstruction();
+      }
+      if (fold_pc_relative_operands && inst.IsValid()) {
+        FoldPCRelativeOperands(inst);
+      }
+      ++num_trace_insts;
+      trace_insts.emplace_back(inst_addr, inst.bytes.empty()
+                                              ? inst_bytes.size()
+                                              : inst.bytes.size());
+
+      auto lift_status = kLiftedLifterError;
+      {
+        StatisticsTimer timer(Timer(&LiftStatistics::lift_seconds));
+        lift_status = inst_lifter.LiftIntoBlock(inst, block, state_ptr);
+      }
+      if (stats) {
+        stats->num_lifted_insts += 1;
+        stats->num_failed_lifts += kLiftedInstruction != lift_status;
+      }
       if (kLiftedInstruction != lift_status) {
         AddTerminatingTailCall(block, intrinsics->error);
         continue;
@@ -354,15 +1982,14 @@ bool TraceLifter::Impl::Lift(
       // Handle lifting a delayed instruction.
       auto try_delay = arch->MayHaveDelaySlot(inst);
       if (try_delay) {
-        delayed_inst.Reset();
         if (!ReadInstructionBytes(inst.delayed_pc) ||
-            !arch->DecodeDelayedInstruction(inst.delayed_pc, inst_bytes,
-                                            delayed_inst)) {
+            !DecodeDelayedInstruction()) {
           LOG(ERROR) << "Couldn't read delayed inst "
                      << delayed_inst.Serialize();
           AddTerminatingTailCall(block, intrinsics->error);
           continue;
         }
+        trace_insts.emplace_back(inst.delayed_pc, delayed_inst.bytes.size());
       }
 
       // Functor used to add in a delayed instruction.
@@ -382,6 +2009,22 @@ bool TraceLifter::Impl::Lift(
         }
       };
 
+      // Functor used to add in a delayed instruction that executes on both
+      // paths of a conditional control-flow instruction, i.e. that isn't
+      // annulled. It is lifted once, into `block`, before the branch on
+      // `BRANCH_TAKEN`, which delayed instructions don't write. Returns
+      // `false` if the delayed instruction must instead be added to each
+      // path, e.g. because it is itself a control-flow instruction.
+      auto try_add_shared_delay_slot = [&](void) -> bool {
+        if (!arch->NextInstructionIsDelayed(inst, delayed_inst, true) ||
+            !arch->NextInstructionIsDelayed(inst, delayed_inst, false) ||
+            delayed_inst.IsControlFlow()) {
+          return false;
+        }
+        try_add_delay_slot(true, block);
+        return true;
+      };
+
       // Connect together the basic blocks.
       switch (inst.category) {
         case Instruction::kCategoryInvalid:
@@ -391,7 +2034,9 @@ bool TraceLifter::Impl::Lift(
 
         case Instruction::kCategoryNormal:
         case Instruction::kCategoryNoOp:
-          llvm::BranchInst::Create(GetOrCreateNextBlock(), block);
+          if (!LiftPredicatedRun()) {
+            llvm::BranchInst::Create(GetOrCreateNextBlock(), block);
+          }
           break;
 
         // Direct jumps could either be local or could be tail-calls. In the
@@ -407,7 +2052,7 @@ bool TraceLifter::Impl::Lift(
 
         case Instruction::kCategoryIndirectJump: {
           try_add_delay_slot(true, block);
-          AddTerminatingTailCall(block, intrinsics->jump);
+          add_indirect_jump(block);
           break;
         }
 
@@ -428,8 +2073,8 @@ bool TraceLifter::Impl::Lift(
           ir.CreateStore(ir.CreateLoad(ret_pc_ref), next_pc_ref);
           ir.CreateBr(GetOrCreateBranchNotTakenBlock());
 
-          AddCall(block, intrinsics->function_call);
-          llvm::BranchInst::Create(fall_through_block, block);
+          llvm::BranchInst::Create(fall_through_block,
+                                   AddIndirectFunctionCall(block));
           block = fall_through_block;
           continue;
         }
@@ -439,11 +2084,11 @@ bool TraceLifter::Impl::Lift(
           auto not_taken_block = GetOrCreateBranchNotTakenBlock();
           const auto orig_not_taken_block = not_taken_block;
 
-          // If we might need to add delay slots, then try to lift the delayed
-          // instruction on each side of the conditional branch, injecting in
-          // new blocks (for the delayed instruction) between the branch
-          // and its original targets.
-          if (try_delay) {
+          // If we might need to add delay slots that aren't shared by both
+          // paths, then try to lift the delayed instruction on each side of
+          // the conditional branch, injecting in new blocks (for the delayed
+          // instruction) between the branch and its original targets.
+          if (try_delay && !try_add_shared_delay_slot()) {
             not_taken_block = llvm::BasicBlock::Create(context, "", func);
 
             try_add_delay_slot(true, taken_block);
@@ -452,8 +2097,7 @@ bool TraceLifter::Impl::Lift(
             llvm::BranchInst::Create(orig_not_taken_block, not_taken_block);
           }
 
-          llvm::BranchInst::Create(taken_block, not_taken_block,
-                                   LoadBranchTaken(block), block);
+          AddConditionalBranch(taken_block, not_taken_block, block);
 
           AddCall(taken_block, intrinsics->function_call);
 
@@ -481,6 +2125,9 @@ bool TraceLifter::Impl::Lift(
             trace_work_list.insert(inst.branch_taken_pc);
             auto target_trace = get_trace_decl(inst.branch_taken_pc);
             AddCall(block, target_trace);
+            if (ReturnsToCaller(inst.branch_taken_pc)) {
+              block = AddReturnCheck(block);
+            }
           }
 
           const auto ret_pc_ref = LoadReturnProgramCounterRef(block);
@@ -501,11 +2148,11 @@ bool TraceLifter::Impl::Lift(
           auto not_taken_block = GetOrCreateBranchNotTakenBlock();
           const auto orig_not_taken_block = not_taken_block;
 
-          // If we might need to add delay slots, then try to lift the delayed
-          // instruction on each side of the conditional branch, injecting in
-          // new blocks (for the delayed instruction) between the branch
-          // and its original targets.
-          if (try_delay) {
+          // If we might need to add delay slots that aren't shared by both
+          // paths, then try to lift the delayed instruction on each side of
+          // the conditional branch, injecting in new blocks (for the delayed
+          // instruction) between the branch and its original targets.
+          if (try_delay && !try_add_shared_delay_slot()) {
             not_taken_block = llvm::BasicBlock::Create(context, "", func);
 
             try_add_delay_slot(true, taken_block);
@@ -514,14 +2161,16 @@ bool TraceLifter::Impl::Lift(
             llvm::BranchInst::Create(orig_not_taken_block, not_taken_block);
           }
 
-          llvm::BranchInst::Create(taken_block, not_taken_block,
-                                   LoadBranchTaken(block), block);
+          AddConditionalBranch(taken_block, not_taken_block, block);
 
           trace_work_list.insert(inst.branch_taken_pc);
           auto target_trace = get_trace_decl(inst.branch_taken_pc);
 
           AddCall(taken_block, intrinsics->function_call);
           AddCall(taken_block, target_trace);
+          if (ReturnsToCaller(inst.branch_taken_pc)) {
+            taken_block = AddReturnCheck(taken_block);
+          }
 
           const auto ret_pc_ref = LoadReturnProgramCounterRef(taken_block);
           const auto next_pc_ref = LoadNextProgramCounterRef(taken_block);
@@ -567,7 +2216,7 @@ bool TraceLifter::Impl::Lift(
 
         case Instruction::kCategoryFunctionReturn:
           try_add_delay_slot(true, block);
-          AddTerminatingTailCall(block, intrinsics->function_return);
+          AddFunctionReturn(block);
           break;
 
         case Instruction::kCategoryConditionalFunctionReturn: {
@@ -575,11 +2224,11 @@ bool TraceLifter::Impl::Lift(
           auto not_taken_block = GetOrCreateBranchNotTakenBlock();
           const auto orig_not_taken_block = not_taken_block;
 
-          // If we might need to add delay slots, then try to lift the delayed
-          // instruction on each side of the conditional branch, injecting in
-          // new blocks (for the delayed instruction) between the branch
-          // and its original targets.
-          if (try_delay) {
+          // If we might need to add delay slots that aren't shared by both
+          // paths, then try to lift the delayed instruction on each side of
+          // the conditional branch, injecting in new blocks (for the delayed
+          // instruction) between the branch and its original targets.
+          if (try_delay && !try_add_shared_delay_slot()) {
             not_taken_block = llvm::BasicBlock::Create(context, "", func);
 
             try_add_delay_slot(true, taken_block);
@@ -588,10 +2237,9 @@ bool TraceLifter::Impl::Lift(
             llvm::BranchInst::Create(orig_not_taken_block, not_taken_block);
           }
 
-          llvm::BranchInst::Create(taken_block, not_taken_block,
-                                   LoadBranchTaken(block), block);
+          AddConditionalBranch(taken_block, not_taken_block, block);
 
-          AddTerminatingTailCall(taken_block, intrinsics->function_return);
+          AddFunctionReturn(taken_block);
           block = orig_not_taken_block;
           continue;
         }
@@ -600,11 +2248,11 @@ bool TraceLifter::Impl::Lift(
           auto taken_block = GetOrCreateBranchTakenBlock();
           auto not_taken_block = GetOrCreateBranchNotTakenBlock();
 
-          // If we might need to add delay slots, then try to lift the delayed
-          // instruction on each side of the conditional branch, injecting in
-          // new blocks (for the delayed instruction) between the branch
-          // and its original targets.
-          if (try_delay) {
+          // If we might need to add delay slots that aren't shared by both
+          // paths, then try to lift the delayed instruction on each side of
+          // the conditional branch, injecting in new blocks (for the delayed
+          // instruction) between the branch and its original targets.
+          if (try_delay && !try_add_shared_delay_slot()) {
             auto new_taken_block = llvm::BasicBlock::Create(context, "", func);
             auto new_not_taken_block =
                 llvm::BasicBlock::Create(context, "", func);
@@ -619,8 +2267,7 @@ bool TraceLifter::Impl::Lift(
             not_taken_block = new_not_taken_block;
           }
 
-          llvm::BranchInst::Create(taken_block, not_taken_block,
-                                   LoadBranchTaken(block), block);
+          AddConditionalBranch(taken_block, not_taken_block, block);
           break;
         }
         case Instruction::kCategoryConditionalIndirectJump: {
@@ -628,11 +2275,11 @@ bool TraceLifter::Impl::Lift(
           auto not_taken_block = GetOrCreateBranchNotTakenBlock();
           const auto orig_not_taken_block = not_taken_block;
 
-          // If we might need to add delay slots, then try to lift the delayed
-          // instruction on each side of the conditional branch, injecting in
-          // new blocks (for the delayed instruction) between the branch
-          // and its original targets.
-          if (try_delay) {
+          // If we might need to add delay slots that aren't shared by both
+          // paths, then try to lift the delayed instruction on each side of
+          // the conditional branch, injecting in new blocks (for the delayed
+          // instruction) between the branch and its original targets.
+          if (try_delay && !try_add_shared_delay_slot()) {
             not_taken_block = llvm::BasicBlock::Create(context, "", func);
 
             try_add_delay_slot(true, taken_block);
@@ -641,10 +2288,9 @@ bool TraceLifter::Impl::Lift(
             llvm::BranchInst::Create(orig_not_taken_block, not_taken_block);
           }
 
-          llvm::BranchInst::Create(taken_block, not_taken_block,
-                                   LoadBranchTaken(block), block);
+          AddConditionalBranch(taken_block, not_taken_block, block);
 
-          AddTerminatingTailCall(taken_block, intrinsics->jump);
+          add_indirect_jump(taken_block);
           block = orig_not_taken_block;
           continue;
         }
@@ -657,11 +2303,358 @@ bool TraceLifter::Impl::Lift(
       }
     }
 
+    if (arch->IsSPARC32() || arch->IsSPARC64()) {
+      SpillRegisterWindows();
+    }
+
+    if (profiling.count_blocks) {
+      InstrumentBlocks(trace_addr);
+    }
+    FinishProfiling(trace_addr);
+    LayOutBlocks();
+    if (split_cold_exits) {
+      SplitColdExits();
+    }
+    AddMissingDebugLocations(func);
+
+    if (stats) {
+      stats->num_traces += 1;
+      stats->num_blocks += func->size();
+    }
+    num_lifted_insts += num_trace_insts;
+    num_lifted_traces += 1;
+
     callback(trace_addr, func);
+    manager.SetLiftedTraceInstructions(trace_addr, trace_insts);
+    if (release) {
+      func = ReleaseTrace(trace_addr, *release);
+    } else {
+      ExposeProfileCounters(module, func->getName().str());
+      if (index) {
+        index->AddFunction(func);
+      }
+    }
     manager.SetLiftedTraceDefinition(trace_addr, func);
   }
 
+  if (outcome != LiftOutcome::kComplete) {
+    LOG(WARNING) << "Stopped lifting from " << std::hex << addr << std::dec
+                 << " after " << num_lifted_traces << " traces: "
+                 << LiftOutcomeName(outcome);
+    return false;
+  }
   return true;
 }
 
+namespace {
+
+// Returns the size of `func`, in LLVM instructions.
+static size_t FunctionSize(const llvm::Function *func) {
+  size_t size = 0;
+  for (const auto &block : *func) {
+    size += block.size();
+  }
+  return size;
+}
+
+// Returns the call of `func` by another trace in `trace_funcs`, if that is the
+// only use of `func`.
+static llvm::CallInst *
+GetOnlyTraceCall(llvm::Function *func,
+                 const std::unordered_set<llvm::Function *> &trace_funcs) {
+  if (func->isDeclaration() || !func->hasOneUse()) {
+    return nullptr;
+  }
+  const auto call = llvm::dyn_cast<llvm::CallInst>(func->user_back());
+  if (!call || call->getCalledFunction() != func ||
+      call->getFunction() == func ||
+      !trace_funcs.count(call->getFunction())) {
+    return nullptr;
+  }
+  return call;
+}
+
+}  // namespace
+
+// Merge each small trace of `traces` whose only use is a single call or tail
+// call from another trace of `traces` into that trace.
+size_t FormTraceRegions(const TraceMap &traces, const RegionLimits &limits) {
+  std::unordered_set<llvm::Function *> trace_funcs;
+  std::vector<std::pair<uint64_t, llvm::Function *>> sorted_traces;
+  for (auto [addr, func] : traces) {
+    if (func) {
+      trace_funcs.insert(func);
+      sorted_traces.emplace_back(addr, func);
+    }
+  }
+  std::sort(sorted_traces.begin(), sorted_traces.end());
+
+  // The only caller of each trace forms a forest. Merge the deepest traces
+  // first, so that each trace already contains the traces merged into it when
+  // it is itself merged into its caller.
+  std::unordered_map<llvm::Function *, size_t> depths;
+  std::function<size_t(llvm::Function *)> get_depth;
+  get_depth = [&](llvm::Function *func) -> size_t {
+    auto [it, added] = depths.emplace(func, 0);
+    if (!added) {
+      return it->second;  // Zero if `func` is on a cycle of only callers.
+    }
+    size_t depth = 0;
+    if (auto call = GetOnlyTraceCall(func, trace_funcs)) {
+      depth = get_depth(call->getFunction()) + 1;
+    }
+    depths[func] = depth;
+    return depth;
+  };
+
+  std::vector<std::tuple<size_t, uint64_t, llvm::Function *>> work_list;
+  for (auto [addr, func] : sorted_traces) {
+    if (auto depth = get_depth(func)) {
+      work_list.emplace_back(depth, addr, func);
+    }
+  }
+  std::sort(work_list.begin(), work_list.end(),
+            [](const auto &a, const auto &b) {
+              return std::get<0>(a) > std::get<0>(b) ||
+                     (std::get<0>(a) == std::get<0>(b) &&
+                      std::get<1>(a) < std::get<1>(b));
+            });
+
+  size_t num_merged = 0;
+  for (auto [depth, addr, func] : work_list) {
+    (void) depth;
+    (void) addr;
+    const auto call = GetOnlyTraceCall(func, trace_funcs);
+    if (!call) {
+      continue;
+    }
+    const auto func_size = FunctionSize(func);
+    if (func_size > limits.max_merged_size ||
+        (FunctionSize(call->getFunction()) + func_size) >
+            limits.max_region_size) {
+      continue;
+    }
+    llvm::InlineFunctionInfo info;
+#if LLVM_VERSION_NUMBER >= LLVM_VERSION(11, 0)
+    num_merged += llvm::InlineFunction(call, info).isSuccess();
+#else
+    num_merged += static_cast<bool>(llvm::InlineFunction(call, info));
+#endif
+  }
+  return num_merged;
+}
+
+ParallelTraceLifter::~ParallelTraceLifter(void) {}
+
+ParallelTraceLifter::ParallelTraceLifter(OSName os_name_, ArchName arch_name_,
+                                         ManagerFactory manager_factory_,
+                                         unsigned num_workers_)
+    : os_name(os_name_),
+      arch_name(arch_name_),
+      manager_factory(std::move(manager_factory_)),
+      num_workers(num_workers_
+                      ? num_workers_
+                      : std::max(1u, std::thread::hardware_concurrency())) {}
+
+void ParallelTraceLifter::NullCallback(unsigned, const Arch *, llvm::Module *,
+                                       const TraceMap &) {}
+
+namespace {
+
+// Schedules the trace heads of a `ParallelTraceLifter` by work stealing. Each
+// worker pushes and pops trace heads at the back of its own deque, so that
+// it tends to lift the callees of a trace soon after the trace, and steals
+// from the front of the deques of other workers when its own is empty.
+class TraceWorkQueue {
+ public:
+  explicit TraceWorkQueue(unsigned num_workers)
+      : deques(num_workers) {}
+
+  // Push the trace head `addr` onto the deque of `worker`, unless it has
+  // already been pushed by some worker. Returns `true` if it was pushed.
+  bool Push(unsigned worker, uint64_t addr) {
+    {
+      std::lock_guard<std::mutex> locker(claimed_lock);
+      if (!claimed.insert(addr).second) {
+        return false;
+      }
+    }
+    {
+      auto &deque = deques[worker];
+      std::lock_guard<std::mutex> locker(deque.lock);
+      deque.addrs.push_back(addr);
+    }
+    {
+      std::lock_guard<std::mutex> locker(lock);
+      ++num_queued;
+      ++num_pending;
+    }
+    cond.notify_one();
+    return true;
+  }
+
+  // Pop the next trace head for `worker` into `addr`, stealing one from
+  // another worker if need be. Blocks until there is a trace head, or until
+  // every trace head has been lifted, in which case it returns `false`.
+  bool Pop(unsigned worker, uint64_t *addr) {
+    const auto num_workers = static_cast<unsigned>(deques.size());
+    for (;;) {
+      for (auto i = 0u; i < num_workers; ++i) {
+        const auto victim = (worker + i) % num_workers;
+        if (TryTake(victim, victim == worker, addr)) {
+          std::lock_guard<std::mutex> locker(lock);
+          --num_queued;
+          return true;
+        }
+      }
+
+      std::unique_lock<std::mutex> locker(lock);
+      cond.wait(locker, [this] { return num_queued || !num_pending; });
+      if (!num_pending) {
+        return false;
+      }
+    }
+  }
+
+  // Mark a trace head returned by `Pop` as lifted. The trace heads that were
+  // discovered while lifting it must already have been pushed.
+  void Done(void) {
+    std::lock_guard<std::mutex> locker(lock);
+    if (!--num_pending) {
+      cond.notify_all();
+    }
+  }
+
+ private:
+  struct Deque {
+    std::mutex lock;
+    std::deque<uint64_t> addrs;
+  };
+
+  bool TryTake(unsigned victim, bool from_back, uint64_t *addr) {
+    auto &deque = deques[victim];
+    std::lock_guard<std::mutex> locker(deque.lock);
+    if (deque.addrs.empty()) {
+      return false;
+    } else if (from_back) {
+      *addr = deque.addrs.back();
+      deque.addrs.pop_back();
+    } else {
+      *addr = deque.addrs.front();
+      deque.addrs.pop_front();
+    }
+    return true;
+  }
+
+  std::vector<Deque> deques;
+
+  // Every trace head ever pushed.
+  std::mutex claimed_lock;
+  std::unordered_set<uint64_t> claimed;
+
+  // `num_queued` is the number of trace heads in the deques, and
+  // `num_pending` is that plus the number being lifted.
+  std::mutex lock;
+  std::condition_variable cond;
+  size_t num_queued{0};
+  size_t num_pending{0};
+};
+
+// Lift the traces handed to worker `shard_index` by `queue` into `shard`.
+// This runs on its own thread, and touches nothing but `queue`, `shard`,
+// and the objects it creates.
+void LiftShard(OSName os_name, ArchName arch_name, unsigned shard_index,
+               const ParallelTraceLifter::ManagerFactory &manager_factory,
+               const ParallelTraceLifter::ShardCallback &callback,
+               TraceWorkQueue &queue, LiftedTraceShard &shard) {
+  shard.context.reset(new llvm::LLVMContext);
+  shard.arch = Arch::Build(shard.context.get(), os_name, arch_name);
+  shard.semantics_module = LoadArchSemantics(shard.arch.get());
+
+  const auto manager =
+      manager_factory(shard_index, shard.semantics_module.get());
+  CHECK(manager != nullptr)
+      << "Trace manager factory returned null for shard " << shard_index;
+
+  IntrinsicTable intrinsics(shard.semantics_module);
+  InstructionLifter inst_lifter(shard.arch.get(), intrinsics);
+  TraceLifter trace_lifter(inst_lifter, *manager);
+
+  // Whoever pops a discovered trace head lifts it, even if it was already
+  // pushed by another worker.
+  trace_lifter.SetTraceHeadCallback([&queue, shard_index](uint64_t addr) {
+    queue.Push(shard_index, addr);
+    return true;
+  });
+
+  uint64_t trace_addr = 0;
+  while (queue.Pop(shard_index, &trace_addr)) {
+    trace_lifter.Lift(trace_addr,
+                      [&shard](uint64_t addr, llvm::Function *func) {
+                        shard.traces[addr] = func;
+                      });
+    queue.Done();
+  }
+
+  callback(shard_index, shard.arch.get(), shard.semantics_module.get(),
+           shard.traces);
+
+  std::stringstream ss;
+  ss << "lifted_code_" << shard_index;
+  shard.module.reset(new llvm::Module(ss.str(), *shard.context));
+  shard.arch->PrepareModuleDataLayout(shard.module.get());
+
+  std::vector<llvm::Function *> funcs;
+  funcs.reserve(shard.traces.size());
+  for (auto &[addr, func] : shard.traces) {
+    (void) addr;
+    funcs.push_back(func);
+  }
+  MoveFunctionsIntoModule(funcs, shard.module.get());
+}
+
+}  // namespace
+
+// Lift all traces reachable from `trace_addrs`.
+std::vector<LiftedTraceShard>
+ParallelTraceLifter::Lift(const std::vector<uint64_t> &trace_addrs_,
+                          ShardCallback callback) {
+  std::vector<uint64_t> trace_addrs(trace_addrs_);
+  std::sort(trace_addrs.begin(), trace_addrs.end());
+  trace_addrs.erase(std::unique(trace_addrs.begin(), trace_addrs.end()),
+                    trace_addrs.end());
+
+  const auto num_roots = trace_addrs.size();
+  const auto num_shards =
+      static_cast<unsigned>(std::min<size_t>(num_workers, num_roots));
+  if (!num_shards) {
+    return {};
+  }
+
+  // Seed each worker with a contiguous address range of the roots. Nearby
+  // traces tend to call each other, so this keeps callers and callees in the
+  // same shard until the workers start stealing. The roots are pushed in
+  // reverse so that each worker starts with the lowest of its roots.
+  TraceWorkQueue queue(num_shards);
+  for (auto i = num_roots; i--;) {
+    queue.Push(static_cast<unsigned>((i * num_shards) / num_roots),
+               trace_addrs[i]);
+  }
+
+  std::vector<LiftedTraceShard> shards(num_shards);
+  std::vector<std::thread> workers;
+  workers.reserve(num_shards);
+  for (auto i = 0u; i < num_shards; ++i) {
+    workers.emplace_back(LiftShard, os_name, arch_name, i,
+                         std::cref(manager_factory), std::cref(callback),
+                         std::ref(queue), std::ref(shards[i]));
+  }
+
+  for (auto &worker : workers) {
+    worker.join();
+  }
+
+  return shards;
+}
+
 }  // namespace remill
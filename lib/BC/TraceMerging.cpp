@@ -0,0 +1,249 @@
+/*
+ * Copyright (c) 2020 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "remill/BC/TraceMerging.h"
+
+#include <glog/logging.h>
+#include <llvm/ADT/Hashing.h>
+#include <llvm/IR/BasicBlock.h>
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/InstIterator.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/IntrinsicInst.h>
+#include <llvm/Transforms/Utils/Cloning.h>
+#include <llvm/Transforms/Utils/ValueMapper.h>
+
+#include <algorithm>
+#include <array>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "remill/BC/ABI.h"
+#include "remill/BC/Util.h"
+#include "remill/BC/Version.h"
+
+#if LLVM_VERSION_NUMBER >= LLVM_VERSION(5, 0)
+#  include <llvm/Transforms/Utils/FunctionComparator.h>
+#endif
+
+namespace remill {
+namespace {
+
+// Integer constants that are at most this far from the address of a trace
+// are taken to be program counter values, unless they are small enough to
+// be counts, sizes, or offsets.
+static constexpr int64_t kMaxPCDelta = 1 << 16;
+
+// Returns `true` if the operands of `inst` can be something other than
+// constants.
+static bool HasVariableOperands(const llvm::Instruction &inst) {
+  return !llvm::isa<llvm::SwitchInst>(inst) &&
+         !llvm::isa<llvm::IntrinsicInst>(inst) &&
+         !llvm::isa<llvm::GetElementPtrInst>(inst) &&
+         !llvm::isa<llvm::AllocaInst>(inst);
+}
+
+// Returns the distance of `val` from `addr`, if `val` is an integer constant
+// of the type of `pc` and it is close enough to `addr` to be a program
+// counter value.
+static bool TryGetPCDelta(llvm::Value *val, const llvm::Argument *pc,
+                          uint64_t addr, int64_t *delta) {
+  const auto ci = llvm::dyn_cast<llvm::ConstantInt>(val);
+  if (!ci || ci->getType() != pc->getType() ||
+      ci->getZExtValue() < static_cast<uint64_t>(kMaxPCDelta)) {
+    return false;
+  }
+  *delta = static_cast<int64_t>(ci->getZExtValue() - addr);
+  return -kMaxPCDelta <= *delta && *delta <= kMaxPCDelta;
+}
+
+// Hashes the instructions of `func`, and the constants that they use, with
+// the program counter values taken relative to `addr`. Traces that would be
+// identical once made relative have the same hash.
+static uint64_t RelativeHash(llvm::Function *func, uint64_t addr) {
+  const auto pc = NthArgument(func, kPCArgNum);
+  auto hash = llvm::hash_combine(func->getFunctionType(), func->size());
+  for (auto &inst : llvm::instructions(func)) {
+    hash = llvm::hash_combine(hash, inst.getOpcode(), inst.getType(),
+                              inst.getNumOperands());
+    const auto can_be_relative = HasVariableOperands(inst);
+    for (auto &op : inst.operands()) {
+      int64_t delta = 0;
+      if (can_be_relative && TryGetPCDelta(op.get(), pc, addr, &delta)) {
+        hash = llvm::hash_combine(hash, delta);
+      } else if (llvm::isa<llvm::Constant>(op.get())) {
+        hash = llvm::hash_combine(hash, op.get());
+      }
+    }
+  }
+  return static_cast<uint64_t>(hash);
+}
+
+// Rewrite the program counter values of `func`, whose address is `addr`, to
+// be relative to its program counter argument.
+static void MakePCRelative(llvm::Function *func, uint64_t addr) {
+  const auto pc = NthArgument(func, kPCArgNum);
+  std::vector<std::pair<llvm::Use *, int64_t>> uses;
+  for (auto &inst : llvm::instructions(func)) {
+    if (HasVariableOperands(inst)) {
+      for (auto &op : inst.operands()) {
+        if (int64_t delta = 0; TryGetPCDelta(op.get(), pc, addr, &delta)) {
+          uses.emplace_back(&op, delta);
+        }
+      }
+    }
+  }
+
+  for (auto [use, delta] : uses) {
+    if (!delta) {
+      use->set(pc);
+      continue;
+    }
+
+    // The value of a PHI node must be computed in its incoming block.
+    auto inst = llvm::cast<llvm::Instruction>(use->getUser());
+    if (auto phi = llvm::dyn_cast<llvm::PHINode>(inst)) {
+      inst = phi->getIncomingBlock(*use)->getTerminator();
+    }
+    llvm::IRBuilder<> ir(inst);
+    use->set(ir.CreateAdd(
+        pc, llvm::ConstantInt::get(pc->getType(),
+                                   static_cast<uint64_t>(delta), true)));
+  }
+}
+
+// Replace the body of the trace `func` with a tail-call to `body`, passing
+// `addr` as the program counter.
+static void MakeThunk(llvm::Function *func, llvm::Function *body,
+                      uint64_t addr) {
+  const auto linkage = func->getLinkage();
+  func->deleteBody();
+  func->setLinkage(linkage);
+
+  auto block = llvm::BasicBlock::Create(func->getContext(), "", func);
+  llvm::IRBuilder<> ir(block);
+  std::array<llvm::Value *, kNumBlockArgs> args;
+  args[kStatePointerArgNum] = NthArgument(func, kStatePointerArgNum);
+  args[kMemoryPointerArgNum] = NthArgument(func, kMemoryPointerArgNum);
+  args[kPCArgNum] =
+      llvm::ConstantInt::get(NthArgument(func, kPCArgNum)->getType(), addr);
+  const auto call = ir.CreateCall(body, args);
+  call->setTailCall(true);
+  ir.CreateRet(call);
+}
+
+}  // namespace
+
+// Share one body between the traces of `traces` that are identical apart
+// from the program counter values that they use.
+unsigned MergeIdenticalTraces(
+    const std::unordered_map<uint64_t, llvm::Function *> &traces) {
+#if LLVM_VERSION_NUMBER >= LLVM_VERSION(5, 0)
+
+  // Group the candidates by their relative hash, lowest address first.
+  std::vector<std::pair<uint64_t, llvm::Function *>> sorted_traces;
+  sorted_traces.reserve(traces.size());
+  for (auto [addr, func] : traces) {
+    if (!func->isDeclaration() &&
+        NthArgument(func, kPCArgNum)->getType()->isIntegerTy()) {
+      sorted_traces.emplace_back(addr, func);
+    }
+  }
+  std::sort(sorted_traces.begin(), sorted_traces.end());
+
+  std::unordered_map<uint64_t, std::vector<size_t>> groups;
+  for (size_t i = 0; i < sorted_traces.size(); ++i) {
+    const auto [addr, func] = sorted_traces[i];
+    groups[RelativeHash(func, addr)].push_back(i);
+  }
+
+  // The traces to make relative, and the `(thunk, body)` pairs.
+  std::vector<size_t> bodies;
+  std::vector<std::pair<size_t, size_t>> thunks;
+
+  // Compare relative copies of the traces of each group, as
+  // `llvm::FunctionComparator` compares constants by value.
+  llvm::GlobalNumberState global_numbers;
+  std::vector<llvm::Function *> copies;
+  std::vector<std::pair<size_t, bool>> classes;
+  for (auto &[hash, group] : groups) {
+    if (group.size() < 2) {
+      continue;
+    }
+
+    copies.clear();
+    classes.clear();
+    for (auto i : group) {
+      const auto [addr, func] = sorted_traces[i];
+      llvm::ValueToValueMapTy value_map;
+      const auto copy = llvm::CloneFunction(func, value_map);
+      MakePCRelative(copy, addr);
+
+      auto found = false;
+      for (auto &[leader, has_members] : classes) {
+        if (!llvm::FunctionComparator(copies[leader], copy, &global_numbers)
+                 .compare()) {
+          thunks.emplace_back(i, group[leader]);
+          has_members = true;
+          found = true;
+          break;
+        }
+      }
+      if (!found) {
+        classes.emplace_back(copies.size(), false);
+      }
+      copies.push_back(copy);
+    }
+
+    for (auto [leader, has_members] : classes) {
+      if (has_members) {
+        bodies.push_back(group[leader]);
+      }
+    }
+    for (auto copy : copies) {
+      copy->eraseFromParent();
+    }
+  }
+
+  for (auto i : bodies) {
+    const auto [addr, func] = sorted_traces[i];
+    MakePCRelative(func, addr);
+
+    // Keep the optimizer from inlining the shared body back into the thunks.
+    func->removeFnAttr(llvm::Attribute::InlineHint);
+    func->removeFnAttr(llvm::Attribute::AlwaysInline);
+    func->addFnAttr(llvm::Attribute::NoInline);
+  }
+
+  for (auto [i, body] : thunks) {
+    const auto [addr, func] = sorted_traces[i];
+    MakeThunk(func, sorted_traces[body].second, addr);
+  }
+
+  DLOG_IF(INFO, !thunks.empty())
+      << "Merged " << thunks.size() << " of " << sorted_traces.size()
+      << " traces into " << bodies.size() << " shared bodies";
+  return static_cast<unsigned>(thunks.size());
+#else
+  return 0;
+#endif
+}
+
+}  // namespace remill
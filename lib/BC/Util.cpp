@@ -17,9 +17,14 @@
 #include <gflags/gflags.h>
 #include <glog/logging.h>
 
+#include <algorithm>
+#include <atomic>
+#include <mutex>
 #include <sstream>
 #include <system_error>
+#include <thread>
 #include <unordered_map>
+#include <unordered_set>
 #include <utility>
 #include <vector>
 
@@ -34,14 +39,18 @@
 #include <llvm/IR/Constants.h>
 #include <llvm/IR/Function.h>
 #include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/InstIterator.h>
 #include <llvm/IR/Instructions.h>
 #include <llvm/IR/IntrinsicInst.h>
 #include <llvm/IR/LLVMContext.h>
 #include <llvm/IR/Metadata.h>
 #include <llvm/IR/Module.h>
 #include <llvm/Support/FileSystem.h>
+#include <llvm/Support/MemoryBuffer.h>
 #include <llvm/Support/SourceMgr.h>
 #include <llvm/Support/raw_ostream.h>
+#include <llvm/Transforms/Utils/Cloning.h>
+#include <llvm/Transforms/Utils/ValueMapper.h>
 
 #include "remill/Arch/Arch.h"
 #include "remill/Arch/Name.h"
@@ -66,6 +75,26 @@ DEFINE_string(
     semantics_search_paths, "",
     "Colon-separated list of search paths to use when searching for semantics files.");
 
+DEFINE_bool(prefer_optimized_semantics, false,
+            "Load the pre-optimized `<arch>.opt.bc` semantics file instead of "
+            "`<arch>.bc` when it exists.");
+
+DEFINE_bool(fast_x87_semantics, false,
+            "Load the `<arch>_fast_x87.bc` semantics of x86 and amd64 "
+            "architectures when they exist, which model the x87 FPU without "
+            "its exception flags or last instruction and data pointers.");
+
+#ifdef REMILL_EMBED_SEMANTICS
+
+// The semantics bitcode embedded by `EmbeddedSemantics.S`. Each module is
+// the bytes from `remill_semantics_<name>` up to `remill_semantics_<name>_end`.
+#  define REMILL_EMBEDDED_SEMANTICS(name) \
+    extern "C" const char remill_semantics_##name[]; \
+    extern "C" const char remill_semantics_##name##_end[];
+#  include "EmbeddedSemantics.inc"
+#  undef REMILL_EMBEDDED_SEMANTICS
+#endif  // REMILL_EMBED_SEMANTICS
+
 namespace {
 #ifdef _WIN32
 extern "C" std::uint32_t GetProcessId(std::uint32_t handle);
@@ -318,21 +347,247 @@ llvm::GlobalVariable *FindGlobaVariable(llvm::Module *module,
   return module->getGlobalVariable(name, true);
 }
 
+namespace {
+
+// A semantics bitcode file that has been found and read into memory. Large
+// files are memory-mapped, so the bytes are shared by all of the modules
+// loaded from them.
+struct SemanticsBitcode {
+  std::string path;
+  std::unique_ptr<llvm::MemoryBuffer> buffer;
+
+  // Whether or not a module parsed from `buffer` was successfully verified.
+  bool verified{false};
+};
+
+// Guards `SemanticsBitcodeCache`, and the `verified` field of its entries.
+static std::mutex gSemanticsBitcodeLock;
+
+// Returns the names of the semantics modules of `arch`, in the order that
+// they are looked for.
+static std::vector<std::string> SemanticsNames(std::string_view arch) {
+
+  // The fast x87 semantics are variants of the x86 and amd64 semantics, so
+  // look for them before the exact ones.
+  std::vector<std::string> sem_names;
+  if (FLAGS_fast_x87_semantics &&
+      (arch.substr(0, 3) == "x86" || arch.substr(0, 5) == "amd64")) {
+    sem_names.push_back(std::string(arch) + "_fast_x87");
+  }
+  sem_names.emplace_back(arch);
+  return sem_names;
+}
+
+// Returns the semantics bitcode of `arch_name` that is embedded in the
+// library with `REMILL_EMBED_SEMANTICS`, or `nullptr`. The buffer refers to
+// the embedded bytes, which are never copied. Semantics files are still
+// searched for when `--semantics_search_paths` or
+// `--prefer_optimized_semantics` is used, as only the unoptimized semantics
+// are embedded.
+static std::unique_ptr<llvm::MemoryBuffer>
+FindEmbeddedSemanticsBitcode(std::string_view arch_name) {
+#ifdef REMILL_EMBED_SEMANTICS
+  struct EmbeddedSemantics {
+    std::string_view name;
+    const char *begin;
+    const char *end;
+  };
+
+  static const EmbeddedSemantics kEmbeddedSemantics[] = {
+#  define REMILL_EMBEDDED_SEMANTICS(name) \
+    {#name, remill_semantics_##name, remill_semantics_##name##_end},
+#  include "EmbeddedSemantics.inc"
+#  undef REMILL_EMBEDDED_SEMANTICS
+      {{}, nullptr, nullptr}};
+
+  if (!FLAGS_semantics_search_paths.empty() ||
+      FLAGS_prefer_optimized_semantics) {
+    return nullptr;
+  }
+
+  for (const auto &sem_name : SemanticsNames(arch_name)) {
+    for (const auto &embedded : kEmbeddedSemantics) {
+      if (embedded.begin && embedded.name == sem_name) {
+        const llvm::StringRef bytes(
+            embedded.begin, static_cast<size_t>(embedded.end - embedded.begin));
+        return llvm::MemoryBuffer::getMemBuffer(
+            bytes, sem_name, false /* RequiresNullTerminator */);
+      }
+    }
+  }
+#else
+  (void) arch_name;
+#endif  // REMILL_EMBED_SEMANTICS
+  return nullptr;
+}
+
+// Returns the bitcode of the semantics file of `arch_name`, searching for and
+// reading the file on first use, unless the semantics are embedded in the
+// library. Later changes to `--semantics_search_paths` don't affect
+// already-read files.
+static SemanticsBitcode &GetSemanticsBitcode(std::string_view arch_name) {
+  static std::unordered_map<std::string, SemanticsBitcode> cache;
+
+  // Entries are never removed, so returned references remain valid.
+  auto &bitcode = cache[std::string(arch_name)];
+  if (!bitcode.buffer) {
+    if (auto buffer = FindEmbeddedSemanticsBitcode(arch_name)) {
+      bitcode.path = "<embedded " + buffer->getBufferIdentifier().str() + ">";
+      bitcode.buffer = std::move(buffer);
+      return bitcode;
+    }
+    bitcode.path = FindSemanticsBitcodeFile(arch_name);
+    bitcode.buffer = MapBitcodeFile(bitcode.path);
+  }
+  return bitcode;
+}
+
+// Parses the semantics for `arch` into `arch->context`. Each semantics file is
+// only read from disk once, and a fully parsed module is only verified the
+// first time that file is parsed.
+static std::unique_ptr<llvm::Module> ParseArchSemantics(const Arch *arch,
+                                                        bool lazy) {
+  auto arch_name = GetArchName(arch->arch_name);
+  std::unique_lock<std::mutex> locker(gSemanticsBitcodeLock);
+  auto &bitcode = GetSemanticsBitcode(arch_name);
+  const auto buffer_ref = bitcode.buffer->getMemBufferRef();
+  const auto needs_verify = !lazy && !bitcode.verified;
+  const auto path = bitcode.path;
+  locker.unlock();
+
+  LOG(INFO) << (lazy ? "Lazily loading " : "Loading ") << arch_name
+            << " semantics from " << path;
+
+  llvm::SMDiagnostic err;
+  std::unique_ptr<llvm::Module> module;
+  if (lazy) {
+    module = llvm::getLazyIRModule(
+        llvm::MemoryBuffer::getMemBuffer(buffer_ref, false), err,
+        *arch->context);
+  } else {
+    module = llvm::parseIR(buffer_ref, err, *arch->context);
+  }
+
+  CHECK(module) << "Unable to parse module file " << path << ": "
+                << err.getMessage().str();
+
+  if (needs_verify) {
+    CHECK(VerifyModule(module.get()))
+        << "Error verifying module read from file " << path;
+    locker.lock();
+    bitcode.verified = true;
+  }
+
+  return module;
+}
+
+}  // namespace
+
 // Loads the semantics for the `arch`-specific machine, i.e. the machine of the
 // code that we want to lift.
 std::unique_ptr<llvm::Module> LoadArchSemantics(const Arch *arch) {
-  auto arch_name = GetArchName(arch->arch_name);
-  auto path = FindSemanticsBitcodeFile(arch_name);
-  LOG(INFO) << "Loading " << arch_name << " semantics from file " << path;
-  auto module = LoadModuleFromFile(arch->context, path);
+  auto module = ParseArchSemantics(arch, false /* lazy */);
   arch->PrepareModule(module);
   arch->InitFromSemanticsModule(module.get());
-  for (auto &func : *module) {
-    Annotate<remill::Semantics>(&func);
-  }
+  AnnotateFunctions<remill::Semantics>(*module);
   return module;
 }
 
+// Loads the semantics for the `arch`-specific machine, but only reads the
+// bodies of semantics functions on demand.
+std::unique_ptr<llvm::Module> LoadLazyArchSemantics(const Arch *arch) {
+  auto module = ParseArchSemantics(arch, true /* lazy */);
+  arch->PrepareModule(module);
+
+  // `InitFromSemanticsModule` inspects, and possibly defines, the body of
+  // `__remill_basic_block`, so it must be read first.
+  CHECK(MaterializeFunction(BasicBlockFunction(module.get())))
+      << "Unable to read __remill_basic_block";
+
+  arch->InitFromSemanticsModule(module.get());
+  AnnotateFunctions<remill::Semantics>(*module);
+  return module;
+}
+
+// Read the body of `func`, and of every function that it transitively uses.
+bool MaterializeFunction(llvm::Function *func, bool verify) {
+  if (!func->isMaterializable()) {
+    return true;
+  }
+
+  std::vector<llvm::Function *> work_list;
+  std::vector<const llvm::Constant *> const_work_list;
+  std::unordered_set<const llvm::Value *> seen;
+
+  // Find the functions used by `val`, looking through constant expressions
+  // and the initializers of global variables.
+  auto add_uses = [&](const llvm::Value *val) {
+    if (!llvm::isa<llvm::Constant>(val) || !seen.insert(val).second) {
+      return;
+    }
+    const_work_list.push_back(llvm::cast<llvm::Constant>(val));
+    while (!const_work_list.empty()) {
+      auto c = const_work_list.back();
+      const_work_list.pop_back();
+      if (auto used_func = llvm::dyn_cast<llvm::Function>(c)) {
+        work_list.push_back(const_cast<llvm::Function *>(used_func));
+        continue;
+      }
+
+      if (auto gv = llvm::dyn_cast<llvm::GlobalVariable>(c)) {
+        if (gv->hasInitializer() &&
+            seen.insert(gv->getInitializer()).second) {
+          const_work_list.push_back(gv->getInitializer());
+        }
+        continue;
+      }
+
+      for (const auto &op : c->operands()) {
+        if (llvm::isa<llvm::Constant>(op.get()) &&
+            seen.insert(op.get()).second) {
+          const_work_list.push_back(llvm::cast<llvm::Constant>(op.get()));
+        }
+      }
+    }
+  };
+
+  seen.insert(func);
+  work_list.push_back(func);
+  while (!work_list.empty()) {
+    auto used_func = work_list.back();
+    work_list.pop_back();
+    if (!used_func->isMaterializable()) {
+      continue;
+    }
+
+    if (auto err = used_func->materialize()) {
+      LOG(ERROR) << "Unable to read the body of function "
+                 << used_func->getName().str() << ": "
+                 << llvm::toString(std::move(err));
+      return false;
+    }
+
+    std::string error;
+    llvm::raw_string_ostream error_stream(error);
+    if (verify && llvm::verifyFunction(*used_func, &error_stream)) {
+      error_stream.flush();
+      LOG(ERROR) << "Error verifying function " << used_func->getName().str()
+                 << ": " << error;
+      return false;
+    }
+
+    for (auto &block : *used_func) {
+      for (auto &inst : block) {
+        for (const auto &op : inst.operands()) {
+          add_uses(op.get());
+        }
+      }
+    }
+  }
+
+  return true;
+}
+
 // Try to verify a module.
 bool VerifyModule(llvm::Module *module) {
   std::string error;
@@ -346,13 +601,60 @@ bool VerifyModule(llvm::Module *module) {
   }
 }
 
+// Memory-maps the file `file_name`, or reads it into memory if it's small.
+std::unique_ptr<llvm::MemoryBuffer> MapBitcodeFile(std::string_view file_name_,
+                                                   bool allow_failure) {
+  const llvm::StringRef file_name(file_name_.data(), file_name_.size());
+#if LLVM_VERSION_NUMBER >= LLVM_VERSION(13, 0)
+  auto maybe_buffer = llvm::MemoryBuffer::getFile(
+      file_name, false /* IsText */, false /* RequiresNullTerminator */);
+#else
+  auto maybe_buffer = llvm::MemoryBuffer::getFile(
+      file_name, -1 /* FileSize */, false /* RequiresNullTerminator */);
+#endif
+  if (!maybe_buffer) {
+    LOG_IF(FATAL, !allow_failure)
+        << "Unable to read file " << file_name_ << ": "
+        << maybe_buffer.getError().message();
+    return {};
+  }
+  return std::move(maybe_buffer.get());
+}
+
+namespace {
+
+// Returns the mapped file `file_name` if it holds bitcode. Textual IR has to
+// be read by `llvm::parseIRFile` instead, as its parser needs a trailing null
+// byte.
+static std::unique_ptr<llvm::MemoryBuffer>
+MapBitcodeFileIfBitcode(std::string_view file_name) {
+  auto buffer = MapBitcodeFile(file_name, true /* allow_failure */);
+  if (buffer) {
+    const auto start =
+        reinterpret_cast<const unsigned char *>(buffer->getBufferStart());
+    const auto end =
+        reinterpret_cast<const unsigned char *>(buffer->getBufferEnd());
+    if (!llvm::isBitcode(start, end)) {
+      buffer.reset();
+    }
+  }
+  return buffer;
+}
+
+}  // namespace
+
 // Reads an LLVM module from a file.
 std::unique_ptr<llvm::Module> LoadModuleFromFile(llvm::LLVMContext *context,
                                                  std::string_view file_name_,
                                                  bool allow_failure) {
   llvm::SMDiagnostic err;
   llvm::StringRef file_name(file_name_.data(), file_name_.size());
-  auto module = llvm::parseIRFile(file_name, err, *context);
+  std::unique_ptr<llvm::Module> module;
+  if (auto buffer = MapBitcodeFileIfBitcode(file_name_)) {
+    module = llvm::parseIR(buffer->getMemBufferRef(), err, *context);
+  } else {
+    module = llvm::parseIRFile(file_name, err, *context);
+  }
 
   if (!module) {
     LOG_IF(FATAL, !allow_failure)
@@ -377,13 +679,41 @@ std::unique_ptr<llvm::Module> LoadModuleFromFile(llvm::LLVMContext *context,
   return module;
 }
 
+// Parses a bitcode file into memory without reading any function bodies.
+std::unique_ptr<llvm::Module>
+LoadLazyModuleFromFile(llvm::LLVMContext *context, std::string_view file_name_,
+                       bool allow_failure) {
+  llvm::SMDiagnostic err;
+  llvm::StringRef file_name(file_name_.data(), file_name_.size());
+  std::unique_ptr<llvm::Module> module;
+  if (auto buffer = MapBitcodeFileIfBitcode(file_name_)) {
+    module = llvm::getLazyIRModule(std::move(buffer), err, *context);
+  } else {
+    module = llvm::getLazyIRFileModule(file_name, err, *context);
+  }
+
+  if (!module) {
+    LOG_IF(FATAL, !allow_failure)
+        << "Unable to parse module file " << file_name_ << ": "
+        << err.getMessage().str();
+    return {};
+  }
+
+  return module;
+}
+
 // Store an LLVM module into a file.
 bool StoreModuleToFile(llvm::Module *module, std::string_view file_name,
                        bool allow_failure) {
   DLOG(INFO) << "Saving bitcode to file " << file_name;
 
+  // The temporary file is unique to this process and to this call, so that
+  // concurrent writers of the same file, be they processes or threads, never
+  // share a temporary, and the last rename wins.
+  static std::atomic<uint64_t> gNextTempId(0);
   std::stringstream ss;
-  ss << file_name << ".tmp." << nativeGetProcessID();
+  ss << file_name << ".tmp." << nativeGetProcessID() << '.'
+     << gNextTempId.fetch_add(1);
   auto tmp_name = ss.str();
 
   std::string error;
@@ -430,6 +760,55 @@ bool StoreModuleToFile(llvm::Module *module, std::string_view file_name,
   }
 }
 
+// Serialize an LLVM module to bitcode in `buffer`.
+bool StoreModuleToBuffer(llvm::Module *module,
+                         llvm::SmallVectorImpl<char> &buffer,
+                         const BitcodeStoreOptions &options,
+                         bool allow_failure) {
+  buffer.clear();
+
+  if (options.verify) {
+    std::string error;
+    llvm::raw_string_ostream error_stream(error);
+    if (llvm::verifyModule(*module, &error_stream)) {
+      error_stream.flush();
+      LOG_IF(FATAL, !allow_failure)
+          << "Error serializing module " << module->getModuleIdentifier()
+          << ": " << error;
+      return false;
+    }
+  }
+
+#if LLVM_VERSION_NUMBER >= LLVM_VERSION(5, 0)
+  llvm::BitcodeWriter writer(buffer);
+#  if LLVM_VERSION_NUMBER < LLVM_VERSION(7, 0)
+  writer.writeModule(module);
+#  else
+  writer.writeModule(*module);
+#  endif
+  if (options.symbol_table) {
+    writer.writeSymtab();
+  }
+  writer.writeStrtab();
+#else
+  llvm::raw_svector_ostream os(buffer);
+  llvm::WriteBitcodeToFile(module, os);
+#endif
+  return true;
+}
+
+// Serialize an LLVM module to bitcode, and write it to `os`.
+bool StoreModuleToStream(llvm::Module *module, llvm::raw_ostream &os,
+                         const BitcodeStoreOptions &options,
+                         bool allow_failure) {
+  llvm::SmallVector<char, 0> buffer;
+  if (!StoreModuleToBuffer(module, buffer, options, allow_failure)) {
+    return false;
+  }
+  os.write(buffer.data(), buffer.size());
+  return true;
+}
+
 // Store a module, serialized to LLVM IR, into a file.
 bool StoreModuleIRToFile(llvm::Module *module, std::string_view file_name_,
                          bool allow_failure) {
@@ -523,23 +902,38 @@ std::string FindHostSemanticsBitcodeFile(void) {
 
 // Find the path to the semantics bitcode file.
 std::string FindSemanticsBitcodeFile(std::string_view arch) {
+  std::vector<std::string> sem_dirs;
   if (!FLAGS_semantics_search_paths.empty()) {
     std::stringstream pp;
     pp << FLAGS_semantics_search_paths;
     for (std::string sem_dir; std::getline(pp, sem_dir, ':');) {
-      std::stringstream ss;
-      ss << sem_dir << "/" << arch << ".bc";
-      if (auto sem_path = ss.str(); FileExists(sem_path)) {
-        return sem_path;
-      }
+      sem_dirs.push_back(std::move(sem_dir));
     }
   }
 
   for (auto sem_dir : gSemanticsSearchPaths) {
-    std::stringstream ss;
-    ss << sem_dir << "/" << arch << ".bc";
-    if (auto sem_path = ss.str(); FileExists(sem_path)) {
-      return sem_path;
+    sem_dirs.emplace_back(sem_dir);
+  }
+
+  const auto sem_names = SemanticsNames(arch);
+
+  // Look for the pre-optimized semantics next to the unoptimized ones, so
+  // that the two always come from the same build.
+  for (const auto &sem_dir : sem_dirs) {
+    for (const auto &sem_name : sem_names) {
+      if (FLAGS_prefer_optimized_semantics) {
+        std::stringstream ss;
+        ss << sem_dir << "/" << sem_name << ".opt.bc";
+        if (auto sem_path = ss.str(); FileExists(sem_path)) {
+          return sem_path;
+        }
+      }
+
+      std::stringstream ss;
+      ss << sem_dir << "/" << sem_name << ".bc";
+      if (auto sem_path = ss.str(); FileExists(sem_path)) {
+        return sem_path;
+      }
     }
   }
 
@@ -708,6 +1102,89 @@ void CloneBlockFunctionInto(llvm::Function *func) {
   CHECK(remill::FindVarInFunction(func, kMemoryVariableName) != nullptr);
 }
 
+// Make `func` a minimal clone of the `__remill_basic_block` function.
+void CloneBlockFunctionPrologueInto(llvm::Function *func) {
+  auto bb_func = BasicBlockFunction(func->getParent());
+  CHECK(remill::FindVarInFunction(bb_func, kMemoryVariableName) != nullptr);
+  CHECK(func->isDeclaration());
+
+#if LLVM_VERSION_NUMBER >= LLVM_VERSION(3, 9)
+  func->getContext().setDiscardValueNames(false);
+#endif
+
+  func->setAttributes(bb_func->getAttributes());
+  func->setLinkage(bb_func->getLinkage());
+  func->setVisibility(bb_func->getVisibility());
+  func->setCallingConv(bb_func->getCallingConv());
+  func->removeFnAttr(llvm::Attribute::OptimizeNone);
+
+  auto new_args = func->arg_begin();
+  for (llvm::Argument &old_arg : bb_func->args()) {
+    (new_args++)->setName(old_arg.getName());
+  }
+
+  llvm::BasicBlock::Create(func->getContext(), "", func);
+  for (auto name : {kStateVariableName, kMemoryVariableName, kPCVariableName,
+                    kNextPCVariableName, kReturnPCVariableName,
+                    kBranchTakenVariableName}) {
+    CHECK(CloneBlockVariableInto(func, name) != nullptr)
+        << "Unable to locate variable " << name
+        << " in `__remill_basic_block`";
+  }
+}
+
+// Clone `val`, and the instructions of the entry block of
+// `__remill_basic_block` that it uses, into `func` with `ir`.
+static llvm::Value *CloneBlockValue(llvm::Value *val, llvm::IRBuilder<> &ir,
+                                    ValueMap &value_map) {
+  if (auto it = value_map.find(val); it != value_map.end()) {
+    return it->second;
+  }
+
+  auto inst = llvm::dyn_cast<llvm::Instruction>(val);
+  if (!inst) {
+    return val;  // E.g. a constant.
+  }
+
+  auto new_inst = inst->clone();
+  new_inst->setDebugLoc(llvm::DebugLoc());
+  for (auto &op : new_inst->operands()) {
+    op.set(CloneBlockValue(op.get(), ir, value_map));
+  }
+  ir.Insert(new_inst, inst->getName());
+  value_map[inst] = new_inst;
+  return new_inst;
+}
+
+// Clone the variable `name` of the `__remill_basic_block` function into the
+// entry block of `func`.
+llvm::Value *CloneBlockVariableInto(llvm::Function *func,
+                                    std::string_view name) {
+  auto bb_func = BasicBlockFunction(func->getParent());
+  auto var = llvm::dyn_cast_or_null<llvm::Instruction>(
+      FindVarInFunction(bb_func, name, true));
+  if (!var || func->empty()) {
+    return nullptr;
+  }
+
+  ValueMap value_map;
+  auto new_args = func->arg_begin();
+  for (llvm::Argument &old_arg : bb_func->args()) {
+    value_map[&old_arg] = &*new_args++;
+  }
+
+  auto &entry_block = func->getEntryBlock();
+  llvm::IRBuilder<> ir(&entry_block, entry_block.getFirstInsertionPt());
+  const auto new_var = CloneBlockValue(var, ir, value_map);
+  for (auto user : var->users()) {
+    if (auto store = llvm::dyn_cast<llvm::StoreInst>(user);
+        store && store->getPointerOperand() == var) {
+      CloneBlockValue(store, ir, value_map);
+    }
+  }
+  return new_var;
+}
+
 // Returns a list of callers of a specific function.
 std::vector<llvm::CallInst *> CallersOf(llvm::Function *func) {
   if (!func) {
@@ -839,6 +1316,22 @@ static void ClearMetaData(T *value) {
   }
 }
 
+// List the compile unit `unit` in `module`, so that the debug info of the
+// functions moved into `module` is kept.
+static void AddCompileUnit(llvm::DICompileUnit *unit, llvm::Module *module) {
+  const auto units = module->getOrInsertNamedMetadata("llvm.dbg.cu");
+  for (auto existing_unit : units->operands()) {
+    if (existing_unit == unit) {
+      return;
+    }
+  }
+  units->addOperand(unit);
+  if (!module->getModuleFlag("Debug Info Version")) {
+    module->addModuleFlag(llvm::Module::Warning, "Debug Info Version",
+                          llvm::DEBUG_METADATA_VERSION);
+  }
+}
+
 static llvm::Constant *MoveConstantIntoModule(llvm::Constant *c,
                                               llvm::Module *dest_module,
                                               ValueMap &value_map) {
@@ -1403,6 +1896,20 @@ llvm::Metadata *CloneMetadataInto(
   llvm::LLVMContext &source_context = source_mod->getContext();
   llvm::LLVMContext &dest_context = dest_mod->getContext();
 
+  // Metadata that doesn't refer to any values only depends on the contexts,
+  // and so can be shared by every transfer in the session.
+  const auto session = &source_context != &dest_context
+                           ? ContextTransferSession::Get(dest_context)
+                           : nullptr;
+  if (session) {
+    if (auto cached_it = session->metadata.find(md);
+        cached_it != session->metadata.end()) {
+      it->second = cached_it->second;
+      return cached_it->second;
+    }
+  }
+  auto cacheable = false;
+
   if (llvm::ValueAsMetadata *val_md = llvm::dyn_cast<llvm::ValueAsMetadata>(md)) {
     llvm::Value *val = val_md->getValue();
     if (auto it = value_map.find(val); it != value_map.end()) {
@@ -1426,9 +1933,11 @@ llvm::Metadata *CloneMetadataInto(
     } else {
       mapped_md = llvm::MDString::get(dest_context, str->getString());
     }
+    cacheable = true;
 
   } else if (llvm::MDTuple *tuple = llvm::dyn_cast<llvm::MDTuple>(md)) {
     std::vector<llvm::Metadata *> mapped_ops;
+    cacheable = true;
     for (llvm::Metadata *op : tuple->operands()) {
       auto mapped_op = CloneMetadataInto(source_mod, dest_mod, op, value_map,
                                          md_map);
@@ -1436,6 +1945,7 @@ llvm::Metadata *CloneMetadataInto(
         return nullptr;  // Possibly cyclic or just not clonable.
       } else {
         mapped_ops.push_back(mapped_op);
+        cacheable = cacheable && session && session->metadata.count(op);
       }
     }
     mapped_md = llvm::MDTuple::get(dest_context, mapped_ops);
@@ -1445,6 +1955,9 @@ llvm::Metadata *CloneMetadataInto(
     return nullptr;
   }
 
+  if (session && cacheable) {
+    session->metadata.emplace(md, mapped_md);
+  }
   it->second = mapped_md;
   return mapped_md;
 }
@@ -1616,98 +2129,519 @@ unsigned ReplaceAllUsesOfConstant(llvm::Constant *old_c, llvm::Constant *new_c,
 }
 
 // Move a function from one module into another module.
+void MoveFunctionIntoModule(llvm::Function *func, llvm::Module *dest_module) {
+  MoveFunctionsIntoModule({func}, dest_module);
+}
+
+// Move the functions `funcs` from their modules into `dest_module`.
 //
 // TODO(pag): Make this work across distinct `llvm::LLVMContext`s.
-void MoveFunctionIntoModule(llvm::Function *func, llvm::Module *dest_module) {
-  const auto source_context = &(func->getContext());
+void MoveFunctionsIntoModule(const std::vector<llvm::Function *> &funcs,
+                             llvm::Module *dest_module) {
   const auto dest_context = &(dest_module->getContext());
-  CHECK_EQ(source_context, dest_context)
-      << "Cannot move function across two independent LLVM contexts.";
 
-  auto source_module = func->getParent();
-  CHECK_NE(source_module, dest_module)
-      << "Cannot move function to the same module.";
+  // Shared by all of `funcs`, so that the globals and declarations that they
+  // reference are only moved or declared in `dest_module` once.
+  ValueMap value_map;
+
+  for (auto func : funcs) {
+    const auto source_context = &(func->getContext());
+    CHECK_EQ(source_context, dest_context)
+        << "Cannot move function across two independent LLVM contexts.";
+
+    auto source_module = func->getParent();
+    CHECK_NE(source_module, dest_module)
+        << "Cannot move function to the same module.";
+
+    const auto func_name = func->getName().str();
+    auto existing_decl_in_dest_module = dest_module->getFunction(func_name);
+    if (existing_decl_in_dest_module) {
+      CHECK_NE(existing_decl_in_dest_module, func);
+      CHECK_EQ(existing_decl_in_dest_module->getFunctionType(),
+               func->getFunctionType());
+
+      existing_decl_in_dest_module->setName(llvm::Twine::createNull());
+      existing_decl_in_dest_module->setLinkage(
+          llvm::GlobalValue::PrivateLinkage);
+      existing_decl_in_dest_module->setVisibility(
+          llvm::GlobalValue::DefaultVisibility);
+    }
 
-  const auto func_name = func->getName().str();
-  auto existing_decl_in_dest_module = dest_module->getFunction(func_name);
-  if (existing_decl_in_dest_module) {
-    CHECK_NE(existing_decl_in_dest_module, func);
-    CHECK_EQ(existing_decl_in_dest_module->getFunctionType(),
-             func->getFunctionType());
+    const auto in_same_context = source_context == dest_context;
+
+    // We need to possibly preserve `func` as a declaration in its source
+    // module.
+    func->setName(llvm::Twine::createNull());
+    auto replacement_decl_in_source_module = llvm::Function::Create(
+        func->getFunctionType(), func->getLinkage(), func_name, source_module);
+
+    replacement_decl_in_source_module->copyAttributesFrom(func);
+    replacement_decl_in_source_module->setVisibility(func->getVisibility());
+    replacement_decl_in_source_module->setCallingConv(func->getCallingConv());
+    if (func->hasSection()) {
+      replacement_decl_in_source_module->setSection(func->getSection());
+    }
+
+    // When mapping in the destination module, we'll reference `func` any time
+    // we see the `replacement_decl_in_source_module` or `func`. This also
+    // covers the uses of `func` by the other functions being moved.
+    (void) ReplaceAllUsesOfConstant(func, replacement_decl_in_source_module,
+                                    source_module);
+    value_map.emplace(replacement_decl_in_source_module, func);
+    value_map.emplace(func, func);
+
+    // Move `func` into the destination module.
+    if (in_same_context) {
+      func->removeFromParent();
+      func->setName(func_name);
+      dest_module->getFunctionList().push_back(func);
+
+    // TODO(pag): Probably clone it into the destination module.
+    } else {
+      LOG(FATAL) << "TODO: Not yet supported.";
+    }
 
-    existing_decl_in_dest_module->setName(llvm::Twine::createNull());
-    existing_decl_in_dest_module->setLinkage(llvm::GlobalValue::PrivateLinkage);
-    existing_decl_in_dest_module->setVisibility(
-        llvm::GlobalValue::DefaultVisibility);
+    // There was a prior existing_decl_in_dest_module declaration in out target
+    // module, so go and swap all uses of it with `func`. When doing this, we
+    // try to rewrite all constants that might use
+    // `existing_decl_in_dest_module` into constants that instead use `func`.
+    if (existing_decl_in_dest_module) {
+      value_map.emplace(existing_decl_in_dest_module, func);
+      if (!ReplaceAllUsesOfConstant(existing_decl_in_dest_module, func,
+                                    dest_module)) {
+        existing_decl_in_dest_module->eraseFromParent();
+      }
+      existing_decl_in_dest_module = nullptr;
+    }
+
+    // Debug info is kept, e.g. the locations added by
+    // `InstructionLifter::SetGuestPCDebugLocations`, as it belongs to the
+    // shared context.
+    const auto sp = func->getSubprogram();
+    IF_LLVM_GTE_370(ClearMetaData(func);)
+    if (sp) {
+      func->setSubprogram(sp);
+      AddCompileUnit(sp->getUnit(), dest_module);
+    }
+
+    // Fill up the locals so that they map to themselves.
+    for (auto &arg : func->args()) {
+      value_map.emplace(&arg, &arg);
+    }
+    for (auto &block : *func) {
+      value_map.emplace(&block, &block);
+      for (auto &inst : block) {
+        const auto loc = sp ? inst.getDebugLoc() : llvm::DebugLoc();
+        ClearMetaData(&inst);
+        if (loc) {
+          inst.setDebugLoc(loc);
+        }
+        value_map.emplace(&inst, &inst);
+      }
+    }
   }
 
-  const auto in_same_context = source_context == dest_context;
+  // Now move all non-locals, once every function has been moved, so that
+  // references between the moved functions resolve to the moved functions.
+  for (auto func : funcs) {
+    for (auto &block : *func) {
+      for (auto &inst : block) {
+        MoveInstructionIntoModule(&inst, dest_module, value_map);
+      }
+    }
+  }
+}
 
-  // We need to possibly preserve `func` as a declaration in its source module.
-  func->setName(llvm::Twine::createNull());
-  auto replacement_decl_in_source_module = llvm::Function::Create(
-      func->getFunctionType(), func->getLinkage(), func_name, source_module);
+namespace {
 
-  replacement_decl_in_source_module->copyAttributesFrom(func);
-  replacement_decl_in_source_module->setVisibility(func->getVisibility());
-  replacement_decl_in_source_module->setCallingConv(func->getCallingConv());
-  if (func->hasSection()) {
-    replacement_decl_in_source_module->setSection(func->getSection());
+// Serialize `module` into bitcode in `buffer`. The bitcode is only read back
+// by `ParseBitcodeBuffer`, so it isn't verified.
+static void WriteBitcodeToBuffer(llvm::Module *module,
+                                 llvm::SmallVectorImpl<char> &buffer) {
+  BitcodeStoreOptions options;
+  options.verify = false;
+  StoreModuleToBuffer(module, buffer, options);
+}
+
+// Parse the bitcode in `buffer` into `context`. If `lazy` is `true`, then
+// `buffer` must outlive the returned module.
+static std::unique_ptr<llvm::Module>
+ParseBitcodeBuffer(llvm::StringRef buffer, llvm::StringRef name,
+                   llvm::LLVMContext *context, bool lazy) {
+  llvm::SMDiagnostic err;
+  std::unique_ptr<llvm::Module> module;
+  if (lazy) {
+    module = llvm::getLazyIRModule(
+        llvm::MemoryBuffer::getMemBuffer(buffer, name, false), err, *context);
+  } else {
+    module = llvm::parseIR(llvm::MemoryBufferRef(buffer, name), err, *context);
+  }
+  CHECK(module) << "Unable to parse bitcode of module " << name.str() << ": "
+                << err.getMessage().str();
+  return module;
+}
+
+}  // namespace
+
+// Copy `module` into `context` by round-tripping it through bitcode in
+// memory.
+std::unique_ptr<llvm::Module> CopyModuleToContext(llvm::Module *module,
+                                                  llvm::LLVMContext *context) {
+  llvm::SmallVector<char, 0> buffer;
+  WriteBitcodeToBuffer(module, buffer);
+  return ParseBitcodeBuffer(llvm::StringRef(buffer.data(), buffer.size()),
+                            module->getModuleIdentifier(), context,
+                            false /* lazy */);
+}
+
+// Move the function definitions of `modules` into `dest_module`.
+void MergeModulesInto(const std::vector<llvm::Module *> &modules,
+                      llvm::Module *dest_module, unsigned num_threads) {
+  const auto dest_context = &(dest_module->getContext());
+
+  // Modules that share a context must be serialized by the same thread.
+  std::vector<std::vector<size_t>> groups;
+  std::unordered_map<llvm::LLVMContext *, size_t> context_group;
+  for (size_t i = 0; i < modules.size(); ++i) {
+    CHECK_NE(modules[i], dest_module);
+    const auto context = &(modules[i]->getContext());
+    if (context == dest_context) {
+      continue;
+    }
+    auto [it, added] = context_group.emplace(context, groups.size());
+    if (added) {
+      groups.emplace_back();
+    }
+    groups[it->second].push_back(i);
+  }
+
+  std::vector<llvm::SmallVector<char, 0>> buffers(modules.size());
+  std::atomic<size_t> next_group(0);
+  auto serialize = [&](void) {
+    for (auto g = next_group++; g < groups.size(); g = next_group++) {
+      for (auto i : groups[g]) {
+        WriteBitcodeToBuffer(modules[i], buffers[i]);
+      }
+    }
+  };
+
+  if (!num_threads) {
+    num_threads = std::thread::hardware_concurrency();
+  }
+  num_threads = std::max<size_t>(1u, std::min<size_t>(num_threads,
+                                                      groups.size()));
+  std::vector<std::thread> threads;
+  for (auto t = 1u; t < num_threads; ++t) {
+    threads.emplace_back(serialize);
+  }
+  serialize();
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  // Everything from here on is in `dest_context`, and so happens on this
+  // thread.
+  for (size_t i = 0; i < modules.size(); ++i) {
+    auto module = modules[i];
+    std::unique_ptr<llvm::Module> parsed_module;
+    if (&(module->getContext()) != dest_context) {
+      const auto &buffer = buffers[i];
+      parsed_module = ParseBitcodeBuffer(
+          llvm::StringRef(buffer.data(), buffer.size()),
+          module->getModuleIdentifier(), dest_context, true /* lazy */);
+      module = parsed_module.get();
+    }
+
+    // Keep the first definition of each function. The bodies of the others
+    // are never read.
+    std::vector<llvm::Function *> funcs;
+    for (auto &func : *module) {
+      if (func.isDeclaration()) {
+        continue;
+      }
+      auto dest_func = dest_module->getFunction(func.getName());
+      if (dest_func && !dest_func->isDeclaration()) {
+        func.deleteBody();
+      } else {
+        funcs.push_back(&func);
+      }
+    }
+
+    for (auto func : funcs) {
+      CHECK(MaterializeFunction(func))
+          << "Unable to read function " << func->getName().str()
+          << " from module " << module->getModuleIdentifier();
+    }
+
+    MoveFunctionsIntoModule(funcs, dest_module);
+  }
+}
+
+// Split the definitions of `module` into one module per element of `parts`.
+std::vector<std::unique_ptr<llvm::Module>>
+SplitModule(llvm::Module *module,
+            const std::vector<std::vector<llvm::Function *>> &parts) {
+  CHECK(!parts.empty());
+
+  std::unordered_map<const llvm::GlobalValue *, size_t> part_of;
+  for (size_t i = 0; i < parts.size(); ++i) {
+    for (auto func : parts[i]) {
+      CHECK_EQ(func->getParent(), module);
+      part_of.emplace(func, i);
+    }
+  }
+
+  // Definitions can be used from other parts, so they need names that can be
+  // linked against.
+  for (auto &gv : module->global_values()) {
+    if (gv.isDeclaration()) {
+      continue;
+    }
+    if (!gv.hasName()) {
+      gv.setName("split_module_global");
+    }
+    if (gv.hasLocalLinkage()) {
+      gv.setLinkage(llvm::GlobalValue::ExternalLinkage);
+      gv.setVisibility(llvm::GlobalValue::HiddenVisibility);
+    }
   }
 
+  std::vector<std::unique_ptr<llvm::Module>> split_modules;
+  split_modules.reserve(parts.size());
+  for (size_t i = 0; i < parts.size(); ++i) {
+    llvm::ValueToValueMapTy value_map;
+    auto split_module = llvm::CloneModule(
+        *module, value_map, [&](const llvm::GlobalValue *gv) {
+          const auto it = part_of.find(gv);
+          return it == part_of.end() ? i == 0 : it->second == i;
+        });
+    split_module->setModuleIdentifier(module->getModuleIdentifier() + "." +
+                                      std::to_string(i));
+
+    // Drop the declarations of the unused definitions of other parts, so
+    // that each part doesn't declare every function.
+    std::vector<llvm::GlobalValue *> unused;
+    for (auto &gv : split_module->global_values()) {
+      if (gv.isDeclaration() && gv.use_empty()) {
+        const auto orig_gv = module->getNamedValue(gv.getName());
+        if (orig_gv && !orig_gv->isDeclaration()) {
+          unused.push_back(&gv);
+        }
+      }
+    }
+    for (auto gv : unused) {
+      gv->eraseFromParent();
+    }
+
+    split_modules.push_back(std::move(split_module));
+  }
+
+  return split_modules;
+}
+
+// Create an empty module named `name` in `context` to lift into, which uses
+// the semantics functions of `semantics`.
+std::unique_ptr<llvm::Module> CreateThinModule(llvm::Module *semantics,
+                                               llvm::LLVMContext *context,
+                                               std::string_view name) {
+  std::unique_ptr<llvm::Module> module(new llvm::Module(
+      llvm::StringRef(name.data(), name.size()), *context));
+  module->setDataLayout(semantics->getDataLayout());
+  module->setTargetTriple(semantics->getTargetTriple());
+
   ValueMap value_map;
+  for (auto &func : *semantics) {
+    if (func.getName().startswith("__remill_") && !func.hasLocalLinkage()) {
+      DeclareFunctionInModule(&func, module.get(), value_map);
+    }
+  }
 
-  // When mapping in the destination module, we'll reference `func` any time
-  // we see the `replacement_decl_in_source_module` or `func`.
-  (void) ReplaceAllUsesOfConstant(func, replacement_decl_in_source_module,
-                                  source_module);
-  value_map.emplace(replacement_decl_in_source_module, func);
-  value_map.emplace(func, func);
+  const auto bb_func = BasicBlockFunction(semantics);
+  CHECK(!bb_func->isMaterializable() || MaterializeFunction(bb_func))
+      << "Unable to read the body of " << bb_func->getName().str();
+  CloneFunctionInto(bb_func, module->getFunction(bb_func->getName()));
+  return module;
+}
 
-  // Move `func` into the destination module.
-  if (in_same_context) {
-    func->removeFromParent();
-    func->setName(func_name);
-    dest_module->getFunctionList().push_back(func);
+// Declare the semantics function `sem` of the instruction function named
+// `function` in `dest_module`, along with its `ISEL_` variable.
+llvm::Function *DeclareISelInModule(std::string_view function,
+                                    llvm::Function *sem,
+                                    llvm::Module *dest_module) {
+  auto &dest_context = dest_module->getContext();
+  auto dest_func = dest_module->getFunction(sem->getName());
+  if (!dest_func) {
+    const auto func_type = llvm::dyn_cast<llvm::FunctionType>(
+        RecontextualizeType(sem->getFunctionType(), dest_context));
+    dest_func =
+        llvm::Function::Create(func_type, llvm::GlobalValue::ExternalLinkage,
+                               sem->getName(), dest_module);
+    dest_func->setCallingConv(sem->getCallingConv());
+    if (&dest_context == &(sem->getContext())) {
+      dest_func->setAttributes(sem->getAttributes());
+    }
+  }
 
-  // TODO(pag): Probably clone it into the destination module.
-  } else {
-    LOG(FATAL) << "TODO: Not yet supported.";
+  std::stringstream ss;
+  ss << "ISEL_" << function;
+  const auto isel_name = ss.str();
+  if (!dest_module->getGlobalVariable(isel_name, true)) {
+    (void) new llvm::GlobalVariable(
+        *dest_module, dest_func->getType(), true,
+        llvm::GlobalValue::InternalLinkage, dest_func, isel_name);
   }
 
-  // There was a prior existing_decl_in_dest_module declaration in out target
-  // module, so go and swap all uses of it with `func`. When doing this, we try
-  // to rewrite all constants that might use `existing_decl_in_dest_module` into
-  // constants that instead use `func`.
-  if (existing_decl_in_dest_module) {
-    value_map.emplace(existing_decl_in_dest_module, func);
-    if (!ReplaceAllUsesOfConstant(existing_decl_in_dest_module, func,
-                                  dest_module)) {
-      existing_decl_in_dest_module->eraseFromParent();
+  return dest_func;
+}
+
+namespace {
+
+// Declare the functions with local linkage that `func` uses in
+// `dest_module`. `DeclareFunctionInModule` refuses to do this, because the
+// declarations are only valid until `LinkSemanticsInto` copies in their
+// bodies, which restores their linkage.
+static void DeclareLocalFunctionsInModule(llvm::Function *func,
+                                          llvm::Module *dest_module,
+                                          ValueMap &value_map) {
+  std::vector<llvm::Constant *> work_list;
+  std::unordered_set<llvm::Constant *> seen;
+  for (auto &inst : llvm::instructions(*func)) {
+    for (auto &op : inst.operands()) {
+      if (auto c = llvm::dyn_cast<llvm::Constant>(op.get());
+          c && seen.insert(c).second) {
+        work_list.push_back(c);
+      }
     }
-    existing_decl_in_dest_module = nullptr;
   }
 
-  IF_LLVM_GTE_370(ClearMetaData(func);)
+  auto &dest_context = dest_module->getContext();
+  while (!work_list.empty()) {
+    const auto c = work_list.back();
+    work_list.pop_back();
 
-  // Fill up the locals so that they map to themselves.
-  for (auto &arg : func->args()) {
-    value_map.emplace(&arg, &arg);
+    if (auto used_func = llvm::dyn_cast<llvm::Function>(c)) {
+      if (!used_func->hasLocalLinkage() || value_map.count(used_func)) {
+        continue;
+      }
+      auto dest_func = dest_module->getFunction(used_func->getName());
+      if (!dest_func) {
+        dest_func = llvm::Function::Create(
+            llvm::dyn_cast<llvm::FunctionType>(RecontextualizeType(
+                used_func->getFunctionType(), dest_context)),
+            llvm::GlobalValue::ExternalLinkage, used_func->getName(),
+            dest_module);
+      }
+      value_map[used_func] = dest_func;
+
+    // Variables are copied with their initializers, and so are searched
+    // by `LinkSemanticsInto` once they're in `dest_module`.
+    } else if (!llvm::isa<llvm::GlobalValue>(c)) {
+      for (auto &op : c->operands()) {
+        if (auto op_c = llvm::dyn_cast<llvm::Constant>(op.get());
+            op_c && seen.insert(op_c).second) {
+          work_list.push_back(op_c);
+        }
+      }
+    }
   }
-  for (auto &block : *func) {
-    value_map.emplace(&block, &block);
-    for (auto &inst : block) {
-      ClearMetaData(&inst);
-      value_map.emplace(&inst, &inst);
+}
+
+}  // namespace
+
+// Define the functions and variables that `module` declares and `semantics`
+// defines by copying them from `semantics`.
+void LinkSemanticsInto(llvm::Module *module, llvm::Module *semantics) {
+  ValueMap value_map;
+  MDMap md_map;
+  std::vector<std::pair<llvm::Function *, llvm::Function *>> funcs;
+  std::vector<std::pair<llvm::GlobalVariable *, llvm::GlobalVariable *>> vars;
+
+  // Copying in a body can declare more functions and variables, so repeat
+  // until there is nothing left to copy.
+  do {
+    funcs.clear();
+    vars.clear();
+
+    for (auto &func : *module) {
+      if (func.isDeclaration() && !func.isIntrinsic()) {
+        if (auto src_func = semantics->getFunction(func.getName());
+            src_func && !src_func->isDeclaration()) {
+          funcs.emplace_back(src_func, &func);
+        }
+      }
+    }
+
+    for (auto &var : module->globals()) {
+      if (var.isDeclaration()) {
+        if (auto src_var = semantics->getGlobalVariable(var.getName(), true);
+            src_var && src_var->hasInitializer()) {
+          vars.emplace_back(src_var, &var);
+        }
+      }
+    }
+
+    for (auto [src_var, var] : vars) {
+      value_map[src_var] = var;
+      var->setInitializer(
+          MoveConstantIntoModule(src_var->getInitializer(), module, value_map));
+    }
+
+    for (auto [src_func, func] : funcs) {
+      CHECK(!src_func->isMaterializable() || MaterializeFunction(src_func))
+          << "Unable to read the body of " << src_func->getName().str();
+
+      value_map[src_func] = func;
+      auto dest_arg = func->arg_begin();
+      for (auto &src_arg : src_func->args()) {
+        value_map[&src_arg] = &*dest_arg++;
+      }
+
+      DeclareLocalFunctionsInModule(src_func, module, value_map);
+      CloneFunctionInto(src_func, func, value_map, md_map);
+    }
+  } while (!funcs.empty() || !vars.empty());
+}
+
+// Store each of `modules` into the file at the same index of `file_names`.
+bool StoreModulesToFiles(const std::vector<llvm::Module *> &modules,
+                         const std::vector<std::string> &file_names,
+                         unsigned num_threads, bool allow_failure) {
+  CHECK_EQ(modules.size(), file_names.size());
+
+  for (auto module : modules) {
+    if (module->materializeAll()) {
+      LOG_IF(FATAL, !allow_failure)
+          << "Unable to materialize everything from "
+          << module->getModuleIdentifier();
+      return false;
     }
   }
 
-  // Now move all non-locals.
-  for (auto &block : *func) {
-    for (auto &inst : block) {
-      MoveInstructionIntoModule(&inst, dest_module, value_map);
+  std::atomic<size_t> next_module(0);
+  std::atomic<bool> stored(true);
+  auto store = [&](void) {
+    for (auto i = next_module++; i < modules.size(); i = next_module++) {
+      if (!StoreModuleToFile(modules[i], file_names[i], allow_failure)) {
+        stored = false;
+      }
     }
+  };
+
+  if (!num_threads) {
+    num_threads = std::thread::hardware_concurrency();
   }
+  num_threads = std::max<size_t>(1u, std::min<size_t>(num_threads,
+                                                      modules.size()));
+  std::vector<std::thread> threads;
+  for (auto t = 1u; t < num_threads; ++t) {
+    threads.emplace_back(store);
+  }
+  store();
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  return stored;
 }
 
 namespace {
@@ -1813,35 +2747,248 @@ llvm::Type *RecontextualizeType(llvm::Type *type, llvm::LLVMContext &context) {
     return type;
   }
 
+  if (auto session = ContextTransferSession::Get(context)) {
+    return RecontextualizeType(type, context, session->types);
+  }
+
   std::unordered_map<llvm::Type *, llvm::Type *> cache;
   return RecontextualizeType(type, context, cache);
 }
 
-// Produce a sequence of instructions that will load values from
-// memory, building up the correct type. This will invoke the various
-// memory read intrinsics in order to match the right type, or
-// recursively build up the right type.
-llvm::Value *LoadFromMemory(const IntrinsicTable &intrinsics,
-                            llvm::BasicBlock *block, llvm::Type *type,
-                            llvm::Value *mem_ptr, llvm::Value *addr) {
+namespace {
+
+// The innermost live session of this thread.
+static thread_local ContextTransferSession *gTransferSession = nullptr;
+
+}  // namespace
+
+ContextTransferSession::ContextTransferSession(
+    llvm::LLVMContext &dest_context_)
+    : dest_context(dest_context_),
+      outer(gTransferSession) {
+  gTransferSession = this;
+}
+
+ContextTransferSession::~ContextTransferSession(void) {
+  CHECK_EQ(gTransferSession, this)
+      << "Context transfer sessions must be destroyed in reverse order";
+  gTransferSession = outer;
+}
+
+// Returns the innermost live session on this thread if it transfers into
+// `context`, or `nullptr`.
+ContextTransferSession *ContextTransferSession::Get(
+    llvm::LLVMContext &context) {
+  if (gTransferSession && &(gTransferSession->dest_context) == &context) {
+    return gTransferSession;
+  }
+  return nullptr;
+}
+
+namespace {
+
+// Make sure that `alloca` is aligned to at least `align` bytes.
+static void SetMinAlignment(llvm::AllocaInst *alloca, unsigned align) {
+  if (alloca->getAlignment() >= align) {
+    return;
+  }
+#if LLVM_VERSION_NUMBER >= LLVM_VERSION(11, 0)
+  alloca->setAlignment(llvm::Align(align));
+#elif LLVM_VERSION_NUMBER >= LLVM_VERSION(10, 0)
+  alloca->setAlignment(llvm::MaybeAlign(align));
+#else
+  alloca->setAlignment(align);
+#endif
+}
+
+}  // namespace
+
+class MemoryAccessEmitter::Impl {
+ public:
+  explicit Impl(const IntrinsicTable &intrinsics_);
+
+  llvm::Value *Load(llvm::IRBuilder<> &ir, llvm::Type *type,
+                    llvm::Value *mem_ptr, llvm::Value *addr);
+
+  llvm::Value *Store(llvm::IRBuilder<> &ir, llvm::Value *val_to_store,
+                     llvm::Value *mem_ptr, llvm::Value *addr);
+
+ private:
+  // Returns the number of bytes that hold the elements of `type` if it is a
+  // vector or array that can be accessed in bulk, or `0`.
+  uint64_t BulkSize(llvm::Type *type);
+
+  // Read `size` bytes of memory at `addr` into `res` (resp. write `size`
+  // bytes of `res` to memory at `addr`), eight bytes at a time where
+  // possible.
+  void ReadBytes(llvm::IRBuilder<> &ir, llvm::AllocaInst *res,
+                 uint64_t size, llvm::Value *mem_ptr, llvm::Value *addr);
+  llvm::Value *WriteBytes(llvm::IRBuilder<> &ir, llvm::AllocaInst *res,
+                          uint64_t size, llvm::Value *mem_ptr,
+                          llvm::Value *addr);
+
+  // Returns `addr + offset`.
+  llvm::Value *Offset(llvm::IRBuilder<> &ir, llvm::Value *addr,
+                      uint64_t offset);
+
+  llvm::Function *FromFP16(void);
+  llvm::Function *ToFP16(void);
+
+  const IntrinsicTable &intrinsics;
+  llvm::Module *const module;
+  llvm::LLVMContext &context;
+  const llvm::DataLayout dl;
+  llvm::Type *const byte_type;
+  llvm::Type *const float_type;
+  llvm::Function *from_fp16{nullptr};
+  llvm::Function *to_fp16{nullptr};
+};
+
+MemoryAccessEmitter::Impl::Impl(const IntrinsicTable &intrinsics_)
+    : intrinsics(intrinsics_),
+      module(intrinsics.error->getParent()),
+      context(module->getContext()),
+      dl(module),
+      byte_type(llvm::Type::getInt8Ty(context)),
+      float_type(llvm::Type::getFloatTy(context)) {}
+
+llvm::Function *MemoryAccessEmitter::Impl::FromFP16(void) {
+  if (!from_fp16) {
+    llvm::Type *types[] = {float_type};
+    from_fp16 = llvm::Intrinsic::getDeclaration(
+        module, llvm::Intrinsic::convert_from_fp16, types);
+  }
+  return from_fp16;
+}
+
+llvm::Function *MemoryAccessEmitter::Impl::ToFP16(void) {
+  if (!to_fp16) {
+    llvm::Type *types[] = {float_type};
+    to_fp16 = llvm::Intrinsic::getDeclaration(
+        module, llvm::Intrinsic::convert_to_fp16, types);
+  }
+  return to_fp16;
+}
+
+llvm::Value *MemoryAccessEmitter::Impl::Offset(llvm::IRBuilder<> &ir,
+                                               llvm::Value *addr,
+                                               uint64_t offset) {
+  return ir.CreateAdd(addr, llvm::ConstantInt::get(addr->getType(), offset,
+                                                   false));
+}
+
+// Vectors and arrays of whole-byte integers and of `float`s and `double`s
+// have the same bytes in memory as in a stack slot, and so can be moved
+// between the two in bulk.
+uint64_t MemoryAccessEmitter::Impl::BulkSize(llvm::Type *type) {
+  llvm::Type *elem_type = nullptr;
+  uint64_t num_elems = 0;
+  if (auto vec_type = llvm::dyn_cast<llvm::FixedVectorType>(type)) {
+    elem_type = vec_type->getElementType();
+    num_elems = vec_type->getNumElements();
+  } else if (auto arr_type = llvm::dyn_cast<llvm::ArrayType>(type)) {
+    elem_type = arr_type->getElementType();
+    num_elems = arr_type->getNumElements();
+  } else {
+    return 0;
+  }
+
+  if (elem_type->isIntegerTy()) {
+    if (elem_type->getIntegerBitWidth() % 8 ||
+        dl.getTypeStoreSize(elem_type) != dl.getTypeAllocSize(elem_type)) {
+      return 0;
+    }
+  } else if (!elem_type->isFloatTy() && !elem_type->isDoubleTy()) {
+    return 0;
+  }
+
+  if (num_elems < 2) {
+    return 0;
+  }
+  return num_elems * dl.getTypeAllocSize(elem_type);
+}
+
+void MemoryAccessEmitter::Impl::ReadBytes(llvm::IRBuilder<> &ir,
+                                          llvm::AllocaInst *res, uint64_t size,
+                                          llvm::Value *mem_ptr,
+                                          llvm::Value *addr) {
+  SetMinAlignment(res, 8);
+  auto bytes = ir.CreateBitCast(res, llvm::PointerType::get(byte_type, 0));
+  for (uint64_t offset = 0; offset < size;) {
+    llvm::Function *read = intrinsics.read_memory_8;
+    uint64_t chunk = 1;
+    if (size - offset >= 8) {
+      read = intrinsics.read_memory_64;
+      chunk = 8;
+    } else if (size - offset >= 4) {
+      read = intrinsics.read_memory_32;
+      chunk = 4;
+    } else if (size - offset >= 2) {
+      read = intrinsics.read_memory_16;
+      chunk = 2;
+    }
 
-  const auto initial_addr = addr;
-  auto module = intrinsics.error->getParent();
-  auto &context = module->getContext();
-  llvm::DataLayout dl(module);
+    // Chunks are naturally aligned within `res`, as their sizes only shrink.
+    llvm::Value *args_2[2] = {mem_ptr, Offset(ir, addr, offset)};
+    auto val = ir.CreateCall(read, args_2);
+    auto ptr = ir.CreateConstInBoundsGEP1_64(byte_type, bytes, offset);
+    ir.CreateStore(val, ir.CreateBitCast(
+                            ptr, llvm::PointerType::get(val->getType(), 0)));
+    offset += chunk;
+  }
+}
+
+llvm::Value *MemoryAccessEmitter::Impl::WriteBytes(llvm::IRBuilder<> &ir,
+                                                   llvm::AllocaInst *res,
+                                                   uint64_t size,
+                                                   llvm::Value *mem_ptr,
+                                                   llvm::Value *addr) {
+  SetMinAlignment(res, 8);
+  auto bytes = ir.CreateBitCast(res, llvm::PointerType::get(byte_type, 0));
+  for (uint64_t offset = 0; offset < size;) {
+    llvm::Function *write = intrinsics.write_memory_8;
+    uint64_t chunk = 1;
+    if (size - offset >= 8) {
+      write = intrinsics.write_memory_64;
+      chunk = 8;
+    } else if (size - offset >= 4) {
+      write = intrinsics.write_memory_32;
+      chunk = 4;
+    } else if (size - offset >= 2) {
+      write = intrinsics.write_memory_16;
+      chunk = 2;
+    }
+
+    const auto chunk_type =
+        llvm::Type::getIntNTy(context, static_cast<unsigned>(chunk * 8));
+    auto ptr = ir.CreateConstInBoundsGEP1_64(byte_type, bytes, offset);
+    auto val = ir.CreateLoad(
+        chunk_type,
+        ir.CreateBitCast(ptr, llvm::PointerType::get(chunk_type, 0)));
+    llvm::Value *args_3[3] = {mem_ptr, Offset(ir, addr, offset), val};
+    mem_ptr = ir.CreateCall(write, args_3);
+    offset += chunk;
+  }
+  return mem_ptr;
+}
+
+llvm::Value *MemoryAccessEmitter::Impl::Load(llvm::IRBuilder<> &ir,
+                                             llvm::Type *type,
+                                             llvm::Value *mem_ptr,
+                                             llvm::Value *addr) {
   llvm::Value *args_2[2] = {mem_ptr, addr};
-  auto index_type = llvm::Type::getIntNTy(context, dl.getPointerSizeInBits(0));
 
-  llvm::IRBuilder<> ir(block);
+  if (const auto bulk_size = BulkSize(type)) {
+    auto res = ir.CreateAlloca(type);
+    ReadBytes(ir, res, bulk_size, mem_ptr, addr);
+    return ir.CreateLoad(type, res);
+  }
 
   switch (type->getTypeID()) {
     case llvm::Type::HalfTyID: {
-      llvm::Type *types[] = {llvm::Type::getFloatTy(context)};
-      auto converter = llvm::Intrinsic::getDeclaration(
-          module, llvm::Intrinsic::convert_from_fp16, types);
       llvm::Value *conv_args[] = {
           ir.CreateCall(intrinsics.read_memory_16, args_2)};
-      return ir.CreateFPTrunc(ir.CreateCall(converter, conv_args), type);
+      return ir.CreateFPTrunc(ir.CreateCall(FromFP16(), conv_args), type);
     }
 
     case llvm::Type::FloatTyID:
@@ -1868,31 +3015,12 @@ llvm::Value *LoadFromMemory(const IntrinsicTable &intrinsics,
       }
       [[clang::fallthrough]];
 
+    // Read the bytes of the value into a stack slot, then load it from there.
     case llvm::Type::FP128TyID:
     case llvm::Type::PPC_FP128TyID: {
-      const auto size = dl.getTypeAllocSize(type);
       auto res = ir.CreateAlloca(type);
-
-      auto i8_array =
-          llvm::ArrayType::get(llvm::Type::getInt8Ty(context), size);
-      auto byte_array =
-          ir.CreateBitCast(res, llvm::PointerType::get(i8_array, 0));
-
-      auto gep_zero = llvm::ConstantInt::get(index_type, 0, false);
-      // Load one byte at a time from memory, and store it into
-      // `res`.
-      for (auto i = 0U; i < size; ++i) {
-        llvm::Value *gep_indices[2] = {
-            gep_zero, llvm::ConstantInt::get(index_type, i, false)};
-        auto call_arg_addr = ir.CreateAdd(
-            addr, llvm::ConstantInt::get(addr->getType(), i, false));
-        llvm::Value* call_args[2] = {mem_ptr, call_arg_addr};
-        auto byte = ir.CreateCall(intrinsics.read_memory_8, llvm::makeArrayRef(call_args));
-        auto byte_ptr = ir.CreateInBoundsGEP(i8_array, byte_array, llvm::makeArrayRef(gep_indices));
-        ir.CreateStore(byte, byte_ptr);
-      }
-
-      return ir.CreateLoad(res);
+      ReadBytes(ir, res, dl.getTypeAllocSize(type), mem_ptr, addr);
+      return ir.CreateLoad(type, res);
     }
 
     // Building up a structure requires us to start with an undef value,
@@ -1905,11 +3033,7 @@ llvm::Value *LoadFromMemory(const IntrinsicTable &intrinsics,
       for (auto i = 0u; i < num_elems; ++i) {
         const auto elem_type = struct_type->getStructElementType(i);
         const auto offset = layout->getElementOffset(i);
-        addr = ir.CreateAdd(initial_addr, llvm::ConstantInt::get(
-                                              addr->getType(), offset, false));
-        auto elem_val =
-            LoadFromMemory(intrinsics, block, elem_type, mem_ptr, addr);
-        ir.SetInsertPoint(block);
+        auto elem_val = Load(ir, elem_type, mem_ptr, Offset(ir, addr, offset));
         unsigned indexes[] = {i};
         val = ir.CreateInsertValue(val, elem_val, indexes);
       }
@@ -1926,12 +3050,8 @@ llvm::Value *LoadFromMemory(const IntrinsicTable &intrinsics,
 
       for (uint64_t index = 0, offset = 0; index < num_elems;
            ++index, offset += elem_size) {
-        addr = ir.CreateAdd(initial_addr, llvm::ConstantInt::get(
-                                              addr->getType(), offset, false));
         unsigned indexes[] = {static_cast<unsigned>(index)};
-        auto elem_val =
-            LoadFromMemory(intrinsics, block, elem_type, mem_ptr, addr);
-        ir.SetInsertPoint(block);
+        auto elem_val = Load(ir, elem_type, mem_ptr, Offset(ir, addr, offset));
         val = ir.CreateInsertValue(val, elem_val, indexes);
       }
       return val;
@@ -1944,9 +3064,7 @@ llvm::Value *LoadFromMemory(const IntrinsicTable &intrinsics,
       auto size_bits = dl.getTypeAllocSizeInBits(ptr_type);
       auto intptr_type =
           llvm::IntegerType::get(context, static_cast<unsigned>(size_bits));
-      auto addr_val =
-          LoadFromMemory(intrinsics, block, intptr_type, mem_ptr, addr);
-      ir.SetInsertPoint(block);
+      auto addr_val = Load(ir, intptr_type, mem_ptr, addr);
       return ir.CreateIntToPtr(addr_val, ptr_type);
     }
 
@@ -1960,11 +3078,7 @@ llvm::Value *LoadFromMemory(const IntrinsicTable &intrinsics,
 
       for (uint64_t index = 0, offset = 0; index < num_elems;
            ++index, offset += elem_size) {
-        addr = ir.CreateAdd(initial_addr, llvm::ConstantInt::get(
-                                              addr->getType(), offset, false));
-        auto elem_val =
-            LoadFromMemory(intrinsics, block, elem_type, mem_ptr, addr);
-        ir.SetInsertPoint(block);
+        auto elem_val = Load(ir, elem_type, mem_ptr, Offset(ir, addr, offset));
         val =
             ir.CreateInsertElement(val, elem_val, static_cast<unsigned>(index));
       }
@@ -1983,34 +3097,23 @@ llvm::Value *LoadFromMemory(const IntrinsicTable &intrinsics,
   }
 }
 
-// Produce a sequence of instructions that will store a value to
-// memory. This will invoke the various memory write intrinsics
-// in order to match the right type, or recursively destructure
-// the type into components which can be written to memory.
-//
-// Returns the new value of the memory pointer.
-llvm::Value *StoreToMemory(const IntrinsicTable &intrinsics,
-                           llvm::BasicBlock *block, llvm::Value *val_to_store,
-                           llvm::Value *mem_ptr, llvm::Value *addr) {
-
-  const auto initial_addr = addr;
-  auto module = intrinsics.error->getParent();
-  auto &context = module->getContext();
-  llvm::DataLayout dl(module);
+llvm::Value *MemoryAccessEmitter::Impl::Store(llvm::IRBuilder<> &ir,
+                                              llvm::Value *val_to_store,
+                                              llvm::Value *mem_ptr,
+                                              llvm::Value *addr) {
   llvm::Value *args_3[3] = {mem_ptr, addr, val_to_store};
-  auto index_type = llvm::Type::getInt32Ty(context);
-
-  llvm::IRBuilder<> ir(block);
 
   auto type = val_to_store->getType();
+  if (const auto bulk_size = BulkSize(type)) {
+    auto res = ir.CreateAlloca(type);
+    ir.CreateStore(val_to_store, res);
+    return WriteBytes(ir, res, bulk_size, mem_ptr, addr);
+  }
+
   switch (type->getTypeID()) {
     case llvm::Type::HalfTyID: {
-      llvm::Type *types[] = {llvm::Type::getFloatTy(context)};
-      auto converter = llvm::Intrinsic::getDeclaration(
-          module, llvm::Intrinsic::convert_to_fp16, types);
-      llvm::Value *conv_args[] = {
-          ir.CreateFPExt(val_to_store, llvm::Type::getFloatTy(context))};
-      args_3[2] = ir.CreateCall(converter, conv_args);
+      llvm::Value *conv_args[] = {ir.CreateFPExt(val_to_store, float_type)};
+      args_3[2] = ir.CreateCall(ToFP16(), conv_args);
 
       return ir.CreateCall(intrinsics.write_memory_16, args_3);
     }
@@ -2043,34 +3146,13 @@ llvm::Value *StoreToMemory(const IntrinsicTable &intrinsics,
       }
       [[clang::fallthrough]];
 
+    // Stack-allocate the value, so we can pull out its bytes and write them
+    // into the target address space.
     case llvm::Type::FP128TyID:
     case llvm::Type::PPC_FP128TyID: {
-      const auto size = dl.getTypeAllocSize(type);
-
-      // Stack-allocate the value, so we can pull out one byte
-      // at a time from it, and then write it into the target
-      // address space.
       auto res = ir.CreateAlloca(type);
       ir.CreateStore(val_to_store, res);
-
-      auto i8_array =
-          llvm::ArrayType::get(llvm::Type::getInt8Ty(context), size);
-      auto byte_array =
-          ir.CreateBitCast(res, llvm::PointerType::get(i8_array, 0));
-      llvm::Value *gep_indices[2] = {
-          llvm::ConstantInt::get(index_type, 0, false), nullptr};
-
-      // Store one byte at a time to memory.
-      for (auto i = 0U; i < size; ++i) {
-        args_3[1] = ir.CreateAdd(
-            addr, llvm::ConstantInt::get(addr->getType(), i, false));
-        gep_indices[1] = llvm::ConstantInt::get(index_type, i, false);
-        auto byte_ptr = ir.CreateInBoundsGEP(i8_array, byte_array, gep_indices);
-        args_3[2] = ir.CreateLoad(byte_ptr);
-        args_3[0] = ir.CreateCall(intrinsics.write_memory_8, args_3);
-      }
-
-      return args_3[0];
+      return WriteBytes(ir, res, dl.getTypeAllocSize(type), mem_ptr, addr);
     }
 
     // Store a structure by storing the individual elements of the structure.
@@ -2080,14 +3162,9 @@ llvm::Value *StoreToMemory(const IntrinsicTable &intrinsics,
       const auto num_elems = struct_type->getNumElements();
       for (auto i = 0u; i < num_elems; ++i) {
         const auto offset = layout->getElementOffset(i);
-        const auto elem_addr = ir.CreateAdd(
-            initial_addr,
-            llvm::ConstantInt::get(addr->getType(), offset, false));
         unsigned indexes[] = {i};
         const auto elem_val = ir.CreateExtractValue(val_to_store, indexes);
-        mem_ptr =
-            StoreToMemory(intrinsics, block, elem_val, mem_ptr, elem_addr);
-        ir.SetInsertPoint(block);
+        mem_ptr = Store(ir, elem_val, mem_ptr, Offset(ir, addr, offset));
       }
       return mem_ptr;
     }
@@ -2101,17 +3178,9 @@ llvm::Value *StoreToMemory(const IntrinsicTable &intrinsics,
 
       for (uint64_t index = 0, offset = 0; index < num_elems;
            ++index, offset += elem_size) {
-
-        auto elem_addr = ir.CreateAdd(
-            initial_addr,
-            llvm::ConstantInt::get(addr->getType(), offset, false));
         unsigned indexes[] = {static_cast<unsigned>(index)};
         auto elem_val = ir.CreateExtractValue(val_to_store, indexes);
-        mem_ptr =
-            StoreToMemory(intrinsics, block, elem_val, mem_ptr, elem_addr);
-        ir.SetInsertPoint(block);
-        offset += elem_size;
-        index += 1;
+        mem_ptr = Store(ir, elem_val, mem_ptr, Offset(ir, addr, offset));
       }
       return mem_ptr;
     }
@@ -2123,9 +3192,8 @@ llvm::Value *StoreToMemory(const IntrinsicTable &intrinsics,
       auto size_bits = dl.getTypeAllocSizeInBits(ptr_type);
       auto intptr_type =
           llvm::IntegerType::get(context, static_cast<unsigned>(size_bits));
-      return StoreToMemory(intrinsics, block,
-                           ir.CreatePtrToInt(val_to_store, intptr_type),
-                           mem_ptr, addr);
+      return Store(ir, ir.CreatePtrToInt(val_to_store, intptr_type), mem_ptr,
+                   addr);
     }
 
     // Build up the vector store in the nearly the same was as we do with arrays.
@@ -2137,17 +3205,9 @@ llvm::Value *StoreToMemory(const IntrinsicTable &intrinsics,
 
       for (uint64_t index = 0, offset = 0; index < num_elems;
            ++index, offset += elem_size) {
-
-        auto elem_addr = ir.CreateAdd(
-            initial_addr,
-            llvm::ConstantInt::get(addr->getType(), offset, false));
         auto elem_val =
             ir.CreateExtractElement(val_to_store, static_cast<unsigned>(index));
-        mem_ptr =
-            StoreToMemory(intrinsics, block, elem_val, mem_ptr, elem_addr);
-        ir.SetInsertPoint(block);
-        offset += elem_size;
-        index += 1;
+        mem_ptr = Store(ir, elem_val, mem_ptr, Offset(ir, addr, offset));
       }
 
       return mem_ptr;
@@ -2165,6 +3225,53 @@ llvm::Value *StoreToMemory(const IntrinsicTable &intrinsics,
   }
 }
 
+MemoryAccessEmitter::MemoryAccessEmitter(const IntrinsicTable &intrinsics)
+    : impl(new Impl(intrinsics)) {}
+
+MemoryAccessEmitter::~MemoryAccessEmitter(void) {}
+
+// Produce a sequence of instructions at the end of `block` that will load a
+// value of type `type` from memory.
+llvm::Value *MemoryAccessEmitter::Load(llvm::BasicBlock *block,
+                                       llvm::Type *type, llvm::Value *mem_ptr,
+                                       llvm::Value *addr) {
+  llvm::IRBuilder<> ir(block);
+  return impl->Load(ir, type, mem_ptr, addr);
+}
+
+// Produce a sequence of instructions at the end of `block` that will store
+// `val_to_store` to memory.
+llvm::Value *MemoryAccessEmitter::Store(llvm::BasicBlock *block,
+                                        llvm::Value *val_to_store,
+                                        llvm::Value *mem_ptr,
+                                        llvm::Value *addr) {
+  llvm::IRBuilder<> ir(block);
+  return impl->Store(ir, val_to_store, mem_ptr, addr);
+}
+
+// Produce a sequence of instructions that will load values from
+// memory, building up the correct type. This will invoke the various
+// memory read intrinsics in order to match the right type, or
+// recursively build up the right type.
+llvm::Value *LoadFromMemory(const IntrinsicTable &intrinsics,
+                            llvm::BasicBlock *block, llvm::Type *type,
+                            llvm::Value *mem_ptr, llvm::Value *addr) {
+  return MemoryAccessEmitter(intrinsics).Load(block, type, mem_ptr, addr);
+}
+
+// Produce a sequence of instructions that will store a value to
+// memory. This will invoke the various memory write intrinsics
+// in order to match the right type, or recursively destructure
+// the type into components which can be written to memory.
+//
+// Returns the new value of the memory pointer.
+llvm::Value *StoreToMemory(const IntrinsicTable &intrinsics,
+                           llvm::BasicBlock *block, llvm::Value *val_to_store,
+                           llvm::Value *mem_ptr, llvm::Value *addr) {
+  return MemoryAccessEmitter(intrinsics).Store(block, val_to_store, mem_ptr,
+                                               addr);
+}
+
 // Create an array of index values to pass to a GetElementPtr instruction
 // that will let us locate a particular register. Returns the final offset
 // into `type` which was reached as the first value in the pair, and the type
@@ -0,0 +1,900 @@
+/*
+ * Copyright (c) 2020 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <glog/logging.h>
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/ADT/StringMap.h>
+#include <llvm/Bitcode/BitcodeReader.h>
+#include <llvm/Bitcode/BitcodeWriter.h>
+#include <llvm/Config/llvm-config.h>
+#include <llvm/DebugInfo/DIContext.h>
+#include <llvm/DebugInfo/DWARF/DWARFContext.h>
+#include <llvm/ExecutionEngine/JITEventListener.h>
+#include <llvm/ExecutionEngine/ObjectCache.h>
+#include <llvm/ExecutionEngine/Orc/CompileUtils.h>
+#include <llvm/ExecutionEngine/Orc/CompileOnDemandLayer.h>
+#include <llvm/ExecutionEngine/Orc/Core.h>
+#include <llvm/ExecutionEngine/Orc/ExecutionUtils.h>
+#include <llvm/ExecutionEngine/Orc/JITTargetMachineBuilder.h>
+#include <llvm/ExecutionEngine/Orc/LLJIT.h>
+#include <llvm/ExecutionEngine/Orc/RTDyldObjectLinkingLayer.h>
+#include <llvm/ExecutionEngine/Orc/ThreadSafeModule.h>
+#include <llvm/ExecutionEngine/SectionMemoryManager.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Object/ObjectFile.h>
+#include <llvm/Object/SymbolSize.h>
+#include <llvm/Support/Error.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/Process.h>
+#include <llvm/Support/TargetSelect.h>
+#include <llvm/Support/raw_ostream.h>
+#include <llvm/Support/xxhash.h>
+#include <remill/BC/Profile.h>
+#include <remill/BC/TraceLifter.h>
+#include <remill/JIT/TraceJIT.h>
+#include <remill/OS/FileSystem.h>
+
+#include <algorithm>
+#include <fstream>
+#include <mutex>
+#include <optional>
+#include <sstream>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "remill/BC/Version.h"
+
+#if LLVM_VERSION_NUMBER >= LLVM_VERSION(17, 0)
+#  include <llvm/TargetParser/Host.h>
+#else
+#  include <llvm/Support/Host.h>
+#endif
+
+namespace remill {
+namespace {
+
+#if LLVM_VERSION_NUMBER >= LLVM_VERSION(12, 0)
+using DefinitionGeneratorBase = llvm::orc::DefinitionGenerator;
+#else
+using DefinitionGeneratorBase = llvm::orc::JITDylib::DefinitionGenerator;
+#endif
+
+// Returns the address of a trace named by the default
+// `TraceManager::TraceName`, i.e. `sub_<hex address>`.
+static std::optional<uint64_t> DefaultTraceAddress(std::string_view name) {
+  llvm::StringRef name_ref(name.data(), name.size());
+  uint64_t addr = 0;
+  if (!name_ref.consume_front("sub_") || name_ref.empty() ||
+      name_ref.getAsInteger(16, addr)) {
+    return std::nullopt;
+  }
+  return addr;
+}
+
+// Called instead of a trace that failed to compile.
+static void LazyCompileFailed(void) {
+  LOG(FATAL) << "Could not compile a lifted trace";
+}
+
+// Mix `val` into `hash`.
+static uint64_t HashCombine(uint64_t hash, uint64_t val) {
+  return hash ^ (val + 0x9E3779B97F4A7C15ull + (hash << 6) + (hash >> 2));
+}
+
+static uint64_t HashString(std::string_view str) {
+  return llvm::xxHash64(llvm::StringRef(str.data(), str.size()));
+}
+
+// Hashes the target, CPU, and CPU features of this host, and the version of
+// LLVM, on which compiled code depends.
+static uint64_t HostHash(const llvm::Triple &triple) {
+  uint64_t hash = HashString(triple.str());
+  hash = HashCombine(hash, HashString(llvm::sys::getHostCPUName().str()));
+  hash = HashCombine(hash, HashString(LLVM_VERSION_STRING));
+
+  llvm::StringMap<bool> features;
+  if (llvm::sys::getHostCPUFeatures(features)) {
+    std::vector<std::string> enabled;
+    for (const auto &feature : features) {
+      if (feature.getValue()) {
+        enabled.push_back(feature.getKey().str());
+      }
+    }
+    std::sort(enabled.begin(), enabled.end());
+    for (const auto &name : enabled) {
+      hash = HashCombine(hash, HashString(name));
+    }
+  }
+  return hash;
+}
+
+// An on-disk cache of the native code of compiled traces. Like `TraceCache`,
+// the index of each trace lists its instructions, so that a trace is only
+// loaded if the bytes of all of its instructions are unchanged.
+class TraceObjectCache final : public llvm::ObjectCache {
+ public:
+  TraceObjectCache(std::string dir_, uint64_t key_,
+                   const TraceJITOptions &options_)
+      : dir(std::move(dir_)),
+        key(key_),
+        options(options_) {}
+
+  // Remember the instructions lifted into the trace at `addr`.
+  void SetTraceInstructions(uint64_t addr, const TraceInstructionList &insts);
+
+  // Store the trace named `name` at `addr` once it is compiled, if its
+  // instructions are known.
+  void AddTrace(uint64_t addr, const std::string &name);
+
+  // Load the native code of the trace at `addr`, and its name. Returns
+  // `nullptr` if there is no cached trace at `addr`, or if any of the bytes
+  // of the trace have changed.
+  std::unique_ptr<llvm::MemoryBuffer> LoadTrace(uint64_t addr,
+                                                std::string *name);
+
+  // Called on a compile thread once `module` is compiled into `obj`.
+  void notifyObjectCompiled(const llvm::Module *module,
+                            llvm::MemoryBufferRef obj) override;
+
+  // The cached traces are added as objects, and so never compiled.
+  std::unique_ptr<llvm::MemoryBuffer>
+  getObject(const llvm::Module *) override {
+    return nullptr;
+  }
+
+ private:
+  // A trace that will be stored once it is compiled.
+  struct PendingTrace {
+    uint64_t addr;
+    uint64_t hash;
+    TraceInstructionList insts;
+  };
+
+  // Hashes the key and the bytes of the instructions `insts`. Returns `false`
+  // if any of the bytes can't be read.
+  bool HashTrace(uint64_t addr, const TraceInstructionList &insts,
+                 uint64_t *hash) const;
+
+  // Path to the file in which the trace at `addr` is stored.
+  std::string TracePath(uint64_t addr, const char *ext) const;
+
+  const std::string dir;
+
+  // Hash of `TraceJITOptions::object_cache_key` and of the host.
+  const uint64_t key;
+
+  const TraceJITOptions &options;
+
+  std::mutex lock;
+  std::unordered_map<uint64_t, TraceInstructionList> trace_insts;
+  std::unordered_map<std::string, PendingTrace> pending;
+};
+
+// Remember the instructions lifted into the trace at `addr`.
+void TraceObjectCache::SetTraceInstructions(uint64_t addr,
+                                            const TraceInstructionList &insts) {
+  std::lock_guard<std::mutex> locker(lock);
+  trace_insts[addr] = insts;
+}
+
+// Path to the file in which the trace at `addr` is stored.
+std::string TraceObjectCache::TracePath(uint64_t addr, const char *ext) const {
+  std::stringstream ss;
+  ss << dir << PathSeparator() << "jit_" << std::hex << key << '_' << addr
+     << ext;
+  return ss.str();
+}
+
+// Hashes the key and the bytes of the instructions `insts`.
+bool TraceObjectCache::HashTrace(uint64_t addr,
+                                 const TraceInstructionList &insts,
+                                 uint64_t *hash) const {
+  uint64_t trace_hash = HashCombine(key, addr);
+  std::string buffer;
+  for (auto [inst_addr, inst_size] : insts) {
+    const auto bytes =
+        options.read_executable_bytes(inst_addr, inst_size, buffer);
+    if (bytes.size() != inst_size) {
+      return false;
+    }
+    trace_hash = HashCombine(trace_hash, inst_addr);
+    trace_hash = HashCombine(trace_hash, HashString(bytes));
+  }
+  *hash = trace_hash;
+  return true;
+}
+
+// Store the trace named `name` at `addr` once it is compiled. The bytes are
+// hashed now, on the thread that lifted the trace, rather than on the compile
+// thread.
+void TraceObjectCache::AddTrace(uint64_t addr, const std::string &name) {
+  TraceInstructionList insts;
+  {
+    std::lock_guard<std::mutex> locker(lock);
+    auto insts_it = trace_insts.find(addr);
+    if (insts_it == trace_insts.end()) {
+      return;
+    }
+    insts = std::move(insts_it->second);
+    trace_insts.erase(insts_it);
+  }
+
+  uint64_t hash = 0;
+  if (!HashTrace(addr, insts, &hash)) {
+    return;
+  }
+
+  std::lock_guard<std::mutex> locker(lock);
+  pending[name] = {addr, hash, std::move(insts)};
+}
+
+// Called on a compile thread once `module` is compiled into `obj`.
+void TraceObjectCache::notifyObjectCompiled(const llvm::Module *module,
+                                            llvm::MemoryBufferRef obj) {
+  std::string name;
+  PendingTrace trace;
+  {
+    std::lock_guard<std::mutex> locker(lock);
+    for (auto &func : *module) {
+      if (func.isDeclaration()) {
+        continue;
+      }
+      if (auto it = pending.find(func.getName().str()); it != pending.end()) {
+        name = it->first;
+        trace = std::move(it->second);
+        pending.erase(it);
+        break;
+      }
+    }
+  }
+
+  if (name.empty()) {
+    return;
+  }
+
+  const auto obj_path = TracePath(trace.addr, ".o");
+  const auto obj_tmp_path = obj_path + ".tmp";
+  std::ofstream obj_file(obj_tmp_path, std::ios::binary | std::ios::trunc);
+  obj_file.write(obj.getBufferStart(),
+                 static_cast<std::streamsize>(obj.getBufferSize()));
+  obj_file.close();
+  if (!obj_file) {
+    RemoveFile(obj_tmp_path);
+    return;
+  }
+  MoveFile(obj_tmp_path, obj_path);
+
+  // Write out the index last, so that a partially written cache entry is
+  // never considered valid.
+  const auto index_path = TracePath(trace.addr, ".idx");
+  const auto tmp_path = index_path + ".tmp";
+  std::ofstream index(tmp_path, std::ios::trunc);
+  index << std::hex << trace.hash << '\n'
+        << name << '\n'
+        << obj.getBufferSize() << '\n'
+        << trace.insts.size();
+  for (auto [inst_addr, inst_size] : trace.insts) {
+    index << '\n' << inst_addr << ' ' << inst_size;
+  }
+  index << '\n';
+  index.close();
+  if (!index) {
+    RemoveFile(tmp_path);
+    return;
+  }
+
+  MoveFile(tmp_path, index_path);
+}
+
+// Load the native code of the trace at `addr`, and its name.
+std::unique_ptr<llvm::MemoryBuffer>
+TraceObjectCache::LoadTrace(uint64_t addr, std::string *name) {
+  std::ifstream index(TracePath(addr, ".idx"));
+  if (!index) {
+    return nullptr;
+  }
+
+  uint64_t expected_hash = 0;
+  size_t obj_size = 0;
+  size_t num_insts = 0;
+  index >> std::hex >> expected_hash >> *name >> obj_size >> num_insts;
+
+  TraceInstructionList insts;
+  for (size_t i = 0; i < num_insts && index; ++i) {
+    uint64_t inst_addr = 0;
+    uint64_t inst_size = 0;
+    index >> inst_addr >> inst_size;
+    insts.emplace_back(inst_addr, inst_size);
+  }
+
+  uint64_t hash = 0;
+  if (!index || !HashTrace(addr, insts, &hash) || hash != expected_hash) {
+    return nullptr;  // Malformed, or the bytes of the trace have changed.
+  }
+
+  // Large objects are mapped rather than read.
+  auto obj = llvm::MemoryBuffer::getFile(TracePath(addr, ".o"));
+  if (!obj || obj.get()->getBufferSize() != obj_size) {
+    return nullptr;
+  }
+  return std::move(obj.get());
+}
+
+// Writes `/tmp/perf-<pid>.map`, from which `perf` names the code of the
+// compiled traces. Each run of the code of a trace that came from one guest
+// instruction, as told by the guest PC debug locations of the trace (see
+// `InstructionLifter::SetGuestPCDebugLocations`), gets an entry of its own,
+// named after the trace and the address of the instruction, e.g.
+// `sub_401000 [0x401005]`. The rest of the code is named after the trace.
+class PerfMapListener final : public llvm::JITEventListener {
+ public:
+  // Returns `nullptr` if the map can't be opened.
+  static std::unique_ptr<PerfMapListener> Create(void);
+
+  void notifyObjectLoaded(
+      ObjectKey, const llvm::object::ObjectFile &obj,
+      const llvm::RuntimeDyld::LoadedObjectInfo &info) override;
+
+ private:
+  explicit PerfMapListener(std::string path_)
+      : path(std::move(path_)),
+        map(path, std::ios::out | std::ios::app) {}
+
+  // Returns `true` if `sym` is a function.
+  static bool IsFunction(const llvm::object::SymbolRef &sym);
+
+  // Add the entries of the function `name` at `[addr, addr + size)` to `os`.
+  static void AddFunction(llvm::DIContext &dwarf, llvm::StringRef name,
+                          llvm::object::SectionedAddress addr, uint64_t size,
+                          std::ostream &os);
+
+  const std::string path;
+
+  std::mutex lock;
+  std::ofstream map;
+};
+
+std::unique_ptr<PerfMapListener> PerfMapListener::Create(void) {
+  std::stringstream ss;
+  ss << "/tmp/perf-" << llvm::sys::Process::getProcessId() << ".map";
+  std::unique_ptr<PerfMapListener> listener(new PerfMapListener(ss.str()));
+  if (!listener->map) {
+    LOG(ERROR) << "Could not open perf map " << listener->path;
+    return nullptr;
+  }
+  return listener;
+}
+
+// Returns `true` if `sym` is a function.
+bool PerfMapListener::IsFunction(const llvm::object::SymbolRef &sym) {
+#if LLVM_VERSION_NUMBER >= LLVM_VERSION(11, 0)
+  auto type = sym.getType();
+  if (!type) {
+    llvm::consumeError(type.takeError());
+    return false;
+  }
+  return *type == llvm::object::SymbolRef::ST_Function;
+#else
+  return sym.getType() == llvm::object::SymbolRef::ST_Function;
+#endif
+}
+
+// Add the entries of the function `name` at `[addr, addr + size)` to `os`.
+void PerfMapListener::AddFunction(llvm::DIContext &dwarf, llvm::StringRef name,
+                                  llvm::object::SectionedAddress addr,
+                                  uint64_t size, std::ostream &os) {
+
+  // The start of each run of code, and the guest PC that it came from, if
+  // any. The line and column of a guest PC debug location are the low 32
+  // bits and the next 16 bits of the PC, and line 0 is code that was added
+  // around the lifted instructions.
+  std::vector<std::pair<uint64_t, std::optional<uint64_t>>> runs;
+  runs.emplace_back(addr.Address, std::nullopt);
+  for (const auto &[line_addr, line] :
+       dwarf.getLineInfoForAddressRange(addr, size)) {
+    std::optional<uint64_t> pc;
+    if (line.Line) {
+      pc = (static_cast<uint64_t>(line.Column) << 32) | line.Line;
+    }
+    if (line_addr == runs.back().first) {
+      runs.back().second = pc;
+    } else if (pc != runs.back().second) {
+      runs.emplace_back(line_addr, pc);
+    }
+  }
+
+  const auto end = addr.Address + size;
+  for (size_t i = 0; i < runs.size(); ++i) {
+    const auto [run_addr, pc] = runs[i];
+    const auto run_end = i + 1 < runs.size() ? runs[i + 1].first : end;
+    if (run_addr >= run_end) {
+      continue;
+    }
+    os << std::hex << run_addr << ' ' << (run_end - run_addr) << ' '
+       << name.str();
+    if (pc) {
+      os << " [0x" << *pc << ']';
+    }
+    os << std::dec << '\n';
+  }
+}
+
+// Called on a compile thread once `obj` is linked. The functions of its debug
+// object are at the addresses to which they were loaded.
+void PerfMapListener::notifyObjectLoaded(
+    ObjectKey, const llvm::object::ObjectFile &obj,
+    const llvm::RuntimeDyld::LoadedObjectInfo &info) {
+  const auto debug_obj_owner = info.getObjectForDebug(obj);
+  const auto &debug_obj =
+      debug_obj_owner.getBinary() ? *debug_obj_owner.getBinary() : obj;
+  const auto dwarf = llvm::DWARFContext::create(debug_obj);
+
+  std::stringstream entries;
+  for (const auto &[sym, size] : llvm::object::computeSymbolSizes(debug_obj)) {
+    if (!IsFunction(sym)) {
+      continue;
+    }
+
+    auto name = sym.getName();
+    if (!name) {
+      llvm::consumeError(name.takeError());
+      continue;
+    }
+
+    auto addr = sym.getAddress();
+    if (!addr) {
+      llvm::consumeError(addr.takeError());
+      continue;
+    }
+
+    uint64_t section_index = llvm::object::SectionedAddress::UndefSection;
+    if (auto section = sym.getSection()) {
+      if (*section != debug_obj.section_end()) {
+        section_index = (*section)->getIndex();
+      }
+    } else {
+      llvm::consumeError(section.takeError());
+    }
+
+    AddFunction(*dwarf, *name, {*addr, section_index}, size, entries);
+  }
+
+  std::lock_guard<std::mutex> locker(lock);
+  map << entries.str();
+  map.flush();
+}
+
+}  // namespace
+
+class TraceJIT::Impl {
+ public:
+  // Returns `true` if the trace at `addr` has been added.
+  bool HasTrace(uint64_t addr);
+
+  // Lift the trace at `addr` with `options.lift_trace` if it hasn't been
+  // added, or load it from `object_cache`. Returns `true` if it has been
+  // added.
+  bool LiftTrace(uint64_t addr);
+
+  // Add the trace at `addr` from `object_cache`. Returns `false` if it isn't
+  // cached.
+  bool LoadCachedTrace(uint64_t addr);
+
+  TraceJITOptions options;
+  char global_prefix{'\0'};
+
+  // Names of the added traces, and the lifted functions of those that have
+  // been looked up.
+  std::mutex lock;
+  std::unordered_map<uint64_t, std::string> trace_names;
+  std::unordered_map<uint64_t, void *> trace_funcs;
+
+  // Serializes the calls to `options.lift_trace`.
+  std::mutex lift_lock;
+
+  // Probed by the chained indirect jumps of the lifted code, and filled in by
+  // `GetTrace`.
+  std::unique_ptr<TraceTableEntry[]> trace_table;
+
+  // Stores and loads compiled traces, if `options.object_cache_dir` is set.
+  std::unique_ptr<TraceObjectCache> object_cache;
+
+  // Writes the perf map, if `options.write_perf_map` is set.
+  std::unique_ptr<PerfMapListener> perf_map;
+
+  // Declared last so that its compile threads, which can call back into the
+  // other members, are stopped first.
+  std::unique_ptr<llvm::orc::LLLazyJIT> jit;
+};
+
+namespace {
+
+// Lifts the missing traces that are called by the traces being linked.
+class TraceGenerator final : public DefinitionGeneratorBase {
+ public:
+  explicit TraceGenerator(TraceJIT::Impl &impl_) : impl(impl_) {}
+
+  llvm::Error tryToGenerate(
+#if LLVM_VERSION_NUMBER >= LLVM_VERSION(12, 0)
+      llvm::orc::LookupState &,
+#endif
+      llvm::orc::LookupKind, llvm::orc::JITDylib &,
+      llvm::orc::JITDylibLookupFlags,
+      const llvm::orc::SymbolLookupSet &symbols) override {
+    for (const auto &[symbol, flags] : symbols) {
+      (void) flags;
+      llvm::StringRef name = *symbol;
+      if (impl.global_prefix) {
+        name.consume_front(llvm::StringRef(&(impl.global_prefix), 1));
+      }
+      if (auto addr = impl.options.trace_address(
+              std::string_view(name.data(), name.size()))) {
+        (void) impl.LiftTrace(*addr);
+      }
+    }
+    return llvm::Error::success();
+  }
+
+ private:
+  TraceJIT::Impl &impl;
+};
+
+}  // namespace
+
+// Returns `true` if the trace at `addr` has been added.
+bool TraceJIT::Impl::HasTrace(uint64_t addr) {
+  std::lock_guard<std::mutex> locker(lock);
+  return trace_names.count(addr);
+}
+
+// Lift the trace at `addr` if it hasn't been added.
+bool TraceJIT::Impl::LiftTrace(uint64_t addr) {
+  if (HasTrace(addr)) {
+    return true;
+  } else if (!options.lift_trace && !object_cache) {
+    return false;
+  }
+  std::lock_guard<std::mutex> locker(lift_lock);
+  if (HasTrace(addr) || LoadCachedTrace(addr)) {
+    return true;
+  }
+  return options.lift_trace && options.lift_trace(addr) && HasTrace(addr);
+}
+
+// Add the trace at `addr` from `object_cache`.
+bool TraceJIT::Impl::LoadCachedTrace(uint64_t addr) {
+  if (!object_cache) {
+    return false;
+  }
+
+  std::string name;
+  auto obj = object_cache->LoadTrace(addr, &name);
+  if (!obj) {
+    return false;
+  }
+
+  if (auto err = jit->addObjectFile(std::move(obj))) {
+    LOG(ERROR) << "Could not add cached trace " << name
+               << " to the JIT: " << llvm::toString(std::move(err));
+    return false;
+  }
+
+  std::lock_guard<std::mutex> locker(lock);
+  trace_names.emplace(addr, name);
+  return true;
+}
+
+TraceJIT::TraceJIT(void) : impl(new Impl) {}
+
+TraceJIT::~TraceJIT(void) {}
+
+std::unique_ptr<TraceJIT> TraceJIT::Create(TraceJITOptions options) {
+  llvm::InitializeNativeTarget();
+  llvm::InitializeNativeTargetAsmPrinter();
+
+  auto num_threads = options.num_compile_threads;
+  if (!num_threads) {
+    num_threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+
+  std::unique_ptr<TraceJIT> trace_jit(new TraceJIT);
+  auto &impl = *(trace_jit->impl);
+
+  llvm::orc::LLLazyJITBuilder builder;
+  builder.setNumCompileThreads(num_threads);
+  if (!options.object_cache_dir.empty()) {
+    if (!options.read_executable_bytes) {
+      LOG(ERROR) << "The trace JIT's object cache needs a way to read "
+                 << "executable bytes";
+      return nullptr;
+    } else if (!TryCreateDirectory(options.object_cache_dir)) {
+      LOG(ERROR) << "Could not create trace JIT object cache directory "
+                 << options.object_cache_dir;
+      return nullptr;
+    }
+
+    auto jtmb = llvm::orc::JITTargetMachineBuilder::detectHost();
+    if (!jtmb) {
+      LOG(ERROR) << "Could not detect the host of the trace JIT: "
+                 << llvm::toString(jtmb.takeError());
+      return nullptr;
+    }
+
+    // `impl.options` is only filled in below, but it is only read once
+    // traces are added.
+    const auto key = HashCombine(options.object_cache_key,
+                                 HostHash(jtmb->getTargetTriple()));
+    impl.object_cache = std::make_unique<TraceObjectCache>(
+        options.object_cache_dir, key, impl.options);
+    builder.setCompileFunctionCreator(
+        [cache = impl.object_cache.get()](
+            llvm::orc::JITTargetMachineBuilder jtmb)
+            -> llvm::Expected<
+                std::unique_ptr<llvm::orc::IRCompileLayer::IRCompiler>> {
+          return std::make_unique<llvm::orc::ConcurrentIRCompiler>(
+              std::move(jtmb), cache);
+        });
+  }
+
+  // Tell profilers about the compiled code through the listeners of the
+  // object linking layer, which is otherwise the default one.
+  std::vector<llvm::JITEventListener *> listeners;
+  if (options.write_perf_map) {
+    impl.perf_map = PerfMapListener::Create();
+    if (!impl.perf_map) {
+      return nullptr;
+    }
+    listeners.push_back(impl.perf_map.get());
+  }
+  if (options.write_jitdump) {
+    if (auto jitdump = llvm::JITEventListener::createPerfJITEventListener()) {
+      listeners.push_back(jitdump);
+    } else {
+      LOG(WARNING) << "Not writing jitdump records; LLVM was built without "
+                   << "perf support";
+    }
+  }
+  if (!listeners.empty()) {
+    builder.setObjectLinkingLayerCreator(
+        [listeners](llvm::orc::ExecutionSession &es, const llvm::Triple &tt)
+            -> std::unique_ptr<llvm::orc::ObjectLayer> {
+          auto layer = std::make_unique<llvm::orc::RTDyldObjectLinkingLayer>(
+#if LLVM_VERSION_NUMBER >= LLVM_VERSION(17, 0)
+              es, [](const llvm::MemoryBuffer &) {
+#else
+              es, [](void) {
+#endif
+                return std::make_unique<llvm::SectionMemoryManager>();
+              });
+          if (tt.isOSBinFormatCOFF()) {
+            layer->setOverrideObjectFlagsWithResponsibilityFlags(true);
+            layer->setAutoClaimResponsibilityForObjectSymbols(true);
+          }
+          for (auto listener : listeners) {
+            layer->registerJITEventListener(*listener);
+          }
+          return layer;
+        });
+  }
+
+#if LLVM_VERSION_NUMBER >= LLVM_VERSION(15, 0)
+  builder.setLazyCompileFailureAddr(
+      llvm::orc::ExecutorAddr::fromPtr(&LazyCompileFailed));
+#else
+  builder.setLazyCompileFailureAddr(
+      llvm::pointerToJITTargetAddress(&LazyCompileFailed));
+#endif
+
+  auto jit = builder.create();
+  if (!jit) {
+    LOG(ERROR) << "Could not create the trace JIT: "
+               << llvm::toString(jit.takeError());
+    return nullptr;
+  }
+
+  impl.options = std::move(options);
+  impl.jit = std::move(*jit);
+  impl.global_prefix = impl.jit->getDataLayout().getGlobalPrefix();
+  if (!impl.options.trace_address) {
+    impl.options.trace_address = DefaultTraceAddress;
+  }
+
+  // Each trace is its own compile unit.
+  impl.jit->setPartitionFunction(
+      llvm::orc::CompileOnDemandLayer::compileWholeModule);
+
+  impl.trace_table.reset(new TraceTableEntry[kNumTraceTableEntries]);
+  for (uint64_t i = 0; i < kNumTraceTableEntries; ++i) {
+    impl.trace_table[i] = {kEmptyTraceTableEntry, nullptr};
+  }
+  impl.options.runtime.emplace(kTraceTableName, impl.trace_table.get());
+
+  auto &dylib = impl.jit->getMainJITDylib();
+  llvm::orc::SymbolMap runtime;
+  for (const auto &[name, ptr] : impl.options.runtime) {
+#if LLVM_VERSION_NUMBER >= LLVM_VERSION(17, 0)
+    runtime[impl.jit->mangleAndIntern(name)] = {
+        llvm::orc::ExecutorAddr::fromPtr(ptr), llvm::JITSymbolFlags::Exported};
+#else
+    runtime[impl.jit->mangleAndIntern(name)] = llvm::JITEvaluatedSymbol(
+        llvm::pointerToJITTargetAddress(ptr), llvm::JITSymbolFlags::Exported);
+#endif
+  }
+  if (!runtime.empty()) {
+    if (auto err = dylib.define(llvm::orc::absoluteSymbols(runtime))) {
+      LOG(ERROR) << "Could not define the runtime of the trace JIT: "
+                 << llvm::toString(std::move(err));
+      return nullptr;
+    }
+  }
+
+  dylib.addGenerator(std::make_unique<TraceGenerator>(impl));
+  if (impl.options.search_process_symbols) {
+    auto gen = llvm::orc::DynamicLibrarySearchGenerator::GetForCurrentProcess(
+        impl.global_prefix);
+    if (!gen) {
+      LOG(ERROR) << "Could not search this process for the runtime: "
+                 << llvm::toString(gen.takeError());
+      return nullptr;
+    }
+    dylib.addGenerator(std::move(*gen));
+  }
+
+  return trace_jit;
+}
+
+// Add the lifted trace `func` at `addr`, the only definition in
+// `trace_module`.
+bool TraceJIT::AddTrace(uint64_t addr, llvm::Function *func,
+                        std::unique_ptr<llvm::Module> trace_module) {
+  const auto name = func->getName().str();
+  if (impl->HasTrace(addr)) {
+    LOG(ERROR) << "The trace JIT already has a trace at " << std::hex << addr
+               << std::dec;
+    return false;
+  }
+
+  // Copy the trace into a context of its own, so that it can be compiled on
+  // another thread.
+  llvm::SmallVector<char, 0> bitcode;
+  {
+    llvm::raw_svector_ostream os(bitcode);
+    llvm::WriteBitcodeToFile(*trace_module, os);
+  }
+  trace_module.reset();
+
+  auto context = std::make_unique<llvm::LLVMContext>();
+  auto module = llvm::parseBitcodeFile(
+      llvm::MemoryBufferRef(llvm::StringRef(bitcode.data(), bitcode.size()),
+                            name),
+      *context);
+  if (!module) {
+    LOG(ERROR) << "Could not copy trace " << name << ": "
+               << llvm::toString(module.takeError());
+    return false;
+  }
+
+  (*module)->setDataLayout(impl->jit->getDataLayout());
+  (*module)->setTargetTriple(impl->jit->getTargetTriple().str());
+  if (auto err = impl->jit->addLazyIRModule(llvm::orc::ThreadSafeModule(
+          std::move(*module), std::move(context)))) {
+    LOG(ERROR) << "Could not add trace " << name
+               << " to the JIT: " << llvm::toString(std::move(err));
+    return false;
+  }
+
+  if (impl->object_cache) {
+    impl->object_cache->AddTrace(addr, name);
+  }
+
+  // Only publish the trace once its symbol is defined, so that `GetTrace`
+  // never looks up a trace that is still being added.
+  std::lock_guard<std::mutex> locker(impl->lock);
+  impl->trace_names.emplace(addr, name);
+  return true;
+}
+
+// Remember `insts`, the instructions of the trace at `addr`, so that the trace
+// is stored in the object cache once it is compiled.
+void TraceJIT::SetTraceInstructions(uint64_t addr,
+                                    const TraceInstructionList &insts) {
+  if (impl->object_cache) {
+    impl->object_cache->SetTraceInstructions(addr, insts);
+  }
+}
+
+// Returns the lifted function of the trace at `addr`, lifting it first if
+// needed, or `nullptr` if it isn't available.
+void *TraceJIT::GetTrace(uint64_t addr) {
+  std::string name;
+  {
+    std::lock_guard<std::mutex> locker(impl->lock);
+    if (auto it = impl->trace_funcs.find(addr);
+        it != impl->trace_funcs.end()) {
+      return it->second;
+    }
+  }
+
+  if (!impl->LiftTrace(addr)) {
+    LOG(ERROR) << "The trace JIT has no trace at " << std::hex << addr
+               << std::dec;
+    return nullptr;
+  }
+
+  {
+    std::lock_guard<std::mutex> locker(impl->lock);
+    name = impl->trace_names[addr];
+  }
+
+  auto sym = impl->jit->lookup(name);
+  if (!sym) {
+    LOG(ERROR) << "Could not link trace " << name << ": "
+               << llvm::toString(sym.takeError());
+    return nullptr;
+  }
+
+#if LLVM_VERSION_NUMBER >= LLVM_VERSION(15, 0)
+  const auto func = sym->toPtr<void *>();
+#else
+  const auto func = llvm::jitTargetAddressToPointer<void *>(sym->getAddress());
+#endif
+
+  std::lock_guard<std::mutex> locker(impl->lock);
+  impl->trace_funcs.emplace(addr, func);
+
+  // Let the chained indirect jumps find this trace. The entry is published
+  // by its `pc`, which lifted code loads with acquire semantics.
+  auto &entry = impl->trace_table[TraceTableIndex(addr)];
+  if (entry.pc == kEmptyTraceTableEntry) {
+    entry.trace = func;
+    __atomic_store_n(&(entry.pc), addr, __ATOMIC_RELEASE);
+  }
+  return func;
+}
+
+// Add the `ProfileCounters` of each added trace that was lifted with
+// `TraceProfiling` enabled to `counters`.
+void TraceJIT::GetProfileCounters(
+    std::vector<const ProfileCounters *> &counters) {
+  std::vector<std::string> names;
+  {
+    std::lock_guard<std::mutex> locker(impl->lock);
+    for (const auto &[addr, name] : impl->trace_names) {
+      (void) addr;
+      names.push_back(ProfileCountersName(name));
+    }
+  }
+
+  // The traces that weren't instrumented have no counters.
+  for (const auto &name : names) {
+    if (auto sym = impl->jit->lookup(name)) {
+#if LLVM_VERSION_NUMBER >= LLVM_VERSION(15, 0)
+      counters.push_back(sym->toPtr<const ProfileCounters *>());
+#else
+      counters.push_back(
+          llvm::jitTargetAddressToPointer<const ProfileCounters *>(
+              sym->getAddress()));
+#endif
+    } else {
+      llvm::consumeError(sym.takeError());
+    }
+  }
+}
+
+}  // namespace remill
@@ -0,0 +1,377 @@
+/*
+ * Copyright (c) 2020 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <glog/logging.h>
+
+#include <cfloat>
+#include <mutex>
+
+#include "remill/Arch/Runtime/Intrinsics.h"
+#include "remill/Memory/PagedMemory.h"
+
+// Implementations of the memory intrinsics on top of `remill::PagedMemory`.
+// These are compiled once per guest address size, as `addr_t` depends on
+// `ADDRESS_SIZE_BITS`.
+
+namespace {
+
+using remill::PagedMemory;
+
+// Serializes the atomic accesses that can't be done with a host atomic, i.e.
+// misaligned ones, and those that cross a page boundary. These are striped by
+// address, and are only atomic with respect to other such accesses at the same
+// address.
+static constexpr unsigned kNumAtomicLocks = 64;
+static std::mutex gAtomicLocks[kNumAtomicLocks];
+
+static inline std::mutex &AtomicLock(addr_t addr) {
+  return gAtomicLocks[(addr / 16) % kNumAtomicLocks];
+}
+
+template <typename T>
+static inline T *AtomicPointer(PagedMemory *memory, addr_t addr) {
+  if (addr % sizeof(T)) {
+    return nullptr;
+  }
+  return reinterpret_cast<T *>(memory->TranslateForWrite(addr, sizeof(T)));
+}
+
+template <typename T, typename Op>
+static inline Memory *FetchAndOp(Memory *memory, addr_t addr, T &value,
+                                 Op op) {
+  const auto pm = PagedMemory::FromMemory(memory);
+  std::lock_guard<std::mutex> locker(AtomicLock(addr));
+  const auto old = pm->Load<T>(addr);
+  pm->Store<T>(addr, op(old, value));
+  value = old;
+  return memory;
+}
+
+template <typename T>
+static inline Memory *CompareExchange(Memory *memory, addr_t addr,
+                                      T &expected, T desired) {
+  const auto pm = PagedMemory::FromMemory(memory);
+  if (auto ptr = AtomicPointer<T>(pm, addr)) {
+    __atomic_compare_exchange_n(ptr, &expected, desired, false,
+                                __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+    return memory;
+  }
+
+  std::lock_guard<std::mutex> locker(AtomicLock(addr));
+  const auto old = pm->Load<T>(addr);
+  if (old == expected) {
+    pm->Store<T>(addr, desired);
+  }
+  expected = old;
+  return memory;
+}
+
+template <typename T>
+static inline Memory *CopyMemory(Memory *memory, addr_t dst, addr_t src,
+                                 addr_t count) {
+  const auto pm = PagedMemory::FromMemory(memory);
+  const uint64_t size = static_cast<uint64_t>(count) * sizeof(T);
+  const auto src_host = pm->TranslateForRead(src, size);
+  const auto dst_host = pm->TranslateForWrite(dst, size);
+  if (src_host && dst_host) {
+    memmove(dst_host, src_host, size);
+  } else {
+    for (addr_t i = 0; i < count; ++i) {
+      const addr_t offset = i * sizeof(T);
+      pm->Store<T>(dst + offset, pm->Load<T>(src + offset));
+    }
+  }
+  return memory;
+}
+
+template <typename T>
+static inline Memory *FillMemory(Memory *memory, addr_t dst, T val,
+                                 addr_t count) {
+  const auto pm = PagedMemory::FromMemory(memory);
+  const uint64_t size = static_cast<uint64_t>(count) * sizeof(T);
+  if (auto dst_host = pm->TranslateForWrite(dst, size)) {
+    for (uint64_t i = 0; i < size; i += sizeof(T)) {
+      memcpy(&(dst_host[i]), &val, sizeof(T));
+    }
+  } else {
+    for (addr_t i = 0; i < count; ++i) {
+      pm->Store<T>(dst + i * sizeof(T), val);
+    }
+  }
+  return memory;
+}
+
+}  // namespace
+
+extern "C" {
+
+#define MAKE_RW_MEMORY(name, type) \
+  type __remill_read_memory_##name(Memory *memory, addr_t addr) { \
+    return PagedMemory::FromMemory(memory)->Load<type>(addr); \
+  } \
+  Memory *__remill_write_memory_##name(Memory *memory, addr_t addr, \
+                                       type val) { \
+    PagedMemory::FromMemory(memory)->Store<type>(addr, val); \
+    return memory; \
+  }
+
+MAKE_RW_MEMORY(8, uint8_t)
+MAKE_RW_MEMORY(16, uint16_t)
+MAKE_RW_MEMORY(32, uint32_t)
+MAKE_RW_MEMORY(64, uint64_t)
+MAKE_RW_MEMORY(f32, float32_t)
+MAKE_RW_MEMORY(f64, float64_t)
+MAKE_RW_MEMORY(v128, vec128_t)
+MAKE_RW_MEMORY(v256, vec256_t)
+MAKE_RW_MEMORY(v512, vec512_t)
+
+#undef MAKE_RW_MEMORY
+
+// The `f80` and `f128` formats are converted through `long double` when the
+// host's `long double` uses them, i.e. on x86 and AArch64 hosts, respectively.
+float64_t __remill_read_memory_f80(Memory *memory, addr_t addr) {
+#if 64 == LDBL_MANT_DIG
+  long double val = 0;
+  PagedMemory::FromMemory(memory)->Read(addr, &val, sizeof(float80_t));
+  return static_cast<float64_t>(val);
+#else
+  LOG(FATAL) << "Reading 80-bit floats is unsupported on this host";
+  return 0.0;
+#endif
+}
+
+Memory *__remill_write_memory_f80(Memory *memory, addr_t addr,
+                                  float64_t val) {
+#if 64 == LDBL_MANT_DIG
+  const auto val_long = static_cast<long double>(val);
+  PagedMemory::FromMemory(memory)->Write(addr, &val_long, sizeof(float80_t));
+#else
+  LOG(FATAL) << "Writing 80-bit floats is unsupported on this host";
+#endif
+  return memory;
+}
+
+float64_t __remill_read_memory_f128(Memory *memory, addr_t addr) {
+#if 113 == LDBL_MANT_DIG
+  long double val = 0;
+  PagedMemory::FromMemory(memory)->Read(addr, &val, sizeof(val));
+  return static_cast<float64_t>(val);
+#else
+  LOG(FATAL) << "Reading 128-bit floats is unsupported on this host";
+  return 0.0;
+#endif
+}
+
+Memory *__remill_write_memory_f128(Memory *memory, addr_t addr,
+                                   float64_t val) {
+#if 113 == LDBL_MANT_DIG
+  const auto val_long = static_cast<long double>(val);
+  PagedMemory::FromMemory(memory)->Write(addr, &val_long, sizeof(val_long));
+#else
+  LOG(FATAL) << "Writing 128-bit floats is unsupported on this host";
+#endif
+  return memory;
+}
+
+#define MAKE_BULK_MEMORY(size) \
+  Memory *__remill_copy_memory_##size(Memory *memory, addr_t dst, addr_t src, \
+                                      addr_t count) { \
+    return CopyMemory<uint##size##_t>(memory, dst, src, count); \
+  } \
+  Memory *__remill_fill_memory_##size(Memory *memory, addr_t dst, \
+                                      uint##size##_t val, addr_t count) { \
+    return FillMemory<uint##size##_t>(memory, dst, val, count); \
+  }
+
+MAKE_BULK_MEMORY(8)
+MAKE_BULK_MEMORY(16)
+MAKE_BULK_MEMORY(32)
+MAKE_BULK_MEMORY(64)
+
+#undef MAKE_BULK_MEMORY
+
+#define MAKE_COMPARE_EXCHANGE(size) \
+  Memory *__remill_compare_exchange_memory_##size( \
+      Memory *memory, addr_t addr, uint##size##_t &expected, \
+      uint##size##_t desired) { \
+    return CompareExchange<uint##size##_t>(memory, addr, expected, desired); \
+  }
+
+MAKE_COMPARE_EXCHANGE(8)
+MAKE_COMPARE_EXCHANGE(16)
+MAKE_COMPARE_EXCHANGE(32)
+MAKE_COMPARE_EXCHANGE(64)
+
+#undef MAKE_COMPARE_EXCHANGE
+
+Memory *__remill_compare_exchange_memory_128(Memory *memory, addr_t addr,
+                                             uint128_t &expected,
+                                             uint128_t &desired) {
+  const auto pm = PagedMemory::FromMemory(memory);
+  if (auto ptr = AtomicPointer<uint128_t>(pm, addr)) {
+#if defined(__x86_64__)
+    struct uint128 {
+      uint64_t lo;
+      uint64_t hi;
+    };
+
+    const auto oldval = reinterpret_cast<uint128 *>(&expected);
+    const auto newval = reinterpret_cast<uint128 *>(&desired);
+    __asm__ __volatile__("lock; cmpxchg16b %0"
+                         : "+m"(*ptr), "+a"(oldval->lo), "+d"(oldval->hi)
+                         : "b"(newval->lo), "c"(newval->hi)
+                         : "memory", "cc");
+    return memory;
+#elif defined(__GCC_HAVE_SYNC_COMPARE_AND_SWAP_16)
+    expected = __sync_val_compare_and_swap(ptr, expected, desired);
+    return memory;
+#else
+    (void) ptr;
+#endif
+  }
+
+  std::lock_guard<std::mutex> locker(AtomicLock(addr));
+  const auto old = pm->Load<uint128_t>(addr);
+  if (old == expected) {
+    pm->Store<uint128_t>(addr, desired);
+  }
+  expected = old;
+  return memory;
+}
+
+#define MAKE_ATOMIC_INTRINSIC(name, size, builtin, expr) \
+  Memory *__remill_fetch_and_##name##_##size(Memory *memory, addr_t addr, \
+                                             uint##size##_t &value) { \
+    using T = uint##size##_t; \
+    const auto pm = PagedMemory::FromMemory(memory); \
+    if (auto ptr = AtomicPointer<T>(pm, addr)) { \
+      value = builtin(ptr, value, __ATOMIC_SEQ_CST); \
+      return memory; \
+    } \
+    return FetchAndOp<T>(memory, addr, value, \
+                         [](T a, T b) -> T { return expr; }); \
+  }
+
+#define MAKE_ATOMIC_INTRINSICS(name, builtin, expr) \
+  MAKE_ATOMIC_INTRINSIC(name, 8, builtin, expr) \
+  MAKE_ATOMIC_INTRINSIC(name, 16, builtin, expr) \
+  MAKE_ATOMIC_INTRINSIC(name, 32, builtin, expr) \
+  MAKE_ATOMIC_INTRINSIC(name, 64, builtin, expr)
+
+MAKE_ATOMIC_INTRINSICS(add, __atomic_fetch_add, a + b)
+MAKE_ATOMIC_INTRINSICS(sub, __atomic_fetch_sub, a - b)
+MAKE_ATOMIC_INTRINSICS(and, __atomic_fetch_and, a & b)
+MAKE_ATOMIC_INTRINSICS(or, __atomic_fetch_or, a | b)
+MAKE_ATOMIC_INTRINSICS(xor, __atomic_fetch_xor, a ^ b)
+MAKE_ATOMIC_INTRINSICS(nand, __atomic_fetch_nand, ~(a & b))
+
+#undef MAKE_ATOMIC_INTRINSICS
+#undef MAKE_ATOMIC_INTRINSIC
+
+Memory *__remill_barrier_load_load(Memory *memory) {
+  __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  return memory;
+}
+
+Memory *__remill_barrier_load_store(Memory *memory) {
+  __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  return memory;
+}
+
+Memory *__remill_barrier_store_load(Memory *memory) {
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  return memory;
+}
+
+Memory *__remill_barrier_store_store(Memory *memory) {
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  return memory;
+}
+
+// The read-modify-write instructions within atomic regions use the atomic
+// intrinsics above, so the regions themselves only need to be fences.
+Memory *__remill_atomic_begin(Memory *memory) {
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  return memory;
+}
+
+Memory *__remill_atomic_end(Memory *memory) {
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  return memory;
+}
+
+Memory *__remill_delay_slot_begin(Memory *memory) {
+  return memory;
+}
+
+Memory *__remill_delay_slot_end(Memory *memory) {
+  return memory;
+}
+
+}  // extern C
+
+namespace remill {
+
+// Add the address of each memory intrinsic above to `runtime`, by name.
+void AddPagedMemoryIntrinsics(
+    std::unordered_map<std::string, void *> &runtime) {
+#define ADD_INTRINSIC(name) runtime[#name] = reinterpret_cast<void *>(&name);
+#define ADD_SIZED_INTRINSICS(name) \
+  ADD_INTRINSIC(name##_8) \
+  ADD_INTRINSIC(name##_16) \
+  ADD_INTRINSIC(name##_32) \
+  ADD_INTRINSIC(name##_64)
+
+  ADD_SIZED_INTRINSICS(__remill_read_memory)
+  ADD_SIZED_INTRINSICS(__remill_write_memory)
+  ADD_INTRINSIC(__remill_read_memory_f32)
+  ADD_INTRINSIC(__remill_write_memory_f32)
+  ADD_INTRINSIC(__remill_read_memory_f64)
+  ADD_INTRINSIC(__remill_write_memory_f64)
+  ADD_INTRINSIC(__remill_read_memory_f80)
+  ADD_INTRINSIC(__remill_write_memory_f80)
+  ADD_INTRINSIC(__remill_read_memory_f128)
+  ADD_INTRINSIC(__remill_write_memory_f128)
+  ADD_INTRINSIC(__remill_read_memory_v128)
+  ADD_INTRINSIC(__remill_write_memory_v128)
+  ADD_INTRINSIC(__remill_read_memory_v256)
+  ADD_INTRINSIC(__remill_write_memory_v256)
+  ADD_INTRINSIC(__remill_read_memory_v512)
+  ADD_INTRINSIC(__remill_write_memory_v512)
+  ADD_SIZED_INTRINSICS(__remill_copy_memory)
+  ADD_SIZED_INTRINSICS(__remill_fill_memory)
+  ADD_SIZED_INTRINSICS(__remill_compare_exchange_memory)
+  ADD_INTRINSIC(__remill_compare_exchange_memory_128)
+  ADD_SIZED_INTRINSICS(__remill_fetch_and_add)
+  ADD_SIZED_INTRINSICS(__remill_fetch_and_sub)
+  ADD_SIZED_INTRINSICS(__remill_fetch_and_and)
+  ADD_SIZED_INTRINSICS(__remill_fetch_and_or)
+  ADD_SIZED_INTRINSICS(__remill_fetch_and_xor)
+  ADD_SIZED_INTRINSICS(__remill_fetch_and_nand)
+  ADD_INTRINSIC(__remill_barrier_load_load)
+  ADD_INTRINSIC(__remill_barrier_load_store)
+  ADD_INTRINSIC(__remill_barrier_store_load)
+  ADD_INTRINSIC(__remill_barrier_store_store)
+  ADD_INTRINSIC(__remill_atomic_begin)
+  ADD_INTRINSIC(__remill_atomic_end)
+  ADD_INTRINSIC(__remill_delay_slot_begin)
+  ADD_INTRINSIC(__remill_delay_slot_end)
+
+#undef ADD_SIZED_INTRINSICS
+#undef ADD_INTRINSIC
+}
+
+}  // namespace remill
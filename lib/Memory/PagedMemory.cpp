@@ -0,0 +1,257 @@
+/*
+ * Copyright (c) 2020 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "remill/Memory/PagedMemory.h"
+
+#include <glog/logging.h>
+
+#include <algorithm>
+#include <iomanip>
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace remill {
+namespace {
+
+static constexpr uint64_t kInvalidPage = ~0ull;
+
+struct alignas(PagedMemory::kPageSize) PageData {
+  uint8_t bytes[PagedMemory::kPageSize];
+};
+
+struct Page {
+  std::unique_ptr<PageData> data;
+  uint8_t perms;
+};
+
+static bool DefaultFaultHandler(PagedMemory &, uint64_t addr, uint64_t size,
+                                PagedMemory::Permission perms, void *) {
+  LOG(FATAL) << "Invalid " << ((perms & PagedMemory::kWrite) ? "write" : "read")
+             << " of " << size << " bytes at guest address " << std::hex
+             << addr << std::dec;
+  return false;
+}
+
+// Calls `cb` with the page number, page offset, and size of each part of
+// `[addr, addr + size)` that falls within one page.
+template <typename CB>
+static bool ForEachPage(uint64_t addr, uint64_t size, CB cb) {
+  while (size) {
+    const auto offset = addr & PagedMemory::kPageMask;
+    const auto chunk = std::min(size, PagedMemory::kPageSize - offset);
+    if (!cb(addr >> PagedMemory::kPageShift, offset, chunk)) {
+      return false;
+    }
+    addr += chunk;
+    size -= chunk;
+  }
+  return true;
+}
+
+}  // namespace
+
+// The page table, shared by every view of an address space. The TLBs of the
+// views are refilled under a shared lock, and the mappings are changed under
+// an exclusive lock.
+class PagedMemory::Impl {
+ public:
+  Page *FindPage(uint64_t page) {
+    auto it = pages.find(page);
+    return it != pages.end() ? &(it->second) : nullptr;
+  }
+
+  // Returns the host address of the `size` bytes at `offset` in the page
+  // `page`, calling the fault handler until the page permits `perms`.
+  uint8_t *Fault(PagedMemory &self, uint64_t page, uint64_t offset,
+                 uint64_t size, uint8_t perms) {
+    for (;;) {
+      FaultHandler handler = nullptr;
+      void *handler_data = nullptr;
+      {
+        std::shared_lock<std::shared_mutex> locker(lock);
+        if (auto p = FindPage(page); p && (p->perms & perms) == perms) {
+          return &(p->data->bytes[offset]);
+        }
+        handler = fault_handler;
+        handler_data = fault_handler_data;
+      }
+      const auto addr = (page << kPageShift) | offset;
+      if (!handler(self, addr, size, static_cast<Permission>(perms),
+                   handler_data)) {
+        return nullptr;
+      }
+    }
+  }
+
+  // Flush the TLBs of every view, after changing the mappings.
+  void FlushTLBs(void) {
+    for (auto view : views) {
+      view->FlushTLB();
+    }
+  }
+
+  std::shared_mutex lock;
+  std::unordered_map<uint64_t, Page> pages;
+  std::vector<PagedMemory *> views;
+  FaultHandler fault_handler{DefaultFaultHandler};
+  void *fault_handler_data{nullptr};
+};
+
+PagedMemory::PagedMemory(void) : impl(new Impl) {
+  impl->views.push_back(this);
+  FlushTLB();
+}
+
+PagedMemory::PagedMemory(PagedMemory &shared) : impl(shared.impl) {
+  std::unique_lock<std::shared_mutex> locker(impl->lock);
+  impl->views.push_back(this);
+  FlushTLB();
+}
+
+PagedMemory::~PagedMemory(void) {
+  std::unique_lock<std::shared_mutex> locker(impl->lock);
+  auto &views = impl->views;
+  views.erase(std::remove(views.begin(), views.end(), this), views.end());
+}
+
+void PagedMemory::SetFaultHandler(FaultHandler handler, void *data) {
+  std::unique_lock<std::shared_mutex> locker(impl->lock);
+  impl->fault_handler = handler ? handler : DefaultFaultHandler;
+  impl->fault_handler_data = data;
+}
+
+void PagedMemory::Map(uint64_t addr, uint64_t size, uint8_t perms) {
+  std::unique_lock<std::shared_mutex> locker(impl->lock);
+  ForEachPage(addr, size, [=](uint64_t page, uint64_t, uint64_t) {
+    auto &p = impl->pages[page];
+    if (!p.data) {
+      p.data.reset(new PageData);
+      memset(p.data->bytes, 0, kPageSize);
+    }
+    p.perms = perms;
+    return true;
+  });
+  impl->FlushTLBs();
+}
+
+void PagedMemory::Unmap(uint64_t addr, uint64_t size) {
+  std::unique_lock<std::shared_mutex> locker(impl->lock);
+  ForEachPage(addr, size, [=](uint64_t page, uint64_t, uint64_t) {
+    impl->pages.erase(page);
+    return true;
+  });
+  impl->FlushTLBs();
+}
+
+void PagedMemory::Protect(uint64_t addr, uint64_t size, uint8_t perms) {
+  std::unique_lock<std::shared_mutex> locker(impl->lock);
+  ForEachPage(addr, size, [=](uint64_t page, uint64_t, uint64_t) {
+    if (auto p = impl->FindPage(page)) {
+      p->perms = perms;
+    }
+    return true;
+  });
+  impl->FlushTLBs();
+}
+
+uint8_t PagedMemory::Permissions(uint64_t addr) const {
+  std::shared_lock<std::shared_mutex> locker(impl->lock);
+  const auto p = impl->FindPage(addr >> kPageShift);
+  return p ? p->perms : kNone;
+}
+
+bool PagedMemory::CopyIn(uint64_t addr, const void *data, uint64_t size) {
+  std::shared_lock<std::shared_mutex> locker(impl->lock);
+  auto bytes = reinterpret_cast<const uint8_t *>(data);
+  return ForEachPage(addr, size,
+                     [&](uint64_t page, uint64_t offset, uint64_t chunk) {
+                       auto p = impl->FindPage(page);
+                       if (!p) {
+                         return false;
+                       }
+                       memcpy(&(p->data->bytes[offset]), bytes, chunk);
+                       bytes += chunk;
+                       return true;
+                     });
+}
+
+bool PagedMemory::CopyOut(uint64_t addr, void *data, uint64_t size) const {
+  std::shared_lock<std::shared_mutex> locker(impl->lock);
+  auto bytes = reinterpret_cast<uint8_t *>(data);
+  return ForEachPage(addr, size,
+                     [&](uint64_t page, uint64_t offset, uint64_t chunk) {
+                       auto p = impl->FindPage(page);
+                       if (!p) {
+                         return false;
+                       }
+                       memcpy(bytes, &(p->data->bytes[offset]), chunk);
+                       bytes += chunk;
+                       return true;
+                     });
+}
+
+bool PagedMemory::Read(uint64_t addr, void *data, uint64_t size) {
+  memset(data, 0, size);
+  auto bytes = reinterpret_cast<uint8_t *>(data);
+  return ForEachPage(addr, size,
+                     [&](uint64_t page, uint64_t offset, uint64_t chunk) {
+                       auto host = impl->Fault(*this, page, offset, chunk,
+                                               kRead);
+                       if (host) {
+                         memcpy(bytes, host, chunk);
+                       }
+                       bytes += chunk;
+                       return host != nullptr;
+                     });
+}
+
+bool PagedMemory::Write(uint64_t addr, const void *data, uint64_t size) {
+  auto bytes = reinterpret_cast<const uint8_t *>(data);
+  return ForEachPage(addr, size,
+                     [&](uint64_t page, uint64_t offset, uint64_t chunk) {
+                       auto host = impl->Fault(*this, page, offset, chunk,
+                                               kWrite);
+                       if (host) {
+                         memcpy(host, bytes, chunk);
+                       }
+                       bytes += chunk;
+                       return host != nullptr;
+                     });
+}
+
+void PagedMemory::FlushTLB(void) {
+  for (auto &entry : read_tlb) {
+    entry = {kInvalidPage, nullptr};
+  }
+  for (auto &entry : write_tlb) {
+    entry = {kInvalidPage, nullptr};
+  }
+}
+
+uint8_t *PagedMemory::Refill(TLBEntry &entry, uint64_t addr, uint8_t perms) {
+  const auto page = addr >> kPageShift;
+  std::shared_lock<std::shared_mutex> locker(impl->lock);
+  const auto p = impl->FindPage(page);
+  if (!p || (p->perms & perms) != perms) {
+    return nullptr;
+  }
+  entry = {page, p->data->bytes};
+  return &(entry.host_page[addr & kPageMask]);
+}
+
+}  // namespace remill
@@ -0,0 +1,158 @@
+#!/usr/bin/env python3
+
+#
+# Copyright (c) 2021-present, Trail of Bits, Inc.
+# All rights reserved.
+#
+# This source code is licensed in accordance with the terms specified in
+# the LICENSE file found in the root directory of this source tree.
+#
+
+"""Compares the quality and speed of the lifted code of an arch test suite
+against a stored baseline, and fails if any test regressed by more than a
+threshold. The number of IR instructions of each test comes from the
+`--metrics_out` table of the `lift-<arch>-tests` generator, and the
+lifted-vs-native slowdown of each test comes from the
+`--benchmark_iterations` mode of the `run-<arch>-tests` runner. Suites
+without a baseline yet are skipped with a warning."""
+
+import argparse
+import csv
+import json
+import math
+import os
+import subprocess
+import sys
+
+
+def read_metrics(path):
+  ir_insts = {}
+  with open(path, newline="") as metrics_file:
+    for row in csv.DictReader(metrics_file, delimiter="\t"):
+      ir_insts[row["test"]] = int(row["ir_insts"])
+  return ir_insts
+
+
+def run_benchmarks(runner, iterations):
+  output = subprocess.run(
+      [runner, "--benchmark_iterations", str(iterations)],
+      check=True, stdout=subprocess.PIPE, universal_newlines=True).stdout
+  slowdowns = {}
+  for row in csv.DictReader(output.splitlines()):
+    slowdowns[row["test"]] = float(row["slowdown"])
+  return slowdowns
+
+
+def geometric_mean(values):
+  values = [max(v, 1e-12) for v in values]
+  if not values:
+    return 0.0
+  return math.exp(sum(math.log(v) for v in values) / len(values))
+
+
+def main():
+  parser = argparse.ArgumentParser(description=__doc__)
+  parser.add_argument("--arch", required=True,
+                      help="Name of the test suite, e.g. amd64_avx.")
+  parser.add_argument("--metrics", required=True,
+                      help="Table written by `lift-<arch>-tests "
+                           "--metrics_out`.")
+  parser.add_argument("--runner",
+                      help="Path to `run-<arch>-tests`. Without it, only the "
+                           "instruction counts are compared.")
+  parser.add_argument("--baseline", required=True,
+                      help="Baseline JSON file to compare against.")
+  parser.add_argument("--benchmark_iterations", type=int, default=1000,
+                      help="Number of executions of each test to time.")
+  parser.add_argument("--max_ir_increase", type=float, default=0.05,
+                      help="Largest allowed relative increase of the number "
+                           "of IR instructions of a test.")
+  parser.add_argument("--max_slowdown_increase", type=float, default=0.25,
+                      help="Largest allowed relative increase of the "
+                           "lifted-vs-native slowdown of a test.")
+  parser.add_argument("--update", action="store_true",
+                      help="Write the current results to the baseline "
+                           "instead of comparing against it.")
+  args = parser.parse_args()
+
+  ir_insts = read_metrics(args.metrics)
+  slowdowns = {}
+  if args.runner:
+    slowdowns = run_benchmarks(args.runner, args.benchmark_iterations)
+
+  current = {}
+  for test, num_insts in ir_insts.items():
+    current[test] = {"ir_insts": num_insts}
+    if test in slowdowns:
+      current[test]["slowdown"] = slowdowns[test]
+
+  if args.update:
+    os.makedirs(os.path.dirname(os.path.abspath(args.baseline)),
+                exist_ok=True)
+    with open(args.baseline, "w") as baseline_file:
+      json.dump({"arch": args.arch,
+                 "benchmark_iterations": args.benchmark_iterations,
+                 "tests": current},
+                baseline_file, indent=1, sort_keys=True)
+      baseline_file.write("\n")
+    print("Wrote the baseline of {} tests to {}".format(
+        len(current), args.baseline))
+    return 0
+
+  try:
+    with open(args.baseline) as baseline_file:
+      baseline = json.load(baseline_file)["tests"]
+  except FileNotFoundError:
+    print("warning: no baseline at {}; skipping {}. Create it with the "
+          "update-perf-baseline-{} target".format(args.baseline, args.arch,
+                                                  args.arch),
+          file=sys.stderr)
+    return 0
+
+  regressions = []
+  base_slowdowns = []
+  curr_slowdowns = []
+  for test in sorted(baseline):
+    if test not in current:
+      print("warning: test {} is no longer lifted".format(test),
+            file=sys.stderr)
+      continue
+
+    base = baseline[test]
+    curr = current[test]
+    limit = base["ir_insts"] * (1.0 + args.max_ir_increase)
+    if curr["ir_insts"] > max(limit, base["ir_insts"] + 1):
+      regressions.append("{}: {} IR instructions, up from {}".format(
+          test, curr["ir_insts"], base["ir_insts"]))
+
+    if "slowdown" in base and "slowdown" in curr:
+      base_slowdowns.append(base["slowdown"])
+      curr_slowdowns.append(curr["slowdown"])
+      limit = base["slowdown"] * (1.0 + args.max_slowdown_increase)
+      if curr["slowdown"] > limit:
+        regressions.append("{}: {:.2f}x slower than native, up from "
+                           "{:.2f}x".format(test, curr["slowdown"],
+                                            base["slowdown"]))
+
+  for test in sorted(set(current) - set(baseline)):
+    print("warning: test {} has no baseline".format(test), file=sys.stderr)
+
+  if base_slowdowns:
+    print("Geometric mean slowdown of {} tests: {:.3f}x, baseline "
+          "{:.3f}x".format(len(curr_slowdowns),
+                           geometric_mean(curr_slowdowns),
+                           geometric_mean(base_slowdowns)))
+
+  if regressions:
+    print("{} performance regressions in {}:".format(
+        len(regressions), args.arch), file=sys.stderr)
+    for regression in regressions:
+      print("  " + regression, file=sys.stderr)
+    return 1
+
+  print("No performance regressions in {}".format(args.arch))
+  return 0
+
+
+if __name__ == "__main__":
+  sys.exit(main())
@@ -14,7 +14,8 @@
 # limitations under the License.
 
 # This script is a convenience script for generating some assembly code that
-# is a template for saving the machine state to a `State` structure.
+# is a template for saving the machine state to a `State` structure, and for
+# restoring it from one.
 
 DIR=$(dirname $(dirname $( cd "$( dirname "${BASH_SOURCE[0]}" )" && pwd )))
 
@@ -33,5 +34,16 @@ ${CXX} \
 mkdir -p $DIR/generated/Arch/X86/
 
 ./a.out > $DIR/generated/Arch/X86/SaveState.S
+
+${CXX} \
+    -std=gnu++11 \
+    -Wno-nested-anon-types -Wno-variadic-macros -Wno-extended-offsetof \
+    -Wno-invalid-offsetof \
+    -Wno-return-type-c-linkage \
+    -m64 -I${DIR} \
+    -DADDRESS_SIZE_BITS=64 -DHAS_FEATURE_AVX=1 -DHAS_FEATURE_AVX512=1 \
+    $DIR/tests/X86/PrintRestoreState.cpp
+
+./a.out > $DIR/generated/Arch/X86/RestoreState.S
 rm ./a.out
 popd
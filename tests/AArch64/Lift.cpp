@@ -17,29 +17,54 @@
 #include <gflags/gflags.h>
 #include <glog/logging.h>
 #include <llvm/IR/Function.h>
+#include <llvm/ADT/SmallString.h>
 #include <llvm/IR/GlobalValue.h>
+#include <llvm/IR/InstIterator.h>
 #include <llvm/IR/Instructions.h>
 #include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/LegacyPassManager.h>
+#include <llvm/IR/Mangler.h>
 #include <llvm/IR/Module.h>
+#include <llvm/IR/Operator.h>
 #include <llvm/IR/Type.h>
+#include <llvm/Support/TargetSelect.h>
+#include <llvm/Support/raw_ostream.h>
+#include <llvm/Target/TargetMachine.h>
+#include <llvm/Target/TargetOptions.h>
+#include <llvm/Transforms/Utils/Cloning.h>
 
 #include <algorithm>
+#include <atomic>
 #include <cstdint>
 #include <fstream>
 #include <map>
 #include <memory>
 #include <sstream>
 #include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
 
 #include "remill/Arch/Arch.h"
 #include "remill/Arch/Instruction.h"
 #include "remill/Arch/Name.h"
+#include "remill/BC/ABI.h"
 #include "remill/BC/IntrinsicTable.h"
 #include "remill/BC/Lifter.h"
+#include "remill/BC/Optimizer.h"
 #include "remill/BC/Util.h"
+#include "remill/BC/Version.h"
 #include "remill/OS/OS.h"
 #include "tests/AArch64/Test.h"
 
+#if LLVM_VERSION_NUMBER >= LLVM_VERSION(14, 0)
+#  include <llvm/MC/TargetRegistry.h>
+#else
+#  include <llvm/Support/TargetRegistry.h>
+#endif
+
 #ifdef __APPLE__
 #  define SYMBOL_PREFIX "_"
 #else
@@ -49,13 +74,34 @@
 DEFINE_string(bc_out, "",
               "Name of the file in which to place the generated bitcode.");
 
+DEFINE_string(metrics_out, "",
+              "Name of the file in which to place a table of what is left "
+              "of the lifted code of each test once it is optimized: the "
+              "numbers of IR instructions, memory intrinsic calls, loads "
+              "and stores of the state structure, and host instructions.");
+
+DEFINE_uint32(num_shards, 1,
+              "Number of modules into which the lifted tests are split. If "
+              "greater than one, then the Nth module is saved in place of "
+              "--bc_out, e.g. to 'tests.N.bc' for 'tests.bc', and only the "
+              "lifted tests are visible outside of each module.");
+
+DEFINE_uint32(shard_threads, 0,
+              "Number of threads on which the shards are lifted. By default, "
+              "one thread per hardware thread is used.");
+
 DECLARE_string(arch);
 DECLARE_string(os);
 
 namespace {
 
+// The code bytes of every test case.
+using TestMemory = std::unordered_map<uint64_t, uint8_t>;
+
 class TestTraceManager : public remill::TraceManager {
  public:
+  explicit TestTraceManager(const TestMemory &memory_) : memory(memory_) {}
+
   virtual ~TestTraceManager(void) = default;
 
   void SetLiftedTraceDefinition(uint64_t addr,
@@ -87,36 +133,228 @@ class TestTraceManager : public remill::TraceManager {
   }
 
  public:
-  std::unordered_map<uint64_t, uint8_t> memory;
+  const TestMemory &memory;
   std::unordered_map<uint64_t, llvm::Function *> traces;
 };
 
-}  // namespace
+// What is left of the lifted code of one test, once it is optimized.
+struct TestMetrics {
+  unsigned ir_insts{0};
+  unsigned memory_calls{0};
+  unsigned state_loads{0};
+  unsigned state_stores{0};
+  unsigned host_insts{0};
+};
 
-extern "C" int main(int argc, char *argv[]) {
-  google::ParseCommandLineFlags(&argc, &argv, true);
-  google::InitGoogleLogging(argv[0]);
+// Returns `true` if `ptr` points into the state structure `state`.
+static bool PointsIntoState(llvm::Value *ptr, llvm::Value *state) {
+  for (;;) {
+    ptr = ptr->stripPointerCasts();
+    if (ptr == state) {
+      return true;
+    } else if (auto gep = llvm::dyn_cast<llvm::GEPOperator>(ptr)) {
+      ptr = gep->getPointerOperand();
+    } else {
+      return false;
+    }
+  }
+}
 
-  DLOG(INFO) << "Generating tests.";
+static bool IsMemoryIntrinsic(llvm::Function *func) {
+  if (!func) {
+    return false;
+  }
+  const auto name = func->getName();
+  return name.startswith("__remill_read_memory_") ||
+         name.startswith("__remill_write_memory_") ||
+         name.startswith("__remill_compare_exchange_memory_") ||
+         name.startswith("__remill_fetch_and_");
+}
 
-  std::vector<const test::TestInfo *> tests;
-  for (auto i = 0U;; ++i) {
-    const auto &test = test::__aarch64_test_table_begin[i];
-    if (&test >= &(test::__aarch64_test_table_end[0])) {
-      break;
+// Count the IR instructions, memory intrinsic calls, and state loads and
+// stores of the lifted function `func`.
+static void CountIR(llvm::Function *func, TestMetrics &metrics) {
+  auto state = remill::NthArgument(func, remill::kStatePointerArgNum);
+  for (auto &inst : llvm::instructions(func)) {
+    metrics.ir_insts += 1;
+    if (auto call = llvm::dyn_cast<llvm::CallInst>(&inst)) {
+      metrics.memory_calls += IsMemoryIntrinsic(call->getCalledFunction());
+    } else if (auto load = llvm::dyn_cast<llvm::LoadInst>(&inst)) {
+      metrics.state_loads += PointsIntoState(load->getPointerOperand(), state);
+    } else if (auto store = llvm::dyn_cast<llvm::StoreInst>(&inst)) {
+      metrics.state_stores +=
+          PointsIntoState(store->getPointerOperand(), state);
     }
-    tests.push_back(&test);
   }
+}
 
-  TestTraceManager manager;
+// Compile `module` for the host, and count the instructions in the assembly
+// of the function of each test in `funcs`.
+static void
+CountHostInstructions(llvm::Module *module,
+                      const std::map<std::string, llvm::Function *> &funcs,
+                      std::map<std::string, TestMetrics> &metrics) {
+  std::string error;
+  const auto triple = module->getTargetTriple();
+  auto target = llvm::TargetRegistry::lookupTarget(triple, error);
+  CHECK(target) << "Could not find target " << triple << ": " << error;
 
-  // Add all code byts from the test cases to the memory.
+  // The generic CPU keeps the counts independent of the host running this.
+  std::unique_ptr<llvm::TargetMachine> tm(target->createTargetMachine(
+      triple, "generic", "", llvm::TargetOptions(), llvm::Reloc::PIC_));
+  module->setDataLayout(tm->createDataLayout());
+
+  llvm::SmallString<0> asm_text;
+  llvm::raw_svector_ostream os(asm_text);
+  llvm::legacy::PassManager pm;
+#if LLVM_VERSION_NUMBER >= LLVM_VERSION(10, 0)
+  const auto file_type = llvm::CGFT_AssemblyFile;
+#else
+  const auto file_type = llvm::TargetMachine::CGFT_AssemblyFile;
+#endif
+  CHECK(!tm->addPassesToEmitFile(pm, os, nullptr, file_type))
+      << "Could not compile the lifted tests for " << triple;
+  pm.run(*module);
+
+  llvm::Mangler mangler;
+  std::unordered_map<std::string, TestMetrics *> symbol_metrics;
+  for (const auto &[test_name, func] : funcs) {
+    std::string symbol;
+    llvm::raw_string_ostream symbol_os(symbol);
+    mangler.getNameWithPrefix(symbol_os, func, false);
+    symbol_os.flush();
+    symbol_metrics.emplace(symbol, &(metrics[test_name]));
+  }
+
+  // Count the instruction lines between the label of each function and its
+  // end. Labels start in the first column, and instructions are indented.
+  llvm::SmallVector<llvm::StringRef, 0> lines;
+  llvm::StringRef(asm_text).split(lines, '\n');
+  TestMetrics *current = nullptr;
+  for (auto line : lines) {
+    if (line.empty()) {
+      continue;
+    } else if (line[0] != '\t' && line[0] != ' ') {
+      if (line.endswith(":")) {
+        if (auto it = symbol_metrics.find(line.drop_back().str());
+            it != symbol_metrics.end()) {
+          current = it->second;
+          continue;
+        }
+      }
+      if (line.contains("func_end")) {
+        current = nullptr;
+      }
+      continue;
+    }
+
+    const auto text = line.ltrim();
+    if (text.startswith(".size") || text.startswith(".cfi_endproc")) {
+      current = nullptr;
+    } else if (current && !text.empty() && text[0] != '.' &&
+               text[0] != '#' && text[0] != ';' && text[0] != '@' &&
+               !text.startswith("//")) {
+      current->host_insts += 1;
+    }
+  }
+}
+
+// Optimize a copy of the lifted code of the `tests` in `module`, and add what
+// is left of each of them to `metrics`.
+static void CollectMetrics(const remill::Arch *arch,
+                           const remill::Arch *host_arch,
+                           const llvm::Module *module,
+                           const std::vector<const test::TestInfo *> &tests,
+                           std::map<std::string, TestMetrics> &metrics) {
+  auto metrics_module = llvm::CloneModule(*module);
+  std::map<std::string, llvm::Function *> funcs;
+  std::unordered_map<uint64_t, llvm::Function *> traces;
+  std::unordered_set<llvm::Function *> lifted_funcs;
   for (auto test : tests) {
-    for (auto addr = test->test_begin; addr < test->test_end; ++addr) {
-      manager.memory[addr] = *reinterpret_cast<uint8_t *>(addr);
+    std::stringstream ss;
+    ss << SYMBOL_PREFIX << test->test_name << "_lifted";
+    auto func = metrics_module->getFunction(ss.str());
+    if (func && !func->isDeclaration()) {
+      funcs[test->test_name] = func;
+      traces[test->test_begin] = func;
+      lifted_funcs.insert(func);
     }
   }
 
+  remill::OptimizationGuide guide = {};
+  guide.eliminate_dead_stores = true;
+  remill::OptimizeModule(arch, metrics_module.get(), traces, guide);
+
+  // Only the lifted code is compiled.
+  for (auto &func : *metrics_module) {
+    if (!func.isDeclaration() && !lifted_funcs.count(&func)) {
+      func.deleteBody();
+    }
+  }
+
+  for (const auto &[test_name, func] : funcs) {
+    CountIR(func, metrics[test_name]);
+  }
+  host_arch->PrepareModule(metrics_module.get());
+  CountHostInstructions(metrics_module.get(), funcs, metrics);
+}
+
+// Save the `metrics` to `--metrics_out`, one test per line, ordered by name,
+// so that the metrics of two revisions can be diffed.
+static void SaveMetrics(const std::map<std::string, TestMetrics> &metrics) {
+  std::ofstream out(FLAGS_metrics_out);
+  CHECK(out) << "Could not open " << FLAGS_metrics_out;
+  out << "test\tir_insts\tmemory_calls\tstate_loads\tstate_stores"
+      << "\thost_insts\n";
+  for (const auto &[test_name, m] : metrics) {
+    out << test_name << '\t' << m.ir_insts << '\t' << m.memory_calls << '\t'
+        << m.state_loads << '\t' << m.state_stores << '\t' << m.host_insts
+        << '\n';
+  }
+}
+
+// Returns the name of the `shard`th of several files that are saved in place
+// of `path`, e.g. `tests_x86.2.bc` for `tests_x86.bc`.
+static std::string ShardFileName(const std::string &path, unsigned shard) {
+  const auto dot = path.rfind('.');
+  const auto sep = path.find_last_of("/\\");
+  std::stringstream ss;
+  if (dot == std::string::npos || (sep != std::string::npos && dot < sep)) {
+    ss << path << '.' << shard;
+  } else {
+    ss << path.substr(0, dot) << '.' << shard << path.substr(dot);
+  }
+  return ss.str();
+}
+
+// Make everything but the `lifted_funcs` internal to `module`, so that the
+// copies of the semantics in the modules of several shards can be linked
+// into one program.
+static void
+InternalizeSemantics(llvm::Module *module,
+                     const std::unordered_set<llvm::Function *> &lifted_funcs) {
+  for (auto &func : *module) {
+    if (!func.isDeclaration() && !lifted_funcs.count(&func)) {
+      func.setComdat(nullptr);
+      func.setLinkage(llvm::GlobalValue::InternalLinkage);
+    }
+  }
+  for (auto &var : module->globals()) {
+    if (!var.isDeclaration() && !var.getName().startswith("llvm.")) {
+      var.setComdat(nullptr);
+      var.setLinkage(llvm::GlobalValue::InternalLinkage);
+    }
+  }
+}
+
+// Lift the `tests` of one shard into a module of their own, and save it to
+// `bc_out`. The metrics of the tests are added to `metrics`.
+static void LiftShard(const std::vector<const test::TestInfo *> &tests,
+                      const TestMemory &memory, const std::string &bc_out,
+                      bool internalize,
+                      std::map<std::string, TestMetrics> &metrics) {
+  TestTraceManager manager(memory);
+
   llvm::LLVMContext context;
   auto os_name = remill::GetOSName(REMILL_OS);
   auto arch_name = remill::GetArchName(FLAGS_arch);
@@ -127,6 +365,7 @@ extern "C" int main(int argc, char *argv[]) {
   remill::InstructionLifter inst_lifter(arch, intrinsics);
   remill::TraceLifter trace_lifter(inst_lifter, manager);
 
+  std::unordered_set<llvm::Function *> lifted_funcs;
   for (auto test : tests) {
     if (!trace_lifter.Lift(test->test_begin)) {
       LOG(ERROR) << "Unable to lift test " << test->test_name;
@@ -139,13 +378,97 @@ extern "C" int main(int argc, char *argv[]) {
 
     auto lifted_trace = manager.GetLiftedTraceDefinition(test->test_begin);
     lifted_trace->setName(ss.str());
+    lifted_funcs.insert(lifted_trace);
   }
 
-  DLOG(INFO) << "Serializing bitcode to " << FLAGS_bc_out;
   auto host_arch =
       remill::Arch::Build(&context, os_name, remill::GetArchName(REMILL_ARCH));
-  host_arch->PrepareModule(module.get());
-  remill::StoreModuleToFile(module.get(), FLAGS_bc_out);
+  if (!FLAGS_metrics_out.empty()) {
+    CollectMetrics(arch.get(), host_arch.get(), module.get(), tests, metrics);
+  }
+
+  if (!bc_out.empty()) {
+    DLOG(INFO) << "Serializing bitcode to " << bc_out;
+    if (internalize) {
+      InternalizeSemantics(module.get(), lifted_funcs);
+    }
+    host_arch->PrepareModule(module.get());
+    remill::StoreModuleToFile(module.get(), bc_out);
+  }
+}
+
+}  // namespace
+
+extern "C" int main(int argc, char *argv[]) {
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  google::InitGoogleLogging(argv[0]);
+
+  DLOG(INFO) << "Generating tests.";
+
+  std::vector<const test::TestInfo *> tests;
+  for (auto i = 0U;; ++i) {
+    const auto &test = test::__aarch64_test_table_begin[i];
+    if (&test >= &(test::__aarch64_test_table_end[0])) {
+      break;
+    }
+    tests.push_back(&test);
+  }
+
+  // Add all code byts from the test cases to the memory.
+  TestMemory memory;
+  for (auto test : tests) {
+    for (auto addr = test->test_begin; addr < test->test_end; ++addr) {
+      memory[addr] = *reinterpret_cast<uint8_t *>(addr);
+    }
+  }
+
+  // The targets are registered once, before any shard compiles its code.
+  if (!FLAGS_metrics_out.empty()) {
+    llvm::InitializeNativeTarget();
+    llvm::InitializeNativeTargetAsmPrinter();
+  }
+
+  // Every shard is saved, even if it has no tests, so that the build knows
+  // which files to expect. The shards hold contiguous ranges of tests.
+  const auto num_shards = std::max(1u, FLAGS_num_shards);
+  std::vector<std::map<std::string, TestMetrics>> shard_metrics(num_shards);
+  std::atomic<unsigned> next_shard(0);
+  auto lift_shards = [&](void) {
+    for (unsigned i; (i = next_shard.fetch_add(1)) < num_shards;) {
+      const auto begin = tests.size() * i / num_shards;
+      const auto end = tests.size() * (i + 1) / num_shards;
+      const std::vector<const test::TestInfo *> shard_tests(
+          tests.begin() + begin, tests.begin() + end);
+      const auto bc_out = (1 < num_shards && !FLAGS_bc_out.empty())
+                              ? ShardFileName(FLAGS_bc_out, i)
+                              : FLAGS_bc_out;
+      LiftShard(shard_tests, memory, bc_out, 1 < num_shards,
+                shard_metrics[i]);
+    }
+  };
+
+  auto num_threads = FLAGS_shard_threads;
+  if (!num_threads) {
+    num_threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  num_threads = std::min(num_threads, num_shards);
+  std::vector<std::thread> threads;
+  for (unsigned i = 1; i < num_threads; ++i) {
+    threads.emplace_back(lift_shards);
+  }
+  lift_shards();
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  if (!FLAGS_metrics_out.empty()) {
+    DLOG(INFO) << "Saving metrics to " << FLAGS_metrics_out;
+    std::map<std::string, TestMetrics> metrics;
+    for (auto &shard : shard_metrics) {
+      metrics.merge(shard);
+    }
+    SaveMetrics(metrics);
+  }
 
   DLOG(INFO) << "Done.";
   return 0;
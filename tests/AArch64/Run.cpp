@@ -24,7 +24,9 @@
 #include <signal.h>
 #include <ucontext.h>
 
+#include <algorithm>
 #include <cfenv>
+#include <chrono>
 #include <cmath>
 #include <cstdint>
 #include <cstdlib>
@@ -43,6 +45,11 @@
 DECLARE_string(arch);
 DECLARE_string(os);
 
+DEFINE_uint64(benchmark_iterations, 0,
+              "If non-zero, then instead of comparing the lifted and native "
+              "states, time this many native and lifted executions of each "
+              "test case, and print how much slower the lifted code is.");
+
 namespace {
 
 struct alignas(128) Stack {
@@ -153,6 +160,44 @@ NEVER_INLINE Memory *__remill_write_memory_f80(Memory *, addr_t, float64_t) {
   abort();
 }
 
+#define MAKE_RW_VEC_MEMORY(size) \
+  NEVER_INLINE vec##size##_t __remill_read_memory_v##size(Memory *, \
+                                                          addr_t addr) { \
+    return AccessMemory<vec##size##_t>(addr); \
+  } \
+  NEVER_INLINE Memory *__remill_write_memory_v##size(Memory *, addr_t addr, \
+                                                     vec##size##_t in) { \
+    AccessMemory<vec##size##_t>(addr) = in; \
+    return nullptr; \
+  }
+
+MAKE_RW_VEC_MEMORY(128)
+MAKE_RW_VEC_MEMORY(256)
+MAKE_RW_VEC_MEMORY(512)
+
+#define MAKE_BULK_MEMORY(size) \
+  NEVER_INLINE Memory *__remill_copy_memory_##size( \
+      Memory *memory, addr_t dst, addr_t src, addr_t count) { \
+    for (addr_t i = 0; i < count; ++i) { \
+      const addr_t offset = i * sizeof(uint##size##_t); \
+      AccessMemory<uint##size##_t>(dst + offset) = \
+          AccessMemory<uint##size##_t>(src + offset); \
+    } \
+    return memory; \
+  } \
+  NEVER_INLINE Memory *__remill_fill_memory_##size( \
+      Memory *memory, addr_t dst, uint##size##_t val, addr_t count) { \
+    for (addr_t i = 0; i < count; ++i) { \
+      AccessMemory<uint##size##_t>(dst + i * sizeof(uint##size##_t)) = val; \
+    } \
+    return memory; \
+  }
+
+MAKE_BULK_MEMORY(8)
+MAKE_BULK_MEMORY(16)
+MAKE_BULK_MEMORY(32)
+MAKE_BULK_MEMORY(64)
+
 Memory *__remill_compare_exchange_memory_8(Memory *memory, addr_t addr,
                                            uint8_t &expected, uint8_t desired) {
   expected = __sync_val_compare_and_swap(reinterpret_cast<uint8_t *>(addr),
@@ -363,15 +408,36 @@ inline static bool operator!=(const T &a, const T &b) {
   return !!memcmp(&a, &b, sizeof(a));
 }
 
+// Describe the run of the test case `info` with the arguments `args` and the
+// initial flags `flags`. This is only done for the messages of failing and
+// logged runs, as building the descriptions of every run otherwise dominates
+// the time taken by a passing test.
+static std::string DescribeRun(const test::TestInfo *info,
+                               const uint64_t *args, NZCV flags) {
+  std::stringstream ss;
+  ss << info->test_name;
+  if (1 <= info->num_args) {
+    ss << " with X0=" << std::hex << args[0];
+    if (2 <= info->num_args) {
+      ss << ", X1=" << std::hex << args[1];
+      if (3 <= info->num_args) {
+        ss << ", X2=" << std::hex << args[2];
+      }
+    }
+  }
+  ss << std::dec << " and N=" << flags.n << ", Z=" << flags.z
+     << ", C=" << flags.c << ", V=" << flags.v;
+  return ss.str();
+}
+
+// Run the test case `info` natively and lifted, with the arguments `args` and
+// the initial flags `flags`, and compare the resulting states and stacks.
+//
+// NOTE(pag): The caller must have set `gUnsupportedInstrBuf`.
 static void RunWithFlags(const test::TestInfo *info, NZCV flags,
-                         std::string desc, uint64_t arg1, uint64_t arg2,
-                         uint64_t arg3) {
+                         const uint64_t *args) {
 
-  DLOG(INFO) << "Testing instruction: " << info->test_name << ": " << desc;
-  if (sigsetjmp(gUnsupportedInstrBuf, true)) {
-    DLOG(INFO) << "Unsupported instruction " << info->test_name;
-    return;
-  }
+  DLOG(INFO) << "Testing instruction: " << DescribeRun(info, args, flags);
 
   memcpy(&gLiftedStack, &gRandomStack, sizeof(gLiftedStack));
   memset(&gLiftedState, 0, sizeof(gLiftedState));
@@ -392,7 +458,7 @@ static void RunWithFlags(const test::TestInfo *info, NZCV flags,
   if (!sigsetjmp(gJmpBuf, true)) {
     gInNativeTest = true;
     asm("msr nzcv, %0" : : "r"(flags));
-    InvokeTestCase(arg1, arg2, arg3);
+    InvokeTestCase(args[0], args[1], args[2]);
   } else {
     native_test_faulted = true;
   }
@@ -436,8 +502,6 @@ static void RunWithFlags(const test::TestInfo *info, NZCV flags,
   native_state->hyper_call = AsyncHyperCall::kInvalid;
   lifted_state->hyper_call = AsyncHyperCall::kInvalid;
 
-  EXPECT_TRUE(lifted_state->gpr == native_state->gpr);
-
   // The lifted code won't update these.
   native_state->nzcv.flat = 0;
   lifted_state->nzcv.flat = 0;
@@ -446,7 +510,19 @@ static void RunWithFlags(const test::TestInfo *info, NZCV flags,
   native_state->fpsr.flat = 0;
   lifted_state->fpsr.flat = 0;
 
-  if (gLiftedState != gNativeState) {
+  // Nearly every run matches, and so compare the states and stacks in bulk,
+  // and only compare them field by field, with descriptive failures, when
+  // they differ.
+  const auto states_match = gLiftedState == gNativeState;
+  const auto stacks_match = gLiftedStack == gNativeStack;
+  if (states_match && stacks_match) {
+    return;
+  }
+
+  const auto desc = DescribeRun(info, args, flags);
+  EXPECT_TRUE(lifted_state->gpr == native_state->gpr);
+
+  if (!states_match) {
     LOG(ERROR) << "States did not match for " << desc;
     EXPECT_TRUE(!"Lifted and native states did not match.");
 
@@ -504,7 +580,7 @@ static void RunWithFlags(const test::TestInfo *info, NZCV flags,
     }
   }
 
-  if (gLiftedStack != gNativeStack) {
+  if (!stacks_match) {
     LOG(ERROR) << "Stacks did not match for " << desc;
 
     for (size_t i = 0; i < sizeof(gLiftedStack.bytes); ++i) {
@@ -526,35 +602,125 @@ TEST_P(InstrTest, SemanticsMatchNative) {
   CHECK(0 < info->num_args)
       << "Test " << info->test_name << " must have at least one argument!";
 
+  // An unsupported instruction would be unsupported in every run, and so the
+  // whole test case is skipped on the first one. This also saves setting the
+  // jump buffer, and its signal mask, on every run.
+  if (sigsetjmp(gUnsupportedInstrBuf, true)) {
+    DLOG(INFO) << "Unsupported instruction " << info->test_name;
+    return;
+  }
+
   for (auto args = info->args_begin; args < info->args_end;
        args += info->num_args) {
-    std::stringstream ss;
-    ss << info->test_name;
-    if (1 <= info->num_args) {
-      ss << " with X0=" << std::hex << args[0];
-      if (2 <= info->num_args) {
-        ss << ", X1=" << std::hex << args[1];
-        if (3 <= info->num_args) {
-          ss << ", X2=" << std::hex << args[3];
-        }
-      }
-    }
-    auto desc = ss.str();
     for (uint32_t i = 0; i <= 0xFU; ++i) {
       NZCV flags;
       flags.flat = i << 28;
-
-      std::stringstream ss2;
-      ss2 << desc << " and N=" << flags.n << ", Z=" << flags.z
-          << ", C=" << flags.c << ", V=" << flags.v;
-
-      RunWithFlags(info, flags, ss2.str(), args[0], args[1], args[2]);
+      RunWithFlags(info, flags, args);
     }
   }
 }
 
 INSTANTIATE_TEST_CASE_P(GeneralInstrTest, InstrTest, testing::ValuesIn(gTests));
 
+// Time `FLAGS_benchmark_iterations` native and lifted executions of the test
+// case `info`, with its first arguments and cleared flags. Returns `false` if
+// the test case faulted, or if its instruction isn't supported.
+static bool BenchmarkTestCase(const test::TestInfo *info, double &native_secs,
+                              double &lifted_secs) {
+  static std::aligned_storage<sizeof(AArch64State),
+                              alignof(AArch64State)>::type initial_state;
+
+  if (info->args_begin >= info->args_end) {
+    return false;
+  }
+
+  if (sigsetjmp(gUnsupportedInstrBuf, true)) {
+    return false;
+  }
+
+  const auto args = info->args_begin;
+  const auto iterations = FLAGS_benchmark_iterations;
+  auto lifted_func = gTranslatedFuncs[info->test_begin];
+  auto lifted_state = reinterpret_cast<AArch64State *>(&gLiftedState);
+  NZCV flags;
+  flags.flat = 0;
+
+  gTestToRun = info->test_begin;
+  gStackSwitcher = &(gLiftedStack._redzone2[0]);
+
+  if (sigsetjmp(gJmpBuf, true)) {
+    return false;
+  }
+
+  // The first native run records the state from which every lifted run
+  // starts.
+  memcpy(&gLiftedStack, &gRandomStack, sizeof(gLiftedStack));
+  gInNativeTest = true;
+  asm("msr nzcv, %0" : : "r"(flags));
+  InvokeTestCase(args[0], args[1], args[2]);
+  memcpy(&initial_state, &gLiftedState, sizeof(initial_state));
+
+  const auto native_start = std::chrono::steady_clock::now();
+  for (uint64_t i = 0; i < iterations; ++i) {
+    memcpy(&gLiftedStack, &gRandomStack, sizeof(gLiftedStack));
+    asm("msr nzcv, %0" : : "r"(flags));
+    InvokeTestCase(args[0], args[1], args[2]);
+  }
+  const auto native_end = std::chrono::steady_clock::now();
+
+  // Includes the additional injected `adrp` and `add`.
+  const auto pc = static_cast<addr_t>(info->test_begin + 4 + 4);
+
+  gInNativeTest = false;
+  std::fesetenv(FE_DFL_ENV);
+  const auto lifted_start = std::chrono::steady_clock::now();
+  for (uint64_t i = 0; i < iterations; ++i) {
+    memcpy(&gLiftedStack, &gRandomStack, sizeof(gLiftedStack));
+    memcpy(&gLiftedState, &initial_state, sizeof(gLiftedState));
+    lifted_state->gpr.pc.aword = pc;
+    (void) lifted_func(*lifted_state, pc, nullptr);
+  }
+  const auto lifted_end = std::chrono::steady_clock::now();
+
+  const std::chrono::duration<double> native_elapsed =
+      native_end - native_start;
+  const std::chrono::duration<double> lifted_elapsed =
+      lifted_end - lifted_start;
+  native_secs = native_elapsed.count();
+  lifted_secs = lifted_elapsed.count();
+  return true;
+}
+
+// Benchmark every test case, printing the time per execution of its native
+// and lifted code, and the slowdown of the lifted code, as CSV.
+static void RunBenchmarks(void) {
+  const auto iterations = static_cast<double>(FLAGS_benchmark_iterations);
+  double log_slowdowns = 0;
+  unsigned num_benchmarked = 0;
+
+  std::cout << "test,native_ns,lifted_ns,slowdown" << std::endl;
+  for (auto info : gTests) {
+    double native_secs = 0;
+    double lifted_secs = 0;
+    if (!BenchmarkTestCase(info, native_secs, lifted_secs)) {
+      LOG(WARNING) << "Not benchmarking " << info->test_name;
+      continue;
+    }
+    const auto slowdown = lifted_secs / std::max(native_secs, 1e-12);
+    std::cout << info->test_name << ',' << (native_secs * 1e9 / iterations)
+              << ',' << (lifted_secs * 1e9 / iterations) << ',' << slowdown
+              << std::endl;
+    log_slowdowns += std::log(std::max(slowdown, 1e-12));
+    num_benchmarked += 1;
+  }
+
+  if (num_benchmarked) {
+    std::cerr << "Geometric mean slowdown of " << num_benchmarked
+              << " test cases: " << std::exp(log_slowdowns / num_benchmarked)
+              << std::endl;
+  }
+}
+
 // Recover from a signal.
 static void RecoverFromError(int sig_num, siginfo_t *, void *context_) {
   if (gInNativeTest) {
@@ -708,5 +874,9 @@ int main(int argc, char **argv) {
   testing::InitGoogleTest(&argc, argv);
 
   SetupSignals();
+  if (FLAGS_benchmark_iterations) {
+    RunBenchmarks();
+    return EXIT_SUCCESS;
+  }
   return RUN_ALL_TESTS();
 }
@@ -0,0 +1,277 @@
+/*
+ * Copyright (c) 2020 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+#include <llvm/IR/BasicBlock.h>
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/InstIterator.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
+#include <llvm/IR/Verifier.h>
+
+#include <memory>
+#include <string_view>
+
+#include "remill/Arch/Arch.h"
+#include "remill/Arch/Instruction.h"
+#include "remill/BC/IntrinsicTable.h"
+#include "remill/BC/Lifter.h"
+#include "remill/BC/MemoryLowering.h"
+#include "remill/BC/Optimizer.h"
+#include "remill/BC/Statistics.h"
+#include "remill/BC/Util.h"
+
+// These check the shape of the lifted IR, which the semantics tests can't
+// observe, as they only compare the lifted code's results to native ones.
+
+namespace {
+
+class LiftedIRTest : public testing::Test {
+ protected:
+  LiftedIRTest(void)
+      : arch(remill::Arch::Get(context, "linux", "amd64")),
+        module(remill::LoadArchSemantics(arch.get())),
+        intrinsics(module.get()) {}
+
+  // Decode `bytes` as the instruction at `pc`.
+  remill::Instruction Decode(uint64_t pc, std::string_view bytes) {
+    remill::Instruction inst;
+    EXPECT_TRUE(arch->DecodeInstruction(pc, bytes, inst));
+    return inst;
+  }
+
+  // Declare a lifted function `name`, and return its entry block.
+  llvm::BasicBlock *DefineTrace(std::string_view name) {
+    const auto func = remill::DeclareLiftedFunction(module.get(), name);
+    remill::CloneBlockFunctionInto(func);
+    return &(func->getEntryBlock());
+  }
+
+  // Lift `inst` into a new lifted function `name`, and return the function.
+  llvm::Function *LiftTrace(std::string_view name, remill::Instruction inst) {
+    remill::InstructionLifter lifter(arch.get(), intrinsics);
+    const auto block = DefineTrace(name);
+    EXPECT_EQ(remill::kLiftedInstruction, lifter.LiftIntoBlock(inst, block));
+    llvm::ReturnInst::Create(context, remill::LoadMemoryPointer(block), block);
+    return block->getParent();
+  }
+
+  // Returns the number of loads in `block` from `ptr`.
+  static unsigned NumLoadsFrom(llvm::BasicBlock *block, llvm::Value *ptr) {
+    auto num_loads = 0u;
+    for (auto &inst : *block) {
+      if (auto load = llvm::dyn_cast<llvm::LoadInst>(&inst);
+          load && load->getPointerOperand() == ptr) {
+        ++num_loads;
+      }
+    }
+    return num_loads;
+  }
+
+  llvm::LLVMContext context;
+  const remill::Arch::ArchPtr arch;
+  const std::unique_ptr<llvm::Module> module;
+  const remill::IntrinsicTable intrinsics;
+};
+
+// A register that an instruction reads, but doesn't write, is forwarded to
+// the next instruction; one that it writes is loaded again.
+TEST_F(LiftedIRTest, RegisterValueForwarding) {
+  remill::InstructionLifter lifter(arch.get(), intrinsics);
+  lifter.SetRegisterValueForwarding(true);
+
+  const auto block = DefineTrace("forwarding");
+  const auto state_ptr = remill::LoadStatePointer(block);
+  auto add_rax_rbx = Decode(0x1000, "\x48\x01\xd8");
+  auto add_rcx_rbx = Decode(0x1003, "\x48\x01\xd9");
+  auto add_rdx_rax = Decode(0x1006, "\x48\x01\xc2");
+  ASSERT_EQ(remill::kLiftedInstruction,
+            lifter.LiftIntoBlock(add_rax_rbx, block, state_ptr));
+  ASSERT_EQ(remill::kLiftedInstruction,
+            lifter.LiftIntoBlock(add_rcx_rbx, block, state_ptr));
+  ASSERT_EQ(remill::kLiftedInstruction,
+            lifter.LiftIntoBlock(add_rdx_rax, block, state_ptr));
+
+  const auto rax = lifter.LoadRegAddress(block, state_ptr, "RAX");
+  const auto rbx = lifter.LoadRegAddress(block, state_ptr, "RBX");
+  EXPECT_EQ(1u, NumLoadsFrom(block, rbx));
+  EXPECT_EQ(2u, NumLoadsFrom(block, rax));
+}
+
+// The writes of a chain are coalesced even if the last write of the chain
+// isn't, and that write then stays at the end of the chain.
+TEST_F(LiftedIRTest, CoalesceWritesBeforeUnmergedWrite) {
+  llvm::Module writes_module("writes", context);
+  const auto write_8 = llvm::Function::Create(
+      intrinsics.write_memory_8->getFunctionType(),
+      llvm::GlobalValue::ExternalLinkage, "__remill_write_memory_8",
+      &writes_module);
+  llvm::Function::Create(intrinsics.write_memory_16->getFunctionType(),
+                         llvm::GlobalValue::ExternalLinkage,
+                         "__remill_write_memory_16", &writes_module);
+
+  // Writes the bytes at `addr`, `addr + 1`, and `addr + 5`.
+  const auto func_type = llvm::FunctionType::get(
+      write_8->getReturnType(),
+      {write_8->getArg(0)->getType(), write_8->getArg(1)->getType()}, false);
+  const auto func = llvm::Function::Create(
+      func_type, llvm::GlobalValue::ExternalLinkage, "writes", &writes_module);
+  llvm::IRBuilder<> ir(llvm::BasicBlock::Create(context, "", func));
+  const auto addr = func->getArg(1);
+  const auto addr_type = addr->getType();
+  llvm::Value *mem = func->getArg(0);
+  mem = ir.CreateCall(write_8, {mem, addr, ir.getInt8(1)});
+  mem = ir.CreateCall(
+      write_8,
+      {mem, ir.CreateAdd(addr, llvm::ConstantInt::get(addr_type, 1)),
+       ir.getInt8(2)});
+  const auto last = ir.CreateCall(
+      write_8,
+      {mem, ir.CreateAdd(addr, llvm::ConstantInt::get(addr_type, 5)),
+       ir.getInt8(3)});
+  const auto ret = ir.CreateRet(last);
+
+  EXPECT_EQ(1u, remill::CoalesceMemoryAccesses(arch.get(), &writes_module));
+  EXPECT_FALSE(llvm::verifyModule(writes_module, &llvm::errs()));
+  EXPECT_EQ(last, ret->getReturnValue());
+
+  const auto wide = llvm::dyn_cast<llvm::CallInst>(last->getArgOperand(0));
+  ASSERT_NE(nullptr, wide);
+  EXPECT_EQ("__remill_write_memory_16",
+            wide->getCalledFunction()->getName().str());
+}
+
+// An incremental optimization leaves a valid module, and still inlines the
+// semantics into the new trace.
+TEST_F(LiftedIRTest, IncrementalOptimizationVerifies) {
+  const auto first = LiftTrace("first", Decode(0x1000, "\x48\x01\xd8"));
+  remill::OptimizeModule(arch.get(), module.get(), {first});
+
+  const auto second = LiftTrace("second", Decode(0x1003, "\x48\x01\xd9"));
+  remill::OptimizationGuide guide = {};
+  guide.incremental = true;
+  remill::OptimizeModule(arch.get(), module.get(), {second}, guide);
+
+  EXPECT_FALSE(llvm::verifyModule(*module, &llvm::errs()));
+  for (auto &func : *module) {
+    EXPECT_FALSE(func.hasFnAttribute(llvm::Attribute::AlwaysInline) &&
+                 func.hasFnAttribute(llvm::Attribute::NoInline))
+        << func.getName().str();
+  }
+  for (auto &inst : llvm::instructions(*second)) {
+    if (auto call = llvm::dyn_cast<llvm::CallInst>(&inst)) {
+      const auto callee = call->getCalledFunction();
+      EXPECT_TRUE(!callee || callee->isDeclaration())
+          << callee->getName().str() << " wasn't inlined";
+    }
+  }
+}
+
+// `REP STOS` and `REP MOVS` only fill or copy in bulk ranges that don't wrap
+// around the address space. The semantics tests can't run these, as they
+// only access their stack.
+TEST_F(LiftedIRTest, RepStringOpsDontBulkAccessWrappingRanges) {
+  remill::InstructionLifter lifter(arch.get(), intrinsics);
+
+  // Lift `bytes` after setting `RCX` to 4, and `RSI` and `RDI` to `src` and
+  // `dst`, with DF clear.
+  const auto lift_with_range = [&](std::string_view name,
+                                   std::string_view bytes, uint64_t src,
+                                   uint64_t dst) {
+    const auto block = DefineTrace(name);
+    const auto state_ptr = remill::LoadStatePointer(block);
+    llvm::IRBuilder<> ir(block);
+    const auto set_reg = [&](std::string_view reg_name, llvm::Value *val) {
+      ir.CreateStore(val, lifter.LoadRegAddress(block, state_ptr, reg_name));
+    };
+    set_reg("RCX", ir.getInt64(4));
+    set_reg("RSI", ir.getInt64(src));
+    set_reg("RDI", ir.getInt64(dst));
+    set_reg("DF", ir.getInt8(0));
+    auto inst = Decode(0x1000, bytes);
+    EXPECT_EQ(remill::kLiftedInstruction,
+              lifter.LiftIntoBlock(inst, block, state_ptr));
+    llvm::ReturnInst::Create(context, remill::LoadMemoryPointer(block), block);
+    lifter.ClearCache();
+    return block->getParent();
+  };
+
+  // `rep stosb` and `rep movsb`.
+  const auto stos = lift_with_range("stos", "\xf3\xaa", 0, 0x1000);
+  const auto stos_wrap = lift_with_range("stos_wrap", "\xf3\xaa", 0, -2);
+  const auto movs = lift_with_range("movs", "\xf3\xa4", 0x1000, 0x2000);
+  const auto movs_wrap = lift_with_range("movs_wrap", "\xf3\xa4", -2, 0x2000);
+  remill::OptimizeModule(arch.get(), module.get(),
+                         {stos, stos_wrap, movs, movs_wrap});
+
+  const auto num_calls_to = [](llvm::Function *func, llvm::Function *callee) {
+    auto num_calls = 0u;
+    for (auto &inst : llvm::instructions(*func)) {
+      if (auto call = llvm::dyn_cast<llvm::CallInst>(&inst);
+          call && call->getCalledFunction() == callee) {
+        ++num_calls;
+      }
+    }
+    return num_calls;
+  };
+
+  EXPECT_EQ(1u, num_calls_to(stos, intrinsics.fill_memory_8));
+  EXPECT_EQ(0u, num_calls_to(stos_wrap, intrinsics.fill_memory_8));
+  EXPECT_EQ(1u, num_calls_to(movs, intrinsics.copy_memory_8));
+  EXPECT_EQ(0u, num_calls_to(movs_wrap, intrinsics.copy_memory_8));
+}
+
+// x86 has no native variants of atomic semantics, and so lifting a `LOCK`
+// instruction with native atomics uses its usual semantics, and doesn't
+// count the missing native variant as missing semantics.
+TEST_F(LiftedIRTest, NativeAtomicsFallBackQuietly) {
+  remill::InstructionLifter lifter(arch.get(), intrinsics);
+  remill::LiftStatistics stats;
+  lifter.SetNativeAtomics(true);
+  lifter.SetStatistics(&stats);
+
+  const auto block = DefineTrace("lock_add");
+  auto lock_add = Decode(0x1000, "\xf0\x48\x01\x18");
+  for (auto i = 0; i < 2; ++i) {
+    EXPECT_EQ(remill::kLiftedInstruction,
+              lifter.LiftIntoBlock(lock_add, block));
+  }
+  EXPECT_EQ(2u, stats.num_isel_lookups);
+  EXPECT_EQ(0u, stats.num_missing_isels);
+}
+
+// Only AArch64 has a `MONITOR_VALUE` variable in its lifted functions.
+TEST_F(LiftedIRTest, NoMonitorValueVariable) {
+  const auto basic_block = module->getFunction("__remill_basic_block");
+  ASSERT_NE(nullptr, basic_block);
+  for (auto &inst : basic_block->getEntryBlock()) {
+    EXPECT_NE("MONITOR_VALUE", inst.getName().str());
+  }
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  google::InitGoogleLogging(argv[0]);
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
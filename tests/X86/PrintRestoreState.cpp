@@ -0,0 +1,163 @@
+/*
+ * Copyright (c) 2020 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <cstddef>
+#include <cstdio>
+
+#include "remill/Arch/X86/Runtime/State.h"
+
+namespace {
+
+// A general purpose register, by its 64- and 32-bit names.
+struct GPR {
+  const char *name64;
+  const char *name32;  // `nullptr` if it's only in 64-bit mode.
+  size_t offset;
+};
+
+// The stack pointer isn't restored; the code that includes the restore code
+// decides which stack it runs on.
+static const GPR kGPRs[] = {
+    {"RAX", "EAX", offsetof(State, gpr.rax)},
+    {"RBX", "EBX", offsetof(State, gpr.rbx)},
+    {"RCX", "ECX", offsetof(State, gpr.rcx)},
+    {"RDX", "EDX", offsetof(State, gpr.rdx)},
+    {"RSI", "ESI", offsetof(State, gpr.rsi)},
+    {"RDI", "EDI", offsetof(State, gpr.rdi)},
+    {"RBP", "EBP", offsetof(State, gpr.rbp)},
+    {"R8", nullptr, offsetof(State, gpr.r8)},
+    {"R9", nullptr, offsetof(State, gpr.r9)},
+    {"R10", nullptr, offsetof(State, gpr.r10)},
+    {"R11", nullptr, offsetof(State, gpr.r11)},
+    {"R12", nullptr, offsetof(State, gpr.r12)},
+    {"R13", nullptr, offsetof(State, gpr.r13)},
+    {"R14", nullptr, offsetof(State, gpr.r14)},
+    {"R15", nullptr, offsetof(State, gpr.r15)},
+};
+
+// Print the move `format` of each of the vector registers `[begin, end)`.
+static void PrintVecMoves(const char *format, unsigned begin, unsigned end) {
+  for (auto i = begin; i < end; ++i) {
+    printf(format, i, offsetof(State, vec[0]) + i * sizeof(VectorReg));
+  }
+}
+
+// OR the byte-sized flag at `offset` into bit `bit` of `EAX`.
+static void PrintFoldFlag(size_t offset, unsigned bit) {
+  printf("movzx ECX, BYTE PTR [RIP + STATE_PTR + %lu]\n", offset);
+  if (bit) {
+    printf("shl ECX, %u\n", bit);
+  }
+  printf("or EAX, ECX\n");
+}
+
+}  // namespace
+
+// This is the inverse of `PrintSaveState.cpp`, and is used by the
+// `print_x86_save_state_asm.sh` script. The generated code loads the native
+// registers from the `State` structure at `STATE_PTR`, and clobbers the
+// stack slot below `RSP` through `gStackSaveSlot`, just like the save code.
+// The expanded flags (`aflag` and `sw`) are folded back into `rflag` and the
+// FPU status word first, because that is where lifted code keeps them.
+//
+// The segment registers and the stack pointer are not restored.
+int main(void) {
+
+  printf("/* Auto-generated file! Don't modify! */\n\n");
+
+  // Fold the FPU status word flags back into the FPU status word.
+  printf("movzx EAX, WORD PTR [RIP + STATE_PTR + %lu]\n",
+         offsetof(State, x87.fxsave.swd));
+  printf("and EAX, %d\n", ~0x473f);
+  PrintFoldFlag(offsetof(State, sw.c0), 8);
+  PrintFoldFlag(offsetof(State, sw.c1), 9);
+  PrintFoldFlag(offsetof(State, sw.c2), 10);
+  PrintFoldFlag(offsetof(State, sw.c3), 14);
+  PrintFoldFlag(offsetof(State, sw.ie), 0);
+  PrintFoldFlag(offsetof(State, sw.de), 1);
+  PrintFoldFlag(offsetof(State, sw.ze), 2);
+  PrintFoldFlag(offsetof(State, sw.oe), 3);
+  PrintFoldFlag(offsetof(State, sw.ue), 4);
+  PrintFoldFlag(offsetof(State, sw.pe), 5);
+  printf("mov WORD PTR [RIP + STATE_PTR + %lu], AX\n",
+         offsetof(State, x87.fxsave.swd));
+
+  // Restore the native FPU state.
+  printf("#if 64 == ADDRESS_SIZE_BITS\n");
+  printf("fxrstor64 [RIP + STATE_PTR + %lu]\n", offsetof(State, x87));
+  printf("#else\n");
+  printf("fxrstor [RIP + STATE_PTR + %lu]\n", offsetof(State, x87));
+  printf("#endif\n");
+
+  // Restore the vector registers at their widest.
+  printf("#if HAS_FEATURE_AVX512\n");
+  PrintVecMoves("vmovdqu64 ZMM%u, [RIP + STATE_PTR + %lu]\n", 0, 8);
+  printf("#if 64 == ADDRESS_SIZE_BITS\n");
+  PrintVecMoves("vmovdqu64 ZMM%u, [RIP + STATE_PTR + %lu]\n", 8, 32);
+  printf("#endif  /* 64 == ADDRESS_SIZE_BITS */\n");
+  printf("#elif HAS_FEATURE_AVX\n");
+  PrintVecMoves("vmovdqu YMM%u, [RIP + STATE_PTR + %lu]\n", 0, 8);
+  printf("#if 64 == ADDRESS_SIZE_BITS\n");
+  PrintVecMoves("vmovdqu YMM%u, [RIP + STATE_PTR + %lu]\n", 8, 16);
+  printf("#endif  /* 64 == ADDRESS_SIZE_BITS */\n");
+  printf("#else\n");
+  PrintVecMoves("movdqu XMM%u, [RIP + STATE_PTR + %lu]\n", 0, 8);
+  printf("#if 64 == ADDRESS_SIZE_BITS\n");
+  PrintVecMoves("movdqu XMM%u, [RIP + STATE_PTR + %lu]\n", 8, 16);
+  printf("#endif  /* 64 == ADDRESS_SIZE_BITS */\n");
+  printf("#endif  /* HAS_FEATURE_AVX512 */\n");
+
+  // Fold the arithmetic flags back into the native flags.
+  printf("mov EAX, DWORD PTR [RIP + STATE_PTR + %lu]\n",
+         offsetof(State, rflag));
+  printf("and EAX, %d\n", ~0xcd5);
+  PrintFoldFlag(offsetof(State, aflag.cf), 0);
+  PrintFoldFlag(offsetof(State, aflag.pf), 2);
+  PrintFoldFlag(offsetof(State, aflag.af), 4);
+  PrintFoldFlag(offsetof(State, aflag.zf), 6);
+  PrintFoldFlag(offsetof(State, aflag.sf), 7);
+  PrintFoldFlag(offsetof(State, aflag.df), 10);
+  PrintFoldFlag(offsetof(State, aflag.of), 11);
+  printf("mov DWORD PTR [RIP + STATE_PTR + %lu], EAX\n",
+         offsetof(State, rflag));
+
+  // Save whatever is on the stack that would get clobbered by the `PUSH`,
+  // restore the flags, and then restore the stack. Nothing after this
+  // changes the flags.
+  printf("lea RSP, [RSP - 8]\n");
+  printf("pop QWORD PTR [RIP + SYMBOL(gStackSaveSlot)]\n");
+  printf("push QWORD PTR [RIP + STATE_PTR + %lu]\n", offsetof(State, rflag));
+  printf("popfq\n");
+  printf("push QWORD PTR [RIP + SYMBOL(gStackSaveSlot)]\n");
+  printf("lea RSP, [RSP + 8]\n");
+
+  // Restore the general purpose registers last, as `EAX` and `ECX` are used
+  // as scratch registers above.
+  printf("#if 64 == ADDRESS_SIZE_BITS\n");
+  for (const auto &gpr : kGPRs) {
+    printf("mov %s, [RIP + STATE_PTR + %lu]\n", gpr.name64, gpr.offset);
+  }
+  printf("#else\n");
+  for (const auto &gpr : kGPRs) {
+    if (gpr.name32) {
+      printf("mov %s, [RIP + STATE_PTR + %lu]\n", gpr.name32, gpr.offset);
+    }
+  }
+  printf("#endif  /* 64 == ADDRESS_SIZE_BITS */\n");
+
+  return 0;
+}
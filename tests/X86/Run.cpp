@@ -24,6 +24,8 @@
 #include <signal.h>
 #include <ucontext.h>
 
+#include <algorithm>
+#include <chrono>
 #include <cmath>
 #include <cstdint>
 #include <cstdlib>
@@ -48,6 +50,11 @@ DEFINE_bool(
     "Trace values of fxsave.cs and fxsave.ds for 32-bit instructions. Disabled "
     "by default since it is commonly broken in virtualized environments.");
 
+DEFINE_uint64(benchmark_iterations, 0,
+              "If non-zero, then instead of comparing the lifted and native "
+              "states, time this many native and lifted executions of each "
+              "test case, and print how much slower the lifted code is.");
+
 namespace {
 
 struct alignas(128) Stack {
@@ -215,6 +222,44 @@ NEVER_INLINE Memory *__remill_write_memory_f128(Memory *, addr_t, double) {
   return nullptr;
 }
 
+#define MAKE_RW_VEC_MEMORY(size) \
+  NEVER_INLINE vec##size##_t __remill_read_memory_v##size(Memory *, \
+                                                          addr_t addr) { \
+    return AccessMemory<vec##size##_t>(addr); \
+  } \
+  NEVER_INLINE Memory *__remill_write_memory_v##size(Memory *, addr_t addr, \
+                                                     vec##size##_t in) { \
+    AccessMemory<vec##size##_t>(addr) = in; \
+    return nullptr; \
+  }
+
+MAKE_RW_VEC_MEMORY(128)
+MAKE_RW_VEC_MEMORY(256)
+MAKE_RW_VEC_MEMORY(512)
+
+#define MAKE_BULK_MEMORY(size) \
+  NEVER_INLINE Memory *__remill_copy_memory_##size( \
+      Memory *memory, addr_t dst, addr_t src, addr_t count) { \
+    for (addr_t i = 0; i < count; ++i) { \
+      const addr_t offset = i * sizeof(uint##size##_t); \
+      AccessMemory<uint##size##_t>(dst + offset) = \
+          AccessMemory<uint##size##_t>(src + offset); \
+    } \
+    return memory; \
+  } \
+  NEVER_INLINE Memory *__remill_fill_memory_##size( \
+      Memory *memory, addr_t dst, uint##size##_t val, addr_t count) { \
+    for (addr_t i = 0; i < count; ++i) { \
+      AccessMemory<uint##size##_t>(dst + i * sizeof(uint##size##_t)) = val; \
+    } \
+    return memory; \
+  }
+
+MAKE_BULK_MEMORY(8)
+MAKE_BULK_MEMORY(16)
+MAKE_BULK_MEMORY(32)
+MAKE_BULK_MEMORY(64)
+
 
 Memory *__remill_compare_exchange_memory_8(Memory *memory, addr_t addr,
                                            uint8_t &expected, uint8_t desired) {
@@ -585,9 +630,36 @@ inline static bool operator!=(const T &a, const T &b) {
   return !!memcmp(&a, &b, sizeof(a));
 }
 
+// Describe the run of the test case `info` with the arguments `args` and the
+// initial flags `flags`. This is only done for the messages of failing and
+// logged runs, as building the descriptions of every run otherwise dominates
+// the time taken by a passing test.
+static std::string DescribeRun(const test::TestInfo *info,
+                               const uint64_t *args, Flags flags) {
+  std::stringstream ss;
+  ss << info->test_name << " with";
+  if (1 <= info->num_args) {
+    ss << " ARG1=0x" << std::hex << args[0];
+    if (2 <= info->num_args) {
+      ss << " ARG2=0x" << std::hex << args[1];
+      if (3 <= info->num_args) {
+        ss << " ARG3=0x" << std::hex << args[2];
+      }
+    }
+  }
+  ss << std::dec << " and"
+     << " CF=" << flags.cf << " PF=" << flags.pf << " AF=" << flags.af
+     << " ZF=" << flags.zf << " SF=" << flags.sf << " DF=" << flags.df
+     << " OF=" << flags.of;
+  return ss.str();
+}
+
+// Run the test case `info` natively and lifted, with the arguments `args` and
+// the initial flags `flags`, and compare the resulting states and stacks.
+//
+// NOTE(pag): The caller must have set `gUnsupportedInstrBuf`.
 static void RunWithFlags(const test::TestInfo *info, Flags flags,
-                         std::string desc, uint64_t arg1, uint64_t arg2,
-                         uint64_t arg3) {
+                         const uint64_t *args) {
 
   // Can't fit a 64-bit stack address into a 32-bit register.
   auto stack_addr = reinterpret_cast<uintptr_t>(&(gLiftedStack.bytes[0]));
@@ -596,11 +668,7 @@ static void RunWithFlags(const test::TestInfo *info, Flags flags,
     return;
   }
 
-  DLOG(INFO) << "Testing instruction: " << info->test_name << ": " << desc;
-  if (sigsetjmp(gUnsupportedInstrBuf, true)) {
-    DLOG(INFO) << "Unsupported instruction " << info->test_name;
-    return;
-  }
+  DLOG(INFO) << "Testing instruction: " << DescribeRun(info, args, flags);
 
   memcpy(&gLiftedStack, &gRandomStack, sizeof(gLiftedStack));
   memset(&gLiftedState, 0, sizeof(gLiftedState));
@@ -623,7 +691,7 @@ static void RunWithFlags(const test::TestInfo *info, Flags flags,
   auto native_test_faulted = false;
   if (!sigsetjmp(gJmpBuf, true)) {
     gInNativeTest = true;
-    InvokeTestCase(arg1, arg2, arg3);
+    InvokeTestCase(args[0], args[1], args[2]);
   } else {
     native_test_faulted = true;
   }
@@ -690,6 +758,27 @@ static void RunWithFlags(const test::TestInfo *info, Flags flags,
   lifted_state->x87.fxsave.fop = 0;
   native_state->x87.fxsave.fop = 0;
 
+#if HAS_FEATURE_FAST_X87
+
+  // The fast x87 semantics don't track the exception flags, or the last
+  // instruction pointer, so only compare the values and condition codes.
+  lifted_state->x87.fxsave.ip = 0;
+  native_state->x87.fxsave.ip = 0;
+#  if 32 == ADDRESS_SIZE_BITS
+  lifted_state->x87.fxsave.cs = {0};
+  native_state->x87.fxsave.cs = {0};
+#  endif
+
+  for (auto state : {lifted_state, native_state}) {
+    state->sw.pe = 0;
+    state->sw.ue = 0;
+    state->sw.oe = 0;
+    state->sw.ze = 0;
+    state->sw.de = 0;
+    state->sw.ie = 0;
+  }
+#endif
+
   // Don't compare the tag words.
   lifted_state->x87.fxsave.ftw.flat = 0;
   native_state->x87.fxsave.ftw.flat = 0;
@@ -764,6 +853,17 @@ static void RunWithFlags(const test::TestInfo *info, Flags flags,
     }
   }
 
+  // Nearly every run matches, and so compare the states and stacks in bulk,
+  // and only compare them field by field, with descriptive failures, when
+  // they differ.
+  const auto states_match = gLiftedState == gNativeState;
+  const auto stacks_match = gLiftedStack == gNativeStack;
+  if (states_match && stacks_match) {
+    return;
+  }
+
+  const auto desc = DescribeRun(info, args, flags);
+
   // Compare the register states.
   for (auto i = 0UL; i < kNumVecRegisters; ++i) {
     EXPECT_EQ(lifted_state->vec[i], native_state->vec[i]);
@@ -784,7 +884,7 @@ static void RunWithFlags(const test::TestInfo *info, Flags flags,
       << lifted_state->x87.fxsave.swd.flat << ", native is "
       << native_state->x87.fxsave.swd.flat << std::dec;
 
-  if (gLiftedState != gNativeState) {
+  if (!states_match) {
     EXPECT_TRUE(false) << "States did not match for " << desc;
 
 #define DIFF(name, a) EXPECT_EQ(lifted_state->a, native_state->a)
@@ -871,7 +971,7 @@ static void RunWithFlags(const test::TestInfo *info, Flags flags,
     }
   }
 
-  if (gLiftedStack != gNativeStack) {
+  if (!stacks_match) {
     LOG(ERROR) << "Stacks did not match for " << desc;
 
     for (size_t i = 0; i < sizeof(gLiftedStack.bytes); ++i) {
@@ -890,21 +990,17 @@ static void RunWithFlags(const test::TestInfo *info, Flags flags,
 
 TEST_P(InstrTest, SemanticsMatchNative) {
   auto info = GetParam();
+
+  // An unsupported instruction would be unsupported in every run, and so the
+  // whole test case is skipped on the first one. This also saves setting the
+  // jump buffer, and its signal mask, on every run.
+  if (sigsetjmp(gUnsupportedInstrBuf, true)) {
+    DLOG(INFO) << "Unsupported instruction " << info->test_name;
+    return;
+  }
+
   for (auto args = info->args_begin; args < info->args_end;
        args += info->num_args) {
-    std::stringstream ss;
-    ss << info->test_name << " with";
-    if (1 <= info->num_args) {
-      ss << " ARG1=0x" << std::hex << args[0];
-      if (2 <= info->num_args) {
-        ss << " ARG2=0x" << std::hex << args[1];
-        if (3 <= info->num_args) {
-          ss << " ARG3=0x" << std::hex << args[3];
-        }
-      }
-    }
-    auto desc = ss.str();
-
     union EFLAGS {
       uint32_t flat;
       struct {
@@ -926,12 +1022,6 @@ TEST_P(InstrTest, SemanticsMatchNative) {
       EFLAGS eflags;
       eflags.flat = i;
 
-      std::stringstream ss2;
-      ss2 << desc << " and"
-          << " CF=" << eflags.cf << " PF=" << eflags.pf << " AF=" << eflags.af
-          << " ZF=" << eflags.zf << " SF=" << eflags.sf << " DF=" << eflags.df
-          << " OF=" << eflags.of;
-
       Flags flags = gRflagsInitial;
       flags.cf = eflags.cf;
       flags.pf = eflags.pf;
@@ -941,7 +1031,7 @@ TEST_P(InstrTest, SemanticsMatchNative) {
       flags.df = eflags.df;
       flags.of = eflags.of;
 
-      RunWithFlags(info, flags, ss2.str(), args[0], args[1], args[2]);
+      RunWithFlags(info, flags, args);
     }
   }
 }
@@ -949,6 +1039,110 @@ TEST_P(InstrTest, SemanticsMatchNative) {
 INSTANTIATE_TEST_SUITE_P(GeneralInstrTest, InstrTest,
                          testing::ValuesIn(gTests));
 
+// Time `FLAGS_benchmark_iterations` native and lifted executions of the test
+// case `info`, with its first arguments and the initial flags. Returns `false`
+// if the test case faulted, or if its instruction isn't supported.
+static bool BenchmarkTestCase(const test::TestInfo *info, double &native_secs,
+                              double &lifted_secs) {
+  static std::aligned_storage<sizeof(X86State), alignof(X86State)>::type
+      initial_state;
+
+  auto stack_addr = reinterpret_cast<uintptr_t>(&(gLiftedStack.bytes[0]));
+  if ((sizeof(addr_t) < sizeof(uintptr_t) &&
+       static_cast<uintptr_t>(static_cast<addr_t>(stack_addr)) !=
+           stack_addr) ||
+      info->args_begin >= info->args_end) {
+    return false;
+  }
+
+  if (sigsetjmp(gUnsupportedInstrBuf, true)) {
+    return false;
+  }
+
+  const auto args = info->args_begin;
+  const auto iterations = FLAGS_benchmark_iterations;
+  auto lifted_func = gTranslatedFuncs[info->test_begin];
+  auto lifted_state = reinterpret_cast<X86State *>(&gLiftedState);
+
+  gTestToRun = info->test_begin;
+  gStackSwitcher = &(gLiftedStack._redzone2[0]);
+  gRflagsForTest = gRflagsInitial;
+
+  if (sigsetjmp(gJmpBuf, true)) {
+    ResetFlags();
+    return false;
+  }
+
+  // The first native run records the state from which every lifted run
+  // starts.
+  ResetFlags();
+  memcpy(&gLiftedStack, &gRandomStack, sizeof(gLiftedStack));
+  gInNativeTest = true;
+  InvokeTestCase(args[0], args[1], args[2]);
+  memcpy(&initial_state, &gLiftedState, sizeof(initial_state));
+
+  const auto native_start = std::chrono::steady_clock::now();
+  for (uint64_t i = 0; i < iterations; ++i) {
+    memcpy(&gLiftedStack, &gRandomStack, sizeof(gLiftedStack));
+    InvokeTestCase(args[0], args[1], args[2]);
+  }
+  const auto native_end = std::chrono::steady_clock::now();
+  ResetFlags();
+
+  gInNativeTest = false;
+  std::fesetenv(FE_DFL_ENV);
+  FixGlibcMxcsrBug();
+  const auto lifted_start = std::chrono::steady_clock::now();
+  for (uint64_t i = 0; i < iterations; ++i) {
+    memcpy(&gLiftedStack, &gRandomStack, sizeof(gLiftedStack));
+    memcpy(&gLiftedState, &initial_state, sizeof(gLiftedState));
+    lifted_state->gpr.rip.aword = static_cast<addr_t>(info->test_begin);
+    (void) lifted_func(*lifted_state,
+                       static_cast<addr_t>(lifted_state->gpr.rip.aword),
+                       nullptr);
+  }
+  const auto lifted_end = std::chrono::steady_clock::now();
+  ResetFlags();
+
+  const std::chrono::duration<double> native_elapsed =
+      native_end - native_start;
+  const std::chrono::duration<double> lifted_elapsed =
+      lifted_end - lifted_start;
+  native_secs = native_elapsed.count();
+  lifted_secs = lifted_elapsed.count();
+  return true;
+}
+
+// Benchmark every test case, printing the time per execution of its native
+// and lifted code, and the slowdown of the lifted code, as CSV.
+static void RunBenchmarks(void) {
+  const auto iterations = static_cast<double>(FLAGS_benchmark_iterations);
+  double log_slowdowns = 0;
+  unsigned num_benchmarked = 0;
+
+  std::cout << "test,native_ns,lifted_ns,slowdown" << std::endl;
+  for (auto info : gTests) {
+    double native_secs = 0;
+    double lifted_secs = 0;
+    if (!BenchmarkTestCase(info, native_secs, lifted_secs)) {
+      LOG(WARNING) << "Not benchmarking " << info->test_name;
+      continue;
+    }
+    const auto slowdown = lifted_secs / std::max(native_secs, 1e-12);
+    std::cout << info->test_name << ',' << (native_secs * 1e9 / iterations)
+              << ',' << (lifted_secs * 1e9 / iterations) << ',' << slowdown
+              << std::endl;
+    log_slowdowns += std::log(std::max(slowdown, 1e-12));
+    num_benchmarked += 1;
+  }
+
+  if (num_benchmarked) {
+    std::cerr << "Geometric mean slowdown of " << num_benchmarked
+              << " test cases: " << std::exp(log_slowdowns / num_benchmarked)
+              << std::endl;
+  }
+}
+
 // Recover from a signal.
 static void RecoverFromError(int sig_num, siginfo_t *, void *context_) {
   if (gInNativeTest) {
@@ -1082,5 +1276,9 @@ int main(int argc, char **argv) {
   testing::InitGoogleTest(&argc, argv);
 
   SetupSignals();
+  if (FLAGS_benchmark_iterations) {
+    RunBenchmarks();
+    return EXIT_SUCCESS;
+  }
   return RUN_ALL_TESTS();
 }